@@ -0,0 +1,117 @@
+/* Header includes -----------------------------------------------------------*/
+#include "adc_filter.h"
+#include <string.h>
+
+/* Private functions ---------------------------------------------------------*/
+/* Codes are left aligned to 16 bits, then offset binary to two's
+   complement flips the top bit, two samples per word; blocks are whole
+   cache lines, so word aligned. A code shifted left stays inside its half
+   since it is below 1 << (16 - align). */
+static void adc_filter_to_q15(uint16_t *samples, uint32_t len, uint32_t align)
+{
+  uint32_t *w = (uint32_t *)samples;
+  uint32_t i;
+
+  for(i = 0U; i < (len / 2U); i++)
+  {
+    w[i] = (w[i] << align) ^ 0x80008000U;
+  }
+}
+
+/* Left shift that brings the largest code of the pipe to 16 bits:
+   resolution, then oversampling sum and right shift */
+static uint32_t adc_filter_align(const adc_pipe_t *p)
+{
+  uint32_t full;
+
+  if((p->resolution < 8U) || (p->resolution > 16U) || ((p->resolution & 1U) != 0U) ||
+     (p->ratio == 0U) || (p->ratio > 1024U))
+  {
+    return 32U;
+  }
+  full = ((1UL << p->resolution) - 1U) * p->ratio;
+  full >>= (p->ratio > 1U) ? p->shift : 0U;
+  if((full == 0U) || (full > 0xFFFFU))
+  {
+    return 32U;
+  }
+  return __CLZ(full) - 16U;
+}
+
+static void adc_filter_reset(adc_filter_t *f)
+{
+  if(f->fir != NULL)
+  {
+    memset(f->fir->state, 0, (f->fir->taps - 1U) * sizeof(*f->fir->state));
+  }
+  if(f->biquad != NULL)
+  {
+    memset(f->biquad->state, 0, 4U * f->biquad->stages * sizeof(*f->biquad->state));
+  }
+}
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef adc_filter_init(adc_filter_t *f)
+{
+  if((f->fir != NULL) && ((f->fir->factor == 0U) || ((ADC_PIPE_BLOCK_SAMPLES % f->fir->factor) != 0U)))
+  {
+    return HAL_ERROR;
+  }
+  f->align = adc_filter_align(f->pipe);
+  if(f->align > 8U)
+  {
+    return HAL_ERROR;
+  }
+  adc_filter_reset(f);
+  f->seq = 0U;
+  f->blocks = 0U;
+  f->gaps = 0U;
+  return HAL_OK;
+}
+
+uint32_t adc_filter_poll(adc_filter_t *f)
+{
+  const adc_pipe_block_t *b;
+  int16_t *x;
+  uint32_t len;
+  uint32_t count = 0U;
+
+  while((b = adc_pipe_get(f->pipe)) != NULL)
+  {
+    if(b->seq != f->seq)
+    {
+      adc_filter_reset(f);
+      f->gaps++;
+    }
+    f->seq = b->seq + 1U;
+
+    adc_filter_to_q15(b->samples, ADC_PIPE_BLOCK_SAMPLES, f->align);
+    x = (int16_t *)b->samples;
+    len = ADC_PIPE_BLOCK_SAMPLES;
+    if(f->fir != NULL)
+    {
+      if(f->fir->factor > 1U)
+      {
+        dsp_decimate_q15(f->fir, x, x, len);
+        len /= f->fir->factor;
+      }
+      else
+      {
+        dsp_fir_q15(f->fir, x, x, len);
+      }
+    }
+    if(f->biquad != NULL)
+    {
+      dsp_biquad_q15(f->biquad, x, x, len);
+    }
+    if(f->sink != NULL)
+    {
+      f->sink(f, x, len, b->seq);
+    }
+
+    adc_pipe_release(f->pipe, b);
+    f->blocks++;
+    count++;
+  }
+  return count;
+}
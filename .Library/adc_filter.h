@@ -0,0 +1,58 @@
+#ifndef __ADC_FILTER_H
+#define __ADC_FILTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+#include "adc_pipe.h"
+#include "dsp.h"
+
+/* Filter stage behind the ADC pipeline: takes each full block, turns the
+   unsigned ADC codes into Q15 (code - 32768) and runs an optional FIR or
+   FIR decimator followed by an optional biquad cascade, all in place in
+   the block, so nothing is copied but the FIR history. Codes below 16 bits
+   (resolution, oversampling and shift of the pipe) are left aligned first,
+   so Q15 full scale is ADC full scale at any resolution. The sink gets the
+   filtered samples and the block goes back to the pool when it returns.
+
+   A gap in the block sequence (the pipeline dropped a block) would splice
+   two unrelated pieces of signal together, so the filter history is
+   cleared first and the gap counted.
+
+   Runs in the consumer task: call adc_filter_poll() from the loop or when
+   the pipe callback signals a block. */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct adc_filter_s adc_filter_t;
+typedef void (*adc_filter_sink_t)(adc_filter_t *f, const int16_t *samples, uint32_t len, uint32_t seq);
+
+struct adc_filter_s
+{
+  adc_pipe_t *pipe;
+  dsp_fir_q15_t *fir;           /* NULL: none; factor > 1 decimates */
+  dsp_biquad_q15_t *biquad;     /* NULL: none, runs after the FIR */
+  adc_filter_sink_t sink;       /* may be NULL */
+  void *context;
+
+  uint32_t align;               /* left shift to 16-bit codes, from the pipe */
+  uint32_t seq;                 /* next block expected */
+  uint32_t blocks;
+  uint32_t gaps;
+};
+
+/* f->pipe and the filters (initialized, FIR state for
+   DSP_FIR_STATE(taps, ADC_PIPE_BLOCK_SAMPLES)) must be set, and the pipe
+   settings filled in. HAL_ERROR if the block length is not a multiple of
+   the decimation factor or the pipe's codes do not fit 16 bits. */
+HAL_StatusTypeDef adc_filter_init(adc_filter_t *f);
+/* Filter every block waiting in the pipe, returns how many */
+uint32_t adc_filter_poll(adc_filter_t *f);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,457 @@
+/* Header includes -----------------------------------------------------------*/
+#include "adc_pipe.h"
+#include "dma_cache.h"
+#include <string.h>
+
+/* Private macro -------------------------------------------------------------*/
+/* ADC clock divider, CCR PRESC code (1: adc_ker_ck / 2). The kernel clock
+   stays at its reset source, PLL2 P, which clock_profile runs at 100 MHz. */
+#ifndef ADC_PIPE_CLOCK_PRESC
+#define ADC_PIPE_CLOCK_PRESC      1U
+#endif
+
+/* Upper bound of flag polling iterations (linearity calibration is the
+   longest, well below 1 ms) */
+#define ADC_PIPE_SPIN_LIMIT       0x100000U
+
+#define ADC_PIPE_MASK             (ADC_PIPE_BLOCKS - 1U)
+#define ADC_PIPE_BLOCK_BYTES      (ADC_PIPE_BLOCK_SAMPLES * 2U)
+
+/* CR bits that start something when written as 1, kept 0 when setting
+   other bits */
+#define ADC_PIPE_CR_RS            (ADC_CR_ADCAL | ADC_CR_JADSTP | ADC_CR_ADSTP | ADC_CR_JADSTART | \
+                                   ADC_CR_ADSTART | ADC_CR_ADDIS | ADC_CR_ADEN)
+
+/* CCR: dual regular interleaved, one 32-bit word per pair (DAMDF 32/10 bits) */
+#define ADC_PIPE_CCR_DUAL         (7UL << ADC_CCR_DUAL_Pos)
+#define ADC_PIPE_CCR_DAMDF        (2UL << ADC_CCR_DAMDF_Pos)
+
+/* Private variables ---------------------------------------------------------*/
+#if defined ( __ICCARM__ )
+#pragma location = ADC_PIPE_POOL_SECTION
+static __ALIGNED(32) uint16_t adc_pipe_pool[ADC_PIPE_BLOCKS][ADC_PIPE_BLOCK_SAMPLES];
+#else
+static __ALIGNED(32) uint16_t adc_pipe_pool[ADC_PIPE_BLOCKS][ADC_PIPE_BLOCK_SAMPLES] __attribute__((section(ADC_PIPE_POOL_SECTION)));
+#endif
+
+/* ADC1/ADC2 is the only dual pair, so there is at most one pipe */
+static adc_pipe_t *adc_pipe_active = NULL;
+
+/* CCR PRESC code to divider */
+static const uint16_t adc_pipe_presc_div[12] = { 1U, 2U, 4U, 6U, 8U, 10U, 12U, 16U, 32U, 64U, 128U, 256U };
+
+/* Private functions ---------------------------------------------------------*/
+static adc_pipe_t *adc_pipe_find(const DMA_HandleTypeDef *hdma)
+{
+  adc_pipe_t *p = adc_pipe_active;
+
+  return ((p != NULL) && (p->hdma == hdma)) ? p : NULL;
+}
+
+static HAL_StatusTypeDef adc_pipe_wait(__IO uint32_t *reg, uint32_t mask, uint32_t value)
+{
+  uint32_t spin = ADC_PIPE_SPIN_LIMIT;
+
+  while((*reg & mask) != value)
+  {
+    if(--spin == 0U)
+    {
+      return HAL_TIMEOUT;
+    }
+  }
+  return HAL_OK;
+}
+
+static void adc_pipe_cr_set(ADC_TypeDef *adc, uint32_t bits)
+{
+  adc->CR = (adc->CR & ~ADC_PIPE_CR_RS) | bits;
+}
+
+/* CFGR RES code; revision V moved 14, 12 and 8 bits to new codes, the old
+   14 and 12 bit codes became the low power variants */
+static uint32_t adc_pipe_res(uint32_t bits)
+{
+  uint32_t v = (HAL_GetREVID() > REV_ID_Y) ? 1U : 0U;
+
+  switch(bits)
+  {
+  case 16U:
+    return 0U;
+  case 14U:
+    return (v != 0U) ? 5U : 1U;
+  case 12U:
+    return (v != 0U) ? 6U : 2U;
+  case 10U:
+    return 3U;
+  case 8U:
+    return (v != 0U) ? 7U : 4U;
+  default:
+    return 0xFFU;
+  }
+}
+
+/* CR BOOST for the ADC clock: revision Y has one bit for above 20 MHz,
+   revision V ranges of half the clock */
+static uint32_t adc_pipe_boost(void)
+{
+  uint32_t f = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_ADC) / adc_pipe_presc_div[ADC_PIPE_CLOCK_PRESC];
+
+  if(HAL_GetREVID() <= REV_ID_Y)
+  {
+    return (f > 20000000UL) ? ADC_CR_BOOST_0 : 0U;
+  }
+  f /= 2U;
+  if(f <= 6250000UL)
+  {
+    return 0U;
+  }
+  if(f <= 12500000UL)
+  {
+    return ADC_CR_BOOST_0;
+  }
+  if(f <= 25000000UL)
+  {
+    return ADC_CR_BOOST_1;
+  }
+  return ADC_CR_BOOST_1 | ADC_CR_BOOST_0;
+}
+
+/* Out of deep power down, regulator on, calibrated and set up for
+   continuous conversion of the channel; the ADC stays disabled */
+static HAL_StatusTypeDef adc_pipe_config(adc_pipe_t *p, ADC_TypeDef *adc, uint32_t boost)
+{
+  __IO uint32_t wait;
+  uint32_t ch = p->channel;
+
+  adc->CR &= ~(ADC_PIPE_CR_RS | ADC_CR_DEEPPWD);
+  adc_pipe_cr_set(adc, ADC_CR_ADVREGEN);
+  /* 10 us regulator start-up, the way the HAL counts it */
+  wait = (SystemCoreClock / (100000UL * 2UL)) + 1U;
+  while(wait != 0U)
+  {
+    wait--;
+  }
+  adc->CR = (adc->CR & ~(ADC_PIPE_CR_RS | ADC_CR_BOOST)) | boost;
+
+  /* Offset and linearity, single ended */
+  adc->CR &= ~(ADC_PIPE_CR_RS | ADC_CR_ADCALDIF);
+  adc_pipe_cr_set(adc, ADC_CR_ADCALLIN);
+  adc_pipe_cr_set(adc, ADC_CR_ADCAL);
+  if(adc_pipe_wait(&adc->CR, ADC_CR_ADCAL, 0U) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  /* Software start, continuous, keep converting through an overrun (the
+     pipe only counts it) */
+  adc->CFGR = (adc_pipe_res(p->resolution) << ADC_CFGR_RES_Pos) | ADC_CFGR_CONT | ADC_CFGR_OVRMOD |
+              ADC_CFGR_DMNGT;
+  adc->CFGR2 = (p->ratio > 1U) ? (((p->ratio - 1U) << ADC_CFGR2_OVSR_Pos) |
+                                   (p->shift << ADC_CFGR2_OVSS_Pos) | ADC_CFGR2_ROVSE) : 0U;
+
+  adc->DIFSEL &= ~(1UL << ch);
+  adc->PCSEL |= 1UL << ch;
+  adc->SQR1 = ch << ADC_SQR1_SQ1_Pos;
+  if(ch < 10U)
+  {
+    adc->SMPR1 = (adc->SMPR1 & ~(7UL << (3U * ch))) | (p->sampling_time << (3U * ch));
+  }
+  else
+  {
+    adc->SMPR2 = (adc->SMPR2 & ~(7UL << (3U * (ch - 10U)))) | (p->sampling_time << (3U * (ch - 10U)));
+  }
+  return HAL_OK;
+}
+
+static HAL_StatusTypeDef adc_pipe_disable(ADC_TypeDef *adc)
+{
+  if((adc->CR & ADC_CR_ADEN) == 0U)
+  {
+    return HAL_OK;
+  }
+  adc_pipe_cr_set(adc, ADC_CR_ADDIS);
+  return adc_pipe_wait(&adc->CR, ADC_CR_ADEN, 0U);
+}
+
+static void adc_pipe_ovr_enable(void)
+{
+  ADC1->IER |= ADC_IER_OVRIE;
+  ADC2->IER |= ADC_IER_OVRIE;
+}
+
+/* Memory m (0 = M0AR) is full and the DMA has moved on to the other one.
+   Its address register may only be written while the DMA is not on it, so
+   if this interrupt came a whole block late the block is already being
+   overwritten and is dropped like one without a free replacement. */
+static void adc_pipe_complete(adc_pipe_t *p, uint32_t m)
+{
+  DMA_Stream_TypeDef *stream = (DMA_Stream_TypeDef *)p->hdma->Instance;
+  uint32_t on = ((stream->CR & DMA_SxCR_CT) != 0U) ? 1U : 0U;
+  uint32_t done = p->dma_block[m];
+  uint32_t next;
+  adc_pipe_block_t *b;
+
+  if((on == m) || (p->free_tail == p->free_head))
+  {
+    p->seq++;
+    p->stats.dropped++;
+    adc_pipe_ovr_enable();
+    return;
+  }
+
+  next = p->free[p->free_tail & ADC_PIPE_MASK];
+  p->free_tail++;
+  if(m == 0U)
+  {
+    stream->M0AR = (uint32_t)adc_pipe_pool[next];
+  }
+  else
+  {
+    stream->M1AR = (uint32_t)adc_pipe_pool[next];
+  }
+  p->dma_block[m] = (uint8_t)next;
+
+  /* Speculative reads may have pulled in lines while the DMA wrote */
+  dma_cache_invalidate(adc_pipe_pool[done], ADC_PIPE_BLOCK_BYTES);
+  b = &p->block[done];
+  b->seq = p->seq++;
+  b->overruns = p->stats.overruns - p->overruns_seen;
+  p->overruns_seen = p->stats.overruns;
+  p->ready[p->ready_head & ADC_PIPE_MASK] = (uint8_t)done;
+  p->ready_head++;
+  p->stats.blocks++;
+  adc_pipe_ovr_enable();
+
+  if(p->callback != NULL)
+  {
+    p->callback(p, b);
+  }
+}
+
+static void adc_pipe_dma_m0(DMA_HandleTypeDef *hdma)
+{
+  adc_pipe_t *p = adc_pipe_find(hdma);
+
+  if(p != NULL)
+  {
+    adc_pipe_complete(p, 0U);
+  }
+}
+
+static void adc_pipe_dma_m1(DMA_HandleTypeDef *hdma)
+{
+  adc_pipe_t *p = adc_pipe_find(hdma);
+
+  if(p != NULL)
+  {
+    adc_pipe_complete(p, 1U);
+  }
+}
+
+static void adc_pipe_dma_error(DMA_HandleTypeDef *hdma)
+{
+  adc_pipe_t *p = adc_pipe_find(hdma);
+
+  /* A FIFO error leaves the stream running, a transfer error stops it */
+  if(p != NULL)
+  {
+    p->stats.dma_errors++;
+    if((((DMA_Stream_TypeDef *)hdma->Instance)->CR & DMA_SxCR_EN) == 0U)
+    {
+      p->running = 0U;
+    }
+  }
+}
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef adc_pipe_init(adc_pipe_t *p)
+{
+  uint32_t boost;
+
+  if(((adc_pipe_active != NULL) && (adc_pipe_active != p)) || (p->hdma == NULL) ||
+     (p->channel > 19U) || (adc_pipe_res(p->resolution) == 0xFFU) || (p->sampling_time > 7U) ||
+     (p->delay > 15U) || (p->ratio == 0U) || (p->ratio > 1024U) || (p->shift > 11U))
+  {
+    return HAL_ERROR;
+  }
+
+  __HAL_RCC_ADC12_CLK_ENABLE();
+  if(((ADC1->CR & ADC_CR_ADEN) != 0U) || ((ADC2->CR & ADC_CR_ADEN) != 0U))
+  {
+    return HAL_ERROR;
+  }
+
+  /* The common clock first, BOOST depends on it */
+  ADC12_COMMON->CCR = (ADC12_COMMON->CCR & ~(ADC_CCR_CKMODE | ADC_CCR_PRESC)) |
+                      (ADC_PIPE_CLOCK_PRESC << ADC_CCR_PRESC_Pos);
+  boost = adc_pipe_boost();
+  if((adc_pipe_config(p, ADC1, boost) != HAL_OK) || (adc_pipe_config(p, ADC2, boost) != HAL_OK))
+  {
+    return HAL_ERROR;
+  }
+
+  /* Both results of a pair in one word of CDR, one DMA request per pair */
+  ADC12_COMMON->CCR = (ADC12_COMMON->CCR & ~(ADC_CCR_DUAL | ADC_CCR_DELAY | ADC_CCR_DAMDF)) |
+                      ADC_PIPE_CCR_DUAL | (p->delay << ADC_CCR_DELAY_Pos) | ADC_PIPE_CCR_DAMDF;
+
+  p->running = 0U;
+  adc_pipe_active = p;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef adc_pipe_start(adc_pipe_t *p)
+{
+  DMA_HandleTypeDef *hdma = p->hdma;
+  uint32_t i;
+
+  if(adc_pipe_active != p)
+  {
+    return HAL_ERROR;
+  }
+  if(p->running != 0U)
+  {
+    return HAL_BUSY;
+  }
+
+  for(i = 0U; i < ADC_PIPE_BLOCKS; i++)
+  {
+    p->block[i].samples = adc_pipe_pool[i];
+    p->block[i].seq = 0U;
+    p->block[i].overruns = 0U;
+  }
+  /* Blocks 0 and 1 go to the DMA, the rest are free */
+  p->dma_block[0] = 0U;
+  p->dma_block[1] = 1U;
+  for(i = 0U; i < (ADC_PIPE_BLOCKS - 2U); i++)
+  {
+    p->free[i] = (uint8_t)(i + 2U);
+  }
+  p->free_tail = 0U;
+  p->free_head = ADC_PIPE_BLOCKS - 2U;
+  p->ready_head = 0U;
+  p->ready_tail = 0U;
+  p->seq = 0U;
+  p->overruns_seen = 0U;
+  memset(&p->stats, 0, sizeof(p->stats));
+
+  /* No dirty line of the pool may be evicted over DMA data later on */
+  dma_cache_invalidate(adc_pipe_pool, sizeof(adc_pipe_pool));
+
+  hdma->XferCpltCallback = adc_pipe_dma_m0;
+  hdma->XferM1CpltCallback = adc_pipe_dma_m1;
+  hdma->XferErrorCallback = adc_pipe_dma_error;
+  hdma->XferHalfCpltCallback = NULL;
+  hdma->XferM1HalfCpltCallback = NULL;
+  hdma->XferAbortCallback = NULL;
+
+  /* In dual mode the master's ready flag covers the pair */
+  ADC1->ISR = ADC_ISR_ADRDY;
+  ADC2->ISR = ADC_ISR_ADRDY;
+  adc_pipe_cr_set(ADC2, ADC_CR_ADEN);
+  adc_pipe_cr_set(ADC1, ADC_CR_ADEN);
+  if(adc_pipe_wait(&ADC1->ISR, ADC_ISR_ADRDY, ADC_ISR_ADRDY) != HAL_OK)
+  {
+    (void)adc_pipe_disable(ADC2);
+    (void)adc_pipe_disable(ADC1);
+    return HAL_ERROR;
+  }
+  ADC1->ISR = ADC_ISR_EOC | ADC_ISR_EOS | ADC_ISR_OVR;
+  ADC2->ISR = ADC_ISR_EOC | ADC_ISR_EOS | ADC_ISR_OVR;
+
+  p->running = 1U;
+  if(HAL_DMAEx_MultiBufferStart_IT(hdma, (uint32_t)&ADC12_COMMON->CDR,
+                                   (uint32_t)adc_pipe_pool[0], (uint32_t)adc_pipe_pool[1],
+                                   ADC_PIPE_BLOCK_SAMPLES / 2U) != HAL_OK)
+  {
+    p->running = 0U;
+    (void)adc_pipe_disable(ADC2);
+    (void)adc_pipe_disable(ADC1);
+    return HAL_ERROR;
+  }
+  adc_pipe_ovr_enable();
+  /* The master starts the pair */
+  adc_pipe_cr_set(ADC1, ADC_CR_ADSTART);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef adc_pipe_stop(adc_pipe_t *p)
+{
+  uint32_t running = p->running;
+  HAL_StatusTypeDef status = HAL_OK;
+
+  if(adc_pipe_active != p)
+  {
+    return HAL_ERROR;
+  }
+
+  /* ADSTP on the master stops the pair */
+  if((ADC1->CR & ADC_CR_ADSTART) != 0U)
+  {
+    adc_pipe_cr_set(ADC1, ADC_CR_ADSTP);
+  }
+  if((adc_pipe_wait(&ADC1->CR, ADC_CR_ADSTART, 0U) != HAL_OK) ||
+     (adc_pipe_wait(&ADC2->CR, ADC_CR_ADSTART, 0U) != HAL_OK))
+  {
+    status = HAL_ERROR;
+  }
+  ADC1->IER &= ~ADC_IER_OVRIE;
+  ADC2->IER &= ~ADC_IER_OVRIE;
+  if((adc_pipe_disable(ADC1) != HAL_OK) || (adc_pipe_disable(ADC2) != HAL_OK))
+  {
+    status = HAL_ERROR;
+  }
+  /* After a transfer error the stream is already off and the abort
+     fails, which is expected */
+  if(HAL_DMA_Abort(p->hdma) != HAL_OK)
+  {
+    status = HAL_ERROR;
+  }
+  p->running = 0U;
+  return (running != 0U) ? status : HAL_OK;
+}
+
+uint32_t adc_pipe_running(const adc_pipe_t *p)
+{
+  return p->running;
+}
+
+const adc_pipe_block_t *adc_pipe_get(adc_pipe_t *p)
+{
+  uint32_t tail = p->ready_tail;
+
+  if(tail == p->ready_head)
+  {
+    return NULL;
+  }
+  p->ready_tail = tail + 1U;
+  return &p->block[p->ready[tail & ADC_PIPE_MASK]];
+}
+
+void adc_pipe_release(adc_pipe_t *p, const adc_pipe_block_t *block)
+{
+  uint32_t head = p->free_head;
+
+  /* A consumer working in place leaves dirty lines; evicted later they
+     would overwrite what the DMA writes into the block next time */
+  dma_cache_flush(block->samples, ADC_PIPE_BLOCK_BYTES);
+  p->free[head & ADC_PIPE_MASK] = (uint8_t)(block - p->block);
+  /* The interrupt may look at free_head right after the store */
+  __DMB();
+  p->free_head = head + 1U;
+}
+
+void adc_pipe_irq(adc_pipe_t *p)
+{
+  if((ADC1->ISR & ADC_ISR_OVR) != 0U)
+  {
+    ADC1->ISR = ADC_ISR_OVR;
+    ADC1->IER &= ~ADC_IER_OVRIE;
+    p->stats.overruns++;
+  }
+  if((ADC2->ISR & ADC_ISR_OVR) != 0U)
+  {
+    ADC2->ISR = ADC_ISR_OVR;
+    ADC2->IER &= ~ADC_IER_OVRIE;
+    p->stats.overruns++;
+  }
+}
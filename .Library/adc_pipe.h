@@ -0,0 +1,140 @@
+#ifndef __ADC_PIPE_H
+#define __ADC_PIPE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+
+/* ADC acquisition pipeline: ADC1 (master) and ADC2 (slave) convert the same
+   input in dual interleaved mode, so the pair samples at twice the rate of
+   one ADC. Both results of a pair are packed into one 32-bit word of the
+   common data register (master in the low half), which makes a block a
+   plain time-ordered array of 16-bit samples.
+
+   The DMA runs in double-buffer mode over a pool of ADC_PIPE_BLOCKS blocks
+   in D2 SRAM: while it fills one block, the interrupt of the previous one
+   points the idle memory address at a free block and queues the full one
+   for the consumer. Blocks go back to the pool with adc_pipe_release(), in
+   any order. When the consumer keeps every block and none is free, the
+   DMA refills the block it just completed and that block counts as
+   dropped; the sequence numbers then show the gap.
+
+     ADC_IRQHandler:          adc_pipe_irq(&pipe);
+     DMAx_Streamy_IRQHandler: HAL_DMA_IRQHandler(pipe.hdma);
+
+   ADC overruns (the DMA did not read a pair in time) are counted and
+   reported on the next block; the overrun interrupt is then off until
+   that block completes so a starved DMA cannot flood the CPU.
+
+   The ADCs are driven at register level (RM0433, ADC chapter), the HAL ADC
+   module stays off. */
+
+/* Exported constants --------------------------------------------------------*/
+/* Blocks in the pool, a power of two; two always belong to the DMA */
+#ifndef ADC_PIPE_BLOCKS
+#define ADC_PIPE_BLOCKS         4U
+#endif
+
+/* Samples per block, a multiple of 16 so blocks are whole cache lines */
+#ifndef ADC_PIPE_BLOCK_SAMPLES
+#define ADC_PIPE_BLOCK_SAMPLES  2048U
+#endif
+
+/* Block pool in D2 SRAM, where DMA1/DMA2 work, see linker file */
+#define ADC_PIPE_POOL_SECTION   ".adc_pool"
+
+/* Sampling time, ADC clock cycles (SMPR) */
+#define ADC_PIPE_SMP_1C5        0U
+#define ADC_PIPE_SMP_2C5        1U
+#define ADC_PIPE_SMP_8C5        2U
+#define ADC_PIPE_SMP_16C5       3U
+#define ADC_PIPE_SMP_32C5       4U
+#define ADC_PIPE_SMP_64C5       5U
+#define ADC_PIPE_SMP_387C5      6U
+#define ADC_PIPE_SMP_810C5      7U
+
+#if (ADC_PIPE_BLOCKS < 4U) || (ADC_PIPE_BLOCKS > 128U) || ((ADC_PIPE_BLOCKS & (ADC_PIPE_BLOCKS - 1U)) != 0U)
+#error "adc_pipe: ADC_PIPE_BLOCKS must be a power of two, 4..128"
+#endif
+#if (ADC_PIPE_BLOCK_SAMPLES == 0U) || ((ADC_PIPE_BLOCK_SAMPLES % 16U) != 0U) || (ADC_PIPE_BLOCK_SAMPLES > 131056U)
+#error "adc_pipe: ADC_PIPE_BLOCK_SAMPLES must be a multiple of 16, at most 131056"
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct adc_pipe_s adc_pipe_t;
+
+typedef struct
+{
+  uint16_t *samples;            /* ADC_PIPE_BLOCK_SAMPLES, oldest first */
+  uint32_t seq;                 /* block number since start, gaps = dropped */
+  uint32_t overruns;            /* ADC overruns since the previous block */
+} adc_pipe_block_t;
+
+typedef void (*adc_pipe_callback_t)(adc_pipe_t *p, const adc_pipe_block_t *block);
+
+typedef struct
+{
+  uint32_t blocks;              /* handed to the consumer */
+  uint32_t dropped;             /* refilled because no block was free */
+  uint32_t overruns;            /* ADC overrun flags seen */
+  uint32_t dma_errors;
+} adc_pipe_stats_t;
+
+struct adc_pipe_s
+{
+  DMA_HandleTypeDef *hdma;      /* stream for ADC1 (master), see adc_pipe_init() */
+  uint32_t channel;             /* 0..19, the same pin on ADC1 and ADC2 */
+  uint32_t resolution;          /* bits: 16, 14, 12, 10 or 8 */
+  uint32_t sampling_time;       /* ADC_PIPE_SMP_x */
+  uint32_t delay;               /* CCR DELAY 0..15, master to slave */
+  uint32_t ratio;               /* oversampling 1..1024, 1 = off */
+  uint32_t shift;               /* oversampling right shift 0..11, result must fit 16 bits */
+  adc_pipe_callback_t callback; /* block queued, from interrupt context, may be NULL */
+  void *context;
+
+  adc_pipe_block_t block[ADC_PIPE_BLOCKS];
+  uint8_t dma_block[2];         /* block behind M0AR/M1AR */
+  uint8_t ready[ADC_PIPE_BLOCKS];
+  uint8_t free[ADC_PIPE_BLOCKS];
+  volatile uint32_t ready_head; /* producer: interrupt */
+  volatile uint32_t ready_tail; /* consumer */
+  volatile uint32_t free_head;  /* consumer */
+  volatile uint32_t free_tail;  /* producer: interrupt */
+  uint32_t seq;
+  uint32_t overruns_seen;
+  volatile uint32_t running;
+  adc_pipe_stats_t stats;
+};
+
+/* Function definitions ------------------------------------------------------*/
+/* hdma (initialized with HAL_DMA_Init: DMA_REQUEST_ADC1, peripheral to
+   memory, word to word, circular), the pin in analog mode and the settings
+   must be set, both ADCs disabled. Powers up and calibrates ADC1/ADC2 for
+   interleaved continuous conversion and sets up dual mode. HAL_ERROR on a
+   bad setting, when an ADC does not answer or another pipe already
+   exists. */
+HAL_StatusTypeDef adc_pipe_init(adc_pipe_t *p);
+/* Start converting into the pool; all blocks are free again */
+HAL_StatusTypeDef adc_pipe_start(adc_pipe_t *p);
+HAL_StatusTypeDef adc_pipe_stop(adc_pipe_t *p);
+/* 0 after a DMA transfer error stopped the stream, stop/start to recover */
+uint32_t adc_pipe_running(const adc_pipe_t *p);
+
+/* Consumer side, one thread. get returns the oldest full block or NULL;
+   the samples stay valid until the block is released and until then the
+   consumer may also work on them in place; release writes the block out
+   of the data cache before the DMA can have it again. */
+const adc_pipe_block_t *adc_pipe_get(adc_pipe_t *p);
+void adc_pipe_release(adc_pipe_t *p, const adc_pipe_block_t *block);
+
+/* Overrun part of the ADC interrupt */
+void adc_pipe_irq(adc_pipe_t *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,387 @@
+
+/* Header includes -----------------------------------------------------------*/
+#include "clock_profile.h"
+
+/* Private macros ------------------------------------------------------------*/
+#define CP_STATIC_ASSERT(expr, name)  typedef char cp_assert_##name[(expr) ? 1 : -1]
+
+#define CP_MHZ(x)                   ((x) * 1000000UL)
+
+/* Datasheet limits per voltage scale (0..3) */
+#define CP_MAX_SYSCLK(vos)          (((vos) == 0U) ? CP_MHZ(480) : ((vos) == 1U) ? CP_MHZ(400) : \
+                                     ((vos) == 2U) ? CP_MHZ(300) : CP_MHZ(200))
+#define CP_MAX_HCLK(vos)            (CP_MAX_SYSCLK(vos) / 2U)
+#define CP_MAX_PCLK(vos)            (CP_MAX_SYSCLK(vos) / 4U)
+
+/* Highest AXI clock for a flash wait-state count (RM0433 flash table) */
+#define CP_MAX_FLASH_HCLK(vos, ws)  (((vos) <= 1U) ? \
+      (((ws) == 0U) ? CP_MHZ(70) : ((ws) == 1U) ? CP_MHZ(140) : ((ws) == 2U) ? CP_MHZ(185) : \
+       ((ws) == 3U) ? CP_MHZ(225) : CP_MHZ(240)) : \
+    ((vos) == 2U) ? \
+      (((ws) == 0U) ? CP_MHZ(55) : ((ws) == 1U) ? CP_MHZ(110) : ((ws) == 2U) ? CP_MHZ(165) : CP_MHZ(225)) : \
+      (((ws) == 0U) ? CP_MHZ(45) : ((ws) == 1U) ? CP_MHZ(90) : ((ws) == 2U) ? CP_MHZ(135) : \
+       ((ws) == 3U) ? CP_MHZ(180) : CP_MHZ(225)))
+/* Highest AXI clock for a flash WRHIGHFREQ setting, 0 or 1 (same table) */
+#define CP_MAX_WRHF_HCLK(vos, wr)   (((vos) <= 1U) ? (((wr) == 0U) ? CP_MHZ(70) : CP_MHZ(185)) : \
+                                     ((vos) == 2U) ? (((wr) == 0U) ? CP_MHZ(55) : CP_MHZ(165)) : \
+                                     (((wr) == 0U) ? CP_MHZ(45) : CP_MHZ(135)))
+#define CP_WRHIGHFREQ(vos, hclk)    (((hclk) <= CP_MAX_WRHF_HCLK(vos, 0U)) ? 0U : \
+                                     ((hclk) <= CP_MAX_WRHF_HCLK(vos, 1U)) ? 1U : 2U)
+
+/* Divider value to register encoding */
+#define CP_HPRE(div)                (((div) == 1U) ? 0U : ((div) == 2U) ? 8U : ((div) == 4U) ? 9U : \
+                                     ((div) == 8U) ? 10U : ((div) == 16U) ? 11U : ((div) == 64U) ? 12U : \
+                                     ((div) == 128U) ? 13U : ((div) == 256U) ? 14U : 15U)
+#define CP_PPRE(div)                (((div) == 1U) ? 0U : ((div) == 2U) ? 4U : ((div) == 4U) ? 5U : \
+                                     ((div) == 8U) ? 6U : 7U)
+
+/* PLL input range / VCO selection from the reference frequency */
+#define CP_PLL_RGE(ref)             (((ref) < CP_MHZ(2)) ? 0U : ((ref) < CP_MHZ(4)) ? 1U : \
+                                     ((ref) < CP_MHZ(8)) ? 2U : 3U)
+#define CP_PLL_VCOSEL(ref)          (((ref) < CP_MHZ(2)) ? 1U : 0U)
+#define CP_PLL(i, src, m, n, p, q, r) \
+  { (m), \
+    (((n) - 1U) << RCC_PLL1DIVR_N1_Pos) | (((p) - 1U) << RCC_PLL1DIVR_P1_Pos) | \
+    (((q) - 1U) << RCC_PLL1DIVR_Q1_Pos) | (((r) - 1U) << RCC_PLL1DIVR_R1_Pos), \
+    (CP_PLL_RGE((src) / (m)) << (RCC_PLLCFGR_PLL1RGE_Pos + (4U * (i)))) | \
+    (CP_PLL_VCOSEL((src) / (m)) << (1U + (4U * (i)))) | (7UL << (16U + (3U * (i)))) }
+#define CP_PLL_OFF                  { 0U, 0U, 0U }
+
+/* Build-time validation of one PLL: input 1-16 MHz, VCO wide 192-960 MHz or
+   medium 150-420 MHz */
+#define CP_CHECK_PLL(name, src, m, n) \
+  CP_STATIC_ASSERT(((src) / (m) >= CP_MHZ(1)) && ((src) / (m) <= CP_MHZ(16)), name##_ref); \
+  CP_STATIC_ASSERT((CP_PLL_VCOSEL((src) / (m)) == 0U) ? \
+                   (((src) / (m) * (n) >= CP_MHZ(192)) && ((src) / (m) * (n) <= CP_MHZ(960))) : \
+                   (((src) / (m) * (n) >= CP_MHZ(150)) && ((src) / (m) * (n) <= CP_MHZ(420))), name##_vco)
+/* PLL1 P divider must be 1 or even */
+#define CP_CHECK_PLL1_P(name, p)    CP_STATIC_ASSERT(((p) == 1U) || (((p) & 1U) == 0U), name##_p)
+
+/* Build-time validation of the bus tree and flash latency */
+#define CP_CHECK_BUS(name, sysclk, vos, cpre, hpre, d1ppre, d2ppre1, d2ppre2, d3ppre, ws) \
+  CP_STATIC_ASSERT((sysclk) / (cpre) <= CP_MAX_SYSCLK(vos), name##_sysclk); \
+  CP_STATIC_ASSERT((sysclk) / (cpre) / (hpre) <= CP_MAX_HCLK(vos), name##_hclk); \
+  CP_STATIC_ASSERT((sysclk) / (cpre) / (hpre) / (d1ppre) <= CP_MAX_PCLK(vos), name##_pclk3); \
+  CP_STATIC_ASSERT((sysclk) / (cpre) / (hpre) / (d2ppre1) <= CP_MAX_PCLK(vos), name##_pclk1); \
+  CP_STATIC_ASSERT((sysclk) / (cpre) / (hpre) / (d2ppre2) <= CP_MAX_PCLK(vos), name##_pclk2); \
+  CP_STATIC_ASSERT((sysclk) / (cpre) / (hpre) / (d3ppre) <= CP_MAX_PCLK(vos), name##_pclk4); \
+  CP_STATIC_ASSERT((sysclk) / (cpre) / (hpre) <= CP_MAX_FLASH_HCLK(vos, ws), name##_flash)
+
+#define CP_BUS(sysclk, vos, cpre, hpre, d1ppre, d2ppre1, d2ppre2, d3ppre, ws) \
+  ((CP_HPRE(cpre) << RCC_D1CFGR_D1CPRE_Pos) | (CP_HPRE(hpre) << RCC_D1CFGR_HPRE_Pos) | \
+   (CP_PPRE(d1ppre) << RCC_D1CFGR_D1PPRE_Pos)), \
+  ((CP_PPRE(d2ppre1) << RCC_D2CFGR_D2PPRE1_Pos) | (CP_PPRE(d2ppre2) << RCC_D2CFGR_D2PPRE2_Pos)), \
+  (CP_PPRE(d3ppre) << RCC_D3CFGR_D3PPRE_Pos), \
+  ((ws) | (CP_WRHIGHFREQ((vos), (sysclk) / (cpre) / (hpre)) << FLASH_ACR_WRHIGHFREQ_Pos))
+
+/* Profile parameters --------------------------------------------------------*/
+/* PLL2 (100 MHz P for SPI/SAI/ADC kernels) and PLL3 (48 MHz Q for USB) are the
+   same in both HSE profiles so hopping between them leaves them running. */
+#define CP_PLL2_HSE                 CP_PLL(1U, HSE_VALUE, 5U, 80U, 4U, 4U, 4U)
+#define CP_PLL3_HSE                 CP_PLL(2U, HSE_VALUE, 5U, 96U, 5U, 10U, 10U)
+CP_CHECK_PLL(pll2_hse, HSE_VALUE, 5U, 80U);
+CP_CHECK_PLL(pll3_hse, HSE_VALUE, 5U, 96U);
+
+/* 480 MHz: 25 / 5 * 192 / 2 */
+#define CP480_SYSCLK                (HSE_VALUE / 5U * 192U / 2U)
+CP_CHECK_PLL(p480_pll1, HSE_VALUE, 5U, 192U);
+CP_CHECK_PLL1_P(p480_pll1, 2U);
+CP_CHECK_BUS(p480, CP480_SYSCLK, 0U, 1U, 2U, 2U, 2U, 2U, 2U, 4U);
+
+/* 200 MHz: 25 / 5 * 160 / 4 */
+#define CP200_SYSCLK                (HSE_VALUE / 5U * 160U / 4U)
+CP_CHECK_PLL(p200_pll1, HSE_VALUE, 5U, 160U);
+CP_CHECK_PLL1_P(p200_pll1, 4U);
+CP_CHECK_BUS(p200, CP200_SYSCLK, 3U, 1U, 2U, 2U, 2U, 2U, 2U, 2U);
+
+/* 64 MHz HSI */
+#define CP64_SYSCLK                 HSI_VALUE
+CP_CHECK_BUS(p64, CP64_SYSCLK, 3U, 1U, 1U, 2U, 2U, 2U, 2U, 1U);
+
+/* Private variables ---------------------------------------------------------*/
+static const clock_profile_t clock_profiles[CLOCK_PROFILE_COUNT] =
+{
+  /* CLOCK_PROFILE_480MHZ */
+  {
+    CP480_SYSCLK, CP480_SYSCLK / 2U, RCC_CFGR_SW_PLL1, RCC_PLLCKSELR_PLLSRC_HSE,
+    { CP_PLL(0U, HSE_VALUE, 5U, 192U, 2U, 4U, 2U), CP_PLL2_HSE, CP_PLL3_HSE },
+    0U, CP_BUS(CP480_SYSCLK, 0U, 1U, 2U, 2U, 2U, 2U, 2U, 4U)
+  },
+  /* CLOCK_PROFILE_200MHZ */
+  {
+    CP200_SYSCLK, CP200_SYSCLK / 2U, RCC_CFGR_SW_PLL1, RCC_PLLCKSELR_PLLSRC_HSE,
+    { CP_PLL(0U, HSE_VALUE, 5U, 160U, 4U, 4U, 4U), CP_PLL2_HSE, CP_PLL3_HSE },
+    3U, CP_BUS(CP200_SYSCLK, 3U, 1U, 2U, 2U, 2U, 2U, 2U, 2U)
+  },
+  /* CLOCK_PROFILE_64MHZ_HSI */
+  {
+    CP64_SYSCLK, CP64_SYSCLK, RCC_CFGR_SW_HSI, RCC_PLLCKSELR_PLLSRC_HSI,
+    { CP_PLL_OFF, CP_PLL_OFF, CP_PLL_OFF },
+    3U, CP_BUS(CP64_SYSCLK, 3U, 1U, 1U, 2U, 2U, 2U, 2U, 1U)
+  }
+};
+
+static const uint32_t clock_vos_reg[4] =
+{
+  PWR_REGULATOR_VOLTAGE_SCALE0, PWR_REGULATOR_VOLTAGE_SCALE1,
+  PWR_REGULATOR_VOLTAGE_SCALE2, PWR_REGULATOR_VOLTAGE_SCALE3
+};
+
+/* Private functions ---------------------------------------------------------*/
+static HAL_StatusTypeDef clock_wait(__IO uint32_t *reg, uint32_t mask, uint32_t value)
+{
+  uint32_t spin = CLOCK_PROFILE_SPIN_LIMIT;
+
+  while((*reg & mask) != value)
+  {
+    if(--spin == 0U)
+    {
+      return HAL_TIMEOUT;
+    }
+  }
+  return HAL_OK;
+}
+
+static uint32_t clock_vos_current(void)
+{
+  switch(PWR->D3CR & PWR_D3CR_VOS)
+  {
+    case PWR_REGULATOR_VOLTAGE_SCALE1:
+      return ((SYSCFG->PWRCR & SYSCFG_PWRCR_ODEN) != 0U) ? 0U : 1U;
+    case PWR_REGULATOR_VOLTAGE_SCALE2:
+      return 2U;
+    default:
+      return 3U;
+  }
+}
+
+static HAL_StatusTypeDef clock_vos_set(uint32_t vos)
+{
+  __HAL_PWR_VOLTAGESCALING_CONFIG(clock_vos_reg[vos]);
+  return clock_wait(&PWR->D3CR, PWR_D3CR_VOSRDY, PWR_D3CR_VOSRDY);
+}
+
+static HAL_StatusTypeDef clock_flash_set(uint32_t acr)
+{
+  MODIFY_REG(FLASH->ACR, FLASH_ACR_LATENCY | FLASH_ACR_WRHIGHFREQ, acr);
+  return clock_wait(&FLASH->ACR, FLASH_ACR_LATENCY | FLASH_ACR_WRHIGHFREQ, acr);
+}
+
+/* Prescaler fields compare by division ratio: codes below the first divide
+   value (8 for HPRE/D1CPRE, 4 for PPRE) all mean /1. */
+static uint32_t clock_div_field_max(uint32_t cur, uint32_t target, uint32_t mask, uint32_t one)
+{
+  uint32_t a = cur & mask;
+  uint32_t b = target & mask;
+  uint32_t an = (a < one) ? 0U : a;
+  uint32_t bn = (b < one) ? 0U : b;
+
+  return (an > bn) ? a : b;
+}
+
+/* Register value keeping, per field, the larger division of cur and target */
+static uint32_t clock_div_max(uint32_t cur, uint32_t target, const uint32_t *pos,
+                              const uint32_t *width, uint32_t count)
+{
+  uint32_t result = cur;
+  uint32_t i;
+  uint32_t mask;
+  uint32_t one;
+
+  for(i = 0U; i < count; i++)
+  {
+    mask = ((1UL << width[i]) - 1U) << pos[i];
+    one = (width[i] == 4U) ? (8UL << pos[i]) : (4UL << pos[i]);
+    result = (result & ~mask) | clock_div_field_max(cur, target, mask, one);
+  }
+  return result;
+}
+
+static const uint32_t clock_d1_pos[3]   = { RCC_D1CFGR_D1CPRE_Pos, RCC_D1CFGR_HPRE_Pos, RCC_D1CFGR_D1PPRE_Pos };
+static const uint32_t clock_d1_width[3] = { 4U, 4U, 3U };
+static const uint32_t clock_d2_pos[2]   = { RCC_D2CFGR_D2PPRE1_Pos, RCC_D2CFGR_D2PPRE2_Pos };
+static const uint32_t clock_d2_width[2] = { 3U, 3U };
+static const uint32_t clock_d3_pos[1]   = { RCC_D3CFGR_D3PPRE_Pos };
+static const uint32_t clock_d3_width[1] = { 3U };
+
+#define CLOCK_D1_MASK   (RCC_D1CFGR_D1CPRE | RCC_D1CFGR_HPRE | RCC_D1CFGR_D1PPRE)
+#define CLOCK_D2_MASK   (RCC_D2CFGR_D2PPRE1 | RCC_D2CFGR_D2PPRE2)
+#define CLOCK_D3_MASK   (RCC_D3CFGR_D3PPRE)
+
+static void clock_bus_set(uint32_t d1, uint32_t d2, uint32_t d3)
+{
+  MODIFY_REG(RCC->D1CFGR, CLOCK_D1_MASK, d1);
+  MODIFY_REG(RCC->D2CFGR, CLOCK_D2_MASK, d2);
+  MODIFY_REG(RCC->D3CFGR, CLOCK_D3_MASK, d3);
+}
+
+static uint32_t clock_pll_matches(uint32_t i, const clock_profile_pll_t *pll, uint32_t pllsrc)
+{
+  uint32_t on = RCC_CR_PLL1ON << (2U * i);
+  uint32_t cfgmask = (0xFUL << (4U * i)) | (7UL << (16U + (3U * i)));
+  uint32_t divm = (RCC->PLLCKSELR >> (RCC_PLLCKSELR_DIVM1_Pos + (8U * i))) & 0x3FU;
+  __IO uint32_t *divr = &RCC->PLL1DIVR + (2U * i);
+
+  if(pll->divm == 0U)
+  {
+    return ((RCC->CR & on) == 0U) ? 1U : 0U;
+  }
+  return (((RCC->CR & on) != 0U)
+          && ((RCC->PLLCKSELR & RCC_PLLCKSELR_PLLSRC) == pllsrc)
+          && (divm == pll->divm)
+          && (*divr == pll->divr)
+          && ((RCC->PLLCFGR & cfgmask) == pll->cfgr)) ? 1U : 0U;
+}
+
+static HAL_StatusTypeDef clock_pll_stop(uint32_t i)
+{
+  CLEAR_BIT(RCC->CR, RCC_CR_PLL1ON << (2U * i));
+  return clock_wait(&RCC->CR, RCC_CR_PLL1RDY << (2U * i), 0U);
+}
+
+static HAL_StatusTypeDef clock_pll_start(uint32_t i, const clock_profile_pll_t *pll)
+{
+  uint32_t cfgmask = (0xFUL << (4U * i)) | (7UL << (16U + (3U * i)));
+  uint32_t divmpos = RCC_PLLCKSELR_DIVM1_Pos + (8U * i);
+
+  MODIFY_REG(RCC->PLLCKSELR, 0x3FUL << divmpos, pll->divm << divmpos);
+  *(&RCC->PLL1DIVR + (2U * i)) = pll->divr;
+  MODIFY_REG(RCC->PLLCFGR, cfgmask, pll->cfgr);
+  SET_BIT(RCC->CR, RCC_CR_PLL1ON << (2U * i));
+  return clock_wait(&RCC->CR, RCC_CR_PLL1RDY << (2U * i), RCC_CR_PLL1RDY << (2U * i));
+}
+
+static HAL_StatusTypeDef clock_sysclk_set(uint32_t sw)
+{
+  __HAL_RCC_SYSCLK_CONFIG(sw);
+  return clock_wait(&RCC->CFGR, RCC_CFGR_SWS, sw << RCC_CFGR_SWS_Pos);
+}
+
+/* Exported functions --------------------------------------------------------*/
+const clock_profile_t *clock_profile_get(clock_profile_id_t id)
+{
+  return (id < CLOCK_PROFILE_COUNT) ? &clock_profiles[id] : NULL;
+}
+
+HAL_StatusTypeDef clock_profile_apply(clock_profile_id_t id)
+{
+  const clock_profile_t *p = clock_profile_get(id);
+  uint32_t vos;
+  uint32_t latency;
+  uint32_t change[3];
+  uint32_t src_change;
+  uint32_t i;
+
+  if(p == NULL)
+  {
+    return HAL_ERROR;
+  }
+
+  __HAL_RCC_SYSCFG_CLK_ENABLE();
+  vos = clock_vos_current();
+  latency = FLASH->ACR & FLASH_ACR_LATENCY;
+
+  /* 1. Raise the core voltage before any frequency goes up */
+  if((p->vos < vos) && (clock_vos_set(p->vos) != HAL_OK))
+  {
+    return HAL_TIMEOUT;
+  }
+
+  /* 2. More wait states before the AXI clock goes up */
+  if(((p->acr & FLASH_ACR_LATENCY) > latency) && (clock_flash_set(p->acr) != HAL_OK))
+  {
+    return HAL_TIMEOUT;
+  }
+
+  /* 3. Prescalers that divide more take effect before the switch */
+  clock_bus_set(clock_div_max(RCC->D1CFGR, p->d1cfgr, clock_d1_pos, clock_d1_width, 3U),
+                clock_div_max(RCC->D2CFGR, p->d2cfgr, clock_d2_pos, clock_d2_width, 2U),
+                clock_div_max(RCC->D3CFGR, p->d3cfgr, clock_d3_pos, clock_d3_width, 1U));
+
+  /* 4. PLLs, only those whose setting differs. PLLSRC is shared by the
+        three PLLs, so a source change restarts all enabled ones. */
+  src_change = ((p->pllsrc != (RCC->PLLCKSELR & RCC_PLLCKSELR_PLLSRC))
+                && ((p->pll[0].divm | p->pll[1].divm | p->pll[2].divm) != 0U)) ? 1U : 0U;
+  for(i = 0U; i < 3U; i++)
+  {
+    change[i] = ((src_change != 0U) || (clock_pll_matches(i, &p->pll[i], p->pllsrc) == 0U)) ? 1U : 0U;
+  }
+
+  if((change[0] != 0U) && (__HAL_RCC_GET_SYSCLK_SOURCE() == RCC_CFGR_SWS_PLL1))
+  {
+    /* PLL1 cannot be reprogrammed while it clocks the core */
+    SET_BIT(RCC->CR, RCC_CR_HSION);
+    if((clock_wait(&RCC->CR, RCC_CR_HSIRDY, RCC_CR_HSIRDY) != HAL_OK)
+       || (clock_sysclk_set(RCC_CFGR_SW_HSI) != HAL_OK))
+    {
+      return HAL_TIMEOUT;
+    }
+  }
+
+  for(i = 0U; i < 3U; i++)
+  {
+    if((change[i] != 0U) && (clock_pll_stop(i) != HAL_OK))
+    {
+      return HAL_TIMEOUT;
+    }
+  }
+
+  if(p->pllsrc == RCC_PLLCKSELR_PLLSRC_HSE)
+  {
+    SET_BIT(RCC->CR, RCC_CR_HSEON);
+    if(clock_wait(&RCC->CR, RCC_CR_HSERDY, RCC_CR_HSERDY) != HAL_OK)
+    {
+      return HAL_TIMEOUT;
+    }
+  }
+  if(src_change != 0U)
+  {
+    MODIFY_REG(RCC->PLLCKSELR, RCC_PLLCKSELR_PLLSRC, p->pllsrc);
+  }
+
+  for(i = 0U; i < 3U; i++)
+  {
+    if((change[i] != 0U) && (p->pll[i].divm != 0U) && (clock_pll_start(i, &p->pll[i]) != HAL_OK))
+    {
+      return HAL_TIMEOUT;
+    }
+  }
+
+  /* 5. System clock switch */
+  if(p->sw == RCC_CFGR_SW_HSI)
+  {
+    SET_BIT(RCC->CR, RCC_CR_HSION);
+    MODIFY_REG(RCC->CR, RCC_CR_HSIDIV, RCC_HSI_DIV1);
+    if(clock_wait(&RCC->CR, RCC_CR_HSIRDY | RCC_CR_HSIDIVF, RCC_CR_HSIRDY | RCC_CR_HSIDIVF) != HAL_OK)
+    {
+      return HAL_TIMEOUT;
+    }
+  }
+  if(((RCC->CFGR & RCC_CFGR_SWS) != (p->sw << RCC_CFGR_SWS_Pos)) && (clock_sysclk_set(p->sw) != HAL_OK))
+  {
+    return HAL_TIMEOUT;
+  }
+
+  /* 6. Final prescalers, then relax flash and voltage once clocks are down */
+  clock_bus_set(p->d1cfgr, p->d2cfgr, p->d3cfgr);
+
+  if((p->acr & FLASH_ACR_LATENCY) <= latency)
+  {
+    if(clock_flash_set(p->acr) != HAL_OK)
+    {
+      return HAL_TIMEOUT;
+    }
+  }
+
+  if((p->vos > vos) && (clock_vos_set(p->vos) != HAL_OK))
+  {
+    return HAL_TIMEOUT;
+  }
+
+  SystemCoreClock = p->sysclk;
+  SystemD2Clock = p->hclk;
+  HAL_RCC_ClockCacheInvalidate();
+
+  /* Timebase follows the new clock tree, as in HAL_RCC_ClockConfig() */
+  return HAL_InitTick(uwTickPrio);
+}
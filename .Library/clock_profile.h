@@ -0,0 +1,60 @@
+#ifndef __CLOCK_PROFILE_H
+#define __CLOCK_PROFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+#include "stm32h7xx_hal_rcc.h"
+
+/* Precomputed clock profiles for the STM32H750 (HSE = HSE_VALUE).
+   Every profile is checked against the datasheet limits at compile time in
+   clock_profile.c, so switching only writes the registers that differ, in
+   the order the reference manual requires, polling ready flags with a
+   bounded spin instead of HAL_GetTick() timeouts. */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  CLOCK_PROFILE_480MHZ = 0U,    /* PLL1 from HSE, VOS0, AXI 240 MHz */
+  CLOCK_PROFILE_200MHZ,         /* PLL1 from HSE, VOS3, AXI 100 MHz */
+  CLOCK_PROFILE_64MHZ_HSI,      /* HSI, all PLLs off, VOS3 */
+  CLOCK_PROFILE_COUNT
+} clock_profile_id_t;
+
+typedef struct
+{
+  uint32_t divm;                /* DIVMx field, 0 : PLL off */
+  uint32_t divr;                /* PLLxDIVR */
+  uint32_t cfgr;                /* PLLx bits of PLLCFGR */
+} clock_profile_pll_t;
+
+typedef struct
+{
+  uint32_t sysclk;              /* Hz */
+  uint32_t hclk;                /* Hz */
+  uint32_t sw;                  /* RCC_CFGR_SW value */
+  uint32_t pllsrc;              /* RCC_PLLCKSELR_PLLSRC value */
+  clock_profile_pll_t pll[3];
+  uint32_t vos;                 /* 0 : VOS0 ... 3 : VOS3 */
+  uint32_t d1cfgr;
+  uint32_t d2cfgr;
+  uint32_t d3cfgr;
+  uint32_t acr;                 /* FLASH LATENCY | WRHIGHFREQ */
+} clock_profile_t;
+
+/* Exported constants --------------------------------------------------------*/
+/* Upper bound of ready-flag polling iterations (a PLL locks in < 100 us) */
+#define CLOCK_PROFILE_SPIN_LIMIT    0x100000U
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef clock_profile_apply(clock_profile_id_t id);
+const clock_profile_t *clock_profile_get(clock_profile_id_t id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CLOCK_PROFILE_H */
@@ -0,0 +1,459 @@
+/* Header includes -----------------------------------------------------------*/
+#include "crc_stream.h"
+#include "dma_cache.h"
+
+/* Private macro -------------------------------------------------------------*/
+/* Largest MDMA block, in bytes */
+#define CRC_STREAM_MDMA_BLOCK   65536U
+
+/* Private variables ---------------------------------------------------------*/
+static MDMA_HandleTypeDef crc_stream_mdma;
+static crc_stream_t *volatile crc_stream_owner;
+static const crc_stream_cfg_t *crc_stream_loaded;
+static crc_stream_stats_t crc_stream_st;
+
+/* The async job in flight: what is left for the MDMA and the CPU, and where
+   it started, to redo it in software after an MDMA error */
+static struct
+{
+  const uint8_t *next;
+  uint32_t bulk;
+  uint32_t chunk;
+  uint32_t tail;
+  const uint8_t *data;
+  uint32_t len;
+  uint32_t value;
+} crc_stream_job;
+
+/* Private functions ---------------------------------------------------------*/
+static inline uint32_t crc_stream_reflect(uint32_t x, uint32_t width)
+{
+  return __RBIT(x) >> (32U - width);
+}
+
+static inline uint32_t crc_stream_mask(uint32_t width)
+{
+  return (width == 32U) ? 0xFFFFFFFFU : ((1UL << width) - 1U);
+}
+
+/* Reflected CRCs run LSB first on the reflected register, the others MSB
+   first on the register moved to the top of the word; both come back in
+   the unit's form */
+static uint32_t crc_stream_sw(const crc_stream_cfg_t *cfg, uint32_t value, const uint8_t *p, uint32_t len)
+{
+  const uint32_t (*t)[256] = (const uint32_t (*)[256])cfg->table;
+  uint32_t w = cfg->width;
+  uint32_t crc;
+  uint32_t poly;
+  uint32_t one;
+  uint32_t two;
+  uint32_t i;
+
+  if(cfg->refin != 0U)
+  {
+    crc = crc_stream_reflect(value, w);
+    if(t != NULL)
+    {
+      for(; len >= 8U; len -= 8U)
+      {
+        one = __UNALIGNED_UINT32_READ(p) ^ crc;
+        two = __UNALIGNED_UINT32_READ(p + 4U);
+        crc = t[7][one & 0xFFU] ^ t[6][(one >> 8) & 0xFFU] ^ t[5][(one >> 16) & 0xFFU] ^ t[4][one >> 24] ^
+              t[3][two & 0xFFU] ^ t[2][(two >> 8) & 0xFFU] ^ t[1][(two >> 16) & 0xFFU] ^ t[0][two >> 24];
+        p += 8U;
+      }
+      for(; len > 0U; len--)
+      {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFFU];
+      }
+    }
+    else
+    {
+      poly = crc_stream_reflect(cfg->poly, w);
+      for(; len > 0U; len--)
+      {
+        crc ^= *p++;
+        for(i = 0U; i < 8U; i++)
+        {
+          crc = ((crc & 1U) != 0U) ? ((crc >> 1) ^ poly) : (crc >> 1);
+        }
+      }
+    }
+    return crc_stream_reflect(crc, w);
+  }
+
+  crc = value << (32U - w);
+  if(t != NULL)
+  {
+    for(; len >= 8U; len -= 8U)
+    {
+      one = __REV(__UNALIGNED_UINT32_READ(p)) ^ crc;
+      two = __REV(__UNALIGNED_UINT32_READ(p + 4U));
+      crc = t[7][one >> 24] ^ t[6][(one >> 16) & 0xFFU] ^ t[5][(one >> 8) & 0xFFU] ^ t[4][one & 0xFFU] ^
+            t[3][two >> 24] ^ t[2][(two >> 16) & 0xFFU] ^ t[1][(two >> 8) & 0xFFU] ^ t[0][two & 0xFFU];
+      p += 8U;
+    }
+    for(; len > 0U; len--)
+    {
+      crc = (crc << 8) ^ t[0][(crc >> 24) ^ *p++];
+    }
+  }
+  else
+  {
+    poly = cfg->poly << (32U - w);
+    for(; len > 0U; len--)
+    {
+      crc ^= (uint32_t)*p++ << 24;
+      for(i = 0U; i < 8U; i++)
+      {
+        crc = ((crc & 0x80000000U) != 0U) ? ((crc << 1) ^ poly) : (crc << 1);
+      }
+    }
+  }
+  return crc >> (32U - w);
+}
+
+static uint32_t crc_stream_acquire(crc_stream_t *s)
+{
+  uint32_t primask = __get_PRIMASK();
+  uint32_t got = 0U;
+
+  __disable_irq();
+  if(crc_stream_owner == NULL)
+  {
+    crc_stream_owner = s;
+    got = 1U;
+  }
+  __set_PRIMASK(primask);
+  return got;
+}
+
+/* Configuration only when it changed; the value always, through INIT */
+static void crc_stream_load(const crc_stream_t *s)
+{
+  const crc_stream_cfg_t *cfg = s->cfg;
+  uint32_t cr;
+
+  if(crc_stream_loaded != cfg)
+  {
+    switch(cfg->width)
+    {
+      case 7U:
+        cr = CRC_CR_POLYSIZE_1 | CRC_CR_POLYSIZE_0;
+        break;
+      case 8U:
+        cr = CRC_CR_POLYSIZE_1;
+        break;
+      case 16U:
+        cr = CRC_CR_POLYSIZE_0;
+        break;
+      default:
+        cr = 0U;
+        break;
+    }
+    if(cfg->refin != 0U)
+    {
+      cr |= CRC_CR_REV_IN_0;
+    }
+    CRC->POL = cfg->poly;
+    CRC->CR = cr;
+    crc_stream_loaded = cfg;
+  }
+  CRC->INIT = s->value;
+  CRC->CR |= CRC_CR_RESET;
+  crc_stream_st.loads++;
+}
+
+/* Whole words go in MSB first, the way the unit takes bytes in order */
+static void crc_stream_hw(const uint8_t *p, uint32_t len)
+{
+  for(; len >= 4U; len -= 4U)
+  {
+    CRC->DR = __REV(__UNALIGNED_UINT32_READ(p));
+    p += 4U;
+  }
+  for(; len > 0U; len--)
+  {
+    *(__IO uint8_t *)(__IO void *)(&CRC->DR) = *p++;
+  }
+}
+
+static void crc_stream_release(crc_stream_t *s)
+{
+  s->value = CRC->DR;
+  crc_stream_owner = NULL;
+}
+
+static HAL_StatusTypeDef crc_stream_mdma_next(void)
+{
+  crc_stream_job.chunk = (crc_stream_job.bulk > CRC_STREAM_MDMA_BLOCK) ? CRC_STREAM_MDMA_BLOCK : crc_stream_job.bulk;
+  return HAL_MDMA_Start_IT(&crc_stream_mdma, (uint32_t)crc_stream_job.next, (uint32_t)&CRC->DR,
+                           crc_stream_job.chunk, 1U);
+}
+
+/* Tail bytes by the CPU, then the stream gets its value and the unit is
+   free again */
+static void crc_stream_finish(void)
+{
+  crc_stream_t *s = crc_stream_owner;
+
+  crc_stream_hw(crc_stream_job.next, crc_stream_job.tail);
+  crc_stream_st.hw_bytes += crc_stream_job.tail;
+  crc_stream_release(s);
+  s->bytes += crc_stream_job.len;
+  s->busy = 0U;
+  if(s->done != NULL)
+  {
+    s->done(s, s->context);
+  }
+}
+
+/* The unit's register is not known after an error: the job is redone in
+   software from the value it started with */
+static void crc_stream_fail(void)
+{
+  crc_stream_t *s = crc_stream_owner;
+
+  crc_stream_st.mdma_errors++;
+  crc_stream_st.sw_bytes += crc_stream_job.len;
+  s->value = crc_stream_sw(s->cfg, crc_stream_job.value, crc_stream_job.data, crc_stream_job.len);
+  s->bytes += crc_stream_job.len;
+  crc_stream_loaded = NULL;
+  crc_stream_owner = NULL;
+  s->busy = 0U;
+  if(s->done != NULL)
+  {
+    s->done(s, s->context);
+  }
+}
+
+static void crc_stream_mdma_cplt(MDMA_HandleTypeDef *hmdma)
+{
+  (void)hmdma;
+  crc_stream_st.mdma_bytes += crc_stream_job.chunk;
+  crc_stream_job.next += crc_stream_job.chunk;
+  crc_stream_job.bulk -= crc_stream_job.chunk;
+  if(crc_stream_job.bulk == 0U)
+  {
+    crc_stream_finish();
+  }
+  else if(crc_stream_mdma_next() != HAL_OK)
+  {
+    crc_stream_fail();
+  }
+}
+
+static void crc_stream_mdma_error(MDMA_HandleTypeDef *hmdma)
+{
+  (void)hmdma;
+  crc_stream_fail();
+}
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef crc_stream_init(MDMA_Channel_TypeDef *channel)
+{
+  __HAL_RCC_CRC_CLK_ENABLE();
+  crc_stream_loaded = NULL;
+  crc_stream_owner = NULL;
+  crc_stream_mdma.Instance = NULL;
+  if(channel == NULL)
+  {
+    return HAL_OK;
+  }
+
+  __HAL_RCC_MDMA_CLK_ENABLE();
+  crc_stream_mdma.Instance = channel;
+  crc_stream_mdma.Init.Request = MDMA_REQUEST_SW;
+  crc_stream_mdma.Init.TransferTriggerMode = MDMA_FULL_TRANSFER;
+  crc_stream_mdma.Init.Priority = MDMA_PRIORITY_LOW;
+  crc_stream_mdma.Init.Endianness = MDMA_LITTLE_ENDIANNESS_PRESERVE;
+  crc_stream_mdma.Init.SourceInc = MDMA_SRC_INC_WORD;
+  crc_stream_mdma.Init.DestinationInc = MDMA_DEST_INC_DISABLE;
+  crc_stream_mdma.Init.SourceDataSize = MDMA_SRC_DATASIZE_WORD;
+  crc_stream_mdma.Init.DestDataSize = MDMA_DEST_DATASIZE_WORD;
+  crc_stream_mdma.Init.DataAlignment = MDMA_DATAALIGN_RIGHT;
+  crc_stream_mdma.Init.BufferTransferLength = 128U;
+  crc_stream_mdma.Init.SourceBurst = MDMA_SOURCE_BURST_16BEATS;
+  crc_stream_mdma.Init.DestBurst = MDMA_DEST_BURST_SINGLE;
+  crc_stream_mdma.Init.SourceBlockAddressOffset = 0;
+  crc_stream_mdma.Init.DestBlockAddressOffset = 0;
+  if(HAL_MDMA_Init(&crc_stream_mdma) != HAL_OK)
+  {
+    crc_stream_mdma.Instance = NULL;
+    return HAL_ERROR;
+  }
+  /* Bytes and half-words both swapped: each word reaches the unit MSB
+     first, as crc_stream_hw() writes it. The HAL only takes one of the
+     two, and only sets CCR in HAL_MDMA_Init(). */
+  channel->CCR |= MDMA_CCR_BEX | MDMA_CCR_HEX;
+  crc_stream_mdma.XferCpltCallback = crc_stream_mdma_cplt;
+  crc_stream_mdma.XferErrorCallback = crc_stream_mdma_error;
+
+  HAL_NVIC_SetPriority(MDMA_IRQn, CRC_STREAM_MDMA_IRQ_PRIORITY, 0U);
+  HAL_NVIC_EnableIRQ(MDMA_IRQn);
+  return HAL_OK;
+}
+
+void crc_stream_table(const crc_stream_cfg_t *cfg)
+{
+  uint32_t (*t)[256] = cfg->table;
+  uint32_t w = cfg->width;
+  uint32_t poly;
+  uint32_t c;
+  uint32_t b;
+  uint32_t i;
+
+  if(cfg->refin != 0U)
+  {
+    poly = crc_stream_reflect(cfg->poly, w);
+    for(b = 0U; b < 256U; b++)
+    {
+      c = b;
+      for(i = 0U; i < 8U; i++)
+      {
+        c = ((c & 1U) != 0U) ? ((c >> 1) ^ poly) : (c >> 1);
+      }
+      t[0][b] = c;
+    }
+    for(b = 0U; b < 256U; b++)
+    {
+      for(i = 1U; i < 8U; i++)
+      {
+        t[i][b] = (t[i - 1U][b] >> 8) ^ t[0][t[i - 1U][b] & 0xFFU];
+      }
+    }
+  }
+  else
+  {
+    poly = cfg->poly << (32U - w);
+    for(b = 0U; b < 256U; b++)
+    {
+      c = b << 24;
+      for(i = 0U; i < 8U; i++)
+      {
+        c = ((c & 0x80000000U) != 0U) ? ((c << 1) ^ poly) : (c << 1);
+      }
+      t[0][b] = c;
+    }
+    for(b = 0U; b < 256U; b++)
+    {
+      for(i = 1U; i < 8U; i++)
+      {
+        t[i][b] = (t[i - 1U][b] << 8) ^ t[0][t[i - 1U][b] >> 24];
+      }
+    }
+  }
+}
+
+void crc_stream_begin(crc_stream_t *s, const crc_stream_cfg_t *cfg)
+{
+  s->cfg = cfg;
+  s->value = cfg->init & crc_stream_mask(cfg->width);
+  s->bytes = 0U;
+  s->busy = 0U;
+}
+
+HAL_StatusTypeDef crc_stream_update(crc_stream_t *s, const void *data, uint32_t len)
+{
+  if(s->busy != 0U)
+  {
+    return HAL_BUSY;
+  }
+  if(crc_stream_acquire(s) != 0U)
+  {
+    crc_stream_load(s);
+    crc_stream_hw(data, len);
+    crc_stream_release(s);
+    crc_stream_st.hw_bytes += len;
+  }
+  else
+  {
+    s->value = crc_stream_sw(s->cfg, s->value, data, len);
+    crc_stream_st.sw_bytes += len;
+  }
+  s->bytes += len;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef crc_stream_update_async(crc_stream_t *s, const void *data, uint32_t len,
+                                          crc_stream_done_t done, void *context)
+{
+  const uint8_t *p = data;
+  uint32_t head;
+
+  if(s->busy != 0U)
+  {
+    return HAL_BUSY;
+  }
+  if((crc_stream_mdma.Instance == NULL) || (len < CRC_STREAM_MDMA_MIN))
+  {
+    (void)crc_stream_update(s, data, len);
+    if(done != NULL)
+    {
+      done(s, context);
+    }
+    return HAL_OK;
+  }
+  if(crc_stream_acquire(s) == 0U)
+  {
+    return HAL_BUSY;
+  }
+
+  s->busy = 1U;
+  s->done = done;
+  s->context = context;
+  crc_stream_st.jobs++;
+  crc_stream_job.data = p;
+  crc_stream_job.len = len;
+  crc_stream_job.value = s->value;
+
+  /* Up to the first word boundary by the CPU, the MDMA reads whole words */
+  crc_stream_load(s);
+  head = (0U - (uint32_t)p) & 3U;
+  crc_stream_hw(p, head);
+  crc_stream_st.hw_bytes += head;
+  crc_stream_job.next = p + head;
+  crc_stream_job.bulk = (len - head) & ~3U;
+  crc_stream_job.tail = (len - head) & 3U;
+
+  dma_cache_clean(crc_stream_job.next, crc_stream_job.bulk);
+  if(crc_stream_mdma_next() != HAL_OK)
+  {
+    crc_stream_fail();
+  }
+  return HAL_OK;
+}
+
+uint32_t crc_stream_value(const crc_stream_t *s)
+{
+  const crc_stream_cfg_t *cfg = s->cfg;
+  uint32_t v = s->value;
+
+  if(cfg->refout != 0U)
+  {
+    v = crc_stream_reflect(v, cfg->width);
+  }
+  return (v ^ cfg->xorout) & crc_stream_mask(cfg->width);
+}
+
+uint32_t crc_stream_calc(const crc_stream_cfg_t *cfg, const void *data, uint32_t len)
+{
+  crc_stream_t s;
+
+  crc_stream_begin(&s, cfg);
+  (void)crc_stream_update(&s, data, len);
+  return crc_stream_value(&s);
+}
+
+const crc_stream_stats_t *crc_stream_stats(void)
+{
+  return &crc_stream_st;
+}
+
+void crc_stream_mdma_irq(void)
+{
+  if(crc_stream_mdma.Instance != NULL)
+  {
+    HAL_MDMA_IRQHandler(&crc_stream_mdma);
+  }
+}
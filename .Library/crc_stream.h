@@ -0,0 +1,126 @@
+#ifndef __CRC_STREAM_H
+#define __CRC_STREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+
+/* CRC service on the one CRC unit, shared by any number of streams with
+   their own polynomials. A stream keeps its running register value, so the
+   unit can be reloaded with another stream's configuration and value at
+   any point and two checksums interleave freely: an Ethernet payload, a
+   flash image being programmed and a protocol frame can all be in flight.
+
+   The register value is kept in the form the unit holds it (input
+   reflection done by the unit, no output reflection), so a stream can
+   also move to the software path and back between any two updates. The
+   software path is slicing-by-8 with an 8 x 256 word table per
+   configuration (bitwise when the configuration has none) and takes over
+   whenever the unit is in use by someone else, including from an
+   interrupt that lands in the middle of another update: updates never
+   wait for each other.
+
+   Large buffers can go through the MDMA. crc_stream_update_async() feeds
+   the word aligned bulk of the buffer to the unit by MDMA, with the byte
+   swap done by the MDMA, and calls back when it is done; the unit is held
+   for the whole job and synchronous updates of other streams fall back to
+   software meanwhile. The MDMA interrupt handler has to call
+   crc_stream_mdma_irq().
+
+   Widths of 7, 8, 16 and 32 bits, any odd polynomial, init, xorout and
+   input/output reflection, as in the usual CRC catalogue. */
+
+/* Exported constants --------------------------------------------------------*/
+/* Async updates shorter than this run synchronously */
+#ifndef CRC_STREAM_MDMA_MIN
+#define CRC_STREAM_MDMA_MIN     512U
+#endif
+
+/* MDMA interrupt priority */
+#ifndef CRC_STREAM_MDMA_IRQ_PRIORITY
+#define CRC_STREAM_MDMA_IRQ_PRIORITY 6U
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+typedef uint32_t crc_stream_table_t[8][256];
+
+typedef struct
+{
+  uint32_t poly;                /* normal (MSB first) form, odd */
+  uint32_t init;                /* start value of the unreflected register */
+  uint32_t xorout;
+  uint8_t width;                /* 7, 8, 16 or 32 */
+  uint8_t refin;
+  uint8_t refout;
+  uint32_t (*table)[256];       /* crc_stream_table_t for slicing-by-8, NULL: bitwise */
+} crc_stream_cfg_t;
+
+typedef struct crc_stream_s crc_stream_t;
+typedef void (*crc_stream_done_t)(crc_stream_t *s, void *context);
+
+struct crc_stream_s
+{
+  const crc_stream_cfg_t *cfg;
+  uint32_t value;               /* register, as the unit holds it */
+  uint32_t bytes;
+  volatile uint32_t busy;       /* async job running */
+  crc_stream_done_t done;
+  void *context;
+};
+
+typedef struct
+{
+  uint32_t hw_bytes;            /* fed to the unit by the CPU */
+  uint32_t mdma_bytes;          /* fed to the unit by the MDMA */
+  uint32_t sw_bytes;            /* done in software */
+  uint32_t loads;               /* unit reloaded with a stream */
+  uint32_t jobs;                /* async jobs through the MDMA */
+  uint32_t mdma_errors;         /* jobs redone in software */
+} crc_stream_stats_t;
+
+/* Exported macro ------------------------------------------------------------*/
+/* Catalogue configurations; table is a crc_stream_table_t or NULL */
+#define CRC_STREAM_CRC32(table)        {0x04C11DB7U, 0xFFFFFFFFU, 0xFFFFFFFFU, 32U, 1U, 1U, (table)}
+#define CRC_STREAM_CRC32C(table)       {0x1EDC6F41U, 0xFFFFFFFFU, 0xFFFFFFFFU, 32U, 1U, 1U, (table)}
+#define CRC_STREAM_CRC32_MPEG2(table)  {0x04C11DB7U, 0xFFFFFFFFU, 0x00000000U, 32U, 0U, 0U, (table)}
+#define CRC_STREAM_CRC16_CCITT(table)  {0x1021U, 0xFFFFU, 0x0000U, 16U, 0U, 0U, (table)}
+#define CRC_STREAM_CRC16_XMODEM(table) {0x1021U, 0x0000U, 0x0000U, 16U, 0U, 0U, (table)}
+#define CRC_STREAM_CRC16_MODBUS(table) {0x8005U, 0xFFFFU, 0x0000U, 16U, 1U, 1U, (table)}
+#define CRC_STREAM_CRC8(table)         {0x07U, 0x00U, 0x00U, 8U, 0U, 0U, (table)}
+#define CRC_STREAM_CRC8_MAXIM(table)   {0x31U, 0x00U, 0x00U, 8U, 1U, 1U, (table)}
+#define CRC_STREAM_CRC7_MMC(table)     {0x09U, 0x00U, 0x00U, 7U, 0U, 0U, (table)}
+
+/* Function definitions ------------------------------------------------------*/
+/* Clocks the unit. channel is the MDMA channel for async updates, NULL to
+   run them synchronously. */
+HAL_StatusTypeDef crc_stream_init(MDMA_Channel_TypeDef *channel);
+/* Fill cfg->table, once per configuration before its first update */
+void crc_stream_table(const crc_stream_cfg_t *cfg);
+
+/* Start a checksum */
+void crc_stream_begin(crc_stream_t *s, const crc_stream_cfg_t *cfg);
+/* Add bytes, on the unit when it is free and in software otherwise.
+   HAL_BUSY if the stream has an async job running. */
+HAL_StatusTypeDef crc_stream_update(crc_stream_t *s, const void *data, uint32_t len);
+/* Add bytes by MDMA, done(s, context) from the MDMA interrupt when they are
+   in (at once for short buffers). The buffer must stay unchanged until
+   then. HAL_BUSY if the unit or the stream is in use. */
+HAL_StatusTypeDef crc_stream_update_async(crc_stream_t *s, const void *data, uint32_t len,
+                                          crc_stream_done_t done, void *context);
+/* Checksum of the bytes so far; the stream can go on */
+uint32_t crc_stream_value(const crc_stream_t *s);
+
+/* One-shot checksum of a buffer */
+uint32_t crc_stream_calc(const crc_stream_cfg_t *cfg, const void *data, uint32_t len);
+
+const crc_stream_stats_t *crc_stream_stats(void);
+void crc_stream_mdma_irq(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,290 @@
+/* Header includes -----------------------------------------------------------*/
+#include "d3_log.h"
+#include "dma_cache.h"
+#include <string.h>
+
+/* Private macro -------------------------------------------------------------*/
+#define D3_LOG_IS_GEN(req)      (((req) >= BDMA_REQUEST_GENERATOR0) && ((req) <= BDMA_REQUEST_GENERATOR7))
+
+/* Private variables ---------------------------------------------------------*/
+#if defined ( __ICCARM__ )
+#pragma location = D3_LOG_SECTION
+static __ALIGNED(32) uint8_t d3_log_ring[D3_LOG_RING_BYTES];
+#else
+static __ALIGNED(32) uint8_t d3_log_ring[D3_LOG_RING_BYTES] __attribute__((section(D3_LOG_SECTION)));
+#endif
+
+static const uint32_t d3_log_palign[5] =
+{
+  0U, DMA_PDATAALIGN_BYTE, DMA_PDATAALIGN_HALFWORD, 0U, DMA_PDATAALIGN_WORD
+};
+
+static const uint32_t d3_log_malign[5] =
+{
+  0U, DMA_MDATAALIGN_BYTE, DMA_MDATAALIGN_HALFWORD, 0U, DMA_MDATAALIGN_WORD
+};
+
+/* The HAL callbacks carry no context and the ring is static: one logger */
+static d3_log_t *d3_log_active = NULL;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t d3_log_channel(const d3_log_t *l)
+{
+  return ((uint32_t)l->hdma->Instance - BDMA_Channel0_BASE) / 0x14U;
+}
+
+/* Half and full transfer: one more batch is complete */
+static void d3_log_dma_batch(DMA_HandleTypeDef *hdma)
+{
+  d3_log_t *l = d3_log_active;
+
+  if((l != NULL) && (l->hdma == hdma))
+  {
+    l->halves++;
+  }
+}
+
+static void d3_log_dma_error(DMA_HandleTypeDef *hdma)
+{
+  d3_log_t *l = d3_log_active;
+
+  if((l != NULL) && (l->hdma == hdma))
+  {
+    l->stats.dma_errors++;
+    l->running = 0U;
+  }
+}
+
+static uint32_t d3_log_check(const d3_log_t *l)
+{
+  uint32_t gen = D3_LOG_IS_GEN(l->request) ? 1U : 0U;
+
+  if((l->hdma == NULL) || !IS_BDMA_CHANNEL_INSTANCE(l->hdma->Instance) ||
+     ((l->size != 1U) && (l->size != 2U) && (l->size != 4U)) ||
+     ((l->source & (l->size - 1U)) != 0U) || (l->threshold == 0U) ||
+     (l->threshold > (D3_LOG_RING_BYTES / 2U / l->size)) || (l->threshold > 32767U) ||
+     (gen != ((l->hlptim != NULL) ? 1U : 0U)) || !IS_BDMA_REQUEST(l->request))
+  {
+    return 0U;
+  }
+  if((l->hlptim != NULL) &&
+     (((l->hlptim->Instance != LPTIM2) && (l->hlptim->Instance != LPTIM3)) ||
+      (l->period < 2U) || (l->period > 65536U)))
+  {
+    return 0U;
+  }
+  return 1U;
+}
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef d3_log_init(d3_log_t *l)
+{
+  HAL_DMA_MuxRequestGeneratorConfigTypeDef rg;
+  DMA_HandleTypeDef *hdma = l->hdma;
+  IRQn_Type irq;
+  uint32_t ch;
+
+  if(((d3_log_active != NULL) && (d3_log_active != l)) || (d3_log_check(l) == 0U))
+  {
+    return HAL_ERROR;
+  }
+  ch = d3_log_channel(l);
+
+  /* Clocked in D3 whatever the CPU does */
+  __HAL_RCC_BDMA_CLK_ENABLE();
+  __HAL_RCC_BDMA_CLKAM_ENABLE();
+  __HAL_RCC_D3SRAM1_CLKAM_ENABLE();
+  if((l->source >= LPUART1_BASE) && (l->source < (LPUART1_BASE + 0x400U)))
+  {
+    __HAL_RCC_LPUART1_CLKAM_ENABLE();
+  }
+
+  if(l->hlptim != NULL)
+  {
+    if(l->hlptim->Instance == LPTIM2)
+    {
+      __HAL_RCC_LPTIM2_CLK_ENABLE();
+      __HAL_RCC_LPTIM2_CLKAM_ENABLE();
+    }
+    else
+    {
+      __HAL_RCC_LPTIM3_CLK_ENABLE();
+      __HAL_RCC_LPTIM3_CLKAM_ENABLE();
+    }
+    if(HAL_LPTIM_Init(l->hlptim) != HAL_OK)
+    {
+      return HAL_ERROR;
+    }
+  }
+
+  hdma->Init.Request = l->request;
+  hdma->Init.Direction = DMA_PERIPH_TO_MEMORY;
+  hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma->Init.MemInc = DMA_MINC_ENABLE;
+  hdma->Init.PeriphDataAlignment = d3_log_palign[l->size];
+  hdma->Init.MemDataAlignment = d3_log_malign[l->size];
+  hdma->Init.Mode = DMA_CIRCULAR;
+  hdma->Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  if(HAL_DMA_Init(hdma) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  /* One request per rising edge of the LPTIM output */
+  if(l->hlptim != NULL)
+  {
+    rg.SignalID = (l->hlptim->Instance == LPTIM2) ? HAL_DMAMUX2_REQ_GEN_LPTIM2_OUT : HAL_DMAMUX2_REQ_GEN_LPTIM3_OUT;
+    rg.Polarity = HAL_DMAMUX_REQ_GEN_RISING;
+    rg.RequestNumber = 1U;
+    if(HAL_DMAEx_ConfigMuxRequestGenerator(hdma, &rg) != HAL_OK)
+    {
+      return HAL_ERROR;
+    }
+  }
+
+  /* BDMA channel n is EXTI line 66 + n, which wakes the CPU from Stop */
+  EXTI_D1->IMR3 |= 1UL << (2U + ch);
+  irq = (IRQn_Type)((uint32_t)BDMA_Channel0_IRQn + ch);
+  HAL_NVIC_SetPriority(irq, D3_LOG_IRQ_PRIORITY, 0U);
+  HAL_NVIC_EnableIRQ(irq);
+
+  l->running = 0U;
+  d3_log_active = l;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef d3_log_start(d3_log_t *l)
+{
+  DMA_HandleTypeDef *hdma = l->hdma;
+
+  if(d3_log_active != l)
+  {
+    return HAL_ERROR;
+  }
+  if(l->running != 0U)
+  {
+    return HAL_BUSY;
+  }
+
+  l->count = 0U;
+  l->halves = 0U;
+  memset(&l->stats, 0, sizeof(l->stats));
+
+  hdma->XferHalfCpltCallback = d3_log_dma_batch;
+  hdma->XferCpltCallback = d3_log_dma_batch;
+  hdma->XferErrorCallback = d3_log_dma_error;
+  hdma->XferAbortCallback = NULL;
+
+  /* Consumer first, pacer last */
+  l->running = 1U;
+  if(HAL_DMA_Start_IT(hdma, l->source, (uint32_t)d3_log_ring, 2U * l->threshold) != HAL_OK)
+  {
+    l->running = 0U;
+    return HAL_ERROR;
+  }
+  if(l->hlptim != NULL)
+  {
+    (void)HAL_DMAEx_EnableMuxRequestGenerator(hdma);
+    if(HAL_LPTIM_PWM_Start(l->hlptim, l->period - 1U, (l->period / 2U) - 1U) != HAL_OK)
+    {
+      (void)d3_log_stop(l);
+      return HAL_ERROR;
+    }
+  }
+
+  /* D3 stays in Run while D1 sleeps */
+  HAL_PWREx_ConfigD3Domain(PWR_D3_DOMAIN_RUN);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef d3_log_stop(d3_log_t *l)
+{
+  HAL_StatusTypeDef status = HAL_OK;
+
+  if(d3_log_active != l)
+  {
+    return HAL_ERROR;
+  }
+
+  if(l->hlptim != NULL)
+  {
+    (void)HAL_LPTIM_PWM_Stop(l->hlptim);
+    (void)HAL_DMAEx_DisableMuxRequestGenerator(l->hdma);
+  }
+  /* After a transfer error the channel is already off */
+  if(l->hdma->State == HAL_DMA_STATE_BUSY)
+  {
+    status = HAL_DMA_Abort(l->hdma);
+  }
+  l->running = 0U;
+  HAL_PWREx_ConfigD3Domain(PWR_D3_DOMAIN_STOP);
+  return status;
+}
+
+void d3_log_sleep(d3_log_t *l)
+{
+  uint32_t primask;
+  uint32_t slept = 0U;
+
+  /* With interrupts masked, a batch that completes between the check and
+     the WFI still ends the WFI */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if((l->running != 0U) && (l->halves == l->count))
+  {
+    l->stats.sleeps++;
+    HAL_PWREx_EnterSTOPMode(PWR_MAINREGULATOR_ON, PWR_STOPENTRY_WFI, PWR_D1_DOMAIN);
+    slept = 1U;
+  }
+  __set_PRIMASK(primask);
+
+  /* The BDMA interrupt has run by now */
+  if((slept != 0U) && (l->halves != l->count))
+  {
+    l->stats.wakeups++;
+  }
+}
+
+HAL_StatusTypeDef d3_log_get(d3_log_t *l, d3_log_batch_t *batch)
+{
+  uint32_t halves = l->halves;
+  uint32_t skip = 0U;
+  uint32_t bytes = l->threshold * l->size;
+  uint8_t *samples;
+
+  if(halves == l->count)
+  {
+    return HAL_BUSY;
+  }
+  /* Two batches behind: the BDMA is writing over the oldest one, keep
+     only the newest complete batch */
+  if((halves - l->count) >= 2U)
+  {
+    skip = (halves - 1U - l->count) * l->threshold;
+    l->count = halves - 1U;
+    l->stats.lost += skip;
+  }
+
+  samples = &d3_log_ring[(l->count & 1U) * bytes];
+  /* Speculative reads may have pulled in lines while the BDMA wrote */
+  dma_cache_invalidate(samples, bytes);
+  batch->samples = samples;
+  batch->count = l->threshold;
+  batch->first = l->count * l->threshold;
+  batch->lost = skip;
+  l->stats.batches++;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef d3_log_release(d3_log_t *l)
+{
+  HAL_StatusTypeDef status = HAL_OK;
+
+  if((l->halves - l->count) >= 2U)
+  {
+    l->stats.torn++;
+    status = HAL_ERROR;
+  }
+  l->count++;
+  return status;
+}
@@ -0,0 +1,116 @@
+#ifndef __D3_LOG_H
+#define __D3_LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+
+/* Low-power data logger that runs in D3 while D1 is stopped. The BDMA
+   moves one sample per request from a D3 source register into a ring in
+   SRAM4. The requests come from a DMAMUX2 request generator clocked by
+   LPTIM2 or LPTIM3 (sampling a register at a fixed rate) or from the
+   source itself (LPUART1 receiving a sensor stream). The ring is two
+   batches of `threshold` samples. The BDMA half and full transfer
+   interrupts end a batch, and through EXTI they wake the CPU, so it wakes
+   once per threshold samples and not once per sample.
+
+     for(;;)
+     {
+       d3_log_sleep(&log);
+       while(d3_log_get(&log, &batch) == HAL_OK)
+       {
+         ... batch.samples, batch.count ...
+         d3_log_release(&log);
+       }
+     }
+
+   A batch must be released before the BDMA comes round to it again,
+   within one batch period of it being handed out. Batches the consumer
+   missed altogether are skipped and counted in `lost`. Samples keep their
+   numbering across sleeps, so a gap shows in `first`.
+
+   The caller selects LSE or LSI as the LPTIM kernel clock and a Stop-
+   capable kernel clock for LPUART1 (UESM set). The BDMA, SRAM4, the LPTIM
+   and LPUART1 are put in autonomous mode here. Other sources need their
+   own autonomous bit. D2 stops too while D1 sleeps, so TIM5 and the
+   timebase stand still.
+
+     BDMA_Channelx_IRQHandler: HAL_DMA_IRQHandler(log.hdma); */
+
+/* Exported constants --------------------------------------------------------*/
+/* Ring in SRAM4, see linker file */
+#ifndef D3_LOG_RING_BYTES
+#define D3_LOG_RING_BYTES       32768U
+#endif
+#define D3_LOG_SECTION          ".d3_log"
+
+#ifndef D3_LOG_IRQ_PRIORITY
+#define D3_LOG_IRQ_PRIORITY     6U
+#endif
+
+#if (D3_LOG_RING_BYTES == 0U) || (D3_LOG_RING_BYTES > 65536U) || ((D3_LOG_RING_BYTES % 32U) != 0U)
+#error "d3_log: D3_LOG_RING_BYTES must be a multiple of 32, at most 64 KB"
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  const void *samples;          /* in SRAM4, oldest first */
+  uint32_t count;               /* samples */
+  uint32_t first;               /* number of the first sample since start */
+  uint32_t lost;                /* samples skipped just before this batch */
+} d3_log_batch_t;
+
+typedef struct
+{
+  uint32_t batches;             /* handed to the application */
+  uint32_t lost;                /* samples overwritten before they were read */
+  uint32_t torn;                /* batches overwritten while held */
+  uint32_t sleeps;
+  uint32_t wakeups;             /* sleeps that ended with a batch ready */
+  uint32_t dma_errors;
+} d3_log_stats_t;
+
+typedef struct
+{
+  LPTIM_HandleTypeDef *hlptim;  /* LPTIM2/LPTIM3, Instance and Init set; NULL if the source paces */
+  DMA_HandleTypeDef *hdma;      /* BDMA channel, Instance and Init.Priority set */
+  uint32_t request;             /* BDMA_REQUEST_GENERATORn with hlptim, else the source's BDMA_REQUEST_x */
+  uint32_t source;              /* D3 register read per sample: LPUART1->RDR, ... */
+  uint32_t size;                /* bytes per sample: 1, 2 or 4 */
+  uint32_t period;              /* LPTIM ticks per sample, 2..65536 */
+  uint32_t threshold;           /* samples per batch and per wakeup */
+
+  uint32_t count;               /* batches handed out, skips included */
+  volatile uint32_t halves;     /* batches completed by the BDMA */
+  volatile uint32_t running;
+  d3_log_stats_t stats;
+} d3_log_t;
+
+/* Function definitions ------------------------------------------------------*/
+/* The settings must be set. Initializes the LPTIM, the BDMA channel and the
+   request generator. HAL_ERROR if the settings or a HAL step fail, or if
+   another logger exists. */
+HAL_StatusTypeDef d3_log_init(d3_log_t *l);
+/* Start sampling into an empty ring */
+HAL_StatusTypeDef d3_log_start(d3_log_t *l);
+HAL_StatusTypeDef d3_log_stop(d3_log_t *l);
+
+/* Stop D1, with D3 kept running, until a batch is ready or another
+   interrupt wakes the CPU. Returns at once if a batch is already waiting. */
+void d3_log_sleep(d3_log_t *l);
+
+/* The oldest complete batch, HAL_BUSY if none is ready */
+HAL_StatusTypeDef d3_log_get(d3_log_t *l, d3_log_batch_t *batch);
+/* Done with the batch from d3_log_get(). HAL_ERROR if the BDMA wrote over
+   it while it was held. */
+HAL_StatusTypeDef d3_log_release(d3_log_t *l);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
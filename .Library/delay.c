@@ -2,13 +2,85 @@
 /* Header includes -----------------------------------------------------------*/
 #include "delay.h"
 
+/* Private defines -----------------------------------------------------------*/
+#define DWT_LAR_KEY            0xC5ACCE55U
+/* Longest single busy-wait, keeps (now - start) well below a CYCCNT wrap
+   (2^32 cycles = 8.9 s at 480 MHz). */
+#define DELAY_MAX_CHUNK_US     1000000U
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t delay_core_clock = 0U;   /* SystemCoreClock the factors were computed for */
+static uint32_t delay_cyc_per_us = 0U;   /* integer part of cycles per microsecond */
+static uint32_t delay_cyc_frac   = 0U;   /* remaining cycles per second, for non-MHz clocks */
+
 void SysTick_Handler(void)
 {
   HAL_IncTick();
 }
 
-void delayus(uint32_t nus){
-    HAL_Delay(nus);
+static void delay_calibrate(void)
+{
+  delay_core_clock = SystemCoreClock;
+  delay_cyc_per_us = delay_core_clock / 1000000U;
+  delay_cyc_frac   = delay_core_clock % 1000000U;
+}
+
+void delay_init(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  /* The Cortex-M7 DWT is locked after reset */
+  DWT->LAR = DWT_LAR_KEY;
+  if((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0U)
+  {
+    DWT->CYCCNT = 0U;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  }
+  delay_calibrate();
+}
+
+uint32_t delay_cycles(void)
+{
+  return DWT->CYCCNT;
+}
+
+void delay_cycles_wait(uint32_t cycles)
+{
+  uint32_t start = DWT->CYCCNT;
+
+  /* Unsigned subtraction stays correct across one counter wrap */
+  while((DWT->CYCCNT - start) < cycles)
+  {
+  }
+}
+
+void delayus(uint32_t nus)
+{
+  uint32_t start = DWT->CYCCNT;
+  uint32_t chunk;
+  uint32_t cycles;
+
+  if((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0U)
+  {
+    delay_init();
+    start = DWT->CYCCNT;
+  }
+  else if(delay_core_clock != SystemCoreClock)
+  {
+    /* SystemCoreClockUpdate() changed the core clock since the last call */
+    delay_calibrate();
+  }
+
+  while(nus != 0U)
+  {
+    chunk = (nus > DELAY_MAX_CHUNK_US) ? DELAY_MAX_CHUNK_US : nus;
+    cycles = (chunk * delay_cyc_per_us)
+           + (uint32_t)(((uint64_t)chunk * delay_cyc_frac) / 1000000U);
+    while((DWT->CYCCNT - start) < cycles)
+    {
+    }
+    start += cycles;
+    nus -= chunk;
+  }
 }
 void delayms(uint32_t nms){
   while(nms--){
@@ -19,4 +91,4 @@ void delays (uint32_t ns){
   while(ns--){
      delayus(1000000);
   }
-}
\ No newline at end of file
+}
@@ -11,6 +11,13 @@ extern "C" {
 
 /* Function definitions ------------------------------------------------------*/
 
+/* Enables the DWT cycle counter used as delay timebase. Called lazily by
+   delayus() too, so an explicit call is only needed to avoid the first-call
+   setup cost. */
+void delay_init(void);
+uint32_t delay_cycles(void);
+void delay_cycles_wait(uint32_t cycles);
+
 void delayus(uint32_t nus);
 void delayms(uint32_t nms);
 void delays (uint32_t ns);
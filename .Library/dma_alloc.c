@@ -0,0 +1,439 @@
+/* Header includes -----------------------------------------------------------*/
+#include "dma_alloc.h"
+#include <string.h>
+
+/* Private macro -------------------------------------------------------------*/
+#define DMA_ALLOC_NONE          0xFFFFFFFFU
+
+/* Private variables ---------------------------------------------------------*/
+static const uint8_t dma_alloc_streams[DMA_ALLOC_CONTROLLERS] = { 8U, 8U, 8U, 16U };
+
+static const uint32_t dma_alloc_dma_priority[4] =
+{
+  DMA_PRIORITY_LOW, DMA_PRIORITY_MEDIUM, DMA_PRIORITY_HIGH, DMA_PRIORITY_VERY_HIGH
+};
+
+static const uint32_t dma_alloc_mdma_priority[4] =
+{
+  MDMA_PRIORITY_LOW, MDMA_PRIORITY_MEDIUM, MDMA_PRIORITY_HIGH, MDMA_PRIORITY_VERY_HIGH
+};
+
+static dma_alloc_stats_t dma_alloc_state;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t dma_alloc_base(uint32_t ctrl, uint32_t i)
+{
+  switch(ctrl)
+  {
+    case DMA_ALLOC_DMA1: return DMA1_Stream0_BASE + (i * 0x18U);
+    case DMA_ALLOC_DMA2: return DMA2_Stream0_BASE + (i * 0x18U);
+    case DMA_ALLOC_BDMA: return BDMA_Channel0_BASE + (i * 0x14U);
+    default:             return MDMA_Channel0_BASE + (i * 0x40U);
+  }
+}
+
+/* Controller and stream of an instance, DMA_ALLOC_NONE if it is none */
+static uint32_t dma_alloc_find(const void *instance, uint32_t *index)
+{
+  uint32_t a = (uint32_t)instance;
+  uint32_t ctrl;
+
+  for(ctrl = 0U; ctrl < DMA_ALLOC_CONTROLLERS; ctrl++)
+  {
+    *index = (a - dma_alloc_base(ctrl, 0U)) / (dma_alloc_base(ctrl, 1U) - dma_alloc_base(ctrl, 0U));
+    if((a >= dma_alloc_base(ctrl, 0U)) && (*index < dma_alloc_streams[ctrl]) &&
+       (a == dma_alloc_base(ctrl, *index)))
+    {
+      return ctrl;
+    }
+  }
+  return DMA_ALLOC_NONE;
+}
+
+static uint32_t dma_alloc_within(uint32_t start, uint32_t end, uint32_t base, uint32_t size)
+{
+  return ((start >= base) && (end <= base + size) && (end >= start)) ? 1U : 0U;
+}
+
+static uint32_t dma_alloc_overlaps(uint32_t start, uint32_t end, uint32_t base, uint32_t size)
+{
+  return ((start < base + size) && (end > base)) ? 1U : 0U;
+}
+
+/* 1 if the controller reaches all of [mem, mem + len) */
+static uint32_t dma_alloc_reach(uint32_t ctrl, const void *mem, uint32_t len)
+{
+  uint32_t start = (uint32_t)mem;
+  uint32_t end = start + len;
+
+  if((mem == NULL) || (len == 0U))
+  {
+    return 1U;
+  }
+  switch(ctrl)
+  {
+    case DMA_ALLOC_DMA1:
+    case DMA_ALLOC_DMA2:
+      return (dma_alloc_overlaps(start, end, D1_ITCMRAM_BASE, 0x10000U) ||
+              dma_alloc_overlaps(start, end, D1_DTCMRAM_BASE, 0x20000U)) ? 0U : 1U;
+    case DMA_ALLOC_BDMA:
+      return (dma_alloc_within(start, end, D3_SRAM_BASE, 0x10000U) ||
+              dma_alloc_within(start, end, D3_BKPSRAM_BASE, 0x1000U)) ? 1U : 0U;
+    default:
+      return 1U;
+  }
+}
+
+static uint32_t dma_alloc_reach_req(uint32_t ctrl, const dma_alloc_req_t *req)
+{
+  return (dma_alloc_reach(ctrl, req->mem, req->len) != 0U) &&
+         (dma_alloc_reach(ctrl, req->mem2, req->len2) != 0U) ? 1U : 0U;
+}
+
+static uint32_t dma_alloc_free_mask(uint32_t ctrl)
+{
+  const dma_alloc_ctrl_stats_t *c = &dma_alloc_state.ctrl[ctrl];
+  uint32_t mask = 0U;
+  uint32_t i;
+
+  for(i = 0U; i < dma_alloc_streams[ctrl]; i++)
+  {
+    if(c->stream[i].used == 0U)
+    {
+      mask |= 1UL << i;
+    }
+  }
+  return mask;
+}
+
+/* Sum of the classes on a controller, plus one per stream */
+static uint32_t dma_alloc_weight(uint32_t ctrl)
+{
+  const dma_alloc_ctrl_stats_t *c = &dma_alloc_state.ctrl[ctrl];
+  uint32_t weight = 0U;
+  uint32_t i;
+
+  for(i = 0U; i < dma_alloc_streams[ctrl]; i++)
+  {
+    if(c->stream[i].used != 0U)
+    {
+      weight += c->stream[i].cls + 1U;
+    }
+  }
+  return weight;
+}
+
+/* Take a stream of the first controller in the list with room, or of the
+   lightest one if prefer is 0. Streams of one priority are served in
+   stream order, so the upper classes get the low numbers. Returns the
+   instance, 0 if all are full; the caller counts the failure once it has
+   tried every controller. Interrupts off. */
+static uint32_t dma_alloc_take(const uint32_t *ctrls, uint32_t n, uint32_t prefer, const dma_alloc_req_t *req)
+{
+  dma_alloc_stream_stats_t *s;
+  uint32_t best = DMA_ALLOC_NONE;
+  uint32_t best_weight = 0U;
+  uint32_t weight;
+  uint32_t mask;
+  uint32_t i;
+
+  for(i = 0U; i < n; i++)
+  {
+    if(dma_alloc_free_mask(ctrls[i]) == 0U)
+    {
+      continue;
+    }
+    weight = dma_alloc_weight(ctrls[i]);
+    if((best == DMA_ALLOC_NONE) || (weight < best_weight))
+    {
+      best = ctrls[i];
+      best_weight = weight;
+      if(prefer != 0U)
+      {
+        break;
+      }
+    }
+  }
+  if(best == DMA_ALLOC_NONE)
+  {
+    return 0U;
+  }
+
+  mask = dma_alloc_free_mask(best);
+  i = (req->cls >= DMA_ALLOC_STREAM) ? __CLZ(__RBIT(mask)) : (31U - __CLZ(mask));
+  s = &dma_alloc_state.ctrl[best].stream[i];
+  s->used = 1U;
+  s->request = req->request;
+  s->cls = req->cls;
+  s->grants++;
+  return dma_alloc_base(best, i);
+}
+
+/* A request none of the controllers had a stream for */
+static void dma_alloc_fail(const uint32_t *ctrls, uint32_t n)
+{
+  uint32_t i;
+
+  for(i = 0U; i < n; i++)
+  {
+    dma_alloc_state.ctrl[ctrls[i]].failures++;
+  }
+}
+
+static uint32_t dma_alloc_enabled(uint32_t ctrl, uint32_t i)
+{
+  uint32_t base = dma_alloc_base(ctrl, i);
+
+  switch(ctrl)
+  {
+    case DMA_ALLOC_DMA1:
+    case DMA_ALLOC_DMA2:
+      return ((((DMA_Stream_TypeDef *)base)->CR & DMA_SxCR_EN) != 0U) ? 1U : 0U;
+    case DMA_ALLOC_BDMA:
+      return ((((BDMA_Channel_TypeDef *)base)->CCR & BDMA_CCR_EN) != 0U) ? 1U : 0U;
+    default:
+      return ((((MDMA_Channel_TypeDef *)base)->CCR & MDMA_CCR_EN) != 0U) ? 1U : 0U;
+  }
+}
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef dma_alloc_dma(DMA_HandleTypeDef *hdma, const dma_alloc_req_t *req)
+{
+  uint32_t ctrls[3];
+  uint32_t n = 0U;
+  uint32_t prefer = 0U;
+  uint32_t instance;
+  uint32_t primask;
+
+  if(req->cls > DMA_ALLOC_REALTIME)
+  {
+    dma_alloc_state.refused++;
+    return HAL_ERROR;
+  }
+  switch(req->mux)
+  {
+    case DMA_ALLOC_MUX1:
+      if(IS_DMA_REQUEST(req->request) && dma_alloc_reach_req(DMA_ALLOC_DMA1, req))
+      {
+        ctrls[n++] = DMA_ALLOC_DMA1;
+        ctrls[n++] = DMA_ALLOC_DMA2;
+      }
+      break;
+    case DMA_ALLOC_MUX2:
+      if(IS_BDMA_REQUEST(req->request) && dma_alloc_reach_req(DMA_ALLOC_BDMA, req))
+      {
+        ctrls[n++] = DMA_ALLOC_BDMA;
+      }
+      break;
+    case DMA_ALLOC_MEM:
+      /* D3 to D3 stays on the BDMA while it has room */
+      if((req->mem != NULL) && (req->mem2 != NULL) && dma_alloc_reach_req(DMA_ALLOC_BDMA, req))
+      {
+        ctrls[n++] = DMA_ALLOC_BDMA;
+        prefer = 1U;
+      }
+      if(dma_alloc_reach_req(DMA_ALLOC_DMA1, req))
+      {
+        ctrls[n++] = DMA_ALLOC_DMA1;
+        ctrls[n++] = DMA_ALLOC_DMA2;
+      }
+      break;
+    default:
+      break;
+  }
+  if(n == 0U)
+  {
+    dma_alloc_state.refused++;
+    return HAL_ERROR;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if(prefer != 0U)
+  {
+    /* BDMA first, then the lighter of DMA1/DMA2 */
+    instance = dma_alloc_take(ctrls, 1U, 1U, req);
+    if(instance == 0U)
+    {
+      instance = dma_alloc_take(&ctrls[1], n - 1U, 0U, req);
+    }
+  }
+  else
+  {
+    instance = dma_alloc_take(ctrls, n, 0U, req);
+  }
+  if(instance == 0U)
+  {
+    dma_alloc_fail(ctrls, n);
+  }
+  __set_PRIMASK(primask);
+  if(instance == 0U)
+  {
+    return HAL_BUSY;
+  }
+
+  hdma->Instance = (void *)instance;
+  hdma->Init.Request = (req->mux == DMA_ALLOC_MEM) ? DMA_REQUEST_MEM2MEM : req->request;
+  hdma->Init.Priority = dma_alloc_dma_priority[req->cls];
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef dma_alloc_mdma(MDMA_HandleTypeDef *hmdma, const dma_alloc_req_t *req)
+{
+  const uint32_t ctrl = DMA_ALLOC_MDMA;
+  uint32_t instance;
+  uint32_t primask;
+
+  if((req->cls > DMA_ALLOC_REALTIME) || !IS_MDMA_REQUEST(req->request))
+  {
+    dma_alloc_state.refused++;
+    return HAL_ERROR;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  instance = dma_alloc_take(&ctrl, 1U, 1U, req);
+  if(instance == 0U)
+  {
+    dma_alloc_fail(&ctrl, 1U);
+  }
+  __set_PRIMASK(primask);
+  if(instance == 0U)
+  {
+    return HAL_BUSY;
+  }
+
+  hmdma->Instance = (MDMA_Channel_TypeDef *)instance;
+  hmdma->Init.Request = req->request;
+  hmdma->Init.Priority = dma_alloc_mdma_priority[req->cls];
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef dma_alloc_reserve(const void *instance, uint32_t cls)
+{
+  dma_alloc_stream_stats_t *s;
+  HAL_StatusTypeDef status = HAL_OK;
+  uint32_t ctrl;
+  uint32_t i;
+  uint32_t primask;
+
+  ctrl = dma_alloc_find(instance, &i);
+  if((ctrl == DMA_ALLOC_NONE) || (cls > DMA_ALLOC_REALTIME))
+  {
+    return HAL_ERROR;
+  }
+  s = &dma_alloc_state.ctrl[ctrl].stream[i];
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if(s->used != 0U)
+  {
+    status = HAL_BUSY;
+  }
+  else
+  {
+    s->used = 1U;
+    s->request = DMA_ALLOC_NONE;
+    s->cls = cls;
+    s->grants++;
+  }
+  __set_PRIMASK(primask);
+  return status;
+}
+
+void dma_alloc_free(const void *instance)
+{
+  uint32_t ctrl;
+  uint32_t i;
+
+  ctrl = dma_alloc_find(instance, &i);
+  if(ctrl != DMA_ALLOC_NONE)
+  {
+    dma_alloc_state.ctrl[ctrl].stream[i].used = 0U;
+  }
+}
+
+void dma_alloc_sample(void)
+{
+  dma_alloc_ctrl_stats_t *c;
+  uint32_t classes[4];
+  uint32_t enabled;
+  uint32_t tied;
+  uint32_t ctrl;
+  uint32_t i;
+
+  for(ctrl = 0U; ctrl < DMA_ALLOC_CONTROLLERS; ctrl++)
+  {
+    c = &dma_alloc_state.ctrl[ctrl];
+    memset(classes, 0, sizeof(classes));
+    enabled = 0U;
+    tied = 0U;
+    /* Every stream, the allocator's or not: the arbiter sees them all */
+    for(i = 0U; i < dma_alloc_streams[ctrl]; i++)
+    {
+      if(dma_alloc_enabled(ctrl, i) != 0U)
+      {
+        c->stream[i].busy++;
+        enabled++;
+        if((c->stream[i].used != 0U) && (++classes[c->stream[i].cls] == 2U))
+        {
+          tied = 1U;
+        }
+      }
+    }
+    c->samples++;
+    if(enabled >= 2U)
+    {
+      c->contended++;
+    }
+    c->tied += tied;
+    if(enabled > c->peak)
+    {
+      c->peak = enabled;
+    }
+  }
+}
+
+uint32_t dma_alloc_load(const void *instance)
+{
+  const dma_alloc_ctrl_stats_t *c;
+  uint32_t ctrl;
+  uint32_t i;
+
+  ctrl = dma_alloc_find(instance, &i);
+  if(ctrl == DMA_ALLOC_NONE)
+  {
+    return 0U;
+  }
+  c = &dma_alloc_state.ctrl[ctrl];
+  return (c->samples == 0U) ? 0U : (uint32_t)(((uint64_t)c->stream[i].busy * 1000U) / c->samples);
+}
+
+const dma_alloc_stats_t *dma_alloc_stats(void)
+{
+  return &dma_alloc_state;
+}
+
+void dma_alloc_stats_reset(void)
+{
+  dma_alloc_ctrl_stats_t *c;
+  uint32_t ctrl;
+  uint32_t i;
+
+  /* Counters only, the allocations stay */
+  for(ctrl = 0U; ctrl < DMA_ALLOC_CONTROLLERS; ctrl++)
+  {
+    c = &dma_alloc_state.ctrl[ctrl];
+    c->samples = 0U;
+    c->contended = 0U;
+    c->tied = 0U;
+    c->peak = 0U;
+    c->failures = 0U;
+    for(i = 0U; i < DMA_ALLOC_STREAMS; i++)
+    {
+      c->stream[i].busy = 0U;
+      c->stream[i].grants = 0U;
+    }
+  }
+  dma_alloc_state.refused = 0U;
+}
@@ -0,0 +1,123 @@
+#ifndef __DMA_ALLOC_H
+#define __DMA_ALLOC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+
+/* DMA streams handed out on demand instead of assigned by hand. A driver
+   asks for a stream with its request, its buffer and a priority class and
+   gets the Instance and Init.Priority of its handle filled in; the rest of
+   the handle and HAL_DMA_Init() / HAL_MDMA_Init() stay with the driver.
+
+   Which controller serves a request follows the domains:
+   - DMAMUX1 requests (D1/D2 peripherals) go to DMA1 or DMA2, which reach
+     everything but the TCMs,
+   - DMAMUX2 requests (D3 peripherals) go to the BDMA, which only reaches
+     SRAM4 and the backup SRAM,
+   - MDMA requests and software requests go to the MDMA, which reaches
+     all memory, TCM included,
+   - memory to memory on a DMA handle goes to DMA1/DMA2, or to the BDMA
+     when both ends are in D3.
+   A buffer the controller cannot reach is refused.
+
+   Streams of one controller with the same priority are served in stream
+   number order, so the classes above DMA_ALLOC_NORMAL take the lowest free
+   stream and the others the highest; between DMA1 and DMA2 the one with
+   less priority weight allocated gets the stream.
+
+   Streams assigned outside the allocator (fixed channels of mdma_copy,
+   crc_stream, ...) are marked with dma_alloc_reserve(). Utilisation and
+   contention are sampled: call dma_alloc_sample() periodically, e.g. from
+   a timebase alarm, and read dma_alloc_stats(). */
+
+/* Exported constants --------------------------------------------------------*/
+#define DMA_ALLOC_STREAMS       16U             /* most streams per controller (MDMA) */
+
+/* Requests without a DMAMUX line, for dma_alloc_req_t.mux */
+#define DMA_ALLOC_MEM           0U              /* memory to memory */
+#define DMA_ALLOC_MUX1          1U              /* DMA_REQUEST_x */
+#define DMA_ALLOC_MUX2          2U              /* BDMA_REQUEST_x */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  DMA_ALLOC_DMA1 = 0U,
+  DMA_ALLOC_DMA2,
+  DMA_ALLOC_BDMA,
+  DMA_ALLOC_MDMA,
+  DMA_ALLOC_CONTROLLERS
+} dma_alloc_ctrl_t;
+
+/* Priority classes, low to high */
+typedef enum
+{
+  DMA_ALLOC_BULK = 0U,          /* background copies, logging */
+  DMA_ALLOC_NORMAL,             /* ordinary peripheral traffic */
+  DMA_ALLOC_STREAM,             /* continuous streams that must not overrun */
+  DMA_ALLOC_REALTIME            /* control loop data, latency bound */
+} dma_alloc_class_t;
+
+typedef struct
+{
+  uint32_t mux;                 /* DMA_ALLOC_MUX1/MUX2/MEM, ignored for the MDMA */
+  uint32_t request;             /* DMA_REQUEST_x, BDMA_REQUEST_x or MDMA_REQUEST_x */
+  uint32_t cls;                 /* dma_alloc_class_t */
+  const void *mem;              /* buffer, may be NULL to skip the check */
+  uint32_t len;
+  const void *mem2;             /* memory to memory: the other end */
+  uint32_t len2;
+} dma_alloc_req_t;
+
+typedef struct
+{
+  uint32_t used;                /* 1: allocated or reserved */
+  uint32_t request;
+  uint32_t cls;
+  uint32_t busy;                /* samples with the stream enabled */
+  uint32_t grants;              /* times allocated */
+} dma_alloc_stream_stats_t;
+
+typedef struct
+{
+  uint32_t samples;
+  uint32_t contended;           /* samples with two or more streams enabled */
+  uint32_t tied;                /* ... two or more of them in one class */
+  uint32_t peak;                /* most streams enabled at once */
+  uint32_t failures;            /* requests refused for want of a stream */
+  dma_alloc_stream_stats_t stream[DMA_ALLOC_STREAMS];
+} dma_alloc_ctrl_stats_t;
+
+typedef struct
+{
+  dma_alloc_ctrl_stats_t ctrl[DMA_ALLOC_CONTROLLERS];
+  uint32_t refused;             /* buffers out of reach, bad requests */
+} dma_alloc_stats_t;
+
+/* Function definitions ------------------------------------------------------*/
+/* Fill hdma->Instance, Init.Request and Init.Priority for a DMA1/DMA2/BDMA
+   stream. HAL_ERROR if the buffer is out of reach or the request does not
+   fit, HAL_BUSY if every stream that could serve it is taken. */
+HAL_StatusTypeDef dma_alloc_dma(DMA_HandleTypeDef *hdma, const dma_alloc_req_t *req);
+/* The same for an MDMA channel */
+HAL_StatusTypeDef dma_alloc_mdma(MDMA_HandleTypeDef *hmdma, const dma_alloc_req_t *req);
+/* Take a stream assigned by hand (a DMA/BDMA stream or MDMA channel
+   instance); HAL_BUSY if the allocator already handed it out */
+HAL_StatusTypeDef dma_alloc_reserve(const void *instance, uint32_t cls);
+void dma_alloc_free(const void *instance);
+
+/* Count enabled streams, from a periodic context */
+void dma_alloc_sample(void);
+/* Share of samples a stream was enabled, per mille */
+uint32_t dma_alloc_load(const void *instance);
+const dma_alloc_stats_t *dma_alloc_stats(void);
+void dma_alloc_stats_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,216 @@
+/* Header includes -----------------------------------------------------------*/
+#include "dma_cache.h"
+
+/* Private variables ---------------------------------------------------------*/
+#if defined ( __ICCARM__ )
+#pragma location = DMA_ARENA_SECTION
+static __ALIGNED(DMA_ARENA_SIZE) uint8_t dma_arena[DMA_ARENA_SIZE];
+#else
+static __ALIGNED(DMA_ARENA_SIZE) uint8_t dma_arena[DMA_ARENA_SIZE] __attribute__((section(DMA_ARENA_SECTION)));
+#endif
+
+static uint32_t dma_arena_used = 0U;
+static uint32_t dma_arena_ready = 0U;
+
+/* Private functions ---------------------------------------------------------*/
+/* 1 if [start, end) lies inside [base, base + size) */
+static uint32_t dma_cache_within(uint32_t start, uint32_t end, uint32_t base, uint32_t size)
+{
+  return ((start >= base) && (end <= base + size) && (end >= start)) ? 1U : 0U;
+}
+
+/* Function definitions ------------------------------------------------------*/
+uint32_t dma_cache_needed(const void *addr, uint32_t len)
+{
+  uint32_t start = (uint32_t)addr;
+  uint32_t end = start + len;
+
+  if((len == 0U) || ((SCB->CCR & SCB_CCR_DC_Msk) == 0U))
+  {
+    return 0U;
+  }
+
+  /* Regions the core does not cache under the default memory map */
+  if(dma_cache_within(start, end, D1_ITCMRAM_BASE, 0x10000U) ||
+     dma_cache_within(start, end, D1_DTCMRAM_BASE, 0x20000U) ||
+     dma_cache_within(start, end, PERIPH_BASE, 0x20000000U))
+  {
+    return 0U;
+  }
+
+  if((dma_arena_ready != 0U) &&
+     dma_cache_within(start, end, (uint32_t)dma_arena, DMA_ARENA_SIZE))
+  {
+    return 0U;
+  }
+
+  return 1U;
+}
+
+void dma_cache_clean(const void *addr, uint32_t len)
+{
+  uint32_t line;
+  uint32_t end;
+
+  if(dma_cache_needed(addr, len) == 0U)
+  {
+    return;
+  }
+
+  line = (uint32_t)addr & ~(DMA_CACHE_LINE - 1U);
+  end = (uint32_t)addr + len;
+
+  __DSB();
+  while(line < end)
+  {
+    SCB->DCCMVAC = line;
+    line += DMA_CACHE_LINE;
+  }
+  __DSB();
+  __ISB();
+}
+
+void dma_cache_invalidate(void *addr, uint32_t len)
+{
+  uint32_t first;
+  uint32_t last;
+  uint32_t start = (uint32_t)addr;
+  uint32_t end = start + len;
+
+  if(dma_cache_needed(addr, len) == 0U)
+  {
+    return;
+  }
+
+  first = start & ~(DMA_CACHE_LINE - 1U);
+  last = (end + DMA_CACHE_LINE - 1U) & ~(DMA_CACHE_LINE - 1U);
+
+  __DSB();
+
+  /* Partial lines also hold bytes outside the buffer: write them back
+     before dropping the line */
+  if(first != start)
+  {
+    SCB->DCCIMVAC = first;
+    first += DMA_CACHE_LINE;
+  }
+  if((first < last) && (last != end))
+  {
+    last -= DMA_CACHE_LINE;
+    SCB->DCCIMVAC = last;
+  }
+
+  while(first < last)
+  {
+    SCB->DCIMVAC = first;
+    first += DMA_CACHE_LINE;
+  }
+
+  __DSB();
+  __ISB();
+}
+
+void dma_cache_flush(void *addr, uint32_t len)
+{
+  uint32_t line;
+  uint32_t end;
+
+  if(dma_cache_needed(addr, len) == 0U)
+  {
+    return;
+  }
+
+  line = (uint32_t)addr & ~(DMA_CACHE_LINE - 1U);
+  end = (uint32_t)addr + len;
+
+  __DSB();
+  while(line < end)
+  {
+    SCB->DCCIMVAC = line;
+    line += DMA_CACHE_LINE;
+  }
+  __DSB();
+  __ISB();
+}
+
+void dma_arena_init(void)
+{
+  MPU_Region_InitTypeDef region;
+  uint32_t ctrl;
+
+  if(dma_arena_ready != 0U)
+  {
+    return;
+  }
+
+  /* Nothing of the arena may stay in the cache once it is mapped uncached */
+  dma_cache_flush(dma_arena, DMA_ARENA_SIZE);
+
+  ctrl = MPU->CTRL;
+  HAL_MPU_Disable();
+
+  region.Enable = MPU_REGION_ENABLE;
+  region.Number = DMA_ARENA_MPU_REGION;
+  region.BaseAddress = (uint32_t)dma_arena;
+  /* Size field is log2(size) - 1 */
+  region.Size = (uint8_t)(30U - __CLZ(DMA_ARENA_SIZE));
+  region.SubRegionDisable = 0x00U;
+  region.TypeExtField = MPU_TEX_LEVEL1;           /* normal, non-cacheable */
+  region.AccessPermission = MPU_REGION_FULL_ACCESS;
+  region.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+  region.IsShareable = MPU_ACCESS_NOT_SHAREABLE;
+  region.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
+  region.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+  HAL_MPU_ConfigRegion(&region);
+
+  if((ctrl & MPU_CTRL_ENABLE_Msk) != 0U)
+  {
+    HAL_MPU_Enable(ctrl & ~MPU_CTRL_ENABLE_Msk);
+  }
+  else
+  {
+    HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
+  }
+
+  dma_arena_ready = 1U;
+}
+
+void *dma_arena_alloc(uint32_t size)
+{
+  uint32_t primask;
+  void *block = NULL;
+
+  size = DMA_CACHE_ROUND(size);
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  if((dma_arena_ready != 0U) && (size != 0U) && (size <= DMA_ARENA_SIZE - dma_arena_used))
+  {
+    block = &dma_arena[dma_arena_used];
+    dma_arena_used += size;
+  }
+
+  __set_PRIMASK(primask);
+
+  return block;
+}
+
+uint32_t dma_arena_available(void)
+{
+  return (dma_arena_ready != 0U) ? (DMA_ARENA_SIZE - dma_arena_used) : 0U;
+}
+
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+/* The HAL drivers call these hooks; their __weak defaults in stm32h7xx_hal.c
+   do not know about TCM or the arena */
+void HAL_DMA_CacheClean(const void *addr, uint32_t len)
+{
+  dma_cache_clean(addr, len);
+}
+
+void HAL_DMA_CacheInvalidate(void *addr, uint32_t len)
+{
+  dma_cache_invalidate(addr, len);
+}
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
@@ -0,0 +1,79 @@
+#ifndef __DMA_CACHE_H
+#define __DMA_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+
+/* D-cache coherency for DMA buffers. The CMSIS SCB_*DCache_by_Addr helpers
+   expect a line aligned address; given an unaligned one they walk from the
+   line the address falls in and stop a line short, so the tail of the buffer
+   is silently left alone. The functions here round the range out to whole
+   32-byte lines, skip memory the core never caches (TCM, peripherals, the DMA
+   arena) and do nothing while the D-cache is off.
+
+   Rules for a transfer:
+     memory -> peripheral   dma_cache_clean() before the start
+     peripheral -> memory   dma_cache_invalidate() before the start and again
+                            on completion (speculative reads can refill lines
+                            while the DMA is writing)
+   A receive buffer that shares its first or last line with other data gets
+   that line cleaned before it is invalidated so the neighbour survives; the
+   neighbour must then not be written by the CPU until the transfer is done.
+
+   With USE_HAL_DMA_CACHE_MAINTENANCE set in stm32h7xx_hal_conf.h the SPI,
+   UART, SD and ETH drivers call HAL_DMA_CacheClean()/HAL_DMA_CacheInvalidate();
+   this file provides them on top of the functions below, so the HAL itself
+   builds without .Library.
+
+   The DMA arena is the alternative: a block the MPU maps normal
+   non-cacheable, handed out by dma_arena_alloc(), which never needs
+   maintenance at all. */
+
+/* Exported constants --------------------------------------------------------*/
+#define DMA_CACHE_LINE          32U
+
+/* Size of the non-cacheable arena, a power of two from 32 bytes to 4 GB. The
+   MPU needs the base aligned to the size. */
+#ifndef DMA_ARENA_SIZE
+#define DMA_ARENA_SIZE          (16U * 1024U)
+#endif
+#define DMA_ARENA_SECTION       ".dma_arena"
+#ifndef DMA_ARENA_MPU_REGION
+#define DMA_ARENA_MPU_REGION    MPU_REGION_NUMBER15
+#endif
+
+#if ((DMA_ARENA_SIZE & (DMA_ARENA_SIZE - 1U)) != 0U) || (DMA_ARENA_SIZE < 32U)
+#error "dma_cache: DMA_ARENA_SIZE must be a power of two >= 32"
+#endif
+
+/* Exported macro ------------------------------------------------------------*/
+/* Round up to a whole number of cache lines, for sizing buffers */
+#define DMA_CACHE_ROUND(size)   ((((uint32_t)(size)) + DMA_CACHE_LINE - 1U) & ~(DMA_CACHE_LINE - 1U))
+
+/* Function definitions ------------------------------------------------------*/
+/* Write dirty lines of [addr, addr + len) back to memory */
+void dma_cache_clean(const void *addr, uint32_t len);
+/* Drop cached lines of [addr, addr + len), see above for partial lines */
+void dma_cache_invalidate(void *addr, uint32_t len);
+/* Clean then drop, for buffers the DMA both reads and writes */
+void dma_cache_flush(void *addr, uint32_t len);
+/* 1 if the range may be held in the D-cache and needs maintenance */
+uint32_t dma_cache_needed(const void *addr, uint32_t len);
+
+/* Map the arena non-cacheable with the MPU. Call once before allocating;
+   keeps the MPU enable state and the other regions as they are. */
+void dma_arena_init(void);
+/* size bytes rounded up to whole cache lines, NULL once the arena is full
+   or before dma_arena_init(). Allocations are never freed. */
+void *dma_arena_alloc(uint32_t size);
+uint32_t dma_arena_available(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
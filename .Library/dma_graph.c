@@ -0,0 +1,297 @@
+/* Header includes -----------------------------------------------------------*/
+#include "dma_graph.h"
+
+/* Private macro -------------------------------------------------------------*/
+#define DMA_GRAPH_MUX1          0x100U
+#define DMA_GRAPH_MUX2          0x200U
+#define DMA_GRAPH_MUX(ch)       ((ch) & 0x300U)
+#define DMA_GRAPH_INDEX(ch)     ((ch) & 0xFFU)
+#define DMA_GRAPH_NO_NODE       0xFFU
+
+/* Private functions ---------------------------------------------------------*/
+/* DMAMUX channel behind a stream, DMA_GRAPH_NONE if it has none */
+static uint32_t dma_graph_channel(const void *instance)
+{
+  uint32_t a = (uint32_t)instance;
+
+  if((a >= DMA1_Stream0_BASE) && (a <= DMA1_Stream7_BASE))
+  {
+    return DMA_GRAPH_MUX1 | ((a - DMA1_Stream0_BASE) / 0x18U);
+  }
+  if((a >= DMA2_Stream0_BASE) && (a <= DMA2_Stream7_BASE))
+  {
+    return DMA_GRAPH_MUX1 | (8U + ((a - DMA2_Stream0_BASE) / 0x18U));
+  }
+  if((a >= BDMA_Channel0_BASE) && (a <= BDMA_Channel7_BASE))
+  {
+    return DMA_GRAPH_MUX2 | ((a - BDMA_Channel0_BASE) / 0x14U);
+  }
+  return DMA_GRAPH_NONE;
+}
+
+static inline uint32_t dma_graph_is_gen(uint32_t request)
+{
+  /* DMA_REQUEST_GENERATOR0..7 and BDMA_REQUEST_GENERATOR0..7 are both 1..8 */
+  return ((request >= DMA_REQUEST_GENERATOR0) && (request <= DMA_REQUEST_GENERATOR7)) ? 1U : 0U;
+}
+
+/* Node whose channel event a signal is, DMA_GRAPH_NO_NODE for an outside
+   signal; DMA_GRAPH_NONE if the node is not there or makes no event */
+static uint32_t dma_graph_source(const dma_graph_t *g, uint32_t mux, uint32_t signal, uint32_t gen)
+{
+  uint32_t ch;
+  uint32_t i;
+
+  if(mux == DMA_GRAPH_MUX1)
+  {
+    if(signal >= 3U)
+    {
+      return DMA_GRAPH_NO_NODE;
+    }
+  }
+  else if(signal >= ((gen != 0U) ? 7U : 6U))
+  {
+    return DMA_GRAPH_NO_NODE;
+  }
+  ch = mux | signal;
+  for(i = 0U; i < g->count; i++)
+  {
+    if((g->nodes[i].channel == ch) && (g->nodes[i].event != 0U))
+    {
+      return i;
+    }
+  }
+  return DMA_GRAPH_NONE;
+}
+
+static uint32_t dma_graph_check(const dma_graph_node_t *n)
+{
+  uint32_t mux = DMA_GRAPH_MUX(n->channel);
+  uint32_t gen = dma_graph_is_gen(n->request);
+
+  if((n->hdma == NULL) || (dma_graph_channel(n->hdma->Instance) != n->channel))
+  {
+    return 0U;
+  }
+  if(gen != 0U)
+  {
+    if((n->gen_count == 0U) || (n->gen_count > 32U) ||
+       ((mux == DMA_GRAPH_MUX1) ? !IS_DMA_DMAMUX_REQUEST_GEN_SIGNAL_ID(n->gen_signal) :
+                                  !IS_BDMA_DMAMUX_REQUEST_GEN_SIGNAL_ID(n->gen_signal)))
+    {
+      return 0U;
+    }
+  }
+  if((n->sync_signal != DMA_GRAPH_NONE) &&
+     ((mux == DMA_GRAPH_MUX1) ? !IS_DMA_DMAMUX_SYNC_SIGNAL_ID(n->sync_signal) :
+                                !IS_BDMA_DMAMUX_SYNC_SIGNAL_ID(n->sync_signal)))
+  {
+    return 0U;
+  }
+  if(((n->sync_signal != DMA_GRAPH_NONE) || (n->event != 0U)) && ((n->count == 0U) || (n->count > 32U)))
+  {
+    return 0U;
+  }
+  return 1U;
+}
+
+/* Streams are armed in order of their distance to the end of their chain,
+   the nodes nothing else waits on first. A loop never settles. */
+static HAL_StatusTypeDef dma_graph_order(dma_graph_t *g, const uint8_t (*up)[2])
+{
+  uint8_t height[DMA_GRAPH_MAX] = {0U};
+  uint32_t changed = 1U;
+  uint32_t pass;
+  uint32_t i;
+  uint32_t j;
+  uint32_t k;
+  uint8_t t;
+
+  for(pass = 0U; (pass <= g->count) && (changed != 0U); pass++)
+  {
+    changed = 0U;
+    for(i = 0U; i < g->count; i++)
+    {
+      for(j = 0U; j < 2U; j++)
+      {
+        k = up[i][j];
+        if((k != DMA_GRAPH_NO_NODE) && (height[k] <= height[i]))
+        {
+          height[k] = height[i] + 1U;
+          changed = 1U;
+        }
+      }
+    }
+  }
+  if(changed != 0U)
+  {
+    return HAL_ERROR;
+  }
+
+  for(i = 0U; i < g->count; i++)
+  {
+    g->order[i] = (uint8_t)i;
+  }
+  for(i = 1U; i < g->count; i++)
+  {
+    t = g->order[i];
+    for(j = i; (j > 0U) && (height[g->order[j - 1U]] > height[t]); j--)
+    {
+      g->order[j] = g->order[j - 1U];
+    }
+    g->order[j] = t;
+  }
+  return HAL_OK;
+}
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef dma_graph_init(dma_graph_t *g, const dma_graph_node_t *nodes, uint32_t count)
+{
+  uint8_t up[DMA_GRAPH_MAX][2];
+  const dma_graph_node_t *n;
+  HAL_DMA_MuxSyncConfigTypeDef sync;
+  HAL_DMA_MuxRequestGeneratorConfigTypeDef rg;
+  uint32_t channels = 0U;
+  uint32_t gens = 0U;
+  uint32_t mux;
+  uint32_t bit;
+  uint32_t src;
+  uint32_t i;
+
+  if((count == 0U) || (count > DMA_GRAPH_MAX))
+  {
+    return HAL_ERROR;
+  }
+  g->nodes = nodes;
+  g->count = count;
+  g->running = 0U;
+
+  for(i = 0U; i < count; i++)
+  {
+    n = &nodes[i];
+    if(dma_graph_check(n) == 0U)
+    {
+      return HAL_ERROR;
+    }
+    mux = DMA_GRAPH_MUX(n->channel);
+
+    /* Each DMAMUX channel and request generator once */
+    bit = 1UL << (DMA_GRAPH_INDEX(n->channel) + ((mux == DMA_GRAPH_MUX1) ? 0U : 16U));
+    if((channels & bit) != 0U)
+    {
+      return HAL_ERROR;
+    }
+    channels |= bit;
+    if(dma_graph_is_gen(n->request) != 0U)
+    {
+      bit = 1UL << ((n->request - DMA_REQUEST_GENERATOR0) + ((mux == DMA_GRAPH_MUX1) ? 0U : 8U));
+      if((gens & bit) != 0U)
+      {
+        return HAL_ERROR;
+      }
+      gens |= bit;
+    }
+
+    /* A chained signal needs its node, generating events */
+    up[i][0] = DMA_GRAPH_NO_NODE;
+    up[i][1] = DMA_GRAPH_NO_NODE;
+    if(n->sync_signal != DMA_GRAPH_NONE)
+    {
+      src = dma_graph_source(g, mux, n->sync_signal, 0U);
+      if(src == DMA_GRAPH_NONE)
+      {
+        return HAL_ERROR;
+      }
+      up[i][0] = (uint8_t)src;
+    }
+    if(dma_graph_is_gen(n->request) != 0U)
+    {
+      src = dma_graph_source(g, mux, n->gen_signal, 1U);
+      if(src == DMA_GRAPH_NONE)
+      {
+        return HAL_ERROR;
+      }
+      up[i][1] = (uint8_t)src;
+    }
+  }
+  if(dma_graph_order(g, (const uint8_t (*)[2])up) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  for(i = 0U; i < count; i++)
+  {
+    n = &nodes[i];
+    n->hdma->Init.Request = n->request;
+    if(HAL_DMA_Init(n->hdma) != HAL_OK)
+    {
+      return HAL_ERROR;
+    }
+    /* After the init, which clears the DMAMUX channel */
+    if((n->sync_signal != DMA_GRAPH_NONE) || (n->event != 0U))
+    {
+      sync.SyncSignalID = (n->sync_signal != DMA_GRAPH_NONE) ? n->sync_signal : 0U;
+      sync.SyncPolarity = (n->sync_signal != DMA_GRAPH_NONE) ? n->sync_polarity : HAL_DMAMUX_SYNC_NO_EVENT;
+      sync.SyncEnable = (n->sync_signal != DMA_GRAPH_NONE) ? ENABLE : DISABLE;
+      sync.EventEnable = (n->event != 0U) ? ENABLE : DISABLE;
+      sync.RequestNumber = n->count;
+      if(HAL_DMAEx_ConfigMuxSync(n->hdma, &sync) != HAL_OK)
+      {
+        return HAL_ERROR;
+      }
+    }
+    if(dma_graph_is_gen(n->request) != 0U)
+    {
+      rg.SignalID = n->gen_signal;
+      rg.Polarity = n->gen_polarity;
+      rg.RequestNumber = n->gen_count;
+      if(HAL_DMAEx_ConfigMuxRequestGenerator(n->hdma, &rg) != HAL_OK)
+      {
+        return HAL_ERROR;
+      }
+    }
+  }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef dma_graph_start(dma_graph_t *g)
+{
+  const dma_graph_node_t *n;
+  uint32_t i;
+
+  for(i = 0U; i < g->count; i++)
+  {
+    n = &g->nodes[g->order[i]];
+    if((n->len != 0U) && (HAL_DMA_Start(n->hdma, n->src, n->dst, n->len) != HAL_OK))
+    {
+      dma_graph_stop(g);
+      return HAL_ERROR;
+    }
+    if(dma_graph_is_gen(n->request) != 0U)
+    {
+      (void)HAL_DMAEx_EnableMuxRequestGenerator(n->hdma);
+    }
+  }
+  g->running = 1U;
+  return HAL_OK;
+}
+
+void dma_graph_stop(dma_graph_t *g)
+{
+  const dma_graph_node_t *n;
+  uint32_t i;
+
+  for(i = g->count; i > 0U; i--)
+  {
+    n = &g->nodes[g->order[i - 1U]];
+    if(dma_graph_is_gen(n->request) != 0U)
+    {
+      (void)HAL_DMAEx_DisableMuxRequestGenerator(n->hdma);
+    }
+    if((n->len != 0U) && (n->hdma->State == HAL_DMA_STATE_BUSY))
+    {
+      (void)HAL_DMA_Abort(n->hdma);
+    }
+  }
+  g->running = 0U;
+}
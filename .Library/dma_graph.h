@@ -0,0 +1,106 @@
+#ifndef __DMA_GRAPH_H
+#define __DMA_GRAPH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+
+/* DMA streams that trigger each other through the DMAMUX, set up from a
+   table. Each node is one DMA1/DMA2 stream or BDMA channel with its DMAMUX
+   channel: a peripheral request or a request generator, optional
+   synchronization, and optionally an event every `count` requests. A
+   node's event is the sync or generator signal of the nodes after it, so a
+   chain such as
+
+     TIM12 TRGO -> generator 0 -> DMA1 stream 0 (event every 4 requests)
+                -> sync of DMA1 stream 1 -> ...
+
+   runs with no interrupt in between. Only DMAMUX1 channels 0..2 (DMA1
+   streams 0..2) and DMAMUX2 channels 0..6 (BDMA channels 0..6, 0..5 as a
+   sync signal) have their event routed back into the multiplexer.
+
+   Mistakes that can be seen in one table entry are compile errors: build
+   channels, chained signals and counts with the DMA_GRAPH_* macros below,
+   and list the channels and generators of a graph in DMA_GRAPH_UNIQUE() to
+   have a resource used twice refused by the compiler. What needs the whole
+   table (the stream behind a handle, a signal from a node that is missing
+   or generates no event, loops) is checked by dma_graph_init(), which also
+   works out the order to arm the streams: those at the end of the chains
+   first, so nothing fires into a stream that is not running yet. */
+
+/* Exported constants --------------------------------------------------------*/
+#define DMA_GRAPH_MAX           24U             /* DMAMUX1 and DMAMUX2 channels */
+#define DMA_GRAPH_NONE          0xFFFFFFFFU     /* no sync / no generator signal */
+
+/* Exported macro ------------------------------------------------------------*/
+/* Constant v, or a compile error (negative array size) when ok is false */
+#define DMA_GRAPH_CHECK(v, ok)  ((v) + (0U * sizeof(char[(ok) ? 1 : -1])))
+
+/* DMAMUX channel of a node: DMAMUX1 n = DMA1 stream n (0..7) and DMA2
+   stream n - 8 (8..15), DMAMUX2 n = BDMA channel n */
+#define DMA_GRAPH_CH1(n)        DMA_GRAPH_CHECK(0x100U | (n), (n) < 16U)
+#define DMA_GRAPH_CH2(n)        DMA_GRAPH_CHECK(0x200U | (n), (n) < 8U)
+/* Event of DMAMUX1 channel n as sync or generator signal */
+#define DMA_GRAPH_EVT1(n)       DMA_GRAPH_CHECK((uint32_t)(n), (n) < 3U)
+/* Event of DMAMUX2 channel n as sync signal / as generator signal */
+#define DMA_GRAPH_SYNC_EVT2(n)  DMA_GRAPH_CHECK((uint32_t)(n), (n) < 6U)
+#define DMA_GRAPH_GEN_EVT2(n)   DMA_GRAPH_CHECK((uint32_t)(n), (n) < 7U)
+/* Requests per sync edge, per event or per generator edge */
+#define DMA_GRAPH_COUNT(n)      DMA_GRAPH_CHECK((uint32_t)(n), ((n) >= 1U) && ((n) <= 32U))
+/* Request generators, for DMA_GRAPH_UNIQUE() */
+#define DMA_GRAPH_RG1(n)        DMA_GRAPH_CHECK(0x500U | (n), (n) < 8U)
+#define DMA_GRAPH_RG2(n)        DMA_GRAPH_CHECK(0x600U | (n), (n) < 8U)
+
+/* DMA_GRAPH_UNIQUE(name, DMA_GRAPH_USES(DMA_GRAPH_CH1(0)) DMA_GRAPH_USES(...))
+   at file scope: two equal case labels if a resource is listed twice */
+#define DMA_GRAPH_USES(id)      case (id):
+#define DMA_GRAPH_UNIQUE(name, uses) \
+  static inline void name##_unique(uint32_t id) { switch(id) { uses break; default: break; } }
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  DMA_HandleTypeDef *hdma;      /* Init filled in but for Request */
+  uint32_t channel;             /* DMA_GRAPH_CH1/CH2, the DMAMUX channel of hdma */
+  uint32_t request;             /* peripheral request, or DMA_REQUEST_GENERATORn / BDMA_REQUEST_GENERATORn */
+
+  uint32_t gen_signal;          /* with a generator: HAL_DMAMUXx_REQ_GEN_* or a chained event */
+  uint32_t gen_polarity;        /* HAL_DMAMUX_REQ_GEN_RISING... */
+  uint32_t gen_count;           /* requests per generator edge */
+
+  uint32_t sync_signal;         /* HAL_DMAMUXx_SYNC_*, a chained event or DMA_GRAPH_NONE */
+  uint32_t sync_polarity;       /* HAL_DMAMUX_SYNC_RISING... */
+  uint32_t count;               /* requests per sync edge and per event */
+  uint32_t event;               /* 1: event every count requests */
+
+  uint32_t src;                 /* transfer armed by dma_graph_start(); */
+  uint32_t dst;                 /* len 0: started by its owner instead */
+  uint32_t len;
+} dma_graph_node_t;
+
+typedef struct
+{
+  const dma_graph_node_t *nodes;
+  uint32_t count;
+
+  uint8_t order[DMA_GRAPH_MAX]; /* arm order, chain ends first */
+  uint32_t running;
+} dma_graph_t;
+
+/* Function definitions ------------------------------------------------------*/
+/* Check the table and set up every stream, sync and generator; nothing
+   runs yet. HAL_ERROR for a table that cannot work. */
+HAL_StatusTypeDef dma_graph_init(dma_graph_t *g, const dma_graph_node_t *nodes, uint32_t count);
+/* Arm the streams and enable the generators, chain ends first */
+HAL_StatusTypeDef dma_graph_start(dma_graph_t *g);
+/* Generators off and streams aborted, chain starts first */
+void dma_graph_stop(dma_graph_t *g);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,396 @@
+/* Header includes -----------------------------------------------------------*/
+#include "dsp.h"
+#include "stm32h7xx_hal.h"
+#include <math.h>
+#include <string.h>
+
+/* Private functions ---------------------------------------------------------*/
+#if DSP_SIMD
+/* Two Q15 values as one word, the first in the low half. memcpy keeps the
+   type punning legal and compiles to a single, possibly unaligned, LDR/STR. */
+__STATIC_FORCEINLINE uint32_t dsp_ld2(const int16_t *p)
+{
+  uint32_t v;
+
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+__STATIC_FORCEINLINE void dsp_st2(int16_t *p, uint32_t v)
+{
+  memcpy(p, &v, sizeof(v));
+}
+
+/* Sum of a[k] * b[k], two products per SMLALD */
+__STATIC_FORCEINLINE int64_t dsp_mac_q15(const int16_t *a, const int16_t *b, uint32_t len)
+{
+  int64_t acc = 0;
+  uint32_t i = len >> 2;
+
+  while(i-- != 0U)
+  {
+    acc = (int64_t)__SMLALD(dsp_ld2(a), dsp_ld2(b), acc);
+    acc = (int64_t)__SMLALD(dsp_ld2(a + 2), dsp_ld2(b + 2), acc);
+    a += 4;
+    b += 4;
+  }
+  i = len & 3U;
+  while(i-- != 0U)
+  {
+    acc += (int32_t)*a++ * *b++;
+  }
+  return acc;
+}
+
+/* x * w for packed Q15 complex values: SMUSD gives re, SMUADX im */
+__STATIC_FORCEINLINE uint32_t dsp_cmul_q15(uint32_t x, uint32_t w)
+{
+  int32_t re = __SSAT((int32_t)__SMUSD(x, w) >> 15, 16);
+  int32_t im = __SSAT((int32_t)__SMUADX(x, w) >> 15, 16);
+
+  return __PKHBT(re, im, 16);
+}
+#endif /* DSP_SIMD */
+
+__STATIC_FORCEINLINE int64_t dsp_mac_q31(const int32_t *a, const int32_t *b, uint32_t len)
+{
+  int64_t acc = 0;
+  uint32_t i = len >> 2;
+
+  while(i-- != 0U)
+  {
+    acc += (int64_t)a[0] * b[0];
+    acc += (int64_t)a[1] * b[1];
+    acc += (int64_t)a[2] * b[2];
+    acc += (int64_t)a[3] * b[3];
+    a += 4;
+    b += 4;
+  }
+  i = len & 3U;
+  while(i-- != 0U)
+  {
+    acc += (int64_t)*a++ * *b++;
+  }
+  return acc;
+}
+
+/* Function definitions ------------------------------------------------------*/
+#if DSP_SIMD
+int64_t dsp_dot_q15(const int16_t *a, const int16_t *b, uint32_t len)
+{
+  return dsp_mac_q15(a, b, len);
+}
+
+int16_t dsp_rms_q15(const int16_t *src, uint32_t len)
+{
+  uint32_t root = dsp_isqrt((uint64_t)dsp_mac_q15(src, src, len) / len);
+
+  return (int16_t)((root > 32767U) ? 32767U : root);
+}
+
+void dsp_fir_q15(dsp_fir_q15_t *f, const int16_t *src, int16_t *dst, uint32_t len)
+{
+  uint32_t hist = f->taps - 1U;
+  uint32_t n;
+
+  memcpy(&f->state[hist], src, len * sizeof(*src));
+  for(n = 0U; n < len; n++)
+  {
+    dst[n] = dsp_sat_q15(dsp_mac_q15(f->coeffs, &f->state[n], f->taps) >> 15);
+  }
+  memmove(f->state, &f->state[len], hist * sizeof(*src));
+}
+
+void dsp_decimate_q15(dsp_fir_q15_t *f, const int16_t *src, int16_t *dst, uint32_t len)
+{
+  uint32_t hist = f->taps - 1U;
+  uint32_t n;
+
+  memcpy(&f->state[hist], src, len * sizeof(*src));
+  for(n = f->factor - 1U; n < len; n += f->factor)
+  {
+    *dst++ = dsp_sat_q15(dsp_mac_q15(f->coeffs, &f->state[n], f->taps) >> 15);
+  }
+  memmove(f->state, &f->state[len], hist * sizeof(*src));
+}
+
+/* The x and y histories live packed in registers, one SMLALD each */
+void dsp_biquad_q15(dsp_biquad_q15_t *f, const int16_t *src, int16_t *dst, uint32_t len)
+{
+  const int16_t *c = f->coeffs;
+  int16_t *s = f->state;
+  uint32_t shift = 15U - f->shift;
+  uint32_t stage;
+  uint32_t n;
+  uint32_t b12, a12, x12, y12;
+  int32_t b0;
+  int64_t acc;
+  int16_t x;
+  int16_t y;
+
+  for(stage = 0U; stage < f->stages; stage++)
+  {
+    b0 = c[0];
+    b12 = __PKHBT(c[1], c[2], 16);
+    a12 = __PKHBT(c[3], c[4], 16);
+    x12 = __PKHBT(s[0], s[1], 16);
+    y12 = __PKHBT(s[2], s[3], 16);
+    for(n = 0U; n < len; n++)
+    {
+      x = src[n];
+      acc = b0 * x;
+      acc = (int64_t)__SMLALD(b12, x12, acc);
+      acc = (int64_t)__SMLALD(a12, y12, acc);
+      y = dsp_sat_q15(acc >> shift);
+      x12 = __PKHBT(x, x12, 16);
+      y12 = __PKHBT(y, y12, 16);
+      dst[n] = y;
+    }
+    s[0] = (int16_t)x12;
+    s[1] = (int16_t)(x12 >> 16);
+    s[2] = (int16_t)y12;
+    s[3] = (int16_t)(y12 >> 16);
+    src = dst;
+    c += 5;
+    s += 4;
+  }
+}
+
+/* The butterfly of dsp_cfft_q15_ref() on packed re/im words: the halving
+   SHADD16/SHSUB16 do the 1/4 scaling, SHSAX/SHASX add the j-rotated
+   quarter, three complex products per butterfly */
+void dsp_cfft_q15(const dsp_cfft_q15_t *f, int16_t *data)
+{
+  const int16_t *tw = f->twiddle;
+  uint32_t n = f->n;
+  uint32_t span;
+  uint32_t q;
+  uint32_t step = 1U;
+  uint32_t g;
+  uint32_t k;
+  uint32_t i;
+  uint32_t j;
+  int16_t *a;
+  uint32_t xa, xb, xc, xd;
+  uint32_t t0, t1, t2, t3;
+
+  for(span = n; span >= 4U; span >>= 2)
+  {
+    q = 2U * (span >> 2);
+    for(g = 0U; g < n; g += span)
+    {
+      for(k = 0U; k < (span >> 2); k++)
+      {
+        a = &data[2U * (g + k)];
+        xa = dsp_ld2(a);
+        xb = dsp_ld2(a + q);
+        xc = dsp_ld2(a + (2U * q));
+        xd = dsp_ld2(a + (3U * q));
+        t0 = __SHADD16(xa, xc);
+        t1 = __SHSUB16(xa, xc);
+        t2 = __SHADD16(xb, xd);
+        t3 = __SHSUB16(xb, xd);
+        xa = __SHADD16(t0, t2);
+        xb = __SHSAX(t1, t3);
+        xc = __SHSUB16(t0, t2);
+        xd = __SHASX(t1, t3);
+        if(k != 0U)
+        {
+          xb = dsp_cmul_q15(xb, dsp_ld2(&tw[2U * k * step]));
+          xc = dsp_cmul_q15(xc, dsp_ld2(&tw[4U * k * step]));
+          xd = dsp_cmul_q15(xd, dsp_ld2(&tw[6U * k * step]));
+        }
+        dsp_st2(a, xa);
+        dsp_st2(a + q, xb);
+        dsp_st2(a + (2U * q), xc);
+        dsp_st2(a + (3U * q), xd);
+      }
+    }
+    step <<= 2;
+  }
+
+  for(i = 0U; i < n; i++)
+  {
+    j = dsp_digit_rev(i, f->stages);
+    if(j > i)
+    {
+      xa = dsp_ld2(&data[2U * i]);
+      dsp_st2(&data[2U * i], dsp_ld2(&data[2U * j]));
+      dsp_st2(&data[2U * j], xa);
+    }
+  }
+}
+#else
+int64_t dsp_dot_q15(const int16_t *a, const int16_t *b, uint32_t len)
+{
+  return dsp_dot_q15_ref(a, b, len);
+}
+
+int16_t dsp_rms_q15(const int16_t *src, uint32_t len)
+{
+  return dsp_rms_q15_ref(src, len);
+}
+
+void dsp_fir_q15(dsp_fir_q15_t *f, const int16_t *src, int16_t *dst, uint32_t len)
+{
+  dsp_fir_q15_ref(f, src, dst, len);
+}
+
+void dsp_decimate_q15(dsp_fir_q15_t *f, const int16_t *src, int16_t *dst, uint32_t len)
+{
+  dsp_decimate_q15_ref(f, src, dst, len);
+}
+
+void dsp_biquad_q15(dsp_biquad_q15_t *f, const int16_t *src, int16_t *dst, uint32_t len)
+{
+  dsp_biquad_q15_ref(f, src, dst, len);
+}
+
+void dsp_cfft_q15(const dsp_cfft_q15_t *f, int16_t *data)
+{
+  dsp_cfft_q15_ref(f, data);
+}
+#endif /* DSP_SIMD */
+
+int64_t dsp_dot_q31(const int32_t *a, const int32_t *b, uint32_t len)
+{
+  int64_t acc = 0;
+  uint32_t i = len >> 2;
+
+  while(i-- != 0U)
+  {
+    acc += ((int64_t)a[0] * b[0]) >> 14;
+    acc += ((int64_t)a[1] * b[1]) >> 14;
+    acc += ((int64_t)a[2] * b[2]) >> 14;
+    acc += ((int64_t)a[3] * b[3]) >> 14;
+    a += 4;
+    b += 4;
+  }
+  i = len & 3U;
+  while(i-- != 0U)
+  {
+    acc += ((int64_t)*a++ * *b++) >> 14;
+  }
+  return acc;
+}
+
+/* Four partial sums hide the latency of the FPU multiply-add */
+float dsp_dot_f32(const float *a, const float *b, uint32_t len)
+{
+  float acc0 = 0.0f;
+  float acc1 = 0.0f;
+  float acc2 = 0.0f;
+  float acc3 = 0.0f;
+  uint32_t i = len >> 2;
+
+  while(i-- != 0U)
+  {
+    acc0 += a[0] * b[0];
+    acc1 += a[1] * b[1];
+    acc2 += a[2] * b[2];
+    acc3 += a[3] * b[3];
+    a += 4;
+    b += 4;
+  }
+  i = len & 3U;
+  while(i-- != 0U)
+  {
+    acc0 += *a++ * *b++;
+  }
+  return (acc0 + acc1) + (acc2 + acc3);
+}
+
+int32_t dsp_rms_q31(const int32_t *src, uint32_t len)
+{
+  uint64_t acc = 0U;
+  uint32_t root;
+  uint32_t i = len >> 1;
+  const int32_t *p = src;
+
+  while(i-- != 0U)
+  {
+    acc += (uint64_t)((int64_t)p[0] * p[0]) >> 31;
+    acc += (uint64_t)((int64_t)p[1] * p[1]) >> 31;
+    p += 2;
+  }
+  if((len & 1U) != 0U)
+  {
+    acc += (uint64_t)((int64_t)p[0] * p[0]) >> 31;
+  }
+  root = dsp_isqrt((acc / len) << 31);
+  return (int32_t)((root > 0x7FFFFFFFU) ? 0x7FFFFFFFU : root);
+}
+
+float dsp_rms_f32(const float *src, uint32_t len)
+{
+  return sqrtf(dsp_dot_f32(src, src, len) / (float)len);
+}
+
+void dsp_fir_q31(dsp_fir_q31_t *f, const int32_t *src, int32_t *dst, uint32_t len)
+{
+  uint32_t hist = f->taps - 1U;
+  uint32_t n;
+
+  memcpy(&f->state[hist], src, len * sizeof(*src));
+  for(n = 0U; n < len; n++)
+  {
+    dst[n] = dsp_sat_q31(dsp_mac_q31(f->coeffs, &f->state[n], f->taps) >> 31);
+  }
+  memmove(f->state, &f->state[len], hist * sizeof(*src));
+}
+
+void dsp_fir_f32(dsp_fir_f32_t *f, const float *src, float *dst, uint32_t len)
+{
+  uint32_t hist = f->taps - 1U;
+  uint32_t n;
+
+  memcpy(&f->state[hist], src, len * sizeof(*src));
+  for(n = 0U; n < len; n++)
+  {
+    dst[n] = dsp_dot_f32(f->coeffs, &f->state[n], f->taps);
+  }
+  memmove(f->state, &f->state[len], hist * sizeof(*src));
+}
+
+void dsp_decimate_q31(dsp_fir_q31_t *f, const int32_t *src, int32_t *dst, uint32_t len)
+{
+  uint32_t hist = f->taps - 1U;
+  uint32_t n;
+
+  memcpy(&f->state[hist], src, len * sizeof(*src));
+  for(n = f->factor - 1U; n < len; n += f->factor)
+  {
+    *dst++ = dsp_sat_q31(dsp_mac_q31(f->coeffs, &f->state[n], f->taps) >> 31);
+  }
+  memmove(f->state, &f->state[len], hist * sizeof(*src));
+}
+
+void dsp_decimate_f32(dsp_fir_f32_t *f, const float *src, float *dst, uint32_t len)
+{
+  uint32_t hist = f->taps - 1U;
+  uint32_t n;
+
+  memcpy(&f->state[hist], src, len * sizeof(*src));
+  for(n = f->factor - 1U; n < len; n += f->factor)
+  {
+    *dst++ = dsp_dot_f32(f->coeffs, &f->state[n], f->taps);
+  }
+  memmove(f->state, &f->state[len], hist * sizeof(*src));
+}
+
+/* A biquad is a recursion through y, unrolling buys nothing there; the
+   same goes for the float FFT without SIMD. The reference is the kernel. */
+void dsp_biquad_q31(dsp_biquad_q31_t *f, const int32_t *src, int32_t *dst, uint32_t len)
+{
+  dsp_biquad_q31_ref(f, src, dst, len);
+}
+
+void dsp_biquad_f32(dsp_biquad_f32_t *f, const float *src, float *dst, uint32_t len)
+{
+  dsp_biquad_f32_ref(f, src, dst, len);
+}
+
+void dsp_cfft_f32(const dsp_cfft_f32_t *f, float *data)
+{
+  dsp_cfft_f32_ref(f, data);
+}
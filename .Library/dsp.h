@@ -0,0 +1,202 @@
+#ifndef __DSP_H
+#define __DSP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include <stdint.h>
+
+/* Signal processing kernels in Q15 (int16_t, 1.15), Q31 (int32_t, 1.31)
+   and float. Every kernel xxx() has a portable C twin xxx_ref() in
+   dsp_ref.c that defines its result; dsp_ref.c needs nothing but a C
+   compiler, so the same file runs on a host against test vectors.
+
+   With the Cortex-M7 DSP extension the Q15 kernels work on two samples per
+   instruction (SMLALD, SHADD16, SMUSD...); without it (DSP_SIMD 0) they
+   call the reference. The Q31/float kernels have no SIMD form on the M7,
+   they are unrolled where that pays and are the reference otherwise. The
+   Q15/Q31 results are bit-exact with the reference on any compiler. The float
+   kernels split sums over several accumulators and the compiler may fuse
+   multiply-adds, so they only match the reference to rounding; compare
+   them with a tolerance.
+
+   Fixed point rules, as in CMSIS-DSP:
+     products are summed in 64 bits and scaled back with saturation,
+     FIR/decimator coefficients are stored time reversed (c[0] = h[taps-1]),
+     the Q15 FFT scales by 1/4 per stage, the result is X[k] / n. */
+
+/* Exported constants --------------------------------------------------------*/
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1) && !defined(DSP_NO_SIMD)
+#define DSP_SIMD                1
+#else
+#define DSP_SIMD                0
+#endif
+
+/* FFT lengths, powers of 4 */
+#define DSP_CFFT_MIN            16U
+#define DSP_CFFT_MAX            4096U
+
+/* Exported macro ------------------------------------------------------------*/
+/* Samples of FIR state for blocks of up to len samples */
+#define DSP_FIR_STATE(taps, len)    ((taps) + (len) - 1U)
+/* Complex twiddle factors (two values each) an n-point FFT needs */
+#define DSP_CFFT_TWIDDLES(n)        (3U * (n) / 4U)
+
+/* Exported types ------------------------------------------------------------*/
+/* FIR filter and decimator. state holds DSP_FIR_STATE(taps, len) samples
+   for the longest block; factor is only used by the decimator. */
+typedef struct
+{
+  const int16_t *coeffs;        /* taps, time reversed */
+  int16_t *state;
+  uint16_t taps;
+  uint16_t factor;
+} dsp_fir_q15_t;
+
+typedef struct
+{
+  const int32_t *coeffs;
+  int32_t *state;
+  uint16_t taps;
+  uint16_t factor;
+} dsp_fir_q31_t;
+
+typedef struct
+{
+  const float *coeffs;
+  float *state;
+  uint16_t taps;
+  uint16_t factor;
+} dsp_fir_f32_t;
+
+/* Cascade of second order sections, coefficients b0 b1 b2 a1 a2 per stage
+   for y = b0 x[n] + b1 x[n-1] + b2 x[n-2] + a1 y[n-1] + a2 y[n-2] (the a
+   terms carry the opposite sign of the usual transfer function). The
+   fixed point ones are direct form I with 4 state values per stage and
+   coefficients scaled down by 2^shift (Q15 at most 15, Q31 at most 31);
+   float is direct form II transposed with 2 state values per stage. */
+typedef struct
+{
+  const int16_t *coeffs;
+  int16_t *state;
+  uint8_t stages;
+  uint8_t shift;
+} dsp_biquad_q15_t;
+
+typedef struct
+{
+  const int32_t *coeffs;
+  int32_t *state;
+  uint8_t stages;
+  uint8_t shift;
+} dsp_biquad_q31_t;
+
+typedef struct
+{
+  const float *coeffs;
+  float *state;
+  uint8_t stages;
+} dsp_biquad_f32_t;
+
+/* Forward complex FFT, in place on n interleaved re/im pairs, natural
+   order in and out. Inverse: conjugate the input and the output. */
+typedef struct
+{
+  uint32_t n;
+  uint32_t stages;
+  const int16_t *twiddle;
+} dsp_cfft_q15_t;
+
+typedef struct
+{
+  uint32_t n;
+  uint32_t stages;
+  const float *twiddle;
+} dsp_cfft_f32_t;
+
+/* Function definitions ------------------------------------------------------*/
+/* Dot product. Q15: 34.30 sum; Q31: products >> 14 summed, 16.48 */
+int64_t dsp_dot_q15(const int16_t *a, const int16_t *b, uint32_t len);
+int64_t dsp_dot_q31(const int32_t *a, const int32_t *b, uint32_t len);
+float dsp_dot_f32(const float *a, const float *b, uint32_t len);
+
+/* Root mean square, len > 0 */
+int16_t dsp_rms_q15(const int16_t *src, uint32_t len);
+int32_t dsp_rms_q31(const int32_t *src, uint32_t len);
+float dsp_rms_f32(const float *src, uint32_t len);
+
+/* FIR: clear the history and set up; factor 1 for a plain filter */
+void dsp_fir_q15_init(dsp_fir_q15_t *f, const int16_t *coeffs,
+                      uint16_t taps, uint16_t factor, int16_t *state);
+void dsp_fir_q31_init(dsp_fir_q31_t *f, const int32_t *coeffs,
+                      uint16_t taps, uint16_t factor, int32_t *state);
+void dsp_fir_f32_init(dsp_fir_f32_t *f, const float *coeffs, uint16_t taps, uint16_t factor, float *state);
+void dsp_fir_q15(dsp_fir_q15_t *f, const int16_t *src, int16_t *dst, uint32_t len);
+void dsp_fir_q31(dsp_fir_q31_t *f, const int32_t *src, int32_t *dst, uint32_t len);
+void dsp_fir_f32(dsp_fir_f32_t *f, const float *src, float *dst, uint32_t len);
+/* Filter and keep every factor-th output; len a multiple of factor,
+   dst gets len / factor samples */
+void dsp_decimate_q15(dsp_fir_q15_t *f, const int16_t *src, int16_t *dst, uint32_t len);
+void dsp_decimate_q31(dsp_fir_q31_t *f, const int32_t *src, int32_t *dst, uint32_t len);
+void dsp_decimate_f32(dsp_fir_f32_t *f, const float *src, float *dst, uint32_t len);
+
+/* Biquad cascade; init clears the state */
+void dsp_biquad_q15_init(dsp_biquad_q15_t *f, const int16_t *coeffs,
+                         uint8_t stages, uint8_t shift, int16_t *state);
+void dsp_biquad_q31_init(dsp_biquad_q31_t *f, const int32_t *coeffs,
+                         uint8_t stages, uint8_t shift, int32_t *state);
+void dsp_biquad_f32_init(dsp_biquad_f32_t *f, const float *coeffs, uint8_t stages, float *state);
+void dsp_biquad_q15(dsp_biquad_q15_t *f, const int16_t *src, int16_t *dst, uint32_t len);
+void dsp_biquad_q31(dsp_biquad_q31_t *f, const int32_t *src, int32_t *dst, uint32_t len);
+void dsp_biquad_f32(dsp_biquad_f32_t *f, const float *src, float *dst, uint32_t len);
+
+/* FFT: fill twiddle (DSP_CFFT_TWIDDLES(n) pairs) for n, 1 if n is a power
+   of 4 within DSP_CFFT_MIN..MAX, 0 otherwise. The Q15 input must stay
+   within the unit circle, |re + j im| < 1. */
+uint32_t dsp_cfft_q15_init(dsp_cfft_q15_t *f, int16_t *twiddle, uint32_t n);
+uint32_t dsp_cfft_f32_init(dsp_cfft_f32_t *f, float *twiddle, uint32_t n);
+void dsp_cfft_q15(const dsp_cfft_q15_t *f, int16_t *data);
+void dsp_cfft_f32(const dsp_cfft_f32_t *f, float *data);
+
+/* Reference versions, same contracts */
+int64_t dsp_dot_q15_ref(const int16_t *a, const int16_t *b, uint32_t len);
+int64_t dsp_dot_q31_ref(const int32_t *a, const int32_t *b, uint32_t len);
+float dsp_dot_f32_ref(const float *a, const float *b, uint32_t len);
+int16_t dsp_rms_q15_ref(const int16_t *src, uint32_t len);
+int32_t dsp_rms_q31_ref(const int32_t *src, uint32_t len);
+float dsp_rms_f32_ref(const float *src, uint32_t len);
+void dsp_fir_q15_ref(dsp_fir_q15_t *f, const int16_t *src, int16_t *dst, uint32_t len);
+void dsp_fir_q31_ref(dsp_fir_q31_t *f, const int32_t *src, int32_t *dst, uint32_t len);
+void dsp_fir_f32_ref(dsp_fir_f32_t *f, const float *src, float *dst, uint32_t len);
+void dsp_decimate_q15_ref(dsp_fir_q15_t *f, const int16_t *src, int16_t *dst, uint32_t len);
+void dsp_decimate_q31_ref(dsp_fir_q31_t *f, const int32_t *src, int32_t *dst, uint32_t len);
+void dsp_decimate_f32_ref(dsp_fir_f32_t *f, const float *src, float *dst, uint32_t len);
+void dsp_biquad_q15_ref(dsp_biquad_q15_t *f, const int16_t *src, int16_t *dst, uint32_t len);
+void dsp_biquad_q31_ref(dsp_biquad_q31_t *f, const int32_t *src, int32_t *dst, uint32_t len);
+void dsp_biquad_f32_ref(dsp_biquad_f32_t *f, const float *src, float *dst, uint32_t len);
+void dsp_cfft_q15_ref(const dsp_cfft_q15_t *f, int16_t *data);
+void dsp_cfft_f32_ref(const dsp_cfft_f32_t *f, float *data);
+
+/* Helpers shared by both versions */
+static inline int16_t dsp_sat_q15(int64_t x)
+{
+  return (int16_t)((x > 32767) ? 32767 : ((x < -32768) ? -32768 : x));
+}
+
+static inline int32_t dsp_sat_q31(int64_t x)
+{
+  return (int32_t)((x > INT32_MAX) ? INT32_MAX : ((x < INT32_MIN) ? INT32_MIN : x));
+}
+
+/* floor(sqrt(x)) */
+uint32_t dsp_isqrt(uint64_t x);
+/* i with its stages base-4 digits reversed, the FFT output order */
+uint32_t dsp_digit_rev(uint32_t i, uint32_t stages);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
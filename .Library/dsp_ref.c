@@ -0,0 +1,589 @@
+/* Header includes -----------------------------------------------------------*/
+#include "dsp.h"
+#include <math.h>
+#include <string.h>
+
+/* Reference kernels and the set-up code both versions share. Plain C, no
+   target headers, so this file also builds on a host. */
+
+/* Private macro -------------------------------------------------------------*/
+#define DSP_PI                  3.14159265358979323846
+
+/* Private functions ---------------------------------------------------------*/
+/* n = 4^stages within the supported range, stages = 0 otherwise */
+static uint32_t dsp_cfft_stages(uint32_t n)
+{
+  uint32_t stages = 0U;
+  uint32_t m = 1U;
+
+  while(m < n)
+  {
+    m <<= 2;
+    stages++;
+  }
+  return ((m == n) && (n >= DSP_CFFT_MIN) && (n <= DSP_CFFT_MAX)) ? stages : 0U;
+}
+
+/* Q15 complex product, each part scaled back with saturation */
+static void dsp_cmul_q15(int32_t *re, int32_t *im, const int16_t *w)
+{
+  int32_t r = (*re * w[0]) - (*im * w[1]);
+  int32_t i = (*re * w[1]) + (*im * w[0]);
+
+  *re = dsp_sat_q15(r >> 15);
+  *im = dsp_sat_q15(i >> 15);
+}
+
+static void dsp_cmul_f32(float *re, float *im, const float *w)
+{
+  float r = (*re * w[0]) - (*im * w[1]);
+  float i = (*re * w[1]) + (*im * w[0]);
+
+  *re = r;
+  *im = i;
+}
+
+/* Function definitions ------------------------------------------------------*/
+uint32_t dsp_isqrt(uint64_t x)
+{
+  uint64_t root = 0U;
+  uint64_t bit = 1ULL << 62;
+
+  while(bit > x)
+  {
+    bit >>= 2;
+  }
+  while(bit != 0U)
+  {
+    if(x >= (root + bit))
+    {
+      x -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+    {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)root;
+}
+
+uint32_t dsp_digit_rev(uint32_t i, uint32_t stages)
+{
+  uint32_t r = 0U;
+
+  while(stages-- != 0U)
+  {
+    r = (r << 2) | (i & 3U);
+    i >>= 2;
+  }
+  return r;
+}
+
+void dsp_fir_q15_init(dsp_fir_q15_t *f, const int16_t *coeffs, uint16_t taps, uint16_t factor, int16_t *state)
+{
+  f->coeffs = coeffs;
+  f->state = state;
+  f->taps = taps;
+  f->factor = factor;
+  memset(state, 0, (taps - 1U) * sizeof(*state));
+}
+
+void dsp_fir_q31_init(dsp_fir_q31_t *f, const int32_t *coeffs, uint16_t taps, uint16_t factor, int32_t *state)
+{
+  f->coeffs = coeffs;
+  f->state = state;
+  f->taps = taps;
+  f->factor = factor;
+  memset(state, 0, (taps - 1U) * sizeof(*state));
+}
+
+void dsp_fir_f32_init(dsp_fir_f32_t *f, const float *coeffs, uint16_t taps, uint16_t factor, float *state)
+{
+  f->coeffs = coeffs;
+  f->state = state;
+  f->taps = taps;
+  f->factor = factor;
+  memset(state, 0, (taps - 1U) * sizeof(*state));
+}
+
+void dsp_biquad_q15_init(dsp_biquad_q15_t *f, const int16_t *coeffs,
+                         uint8_t stages, uint8_t shift, int16_t *state)
+{
+  f->coeffs = coeffs;
+  f->state = state;
+  f->stages = stages;
+  f->shift = shift;
+  memset(state, 0, 4U * stages * sizeof(*state));
+}
+
+void dsp_biquad_q31_init(dsp_biquad_q31_t *f, const int32_t *coeffs,
+                         uint8_t stages, uint8_t shift, int32_t *state)
+{
+  f->coeffs = coeffs;
+  f->state = state;
+  f->stages = stages;
+  f->shift = shift;
+  memset(state, 0, 4U * stages * sizeof(*state));
+}
+
+void dsp_biquad_f32_init(dsp_biquad_f32_t *f, const float *coeffs, uint8_t stages, float *state)
+{
+  f->coeffs = coeffs;
+  f->state = state;
+  f->stages = stages;
+  memset(state, 0, 2U * stages * sizeof(*state));
+}
+
+/* Twiddles W^k = exp(-j 2 pi k / n), from double so host and target agree */
+uint32_t dsp_cfft_q15_init(dsp_cfft_q15_t *f, int16_t *twiddle, uint32_t n)
+{
+  uint32_t stages = dsp_cfft_stages(n);
+  uint32_t k;
+
+  if(stages == 0U)
+  {
+    return 0U;
+  }
+  for(k = 0U; k < DSP_CFFT_TWIDDLES(n); k++)
+  {
+    double a = (2.0 * DSP_PI * (double)k) / (double)n;
+
+    twiddle[2U * k] = (int16_t)floor((cos(a) * 32767.0) + 0.5);
+    twiddle[(2U * k) + 1U] = (int16_t)floor((-sin(a) * 32767.0) + 0.5);
+  }
+  f->n = n;
+  f->stages = stages;
+  f->twiddle = twiddle;
+  return 1U;
+}
+
+uint32_t dsp_cfft_f32_init(dsp_cfft_f32_t *f, float *twiddle, uint32_t n)
+{
+  uint32_t stages = dsp_cfft_stages(n);
+  uint32_t k;
+
+  if(stages == 0U)
+  {
+    return 0U;
+  }
+  for(k = 0U; k < DSP_CFFT_TWIDDLES(n); k++)
+  {
+    double a = (2.0 * DSP_PI * (double)k) / (double)n;
+
+    twiddle[2U * k] = (float)cos(a);
+    twiddle[(2U * k) + 1U] = (float)-sin(a);
+  }
+  f->n = n;
+  f->stages = stages;
+  f->twiddle = twiddle;
+  return 1U;
+}
+
+int64_t dsp_dot_q15_ref(const int16_t *a, const int16_t *b, uint32_t len)
+{
+  int64_t acc = 0;
+  uint32_t i;
+
+  for(i = 0U; i < len; i++)
+  {
+    acc += (int32_t)a[i] * b[i];
+  }
+  return acc;
+}
+
+int64_t dsp_dot_q31_ref(const int32_t *a, const int32_t *b, uint32_t len)
+{
+  int64_t acc = 0;
+  uint32_t i;
+
+  for(i = 0U; i < len; i++)
+  {
+    acc += ((int64_t)a[i] * b[i]) >> 14;
+  }
+  return acc;
+}
+
+float dsp_dot_f32_ref(const float *a, const float *b, uint32_t len)
+{
+  float acc = 0.0f;
+  uint32_t i;
+
+  for(i = 0U; i < len; i++)
+  {
+    acc += a[i] * b[i];
+  }
+  return acc;
+}
+
+/* Mean square in Q30, its root is Q15 */
+int16_t dsp_rms_q15_ref(const int16_t *src, uint32_t len)
+{
+  uint32_t root = dsp_isqrt((uint64_t)dsp_dot_q15_ref(src, src, len) / len);
+
+  return (int16_t)((root > 32767U) ? 32767U : root);
+}
+
+/* Squares scaled to Q31 before summing, the mean goes back to Q62 for the
+   root */
+int32_t dsp_rms_q31_ref(const int32_t *src, uint32_t len)
+{
+  uint64_t acc = 0U;
+  uint32_t root;
+  uint32_t i;
+
+  for(i = 0U; i < len; i++)
+  {
+    acc += (uint64_t)((int64_t)src[i] * src[i]) >> 31;
+  }
+  root = dsp_isqrt((acc / len) << 31);
+  return (int32_t)((root > 0x7FFFFFFFU) ? 0x7FFFFFFFU : root);
+}
+
+float dsp_rms_f32_ref(const float *src, uint32_t len)
+{
+  return sqrtf(dsp_dot_f32_ref(src, src, len) / (float)len);
+}
+
+/* The FIR state is taps - 1 samples of history followed by the block, so
+   output n is the dot product of the coefficients with state[n..] */
+void dsp_fir_q15_ref(dsp_fir_q15_t *f, const int16_t *src, int16_t *dst, uint32_t len)
+{
+  uint32_t hist = f->taps - 1U;
+  uint32_t n;
+
+  memcpy(&f->state[hist], src, len * sizeof(*src));
+  for(n = 0U; n < len; n++)
+  {
+    dst[n] = dsp_sat_q15(dsp_dot_q15_ref(f->coeffs, &f->state[n], f->taps) >> 15);
+  }
+  memmove(f->state, &f->state[len], hist * sizeof(*src));
+}
+
+void dsp_fir_q31_ref(dsp_fir_q31_t *f, const int32_t *src, int32_t *dst, uint32_t len)
+{
+  uint32_t hist = f->taps - 1U;
+  uint32_t n;
+  uint32_t k;
+  int64_t acc;
+
+  memcpy(&f->state[hist], src, len * sizeof(*src));
+  for(n = 0U; n < len; n++)
+  {
+    acc = 0;
+    for(k = 0U; k < f->taps; k++)
+    {
+      acc += (int64_t)f->coeffs[k] * f->state[n + k];
+    }
+    dst[n] = dsp_sat_q31(acc >> 31);
+  }
+  memmove(f->state, &f->state[len], hist * sizeof(*src));
+}
+
+void dsp_fir_f32_ref(dsp_fir_f32_t *f, const float *src, float *dst, uint32_t len)
+{
+  uint32_t hist = f->taps - 1U;
+  uint32_t n;
+
+  memcpy(&f->state[hist], src, len * sizeof(*src));
+  for(n = 0U; n < len; n++)
+  {
+    dst[n] = dsp_dot_f32_ref(f->coeffs, &f->state[n], f->taps);
+  }
+  memmove(f->state, &f->state[len], hist * sizeof(*src));
+}
+
+/* Output m is the filter output at the last of each factor inputs */
+void dsp_decimate_q15_ref(dsp_fir_q15_t *f, const int16_t *src, int16_t *dst, uint32_t len)
+{
+  uint32_t hist = f->taps - 1U;
+  uint32_t n;
+
+  memcpy(&f->state[hist], src, len * sizeof(*src));
+  for(n = f->factor - 1U; n < len; n += f->factor)
+  {
+    *dst++ = dsp_sat_q15(dsp_dot_q15_ref(f->coeffs, &f->state[n], f->taps) >> 15);
+  }
+  memmove(f->state, &f->state[len], hist * sizeof(*src));
+}
+
+void dsp_decimate_q31_ref(dsp_fir_q31_t *f, const int32_t *src, int32_t *dst, uint32_t len)
+{
+  uint32_t hist = f->taps - 1U;
+  uint32_t n;
+  uint32_t k;
+  int64_t acc;
+
+  memcpy(&f->state[hist], src, len * sizeof(*src));
+  for(n = f->factor - 1U; n < len; n += f->factor)
+  {
+    acc = 0;
+    for(k = 0U; k < f->taps; k++)
+    {
+      acc += (int64_t)f->coeffs[k] * f->state[n + k];
+    }
+    *dst++ = dsp_sat_q31(acc >> 31);
+  }
+  memmove(f->state, &f->state[len], hist * sizeof(*src));
+}
+
+void dsp_decimate_f32_ref(dsp_fir_f32_t *f, const float *src, float *dst, uint32_t len)
+{
+  uint32_t hist = f->taps - 1U;
+  uint32_t n;
+
+  memcpy(&f->state[hist], src, len * sizeof(*src));
+  for(n = f->factor - 1U; n < len; n += f->factor)
+  {
+    *dst++ = dsp_dot_f32_ref(f->coeffs, &f->state[n], f->taps);
+  }
+  memmove(f->state, &f->state[len], hist * sizeof(*src));
+}
+
+/* Each stage filters src into dst, the following ones work in place */
+void dsp_biquad_q15_ref(dsp_biquad_q15_t *f, const int16_t *src, int16_t *dst, uint32_t len)
+{
+  const int16_t *c = f->coeffs;
+  int16_t *s = f->state;
+  uint32_t stage;
+  uint32_t n;
+  int64_t acc;
+  int16_t y;
+
+  for(stage = 0U; stage < f->stages; stage++)
+  {
+    for(n = 0U; n < len; n++)
+    {
+      acc = ((int64_t)c[0] * src[n]) + ((int64_t)c[1] * s[0]) + ((int64_t)c[2] * s[1]);
+      acc += ((int64_t)c[3] * s[2]) + ((int64_t)c[4] * s[3]);
+      y = dsp_sat_q15(acc >> (15U - f->shift));
+      s[1] = s[0];
+      s[0] = src[n];
+      s[3] = s[2];
+      s[2] = y;
+      dst[n] = y;
+    }
+    src = dst;
+    c += 5;
+    s += 4;
+  }
+}
+
+void dsp_biquad_q31_ref(dsp_biquad_q31_t *f, const int32_t *src, int32_t *dst, uint32_t len)
+{
+  const int32_t *c = f->coeffs;
+  int32_t *s = f->state;
+  uint32_t stage;
+  uint32_t n;
+  int64_t acc;
+  int32_t y;
+
+  for(stage = 0U; stage < f->stages; stage++)
+  {
+    for(n = 0U; n < len; n++)
+    {
+      acc = ((int64_t)c[0] * src[n]) + ((int64_t)c[1] * s[0]) + ((int64_t)c[2] * s[1]);
+      acc += ((int64_t)c[3] * s[2]) + ((int64_t)c[4] * s[3]);
+      y = dsp_sat_q31(acc >> (31U - f->shift));
+      s[1] = s[0];
+      s[0] = src[n];
+      s[3] = s[2];
+      s[2] = y;
+      dst[n] = y;
+    }
+    src = dst;
+    c += 5;
+    s += 4;
+  }
+}
+
+void dsp_biquad_f32_ref(dsp_biquad_f32_t *f, const float *src, float *dst, uint32_t len)
+{
+  const float *c = f->coeffs;
+  float *s = f->state;
+  uint32_t stage;
+  uint32_t n;
+  float x;
+  float y;
+
+  for(stage = 0U; stage < f->stages; stage++)
+  {
+    for(n = 0U; n < len; n++)
+    {
+      x = src[n];
+      y = (c[0] * x) + s[0];
+      s[0] = (c[1] * x) + (c[3] * y) + s[1];
+      s[1] = (c[2] * x) + (c[4] * y);
+      dst[n] = y;
+    }
+    src = dst;
+    c += 5;
+    s += 2;
+  }
+}
+
+/* Radix-4 decimation in frequency. A stage splits each span of L points
+   into four quarters a b c d and writes
+
+     a' = (a + b + c + d)              b' = (a - jb - c + jd) W^k
+     c' = (a - b + c - d) W^2k         d' = (a + jb - c - jd) W^3k
+
+   with W the n-th root of unity and k the offset in the quarter times
+   n / L. The Q15 version halves after each of the two additions (1/4 per
+   stage, the last bit rounds toward minus infinity) and skips the
+   multiplications for k = 0. The result comes out in base-4 digit
+   reversed order and is sorted at the end. */
+void dsp_cfft_q15_ref(const dsp_cfft_q15_t *f, int16_t *data)
+{
+  uint32_t n = f->n;
+  uint32_t span;
+  uint32_t q;
+  uint32_t step = 1U;
+  uint32_t g;
+  uint32_t k;
+  uint32_t i;
+  uint32_t j;
+  int16_t *a;
+  int16_t *b;
+  int16_t *c;
+  int16_t *d;
+  int32_t t0r, t0i, t1r, t1i, t2r, t2i, t3r, t3i;
+  int32_t yr[4];
+  int32_t yi[4];
+  int16_t tmp[2];
+
+  for(span = n; span >= 4U; span >>= 2)
+  {
+    q = span >> 2;
+    for(g = 0U; g < n; g += span)
+    {
+      for(k = 0U; k < q; k++)
+      {
+        a = &data[2U * (g + k)];
+        b = a + (2U * q);
+        c = b + (2U * q);
+        d = c + (2U * q);
+        t0r = (a[0] + c[0]) >> 1;
+        t0i = (a[1] + c[1]) >> 1;
+        t1r = (a[0] - c[0]) >> 1;
+        t1i = (a[1] - c[1]) >> 1;
+        t2r = (b[0] + d[0]) >> 1;
+        t2i = (b[1] + d[1]) >> 1;
+        t3r = (b[0] - d[0]) >> 1;
+        t3i = (b[1] - d[1]) >> 1;
+        yr[0] = (t0r + t2r) >> 1;
+        yi[0] = (t0i + t2i) >> 1;
+        yr[1] = (t1r + t3i) >> 1;
+        yi[1] = (t1i - t3r) >> 1;
+        yr[2] = (t0r - t2r) >> 1;
+        yi[2] = (t0i - t2i) >> 1;
+        yr[3] = (t1r - t3i) >> 1;
+        yi[3] = (t1i + t3r) >> 1;
+        if(k != 0U)
+        {
+          dsp_cmul_q15(&yr[1], &yi[1], &f->twiddle[2U * k * step]);
+          dsp_cmul_q15(&yr[2], &yi[2], &f->twiddle[4U * k * step]);
+          dsp_cmul_q15(&yr[3], &yi[3], &f->twiddle[6U * k * step]);
+        }
+        a[0] = (int16_t)yr[0];
+        a[1] = (int16_t)yi[0];
+        b[0] = (int16_t)yr[1];
+        b[1] = (int16_t)yi[1];
+        c[0] = (int16_t)yr[2];
+        c[1] = (int16_t)yi[2];
+        d[0] = (int16_t)yr[3];
+        d[1] = (int16_t)yi[3];
+      }
+    }
+    step <<= 2;
+  }
+
+  for(i = 0U; i < n; i++)
+  {
+    j = dsp_digit_rev(i, f->stages);
+    if(j > i)
+    {
+      memcpy(tmp, &data[2U * i], sizeof(tmp));
+      memcpy(&data[2U * i], &data[2U * j], sizeof(tmp));
+      memcpy(&data[2U * j], tmp, sizeof(tmp));
+    }
+  }
+}
+
+void dsp_cfft_f32_ref(const dsp_cfft_f32_t *f, float *data)
+{
+  uint32_t n = f->n;
+  uint32_t span;
+  uint32_t q;
+  uint32_t step = 1U;
+  uint32_t g;
+  uint32_t k;
+  uint32_t i;
+  uint32_t j;
+  float *a;
+  float *b;
+  float *c;
+  float *d;
+  float t0r, t0i, t1r, t1i, t2r, t2i, t3r, t3i;
+  float yr[4];
+  float yi[4];
+  float tmp[2];
+
+  for(span = n; span >= 4U; span >>= 2)
+  {
+    q = span >> 2;
+    for(g = 0U; g < n; g += span)
+    {
+      for(k = 0U; k < q; k++)
+      {
+        a = &data[2U * (g + k)];
+        b = a + (2U * q);
+        c = b + (2U * q);
+        d = c + (2U * q);
+        t0r = a[0] + c[0];
+        t0i = a[1] + c[1];
+        t1r = a[0] - c[0];
+        t1i = a[1] - c[1];
+        t2r = b[0] + d[0];
+        t2i = b[1] + d[1];
+        t3r = b[0] - d[0];
+        t3i = b[1] - d[1];
+        yr[0] = t0r + t2r;
+        yi[0] = t0i + t2i;
+        yr[1] = t1r + t3i;
+        yi[1] = t1i - t3r;
+        yr[2] = t0r - t2r;
+        yi[2] = t0i - t2i;
+        yr[3] = t1r - t3i;
+        yi[3] = t1i + t3r;
+        if(k != 0U)
+        {
+          dsp_cmul_f32(&yr[1], &yi[1], &f->twiddle[2U * k * step]);
+          dsp_cmul_f32(&yr[2], &yi[2], &f->twiddle[4U * k * step]);
+          dsp_cmul_f32(&yr[3], &yi[3], &f->twiddle[6U * k * step]);
+        }
+        a[0] = yr[0];
+        a[1] = yi[0];
+        b[0] = yr[1];
+        b[1] = yi[1];
+        c[0] = yr[2];
+        c[1] = yi[2];
+        d[0] = yr[3];
+        d[1] = yi[3];
+      }
+    }
+    step <<= 2;
+  }
+
+  for(i = 0U; i < n; i++)
+  {
+    j = dsp_digit_rev(i, f->stages);
+    if(j > i)
+    {
+      memcpy(tmp, &data[2U * i], sizeof(tmp));
+      memcpy(&data[2U * i], &data[2U * j], sizeof(tmp));
+      memcpy(&data[2U * j], tmp, sizeof(tmp));
+    }
+  }
+}
@@ -0,0 +1,431 @@
+
+/* Header includes -----------------------------------------------------------*/
+#include "eth_zc.h"
+#include "dma_cache.h"
+
+/* Private variables ---------------------------------------------------------*/
+#if defined ( __ICCARM__ )
+#pragma location = ETH_ZC_DESC_SECTION
+static ETH_DMADescTypeDef eth_zc_rx_desc[ETH_RX_DESC_CNT];
+#pragma location = ETH_ZC_DESC_SECTION
+static ETH_DMADescTypeDef eth_zc_tx_desc[ETH_TX_DESC_CNT];
+#pragma location = ETH_ZC_POOL_SECTION
+static __ALIGNED(32) uint8_t eth_zc_mem[ETH_ZC_POOL_CNT][ETH_ZC_BUF_SIZE];
+#else
+static ETH_DMADescTypeDef eth_zc_rx_desc[ETH_RX_DESC_CNT] __attribute__((section(ETH_ZC_DESC_SECTION)));
+static ETH_DMADescTypeDef eth_zc_tx_desc[ETH_TX_DESC_CNT] __attribute__((section(ETH_ZC_DESC_SECTION)));
+static __ALIGNED(32) uint8_t eth_zc_mem[ETH_ZC_POOL_CNT][ETH_ZC_BUF_SIZE] __attribute__((section(ETH_ZC_POOL_SECTION)));
+#endif
+
+static eth_zc_buf_t eth_zc_hdr[ETH_ZC_POOL_CNT];
+static eth_zc_buf_t *eth_zc_free_list = NULL;
+
+static ETH_HandleTypeDef *eth_zc_heth = NULL;
+
+/* Buffer attached to each descriptor, NULL once handed to the application */
+static eth_zc_buf_t *eth_zc_rx_buf[ETH_RX_DESC_CNT];
+static uint32_t eth_zc_rx_cur = 0U;       /* next descriptor the DMA completes */
+static uint32_t eth_zc_rx_refill = 0U;    /* first descriptor without buffer */
+static volatile uint32_t eth_zc_rx_empty = 0U;    /* descriptors waiting for a buffer */
+static volatile uint8_t eth_zc_rx_filling = 0U;   /* eth_zc_rx_fill() running */
+static volatile uint8_t eth_zc_rx_again = 0U;     /* and asked to run again */
+static volatile uint8_t eth_zc_rx_starved = 0U;   /* the last fill ran out of buffers */
+
+/* Frame buffer owning each TX descriptor, freed on completion */
+static eth_zc_buf_t *eth_zc_tx_buf[ETH_TX_DESC_CNT];
+static uint32_t eth_zc_tx_head = 0U;      /* next descriptor to fill */
+static uint32_t eth_zc_tx_dirty = 0U;     /* oldest descriptor not reclaimed */
+static volatile uint32_t eth_zc_tx_used = 0U;
+
+static eth_zc_stats_t eth_zc_stats;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t eth_zc_next_rx(uint32_t idx)
+{
+  return (idx + 1U == (uint32_t)ETH_RX_DESC_CNT) ? 0U : (idx + 1U);
+}
+
+static uint32_t eth_zc_next_tx(uint32_t idx)
+{
+  return (idx + 1U == (uint32_t)ETH_TX_DESC_CNT) ? 0U : (idx + 1U);
+}
+
+/* The descriptor is handed to the DMA before the buffer is published in
+   eth_zc_rx_buf[], so eth_zc_rx() never sees a buffer next to a stale
+   written-back descriptor */
+static void eth_zc_rx_arm(uint32_t idx, eth_zc_buf_t *buf)
+{
+  ETH_DMADescTypeDef *desc = &eth_zc_rx_desc[idx];
+
+  WRITE_REG(desc->DESC0, (uint32_t)buf->data);
+  WRITE_REG(desc->BackupAddr0, (uint32_t)buf->data);
+  WRITE_REG(desc->DESC2, 0U);
+  WRITE_REG(desc->BackupAddr1, 0U);
+  __DMB();
+  WRITE_REG(desc->DESC3, ETH_DMARXNDESCRF_OWN | ETH_DMARXNDESCRF_IOC | ETH_DMARXNDESCRF_BUF1V);
+  eth_zc_rx_buf[idx] = buf;
+}
+
+/* Gives buffers to every empty descriptor, then moves the tail pointer once;
+   the tail pointer write also resumes a receive DMA suspended on RBU. Runs
+   from eth_zc_rx() and from eth_zc_free() in whatever context that is
+   called; a call that finds another one running leaves the work to it. */
+static void eth_zc_rx_fill(void)
+{
+  uint32_t last;
+  uint32_t done;
+  uint32_t primask = __get_PRIMASK();
+  eth_zc_buf_t *buf;
+
+  __disable_irq();
+  if(eth_zc_rx_filling != 0U)
+  {
+    eth_zc_rx_again = 1U;
+    __set_PRIMASK(primask);
+    return;
+  }
+  eth_zc_rx_filling = 1U;
+  __set_PRIMASK(primask);
+
+  do
+  {
+    eth_zc_rx_again = 0U;
+    eth_zc_rx_starved = 0U;
+    last = (uint32_t)ETH_RX_DESC_CNT;
+    while(eth_zc_rx_empty != 0U)
+    {
+      buf = eth_zc_alloc();
+      if(buf == NULL)
+      {
+        eth_zc_stats.rx_no_buffer++;
+        eth_zc_rx_starved = 1U;
+        break;
+      }
+      /* The DMA writes the whole buffer, drop stale lines before it does */
+      dma_cache_invalidate(buf->data, ETH_ZC_BUF_SIZE);
+      eth_zc_rx_arm(eth_zc_rx_refill, buf);
+      last = eth_zc_rx_refill;
+      eth_zc_rx_refill = eth_zc_next_rx(eth_zc_rx_refill);
+      __disable_irq();
+      eth_zc_rx_empty--;
+      __set_PRIMASK(primask);
+    }
+
+    if(last != (uint32_t)ETH_RX_DESC_CNT)
+    {
+      __DSB();
+      WRITE_REG(eth_zc_heth->Instance->DMACRDTPR, (uint32_t)&eth_zc_rx_desc[last]);
+    }
+
+    /* A buffer freed meanwhile sets eth_zc_rx_again */
+    __disable_irq();
+    done = (eth_zc_rx_again == 0U) ? 1U : 0U;
+    if(done != 0U)
+    {
+      eth_zc_rx_filling = 0U;
+    }
+    __set_PRIMASK(primask);
+  } while(done == 0U);
+}
+
+/* Exported functions --------------------------------------------------------*/
+HAL_StatusTypeDef eth_zc_init(ETH_HandleTypeDef *heth)
+{
+  uint32_t i;
+
+  eth_zc_free_list = NULL;
+  for(i = 0U; i < ETH_ZC_POOL_CNT; i++)
+  {
+    eth_zc_hdr[i].data = eth_zc_mem[i];
+    eth_zc_hdr[i].len = 0U;
+    eth_zc_hdr[i].next = eth_zc_free_list;
+    eth_zc_free_list = &eth_zc_hdr[i];
+  }
+
+  heth->Init.RxDesc = eth_zc_rx_desc;
+  heth->Init.TxDesc = eth_zc_tx_desc;
+  heth->Init.RxBuffLen = ETH_ZC_BUF_SIZE;
+  if(HAL_ETH_Init(heth) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+  eth_zc_heth = heth;
+
+  for(i = 0U; i < (uint32_t)ETH_RX_DESC_CNT; i++)
+  {
+    eth_zc_rx_buf[i] = eth_zc_alloc();
+    dma_cache_invalidate(eth_zc_rx_buf[i]->data, ETH_ZC_BUF_SIZE);
+    if(HAL_ETH_DescAssignMemory(heth, i, eth_zc_rx_buf[i]->data, NULL) != HAL_OK)
+    {
+      return HAL_ERROR;
+    }
+  }
+  for(i = 0U; i < (uint32_t)ETH_TX_DESC_CNT; i++)
+  {
+    eth_zc_tx_buf[i] = NULL;
+  }
+  eth_zc_rx_cur = 0U;
+  eth_zc_rx_refill = 0U;
+  eth_zc_rx_empty = 0U;
+  eth_zc_rx_filling = 0U;
+  eth_zc_rx_again = 0U;
+  eth_zc_rx_starved = 0U;
+  eth_zc_tx_head = 0U;
+  eth_zc_tx_dirty = 0U;
+  eth_zc_tx_used = 0U;
+
+  return HAL_ETH_Start_IT(heth);
+}
+
+eth_zc_buf_t *eth_zc_alloc(void)
+{
+  uint32_t primask = __get_PRIMASK();
+  eth_zc_buf_t *buf;
+
+  __disable_irq();
+  buf = eth_zc_free_list;
+  if(buf != NULL)
+  {
+    eth_zc_free_list = buf->next;
+    buf->next = NULL;
+    buf->len = 0U;
+  }
+  __set_PRIMASK(primask);
+  return buf;
+}
+
+void eth_zc_free(eth_zc_buf_t *chain)
+{
+  uint32_t primask = __get_PRIMASK();
+  eth_zc_buf_t *next;
+
+  __disable_irq();
+  while(chain != NULL)
+  {
+    next = chain->next;
+    chain->next = eth_zc_free_list;
+    eth_zc_free_list = chain;
+    chain = next;
+  }
+  __set_PRIMASK(primask);
+
+  /* Descriptors left without a buffer would stay that way until the next
+     eth_zc_rx(), and one that waits for a receive interrupt never comes
+     once the DMA has stopped on RBU. A fill in progress retries. */
+  if((eth_zc_rx_starved != 0U) || (eth_zc_rx_filling != 0U))
+  {
+    eth_zc_rx_fill();
+  }
+}
+
+eth_zc_buf_t *eth_zc_rx(void)
+{
+  eth_zc_buf_t *head = NULL;
+  eth_zc_buf_t *tail = NULL;
+  eth_zc_buf_t *buf;
+  uint32_t idx;
+  uint32_t count;
+  uint32_t complete;
+  uint32_t desc3;
+  uint32_t received;
+  uint32_t error;
+  uint32_t empty;
+  uint32_t primask;
+
+  while(head == NULL)
+  {
+    /* Only take a frame once the DMA has released all its descriptors */
+    idx = eth_zc_rx_cur;
+    count = 0U;
+    complete = 0U;
+    while((eth_zc_rx_buf[idx] != NULL) && (count < (uint32_t)ETH_RX_DESC_CNT))
+    {
+      desc3 = READ_REG(eth_zc_rx_desc[idx].DESC3);
+      if((desc3 & ETH_DMARXNDESCWBF_OWN) != 0U)
+      {
+        break;
+      }
+      count++;
+      if((desc3 & (ETH_DMARXNDESCWBF_CTXT | ETH_DMARXNDESCWBF_LD)) == ETH_DMARXNDESCWBF_LD)
+      {
+        complete = 1U;
+        break;
+      }
+      idx = eth_zc_next_rx(idx);
+    }
+    if(complete == 0U)
+    {
+      break;
+    }
+
+    /* Detach the buffers, the descriptors are refilled in batches */
+    received = 0U;
+    error = 0U;
+    tail = NULL;
+    empty = count;
+    while(count-- != 0U)
+    {
+      desc3 = READ_REG(eth_zc_rx_desc[eth_zc_rx_cur].DESC3);
+      buf = eth_zc_rx_buf[eth_zc_rx_cur];
+      eth_zc_rx_buf[eth_zc_rx_cur] = NULL;
+      eth_zc_rx_cur = eth_zc_next_rx(eth_zc_rx_cur);
+
+      if((desc3 & ETH_DMARXNDESCWBF_CTXT) != 0U)
+      {
+        /* Timestamp context descriptor, carries no data */
+        eth_zc_free(buf);
+        continue;
+      }
+
+      /* PL is the frame length so far, only used on the last buffer */
+      buf->len = ((desc3 & ETH_DMARXNDESCWBF_LD) != 0U) ?
+                 ((desc3 & ETH_DMARXNDESCWBF_PL) - received) : ETH_ZC_BUF_SIZE;
+      received += buf->len;
+      error |= desc3 & ETH_DMARXNDESCWBF_ES;
+      dma_cache_invalidate(buf->data, buf->len);
+
+      if(tail == NULL)
+      {
+        head = buf;
+      }
+      else
+      {
+        tail->next = buf;
+      }
+      tail = buf;
+    }
+    /* Only now, a fill from an interrupt arms what was detached */
+    primask = __get_PRIMASK();
+    __disable_irq();
+    eth_zc_rx_empty += empty;
+    __set_PRIMASK(primask);
+
+    if(error != 0U)
+    {
+      eth_zc_stats.rx_errors++;
+      eth_zc_free(head);
+      head = NULL;
+    }
+  }
+
+  if(head != NULL)
+  {
+    eth_zc_stats.rx_frames++;
+  }
+
+  if(eth_zc_rx_empty >= ETH_ZC_REFILL_BATCH)
+  {
+    eth_zc_rx_fill();
+  }
+  return head;
+}
+
+void eth_zc_tx_reclaim(void)
+{
+  ETH_DMADescTypeDef *desc;
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  while(eth_zc_tx_used != 0U)
+  {
+    desc = &eth_zc_tx_desc[eth_zc_tx_dirty];
+    if((READ_REG(desc->DESC3) & ETH_DMATXNDESCRF_OWN) != 0U)
+    {
+      break;
+    }
+    if(eth_zc_tx_buf[eth_zc_tx_dirty] != NULL)
+    {
+      /* Set on the last descriptor of a frame: whole chain is done */
+      eth_zc_free(eth_zc_tx_buf[eth_zc_tx_dirty]);
+      eth_zc_tx_buf[eth_zc_tx_dirty] = NULL;
+    }
+    eth_zc_tx_dirty = eth_zc_next_tx(eth_zc_tx_dirty);
+    eth_zc_tx_used--;
+  }
+  __set_PRIMASK(primask);
+}
+
+HAL_StatusTypeDef eth_zc_tx(eth_zc_buf_t *chain)
+{
+  ETH_DMADescTypeDef *desc;
+  eth_zc_buf_t *buf;
+  uint32_t count = 0U;
+  uint32_t length = 0U;
+  uint32_t first = eth_zc_tx_head;
+  uint32_t idx;
+  uint32_t desc3;
+  uint32_t primask;
+
+  for(buf = chain; buf != NULL; buf = buf->next)
+  {
+    count++;
+    length += buf->len;
+  }
+  if((count == 0U) || (length > ETH_DMATXNDESCRF_FL))
+  {
+    return HAL_ERROR;
+  }
+
+  if(((uint32_t)ETH_TX_DESC_CNT - eth_zc_tx_used) < count)
+  {
+    eth_zc_tx_reclaim();
+    if(((uint32_t)ETH_TX_DESC_CNT - eth_zc_tx_used) < count)
+    {
+      eth_zc_stats.tx_ring_full++;
+      return HAL_BUSY;
+    }
+  }
+
+  idx = first;
+  for(buf = chain; buf != NULL; buf = buf->next)
+  {
+    desc = &eth_zc_tx_desc[idx];
+    dma_cache_clean(buf->data, buf->len);
+
+    WRITE_REG(desc->DESC0, (uint32_t)buf->data);
+    WRITE_REG(desc->DESC1, 0U);
+    WRITE_REG(desc->DESC2, (buf->len & ETH_DMATXNDESCRF_B1L) |
+                           ((buf->next == NULL) ? ETH_DMATXNDESCRF_IOC : 0U));
+
+    desc3 = (length & ETH_DMATXNDESCRF_FL) | ETH_CRC_PAD_INSERT;
+    if(idx == first)
+    {
+      desc3 |= ETH_DMATXNDESCRF_FD;
+    }
+    if(buf->next == NULL)
+    {
+      desc3 |= ETH_DMATXNDESCRF_LD;
+      /* Chain ownership sits on the last descriptor */
+      eth_zc_tx_buf[idx] = chain;
+    }
+    /* The first descriptor is released last so the DMA never sees a
+       partial frame */
+    if(idx != first)
+    {
+      desc3 |= ETH_DMATXNDESCRF_OWN;
+    }
+    WRITE_REG(desc->DESC3, desc3);
+    idx = eth_zc_next_tx(idx);
+  }
+
+  eth_zc_tx_head = idx;
+
+  __DMB();
+  SET_BIT(eth_zc_tx_desc[first].DESC3, ETH_DMATXNDESCRF_OWN);
+  __DSB();
+  WRITE_REG(eth_zc_heth->Instance->DMACTDTPR, (uint32_t)&eth_zc_tx_desc[idx]);
+
+  /* Counted only now so eth_zc_tx_reclaim() never sees them half built */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  eth_zc_tx_used += count;
+  __set_PRIMASK(primask);
+
+  eth_zc_stats.tx_frames++;
+  return HAL_OK;
+}
+
+void eth_zc_get_stats(eth_zc_stats_t *stats)
+{
+  *stats = eth_zc_stats;
+}
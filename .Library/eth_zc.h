@@ -0,0 +1,96 @@
+#ifndef __ETH_ZC_H
+#define __ETH_ZC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+#include "stm32h7xx_hal_eth.h"
+
+/* Zero-copy Ethernet: frames live in a pool of cache-line aligned buffers
+   that move between the DMA descriptors and the application by ownership.
+   A received frame is handed out as the chain of buffers the DMA wrote it
+   into and its descriptors get fresh pool buffers; the application gives
+   the buffers back with eth_zc_free(). Transmit takes a buffer chain, one
+   descriptor per buffer, and frees it once the DMA is done with it.
+
+   When the application holds so many buffers that the pool runs dry, RX
+   descriptors stay empty and the DMA stops on RBU with no receive
+   interrupt to follow; the next eth_zc_free() refills them and restarts
+   it, so the application may wait for HAL_ETH_RxCpltCallback before
+   calling eth_zc_rx().
+
+   The pool is ETH_ZC_POOL_CNT * ETH_ZC_BUF_SIZE bytes of SRAM1-3, 144 KiB
+   with 32 descriptors per ring: half of the 288 KiB region, which also
+   holds the descriptors, the DMA arena and the ADC pool. ETH_RX_DESC_CNT
+   buffers sit in the RX ring at all times; the rest is what received
+   frames being processed and queued TX frames can hold. */
+
+/* Exported constants --------------------------------------------------------*/
+#define ETH_ZC_BUF_SIZE         1536U   /* per buffer, multiple of 32 */
+/* Buffers in the pool, see above; more than ETH_RX_DESC_CNT */
+#ifndef ETH_ZC_POOL_CNT
+#define ETH_ZC_POOL_CNT         (ETH_RX_DESC_CNT + ETH_TX_DESC_CNT + 32U)
+#endif
+/* Empty RX descriptors collected before one refill + tail pointer write */
+#define ETH_ZC_REFILL_BATCH     8U
+
+/* Descriptors must be in memory the MPU maps non-cacheable, see linker file */
+#define ETH_ZC_DESC_SECTION     ".eth_desc"
+#define ETH_ZC_POOL_SECTION     ".eth_pool"
+
+#if (ETH_RX_DESC_CNT < 32) || (ETH_RX_DESC_CNT > 256) || (ETH_TX_DESC_CNT < 32) || (ETH_TX_DESC_CNT > 256)
+#error "eth_zc: ETH_RX_DESC_CNT / ETH_TX_DESC_CNT must be 32..256"
+#endif
+#if (ETH_ZC_POOL_CNT <= ETH_RX_DESC_CNT)
+#error "eth_zc: ETH_ZC_POOL_CNT must leave buffers beyond the RX ring"
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct eth_zc_buf_s
+{
+  struct eth_zc_buf_s *next;    /* next buffer of the same frame */
+  uint8_t *data;
+  uint32_t len;                 /* bytes used in data */
+} eth_zc_buf_t;
+
+typedef struct
+{
+  uint32_t rx_frames;
+  uint32_t rx_errors;
+  uint32_t rx_no_buffer;        /* refill found the pool empty */
+  uint32_t tx_frames;
+  uint32_t tx_ring_full;
+} eth_zc_stats_t;
+
+/* Function definitions ------------------------------------------------------*/
+/* heth->Instance, Init.MACAddr and Init.MediaInterface must be set; the
+   descriptors and RxBuffLen are filled in here, then the ETH is started. */
+HAL_StatusTypeDef eth_zc_init(ETH_HandleTypeDef *heth);
+
+/* From any context. eth_zc_free() refills the RX ring itself after the
+   pool ran dry. */
+eth_zc_buf_t *eth_zc_alloc(void);
+void eth_zc_free(eth_zc_buf_t *chain);
+
+/* Next received frame as a buffer chain, NULL if none. Invalid frames are
+   recycled to the ring without being returned. */
+eth_zc_buf_t *eth_zc_rx(void);
+
+/* Queues a frame of one or more buffers (single caller context). Returns
+   HAL_BUSY, leaving the chain with the caller, when the ring has not enough
+   free descriptors. */
+HAL_StatusTypeDef eth_zc_tx(eth_zc_buf_t *chain);
+
+/* Returns transmitted buffers to the pool; call from HAL_ETH_TxCpltCallback */
+void eth_zc_tx_reclaim(void);
+
+void eth_zc_get_stats(eth_zc_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ETH_ZC_H */
@@ -0,0 +1,610 @@
+/* Header includes -----------------------------------------------------------*/
+#include "gfx2d.h"
+#include "dma_cache.h"
+#include <string.h>
+
+/* Private macro -------------------------------------------------------------*/
+#define GFX2D_MODE_M2M          (0UL << DMA2D_CR_MODE_Pos)
+#define GFX2D_MODE_PFC          (1UL << DMA2D_CR_MODE_Pos)
+#define GFX2D_MODE_BLEND        (2UL << DMA2D_CR_MODE_Pos)
+#define GFX2D_MODE_R2M          (3UL << DMA2D_CR_MODE_Pos)
+#define GFX2D_AM_MULTIPLY       (2UL << DMA2D_FGPFCCR_AM_Pos)
+#define GFX2D_CLUT_256          (255UL << DMA2D_FGPFCCR_CS_Pos)
+
+#define GFX2D_IT                (DMA2D_CR_TCIE | DMA2D_CR_TEIE | DMA2D_CR_CEIE | DMA2D_CR_CAEIE | DMA2D_CR_CTCIE)
+#define GFX2D_ERRORS            (DMA2D_ISR_TEIF | DMA2D_ISR_CAEIF | DMA2D_ISR_CEIF)
+#define GFX2D_FLAGS             (GFX2D_ERRORS | DMA2D_ISR_TCIF | DMA2D_ISR_CTCIF | DMA2D_ISR_TWIF)
+
+#define GFX2D_MASK              (GFX2D_QUEUE - 1U)
+#define GFX2D_PL_MAX            16383U
+
+/* The DMA2D is an AXI master and cannot reach the TCMs */
+#define GFX2D_TCM(addr)         ((((addr) & 0xFF000000U) == 0x00000000U) || \
+                                 (((addr) & 0xFF000000U) == 0x20000000U))
+
+/* Private typedef -----------------------------------------------------------*/
+typedef enum
+{
+  GFX2D_FILL = 0U,
+  GFX2D_BLIT,
+  GFX2D_BLEND,
+  GFX2D_GLYPH
+} gfx2d_kind_t;
+
+/* One operation, clipped */
+typedef struct
+{
+  uint32_t kind;
+  const gfx2d_surface_t *dst;
+  const gfx2d_surface_t *src;
+  uint32_t x;
+  uint32_t y;
+  uint32_t sx;
+  uint32_t sy;
+  uint32_t w;
+  uint32_t h;
+  uint32_t argb;                /* fill and glyph colour */
+  uint32_t alpha;               /* blend */
+} gfx2d_rect_t;
+
+/* DMA2D register image of a queued operation */
+typedef struct
+{
+  uint32_t cr;
+  uint32_t fgpfccr;
+  uint32_t fgcolr;
+  uint32_t fgmar;
+  uint32_t fgor;
+  uint32_t bgpfccr;
+  uint32_t bgmar;
+  uint32_t bgor;
+  uint32_t opfccr;
+  uint32_t ocolr;
+  uint32_t omar;
+  uint32_t oor;
+  uint32_t nlr;
+  const uint32_t *clut;         /* L8 source, loaded before the transfer */
+} gfx2d_op_t;
+
+/* Private variables ---------------------------------------------------------*/
+static gfx2d_op_t gfx2d_queue[GFX2D_QUEUE];
+static volatile uint32_t gfx2d_head = 0U;       /* caller */
+static volatile uint32_t gfx2d_tail = 0U;       /* interrupt */
+static volatile uint32_t gfx2d_running = 0U;
+static const uint32_t *gfx2d_clut = NULL;       /* in the foreground CLUT */
+static gfx2d_stats_t gfx2d_stat;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t gfx2d_bits(uint32_t format)
+{
+  switch(format)
+  {
+    case GFX2D_ARGB8888: return 32U;
+    case GFX2D_RGB565:   return 16U;
+    case GFX2D_A4:       return 4U;
+    default:             return 8U;
+  }
+}
+
+static uint32_t gfx2d_addr(const gfx2d_surface_t *s, uint32_t x, uint32_t y)
+{
+  return (uint32_t)s->pixels + ((((y * s->pitch) + x) * gfx2d_bits(s->format)) / 8U);
+}
+
+/* Bytes from the first pixel of a rectangle to past its last */
+static uint32_t gfx2d_span(const gfx2d_surface_t *s, uint32_t w, uint32_t h)
+{
+  return (((((h - 1U) * s->pitch) + w) * gfx2d_bits(s->format)) + 7U) / 8U;
+}
+
+static uint32_t gfx2d_pack565(uint32_t argb)
+{
+  return ((argb >> 8) & 0xF800U) | ((argb >> 5) & 0x07E0U) | ((argb >> 3) & 0x001FU);
+}
+
+static uint32_t gfx2d_read(const gfx2d_surface_t *s, uint32_t x, uint32_t y, uint32_t argb)
+{
+  uint32_t i = (y * s->pitch) + x;
+  uint32_t v;
+  uint32_t r;
+  uint32_t g;
+  uint32_t b;
+
+  switch(s->format)
+  {
+    case GFX2D_ARGB8888:
+      return ((const uint32_t *)s->pixels)[i];
+    case GFX2D_RGB565:
+      v = ((const uint16_t *)s->pixels)[i];
+      r = (v >> 11) & 0x1FU;
+      g = (v >> 5) & 0x3FU;
+      b = v & 0x1FU;
+      return 0xFF000000U | (((r << 3) | (r >> 2)) << 16) | (((g << 2) | (g >> 4)) << 8) | ((b << 3) | (b >> 2));
+    case GFX2D_L8:
+      return s->clut[((const uint8_t *)s->pixels)[i]];
+    case GFX2D_A8:
+      return ((uint32_t)((const uint8_t *)s->pixels)[i] << 24) | (argb & 0x00FFFFFFU);
+    default:
+      v = (((const uint8_t *)s->pixels)[i >> 1] >> ((i & 1U) * 4U)) & 0x0FU;
+      return ((v * 0x11U) << 24) | (argb & 0x00FFFFFFU);
+  }
+}
+
+static void gfx2d_write(const gfx2d_surface_t *s, uint32_t x, uint32_t y, uint32_t argb)
+{
+  uint32_t i = (y * s->pitch) + x;
+
+  if(s->format == GFX2D_ARGB8888)
+  {
+    ((uint32_t *)s->pixels)[i] = argb;
+  }
+  else
+  {
+    ((uint16_t *)s->pixels)[i] = (uint16_t)gfx2d_pack565(argb);
+  }
+}
+
+/* fg over bg, the DMA2D blender */
+static uint32_t gfx2d_mix(uint32_t fg, uint32_t bg)
+{
+  uint32_t af = fg >> 24;
+  uint32_t ab = bg >> 24;
+  uint32_t am = (af * ab) / 255U;
+  uint32_t a = af + ab - am;
+  uint32_t out;
+  uint32_t cf;
+  uint32_t cb;
+  uint32_t s;
+
+  if(a == 0U)
+  {
+    return 0U;
+  }
+  out = a << 24;
+  for(s = 0U; s < 24U; s += 8U)
+  {
+    cf = (fg >> s) & 0xFFU;
+    cb = (bg >> s) & 0xFFU;
+    out |= (((cf * af) + (cb * ab) - (cb * am)) / a) << s;
+  }
+  return out;
+}
+
+static uint32_t gfx2d_scale(uint32_t argb, uint32_t alpha)
+{
+  return ((((argb >> 24) * alpha) / 255U) << 24) | (argb & 0x00FFFFFFU);
+}
+
+static void gfx2d_cpu(const gfx2d_rect_t *r)
+{
+  const gfx2d_surface_t *dst = r->dst;
+  const gfx2d_surface_t *src = r->src;
+  uint32_t bytes;
+  uint32_t v;
+  uint32_t i;
+  uint32_t j;
+
+  /* The DMA2D may have written either surface behind the cache */
+  dma_cache_flush((void *)gfx2d_addr(dst, r->x, r->y), gfx2d_span(dst, r->w, r->h));
+  if(src != NULL)
+  {
+    dma_cache_flush((void *)gfx2d_addr(src, r->sx, r->sy), gfx2d_span(src, r->w, r->h));
+  }
+
+  switch(r->kind)
+  {
+    case GFX2D_FILL:
+      v = (dst->format == GFX2D_ARGB8888) ? r->argb : gfx2d_pack565(r->argb);
+      for(j = 0U; j < r->h; j++)
+      {
+        for(i = 0U; i < r->w; i++)
+        {
+          if(dst->format == GFX2D_ARGB8888)
+          {
+            ((uint32_t *)dst->pixels)[((r->y + j) * dst->pitch) + r->x + i] = v;
+          }
+          else
+          {
+            ((uint16_t *)dst->pixels)[((r->y + j) * dst->pitch) + r->x + i] = (uint16_t)v;
+          }
+        }
+      }
+      break;
+
+    case GFX2D_BLIT:
+      if(src->format == dst->format)
+      {
+        bytes = (r->w * gfx2d_bits(dst->format)) / 8U;
+        for(j = 0U; j < r->h; j++)
+        {
+          memmove((void *)gfx2d_addr(dst, r->x, r->y + j), (const void *)gfx2d_addr(src, r->sx, r->sy + j), bytes);
+        }
+        break;
+      }
+      for(j = 0U; j < r->h; j++)
+      {
+        for(i = 0U; i < r->w; i++)
+        {
+          gfx2d_write(dst, r->x + i, r->y + j, gfx2d_read(src, r->sx + i, r->sy + j, 0U));
+        }
+      }
+      break;
+
+    default:
+      /* Blend and glyph: the source alpha times a constant, over dst */
+      for(j = 0U; j < r->h; j++)
+      {
+        for(i = 0U; i < r->w; i++)
+        {
+          v = gfx2d_scale(gfx2d_read(src, r->sx + i, r->sy + j, r->argb), r->alpha);
+          gfx2d_write(dst, r->x + i, r->y + j, gfx2d_mix(v, gfx2d_read(dst, r->x + i, r->y + j, 0U)));
+        }
+      }
+      break;
+  }
+
+  gfx2d_stat.cpu_ops++;
+  gfx2d_stat.cpu_pixels += r->w * r->h;
+}
+
+/* 1 if the DMA2D can do the operation */
+static uint32_t gfx2d_hw_ok(const gfx2d_rect_t *r)
+{
+  const gfx2d_surface_t *src = r->src;
+
+  if((r->w > GFX2D_PL_MAX) || GFX2D_TCM((uint32_t)r->dst->pixels))
+  {
+    return 0U;
+  }
+  if(src != NULL)
+  {
+    if(GFX2D_TCM((uint32_t)src->pixels) ||
+       ((src->format == GFX2D_L8) && GFX2D_TCM((uint32_t)src->clut)) ||
+       ((src->format == GFX2D_A4) && (((src->pitch | r->sx | r->w) & 1U) != 0U)))
+    {
+      return 0U;
+    }
+  }
+  return 1U;
+}
+
+static void gfx2d_build(const gfx2d_rect_t *r, gfx2d_op_t *op)
+{
+  const gfx2d_surface_t *dst = r->dst;
+  const gfx2d_surface_t *src = r->src;
+
+  memset(op, 0, sizeof(*op));
+  op->opfccr = dst->format;
+  op->omar = gfx2d_addr(dst, r->x, r->y);
+  op->oor = dst->pitch - r->w;
+  op->nlr = (r->w << DMA2D_NLR_PL_Pos) | r->h;
+  if(src != NULL)
+  {
+    op->fgmar = gfx2d_addr(src, r->sx, r->sy);
+    op->fgor = src->pitch - r->w;
+    op->fgpfccr = src->format;
+    if(src->format == GFX2D_L8)
+    {
+      op->fgpfccr |= GFX2D_CLUT_256;
+      op->clut = src->clut;
+    }
+  }
+
+  switch(r->kind)
+  {
+    case GFX2D_FILL:
+      op->cr = GFX2D_MODE_R2M;
+      op->ocolr = (dst->format == GFX2D_ARGB8888) ? r->argb : gfx2d_pack565(r->argb);
+      break;
+    case GFX2D_BLIT:
+      op->cr = (src->format == dst->format) ? GFX2D_MODE_M2M : GFX2D_MODE_PFC;
+      break;
+    default:
+      /* The destination is also the background */
+      op->cr = GFX2D_MODE_BLEND;
+      op->fgpfccr |= GFX2D_AM_MULTIPLY | (r->alpha << DMA2D_FGPFCCR_ALPHA_Pos);
+      op->fgcolr = r->argb & 0x00FFFFFFU;
+      op->bgpfccr = dst->format;
+      op->bgmar = op->omar;
+      op->bgor = op->oor;
+      break;
+  }
+}
+
+/* Start the operation at the tail, its CLUT first if it is not loaded.
+   Interrupts off or from the interrupt. */
+static void gfx2d_kick(void)
+{
+  const gfx2d_op_t *op;
+
+  if(gfx2d_tail == gfx2d_head)
+  {
+    gfx2d_running = 0U;
+    return;
+  }
+  op = &gfx2d_queue[gfx2d_tail & GFX2D_MASK];
+  gfx2d_running = 1U;
+
+  if((op->clut != NULL) && (op->clut != gfx2d_clut))
+  {
+    gfx2d_clut = op->clut;
+    DMA2D->CR = GFX2D_IT;
+    DMA2D->FGCMAR = (uint32_t)op->clut;
+    DMA2D->FGPFCCR = op->fgpfccr | DMA2D_FGPFCCR_START;
+    return;
+  }
+
+  DMA2D->FGPFCCR = op->fgpfccr;
+  DMA2D->FGCOLR = op->fgcolr;
+  DMA2D->FGMAR = op->fgmar;
+  DMA2D->FGOR = op->fgor;
+  DMA2D->BGPFCCR = op->bgpfccr;
+  DMA2D->BGMAR = op->bgmar;
+  DMA2D->BGOR = op->bgor;
+  DMA2D->OPFCCR = op->opfccr;
+  DMA2D->OCOLR = op->ocolr;
+  DMA2D->OMAR = op->omar;
+  DMA2D->OOR = op->oor;
+  DMA2D->NLR = op->nlr;
+  DMA2D->CR = op->cr | GFX2D_IT | DMA2D_CR_START;
+}
+
+static void gfx2d_push(const gfx2d_rect_t *r)
+{
+  const gfx2d_surface_t *src = r->src;
+  gfx2d_op_t *op;
+  uint32_t primask;
+
+  if((gfx2d_head - gfx2d_tail) >= GFX2D_QUEUE)
+  {
+    gfx2d_stat.waits++;
+    while((gfx2d_head - gfx2d_tail) >= GFX2D_QUEUE)
+    {
+    }
+  }
+
+  /* Sources out to memory; the destination also out of the cache, so no
+     stale line hides what the DMA2D writes */
+  if(src != NULL)
+  {
+    dma_cache_clean((const void *)gfx2d_addr(src, r->sx, r->sy), gfx2d_span(src, r->w, r->h));
+    if(src->format == GFX2D_L8)
+    {
+      dma_cache_clean(src->clut, 256U * 4U);
+    }
+  }
+  dma_cache_flush((void *)gfx2d_addr(r->dst, r->x, r->y), gfx2d_span(r->dst, r->w, r->h));
+
+  /* Only this thread adds, the slot at head is free */
+  op = &gfx2d_queue[gfx2d_head & GFX2D_MASK];
+  gfx2d_build(r, op);
+  gfx2d_stat.dma2d_ops++;
+  gfx2d_stat.dma2d_pixels += r->w * r->h;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  gfx2d_head++;
+  if(gfx2d_running == 0U)
+  {
+    gfx2d_kick();
+  }
+  __set_PRIMASK(primask);
+}
+
+/* Clip to both surfaces; 0 if nothing is left */
+static uint32_t gfx2d_clip(gfx2d_rect_t *r, int32_t x, int32_t y, int32_t sx, int32_t sy, int32_t w, int32_t h)
+{
+  if(x < 0)
+  {
+    sx -= x;
+    w += x;
+    x = 0;
+  }
+  if(y < 0)
+  {
+    sy -= y;
+    h += y;
+    y = 0;
+  }
+  if(r->src != NULL)
+  {
+    if(sx < 0)
+    {
+      x -= sx;
+      w += sx;
+      sx = 0;
+    }
+    if(sy < 0)
+    {
+      y -= sy;
+      h += sy;
+      sy = 0;
+    }
+    if(w > ((int32_t)r->src->width - sx))
+    {
+      w = (int32_t)r->src->width - sx;
+    }
+    if(h > ((int32_t)r->src->height - sy))
+    {
+      h = (int32_t)r->src->height - sy;
+    }
+  }
+  if(w > ((int32_t)r->dst->width - x))
+  {
+    w = (int32_t)r->dst->width - x;
+  }
+  if(h > ((int32_t)r->dst->height - y))
+  {
+    h = (int32_t)r->dst->height - y;
+  }
+  if((w <= 0) || (h <= 0))
+  {
+    return 0U;
+  }
+  r->x = (uint32_t)x;
+  r->y = (uint32_t)y;
+  r->sx = (uint32_t)sx;
+  r->sy = (uint32_t)sy;
+  r->w = (uint32_t)w;
+  r->h = (uint32_t)h;
+  return 1U;
+}
+
+static HAL_StatusTypeDef gfx2d_run(gfx2d_rect_t *r, int32_t x, int32_t y, int32_t sx, int32_t sy, int32_t w, int32_t h)
+{
+  if((r->dst->format != GFX2D_ARGB8888) && (r->dst->format != GFX2D_RGB565))
+  {
+    return HAL_ERROR;
+  }
+  if((r->src != NULL) && (r->src->format == GFX2D_L8) && (r->src->clut == NULL))
+  {
+    return HAL_ERROR;
+  }
+  if(gfx2d_clip(r, x, y, sx, sy, w, h) == 0U)
+  {
+    return HAL_OK;
+  }
+
+  if(gfx2d_hw_ok(r) == 0U)
+  {
+    gfx2d_sync();
+    gfx2d_cpu(r);
+  }
+  else if(((r->w * r->h) <= GFX2D_CPU_MAX) && (gfx2d_busy() == 0U))
+  {
+    gfx2d_cpu(r);
+  }
+  else
+  {
+    gfx2d_push(r);
+  }
+  return HAL_OK;
+}
+
+static uint32_t gfx2d_is_color(const gfx2d_surface_t *s)
+{
+  return ((s->format == GFX2D_ARGB8888) || (s->format == GFX2D_RGB565) || (s->format == GFX2D_L8)) ? 1U : 0U;
+}
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef gfx2d_init(void)
+{
+  __HAL_RCC_DMA2D_CLK_ENABLE();
+
+  DMA2D->CR = 0U;
+  DMA2D->IFCR = GFX2D_FLAGS;
+  gfx2d_head = 0U;
+  gfx2d_tail = 0U;
+  gfx2d_running = 0U;
+  gfx2d_clut = NULL;
+  memset(&gfx2d_stat, 0, sizeof(gfx2d_stat));
+
+  HAL_NVIC_SetPriority(DMA2D_IRQn, GFX2D_IRQ_PRIORITY, 0U);
+  HAL_NVIC_EnableIRQ(DMA2D_IRQn);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef gfx2d_fill(const gfx2d_surface_t *dst, int32_t x, int32_t y,
+                             int32_t w, int32_t h, uint32_t argb)
+{
+  gfx2d_rect_t r;
+
+  memset(&r, 0, sizeof(r));
+  r.kind = GFX2D_FILL;
+  r.dst = dst;
+  r.argb = argb;
+  return gfx2d_run(&r, x, y, 0, 0, w, h);
+}
+
+HAL_StatusTypeDef gfx2d_blit(const gfx2d_surface_t *dst, int32_t x, int32_t y,
+                             const gfx2d_surface_t *src, int32_t sx, int32_t sy, int32_t w, int32_t h)
+{
+  gfx2d_rect_t r;
+
+  if(gfx2d_is_color(src) == 0U)
+  {
+    return HAL_ERROR;
+  }
+  memset(&r, 0, sizeof(r));
+  r.kind = GFX2D_BLIT;
+  r.dst = dst;
+  r.src = src;
+  return gfx2d_run(&r, x, y, sx, sy, w, h);
+}
+
+HAL_StatusTypeDef gfx2d_blend(const gfx2d_surface_t *dst, int32_t x, int32_t y,
+                              const gfx2d_surface_t *src, int32_t sx, int32_t sy, int32_t w, int32_t h,
+                              uint8_t alpha)
+{
+  gfx2d_rect_t r;
+
+  if(gfx2d_is_color(src) == 0U)
+  {
+    return HAL_ERROR;
+  }
+  memset(&r, 0, sizeof(r));
+  r.kind = GFX2D_BLEND;
+  r.dst = dst;
+  r.src = src;
+  r.alpha = alpha;
+  return gfx2d_run(&r, x, y, sx, sy, w, h);
+}
+
+HAL_StatusTypeDef gfx2d_glyph(const gfx2d_surface_t *dst, int32_t x, int32_t y,
+                              const gfx2d_surface_t *glyph, uint32_t argb)
+{
+  gfx2d_rect_t r;
+
+  if((glyph->format != GFX2D_A8) && (glyph->format != GFX2D_A4))
+  {
+    return HAL_ERROR;
+  }
+  memset(&r, 0, sizeof(r));
+  r.kind = GFX2D_GLYPH;
+  r.dst = dst;
+  r.src = glyph;
+  r.argb = argb;
+  r.alpha = argb >> 24;
+  return gfx2d_run(&r, x, y, 0, 0, glyph->width, glyph->height);
+}
+
+void gfx2d_sync(void)
+{
+  while(gfx2d_busy() != 0U)
+  {
+  }
+}
+
+uint32_t gfx2d_busy(void)
+{
+  return ((gfx2d_running != 0U) || (gfx2d_head != gfx2d_tail)) ? 1U : 0U;
+}
+
+const gfx2d_stats_t *gfx2d_stats(void)
+{
+  return &gfx2d_stat;
+}
+
+void gfx2d_irq(void)
+{
+  uint32_t isr = DMA2D->ISR;
+
+  DMA2D->IFCR = isr & GFX2D_FLAGS;
+  if((isr & GFX2D_ERRORS) != 0U)
+  {
+    /* Drop the operation; reload the CLUT for the next one */
+    gfx2d_stat.errors++;
+    gfx2d_clut = NULL;
+    gfx2d_tail++;
+  }
+  else if((isr & DMA2D_ISR_TCIF) != 0U)
+  {
+    gfx2d_tail++;
+  }
+  else if((isr & DMA2D_ISR_CTCIF) == 0U)
+  {
+    return;
+  }
+  /* Next operation, or the transfer after its CLUT */
+  gfx2d_kick();
+}
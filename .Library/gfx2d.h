@@ -0,0 +1,116 @@
+#ifndef __GFX2D_H
+#define __GFX2D_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+
+/* 2D drawing on the DMA2D: rectangle fill, blit with format conversion,
+   alpha blending and A4/A8 glyphs. Calls queue the operation and return,
+   and the DMA2D interrupt starts the next one, so the CPU keeps working
+   while the DMA2D draws. Operations run in call order, CPU ones included.
+
+   Operations of at most GFX2D_CPU_MAX pixels, called while the queue is
+   idle, are drawn by the CPU on the spot, since setting up the DMA2D
+   costs more. So are operations the DMA2D cannot do: surfaces in TCM, an
+   A4 glyph at an odd position or width. Those first wait for the queue
+   to drain. The CPU path uses the DMA2D arithmetic:
+   - 5/6-bit channels widen by repeating their top bits and narrow by
+     truncation,
+   - A4 is A * 0x11, first pixel in the low nibble,
+   - alpha times constant alpha is a * c / 255,
+   - blending gives a = af + ab - af * ab / 255 and
+     c = (cf * af + cb * ab - cb * af * ab / 255) / a.
+
+   Destinations are ARGB8888 or RGB565. L8 (with a CLUT of ARGB8888
+   entries), A8 and A4 are source formats only. A CLUT is loaded again
+   only when the pointer changes, not when its entries do. Rectangles are
+   clipped to both surfaces. Surfaces are cleaned/flushed from the data
+   cache around each operation. A surface the CPU reads after DMA2D
+   writes, in cached memory, needs gfx2d_sync() and then
+   dma_cache_invalidate(). Map framebuffers write-through
+   (MPU_PLAN_FRAMEBUFFER) to keep that cheap.
+
+   Not for interrupt context. DMA2D_IRQHandler has to call gfx2d_irq(). */
+
+/* Exported constants --------------------------------------------------------*/
+#ifndef GFX2D_CPU_MAX
+#define GFX2D_CPU_MAX           64U             /* pixels */
+#endif
+
+#ifndef GFX2D_QUEUE
+#define GFX2D_QUEUE             16U             /* operations, power of two */
+#endif
+
+#ifndef GFX2D_IRQ_PRIORITY
+#define GFX2D_IRQ_PRIORITY      6U
+#endif
+
+#if (GFX2D_QUEUE < 2U) || ((GFX2D_QUEUE & (GFX2D_QUEUE - 1U)) != 0U)
+#error "gfx2d: GFX2D_QUEUE must be a power of two"
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+/* Values are the DMA2D input color modes */
+typedef enum
+{
+  GFX2D_ARGB8888 = 0U,
+  GFX2D_RGB565 = 2U,
+  GFX2D_L8 = 5U,
+  GFX2D_A8 = 9U,
+  GFX2D_A4 = 10U
+} gfx2d_format_t;
+
+typedef struct
+{
+  void *pixels;
+  uint16_t width;
+  uint16_t height;
+  uint16_t pitch;               /* pixels per line, even for A4 */
+  uint16_t format;              /* gfx2d_format_t */
+  const uint32_t *clut;         /* L8: 256 ARGB8888 entries */
+} gfx2d_surface_t;
+
+typedef struct
+{
+  uint32_t dma2d_ops;
+  uint32_t dma2d_pixels;
+  uint32_t cpu_ops;
+  uint32_t cpu_pixels;
+  uint32_t waits;               /* calls that found the queue full */
+  uint32_t errors;              /* DMA2D transfer, CLUT or configuration errors */
+} gfx2d_stats_t;
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef gfx2d_init(void);
+
+/* All return HAL_ERROR for a format the operation cannot take; a
+   rectangle clipped away entirely is HAL_OK */
+HAL_StatusTypeDef gfx2d_fill(const gfx2d_surface_t *dst, int32_t x, int32_t y,
+                             int32_t w, int32_t h, uint32_t argb);
+/* Copy a rectangle, converting the format if the surfaces differ */
+HAL_StatusTypeDef gfx2d_blit(const gfx2d_surface_t *dst, int32_t x, int32_t y,
+                             const gfx2d_surface_t *src, int32_t sx, int32_t sy, int32_t w, int32_t h);
+/* src over dst, src alpha scaled by alpha (255 = as is) */
+HAL_StatusTypeDef gfx2d_blend(const gfx2d_surface_t *dst, int32_t x, int32_t y,
+                              const gfx2d_surface_t *src, int32_t sx, int32_t sy, int32_t w, int32_t h,
+                              uint8_t alpha);
+/* An A8/A4 glyph in colour argb over dst, its top left at x, y */
+HAL_StatusTypeDef gfx2d_glyph(const gfx2d_surface_t *dst, int32_t x, int32_t y,
+                              const gfx2d_surface_t *glyph, uint32_t argb);
+
+/* Wait until every queued operation is drawn */
+void gfx2d_sync(void);
+uint32_t gfx2d_busy(void);
+
+const gfx2d_stats_t *gfx2d_stats(void);
+void gfx2d_irq(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
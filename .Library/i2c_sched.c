@@ -0,0 +1,550 @@
+/* Header includes -----------------------------------------------------------*/
+#include "i2c_sched.h"
+#include "dma_cache.h"
+#include "pin.h"
+
+/* Private macro -------------------------------------------------------------*/
+/* I2C buses with a scheduler, the HAL callbacks look them up here */
+#ifndef I2C_SCHED_MAX
+#define I2C_SCHED_MAX           4U
+#endif
+
+/* Half SCL period while clocking a stuck bus free, ~100 kHz */
+#define I2C_RECOVER_HALF_US     5U
+
+/* What s->alarm is armed for */
+#define I2C_ALARM_TIMEOUT       0U
+#define I2C_ALARM_RETRY         1U
+#define I2C_ALARM_RECOVER       2U
+
+/* Recovery steps, one per half SCL period */
+#define I2C_RECOVER_CHECK       0U      /* SCL high: SDA released? */
+#define I2C_RECOVER_PULSE       1U      /* SCL low */
+#define I2C_RECOVER_STOP        2U      /* SCL and SDA low */
+#define I2C_RECOVER_STOP_SDA    3U      /* SCL high, SDA low */
+#define I2C_RECOVER_END         4U      /* STOP sent */
+
+#define I2C_BUS_ERRORS          (HAL_I2C_ERROR_BERR | HAL_I2C_ERROR_ARLO | HAL_I2C_ERROR_TIMEOUT)
+
+/* Private variables ---------------------------------------------------------*/
+static i2c_sched_t *i2c_sched_list[I2C_SCHED_MAX];
+
+/* Private functions ---------------------------------------------------------*/
+static void i2c_sched_run(i2c_sched_t *s);
+
+static void i2c_sched_alarm(void *context);
+
+static i2c_sched_t *i2c_sched_find(const I2C_HandleTypeDef *hi2c)
+{
+  uint32_t i;
+
+  for(i = 0U; i < I2C_SCHED_MAX; i++)
+  {
+    if((i2c_sched_list[i] != NULL) && (i2c_sched_list[i]->hi2c == hi2c))
+    {
+      return i2c_sched_list[i];
+    }
+  }
+  return NULL;
+}
+
+/* Sequential transfer option for segment i: STOP after the last one, a
+   continued transfer into a following segment of the same direction and a
+   repeated start in front of one that turns the bus around */
+static uint32_t i2c_sched_option(const i2c_job_t *job, uint32_t i)
+{
+  if((i + 1U) == job->count)
+  {
+    return (i == 0U) ? I2C_FIRST_AND_LAST_FRAME : I2C_LAST_FRAME;
+  }
+  if(job->seg[i + 1U].read == job->seg[i].read)
+  {
+    return (i == 0U) ? I2C_FIRST_AND_NEXT_FRAME : I2C_NEXT_FRAME;
+  }
+  return (i == 0U) ? I2C_FIRST_FRAME : I2C_LAST_FRAME_NO_STOP;
+}
+
+static uint32_t i2c_sched_use_dma(const i2c_sched_t *s, const i2c_seg_t *seg)
+{
+  if(seg->len < I2C_SCHED_DMA_MIN)
+  {
+    return 0U;
+  }
+  return (((seg->read != 0U) ? s->hi2c->hdmarx : s->hi2c->hdmatx) != NULL) ? 1U : 0U;
+}
+
+static HAL_StatusTypeDef i2c_sched_start_seg(i2c_sched_t *s, i2c_job_t *job)
+{
+  I2C_HandleTypeDef *hi2c = s->hi2c;
+  i2c_seg_t *seg = &job->seg[job->step];
+  uint32_t option = i2c_sched_option(job, job->step);
+  uint16_t addr = (uint16_t)(job->addr << 1);
+
+  if(i2c_sched_use_dma(s, seg) != 0U)
+  {
+    if(seg->read != 0U)
+    {
+      dma_cache_invalidate(seg->data, seg->len);
+      return HAL_I2C_Master_Seq_Receive_DMA(hi2c, addr, seg->data, seg->len, option);
+    }
+    dma_cache_clean(seg->data, seg->len);
+    return HAL_I2C_Master_Seq_Transmit_DMA(hi2c, addr, seg->data, seg->len, option);
+  }
+  if(seg->read != 0U)
+  {
+    return HAL_I2C_Master_Seq_Receive_IT(hi2c, addr, seg->data, seg->len, option);
+  }
+  return HAL_I2C_Master_Seq_Transmit_IT(hi2c, addr, seg->data, seg->len, option);
+}
+
+static void i2c_sched_finish(i2c_sched_t *s, i2c_job_t *job, HAL_StatusTypeDef status)
+{
+  uint64_t now = timebase_us();
+  uint32_t latency;
+
+  timebase_alarm_cancel(&s->alarm);
+  job->status = status;
+  job->bus_us = (uint32_t)(now - job->stamp);
+  latency = job->wait_us + job->bus_us;
+
+  s->stats.jobs++;
+  if(status != HAL_OK)
+  {
+    s->stats.errors++;
+  }
+  if(latency > s->stats.max_latency_us)
+  {
+    s->stats.max_latency_us = latency;
+  }
+  if(job->done != NULL)
+  {
+    job->done(job);
+  }
+  s->active = NULL;
+  i2c_sched_run(s);
+}
+
+/* Drive the pins in mask as open-drain outputs, their mode and output
+   type saved in save[0..1]; pull, speed and AF stay */
+static void i2c_sched_pins_take(GPIO_TypeDef *port, uint32_t mask, uint32_t *save)
+{
+  uint32_t m2 = pin_spread2(mask);
+
+  save[0] = port->MODER;
+  save[1] = port->OTYPER;
+  port->OTYPER = save[1] | mask;
+  port->MODER = (save[0] & ~(m2 * 3U)) | (m2 * PIN_MODE_OUTPUT);
+}
+
+static void i2c_sched_pins_give(GPIO_TypeDef *port, uint32_t mask, const uint32_t *save)
+{
+  uint32_t m2 = pin_spread2(mask) * 3U;
+
+  port->MODER = (port->MODER & ~m2) | (save[0] & m2);
+  port->OTYPER = (port->OTYPER & ~mask) | (save[1] & mask);
+}
+
+/* Reset the peripheral and take the bus pins; the alarm does the rest.
+   s->recovering is set. */
+static void i2c_sched_recover_start(i2c_sched_t *s)
+{
+  s->stats.recoveries++;
+
+  /* PE = 0 is the peripheral's software reset */
+  CLEAR_BIT(s->hi2c->Instance->CR1, I2C_CR1_PE);
+
+  pin_set(s->scl_port, s->scl_mask);
+  pin_set(s->sda_port, s->sda_mask);
+  i2c_sched_pins_take(s->scl_port, s->scl_mask, &s->pin_save[0]);
+  i2c_sched_pins_take(s->sda_port, s->sda_mask, &s->pin_save[2]);
+  s->recover_step = I2C_RECOVER_CHECK;
+  s->recover_pulses = 0U;
+  s->alarm_kind = I2C_ALARM_RECOVER;
+  /* +1: at least the half period */
+  timebase_alarm_start_in(&s->alarm, I2C_RECOVER_HALF_US + 1U, i2c_sched_alarm, s);
+}
+
+/* One half SCL period of the recovery. A target stuck in a read holds SDA
+   low until it has shifted out the rest of its byte: clock until it lets
+   go, then send a STOP. */
+static void i2c_sched_recover_step(i2c_sched_t *s)
+{
+  I2C_TypeDef *i2c = s->hi2c->Instance;
+  uint32_t step = s->recover_step;
+
+  if(step == I2C_RECOVER_CHECK)
+  {
+    pin_clr(s->scl_port, s->scl_mask);
+    if((pin_read(s->sda_port, s->sda_mask) == 0U) && (s->recover_pulses < 9U))
+    {
+      step = I2C_RECOVER_PULSE;
+    }
+    else
+    {
+      pin_clr(s->sda_port, s->sda_mask);
+      step = I2C_RECOVER_STOP;
+    }
+  }
+  else if(step == I2C_RECOVER_PULSE)
+  {
+    pin_set(s->scl_port, s->scl_mask);
+    s->recover_pulses++;
+    step = I2C_RECOVER_CHECK;
+  }
+  else if(step == I2C_RECOVER_STOP)
+  {
+    pin_set(s->scl_port, s->scl_mask);
+    step = I2C_RECOVER_STOP_SDA;
+  }
+  else if(step == I2C_RECOVER_STOP_SDA)
+  {
+    pin_set(s->sda_port, s->sda_mask);
+    step = I2C_RECOVER_END;
+  }
+  else
+  {
+    i2c_sched_pins_give(s->scl_port, s->scl_mask, &s->pin_save[0]);
+    i2c_sched_pins_give(s->sda_port, s->sda_mask, &s->pin_save[2]);
+    SET_BIT(i2c->CR1, I2C_CR1_PE);
+    if(((i2c->ISR & I2C_ISR_BUSY) != 0U) || (pin_read(s->sda_port, s->sda_mask) == 0U))
+    {
+      s->stats.stuck++;
+    }
+    s->recovering = 0U;
+    i2c_sched_run(s);
+    return;
+  }
+  s->recover_step = (uint8_t)step;
+  timebase_alarm_start_in(&s->alarm, I2C_RECOVER_HALF_US + 1U, i2c_sched_alarm, s);
+}
+
+/* Report job, then free the bus before the next one starts */
+static void i2c_sched_finish_recover(i2c_sched_t *s, i2c_job_t *job, HAL_StatusTypeDef status)
+{
+  s->recovering = 1U;
+  i2c_sched_finish(s, job, status);
+  i2c_sched_recover_start(s);
+}
+
+/* (Re)start the active job from its first segment */
+static void i2c_sched_attempt(i2c_sched_t *s, i2c_job_t *job)
+{
+  job->step = 0U;
+  job->error = HAL_I2C_ERROR_NONE;
+  s->alarm_kind = I2C_ALARM_TIMEOUT;
+  timebase_alarm_start_in(&s->alarm, I2C_SCHED_TIMEOUT_US, i2c_sched_alarm, s);
+  if(i2c_sched_start_seg(s, job) != HAL_OK)
+  {
+    job->error = HAL_I2C_GetError(s->hi2c);
+    i2c_sched_finish(s, job, HAL_ERROR);
+  }
+}
+
+/* Job timeout: the bus or the peripheral hangs. Stop everything, report
+   the job and free the bus. NACK retry: start the job again. Recovery:
+   the next half SCL period. */
+static void i2c_sched_alarm(void *context)
+{
+  i2c_sched_t *s = (i2c_sched_t *)context;
+  I2C_HandleTypeDef *hi2c = s->hi2c;
+  i2c_job_t *job = s->active;
+  uint32_t primask;
+
+  if(s->alarm_kind == I2C_ALARM_RECOVER)
+  {
+    i2c_sched_recover_step(s);
+    return;
+  }
+  if(job == NULL)
+  {
+    return;
+  }
+  if(s->alarm_kind == I2C_ALARM_RETRY)
+  {
+    job->attempt++;
+    s->stats.retries++;
+    i2c_sched_attempt(s, job);
+    return;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  __HAL_I2C_DISABLE_IT(hi2c, I2C_IT_ERRI | I2C_IT_TCI | I2C_IT_STOPI | I2C_IT_NACKI |
+                             I2C_IT_ADDRI | I2C_IT_RXI | I2C_IT_TXI);
+  if(hi2c->hdmatx != NULL)
+  {
+    (void)HAL_DMA_Abort(hi2c->hdmatx);
+  }
+  if(hi2c->hdmarx != NULL)
+  {
+    (void)HAL_DMA_Abort(hi2c->hdmarx);
+  }
+  hi2c->State = HAL_I2C_STATE_READY;
+  hi2c->Mode = HAL_I2C_MODE_NONE;
+  hi2c->PreviousState = (uint32_t)HAL_I2C_MODE_NONE;
+  __HAL_UNLOCK(hi2c);
+  __set_PRIMASK(primask);
+
+  job->error |= HAL_I2C_ERROR_TIMEOUT;
+  i2c_sched_finish_recover(s, job, HAL_TIMEOUT);
+}
+
+static void i2c_sched_seg_done(i2c_sched_t *s)
+{
+  i2c_job_t *job;
+  i2c_seg_t *seg;
+
+  if(s->active == NULL)
+  {
+    return;
+  }
+  job = s->active;
+  seg = &job->seg[job->step];
+  if((seg->read != 0U) && (i2c_sched_use_dma(s, seg) != 0U))
+  {
+    /* Lines speculatively refilled during the transfer are stale */
+    dma_cache_invalidate(seg->data, seg->len);
+  }
+
+  job->step++;
+  if(job->step < job->count)
+  {
+    if(i2c_sched_start_seg(s, job) != HAL_OK)
+    {
+      job->error = HAL_I2C_GetError(s->hi2c);
+      i2c_sched_finish_recover(s, job, HAL_ERROR);
+    }
+    return;
+  }
+  i2c_sched_finish(s, job, HAL_OK);
+}
+
+/* Start the next queued job if the bus is free */
+static void i2c_sched_run(i2c_sched_t *s)
+{
+  i2c_job_t *job;
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  job = s->head;
+  if((s->active != NULL) || (s->recovering != 0U) || (job == NULL))
+  {
+    __set_PRIMASK(primask);
+    return;
+  }
+  s->head = job->next;
+  if(s->head == NULL)
+  {
+    s->tail = NULL;
+  }
+  s->active = job;
+  __set_PRIMASK(primask);
+
+  job->attempt = 0U;
+  job->wait_us = timebase_elapsed_us(job->stamp);
+  job->stamp = timebase_us();
+  i2c_sched_attempt(s, job);
+}
+
+static void i2c_sched_error(i2c_sched_t *s)
+{
+  I2C_HandleTypeDef *hi2c = s->hi2c;
+  i2c_job_t *job = s->active;
+
+  if(job == NULL)
+  {
+    return;
+  }
+  job->error = HAL_I2C_GetError(hi2c);
+
+  /* The target NACKed and the peripheral has sent the STOP: try again
+     later, the bus itself is fine */
+  if(job->error == HAL_I2C_ERROR_AF)
+  {
+    s->stats.nacks++;
+    if(job->attempt < job->retries)
+    {
+      s->alarm_kind = I2C_ALARM_RETRY;
+      timebase_alarm_start_in(&s->alarm, I2C_SCHED_RETRY_US, i2c_sched_alarm, s);
+      return;
+    }
+  }
+  if(((job->error & I2C_BUS_ERRORS) != 0U) || ((hi2c->Instance->ISR & I2C_ISR_BUSY) != 0U))
+  {
+    i2c_sched_finish_recover(s, job, HAL_ERROR);
+    return;
+  }
+  i2c_sched_finish(s, job, HAL_ERROR);
+}
+
+#if (USE_HAL_I2C_REGISTER_CALLBACKS == 1U)
+/* Registered on the handles of the schedulers */
+static void i2c_sched_cplt_callback(I2C_HandleTypeDef *hi2c)
+{
+  i2c_sched_seg_done(i2c_sched_find(hi2c));
+}
+
+static void i2c_sched_error_callback(I2C_HandleTypeDef *hi2c)
+{
+  i2c_sched_error(i2c_sched_find(hi2c));
+}
+#else
+static void i2c_sched_event(I2C_HandleTypeDef *hi2c, uint32_t event)
+{
+  i2c_sched_t *s = i2c_sched_find(hi2c);
+
+  if(s == NULL)
+  {
+    i2c_sched_other_callback(hi2c, event);
+  }
+  else if(event == I2C_SCHED_ERROR)
+  {
+    i2c_sched_error(s);
+  }
+  else
+  {
+    i2c_sched_seg_done(s);
+  }
+}
+#endif /* USE_HAL_I2C_REGISTER_CALLBACKS */
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef i2c_sched_init(i2c_sched_t *s)
+{
+  uint32_t i;
+
+  for(i = 0U; i < I2C_SCHED_MAX; i++)
+  {
+    if((i2c_sched_list[i] == NULL) || (i2c_sched_list[i] == s))
+    {
+#if (USE_HAL_I2C_REGISTER_CALLBACKS == 1U)
+      if((HAL_I2C_RegisterCallback(s->hi2c, HAL_I2C_MASTER_TX_COMPLETE_CB_ID, i2c_sched_cplt_callback) != HAL_OK) ||
+         (HAL_I2C_RegisterCallback(s->hi2c, HAL_I2C_MASTER_RX_COMPLETE_CB_ID, i2c_sched_cplt_callback) != HAL_OK) ||
+         (HAL_I2C_RegisterCallback(s->hi2c, HAL_I2C_ERROR_CB_ID, i2c_sched_error_callback) != HAL_OK))
+      {
+        return HAL_ERROR;
+      }
+#endif /* USE_HAL_I2C_REGISTER_CALLBACKS */
+      s->head = NULL;
+      s->tail = NULL;
+      s->active = NULL;
+      s->alarm_kind = I2C_ALARM_TIMEOUT;
+      s->recovering = 0U;
+      s->stats.jobs = 0U;
+      s->stats.errors = 0U;
+      s->stats.nacks = 0U;
+      s->stats.retries = 0U;
+      s->stats.recoveries = 0U;
+      s->stats.stuck = 0U;
+      s->stats.max_latency_us = 0U;
+      i2c_sched_list[i] = s;
+      return HAL_OK;
+    }
+  }
+  return HAL_ERROR;
+}
+
+HAL_StatusTypeDef i2c_sched_submit(i2c_sched_t *s, i2c_job_t *job)
+{
+  uint32_t primask;
+  uint32_t i;
+
+  if((job->count == 0U) || (job->count > I2C_JOB_MAX_SEGS))
+  {
+    return HAL_ERROR;
+  }
+  for(i = 0U; i < job->count; i++)
+  {
+    if(job->seg[i].len == 0U)
+    {
+      return HAL_ERROR;
+    }
+  }
+
+  job->next = NULL;
+  job->stamp = timebase_us();
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if(s->tail != NULL)
+  {
+    s->tail->next = job;
+  }
+  else
+  {
+    s->head = job;
+  }
+  s->tail = job;
+  __set_PRIMASK(primask);
+
+  i2c_sched_run(s);
+  return HAL_OK;
+}
+
+uint32_t i2c_sched_idle(const i2c_sched_t *s)
+{
+  return ((s->active == NULL) && (s->head == NULL) && (s->recovering == 0U)) ? 1U : 0U;
+}
+
+HAL_StatusTypeDef i2c_sched_recover(i2c_sched_t *s)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if((s->active != NULL) || (s->recovering != 0U))
+  {
+    __set_PRIMASK(primask);
+    return HAL_BUSY;
+  }
+  s->recovering = 1U;
+  __set_PRIMASK(primask);
+
+  i2c_sched_recover_start(s);
+  return HAL_OK;
+}
+
+void i2c_job_reg_read(i2c_job_t *job, uint16_t addr, uint16_t reg, uint8_t reg_size,
+                      uint8_t *data, uint16_t len)
+{
+  job->addr = addr;
+  job->reg[0] = (reg_size == 2U) ? (uint8_t)(reg >> 8) : (uint8_t)reg;
+  job->reg[1] = (uint8_t)reg;
+  job->seg[0].data = job->reg;
+  job->seg[0].len = reg_size;
+  job->seg[0].read = 0U;
+  job->seg[1].data = data;
+  job->seg[1].len = len;
+  job->seg[1].read = 1U;
+  job->count = 2U;
+}
+
+void i2c_job_reg_write(i2c_job_t *job, uint16_t addr, uint16_t reg, uint8_t reg_size,
+                       uint8_t *data, uint16_t len)
+{
+  i2c_job_reg_read(job, addr, reg, reg_size, data, len);
+  job->seg[1].read = 0U;
+}
+
+#if (USE_HAL_I2C_REGISTER_CALLBACKS != 1U)
+__weak void i2c_sched_other_callback(I2C_HandleTypeDef *hi2c, uint32_t event)
+{
+  UNUSED(hi2c);
+  UNUSED(event);
+}
+
+/* HAL callbacks -------------------------------------------------------------*/
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  i2c_sched_event(hi2c, I2C_SCHED_MASTER_TX_CPLT);
+}
+
+void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  i2c_sched_event(hi2c, I2C_SCHED_MASTER_RX_CPLT);
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+  i2c_sched_event(hi2c, I2C_SCHED_ERROR);
+}
+#endif /* USE_HAL_I2C_REGISTER_CALLBACKS */
@@ -0,0 +1,164 @@
+#ifndef __I2C_SCHED_H
+#define __I2C_SCHED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+#include "timebase.h"
+
+/* I2C job scheduler: jobs for any number of targets on one bus are queued
+   without blocking and run one after the other from the I2C/DMA
+   interrupts. A job is a batch of up to I2C_JOB_MAX_SEGS segments to one
+   target, sent with repeated starts in between and a single STOP at the
+   end; two writes in a row continue without a restart, so a register
+   address and its data can come from separate buffers.
+
+   A NACK (target busy, e.g. an EEPROM write cycle) retries the job after
+   I2C_SCHED_RETRY_US, up to job->retries times. A bus error, lost
+   arbitration or a job that does not finish within I2C_SCHED_TIMEOUT_US
+   resets the peripheral and clocks the bus free (up to 9 SCL pulses and a
+   STOP) before the next job. Each job reports how long it waited in the
+   queue and how long it was on the bus, from the timebase.
+
+   The recovery runs from timebase alarms, one half SCL period per alarm,
+   so no interrupt busy-waits through it; the failed job's done() comes
+   first and the next job starts once the bus is free. It drives the bus
+   pins as open-drain outputs and puts back their mode and output type
+   afterwards; pull, speed and AF are left as the application set them.
+
+   With USE_HAL_I2C_REGISTER_CALLBACKS set, i2c_sched_init() registers the
+   callbacks on the scheduler's handle, so it must come after
+   HAL_I2C_Init(). Without it this module defines
+   HAL_I2C_MasterTxCpltCallback, MasterRxCpltCallback and ErrorCallback,
+   and passes the events of I2C handles that have no scheduler on to
+   i2c_sched_other_callback(). The application keeps calling
+   HAL_I2C_EV_IRQHandler(), HAL_I2C_ER_IRQHandler() and
+   HAL_DMA_IRQHandler() from the vectors. */
+
+/* Exported constants --------------------------------------------------------*/
+#define I2C_JOB_MAX_SEGS        4U
+
+/* A job running longer than this means the bus is stuck */
+#ifndef I2C_SCHED_TIMEOUT_US
+#define I2C_SCHED_TIMEOUT_US    20000U
+#endif
+
+/* Wait before retrying a job the target NACKed */
+#ifndef I2C_SCHED_RETRY_US
+#define I2C_SCHED_RETRY_US      500U
+#endif
+
+/* Shorter segments use the interrupt path, the DMA setup costs more */
+#ifndef I2C_SCHED_DMA_MIN
+#define I2C_SCHED_DMA_MIN       4U
+#endif
+
+/* i2c_sched_other_callback() events */
+#define I2C_SCHED_MASTER_TX_CPLT  0U
+#define I2C_SCHED_MASTER_RX_CPLT  1U
+#define I2C_SCHED_ERROR           2U
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct i2c_job_s i2c_job_t;
+typedef void (*i2c_job_done_t)(i2c_job_t *job);
+
+typedef struct
+{
+  uint8_t *data;
+  uint16_t len;
+  uint16_t read;                /* 0 = write to the target */
+} i2c_seg_t;
+
+struct i2c_job_s
+{
+  i2c_job_t *next;              /* owned by the scheduler until done() */
+  uint16_t addr;                /* 7-bit target address */
+  uint8_t count;                /* segments used */
+  uint8_t retries;              /* extra attempts after a NACK */
+  i2c_seg_t seg[I2C_JOB_MAX_SEGS];
+  uint8_t reg[2];               /* register address for the helpers */
+  i2c_job_done_t done;          /* from interrupt context, may be NULL */
+  void *context;
+
+  /* Results, valid in done() */
+  HAL_StatusTypeDef status;     /* HAL_OK, HAL_ERROR or HAL_TIMEOUT */
+  uint32_t error;               /* HAL_I2C_ERROR_xx of the last attempt */
+  uint32_t wait_us;             /* submit to first start */
+  uint32_t bus_us;              /* first start to done, retries included */
+
+  /* Scheduler state */
+  uint64_t stamp;
+  uint8_t step;
+  uint8_t attempt;
+};
+
+typedef struct
+{
+  uint32_t jobs;
+  uint32_t errors;
+  uint32_t nacks;
+  uint32_t retries;
+  uint32_t recoveries;
+  uint32_t stuck;               /* recoveries that left the bus busy */
+  uint32_t max_latency_us;      /* submit to done */
+} i2c_sched_stats_t;
+
+typedef struct
+{
+  I2C_HandleTypeDef *hi2c;
+  GPIO_TypeDef *scl_port;       /* bus pins, for recovery */
+  uint32_t scl_mask;
+  GPIO_TypeDef *sda_port;
+  uint32_t sda_mask;
+  uint32_t af;                  /* alternate function of both pins */
+
+  i2c_job_t *head;              /* pending */
+  i2c_job_t *tail;
+  i2c_job_t *volatile active;
+  timebase_alarm_t alarm;       /* job timeout, NACK retry or recovery */
+  uint8_t alarm_kind;
+  uint8_t recover_step;
+  uint8_t recover_pulses;
+  volatile uint8_t recovering;  /* jobs wait while set */
+  uint32_t pin_save[4];         /* SCL, SDA MODER and OTYPER */
+  i2c_sched_stats_t stats;
+} i2c_sched_t;
+
+/* Function definitions ------------------------------------------------------*/
+/* s->hi2c (initialized master, DMA handles optional) and the pin fields
+   must be set. HAL_ERROR if no scheduler slot is free or the HAL
+   callbacks could not be registered. */
+HAL_StatusTypeDef i2c_sched_init(i2c_sched_t *s);
+/* Queue a job, from any context. HAL_ERROR for an empty or oversized job. */
+HAL_StatusTypeDef i2c_sched_submit(i2c_sched_t *s, i2c_job_t *job);
+/* Nothing queued, running or recovering */
+uint32_t i2c_sched_idle(const i2c_sched_t *s);
+/* Reset the peripheral and start clocking the bus free, in the background;
+   queued jobs wait for it. HAL_BUSY while a job or a recovery runs. The
+   scheduler does this itself after bus errors; stats.stuck counts the
+   recoveries after which SDA or the bus was still busy. */
+HAL_StatusTypeDef i2c_sched_recover(i2c_sched_t *s);
+
+/* Fill job with a register read (address, repeated start, read) or a
+   register write (address and data in one write). reg_size is 1 or 2,
+   16-bit register addresses are sent MSB first. */
+void i2c_job_reg_read(i2c_job_t *job, uint16_t addr, uint16_t reg, uint8_t reg_size,
+                      uint8_t *data, uint16_t len);
+void i2c_job_reg_write(i2c_job_t *job, uint16_t addr, uint16_t reg, uint8_t reg_size,
+                       uint8_t *data, uint16_t len);
+
+#if (USE_HAL_I2C_REGISTER_CALLBACKS != 1U)
+/* HAL I2C callback of a handle without a scheduler, event I2C_SCHED_xx,
+   from interrupt context. Weak, does nothing; the application overrides
+   it to drive its other I2Cs through the HAL callbacks. */
+void i2c_sched_other_callback(I2C_HandleTypeDef *hi2c, uint32_t event);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
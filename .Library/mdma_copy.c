@@ -0,0 +1,431 @@
+/* Header includes -----------------------------------------------------------*/
+#include "mdma_copy.h"
+#include "dma_cache.h"
+#include "delay.h"
+#include <string.h>
+
+/* Private macro -------------------------------------------------------------*/
+#define MDMA_COPY_FLAGS         (MDMA_CIFCR_CTEIF | MDMA_CIFCR_CCTCIF | MDMA_CIFCR_CBRTIF | \
+                                 MDMA_CIFCR_CBTIF | MDMA_CIFCR_CLTCIF)
+/* 128-byte buffer transfers, the most the channel FIFO takes */
+#define MDMA_COPY_TLEN          128U
+#define MDMA_COPY_BURST         16U
+
+/* ITCM and DTCM are reached over the AHBS port, not AXI */
+#define MDMA_COPY_TCM(addr)     ((((addr) & 0xFF000000U) == 0x00000000U) || \
+                                 (((addr) & 0xFF000000U) == 0x20000000U))
+
+/* Private variables ---------------------------------------------------------*/
+static MDMA_Channel_TypeDef *mdma_copy_ch;
+static mdma_copy_job_t *volatile mdma_copy_run;
+static mdma_copy_job_t *mdma_copy_head;
+static mdma_copy_job_t *mdma_copy_tail;
+static mdma_copy_stats_t mdma_copy_st = {0U, 0U, 0U, 0U, 0U, MDMA_COPY_CPU_MAX};
+
+/* Private functions ---------------------------------------------------------*/
+/* Bytes from the first to the last one touched, with the gaps between rows */
+static inline uint32_t mdma_copy_span(uint32_t pitch, const mdma_copy_op_t *op)
+{
+  return ((op->rows - 1U) * pitch) + op->width;
+}
+
+/* The register images for one operation, linked to the next one. The data
+   size is the widest that divides every address, length and pitch; bursts
+   only when the rows start on a burst boundary, so none crosses a 1 KB
+   one. The fill pattern is 8-byte aligned and read in place, so it limits
+   neither. Plain operations beyond one block repeat 64 KB blocks and take
+   the rest in a second node. */
+static HAL_StatusTypeDef mdma_copy_build(mdma_copy_op_t *op, uint32_t link)
+{
+  MDMA_LinkNodeTypeDef *n = op->node;
+  uint32_t src = (op->src != NULL) ? (uint32_t)op->src : (uint32_t)op->fill;
+  uint32_t dst = (uint32_t)op->dst;
+  uint32_t a = (op->src != NULL) ? (src | dst) : dst;
+  uint32_t lg;
+  uint32_t ctcr;
+  uint32_t blocks;
+  uint32_t rest;
+
+  if((op->width == 0U) || (op->rows == 0U))
+  {
+    return HAL_ERROR;
+  }
+  if(op->rows > 1U)
+  {
+    if((op->width > MDMA_COPY_ROW_MAX) || (op->rows > MDMA_COPY_ROWS_MAX) ||
+       (op->dst_pitch < op->width) || ((op->dst_pitch - op->width) > MDMA_COPY_GAP_MAX) ||
+       ((op->src != NULL) && ((op->src_pitch < op->width) || ((op->src_pitch - op->width) > MDMA_COPY_GAP_MAX))))
+    {
+      return HAL_ERROR;
+    }
+    a |= op->dst_pitch | ((op->src != NULL) ? op->src_pitch : 0U);
+  }
+
+  lg = (((a | op->width) & 7U) == 0U) ? 3U : (((a | op->width) & 3U) == 0U) ? 2U : (((a | op->width) & 1U) == 0U) ? 1U : 0U;
+  ctcr = MDMA_CTCR_DINC_1 | (lg << MDMA_CTCR_DINCOS_Pos) | (lg << MDMA_CTCR_SSIZE_Pos) | (lg << MDMA_CTCR_DSIZE_Pos) |
+         ((MDMA_COPY_TLEN - 1U) << MDMA_CTCR_TLEN_Pos) | MDMA_FULL_TRANSFER | MDMA_CTCR_SWRM;
+  if((a & ((MDMA_COPY_BURST << lg) - 1U)) == 0U)
+  {
+    ctcr |= MDMA_DEST_BURST_16BEATS;
+  }
+  if(op->src != NULL)
+  {
+    ctcr |= MDMA_CTCR_SINC_1 | (lg << MDMA_CTCR_SINCOS_Pos);
+    if((a & ((MDMA_COPY_BURST << lg) - 1U)) == 0U)
+    {
+      ctcr |= MDMA_SOURCE_BURST_16BEATS;
+    }
+  }
+
+  n[0].CTCR = ctcr;
+  n[0].CSAR = src;
+  n[0].CDAR = dst;
+  n[0].CTBR = (MDMA_COPY_TCM(src) ? MDMA_CTBR_SBUS : 0U) | (MDMA_COPY_TCM(dst) ? MDMA_CTBR_DBUS : 0U);
+  n[0].Reserved = 0U;
+  n[0].CMAR = 0U;
+  n[0].CMDR = 0U;
+  n[0].CLAR = link;
+
+  if(op->rows > 1U)
+  {
+    /* The update values are added at the end of each row */
+    n[0].CBNDTR = op->width | ((op->rows - 1U) << MDMA_CBNDTR_BRC_Pos);
+    n[0].CBRUR = ((op->src != NULL) ? (op->src_pitch - op->width) : 0U) |
+                 ((op->dst_pitch - op->width) << MDMA_CBRUR_DUV_Pos);
+    return HAL_OK;
+  }
+
+  blocks = op->width / MDMA_COPY_ROW_MAX;
+  rest = op->width % MDMA_COPY_ROW_MAX;
+  n[0].CBRUR = 0U;
+  if(blocks == 0U)
+  {
+    n[0].CBNDTR = rest;
+    return HAL_OK;
+  }
+  if(blocks > MDMA_COPY_ROWS_MAX)
+  {
+    return HAL_ERROR;
+  }
+  n[0].CBNDTR = MDMA_COPY_ROW_MAX | ((blocks - 1U) << MDMA_CBNDTR_BRC_Pos);
+  if(rest != 0U)
+  {
+    n[1] = n[0];
+    n[1].CBNDTR = rest;
+    n[1].CSAR = (op->src != NULL) ? (src + (blocks * MDMA_COPY_ROW_MAX)) : src;
+    n[1].CDAR = dst + (blocks * MDMA_COPY_ROW_MAX);
+    n[0].CLAR = (uint32_t)&n[1];
+  }
+  return HAL_OK;
+}
+
+static void mdma_copy_cpu(const mdma_copy_op_t *op)
+{
+  uint8_t *d = op->dst;
+  const uint8_t *s = op->src;
+  uint32_t r;
+
+  for(r = 0U; r < op->rows; r++)
+  {
+    if(s != NULL)
+    {
+      memcpy(d, s, op->width);
+      s += op->src_pitch;
+    }
+    else
+    {
+      memset(d, (int)(op->fill[0] & 0xFFU), op->width);
+    }
+    d += op->dst_pitch;
+  }
+}
+
+/* Called with the channel idle and interrupts masked */
+static void mdma_copy_start(mdma_copy_job_t *job)
+{
+  MDMA_Channel_TypeDef *ch = mdma_copy_ch;
+  const MDMA_LinkNodeTypeDef *n = &job->ops[0].node[0];
+
+  mdma_copy_run = job;
+  job->state = MDMA_COPY_RUNNING;
+  ch->CIFCR = MDMA_COPY_FLAGS;
+  ch->CTCR = n->CTCR;
+  ch->CBNDTR = n->CBNDTR;
+  ch->CSAR = n->CSAR;
+  ch->CDAR = n->CDAR;
+  ch->CBRUR = n->CBRUR;
+  ch->CLAR = n->CLAR;
+  ch->CTBR = n->CTBR;
+  ch->CMAR = 0U;
+  ch->CMDR = 0U;
+  ch->CCR = MDMA_COPY_PRIORITY | MDMA_CCR_TEIE | MDMA_CCR_CTCIE;
+  ch->CCR |= MDMA_CCR_EN;
+  ch->CCR |= MDMA_CCR_SWRQ;
+}
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef mdma_copy_init(MDMA_Channel_TypeDef *channel)
+{
+  if(channel == NULL)
+  {
+    return HAL_ERROR;
+  }
+  __HAL_RCC_MDMA_CLK_ENABLE();
+  channel->CCR = 0U;
+  channel->CIFCR = MDMA_COPY_FLAGS;
+  mdma_copy_ch = channel;
+  mdma_copy_run = NULL;
+  mdma_copy_head = NULL;
+  mdma_copy_tail = NULL;
+
+  HAL_NVIC_SetPriority(MDMA_IRQn, MDMA_COPY_IRQ_PRIORITY, 0U);
+  HAL_NVIC_EnableIRQ(MDMA_IRQn);
+  return HAL_OK;
+}
+
+void mdma_copy_op(mdma_copy_op_t *op, void *dst, const void *src, uint32_t len)
+{
+  mdma_copy_op_2d(op, dst, len, src, len, len, 1U);
+}
+
+void mdma_copy_op_fill(mdma_copy_op_t *op, void *dst, uint8_t value, uint32_t len)
+{
+  mdma_copy_op_2d(op, dst, len, NULL, len, len, 1U);
+  op->fill[0] = value * 0x01010101U;
+  op->fill[1] = op->fill[0];
+}
+
+void mdma_copy_op_2d(mdma_copy_op_t *op, void *dst, uint32_t dst_pitch, const void *src,
+                     uint32_t src_pitch, uint32_t width, uint32_t rows)
+{
+  op->dst = dst;
+  op->src = src;
+  op->width = width;
+  op->rows = rows;
+  op->src_pitch = src_pitch;
+  op->dst_pitch = dst_pitch;
+}
+
+HAL_StatusTypeDef mdma_copy_submit(mdma_copy_job_t *job)
+{
+  mdma_copy_op_t *op;
+  uint32_t bytes = 0U;
+  uint32_t primask;
+  uint32_t i;
+
+  if((job->state == MDMA_COPY_QUEUED) || (job->state == MDMA_COPY_RUNNING))
+  {
+    return HAL_BUSY;
+  }
+  if((job->ops == NULL) || (job->count == 0U))
+  {
+    return HAL_ERROR;
+  }
+  for(i = 0U; i < job->count; i++)
+  {
+    bytes += job->ops[i].width * job->ops[i].rows;
+  }
+  job->bytes = bytes;
+
+  if((mdma_copy_ch == NULL) || ((bytes < mdma_copy_st.crossover) && (mdma_copy_run == NULL)))
+  {
+    for(i = 0U; i < job->count; i++)
+    {
+      mdma_copy_cpu(&job->ops[i]);
+    }
+    mdma_copy_st.cpu_jobs++;
+    mdma_copy_st.cpu_bytes += bytes;
+    job->state = MDMA_COPY_DONE;
+    if(job->done != NULL)
+    {
+      job->done(job, job->context);
+    }
+    return HAL_OK;
+  }
+
+  if((((uint32_t)job->ops & 7U) != 0U) || MDMA_COPY_TCM((uint32_t)job->ops))
+  {
+    return HAL_ERROR;
+  }
+  for(i = 0U; i < job->count; i++)
+  {
+    op = &job->ops[i];
+    if(mdma_copy_build(op, ((i + 1U) < job->count) ? (uint32_t)job->ops[i + 1U].node : 0U) != HAL_OK)
+    {
+      return HAL_ERROR;
+    }
+    if(op->src != NULL)
+    {
+      dma_cache_clean(op->src, mdma_copy_span(op->src_pitch, op));
+    }
+    /* Clean as well: the gaps between 2D rows may hold dirty data */
+    dma_cache_flush(op->dst, mdma_copy_span(op->dst_pitch, op));
+  }
+  dma_cache_clean(job->ops, job->count * sizeof(*job->ops));
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  job->next = NULL;
+  job->state = MDMA_COPY_QUEUED;
+  if(mdma_copy_run == NULL)
+  {
+    mdma_copy_start(job);
+  }
+  else
+  {
+    if(mdma_copy_tail != NULL)
+    {
+      mdma_copy_tail->next = job;
+    }
+    else
+    {
+      mdma_copy_head = job;
+    }
+    mdma_copy_tail = job;
+  }
+  __set_PRIMASK(primask);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef mdma_copy_wait(const mdma_copy_job_t *job, uint32_t timeout)
+{
+  uint32_t start = HAL_GetTick();
+
+  while((job->state == MDMA_COPY_QUEUED) || (job->state == MDMA_COPY_RUNNING))
+  {
+    if((HAL_GetTick() - start) >= timeout)
+    {
+      return HAL_TIMEOUT;
+    }
+  }
+  return (job->state == MDMA_COPY_ERROR) ? HAL_ERROR : HAL_OK;
+}
+
+uint32_t mdma_copy_busy(void)
+{
+  return (mdma_copy_run != NULL) ? 1U : 0U;
+}
+
+uint32_t mdma_copy_calibrate(void *dst, const void *src, uint32_t len)
+{
+  static __ALIGNED(8) mdma_copy_op_t op;
+  mdma_copy_job_t job;
+  uint32_t crossover = len;
+  uint32_t size;
+  uint32_t t0;
+  uint32_t cpu;
+  uint32_t dma;
+
+  if((mdma_copy_ch == NULL) || (mdma_copy_run != NULL))
+  {
+    return mdma_copy_st.crossover;
+  }
+  delay_init();
+  job.ops = &op;
+  job.count = 1U;
+  job.done = NULL;
+  job.context = NULL;
+
+  for(size = 64U; size <= len; size *= 2U)
+  {
+    t0 = delay_cycles();
+    memcpy(dst, src, size);
+    cpu = delay_cycles() - t0;
+
+    /* Forced onto the MDMA, submit to completion with the cache work */
+    mdma_copy_st.crossover = 0U;
+    mdma_copy_op(&op, dst, src, size);
+    job.state = MDMA_COPY_IDLE;
+    t0 = delay_cycles();
+    if(mdma_copy_submit(&job) != HAL_OK)
+    {
+      break;
+    }
+    while((job.state == MDMA_COPY_QUEUED) || (job.state == MDMA_COPY_RUNNING))
+    {
+    }
+    dma = delay_cycles() - t0;
+
+    if(dma < cpu)
+    {
+      crossover = size;
+      break;
+    }
+  }
+  mdma_copy_st.crossover = crossover;
+  return crossover;
+}
+
+const mdma_copy_stats_t *mdma_copy_stats(void)
+{
+  return &mdma_copy_st;
+}
+
+void mdma_copy_irq(void)
+{
+  MDMA_Channel_TypeDef *ch = mdma_copy_ch;
+  mdma_copy_job_t *job = mdma_copy_run;
+  mdma_copy_job_t *next;
+  mdma_copy_op_t *op;
+  uint32_t isr;
+  uint32_t state;
+  uint32_t primask;
+  uint32_t i;
+
+  if((ch == NULL) || (job == NULL))
+  {
+    return;
+  }
+  isr = ch->CISR;
+  if((isr & MDMA_CISR_TEIF) != 0U)
+  {
+    ch->CCR &= ~MDMA_CCR_EN;
+    while((ch->CCR & MDMA_CCR_EN) != 0U)
+    {
+    }
+    mdma_copy_st.errors++;
+    state = MDMA_COPY_ERROR;
+  }
+  else if((isr & MDMA_CISR_CTCIF) != 0U)
+  {
+    mdma_copy_st.mdma_jobs++;
+    mdma_copy_st.mdma_bytes += job->bytes;
+    state = MDMA_COPY_DONE;
+  }
+  else
+  {
+    return;
+  }
+  ch->CIFCR = MDMA_COPY_FLAGS;
+
+  /* Next job first, so it runs while this one is finished off */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  next = mdma_copy_head;
+  if(next != NULL)
+  {
+    mdma_copy_head = next->next;
+    if(mdma_copy_head == NULL)
+    {
+      mdma_copy_tail = NULL;
+    }
+    mdma_copy_start(next);
+  }
+  else
+  {
+    mdma_copy_run = NULL;
+  }
+  __set_PRIMASK(primask);
+
+  /* Lines speculatively loaded during the transfer */
+  for(i = 0U; i < job->count; i++)
+  {
+    op = &job->ops[i];
+    dma_cache_invalidate(op->dst, mdma_copy_span(op->dst_pitch, op));
+  }
+  job->state = state;
+  if(job->done != NULL)
+  {
+    job->done(job, job->context);
+  }
+}
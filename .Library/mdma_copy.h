@@ -0,0 +1,128 @@
+#ifndef __MDMA_COPY_H
+#define __MDMA_COPY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+
+/* Asynchronous memory copy and fill on one MDMA channel. A job is a list of
+   operations (plain copies, fills and strided 2D copies) that the MDMA runs
+   as one linked list from a single software request; jobs queue behind
+   each other and complete in submit order. Completion is a callback from
+   the MDMA interrupt and a state in the job that can be polled or waited
+   on, like a future.
+
+   Small jobs are not worth the setup and the cache maintenance: a job of
+   fewer bytes than the crossover, submitted while the MDMA is idle, is
+   done by the CPU on the spot and is complete when submit returns.
+   mdma_copy_calibrate() measures the crossover on the running system.
+
+   Each operation carries the linked list nodes the MDMA reads, so the
+   operations must stay in place until the job completes and must not be
+   in TCM (the MDMA fetches nodes over AXI): keep them static. Sources and
+   destinations may be anywhere the MDMA reaches, TCM included. Cached
+   memory is cleaned and invalidated around the transfer; a destination
+   that shares cache lines with other data follows the dma_cache rules.
+
+   The MDMA interrupt handler has to call mdma_copy_irq(). */
+
+/* Exported constants --------------------------------------------------------*/
+/* Jobs of fewer bytes run on the CPU when the MDMA is idle, until
+   mdma_copy_calibrate() says otherwise */
+#ifndef MDMA_COPY_CPU_MAX
+#define MDMA_COPY_CPU_MAX       2048U
+#endif
+
+#ifndef MDMA_COPY_PRIORITY
+#define MDMA_COPY_PRIORITY      MDMA_PRIORITY_LOW
+#endif
+
+#ifndef MDMA_COPY_IRQ_PRIORITY
+#define MDMA_COPY_IRQ_PRIORITY  6U
+#endif
+
+/* Largest 2D row and row gap, and the largest plain operation */
+#define MDMA_COPY_ROW_MAX       65536U
+#define MDMA_COPY_ROWS_MAX      4096U
+#define MDMA_COPY_GAP_MAX       65535U
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  MDMA_COPY_IDLE = 0U,
+  MDMA_COPY_QUEUED,
+  MDMA_COPY_RUNNING,
+  MDMA_COPY_DONE,
+  MDMA_COPY_ERROR
+} mdma_copy_state_t;
+
+typedef struct
+{
+  MDMA_LinkNodeTypeDef node[2]; /* built at submit, read by the MDMA */
+  uint32_t fill[2];             /* fill pattern, read by the MDMA */
+  void *dst;
+  const void *src;              /* NULL: fill */
+  uint32_t width;               /* bytes per row, all of it for plain ops */
+  uint32_t rows;
+  uint32_t src_pitch;
+  uint32_t dst_pitch;
+} mdma_copy_op_t;
+
+typedef struct mdma_copy_job_s mdma_copy_job_t;
+typedef void (*mdma_copy_done_t)(mdma_copy_job_t *job, void *context);
+
+struct mdma_copy_job_s
+{
+  mdma_copy_op_t *ops;          /* 8-byte aligned, not in TCM */
+  uint32_t count;
+  mdma_copy_done_t done;        /* may be NULL */
+  void *context;
+
+  volatile uint32_t state;      /* mdma_copy_state_t */
+  uint32_t bytes;
+  mdma_copy_job_t *next;
+};
+
+typedef struct
+{
+  uint32_t cpu_jobs;
+  uint32_t cpu_bytes;
+  uint32_t mdma_jobs;
+  uint32_t mdma_bytes;
+  uint32_t errors;
+  uint32_t crossover;           /* bytes, CPU below */
+} mdma_copy_stats_t;
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef mdma_copy_init(MDMA_Channel_TypeDef *channel);
+
+/* Describe one operation */
+void mdma_copy_op(mdma_copy_op_t *op, void *dst, const void *src, uint32_t len);
+void mdma_copy_op_fill(mdma_copy_op_t *op, void *dst, uint8_t value, uint32_t len);
+void mdma_copy_op_2d(mdma_copy_op_t *op, void *dst, uint32_t dst_pitch, const void *src,
+                     uint32_t src_pitch, uint32_t width, uint32_t rows);
+
+/* job->ops, count, done and context must be set. HAL_ERROR for operations
+   out of range or misplaced, HAL_BUSY if the job is still in flight. */
+HAL_StatusTypeDef mdma_copy_submit(mdma_copy_job_t *job);
+/* HAL_OK once done, HAL_ERROR on an MDMA error, HAL_TIMEOUT after timeout ms */
+HAL_StatusTypeDef mdma_copy_wait(const mdma_copy_job_t *job, uint32_t timeout);
+uint32_t mdma_copy_busy(void);
+
+/* Time memcpy against the MDMA for sizes from 64 bytes up to len, over
+   dst and src (both len bytes, not in TCM), with the queue idle and the
+   MDMA interrupt running, and use the first size the MDMA wins at as the
+   crossover. Returns it. */
+uint32_t mdma_copy_calibrate(void *dst, const void *src, uint32_t len);
+
+const mdma_copy_stats_t *mdma_copy_stats(void);
+void mdma_copy_irq(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,281 @@
+/* Header includes -----------------------------------------------------------*/
+#include "mpu_plan.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint8_t tex;
+  uint8_t cacheable;
+  uint8_t bufferable;
+  uint8_t shareable;
+  uint8_t access;
+  uint8_t no_exec;
+} mpu_plan_attr_t;
+
+/* Private variables ---------------------------------------------------------*/
+/* TEX/C/B/S per use, see the ARMv7-M memory attribute encoding */
+static const mpu_plan_attr_t mpu_plan_attr[MPU_PLAN_USE_COUNT] =
+{
+  /* CODE: normal, write-through no write-allocate */
+  {MPU_TEX_LEVEL0, MPU_ACCESS_CACHEABLE, MPU_ACCESS_NOT_BUFFERABLE, MPU_ACCESS_NOT_SHAREABLE,
+   MPU_REGION_PRIV_RO_URO, MPU_INSTRUCTION_ACCESS_ENABLE},
+  /* RAMCODE: as DATA, executable; TCM is not cached either way */
+  {MPU_TEX_LEVEL1, MPU_ACCESS_CACHEABLE, MPU_ACCESS_BUFFERABLE, MPU_ACCESS_NOT_SHAREABLE,
+   MPU_REGION_FULL_ACCESS, MPU_INSTRUCTION_ACCESS_ENABLE},
+  /* RODATA */
+  {MPU_TEX_LEVEL0, MPU_ACCESS_CACHEABLE, MPU_ACCESS_NOT_BUFFERABLE, MPU_ACCESS_NOT_SHAREABLE,
+   MPU_REGION_PRIV_RO_URO, MPU_INSTRUCTION_ACCESS_DISABLE},
+  /* DATA: normal, write-back write-allocate */
+  {MPU_TEX_LEVEL1, MPU_ACCESS_CACHEABLE, MPU_ACCESS_BUFFERABLE, MPU_ACCESS_NOT_SHAREABLE,
+   MPU_REGION_FULL_ACCESS, MPU_INSTRUCTION_ACCESS_DISABLE},
+  /* STACK */
+  {MPU_TEX_LEVEL1, MPU_ACCESS_CACHEABLE, MPU_ACCESS_BUFFERABLE, MPU_ACCESS_NOT_SHAREABLE,
+   MPU_REGION_FULL_ACCESS, MPU_INSTRUCTION_ACCESS_DISABLE},
+  /* DMA: normal, non-cacheable */
+  {MPU_TEX_LEVEL1, MPU_ACCESS_NOT_CACHEABLE, MPU_ACCESS_NOT_BUFFERABLE, MPU_ACCESS_NOT_SHAREABLE,
+   MPU_REGION_FULL_ACCESS, MPU_INSTRUCTION_ACCESS_DISABLE},
+  /* FRAMEBUFFER: normal, write-through no write-allocate */
+  {MPU_TEX_LEVEL0, MPU_ACCESS_CACHEABLE, MPU_ACCESS_NOT_BUFFERABLE, MPU_ACCESS_NOT_SHAREABLE,
+   MPU_REGION_FULL_ACCESS, MPU_INSTRUCTION_ACCESS_DISABLE},
+  /* DEVICE: shareable device */
+  {MPU_TEX_LEVEL0, MPU_ACCESS_NOT_CACHEABLE, MPU_ACCESS_BUFFERABLE, MPU_ACCESS_SHAREABLE,
+   MPU_REGION_FULL_ACCESS, MPU_INSTRUCTION_ACCESS_DISABLE},
+  /* NO_ACCESS: strongly ordered, no access */
+  {MPU_TEX_LEVEL0, MPU_ACCESS_NOT_CACHEABLE, MPU_ACCESS_NOT_BUFFERABLE, MPU_ACCESS_SHAREABLE,
+   MPU_REGION_NO_ACCESS, MPU_INSTRUCTION_ACCESS_DISABLE},
+};
+
+/* H750 memory map. SRAM1-3 and SRAM4 are where the D2/D3 DMAs work, so they
+   are mapped non-cacheable; the FMC/QSPI window is no access except for the
+   flash actually fitted, which keeps speculative reads off the buses.
+   ITCM holds the code copied out of flash at startup and must stay
+   writable. */
+static const mpu_plan_range_t mpu_plan_h750[] =
+{
+  {0x60000000U,        0x80000000U,        MPU_PLAN_NO_ACCESS},
+  {D1_ITCMRAM_BASE,    0x00010000U,        MPU_PLAN_RAMCODE},
+  {D1_DTCMRAM_BASE,    0x00020000U,        MPU_PLAN_DATA},
+  {FLASH_BANK1_BASE,   0x00020000U,        MPU_PLAN_CODE},
+  {D1_AXISRAM_BASE,    0x00080000U,        MPU_PLAN_DATA},
+  {D2_AHBSRAM_BASE,    0x00048000U,        MPU_PLAN_DMA},
+  {D3_SRAM_BASE,       0x00010000U,        MPU_PLAN_DMA},
+  {QSPI_BASE,          MPU_PLAN_QSPI_SIZE, MPU_PLAN_CODE},
+};
+
+static mpu_plan_t mpu_plan_active;
+
+/* Private functions ---------------------------------------------------------*/
+static uint64_t mpu_plan_end(const mpu_plan_range_t *range)
+{
+  return (uint64_t)range->base + ((range->size == 0U) ? 0x100000000ULL : (uint64_t)range->size);
+}
+
+static HAL_StatusTypeDef mpu_plan_check(const mpu_plan_range_t *table, uint32_t count, uint32_t *failed)
+{
+  uint32_t i;
+  uint32_t j;
+
+  for(i = 0U; i < count; i++)
+  {
+    *failed = i;
+
+    if((table[i].use >= MPU_PLAN_USE_COUNT) ||
+       ((table[i].base & 0x1FU) != 0U) || ((table[i].size & 0x1FU) != 0U) ||
+       (mpu_plan_end(&table[i]) > 0x100000000ULL))
+    {
+      return HAL_ERROR;
+    }
+
+    if(table[i].use == MPU_PLAN_NO_ACCESS)
+    {
+      continue;
+    }
+
+    for(j = 0U; j < i; j++)
+    {
+      if((table[j].use != MPU_PLAN_NO_ACCESS) &&
+         (table[i].base < mpu_plan_end(&table[j])) && (table[j].base < mpu_plan_end(&table[i])))
+      {
+        return HAL_ERROR;
+      }
+    }
+  }
+
+  return HAL_OK;
+}
+
+/* Pick the region covering the most of [cur, end) starting exactly at cur.
+   From 256 bytes up a region has 8 subregions that can be disabled, so it
+   may start and stop on any subregion boundary. Returns the bytes covered. */
+static uint64_t mpu_plan_fit(uint64_t cur, uint64_t end, MPU_Region_InitTypeDef *region)
+{
+  uint64_t best = 0U;
+  uint64_t size;
+  uint64_t base;
+  uint64_t sub;
+  uint64_t stop;
+  uint64_t covered;
+  uint32_t first;
+  uint32_t last;
+  uint32_t shift;
+  uint8_t srd;
+
+  for(shift = 5U; shift <= 32U; shift++)
+  {
+    size = 1ULL << shift;
+    base = cur & ~(size - 1U);
+
+    if(shift < 8U)
+    {
+      if((base != cur) || (cur + size > end))
+      {
+        continue;
+      }
+      covered = size;
+      srd = 0x00U;
+    }
+    else
+    {
+      sub = size >> 3;
+      if((cur & (sub - 1U)) != 0U)
+      {
+        continue;
+      }
+      stop = (end < base + size) ? end : (base + size);
+      first = (uint32_t)((cur - base) / sub);
+      last = (uint32_t)((stop - base) / sub);
+      if(last <= first)
+      {
+        continue;
+      }
+      covered = (uint64_t)(last - first) * sub;
+      srd = (uint8_t)~(((1U << last) - 1U) & ~((1U << first) - 1U));
+    }
+
+    /* Strictly more: for equal coverage keep the smaller region */
+    if(covered > best)
+    {
+      best = covered;
+      region->BaseAddress = (uint32_t)base;
+      region->Size = (uint8_t)(shift - 1U);
+      region->SubRegionDisable = srd;
+    }
+  }
+
+  return best;
+}
+
+static HAL_StatusTypeDef mpu_plan_emit(const mpu_plan_range_t *range, mpu_plan_t *plan)
+{
+  const mpu_plan_attr_t *attr = &mpu_plan_attr[range->use];
+  MPU_Region_InitTypeDef *region;
+  uint64_t cur = range->base;
+  uint64_t end = mpu_plan_end(range);
+
+  while(cur < end)
+  {
+    if(plan->count >= MPU_PLAN_MAX_REGIONS)
+    {
+      return HAL_ERROR;
+    }
+
+    region = &plan->region[plan->count];
+    region->Enable = MPU_REGION_ENABLE;
+    region->Number = (uint8_t)plan->count;
+    region->TypeExtField = attr->tex;
+    region->AccessPermission = attr->access;
+    region->DisableExec = attr->no_exec;
+    region->IsShareable = attr->shareable;
+    region->IsCacheable = attr->cacheable;
+    region->IsBufferable = attr->bufferable;
+
+    /* Never 0: range ends are 32-byte aligned, a 32-byte region always fits */
+    cur += mpu_plan_fit(cur, end, region);
+    plan->count++;
+  }
+
+  return HAL_OK;
+}
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef mpu_plan_build(const mpu_plan_range_t *table, uint32_t count, mpu_plan_t *plan)
+{
+  uint32_t pass;
+  uint32_t i;
+
+  plan->count = 0U;
+  plan->failed = 0U;
+
+  if(mpu_plan_check(table, count, &plan->failed) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  /* NO_ACCESS ranges first so everything else takes priority over them */
+  for(pass = 0U; pass < 2U; pass++)
+  {
+    for(i = 0U; i < count; i++)
+    {
+      if((table[i].use == MPU_PLAN_NO_ACCESS) != (pass == 0U))
+      {
+        continue;
+      }
+
+      plan->failed = i;
+      if(mpu_plan_emit(&table[i], plan) != HAL_OK)
+      {
+        return HAL_ERROR;
+      }
+    }
+  }
+
+  return HAL_OK;
+}
+
+void mpu_plan_apply(const mpu_plan_t *plan)
+{
+  MPU_Region_InitTypeDef off = {0};
+  uint32_t primask;
+  uint32_t i;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  /* Lines of memory that turns non-cacheable must not linger dirty */
+  if((SCB->CCR & SCB_CCR_DC_Msk) != 0U)
+  {
+    SCB_CleanInvalidateDCache();
+  }
+
+  HAL_MPU_Disable();
+
+  for(i = 0U; i < MPU_PLAN_MAX_REGIONS; i++)
+  {
+    if(i < plan->count)
+    {
+      HAL_MPU_ConfigRegion((MPU_Region_InitTypeDef *)&plan->region[i]);
+    }
+    else
+    {
+      off.Number = (uint8_t)i;
+      off.Enable = MPU_REGION_DISABLE;
+      HAL_MPU_ConfigRegion(&off);
+    }
+  }
+
+  HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
+
+  __set_PRIMASK(primask);
+}
+
+HAL_StatusTypeDef mpu_plan_init(void)
+{
+  if(mpu_plan_build(mpu_plan_h750, sizeof(mpu_plan_h750) / sizeof(mpu_plan_h750[0]), &mpu_plan_active) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  mpu_plan_apply(&mpu_plan_active);
+
+  return HAL_OK;
+}
@@ -0,0 +1,81 @@
+#ifndef __MPU_PLAN_H
+#define __MPU_PLAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+
+/* MPU region planner: a table says what each address range is used for and
+   the planner turns it into MPU regions with the matching memory attributes.
+   Ranges only need 32-byte alignment; a range that is not a naturally aligned
+   power of two is covered by a larger region with subregions disabled, or
+   split over several regions. Ranges must not overlap, except NO_ACCESS
+   ones: those get the lowest region numbers so every other range punches
+   through them (a higher region number wins on the Cortex-M7). */
+
+/* Exported constants --------------------------------------------------------*/
+/* Regions 0 .. MPU_PLAN_MAX_REGIONS - 1 belong to the planner. Region 15 is
+   left to the DMA arena, see dma_cache.h. */
+#ifndef MPU_PLAN_MAX_REGIONS
+#define MPU_PLAN_MAX_REGIONS    15U
+#endif
+
+/* Size of the memory-mapped QSPI flash, used by the default H750 table */
+#ifndef MPU_PLAN_QSPI_SIZE
+#define MPU_PLAN_QSPI_SIZE      (8U * 1024U * 1024U)
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  MPU_PLAN_CODE = 0,      /* executable, read-only (flash programming needs
+                             the MPU off), write-through cached */
+  MPU_PLAN_RAMCODE,       /* executable, read/write: RAM that code is copied
+                             into and run from, e.g. ITCM */
+  MPU_PLAN_RODATA,        /* read-only, write-through cached */
+  MPU_PLAN_DATA,          /* read/write, write-back write-allocate */
+  MPU_PLAN_STACK,         /* as DATA, never executable */
+  MPU_PLAN_DMA,           /* normal non-cacheable, no maintenance needed */
+  MPU_PLAN_FRAMEBUFFER,   /* write-through: reads cached, writes reach RAM */
+  MPU_PLAN_DEVICE,        /* shareable device */
+  MPU_PLAN_NO_ACCESS,     /* fault on access, stops speculative reads */
+  MPU_PLAN_USE_COUNT
+} mpu_plan_use_t;
+
+typedef struct
+{
+  uint32_t base;
+  uint32_t size;          /* bytes, 0 = whole 4 GB from base 0 */
+  mpu_plan_use_t use;
+} mpu_plan_range_t;
+
+typedef struct
+{
+  MPU_Region_InitTypeDef region[MPU_PLAN_MAX_REGIONS];
+  uint32_t count;
+  uint32_t failed;        /* table index that made mpu_plan_build() fail */
+} mpu_plan_t;
+
+/* Function definitions ------------------------------------------------------*/
+/* Turn a range table into MPU regions. HAL_ERROR if a range is misaligned,
+   two ranges overlap or more than MPU_PLAN_MAX_REGIONS regions are needed;
+   plan->failed then names the offending entry. */
+HAL_StatusTypeDef mpu_plan_build(const mpu_plan_range_t *table, uint32_t count, mpu_plan_t *plan);
+/* Program the regions with interrupts masked. The D-cache is cleaned and
+   invalidated first since attributes of cached memory may change. */
+void mpu_plan_apply(const mpu_plan_t *plan);
+/* Build and apply the H750 memory map: TCMs, flash, AXI SRAM, D2/D3 SRAM
+   for DMA, QSPI as code and no access over the unused external space.
+   ITCM is RAMCODE, writable as well as executable: the startup code copies
+   __ramfunc and .textrw there, so this may run before or after that copy
+   and the code may still be patched at run time. */
+HAL_StatusTypeDef mpu_plan_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
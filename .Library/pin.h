@@ -0,0 +1,173 @@
+#ifndef __PIN_H
+#define __PIN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+
+/* GPIO pins resolved at compile time. A pin is a "port, number" pair
+   behind a macro and the PIN_ macros take it as one argument:
+
+     #define LED_PIN        GPIOD, 0
+
+     PIN_CONFIG(LED_PIN, PIN_MODE_OUTPUT, PIN_OTYPE_PP, PIN_SPEED_VHIGH, PIN_PULL_NONE, 0U);
+     PIN_SET(LED_PIN);
+     if(PIN_READ(KEY_PIN)) ...
+
+   Set, clear and toggle are a single BSRR store (toggle reads ODR first),
+   so they cannot lose a concurrent change to another pin of the port the
+   way an ODR read-modify-write from an interrupt can. pin_config() sets up
+   any number of pins of one port with one write per register; with a
+   constant mask the field masks fold to constants. */
+
+/* Exported constants --------------------------------------------------------*/
+#define PIN_MODE_INPUT          0U
+#define PIN_MODE_OUTPUT         1U
+#define PIN_MODE_AF             2U
+#define PIN_MODE_ANALOG         3U
+
+#define PIN_OTYPE_PP            0U
+#define PIN_OTYPE_OD            1U
+
+#define PIN_SPEED_LOW           0U
+#define PIN_SPEED_MEDIUM        1U
+#define PIN_SPEED_HIGH          2U
+#define PIN_SPEED_VHIGH         3U
+
+#define PIN_PULL_NONE           0U
+#define PIN_PULL_UP             1U
+#define PIN_PULL_DOWN           2U
+
+/* Exported macro ------------------------------------------------------------*/
+#define PIN_BIT(n)              (1UL << (n))
+
+/* The extra level expands the pin macro into its two arguments */
+#define PIN_PORT(...)           PIN_PORT_(__VA_ARGS__)
+#define PIN_MASK(...)           PIN_MASK_(__VA_ARGS__)
+#define PIN_SET(...)            PIN_SET_(__VA_ARGS__)
+#define PIN_CLR(...)            PIN_CLR_(__VA_ARGS__)
+#define PIN_WRITE(pin, level)   PIN_WRITE_(pin, level)
+#define PIN_TOGGLE(...)         PIN_TOGGLE_(__VA_ARGS__)
+#define PIN_READ(...)           PIN_READ_(__VA_ARGS__)
+#define PIN_CLOCK_ENABLE(...)   PIN_CLOCK_ENABLE_(__VA_ARGS__)
+#define PIN_CONFIG(pin, mode, otype, speed, pull, af) \
+                                PIN_CONFIG_(pin, mode, otype, speed, pull, af)
+
+#define PIN_PORT_(port, n)      (port)
+#define PIN_MASK_(port, n)      PIN_BIT(n)
+#define PIN_SET_(port, n)       pin_set((port), PIN_BIT(n))
+#define PIN_CLR_(port, n)       pin_clr((port), PIN_BIT(n))
+#define PIN_WRITE_(port, n, level) \
+                                pin_write((port), PIN_BIT(n), (level))
+#define PIN_TOGGLE_(port, n)    pin_toggle((port), PIN_BIT(n))
+#define PIN_READ_(port, n)      (pin_read((port), PIN_BIT(n)) != 0U)
+#define PIN_CLOCK_ENABLE_(port, n) \
+                                pin_clock_enable(port)
+#define PIN_CONFIG_(port, n, mode, otype, speed, pull, af) \
+                                pin_config((port), PIN_BIT(n), (mode), (otype), (speed), (pull), (af))
+
+/* Function definitions ------------------------------------------------------*/
+__STATIC_FORCEINLINE void pin_set(GPIO_TypeDef *port, uint32_t mask)
+{
+  port->BSRR = mask;
+}
+
+__STATIC_FORCEINLINE void pin_clr(GPIO_TypeDef *port, uint32_t mask)
+{
+  port->BSRR = mask << 16;
+}
+
+/* Pins in mask go to level in one store, 0 = low */
+__STATIC_FORCEINLINE void pin_write(GPIO_TypeDef *port, uint32_t mask, uint32_t level)
+{
+  port->BSRR = (level != 0U) ? mask : (mask << 16);
+}
+
+/* Pins in set high and pins in clr low in the same store */
+__STATIC_FORCEINLINE void pin_write_masked(GPIO_TypeDef *port, uint32_t set, uint32_t clr)
+{
+  port->BSRR = set | (clr << 16);
+}
+
+__STATIC_FORCEINLINE void pin_toggle(GPIO_TypeDef *port, uint32_t mask)
+{
+  uint32_t odr = port->ODR;
+
+  port->BSRR = ((odr & mask) << 16) | (~odr & mask);
+}
+
+__STATIC_FORCEINLINE uint32_t pin_read(const GPIO_TypeDef *port, uint32_t mask)
+{
+  return port->IDR & mask;
+}
+
+/* Bit n of a 16-bit mask to bits 2n and 2n+1 set to 01 */
+__STATIC_FORCEINLINE uint32_t pin_spread2(uint32_t mask)
+{
+  uint32_t x = mask & 0xFFFFU;
+
+  x = (x | (x << 8)) & 0x00FF00FFU;
+  x = (x | (x << 4)) & 0x0F0F0F0FU;
+  x = (x | (x << 2)) & 0x33333333U;
+  x = (x | (x << 1)) & 0x55555555U;
+  return x;
+}
+
+/* Bit n of an 8-bit mask to bits 4n..4n+3 set to 0001 */
+__STATIC_FORCEINLINE uint32_t pin_spread4(uint32_t mask)
+{
+  uint32_t x = mask & 0xFFU;
+
+  x = (x | (x << 12)) & 0x000F000FU;
+  x = (x | (x << 6)) & 0x03030303U;
+  x = (x | (x << 3)) & 0x11111111U;
+  return x;
+}
+
+__STATIC_FORCEINLINE void pin_clock_enable(const GPIO_TypeDef *port)
+{
+  uint32_t index = ((uint32_t)port - GPIOA_BASE) >> 10;
+
+  SET_BIT(RCC->AHB4ENR, 1UL << index);
+  /* Delay after an RCC peripheral clock enabling */
+  (void)READ_BIT(RCC->AHB4ENR, 1UL << index);
+}
+
+/* Configure every pin in mask the same way, one write per register. AF,
+   type, speed and pull are set before MODER so an output or AF pin starts
+   out fully configured; set its initial level with pin_write() first. */
+__STATIC_FORCEINLINE void pin_config(GPIO_TypeDef *port, uint32_t mask, uint32_t mode,
+                                     uint32_t otype, uint32_t speed, uint32_t pull, uint32_t af)
+{
+  uint32_t m2 = pin_spread2(mask);
+  uint32_t lo4 = pin_spread4(mask);
+  uint32_t hi4 = pin_spread4(mask >> 8);
+
+  if(mode == PIN_MODE_AF)
+  {
+    if(lo4 != 0U)
+    {
+      port->AFR[0] = (port->AFR[0] & ~(lo4 * 0xFU)) | (lo4 * af);
+    }
+    if(hi4 != 0U)
+    {
+      port->AFR[1] = (port->AFR[1] & ~(hi4 * 0xFU)) | (hi4 * af);
+    }
+  }
+  if((mode == PIN_MODE_OUTPUT) || (mode == PIN_MODE_AF))
+  {
+    port->OTYPER = (port->OTYPER & ~mask) | ((otype != 0U) ? mask : 0U);
+    port->OSPEEDR = (port->OSPEEDR & ~(m2 * 3U)) | (m2 * speed);
+  }
+  port->PUPDR = (port->PUPDR & ~(m2 * 3U)) | (m2 * pull);
+  port->MODER = (port->MODER & ~(m2 * 3U)) | (m2 * mode);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,248 @@
+/* Header includes -----------------------------------------------------------*/
+#include "qspi_boot.h"
+
+/* Private macro -------------------------------------------------------------*/
+#define QSPI_BOOT_TIMEOUT       HAL_QSPI_TIMEOUT_DEFAULT_VALUE
+
+/* Private variables ---------------------------------------------------------*/
+QSPI_HandleTypeDef hqspi;
+
+/* Private functions ---------------------------------------------------------*/
+static void qspi_boot_pin(GPIO_TypeDef *port, uint32_t pin, uint32_t af)
+{
+  GPIO_InitTypeDef gpio;
+
+  gpio.Pin = pin;
+  gpio.Mode = GPIO_MODE_AF_PP;
+  gpio.Pull = GPIO_NOPULL;
+  gpio.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+  gpio.Alternate = af;
+  HAL_GPIO_Init(port, &gpio);
+}
+
+/* Single-line instruction with optional single-line data, for the register
+   commands issued before quad mode is known to work */
+static void qspi_boot_command(QSPI_CommandTypeDef *cmd, uint32_t instruction, uint32_t nbdata)
+{
+  cmd->Instruction = instruction;
+  cmd->Address = 0U;
+  cmd->AlternateBytes = 0U;
+  cmd->AddressSize = QSPI_ADDRESS_24_BITS;
+  cmd->AlternateBytesSize = QSPI_ALTERNATE_BYTES_8_BITS;
+  cmd->DummyCycles = 0U;
+  cmd->InstructionMode = QSPI_INSTRUCTION_1_LINE;
+  cmd->AddressMode = QSPI_ADDRESS_NONE;
+  cmd->AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
+  cmd->DataMode = (nbdata != 0U) ? QSPI_DATA_1_LINE : QSPI_DATA_NONE;
+  cmd->NbData = nbdata;
+  cmd->DdrMode = QSPI_DDR_MODE_DISABLE;
+  cmd->DdrHoldHalfCycle = QSPI_DDR_HHC_ANALOG_DELAY;
+  cmd->SIOOMode = QSPI_SIOO_INST_EVERY_CMD;
+}
+
+/* Poll status register 1 in hardware until (SR1 & mask) == match */
+static HAL_StatusTypeDef qspi_boot_poll(uint8_t mask, uint8_t match)
+{
+  QSPI_CommandTypeDef cmd;
+  QSPI_AutoPollingTypeDef cfg;
+
+  qspi_boot_command(&cmd, QSPI_CMD_READ_STATUS1, 1U);
+  cfg.Match = match;
+  cfg.Mask = mask;
+  cfg.Interval = 0x10U;
+  cfg.StatusBytesSize = 1U;
+  cfg.MatchMode = QSPI_MATCH_MODE_AND;
+  cfg.AutomaticStop = QSPI_AUTOMATIC_STOP_ENABLE;
+  return HAL_QSPI_AutoPolling(&hqspi, &cmd, &cfg, QSPI_BOOT_TIMEOUT);
+}
+
+static HAL_StatusTypeDef qspi_boot_reset(void)
+{
+  QSPI_CommandTypeDef cmd;
+
+  qspi_boot_command(&cmd, QSPI_CMD_RESET_ENABLE, 0U);
+  if(HAL_QSPI_Command(&hqspi, &cmd, QSPI_BOOT_TIMEOUT) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+  qspi_boot_command(&cmd, QSPI_CMD_RESET_DEVICE, 0U);
+  if(HAL_QSPI_Command(&hqspi, &cmd, QSPI_BOOT_TIMEOUT) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+  /* tRST is 30 us; the status poll also covers a reset during an erase */
+  HAL_Delay(1U);
+  return qspi_boot_poll(QSPI_STATUS1_WIP, 0U);
+}
+
+/* Quad reads need QE in status register 2. It is non-volatile, so it is only
+   written on the first boot of a fresh part */
+static HAL_StatusTypeDef qspi_boot_quad_enable(void)
+{
+  QSPI_CommandTypeDef cmd;
+  uint8_t sr2;
+
+  qspi_boot_command(&cmd, QSPI_CMD_READ_STATUS2, 1U);
+  if((HAL_QSPI_Command(&hqspi, &cmd, QSPI_BOOT_TIMEOUT) != HAL_OK) ||
+     (HAL_QSPI_Receive(&hqspi, &sr2, QSPI_BOOT_TIMEOUT) != HAL_OK))
+  {
+    return HAL_ERROR;
+  }
+  if((sr2 & QSPI_STATUS2_QE) != 0U)
+  {
+    return HAL_OK;
+  }
+
+  qspi_boot_command(&cmd, QSPI_CMD_WRITE_ENABLE, 0U);
+  if((HAL_QSPI_Command(&hqspi, &cmd, QSPI_BOOT_TIMEOUT) != HAL_OK) ||
+     (qspi_boot_poll(QSPI_STATUS1_WEL, QSPI_STATUS1_WEL) != HAL_OK))
+  {
+    return HAL_ERROR;
+  }
+  sr2 |= QSPI_STATUS2_QE;
+  qspi_boot_command(&cmd, QSPI_CMD_WRITE_STATUS2, 1U);
+  if((HAL_QSPI_Command(&hqspi, &cmd, QSPI_BOOT_TIMEOUT) != HAL_OK) ||
+     (HAL_QSPI_Transmit(&hqspi, &sr2, QSPI_BOOT_TIMEOUT) != HAL_OK))
+  {
+    return HAL_ERROR;
+  }
+  return qspi_boot_poll(QSPI_STATUS1_WIP, 0U);
+}
+
+static HAL_StatusTypeDef qspi_boot_memory_mapped(void)
+{
+  QSPI_CommandTypeDef cmd;
+  QSPI_MemoryMappedTypeDef cfg;
+
+  cmd.Instruction = (QSPI_BOOT_DTR == 1U) ? QSPI_CMD_QUAD_READ_DTR : QSPI_CMD_QUAD_READ;
+  cmd.Address = 0U;
+  /* Mode byte 0xFx: no continuous read, every access sends the instruction */
+  cmd.AlternateBytes = 0xFFU;
+  cmd.AddressSize = QSPI_ADDRESS_24_BITS;
+  cmd.AlternateBytesSize = QSPI_ALTERNATE_BYTES_8_BITS;
+  cmd.DummyCycles = QSPI_BOOT_DUMMY_CYCLES;
+  cmd.InstructionMode = QSPI_INSTRUCTION_1_LINE;
+  cmd.AddressMode = QSPI_ADDRESS_4_LINES;
+  cmd.AlternateByteMode = QSPI_ALTERNATE_BYTES_4_LINES;
+  cmd.DataMode = QSPI_DATA_4_LINES;
+  cmd.NbData = 0U;
+  cmd.DdrMode = (QSPI_BOOT_DTR == 1U) ? QSPI_DDR_MODE_ENABLE : QSPI_DDR_MODE_DISABLE;
+  cmd.DdrHoldHalfCycle = (QSPI_BOOT_DTR == 1U) ? QSPI_DDR_HHC_HALF_CLK_DELAY : QSPI_DDR_HHC_ANALOG_DELAY;
+  cmd.SIOOMode = QSPI_SIOO_INST_EVERY_CMD;
+
+  /* Keep nCS low between fetches: consecutive cache line refills at the
+     next address then continue the burst without a new command */
+  cfg.TimeOutActivation = QSPI_TIMEOUT_COUNTER_DISABLE;
+  cfg.TimeOutPeriod = 0U;
+  return HAL_QSPI_MemoryMapped(&hqspi, &cmd, &cfg);
+}
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef qspi_boot_init(void)
+{
+  uint32_t kernel;
+  uint32_t prescaler;
+
+  __HAL_RCC_GPIOB_CLK_ENABLE();
+  __HAL_RCC_GPIOD_CLK_ENABLE();
+  __HAL_RCC_GPIOE_CLK_ENABLE();
+  qspi_boot_pin(QSPI_CLK_PORT, QSPI_CLK_PIN, QSPI_CLK_AF);
+  qspi_boot_pin(QSPI_NCS_PORT, QSPI_NCS_PIN, QSPI_NCS_AF);
+  qspi_boot_pin(QSPI_IO0_PORT, QSPI_IO0_PIN, QSPI_IO0_AF);
+  qspi_boot_pin(QSPI_IO1_PORT, QSPI_IO1_PIN, QSPI_IO1_AF);
+  qspi_boot_pin(QSPI_IO2_PORT, QSPI_IO2_PIN, QSPI_IO2_AF);
+  qspi_boot_pin(QSPI_IO3_PORT, QSPI_IO3_PIN, QSPI_IO3_AF);
+
+  __HAL_RCC_QSPI_CLK_ENABLE();
+  __HAL_RCC_QSPI_FORCE_RESET();
+  __HAL_RCC_QSPI_RELEASE_RESET();
+
+  /* Kernel clock is HCLK3 unless RCC_PERIPHCLK_QSPI selects otherwise */
+  kernel = HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_QSPI);
+  prescaler = (kernel + QSPI_BOOT_MAX_HZ - 1U) / QSPI_BOOT_MAX_HZ;
+  if(prescaler == 0U)
+  {
+    prescaler = 1U;
+  }
+
+  hqspi.Instance = QUADSPI;
+  hqspi.Init.ClockPrescaler = prescaler - 1U;
+  hqspi.Init.FifoThreshold = 4U;
+  /* DTR samples on both edges, the half-cycle shift is SDR only */
+  hqspi.Init.SampleShifting = (QSPI_BOOT_DTR == 1U) ? QSPI_SAMPLE_SHIFTING_NONE : QSPI_SAMPLE_SHIFTING_HALFCYCLE;
+  hqspi.Init.FlashSize = POSITION_VAL(QSPI_BOOT_FLASH_SIZE) - 1U;
+  hqspi.Init.ChipSelectHighTime = QSPI_CS_HIGH_TIME_2_CYCLE;
+  hqspi.Init.ClockMode = QSPI_CLOCK_MODE_0;
+  hqspi.Init.FlashID = QSPI_FLASH_ID_1;
+  hqspi.Init.DualFlash = QSPI_DUALFLASH_DISABLE;
+  if(HAL_QSPI_Init(&hqspi) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  if((qspi_boot_reset() != HAL_OK) ||
+     (qspi_boot_quad_enable() != HAL_OK) ||
+     (qspi_boot_memory_mapped() != HAL_OK))
+  {
+    return HAL_ERROR;
+  }
+
+  /* QSPI becomes cached code, the unused external space no access, so
+     speculative fetches never reach an unmapped address */
+  if(mpu_plan_init() != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+  if((SCB->CCR & SCB_CCR_IC_Msk) == 0U)
+  {
+    SCB_EnableICache();
+  }
+  if((SCB->CCR & SCB_CCR_DC_Msk) == 0U)
+  {
+    SCB_EnableDCache();
+  }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef qspi_boot_jump(uint32_t addr)
+{
+  const uint32_t *vectors = (const uint32_t *)addr;
+  uint32_t sp = vectors[0];
+  uint32_t entry = vectors[1];
+  uint32_t i;
+
+  /* Initial SP in DTCM or AXI SRAM, reset handler a Thumb address inside
+     the mapped flash. An erased flash reads 0xFFFFFFFF and fails both */
+  if(!(((sp > D1_DTCMRAM_BASE) && (sp <= (D1_DTCMRAM_BASE + 0x20000U))) ||
+       ((sp > D1_AXISRAM_BASE) && (sp <= (D1_AXISRAM_BASE + 0x80000U)))))
+  {
+    return HAL_ERROR;
+  }
+  if(((entry & 1U) == 0U) || (entry < QSPI_BASE) ||
+     (entry >= (QSPI_BASE + QSPI_BOOT_FLASH_SIZE)))
+  {
+    return HAL_ERROR;
+  }
+
+  /* The application starts with the interrupt state of a reset: SysTick
+     off, nothing enabled or pending. The loader timebase (TIM5) is
+     reprogrammed by the application's HAL_Init() */
+  __disable_irq();
+  SysTick->CTRL = 0U;
+  for(i = 0U; i < (sizeof(NVIC->ICER) / sizeof(NVIC->ICER[0])); i++)
+  {
+    NVIC->ICER[i] = 0xFFFFFFFFU;
+    NVIC->ICPR[i] = 0xFFFFFFFFU;
+  }
+  SCB->ICSR = SCB_ICSR_PENDSTCLR_Msk | SCB_ICSR_PENDSVCLR_Msk;
+
+  SCB->VTOR = addr;
+  __DSB();
+  __ISB();
+  __set_MSP(sp);
+  __enable_irq();
+  ((void (*)(void))entry)();
+
+  /* Not reached */
+  return HAL_ERROR;
+}
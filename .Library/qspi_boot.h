@@ -0,0 +1,118 @@
+#ifndef __QSPI_BOOT_H
+#define __QSPI_BOOT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+#include "mpu_plan.h"
+
+/* Execute-in-place boot from the QSPI NOR flash. The 128 KB internal flash
+   only holds a loader that calls
+
+     HAL_Init();
+     if(qspi_boot_init() == HAL_OK)
+     {
+       qspi_boot_jump(QSPI_BOOT_APP_ADDR);
+     }
+     (stay here: blink an LED, wait for a debugger)
+
+   qspi_boot_init() resets the flash, sets its QE bit, puts the QUADSPI in
+   memory-mapped mode with a quad (DTR by default) fast read at the highest
+   clock the flash allows, then applies the MPU plan (QSPI as cached code,
+   the rest of the external space no access) and enables both caches.
+   The application is linked with IAR_Project/stm32h750xx_qspi_app.icf and
+   built with VECT_TAB_QSPI so its SystemInit() keeps the loader's clocks.
+
+   The command set is the common one of Winbond W25Qxx / ISSI IS25LP parts;
+   check the dummy cycles and the clock limit against the fitted flash. */
+
+/* Exported constants --------------------------------------------------------*/
+#ifndef QSPI_BOOT_APP_ADDR
+#define QSPI_BOOT_APP_ADDR          QSPI_BASE
+#endif
+
+/* Must match the fitted part, the MPU plan covers the same size */
+#define QSPI_BOOT_FLASH_SIZE        MPU_PLAN_QSPI_SIZE
+
+/* 1: quad I/O DTR read (0xED), 0: quad I/O SDR read (0xEB) */
+#ifndef QSPI_BOOT_DTR
+#define QSPI_BOOT_DTR               1U
+#endif
+
+/* Flash clock limit for the selected read command. W25Q64JV-DTR:
+   80 MHz DTR, 133 MHz SDR. The QUADSPI prescaler is the smallest one that
+   keeps the kernel clock at or below this */
+#ifndef QSPI_BOOT_MAX_HZ
+#if (QSPI_BOOT_DTR == 1U)
+#define QSPI_BOOT_MAX_HZ            80000000U
+#else
+#define QSPI_BOOT_MAX_HZ            133000000U
+#endif
+#endif
+
+/* Dummy clocks after the mode byte. W25Q64JV-DTR: 0xED needs 8 (6 below
+   80 MHz in some parts), 0xEB needs 4 */
+#ifndef QSPI_BOOT_DUMMY_CYCLES
+#if (QSPI_BOOT_DTR == 1U)
+#define QSPI_BOOT_DUMMY_CYCLES      8U
+#else
+#define QSPI_BOOT_DUMMY_CYCLES      4U
+#endif
+#endif
+
+/* Flash commands */
+#define QSPI_CMD_RESET_ENABLE       0x66U
+#define QSPI_CMD_RESET_DEVICE       0x99U
+#define QSPI_CMD_WRITE_ENABLE       0x06U
+#define QSPI_CMD_READ_STATUS1       0x05U
+#define QSPI_CMD_READ_STATUS2       0x35U
+#define QSPI_CMD_WRITE_STATUS2      0x31U
+#define QSPI_CMD_QUAD_READ          0xEBU
+#define QSPI_CMD_QUAD_READ_DTR      0xEDU
+
+#define QSPI_STATUS1_WIP            0x01U
+#define QSPI_STATUS1_WEL            0x02U
+#define QSPI_STATUS2_QE             0x02U
+
+/* Board pins, defaults are the usual H750 core board wiring */
+#ifndef QSPI_CLK_PIN
+#define QSPI_CLK_PORT               GPIOB
+#define QSPI_CLK_PIN                GPIO_PIN_2
+#define QSPI_CLK_AF                 GPIO_AF9_QUADSPI
+#define QSPI_NCS_PORT               GPIOB
+#define QSPI_NCS_PIN                GPIO_PIN_6
+#define QSPI_NCS_AF                 GPIO_AF10_QUADSPI
+#define QSPI_IO0_PORT               GPIOD
+#define QSPI_IO0_PIN                GPIO_PIN_11
+#define QSPI_IO0_AF                 GPIO_AF9_QUADSPI
+#define QSPI_IO1_PORT               GPIOD
+#define QSPI_IO1_PIN                GPIO_PIN_12
+#define QSPI_IO1_AF                 GPIO_AF9_QUADSPI
+#define QSPI_IO2_PORT               GPIOE
+#define QSPI_IO2_PIN                GPIO_PIN_2
+#define QSPI_IO2_AF                 GPIO_AF9_QUADSPI
+#define QSPI_IO3_PORT               GPIOD
+#define QSPI_IO3_PIN                GPIO_PIN_13
+#define QSPI_IO3_AF                 GPIO_AF9_QUADSPI
+#endif
+
+/* Exported variables --------------------------------------------------------*/
+extern QSPI_HandleTypeDef hqspi;
+
+/* Function definitions ------------------------------------------------------*/
+/* Bring the flash up in memory-mapped mode and set up MPU and caches.
+   Needs HAL_Init() first, the flash commands time out on HAL_GetTick(). */
+HAL_StatusTypeDef qspi_boot_init(void);
+/* Check the application vector table at addr and start it with a clean
+   interrupt state. Only returns (HAL_ERROR) if the table looks erased or
+   points outside RAM/QSPI. */
+HAL_StatusTypeDef qspi_boot_jump(uint32_t addr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
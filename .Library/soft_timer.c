@@ -0,0 +1,241 @@
+
+/* Header includes -----------------------------------------------------------*/
+#include "soft_timer.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define TW_ROOT_BITS        8U
+#define TW_LEVEL_BITS       6U
+#define TW_ROOT_SIZE        (1U << TW_ROOT_BITS)
+#define TW_LEVEL_SIZE       (1U << TW_LEVEL_BITS)
+#define TW_ROOT_MASK        (TW_ROOT_SIZE - 1U)
+#define TW_LEVEL_MASK       (TW_LEVEL_SIZE - 1U)
+#define TW_LEVELS           4U
+
+/* Slot of 'ticks' in outer level n (0..3) */
+#define TW_INDEX(ticks, n)  (((ticks) >> (TW_ROOT_BITS + ((n) * TW_LEVEL_BITS))) & TW_LEVEL_MASK)
+
+/* Private variables ---------------------------------------------------------*/
+static soft_timer_node_t tw_root[TW_ROOT_SIZE];
+static soft_timer_node_t tw_level[TW_LEVELS][TW_LEVEL_SIZE];
+static soft_timer_node_t tw_expired;
+static volatile uint32_t tw_now = 0U;     /* next tick to be processed */
+
+/* Private functions ---------------------------------------------------------*/
+static void tw_list_init(soft_timer_node_t *head)
+{
+  head->next = head;
+  head->prev = head;
+}
+
+static void tw_list_add_tail(soft_timer_node_t *head, soft_timer_node_t *node)
+{
+  node->prev = head->prev;
+  node->next = head;
+  head->prev->next = node;
+  head->prev = node;
+}
+
+static void tw_list_del(soft_timer_node_t *node)
+{
+  node->prev->next = node->next;
+  node->next->prev = node->prev;
+  node->next = NULL;
+  node->prev = NULL;
+}
+
+/* Move every node of 'from' to the tail of 'to', O(1) */
+static void tw_list_splice_tail(soft_timer_node_t *from, soft_timer_node_t *to)
+{
+  if(from->next == from)
+  {
+    return;
+  }
+  from->next->prev = to->prev;
+  to->prev->next = from->next;
+  from->prev->next = to;
+  to->prev = from->prev;
+  tw_list_init(from);
+}
+
+/* Must be called with interrupts masked */
+static void tw_insert(soft_timer_t *timer)
+{
+  uint32_t expires = timer->expires;
+  uint32_t idx = expires - tw_now;
+  soft_timer_node_t *slot;
+
+  if((int32_t)idx < 0)
+  {
+    /* Already due, fires on the next tick */
+    slot = &tw_root[tw_now & TW_ROOT_MASK];
+  }
+  else if(idx < TW_ROOT_SIZE)
+  {
+    slot = &tw_root[expires & TW_ROOT_MASK];
+  }
+  else if(idx < (1UL << (TW_ROOT_BITS + TW_LEVEL_BITS)))
+  {
+    slot = &tw_level[0][TW_INDEX(expires, 0U)];
+  }
+  else if(idx < (1UL << (TW_ROOT_BITS + (2U * TW_LEVEL_BITS))))
+  {
+    slot = &tw_level[1][TW_INDEX(expires, 1U)];
+  }
+  else if(idx < (1UL << (TW_ROOT_BITS + (3U * TW_LEVEL_BITS))))
+  {
+    slot = &tw_level[2][TW_INDEX(expires, 2U)];
+  }
+  else
+  {
+    slot = &tw_level[3][TW_INDEX(expires, 3U)];
+  }
+  tw_list_add_tail(slot, &timer->node);
+}
+
+/* Re-distribute one outer slot into the lower levels, returns its index */
+static uint32_t tw_cascade(uint32_t level, uint32_t index)
+{
+  soft_timer_node_t list;
+  soft_timer_node_t *node;
+
+  tw_list_init(&list);
+  tw_list_splice_tail(&tw_level[level][index], &list);
+  while(list.next != &list)
+  {
+    node = list.next;
+    tw_list_del(node);
+    tw_insert((soft_timer_t *)node);
+  }
+  return index;
+}
+
+static void tw_tick(void)
+{
+  uint32_t now = tw_now;
+  uint32_t index = now & TW_ROOT_MASK;
+
+  if((index == 0U)
+     && (tw_cascade(0U, TW_INDEX(now, 0U)) == 0U)
+     && (tw_cascade(1U, TW_INDEX(now, 1U)) == 0U)
+     && (tw_cascade(2U, TW_INDEX(now, 2U)) == 0U))
+  {
+    tw_cascade(3U, TW_INDEX(now, 3U));
+  }
+  tw_now = now + 1U;
+  tw_list_splice_tail(&tw_root[index], &tw_expired);
+}
+
+/* Exported functions --------------------------------------------------------*/
+void soft_timer_init(void)
+{
+  uint32_t i;
+  uint32_t n;
+
+  for(i = 0U; i < TW_ROOT_SIZE; i++)
+  {
+    tw_list_init(&tw_root[i]);
+  }
+  for(n = 0U; n < TW_LEVELS; n++)
+  {
+    for(i = 0U; i < TW_LEVEL_SIZE; i++)
+    {
+      tw_list_init(&tw_level[n][i]);
+    }
+  }
+  tw_list_init(&tw_expired);
+  tw_now = 0U;
+
+  TIM7_Config();
+  TIM6_Config();
+}
+
+void soft_timer_setup(soft_timer_t *timer)
+{
+  timer->node.next = NULL;
+  timer->node.prev = NULL;
+  timer->expires = 0U;
+  timer->period = 0U;
+  timer->callback = NULL;
+  timer->context = NULL;
+}
+
+uint32_t soft_timer_now(void)
+{
+  return tw_now;
+}
+
+void soft_timer_start(soft_timer_t *timer, uint32_t delay, uint32_t period,
+                      soft_timer_callback_t callback, void *context)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if(timer->node.next != NULL)
+  {
+    tw_list_del(&timer->node);
+  }
+  timer->callback = callback;
+  timer->context = context;
+  timer->period = period;
+  /* Fires between delay and delay + 1 ticks from now */
+  timer->expires = tw_now + delay;
+  tw_insert(timer);
+  __set_PRIMASK(primask);
+}
+
+void soft_timer_stop(soft_timer_t *timer)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if(timer->node.next != NULL)
+  {
+    tw_list_del(&timer->node);
+  }
+  timer->period = 0U;
+  __set_PRIMASK(primask);
+}
+
+uint32_t soft_timer_is_active(const soft_timer_t *timer)
+{
+  return (timer->node.next != NULL) ? 1U : 0U;
+}
+
+TCM_CODE void TIM6_DAC_IRQHandler(void)
+{
+  if(__HAL_TIM_GET_FLAG(&htim6, TIM_FLAG_UPDATE) != RESET)
+  {
+    htim6.Instance->SR = (uint32_t)~TIM_FLAG_UPDATE;
+    tw_tick();
+    if(tw_expired.next != &tw_expired)
+    {
+      HAL_NVIC_SetPendingIRQ(TIM7_IRQn);
+    }
+  }
+}
+
+TCM_CODE void TIM7_IRQHandler(void)
+{
+  soft_timer_t *timer;
+  soft_timer_callback_t callback;
+  void *context;
+
+  __disable_irq();
+  while(tw_expired.next != &tw_expired)
+  {
+    timer = (soft_timer_t *)tw_expired.next;
+    tw_list_del(&timer->node);
+    callback = timer->callback;
+    context = timer->context;
+    if(timer->period != 0U)
+    {
+      /* Drift-free: next expiry is relative to the previous one */
+      timer->expires += timer->period;
+      tw_insert(timer);
+    }
+    __enable_irq();
+    callback(context);
+    __disable_irq();
+  }
+  __enable_irq();
+}
@@ -0,0 +1,66 @@
+#ifndef __SOFT_TIMER_H
+#define __SOFT_TIMER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+#include "tim_config.h"
+#include "tcm.h"
+
+/* Software timer service: a hierarchical timer wheel (256 + 4 x 64 slots,
+   full 32-bit tick range) advanced by the TIM6 tick. Start and stop are O(1)
+   and never allocate; timers are owned by the caller. Expired timers are
+   spliced out of the wheel in one operation per tick and their callbacks run
+   as a batch from the TIM7 interrupt, below the tick priority.
+
+   A timer is stopped when its node links are NULL, so a soft_timer_t must
+   start out zeroed: static storage, SOFT_TIMER_INIT, or soft_timer_setup()
+   for one on the stack or the heap. Starting one that holds garbage unlinks
+   nodes that are not there. */
+
+/* Exported types ------------------------------------------------------------*/
+typedef void (*soft_timer_callback_t)(void *context);
+
+typedef struct soft_timer_node_s
+{
+  struct soft_timer_node_s *next;
+  struct soft_timer_node_s *prev;
+} soft_timer_node_t;
+
+typedef struct
+{
+  soft_timer_node_t node;           /* must stay first */
+  uint32_t expires;                 /* absolute tick */
+  uint32_t period;                  /* 0 : one-shot */
+  soft_timer_callback_t callback;   /* called from TIM7 interrupt */
+  void *context;
+} soft_timer_t;
+
+/* Exported macro ------------------------------------------------------------*/
+/* Initializer of a stopped timer */
+#define SOFT_TIMER_INIT         { { NULL, NULL }, 0U, 0U, NULL, NULL }
+
+/* Function definitions ------------------------------------------------------*/
+void soft_timer_init(void);
+/* Makes a timer stopped, before its first start; never on an active one */
+void soft_timer_setup(soft_timer_t *timer);
+uint32_t soft_timer_now(void);
+
+/* delay and period are in TIM6 ticks (1 / TIM6_TICK_HZ), delay < 2^31.
+   Starting an active timer re-schedules it. */
+void soft_timer_start(soft_timer_t *timer, uint32_t delay, uint32_t period,
+                      soft_timer_callback_t callback, void *context);
+void soft_timer_stop(soft_timer_t *timer);
+uint32_t soft_timer_is_active(const soft_timer_t *timer);
+
+TCM_CODE void TIM6_DAC_IRQHandler(void);
+TCM_CODE void TIM7_IRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SOFT_TIMER_H */
@@ -0,0 +1,432 @@
+/* Header includes -----------------------------------------------------------*/
+#include "spi_queue.h"
+#include "pin.h"
+
+/* Private macro -------------------------------------------------------------*/
+/* SPI masters with a queue, the HAL callbacks look them up here */
+#ifndef SPI_QUEUE_MAX
+#define SPI_QUEUE_MAX           4U
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+static spi_queue_t *spi_queue_list[SPI_QUEUE_MAX];
+
+/* Private functions ---------------------------------------------------------*/
+static void spi_queue_run(spi_queue_t *q);
+
+static spi_queue_t *spi_queue_find(const SPI_HandleTypeDef *hspi)
+{
+  uint32_t i;
+
+  for(i = 0U; i < SPI_QUEUE_MAX; i++)
+  {
+    if((spi_queue_list[i] != NULL) && (spi_queue_list[i]->hspi == hspi))
+    {
+      return spi_queue_list[i];
+    }
+  }
+  return NULL;
+}
+
+static uint32_t spi_queue_use_dma(const spi_queue_t *q, const spi_xfer_t *x)
+{
+  const SPI_HandleTypeDef *hspi = q->hspi;
+
+  if((x->len <= SPI_QUEUE_IT_MAX) || ((x->len % q->packet) != 0U))
+  {
+    return 0U;
+  }
+  if(((x->tx != NULL) && (hspi->hdmatx == NULL)) || ((x->rx != NULL) && (hspi->hdmarx == NULL)))
+  {
+    return 0U;
+  }
+  return 1U;
+}
+
+/* Frame size, clock and FIFO threshold for x. The HAL clears SPE at the end
+   of every transfer, so CFG1/CFG2 are writable here; Init is kept in step
+   because the HAL transfer code reads it. Runs before CS is asserted, a
+   CPOL change moves the idle clock level. */
+static void spi_queue_setup(spi_queue_t *q, const spi_xfer_t *x, uint32_t dma)
+{
+  SPI_HandleTypeDef *hspi = q->hspi;
+  uint32_t fthlv = ((dma != 0U) ? (q->packet - 1U) : 0U) << SPI_CFG1_FTHLV_Pos;
+  uint32_t data_size = (x->data_size != 0U) ? x->data_size : q->data_size;
+  uint32_t mbr = (x->prescaler != 0U) ? (x->prescaler & SPI_CFG1_MBR) : q->prescaler;
+  uint32_t cfg1;
+
+  hspi->Init.DataSize = data_size;
+  hspi->Init.BaudRatePrescaler = mbr;
+  hspi->Init.FifoThreshold = fthlv;
+  hspi->Init.CLKPolarity = x->mode & SPI_CFG2_CPOL;
+  hspi->Init.CLKPhase = x->mode & SPI_CFG2_CPHA;
+
+  cfg1 = (hspi->Instance->CFG1 & ~(SPI_CFG1_FTHLV | SPI_CFG1_DSIZE | SPI_CFG1_MBR)) | fthlv | data_size | mbr;
+  if(cfg1 != hspi->Instance->CFG1)
+  {
+    hspi->Instance->CFG1 = cfg1;
+  }
+  MODIFY_REG(hspi->Instance->CFG2, SPI_CFG2_CPOL | SPI_CFG2_CPHA, x->mode);
+}
+
+static HAL_StatusTypeDef spi_queue_transfer(spi_queue_t *q, spi_xfer_t *x, uint32_t dma)
+{
+  SPI_HandleTypeDef *hspi = q->hspi;
+  uint8_t *tx = (uint8_t *)x->tx;
+  uint8_t *rx = (uint8_t *)x->rx;
+
+  if(dma != 0U)
+  {
+    q->stats.dma++;
+    if((tx != NULL) && (rx != NULL))
+    {
+      return HAL_SPI_TransmitReceive_DMA(hspi, tx, rx, x->len);
+    }
+    return (tx != NULL) ? HAL_SPI_Transmit_DMA(hspi, tx, x->len) : HAL_SPI_Receive_DMA(hspi, rx, x->len);
+  }
+  if((tx != NULL) && (rx != NULL))
+  {
+    return HAL_SPI_TransmitReceive_IT(hspi, tx, rx, x->len);
+  }
+  return (tx != NULL) ? HAL_SPI_Transmit_IT(hspi, tx, x->len) : HAL_SPI_Receive_IT(hspi, rx, x->len);
+}
+
+#if defined(USE_SPI_RELOAD_TRANSFER)
+/* Chain the next queued transaction behind x when nothing has to happen
+   between the two: same device and settings, CS held, no delays */
+static void spi_queue_chain(spi_queue_t *q, spi_xfer_t *x)
+{
+  spi_xfer_t *y = q->head;
+  HAL_StatusTypeDef status;
+
+  if((y == NULL) || ((x->flags & SPI_XFER_HOLD_CS) == 0U) || (x->post_us != 0U) || (y->pre_us != 0U) ||
+     (y->cs_port != x->cs_port) || (y->cs_mask != x->cs_mask) || (y->mode != x->mode) ||
+     (y->data_size != x->data_size) || (y->prescaler != x->prescaler) ||
+     ((y->tx == NULL) != (x->tx == NULL)) || ((y->rx == NULL) != (x->rx == NULL)) ||
+     (spi_queue_use_dma(q, y) != 0U))
+  {
+    return;
+  }
+
+  if((y->tx != NULL) && (y->rx != NULL))
+  {
+    status = HAL_SPI_Reload_TransmitReceive_IT(q->hspi, (uint8_t *)y->tx, (uint8_t *)y->rx, y->len);
+  }
+  else if(y->tx != NULL)
+  {
+    status = HAL_SPI_Reload_Transmit_IT(q->hspi, (uint8_t *)y->tx, y->len);
+  }
+  else
+  {
+    status = HAL_SPI_Reload_Receive_IT(q->hspi, (uint8_t *)y->rx, y->len);
+    /* A full-duplex master receives by sending its buffer as dummy data
+       (HAL_SPI_Receive_IT() runs a transmit-receive), but the reload only
+       sets the receive side: the transmit side would go on with stale
+       pointer and count */
+    q->hspi->Reload.pTxBuffPtr = (uint8_t *)y->rx;
+    q->hspi->Reload.TxXferSize = y->len;
+  }
+  if(status == HAL_OK)
+  {
+    q->head = y->next;
+    if(q->head == NULL)
+    {
+      q->tail = NULL;
+    }
+    q->reload = y;
+    q->stats.reloads++;
+  }
+}
+#endif /* USE_SPI_RELOAD_TRANSFER */
+
+/* Clock x out, CS asserted and pre_us over. Masked so the completion
+   cannot run between start and reload. */
+static HAL_StatusTypeDef spi_queue_start(spi_queue_t *q, spi_xfer_t *x)
+{
+  HAL_StatusTypeDef status;
+  uint32_t primask;
+  uint32_t dma = spi_queue_use_dma(q, x);
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  status = spi_queue_transfer(q, x, dma);
+#if defined(USE_SPI_RELOAD_TRANSFER)
+  if((status == HAL_OK) && (dma == 0U))
+  {
+    spi_queue_chain(q, x);
+  }
+#endif /* USE_SPI_RELOAD_TRANSFER */
+  __set_PRIMASK(primask);
+  return status;
+}
+
+static void spi_queue_finish(spi_queue_t *q, spi_xfer_t *x, HAL_StatusTypeDef status)
+{
+  if((x->cs_port != NULL) && ((x->flags & SPI_XFER_HOLD_CS) == 0U))
+  {
+    pin_set(x->cs_port, x->cs_mask);
+  }
+  q->stats.xfers++;
+  if(status != HAL_OK)
+  {
+    q->stats.errors++;
+  }
+  if(x->done != NULL)
+  {
+    x->done(x, status);
+  }
+}
+
+/* Release CS and report active and the transaction chained behind it,
+   then start the next one */
+static void spi_queue_release(spi_queue_t *q)
+{
+  spi_xfer_t *x = q->active;
+  spi_xfer_t *y = q->reload;
+
+  /* active stays set while CS is released and done() runs, so a submit
+     from done() queues behind instead of starting the bus */
+  spi_queue_finish(q, x, q->status);
+  if(y != NULL)
+  {
+    spi_queue_finish(q, y, q->status);
+  }
+  q->reload = NULL;
+  q->active = NULL;
+  spi_queue_run(q);
+}
+
+/* Timebase alarms, TIM5 interrupt */
+static void spi_queue_pre_alarm(void *context)
+{
+  spi_queue_t *q = (spi_queue_t *)context;
+  HAL_StatusTypeDef status = spi_queue_start(q, q->active);
+
+  if(status != HAL_OK)
+  {
+    q->status = status;
+    spi_queue_release(q);
+  }
+}
+
+static void spi_queue_post_alarm(void *context)
+{
+  spi_queue_release((spi_queue_t *)context);
+}
+
+/* Start queued transactions until one is running or waits for pre_us.
+   Claiming active under the mask makes this safe to call from any
+   context. */
+static void spi_queue_run(spi_queue_t *q)
+{
+  spi_xfer_t *x;
+  HAL_StatusTypeDef status;
+  uint32_t primask;
+
+  for(;;)
+  {
+    primask = __get_PRIMASK();
+    __disable_irq();
+    x = q->head;
+    if((q->active != NULL) || (x == NULL))
+    {
+      __set_PRIMASK(primask);
+      return;
+    }
+    q->head = x->next;
+    if(q->head == NULL)
+    {
+      q->tail = NULL;
+    }
+    q->active = x;
+    __set_PRIMASK(primask);
+
+    spi_queue_setup(q, x, spi_queue_use_dma(q, x));
+    if(x->cs_port != NULL)
+    {
+      pin_clr(x->cs_port, x->cs_mask);
+    }
+    if(x->pre_us != 0U)
+    {
+      /* +1: the current microsecond is partly gone */
+      timebase_alarm_start_in(&q->alarm, (uint32_t)x->pre_us + 1U, spi_queue_pre_alarm, q);
+      return;
+    }
+
+    status = spi_queue_start(q, x);
+    if(status == HAL_OK)
+    {
+      return;
+    }
+
+    spi_queue_finish(q, x, status);
+    q->active = NULL;
+  }
+}
+
+static void spi_queue_complete(spi_queue_t *q, HAL_StatusTypeDef status)
+{
+  spi_xfer_t *last;
+
+  if(q->active == NULL)
+  {
+    return;
+  }
+  /* A chained transaction has no post_us in front of the next one */
+  last = (q->reload != NULL) ? q->reload : q->active;
+  q->status = status;
+  if(last->post_us != 0U)
+  {
+    timebase_alarm_start_in(&q->alarm, (uint32_t)last->post_us + 1U, spi_queue_post_alarm, q);
+    return;
+  }
+  spi_queue_release(q);
+}
+
+#if (USE_HAL_SPI_REGISTER_CALLBACKS == 1U)
+/* Registered on the handles of the queues */
+static void spi_queue_cplt_callback(SPI_HandleTypeDef *hspi)
+{
+  spi_queue_complete(spi_queue_find(hspi), HAL_OK);
+}
+
+static void spi_queue_error_callback(SPI_HandleTypeDef *hspi)
+{
+  spi_queue_complete(spi_queue_find(hspi), HAL_ERROR);
+}
+#else
+static void spi_queue_event(SPI_HandleTypeDef *hspi, uint32_t event)
+{
+  spi_queue_t *q = spi_queue_find(hspi);
+
+  if(q == NULL)
+  {
+    spi_queue_other_callback(hspi, event);
+    return;
+  }
+  spi_queue_complete(q, (event == SPI_QUEUE_ERROR) ? HAL_ERROR : HAL_OK);
+}
+#endif /* USE_HAL_SPI_REGISTER_CALLBACKS */
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef spi_queue_init(spi_queue_t *q)
+{
+  const DMA_HandleTypeDef *hdma = (q->hspi->hdmarx != NULL) ? q->hspi->hdmarx : q->hspi->hdmatx;
+  uint32_t slot = SPI_QUEUE_MAX;
+  uint32_t i;
+
+  for(i = 0U; i < SPI_QUEUE_MAX; i++)
+  {
+    if((spi_queue_list[i] == NULL) || (spi_queue_list[i] == q))
+    {
+      slot = i;
+      break;
+    }
+  }
+  if(slot == SPI_QUEUE_MAX)
+  {
+    return HAL_ERROR;
+  }
+#if (USE_HAL_SPI_REGISTER_CALLBACKS == 1U)
+  if((HAL_SPI_RegisterCallback(q->hspi, HAL_SPI_TX_COMPLETE_CB_ID, spi_queue_cplt_callback) != HAL_OK) ||
+     (HAL_SPI_RegisterCallback(q->hspi, HAL_SPI_RX_COMPLETE_CB_ID, spi_queue_cplt_callback) != HAL_OK) ||
+     (HAL_SPI_RegisterCallback(q->hspi, HAL_SPI_TX_RX_COMPLETE_CB_ID, spi_queue_cplt_callback) != HAL_OK) ||
+     (HAL_SPI_RegisterCallback(q->hspi, HAL_SPI_ERROR_CB_ID, spi_queue_error_callback) != HAL_OK))
+  {
+    return HAL_ERROR;
+  }
+#endif /* USE_HAL_SPI_REGISTER_CALLBACKS */
+
+  /* FIFO threshold = peripheral burst of the DMA, one request per packet */
+  q->packet = 1U;
+  if((hdma != NULL) && (hdma->Init.FIFOMode == DMA_FIFOMODE_ENABLE))
+  {
+    if(hdma->Init.PeriphBurst == DMA_PBURST_INC4)
+    {
+      q->packet = 4U;
+    }
+    else if(hdma->Init.PeriphBurst == DMA_PBURST_INC8)
+    {
+      q->packet = 8U;
+    }
+    else if(hdma->Init.PeriphBurst == DMA_PBURST_INC16)
+    {
+      q->packet = 16U;
+    }
+  }
+
+  q->head = NULL;
+  q->tail = NULL;
+  q->active = NULL;
+  q->reload = NULL;
+  q->data_size = q->hspi->Init.DataSize;
+  q->prescaler = q->hspi->Init.BaudRatePrescaler;
+  q->status = HAL_OK;
+  q->stats.xfers = 0U;
+  q->stats.dma = 0U;
+  q->stats.reloads = 0U;
+  q->stats.errors = 0U;
+  spi_queue_list[slot] = q;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef spi_queue_submit(spi_queue_t *q, spi_xfer_t *xfer)
+{
+  uint32_t primask;
+
+  if((xfer->len == 0U) || ((xfer->tx == NULL) && (xfer->rx == NULL)))
+  {
+    return HAL_ERROR;
+  }
+
+  xfer->next = NULL;
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if(q->tail != NULL)
+  {
+    q->tail->next = xfer;
+  }
+  else
+  {
+    q->head = xfer;
+  }
+  q->tail = xfer;
+  __set_PRIMASK(primask);
+
+  spi_queue_run(q);
+  return HAL_OK;
+}
+
+uint32_t spi_queue_idle(const spi_queue_t *q)
+{
+  return ((q->active == NULL) && (q->head == NULL)) ? 1U : 0U;
+}
+
+#if (USE_HAL_SPI_REGISTER_CALLBACKS != 1U)
+__weak void spi_queue_other_callback(SPI_HandleTypeDef *hspi, uint32_t event)
+{
+  UNUSED(hspi);
+  UNUSED(event);
+}
+
+/* HAL callbacks -------------------------------------------------------------*/
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+  spi_queue_event(hspi, SPI_QUEUE_TX_CPLT);
+}
+
+void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+  spi_queue_event(hspi, SPI_QUEUE_RX_CPLT);
+}
+
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+  spi_queue_event(hspi, SPI_QUEUE_TXRX_CPLT);
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
+{
+  spi_queue_event(hspi, SPI_QUEUE_ERROR);
+}
+#endif /* USE_HAL_SPI_REGISTER_CALLBACKS */
@@ -0,0 +1,133 @@
+#ifndef __SPI_QUEUE_H
+#define __SPI_QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+#include "timebase.h"
+
+/* SPI transaction queue: several devices share one SPI master and each
+   transaction carries its own chip select, mode, frame size, clock and
+   CS-to-clock delays. Transactions are queued without blocking and run back
+   to back from the SPI/DMA interrupts; done() is called from interrupt
+   context when one has finished.
+
+   Long transfers go through the DMA with the SPI FIFO threshold matched to
+   the DMA burst, so one DMA request moves a whole packet. Short ones use
+   the interrupt path; when a short transaction has SPI_XFER_HOLD_CS and
+   the next queued one talks to the same device with the same settings, it
+   is chained with a TSIZE reload (USE_SPI_RELOAD_TRANSFER) and the clock
+   does not stop between the two, e.g. a register address and the data.
+
+   The CS-to-clock delays are timebase alarms, not busy-waits: nothing
+   spins in an interrupt for them, and the transfer after pre_us starts
+   and done() after post_us runs from the TIM5 interrupt. A delay lasts at
+   least its length and up to a microsecond more plus the interrupt
+   latency. timebase_init() must have run.
+
+   With USE_HAL_SPI_REGISTER_CALLBACKS set, spi_queue_init() registers the
+   completion callbacks on the queue's handle, so it must come after
+   HAL_SPI_Init(). Without it this module defines HAL_SPI_TxCpltCallback,
+   RxCpltCallback, TxRxCpltCallback and ErrorCallback, and passes the
+   events of SPI handles that have no queue on to
+   spi_queue_other_callback(). The application keeps calling
+   HAL_SPI_IRQHandler() and HAL_DMA_IRQHandler() from the vectors. */
+
+/* Exported constants --------------------------------------------------------*/
+/* Transfers of at most this many frames use the interrupt path */
+#ifndef SPI_QUEUE_IT_MAX
+#define SPI_QUEUE_IT_MAX        16U
+#endif
+
+/* SPI clock polarity/phase */
+#define SPI_XFER_MODE_0         0U
+#define SPI_XFER_MODE_1         SPI_CFG2_CPHA
+#define SPI_XFER_MODE_2         SPI_CFG2_CPOL
+#define SPI_XFER_MODE_3         (SPI_CFG2_CPOL | SPI_CFG2_CPHA)
+
+/* spi_xfer_t.flags */
+#define SPI_XFER_HOLD_CS        0x0001U   /* leave CS asserted for the next transaction */
+
+/* spi_queue_other_callback() events */
+#define SPI_QUEUE_TX_CPLT       0U
+#define SPI_QUEUE_RX_CPLT       1U
+#define SPI_QUEUE_TXRX_CPLT     2U
+#define SPI_QUEUE_ERROR         3U
+
+/* Exported macro ------------------------------------------------------------*/
+/* spi_xfer_t.prescaler from an SPI_BAUDRATEPRESCALER_x value; 0 keeps the
+   clock the SPI was initialized with (bit 0 is not part of CFG1.MBR) */
+#define SPI_XFER_PRESCALER(p)   ((uint32_t)(p) | 1U)
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct spi_xfer_s spi_xfer_t;
+typedef void (*spi_xfer_done_t)(spi_xfer_t *xfer, HAL_StatusTypeDef status);
+
+struct spi_xfer_s
+{
+  spi_xfer_t *next;             /* owned by the queue until done() */
+  GPIO_TypeDef *cs_port;        /* NULL: no software chip select */
+  uint32_t cs_mask;             /* active low */
+  uint32_t mode;                /* SPI_XFER_MODE_x */
+  uint32_t data_size;           /* SPI_DATASIZE_xBIT, 0 = as initialized */
+  uint32_t prescaler;           /* SPI_XFER_PRESCALER(), 0 = as initialized */
+  const void *tx;               /* NULL: receive only */
+  void *rx;                     /* NULL: transmit only */
+  uint16_t len;                 /* frames */
+  uint16_t pre_us;              /* CS asserted to first clock */
+  uint16_t post_us;             /* last clock to CS released */
+  uint16_t flags;               /* SPI_XFER_xx */
+  spi_xfer_done_t done;         /* may be NULL */
+  void *context;
+};
+
+typedef struct
+{
+  uint32_t xfers;
+  uint32_t dma;                 /* started through the DMA */
+  uint32_t reloads;             /* chained by TSIZE reload */
+  uint32_t errors;
+} spi_queue_stats_t;
+
+typedef struct
+{
+  SPI_HandleTypeDef *hspi;
+  spi_xfer_t *head;             /* pending */
+  spi_xfer_t *tail;
+  spi_xfer_t *volatile active;  /* running */
+  spi_xfer_t *reload;           /* chained behind active */
+  uint32_t packet;              /* frames per DMA request */
+  uint32_t data_size;           /* as initialized, for data_size 0 */
+  uint32_t prescaler;           /* as initialized, for prescaler 0 */
+  timebase_alarm_t alarm;       /* pre_us / post_us */
+  HAL_StatusTypeDef status;     /* of active, kept over post_us */
+  spi_queue_stats_t stats;
+} spi_queue_t;
+
+/* Function definitions ------------------------------------------------------*/
+/* q->hspi must be initialized as full-duplex master with software NSS;
+   hdmatx/hdmarx may be left NULL, transfers then all use the interrupt
+   path. HAL_ERROR if no queue slot is free or the HAL callbacks could
+   not be registered. */
+HAL_StatusTypeDef spi_queue_init(spi_queue_t *q);
+/* Queue a transaction, from any context. HAL_ERROR for a zero length or
+   no data buffer at all. */
+HAL_StatusTypeDef spi_queue_submit(spi_queue_t *q, spi_xfer_t *xfer);
+/* Nothing queued or running */
+uint32_t spi_queue_idle(const spi_queue_t *q);
+
+#if (USE_HAL_SPI_REGISTER_CALLBACKS != 1U)
+/* HAL SPI callback of a handle without a queue, event SPI_QUEUE_xx, from
+   interrupt context. Weak, does nothing; the application overrides it to
+   drive its other SPIs through the HAL callbacks. */
+void spi_queue_other_callback(SPI_HandleTypeDef *hspi, uint32_t event);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
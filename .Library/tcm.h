@@ -0,0 +1,34 @@
+#ifndef __TCM_H
+#define __TCM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Placement of hot code and data in the tightly coupled memories. Prefix a
+   function definition with TCM_CODE and a variable with TCM_DATA:
+
+     TCM_CODE void TIM5_IRQHandler(void) { ... }
+     TCM_DATA static uint32_t samples[64];
+
+   With IAR, TCM_CODE is __ramfunc (section .textrw) and TCM_DATA places in
+   .dtcm_ram; both are copied/zeroed by the startup init table like any
+   initialized data. IAR_Project/stm32h750xx_flash_tcm.icf maps them to ITCM
+   and DTCM, stm32h750xx_flash_axisram.icf to AXI SRAM, and the toolkit's
+   stock stm32h750xB.icf knows both sections too. DTCM is not reachable by
+   DMA1/DMA2/ETH, keep DMA buffers out of TCM_DATA. */
+
+/* Exported macro ------------------------------------------------------------*/
+#if defined ( __ICCARM__ )
+#define TCM_CODE        __ramfunc
+#define TCM_DATA        _Pragma("location = \".dtcm_ram\"")
+#else
+#define TCM_CODE        __attribute__((section(".textrw"), noinline))
+#define TCM_DATA        __attribute__((section(".dtcm_ram")))
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
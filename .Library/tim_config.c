@@ -1,19 +1,55 @@
 #include "tim_config.h"
+
+TIM_HandleTypeDef htim6;
+TIM_HandleTypeDef htim7;
+
 void TIM6_Config()
 {
+  uint32_t ticks = TIM_GetAPB1ClockFreq() / TIM6_TICK_HZ;
+  uint32_t prescaler = (ticks + 0xFFFFU) / 0x10000U;   /* 16-bit ARR */
+
   __HAL_RCC_TIM6_CLK_ENABLE();
-  TIM_Base_InitTypeDef TIM_Base_InitStructure;
-  TIM_Base_InitStructure.CounterMode = TIM_COUNTERMODE_UP;
-  TIM_Base_InitStructure.ClockDivision = 5;
-  TIM_Base_InitStructure.Prescaler = 5;
-  TIM_Base_InitStructure.Period = 6;
-  TIM_Base_InitStructure.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
- // TIM_Base_InitStructure.RepetitionCounter = TIM_
-  
+  htim6.Instance = TIM6;
+  htim6.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim6.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim6.Init.Prescaler = prescaler - 1U;
+  htim6.Init.Period = (ticks / prescaler) - 1U;
+  htim6.Init.RepetitionCounter = 0U;
+  htim6.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+  HAL_TIM_Base_Init(&htim6);
+
+  HAL_NVIC_SetPriority(TIM6_DAC_IRQn, TIM6_IRQ_PRIORITY, 0U);
+  HAL_NVIC_EnableIRQ(TIM6_DAC_IRQn);
+  HAL_TIM_Base_Start_IT(&htim6);
 }
 
 void TIM7_Config()
 {
-     __HAL_RCC_TIM7_CLK_ENABLE();
+  __HAL_RCC_TIM7_CLK_ENABLE();
+  htim7.Instance = TIM7;
+  htim7.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim7.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim7.Init.Prescaler = 0U;
+  htim7.Init.Period = 0xFFFFU;
+  htim7.Init.RepetitionCounter = 0U;
+  htim7.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  HAL_TIM_Base_Init(&htim7);
 
-}
\ No newline at end of file
+  /* Counter stays stopped, the IRQ is only pended by software */
+  HAL_NVIC_SetPriority(TIM7_IRQn, TIM7_IRQ_PRIORITY, 0U);
+  HAL_NVIC_EnableIRQ(TIM7_IRQn);
+}
+
+uint32_t TIM_GetAPB1ClockFreq(void)
+{
+  uint32_t pclk1 = HAL_RCC_GetPCLK1Freq();
+  uint32_t ppre1 = (RCC->D2CFGR & RCC_D2CFGR_D2PPRE1) >> RCC_D2CFGR_D2PPRE1_Pos;
+
+  /* ppre1 < 4 : APB1 not divided */
+  if((RCC->CFGR & RCC_CFGR_TIMPRE) == 0U)
+  {
+    return (ppre1 < 4U) ? pclk1 : (2U * pclk1);
+  }
+  /* TIMPRE set: timers run at HCLK up to /4, then 4 x PCLK1 */
+  return (ppre1 < 6U) ? HAL_RCC_GetHCLKFreq() : (4U * pclk1);
+}
@@ -5,7 +5,21 @@
 #include "stm32h7xx_hal_rcc.h"
 #include "stm32h7xx_hal_gpio.h"
 
+/* TIM6 : periodic tick of the software timer service
+   TIM7 : no counting, its interrupt is pended by software to run timer
+          callbacks at a lower priority than the tick */
+#define TIM6_TICK_HZ            1000U
+#define TIM6_IRQ_PRIORITY       2U
+#define TIM7_IRQ_PRIORITY       6U
+
+extern TIM_HandleTypeDef htim6;
+extern TIM_HandleTypeDef htim7;
+
 void TIM6_Config(void);
 void TIM7_Config(void);
 
-#endif
\ No newline at end of file
+/* Kernel clock of the timers on APB1 (TIM2-7, TIM12-14, LPTIM1), taking the
+   x2 / x4 multiplier selected by RCC_CFGR.TIMPRE into account. */
+uint32_t TIM_GetAPB1ClockFreq(void);
+
+#endif
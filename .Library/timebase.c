@@ -0,0 +1,264 @@
+
+/* Header includes -----------------------------------------------------------*/
+#include "timebase.h"
+
+/* Private variables ---------------------------------------------------------*/
+/* Time at counter 0 of the current prescaler setting, only changed with
+   interrupts masked by timebase_init(). */
+static uint64_t timebase_offset = 0U;
+/* Number of 32-bit counter overflows since timebase_offset was taken */
+static volatile uint32_t timebase_wraps = 0U;
+static timebase_alarm_t *timebase_alarms = NULL;
+
+/* Private functions ---------------------------------------------------------*/
+static uint64_t timebase_read(void)
+{
+  uint32_t wraps;
+  uint32_t cnt;
+  uint32_t pending;
+
+  /* Lock-free: retry if the overflow interrupt ran between the two reads */
+  do
+  {
+    wraps = timebase_wraps;
+    cnt = TIMEBASE_TIM->CNT;
+    pending = TIMEBASE_TIM->SR & TIM_SR_UIF;
+  } while(wraps != timebase_wraps);
+
+  /* Overflow happened but its interrupt could not run yet (masked or higher
+     priority caller). Only trust it if the counter was sampled after it. */
+  if((pending != 0U) && (cnt < 0x80000000U))
+  {
+    wraps++;
+  }
+
+  return timebase_offset + (((uint64_t)wraps) << 32) + cnt;
+}
+
+/* Arm CC1 for the head alarm. Must be called with interrupts masked. */
+static void timebase_arm(void)
+{
+  timebase_alarm_t *head = timebase_alarms;
+  uint64_t now;
+  uint64_t ticks;
+
+  if(head == NULL)
+  {
+    TIMEBASE_TIM->DIER &= ~TIM_DIER_CC1IE;
+    return;
+  }
+
+  now = timebase_read();
+  if(head->deadline <= now)
+  {
+    /* Already due: let the interrupt handler dispatch it */
+    TIMEBASE_TIM->DIER |= TIM_DIER_CC1IE;
+    TIMEBASE_TIM->EGR = TIM_EGR_CC1G;
+    return;
+  }
+
+  ticks = head->deadline - timebase_offset;
+  if((uint32_t)(ticks >> 32) != timebase_wraps)
+  {
+    /* Beyond the current counter period, re-armed on overflow */
+    TIMEBASE_TIM->DIER &= ~TIM_DIER_CC1IE;
+    return;
+  }
+
+  TIMEBASE_TIM->CCR1 = (uint32_t)ticks;
+  TIMEBASE_TIM->SR = (uint32_t)~TIM_SR_CC1IF;
+  TIMEBASE_TIM->DIER |= TIM_DIER_CC1IE;
+
+  /* Close the race where the counter passed CCR1 while we wrote it */
+  if(timebase_read() >= head->deadline)
+  {
+    TIMEBASE_TIM->EGR = TIM_EGR_CC1G;
+  }
+}
+
+static void timebase_unlink(timebase_alarm_t *alarm)
+{
+  timebase_alarm_t **link = &timebase_alarms;
+
+  while(*link != NULL)
+  {
+    if(*link == alarm)
+    {
+      *link = alarm->next;
+      alarm->next = NULL;
+      return;
+    }
+    link = &(*link)->next;
+  }
+}
+
+/* Exported functions --------------------------------------------------------*/
+HAL_StatusTypeDef timebase_init(uint32_t priority)
+{
+  uint32_t primask;
+  uint64_t now = 0U;
+  uint32_t clock;
+
+  if(priority >= (1UL << __NVIC_PRIO_BITS))
+  {
+    return HAL_ERROR;
+  }
+
+  clock = TIM_GetAPB1ClockFreq();
+  if((clock % TIMEBASE_FREQ) != 0U)
+  {
+    return HAL_ERROR;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  if((RCC->APB1LENR & RCC_APB1LENR_TIM5EN) != 0U)
+  {
+    /* Clock tree changed while running: keep the time continuous */
+    now = timebase_read();
+  }
+  else
+  {
+    __HAL_RCC_TIM5_CLK_ENABLE();
+  }
+
+  TIMEBASE_TIM->CR1 = TIM_CR1_URS;
+  TIMEBASE_TIM->PSC = (clock / TIMEBASE_FREQ) - 1U;
+  TIMEBASE_TIM->ARR = 0xFFFFFFFFU;
+  TIMEBASE_TIM->CCMR1 = 0U;
+  /* Load PSC and clear CNT without raising UIF (URS set) */
+  TIMEBASE_TIM->EGR = TIM_EGR_UG;
+  TIMEBASE_TIM->SR = 0U;
+  timebase_offset = now;
+  timebase_wraps = 0U;
+  TIMEBASE_TIM->DIER = TIM_DIER_UIE;
+  TIMEBASE_TIM->CR1 |= TIM_CR1_CEN;
+  /* SetSystemClock() leaves SysTick interrupting, it is not needed anymore */
+  SysTick->CTRL = 0U;
+  timebase_arm();
+
+  HAL_NVIC_SetPriority(TIMEBASE_IRQn, priority, 0U);
+  HAL_NVIC_EnableIRQ(TIMEBASE_IRQn);
+
+  __set_PRIMASK(primask);
+  return HAL_OK;
+}
+
+uint64_t timebase_us(void)
+{
+  return timebase_read();
+}
+
+uint32_t timebase_elapsed_us(uint64_t since)
+{
+  return (uint32_t)(timebase_read() - since);
+}
+
+void timebase_alarm_start(timebase_alarm_t *alarm, uint64_t deadline,
+                          timebase_callback_t callback, void *context)
+{
+  timebase_alarm_t **link = &timebase_alarms;
+  uint32_t primask = __get_PRIMASK();
+  uint32_t was_head;
+
+  __disable_irq();
+  was_head = (timebase_alarms == alarm);
+  timebase_unlink(alarm);
+  alarm->deadline = deadline;
+  alarm->callback = callback;
+  alarm->context = context;
+
+  /* Keep the list sorted, equal deadlines fire in start order */
+  while((*link != NULL) && ((*link)->deadline <= deadline))
+  {
+    link = &(*link)->next;
+  }
+  alarm->next = *link;
+  *link = alarm;
+
+  /* A head moved back leaves CC1 on its old deadline otherwise */
+  if((was_head != 0U) || (timebase_alarms == alarm))
+  {
+    timebase_arm();
+  }
+  __set_PRIMASK(primask);
+}
+
+void timebase_alarm_start_in(timebase_alarm_t *alarm, uint32_t delay_us,
+                             timebase_callback_t callback, void *context)
+{
+  timebase_alarm_start(alarm, timebase_read() + delay_us, callback, context);
+}
+
+void timebase_alarm_cancel(timebase_alarm_t *alarm)
+{
+  uint32_t primask = __get_PRIMASK();
+  uint32_t was_head;
+
+  __disable_irq();
+  was_head = (timebase_alarms == alarm);
+  timebase_unlink(alarm);
+  if(was_head != 0U)
+  {
+    timebase_arm();
+  }
+  __set_PRIMASK(primask);
+}
+
+TCM_CODE void TIM5_IRQHandler(void)
+{
+  timebase_alarm_t *alarm;
+  uint32_t sr = TIMEBASE_TIM->SR;
+
+  if((sr & TIM_SR_UIF) != 0U)
+  {
+    TIMEBASE_TIM->SR = (uint32_t)~TIM_SR_UIF;
+    timebase_wraps++;
+  }
+  TIMEBASE_TIM->SR = (uint32_t)~TIM_SR_CC1IF;
+
+  /* Alarms run with the handler's priority; a callback may restart itself */
+  __disable_irq();
+  while((timebase_alarms != NULL) && (timebase_alarms->deadline <= timebase_read()))
+  {
+    alarm = timebase_alarms;
+    timebase_alarms = alarm->next;
+    alarm->next = NULL;
+    __enable_irq();
+    alarm->callback(alarm->context);
+    __disable_irq();
+  }
+  timebase_arm();
+  __enable_irq();
+}
+
+/* HAL timebase overrides ----------------------------------------------------*/
+HAL_StatusTypeDef HAL_InitTick(uint32_t TickPriority)
+{
+  if(timebase_init(TickPriority) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+  uwTickPrio = TickPriority;
+  return HAL_OK;
+}
+
+void HAL_IncTick(void)
+{
+  /* Tickless: nothing to count */
+}
+
+uint32_t HAL_GetTick(void)
+{
+  return (uint32_t)(timebase_read() / 1000U);
+}
+
+void HAL_SuspendTick(void)
+{
+  /* Only overflow/alarm interrupts are enabled, nothing to suspend */
+}
+
+void HAL_ResumeTick(void)
+{
+}
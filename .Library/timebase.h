@@ -0,0 +1,54 @@
+#ifndef __TIMEBASE_H
+#define __TIMEBASE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+#include "tim_config.h"
+#include "tcm.h"
+
+/* Tickless timebase: a free-running 32-bit TIM5 counting microseconds plus a
+   software overflow count gives a 64-bit monotonic clock. There is no periodic
+   interrupt; TIM5 only interrupts on overflow (every ~71 min) and on the
+   earliest pending alarm. Linking this file overrides the weak HAL_InitTick /
+   HAL_GetTick / HAL_IncTick so the HAL keeps its millisecond API on top. */
+
+/* Exported types ------------------------------------------------------------*/
+typedef void (*timebase_callback_t)(void *context);
+
+typedef struct timebase_alarm_s
+{
+  struct timebase_alarm_s *next;
+  uint64_t deadline;                /* absolute time in us */
+  timebase_callback_t callback;     /* called from TIM5 interrupt */
+  void *context;
+} timebase_alarm_t;
+
+/* Exported constants --------------------------------------------------------*/
+#define TIMEBASE_TIM                TIM5
+#define TIMEBASE_IRQn               TIM5_IRQn
+#define TIMEBASE_FREQ               1000000U
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef timebase_init(uint32_t priority);
+uint64_t timebase_us(void);
+uint32_t timebase_elapsed_us(uint64_t since);
+
+/* One-shot alarms. The alarm object is owned by the caller and must stay valid
+   until it fires or is cancelled. Restarting an armed alarm re-schedules it. */
+void timebase_alarm_start(timebase_alarm_t *alarm, uint64_t deadline,
+                          timebase_callback_t callback, void *context);
+void timebase_alarm_start_in(timebase_alarm_t *alarm, uint32_t delay_us,
+                             timebase_callback_t callback, void *context);
+void timebase_alarm_cancel(timebase_alarm_t *alarm);
+
+TCM_CODE void TIM5_IRQHandler(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TIMEBASE_H */
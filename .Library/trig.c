@@ -0,0 +1,136 @@
+/* Header includes -----------------------------------------------------------*/
+#include "trig.h"
+#include <math.h>
+
+/* Private macro -------------------------------------------------------------*/
+#define TRIG_PI                 3.14159265f
+#define TRIG_PI_2               1.57079633f
+#define TRIG_2_PI               0.636619772f      /* 2 / pi */
+/* pi/2 in three parts with short mantissas, so the products with the
+   quadrant number are exact and the reduction loses nothing */
+#define TRIG_PI_2_A             1.5703125f
+#define TRIG_PI_2_B             4.837512969970703125e-4f
+#define TRIG_PI_2_C             7.54978995489188216e-8f
+
+/* Private functions ---------------------------------------------------------*/
+/* Angle to a quadrant k and a rest r in -pi/4..pi/4, then minimax
+   polynomials for sin(r) and cos(r) and a swap/sign per quadrant */
+static inline void trig_eval_sincos(float angle, float *c, float *s)
+{
+  float k = floorf((angle * TRIG_2_PI) + 0.5f);
+  float r = ((angle - (k * TRIG_PI_2_A)) - (k * TRIG_PI_2_B)) - (k * TRIG_PI_2_C);
+  float r2 = r * r;
+  float ps = r + (r * r2 * (-1.6666654611e-1f + (r2 * (8.3321608736e-3f + (r2 * -1.9515295891e-4f)))));
+  float pc = 1.0f + (r2 * (-0.5f + (r2 * (4.166664568298827e-2f + (r2 * (-1.388731625493765e-3f + (r2 * 2.443315711809948e-5f)))))));
+  uint32_t q = (uint32_t)(int32_t)k & 3U;
+
+  switch(q)
+  {
+    case 0U:
+      *c = pc;
+      *s = ps;
+      break;
+    case 1U:
+      *c = -ps;
+      *s = pc;
+      break;
+    case 2U:
+      *c = -pc;
+      *s = -ps;
+      break;
+    default:
+      *c = ps;
+      *s = -pc;
+      break;
+  }
+}
+
+/* atan of t = smaller / larger magnitude (0..1) by an odd polynomial,
+   then moved to the right octant */
+static inline float trig_eval_phase(float y, float x, float t)
+{
+  float t2 = t * t;
+  float a;
+
+  a = t * (0.99997726f + (t2 * (-0.33262347f + (t2 * (0.19354346f + (t2 * (-0.11643287f +
+      (t2 * (0.05265332f + (t2 * -0.01172120f))))))))));
+  if(fabsf(y) > fabsf(x))
+  {
+    a = TRIG_PI_2 - a;
+  }
+  if(x < 0.0f)
+  {
+    a = TRIG_PI - a;
+  }
+  return (y < 0.0f) ? -a : a;
+}
+
+static inline float trig_eval_atan2(float y, float x)
+{
+  float ax = fabsf(x);
+  float ay = fabsf(y);
+  float hi = (ax > ay) ? ax : ay;
+  float lo = (ax > ay) ? ay : ax;
+
+  if(hi == 0.0f)
+  {
+    return 0.0f;
+  }
+  return trig_eval_phase(y, x, lo / hi);
+}
+
+/* The modulus as hi * sqrt(1 + t^2) with the same t, so x^2 + y^2 can
+   neither overflow for large inputs nor underflow for small ones */
+static inline void trig_eval_polar(float x, float y, float *m, float *a)
+{
+  float ax = fabsf(x);
+  float ay = fabsf(y);
+  float hi = (ax > ay) ? ax : ay;
+  float lo = (ax > ay) ? ay : ax;
+  float t;
+
+  if(hi == 0.0f)
+  {
+    *m = 0.0f;
+    *a = 0.0f;
+    return;
+  }
+  t = lo / hi;
+  *m = hi * sqrtf(1.0f + (t * t));
+  *a = trig_eval_phase(y, x, t);
+}
+
+/* Function definitions ------------------------------------------------------*/
+void trig_sincos(float *v, uint32_t n)
+{
+  uint32_t i;
+
+  for(i = 0U; i < n; i++)
+  {
+    trig_eval_sincos(v[2U * i], &v[2U * i], &v[(2U * i) + 1U]);
+  }
+}
+
+void trig_polar(float *v, uint32_t n)
+{
+  float x;
+  float y;
+  uint32_t i;
+
+  for(i = 0U; i < n; i++)
+  {
+    x = v[2U * i];
+    y = v[(2U * i) + 1U];
+    trig_eval_polar(x, y, &v[2U * i], &v[(2U * i) + 1U]);
+  }
+}
+
+void trig_sincos1(float angle, float *c, float *s)
+{
+  trig_eval_sincos(angle, c, s);
+}
+
+float trig_atan2(float y, float x)
+{
+  return trig_eval_atan2(y, x);
+}
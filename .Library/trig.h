@@ -0,0 +1,41 @@
+#ifndef __TRIG_H
+#define __TRIG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include <stdint.h>
+
+/* Batched trigonometry for control loops: arrays of (angle) or (x, y)
+   pairs are turned into (cos, sin) or (modulus, phase) pairs in place,
+   the way a CORDIC coprocessor hands results back. Short polynomials on
+   a reduced range replace sinf/cosf/atan2f; there are no tables, no
+   errno and no calls, so a loop over a batch stays in registers and
+   pipelines on the M7 FPU.
+
+   Accuracy, checked against double precision by Test/trig_test.c:
+     cos/sin   absolute error < 1e-7 for |angle| < 1e4
+     phase     absolute error < 2e-6 rad
+     modulus   relative error < 1.5 FLT_EPSILON
+   Phase and modulus hold for any finite x, y: the modulus is scaled by
+   the larger of |x|, |y| and does not overflow before the result does. */
+
+/* Function definitions ------------------------------------------------------*/
+/* v[2i] is an angle in radians on entry; v[2i] = cos, v[2i+1] = sin on
+   return. n is the number of pairs. */
+void trig_sincos(float *v, uint32_t n);
+/* v[2i], v[2i+1] = x, y on entry; modulus and atan2(y, x) in -pi..pi on
+   return. The phase of (0, 0) is 0. */
+void trig_polar(float *v, uint32_t n);
+
+/* Single values, same arithmetic as the batch versions */
+void trig_sincos1(float angle, float *c, float *s);
+float trig_atan2(float y, float x);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
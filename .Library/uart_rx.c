@@ -0,0 +1,323 @@
+/* Header includes -----------------------------------------------------------*/
+#include "uart_rx.h"
+#include "dma_cache.h"
+#include <string.h>
+
+/* Private macro -------------------------------------------------------------*/
+/* Streams running at the same time, the DMA callbacks look them up here */
+#ifndef UART_RX_MAX
+#define UART_RX_MAX             4U
+#endif
+
+#define UART_RX_LINE_ERRORS     (USART_ISR_PE | USART_ISR_FE | USART_ISR_NE | USART_ISR_ORE)
+
+/* Private variables ---------------------------------------------------------*/
+static uart_rx_t *uart_rx_active[UART_RX_MAX];
+
+/* Private functions ---------------------------------------------------------*/
+static uart_rx_t *uart_rx_find(const DMA_HandleTypeDef *hdma)
+{
+  uint32_t i;
+
+  for(i = 0U; i < UART_RX_MAX; i++)
+  {
+    if((uart_rx_active[i] != NULL) && (uart_rx_active[i]->huart->hdmarx == hdma))
+    {
+      return uart_rx_active[i];
+    }
+  }
+  return NULL;
+}
+
+/* Publish what the DMA wrote since the last call. Both interrupts and the
+   consumer get here, the interrupts possibly at different priorities, so
+   the short read-modify-write of head is done with interrupts masked. */
+static void uart_rx_update(uart_rx_t *rx)
+{
+  uint32_t primask;
+  uint32_t pos;
+  uint32_t mask = rx->size - 1U;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  /* The counter reloads to size right after reaching 0 in circular mode */
+  pos = (rx->size - __HAL_DMA_GET_COUNTER(rx->huart->hdmarx)) & mask;
+  rx->head += (pos - rx->dma_pos) & mask;
+  rx->dma_pos = pos;
+  __set_PRIMASK(primask);
+}
+
+static void uart_rx_event(uart_rx_t *rx, uint32_t events)
+{
+  uart_rx_update(rx);
+  if(rx->callback != NULL)
+  {
+    rx->callback(rx, events);
+  }
+}
+
+static void uart_rx_dma_half(DMA_HandleTypeDef *hdma)
+{
+  uart_rx_t *rx = uart_rx_find(hdma);
+
+  if(rx != NULL)
+  {
+    uart_rx_event(rx, UART_RX_EVT_HALF);
+  }
+}
+
+static void uart_rx_dma_cplt(DMA_HandleTypeDef *hdma)
+{
+  uart_rx_t *rx = uart_rx_find(hdma);
+
+  if(rx != NULL)
+  {
+    uart_rx_event(rx, UART_RX_EVT_WRAP);
+  }
+}
+
+static void uart_rx_dma_error(DMA_HandleTypeDef *hdma)
+{
+  uart_rx_t *rx = uart_rx_find(hdma);
+
+  /* A transfer error disables the stream, uart_rx_stop/start to recover */
+  if(rx != NULL)
+  {
+    rx->errors |= HAL_UART_ERROR_DMA;
+    uart_rx_event(rx, UART_RX_EVT_ERROR);
+  }
+}
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef uart_rx_start(uart_rx_t *rx)
+{
+  UART_HandleTypeDef *huart = rx->huart;
+  DMA_HandleTypeDef *hdma = huart->hdmarx;
+  uint32_t slot = UART_RX_MAX;
+  uint32_t i;
+
+  if((hdma == NULL) || (hdma->Init.Mode != DMA_CIRCULAR) ||
+     (rx->size < 2U) || (rx->size > 0xFFFFU) || ((rx->size & (rx->size - 1U)) != 0U))
+  {
+    return HAL_ERROR;
+  }
+  if(huart->RxState != HAL_UART_STATE_READY)
+  {
+    return HAL_BUSY;
+  }
+  for(i = 0U; i < UART_RX_MAX; i++)
+  {
+    if((uart_rx_active[i] == NULL) || (uart_rx_active[i] == rx))
+    {
+      slot = i;
+      break;
+    }
+  }
+  if(slot == UART_RX_MAX)
+  {
+    return HAL_ERROR;
+  }
+
+  if(rx->rto_bits != 0U)
+  {
+    if(IS_LPUART_INSTANCE(huart->Instance))
+    {
+      return HAL_ERROR;
+    }
+    HAL_UART_ReceiverTimeout_Config(huart, rx->rto_bits);
+    if(HAL_UART_EnableReceiverTimeout(huart) != HAL_OK)
+    {
+      return HAL_BUSY;
+    }
+  }
+
+  rx->head = 0U;
+  rx->tail = 0U;
+  rx->dma_pos = 0U;
+  rx->errors = 0U;
+  rx->lost = 0U;
+  uart_rx_active[slot] = rx;
+
+  huart->ErrorCode = HAL_UART_ERROR_NONE;
+  huart->RxState = HAL_UART_STATE_BUSY_RX;
+  huart->pRxBuffPtr = rx->buf;
+  huart->RxXferSize = (uint16_t)rx->size;
+
+  hdma->XferHalfCpltCallback = uart_rx_dma_half;
+  hdma->XferCpltCallback = uart_rx_dma_cplt;
+  hdma->XferErrorCallback = uart_rx_dma_error;
+  hdma->XferAbortCallback = NULL;
+
+  /* No dirty line of the ring may be evicted over DMA data later on */
+  dma_cache_invalidate(rx->buf, rx->size);
+  if(HAL_DMA_Start_IT(hdma, (uint32_t)&huart->Instance->RDR, (uint32_t)rx->buf, rx->size) != HAL_OK)
+  {
+    huart->RxState = HAL_UART_STATE_READY;
+    uart_rx_active[slot] = NULL;
+    return HAL_ERROR;
+  }
+
+  __HAL_UART_CLEAR_FLAG(huart, UART_CLEAR_IDLEF | UART_CLEAR_RTOF | UART_CLEAR_PEF |
+                               UART_CLEAR_FEF | UART_CLEAR_NEF | UART_CLEAR_OREF);
+  SET_BIT(huart->Instance->CR1, USART_CR1_IDLEIE);
+  if(rx->rto_bits != 0U)
+  {
+    SET_BIT(huart->Instance->CR1, USART_CR1_RTOIE);
+  }
+  if(huart->Init.Parity != UART_PARITY_NONE)
+  {
+    SET_BIT(huart->Instance->CR1, USART_CR1_PEIE);
+  }
+  SET_BIT(huart->Instance->CR3, USART_CR3_EIE | USART_CR3_DMAR);
+  return HAL_OK;
+}
+
+void uart_rx_stop(uart_rx_t *rx)
+{
+  UART_HandleTypeDef *huart = rx->huart;
+  uint32_t i;
+
+  CLEAR_BIT(huart->Instance->CR1, USART_CR1_IDLEIE | USART_CR1_RTOIE | USART_CR1_PEIE);
+  CLEAR_BIT(huart->Instance->CR3, USART_CR3_EIE | USART_CR3_DMAR);
+  /* Directly: HAL_UART_DisableReceiverTimeout() refuses while TX is busy */
+  CLEAR_BIT(huart->Instance->CR2, USART_CR2_RTOEN);
+  (void)HAL_DMA_Abort(huart->hdmarx);
+  huart->RxState = HAL_UART_STATE_READY;
+
+  for(i = 0U; i < UART_RX_MAX; i++)
+  {
+    if(uart_rx_active[i] == rx)
+    {
+      uart_rx_active[i] = NULL;
+    }
+  }
+}
+
+uint32_t uart_rx_peek(uart_rx_t *rx, uart_rx_span_t span[2])
+{
+  uint32_t head;
+  uint32_t tail = rx->tail;
+  uint32_t avail;
+  uint32_t offset;
+  uint32_t first;
+
+  /* head is up to half a ring behind the DMA between interrupts, a lap by
+     less than that would go unseen */
+  uart_rx_update(rx);
+  head = rx->head;
+  avail = head - tail;
+  if(avail > rx->size)
+  {
+    /* The DMA lapped us: what is left in the ring is being overwritten
+       right now, drop all of it and resync on the newest data */
+    rx->lost += avail;
+    rx->tail = head;
+    avail = 0U;
+  }
+
+  offset = tail & (rx->size - 1U);
+  first = rx->size - offset;
+  if(first > avail)
+  {
+    first = avail;
+  }
+  span[0].data = &rx->buf[offset];
+  span[0].len = first;
+  span[1].data = rx->buf;
+  span[1].len = avail - first;
+
+  /* The CPU never writes the ring, so this only drops stale lines */
+  if(span[0].len != 0U)
+  {
+    dma_cache_invalidate((void *)span[0].data, span[0].len);
+  }
+  if(span[1].len != 0U)
+  {
+    dma_cache_invalidate((void *)span[1].data, span[1].len);
+  }
+  return avail;
+}
+
+HAL_StatusTypeDef uart_rx_consume(uart_rx_t *rx, uint32_t len)
+{
+  uint32_t avail;
+
+  /* The spans are read in place while the DMA keeps writing: once it has
+     gone a ring past the tail, what they held was overwritten under the
+     caller */
+  uart_rx_update(rx);
+  avail = rx->head - rx->tail;
+  if(avail > rx->size)
+  {
+    rx->lost += avail;
+    rx->tail = rx->head;
+    return HAL_ERROR;
+  }
+
+  if(len > avail)
+  {
+    len = avail;
+  }
+  rx->tail += len;
+  return HAL_OK;
+}
+
+uint32_t uart_rx_read(uart_rx_t *rx, uint8_t *dst, uint32_t len)
+{
+  uart_rx_span_t span[2];
+  uint32_t done = 0U;
+  uint32_t n;
+  uint32_t i;
+
+  (void)uart_rx_peek(rx, span);
+  for(i = 0U; (i < 2U) && (done < len); i++)
+  {
+    n = span[i].len;
+    if(n > (len - done))
+    {
+      n = len - done;
+    }
+    memcpy(&dst[done], span[i].data, n);
+    done += n;
+  }
+  if(uart_rx_consume(rx, done) != HAL_OK)
+  {
+    return 0U;
+  }
+  return done;
+}
+
+void uart_rx_irq(uart_rx_t *rx)
+{
+  USART_TypeDef *uart = rx->huart->Instance;
+  uint32_t isr = uart->ISR;
+  uint32_t cr1 = uart->CR1;
+  uint32_t events = 0U;
+
+  if(((isr & USART_ISR_IDLE) != 0U) && ((cr1 & USART_CR1_IDLEIE) != 0U))
+  {
+    uart->ICR = USART_ICR_IDLECF;
+    events |= UART_RX_EVT_IDLE;
+  }
+  if(((isr & USART_ISR_RTOF) != 0U) && ((cr1 & USART_CR1_RTOIE) != 0U))
+  {
+    uart->ICR = USART_ICR_RTOCF;
+    events |= UART_RX_EVT_TIMEOUT;
+  }
+  /* Line errors are counted, the DMA keeps running: a bad byte is the
+     protocol's problem, stopping the stream would lose everything after it */
+  if((isr & UART_RX_LINE_ERRORS) != 0U)
+  {
+    rx->errors |= (((isr & USART_ISR_PE) != 0U) ? HAL_UART_ERROR_PE : 0U) |
+                  (((isr & USART_ISR_FE) != 0U) ? HAL_UART_ERROR_FE : 0U) |
+                  (((isr & USART_ISR_NE) != 0U) ? HAL_UART_ERROR_NE : 0U) |
+                  (((isr & USART_ISR_ORE) != 0U) ? HAL_UART_ERROR_ORE : 0U);
+    uart->ICR = USART_ICR_PECF | USART_ICR_FECF | USART_ICR_NECF | USART_ICR_ORECF;
+    events |= UART_RX_EVT_ERROR;
+  }
+
+  if(events != 0U)
+  {
+    uart_rx_event(rx, events);
+  }
+}
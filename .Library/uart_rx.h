@@ -0,0 +1,92 @@
+#ifndef __UART_RX_H
+#define __UART_RX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+
+/* Streaming UART receive: the DMA writes into a ring in circular mode and
+   never stops, the interrupts only publish how far it got. Data shows up
+   at every half/full ring (DMA HT/TC), when the line goes idle for one
+   frame (IDLE) and after a programmable silence (receiver timeout, RTO),
+   so variable length packets arrive without per-byte interrupts.
+
+   The interrupts are the only producer and one thread is the consumer:
+   head is only written with interrupts masked (the interrupts, and peek
+   and consume reading the DMA counter for an exact head), tail only by
+   the consumer, so the consumer takes no lock. Peek hands out the data
+   in place as at most two spans (the ring may wrap).
+
+     USARTx_IRQHandler:       uart_rx_irq(&rx); HAL_UART_IRQHandler(&huart);
+     DMAx_Streamy_IRQHandler: HAL_DMA_IRQHandler(huart.hdmarx);
+
+   The ring must be large enough that the DMA never laps the consumer and
+   that an HT/TC interrupt is served within half a ring of bytes. */
+
+/* Exported constants --------------------------------------------------------*/
+/* Events passed to the callback, several may be set at once */
+#define UART_RX_EVT_HALF        0x01U   /* DMA half transfer */
+#define UART_RX_EVT_WRAP        0x02U   /* DMA transfer complete, ring wrapped */
+#define UART_RX_EVT_IDLE        0x04U   /* line idle, end of a burst */
+#define UART_RX_EVT_TIMEOUT     0x08U   /* no start bit for rto_bits bit times */
+#define UART_RX_EVT_ERROR       0x10U   /* framing/noise/parity/overrun, see errors */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct uart_rx_s uart_rx_t;
+typedef void (*uart_rx_callback_t)(uart_rx_t *rx, uint32_t events);
+
+typedef struct
+{
+  const uint8_t *data;
+  uint32_t len;
+} uart_rx_span_t;
+
+struct uart_rx_s
+{
+  UART_HandleTypeDef *huart;
+  uint8_t *buf;                 /* DMA ring, size a power of two */
+  uint32_t size;
+  uint32_t rto_bits;            /* receiver timeout in bit times, 0 = IDLE only */
+  uart_rx_callback_t callback;  /* from interrupt context, may be NULL */
+  void *context;
+
+  volatile uint32_t head;       /* producer: bytes received, free running */
+  volatile uint32_t tail;       /* consumer: bytes consumed, free running */
+  uint32_t dma_pos;             /* last ring offset read from the DMA counter */
+
+  uint32_t errors;              /* line errors, HAL_UART_ERROR_xx bits seen */
+  uint32_t lost;                /* bytes the DMA overwrote before they were consumed */
+};
+
+/* Function definitions ------------------------------------------------------*/
+/* rx->huart (initialized, hdmarx linked, DMA in DMA_CIRCULAR byte mode),
+   buf, size and optionally rto_bits/callback/context must be set. buf should
+   come from dma_arena_alloc(); a cached buffer works too, peek invalidates
+   the spans it returns. HAL_ERROR for a bad ring size or a DMA not in
+   circular mode, HAL_BUSY if the UART is already receiving. */
+HAL_StatusTypeDef uart_rx_start(uart_rx_t *rx);
+void uart_rx_stop(uart_rx_t *rx);
+
+/* Consumer side. Peek returns the number of bytes available and fills
+   span[0] (and span[1] after a wrap); they stay valid until consumed
+   unless the DMA laps the consumer meanwhile. Consume then returns
+   HAL_ERROR: the spans were overwritten while in use, drop what was
+   parsed from them, the stream resumes at the newest data (lost). */
+uint32_t uart_rx_peek(uart_rx_t *rx, uart_rx_span_t span[2]);
+HAL_StatusTypeDef uart_rx_consume(uart_rx_t *rx, uint32_t len);
+/* Copy out up to len bytes, for callers that do not need zero-copy; 0 if
+   the copy was overwritten */
+uint32_t uart_rx_read(uart_rx_t *rx, uint8_t *dst, uint32_t len);
+
+/* IDLE/RTO/error part of the USART interrupt; clears what it handles so a
+   following HAL_UART_IRQHandler() only sees the transmit side */
+void uart_rx_irq(uart_rx_t *rx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,323 @@
+/* Header includes -----------------------------------------------------------*/
+#include "uart_tx.h"
+#include "dma_cache.h"
+#include <string.h>
+
+/* Private macro -------------------------------------------------------------*/
+/* Queues running at the same time, the DMA callbacks look them up here */
+#ifndef UART_TX_MAX
+#define UART_TX_MAX             4U
+#endif
+
+#define UART_TX_BURST_MAX       0xFFFFU   /* DMA NDTR limit */
+
+/* Private variables ---------------------------------------------------------*/
+static uart_tx_t *uart_tx_active[UART_TX_MAX];
+
+/* Private functions ---------------------------------------------------------*/
+static uart_tx_t *uart_tx_find(const DMA_HandleTypeDef *hdma)
+{
+  uint32_t i;
+
+  for(i = 0U; i < UART_TX_MAX; i++)
+  {
+    if((uart_tx_active[i] != NULL) && (uart_tx_active[i]->huart->hdmatx == hdma))
+    {
+      return uart_tx_active[i];
+    }
+  }
+  return NULL;
+}
+
+/* Start sending what is published if nothing is being sent, from the
+   writers and from the DMA completion. The transmitter is claimed with
+   interrupts masked by setting burst; the FIFO fill and the DMA setup run
+   with them enabled, a write landing meanwhile only queues. */
+static void uart_tx_kick(uart_tx_t *tx)
+{
+  USART_TypeDef *uart = tx->huart->Instance;
+  uint32_t mask = tx->size - 1U;
+  uint32_t pio = 1U;
+  uint32_t primask;
+  uint32_t avail;
+  uint32_t offset;
+  uint32_t len;
+  uint32_t sent;
+
+  for(;;)
+  {
+    primask = __get_PRIMASK();
+    __disable_irq();
+    avail = tx->head - tx->tail;
+    if((tx->burst != 0U) || (avail == 0U))
+    {
+      if(tx->burst == 0U)
+      {
+        tx->huart->gState = HAL_UART_STATE_READY;
+      }
+      __set_PRIMASK(primask);
+      return;
+    }
+    tx->huart->gState = HAL_UART_STATE_BUSY_TX;
+    if((pio == 0U) || (avail > UART_TX_PIO_MAX))
+    {
+      break;
+    }
+
+    /* Cheaper than a DMA setup: fill the FIFO, DMA only what does not fit
+       or what was published meanwhile */
+    tx->burst = avail;
+    __set_PRIMASK(primask);
+    sent = 0U;
+    while((sent < avail) && ((uart->ISR & USART_ISR_TXE_TXFNF) != 0U))
+    {
+      uart->TDR = tx->buf[(tx->tail + sent) & mask];
+      sent++;
+    }
+    __disable_irq();
+    tx->tail += sent;
+    tx->stats.bytes += sent;
+    if(sent == avail)
+    {
+      tx->stats.pio++;
+    }
+    tx->burst = 0U;
+    __set_PRIMASK(primask);
+    pio = 0U;
+  }
+
+  /* One burst up to the end of the ring, the rest follows from the ISR */
+  offset = tx->tail & mask;
+  len = tx->size - offset;
+  if(len > avail)
+  {
+    len = avail;
+  }
+  if(len > UART_TX_BURST_MAX)
+  {
+    len = UART_TX_BURST_MAX;
+  }
+  tx->burst = len;
+  tx->stats.bursts++;
+  if(len > tx->stats.max_burst)
+  {
+    tx->stats.max_burst = len;
+  }
+  __set_PRIMASK(primask);
+
+  dma_cache_clean(&tx->buf[offset], len);
+  if(HAL_DMA_Start_IT(tx->huart->hdmatx, (uint32_t)&tx->buf[offset], (uint32_t)&uart->TDR, len) != HAL_OK)
+  {
+    /* Stays queued, the next write retries */
+    __disable_irq();
+    tx->stats.bursts--;
+    tx->burst = 0U;
+    tx->huart->gState = HAL_UART_STATE_READY;
+    __set_PRIMASK(primask);
+  }
+}
+
+static void uart_tx_dma_cplt(DMA_HandleTypeDef *hdma)
+{
+  uart_tx_t *tx = uart_tx_find(hdma);
+  uint32_t primask;
+
+  if(tx == NULL)
+  {
+    return;
+  }
+  primask = __get_PRIMASK();
+  __disable_irq();
+  tx->tail += tx->burst;
+  tx->stats.bytes += tx->burst;
+  tx->burst = 0U;
+  __set_PRIMASK(primask);
+  uart_tx_kick(tx);
+}
+
+static void uart_tx_dma_error(DMA_HandleTypeDef *hdma)
+{
+  uart_tx_t *tx = uart_tx_find(hdma);
+  uint32_t primask;
+
+  if(tx == NULL)
+  {
+    return;
+  }
+  /* The burst is lost, carry on with the rest of the queue */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  tx->huart->ErrorCode |= HAL_UART_ERROR_DMA;
+  tx->tail += tx->burst;
+  tx->burst = 0U;
+  __set_PRIMASK(primask);
+  uart_tx_kick(tx);
+}
+
+/* Function definitions ------------------------------------------------------*/
+HAL_StatusTypeDef uart_tx_start(uart_tx_t *tx)
+{
+  UART_HandleTypeDef *huart = tx->huart;
+  DMA_HandleTypeDef *hdma = huart->hdmatx;
+  uint32_t slot = UART_TX_MAX;
+  uint32_t i;
+
+  if((hdma == NULL) || (hdma->Init.Mode == DMA_CIRCULAR) ||
+     (tx->size < 2U) || ((tx->size & (tx->size - 1U)) != 0U))
+  {
+    return HAL_ERROR;
+  }
+  if(huart->gState != HAL_UART_STATE_READY)
+  {
+    return HAL_BUSY;
+  }
+  for(i = 0U; i < UART_TX_MAX; i++)
+  {
+    if((uart_tx_active[i] == NULL) || (uart_tx_active[i] == tx))
+    {
+      slot = i;
+      break;
+    }
+  }
+  if(slot == UART_TX_MAX)
+  {
+    return HAL_ERROR;
+  }
+
+  if(IS_UART_FIFO_INSTANCE(huart->Instance))
+  {
+    if((HAL_UARTEx_EnableFifoMode(huart) != HAL_OK) ||
+       (HAL_UARTEx_SetTxFifoThreshold(huart, UART_TX_FIFO_THRESHOLD) != HAL_OK))
+    {
+      return HAL_ERROR;
+    }
+  }
+
+  tx->head = 0U;
+  tx->tail = 0U;
+  tx->reserved = 0U;
+  tx->writers = 0U;
+  tx->burst = 0U;
+  memset(&tx->stats, 0, sizeof(tx->stats));
+  hdma->XferCpltCallback = uart_tx_dma_cplt;
+  hdma->XferHalfCpltCallback = NULL;
+  hdma->XferErrorCallback = uart_tx_dma_error;
+  hdma->XferAbortCallback = NULL;
+  uart_tx_active[slot] = tx;
+
+  /* DMAT stays on, the stream enable alone starts and stops the requests */
+  SET_BIT(huart->Instance->CR3, USART_CR3_DMAT);
+  return HAL_OK;
+}
+
+void uart_tx_stop(uart_tx_t *tx)
+{
+  uint32_t primask;
+  uint32_t i;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  for(i = 0U; i < UART_TX_MAX; i++)
+  {
+    if(uart_tx_active[i] == tx)
+    {
+      uart_tx_active[i] = NULL;
+    }
+  }
+  tx->tail = tx->head;
+  tx->burst = 0U;
+  __set_PRIMASK(primask);
+
+  (void)HAL_DMA_Abort(tx->huart->hdmatx);
+  CLEAR_BIT(tx->huart->Instance->CR3, USART_CR3_DMAT);
+  tx->huart->gState = HAL_UART_STATE_READY;
+}
+
+HAL_StatusTypeDef uart_tx_write(uart_tx_t *tx, const void *data, uint32_t len)
+{
+  uart_tx_seg_t seg;
+
+  seg.data = data;
+  seg.len = len;
+  return uart_tx_writev(tx, &seg, 1U);
+}
+
+HAL_StatusTypeDef uart_tx_writev(uart_tx_t *tx, const uart_tx_seg_t *seg, uint32_t count)
+{
+  uint32_t mask = tx->size - 1U;
+  uint32_t total = 0U;
+  uint32_t primask;
+  uint32_t pos;
+  uint32_t offset;
+  uint32_t first;
+  uint32_t publish;
+  uint32_t i;
+
+  for(i = 0U; i < count; i++)
+  {
+    total += seg[i].len;
+  }
+
+  /* Reserve the room, then copy into it with interrupts enabled */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if(total > (tx->size - (tx->reserved - tx->tail)))
+  {
+    tx->stats.dropped++;
+    __set_PRIMASK(primask);
+    return HAL_BUSY;
+  }
+  pos = tx->reserved;
+  tx->reserved += total;
+  tx->writers++;
+  __set_PRIMASK(primask);
+
+  for(i = 0U; i < count; i++)
+  {
+    offset = pos & mask;
+    first = tx->size - offset;
+    if(first > seg[i].len)
+    {
+      first = seg[i].len;
+    }
+    memcpy(&tx->buf[offset], seg[i].data, first);
+    memcpy(tx->buf, (const uint8_t *)seg[i].data + first, seg[i].len - first);
+    pos += seg[i].len;
+  }
+
+  /* A write this one interrupted reserved before it and is not copied
+     yet: the last writer out publishes for all of them */
+  __disable_irq();
+  tx->writers--;
+  publish = (tx->writers == 0U) ? 1U : 0U;
+  if(publish != 0U)
+  {
+    tx->head = tx->reserved;
+  }
+  __set_PRIMASK(primask);
+  if(publish != 0U)
+  {
+    uart_tx_kick(tx);
+  }
+  return HAL_OK;
+}
+
+uint32_t uart_tx_pending(const uart_tx_t *tx)
+{
+  return tx->head - tx->tail;
+}
+
+HAL_StatusTypeDef uart_tx_flush(uart_tx_t *tx, uint32_t timeout)
+{
+  uint32_t tickstart = HAL_GetTick();
+
+  while((tx->head != tx->tail) ||
+        ((tx->huart->Instance->ISR & USART_ISR_TC) == 0U))
+  {
+    if((HAL_GetTick() - tickstart) > timeout)
+    {
+      return HAL_TIMEOUT;
+    }
+  }
+  return HAL_OK;
+}
@@ -0,0 +1,93 @@
+#ifndef __UART_TX_H
+#define __UART_TX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+
+/* Queued UART transmit. Writers copy their segments into a byte ring and
+   return at once; whatever is queued when the DMA goes idle leaves as one
+   burst (up to the end of the ring), and the next burst is started from
+   the DMA transfer complete interrupt. With the USART FIFO on, the DMA
+   only has to keep 16 bytes ahead of the shifter, so the restart between
+   bursts does not leave a gap on the line. Very short writes to an idle
+   queue go straight into the FIFO without a DMA setup.
+
+     DMAx_Streamy_IRQHandler: HAL_DMA_IRQHandler(huart.hdmatx);
+
+   Writes are all or nothing and may come from any context, including
+   interrupts. Interrupts are masked only to reserve room and to publish
+   it; the copy, the FIFO fill and the DMA setup run with them enabled.
+   The queue keeps the order of the reservations, so a write interrupted
+   by another holds the other's bytes back until its own copy is done.
+   Synchronous USART instances are driven through a UART handle like any
+   other. */
+
+/* Exported constants --------------------------------------------------------*/
+/* Writes of at most this many bytes to an idle queue skip the DMA and
+   fill the FIFO directly */
+#ifndef UART_TX_PIO_MAX
+#define UART_TX_PIO_MAX         8U
+#endif
+
+/* TXFIFO threshold, for the HAL interrupt-driven transmit path */
+#ifndef UART_TX_FIFO_THRESHOLD
+#define UART_TX_FIFO_THRESHOLD  UART_TXFIFO_THRESHOLD_1_8
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  const void *data;
+  uint32_t len;
+} uart_tx_seg_t;
+
+typedef struct
+{
+  uint32_t bytes;               /* bytes handed to the UART */
+  uint32_t bursts;              /* DMA transfers started */
+  uint32_t pio;                 /* writes sent without DMA */
+  uint32_t max_burst;
+  uint32_t dropped;             /* writes refused for lack of room */
+} uart_tx_stats_t;
+
+typedef struct
+{
+  UART_HandleTypeDef *huart;
+  uint8_t *buf;                 /* ring, size a power of two */
+  uint32_t size;
+
+  volatile uint32_t head;       /* bytes published, free running */
+  volatile uint32_t tail;       /* bytes sent, free running */
+  volatile uint32_t reserved;   /* bytes claimed by writers, head once copied */
+  volatile uint32_t writers;    /* writes copying into the ring */
+  volatile uint32_t burst;      /* bytes in the running DMA transfer, 0 = idle */
+  uart_tx_stats_t stats;
+} uart_tx_t;
+
+/* Function definitions ------------------------------------------------------*/
+/* tx->huart (initialized, hdmatx linked, DMA in normal byte mode), buf and
+   size must be set. buf is best taken from dma_arena_alloc(); a cached
+   buffer is cleaned before every burst. Turns the FIFO on where the
+   instance has one. */
+HAL_StatusTypeDef uart_tx_start(uart_tx_t *tx);
+void uart_tx_stop(uart_tx_t *tx);
+
+/* Queue one or more segments as one unit: HAL_BUSY without queuing any of
+   them if they do not fit */
+HAL_StatusTypeDef uart_tx_write(uart_tx_t *tx, const void *data, uint32_t len);
+HAL_StatusTypeDef uart_tx_writev(uart_tx_t *tx, const uart_tx_seg_t *seg, uint32_t count);
+
+/* Bytes queued and not yet handed to the UART */
+uint32_t uart_tx_pending(const uart_tx_t *tx);
+/* Wait until the queue is empty and the last bit is on the line */
+HAL_StatusTypeDef uart_tx_flush(uart_tx_t *tx, uint32_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
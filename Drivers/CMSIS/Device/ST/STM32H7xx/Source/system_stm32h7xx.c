@@ -83,6 +83,12 @@
 /*!< Uncomment the following line if you need to relocate your vector Table in
      Internal SRAM. */
 /* #define VECT_TAB_SRAM */
+/*!< Define VECT_TAB_QSPI (project option) for an application that executes in
+     place from the memory-mapped QSPI flash and is started by the loader in
+     .Library/qspi_boot.c. The loader has already set up the clocks and QSPI,
+     so the RCC reset and SetSystemClock() are skipped: the code would
+     otherwise pull the clock from under its own instruction fetches. */
+/* #define VECT_TAB_QSPI */
 #define VECT_TAB_OFFSET  0x00000000UL /*!< Vector Table base offset field.
                                       This value must be a multiple of 0x200. */
 /******************************************************************************/
@@ -148,6 +154,7 @@ void SystemInit(void)
         #if (__FPU_PRESENT == 1) && (__FPU_USED == 1)
           SCB->CPACR |= ((3UL << (10*2))|(3UL << (11*2)));  /* set CP10 and CP11 Full Access */
         #endif
+      #if !defined(VECT_TAB_QSPI)
         /* Reset the RCC clock configuration to the default reset state ------------*/
 
          /* Increasing the CPU frequency */
@@ -219,6 +226,7 @@ void SystemInit(void)
 
         /* Disable all interrupts */
         RCC->CIER = 0x00000000;
+      #endif /* !VECT_TAB_QSPI */
 
       #if (STM32H7_DEV_ID == 0x450UL)
         /* dual core CM7 or single core line */
@@ -262,7 +270,9 @@ void SystemInit(void)
         FMC_Bank1_R->BTCR[0] = 0x000030D2;
 
         /* Configure the Vector Table location add offset address for cortex-M7 ------------------*/
-      #ifdef VECT_TAB_SRAM
+      #if defined(VECT_TAB_QSPI)
+        SCB->VTOR = QSPI_BASE | VECT_TAB_OFFSET; /* Vector Table in the memory-mapped QSPI flash */
+      #elif defined(VECT_TAB_SRAM)
         SCB->VTOR = D1_AXISRAM_BASE  | VECT_TAB_OFFSET; /* Vector Table Relocation in Internal AXI-RAM */
       #else
         SCB->VTOR = FLASH_BANK1_BASE | VECT_TAB_OFFSET; /* Vector Table Relocation in Internal FLASH */
@@ -270,7 +280,11 @@ void SystemInit(void)
 
       #endif /*DUAL_CORE && CORE_CM4*/
       /*Set value for register configure SystemCoreClock--------------------------------------------*/  
+      #if defined(VECT_TAB_QSPI)
+       SystemCoreClockUpdate();
+      #else
        SetSystemClock();
+      #endif
   
 }
 
@@ -407,6 +421,11 @@ void SystemCoreClockUpdate (void)
       #else
         SystemCoreClock = common_system_clock;
       #endif /* DUAL_CORE && CORE_CM4 */
+
+#if defined(USE_HAL_DRIVER) && defined(HAL_RCC_MODULE_ENABLED)
+  /* Clock tree may have been changed behind the HAL, drop its cached frequencies */
+  HAL_RCC_ClockCacheInvalidate();
+#endif /* USE_HAL_DRIVER && HAL_RCC_MODULE_ENABLED */
 }
 
 void SetSystemClock(){
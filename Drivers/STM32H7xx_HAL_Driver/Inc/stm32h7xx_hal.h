@@ -1050,6 +1050,10 @@ uint32_t HAL_GetDEVID(void);
 uint32_t HAL_GetUIDw0(void);
 uint32_t HAL_GetUIDw1(void);
 uint32_t HAL_GetUIDw2(void);
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+void HAL_DMA_CacheClean(const void *addr, uint32_t len);
+void HAL_DMA_CacheInvalidate(void *addr, uint32_t len);
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
 #if defined(SYSCFG_PMCR_EPIS_SEL)
 void HAL_SYSCFG_ETHInterfaceSelect(uint32_t SYSCFG_ETHInterface);
 #endif /* SYSCFG_PMCR_EPIS_SEL */
@@ -168,6 +168,7 @@
 #define  USE_RTOS                     0
 #define  USE_SD_TRANSCEIVER           1U               /*!< use uSD Transceiver */
 #define  USE_SPI_CRC                  1U               /*!< use CRC in SPI */
+#define  USE_HAL_DMA_CACHE_MAINTENANCE 0U               /*!< clean/invalidate DMA buffers in SPI, UART, SD and ETH */
 
 #define  USE_HAL_ADC_REGISTER_CALLBACKS     0U /* ADC register callback disabled     */
 #define  USE_HAL_CEC_REGISTER_CALLBACKS     0U /* CEC register callback disabled     */
@@ -417,6 +417,48 @@ __weak void HAL_Delay(uint32_t Delay)
   }
 }
 
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+/**
+  * @brief Write the dirty D-cache lines of a DMA buffer back to memory.
+  * @note Called by the SPI, UART, SD and ETH drivers before a transfer reads
+  *       the buffer. The default covers the whole 32-byte lines the range
+  *       touches; it is declared as __weak to be overwritten in user file,
+  *       e.g. by one that skips memory the core does not cache.
+  * @param addr start of the buffer
+  * @param len  buffer length in bytes
+  * @retval None
+  */
+__weak void HAL_DMA_CacheClean(const void *addr, uint32_t len)
+{
+  uint32_t start = (uint32_t)addr & ~31U;
+
+  if ((len != 0U) && ((SCB->CCR & SCB_CCR_DC_Msk) != 0U))
+  {
+    SCB_CleanDCache_by_Addr((uint32_t *)start, (int32_t)(((uint32_t)addr + len) - start));
+  }
+}
+
+/**
+  * @brief Drop the D-cache lines of a DMA buffer.
+  * @note Called by the SPI, UART, SD and ETH drivers before a transfer writes
+  *       the buffer and again on its completion. The default cleans before it
+  *       invalidates so data sharing the first or last line survives; it is
+  *       declared as __weak to be overwritten in user file.
+  * @param addr start of the buffer
+  * @param len  buffer length in bytes
+  * @retval None
+  */
+__weak void HAL_DMA_CacheInvalidate(void *addr, uint32_t len)
+{
+  uint32_t start = (uint32_t)addr & ~31U;
+
+  if ((len != 0U) && ((SCB->CCR & SCB_CCR_DC_Msk) != 0U))
+  {
+    SCB_CleanInvalidateDCache_by_Addr((uint32_t *)start, (int32_t)(((uint32_t)addr + len) - start));
+  }
+}
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
 /**
   * @brief Suspend Tick increment.
   * @note In the default implementation , SysTick timer is the source of time base. It is
@@ -717,6 +717,15 @@ HAL_StatusTypeDef HAL_ETH_DescAssignMemory(ETH_HandleTypeDef *heth, uint32_t Ind
     /* set buffer 2 address valid bit to RDES3 */
     SET_BIT(dmarxdesc->DESC3, ETH_DMARXNDESCRF_BUF2V);
   }
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+  /* Drop cached lines of the buffers before the DMA owns them */
+  HAL_DMA_CacheInvalidate(pBuffer1, heth->Init.RxBuffLen);
+  if(pBuffer2 != NULL)
+  {
+    HAL_DMA_CacheInvalidate(pBuffer2, heth->Init.RxBuffLen);
+  }
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
   /* set OWN bit to RDES3 */
   SET_BIT(dmarxdesc->DESC3, ETH_DMARXNDESCRF_OWN);
 
@@ -1211,6 +1220,9 @@ HAL_StatusTypeDef HAL_ETH_GetRxDataBuffer(ETH_HandleTypeDef *heth, ETH_BufferTyp
   uint32_t index, accumulatedlen = 0, lastdesclen;
   __IO const ETH_DMADescTypeDef *dmarxdesc = (ETH_DMADescTypeDef *)dmarxdesclist->RxDesc[descidx];
   ETH_BufferTypeDef *rxbuff = RxBuffer;
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+  ETH_BufferTypeDef *lastbuff;
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
 
   if(rxbuff == NULL)
   {
@@ -1291,6 +1303,16 @@ HAL_StatusTypeDef HAL_ETH_GetRxDataBuffer(ETH_HandleTypeDef *heth, ETH_BufferTyp
     return HAL_ERROR;
   }
 
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+  /* Lines speculatively refilled during reception are stale */
+  lastbuff = rxbuff;
+  for(rxbuff = RxBuffer; rxbuff != lastbuff; rxbuff = rxbuff->next)
+  {
+    HAL_DMA_CacheInvalidate(rxbuff->buffer, rxbuff->len);
+  }
+  HAL_DMA_CacheInvalidate(lastbuff->buffer, lastbuff->len);
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
   return HAL_OK;
 }
 
@@ -1428,6 +1450,15 @@ HAL_StatusTypeDef HAL_ETH_BuildRxDescriptors(ETH_HandleTypeDef *heth)
 
   for(descscan =0; descscan < totalappdescnbr; descscan++)
   {
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+    /* Drop cached lines of the buffers before the DMA owns them again */
+    HAL_DMA_CacheInvalidate((uint8_t *)dmarxdesc->BackupAddr0, heth->Init.RxBuffLen);
+    if (READ_REG(dmarxdesc->BackupAddr1) != 0U)
+    {
+      HAL_DMA_CacheInvalidate((uint8_t *)dmarxdesc->BackupAddr1, heth->Init.RxBuffLen);
+    }
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
     WRITE_REG(dmarxdesc->DESC0, dmarxdesc->BackupAddr0);
     WRITE_REG(dmarxdesc->DESC3, ETH_DMARXNDESCRF_BUF1V);
 
@@ -2741,6 +2772,15 @@ static uint32_t ETH_Prepare_Tx_Descriptors(ETH_HandleTypeDef *heth, ETH_TxPacket
 
   ETH_BufferTypeDef  *txbuffer = pTxConfig->TxBuffer;
 
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+  /* Write the frame buffers back to memory */
+  for(; txbuffer != NULL; txbuffer = txbuffer->next)
+  {
+    HAL_DMA_CacheClean(txbuffer->buffer, txbuffer->len);
+  }
+  txbuffer = pTxConfig->TxBuffer;
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
   /* Current Tx Descriptor Owned by DMA: cannot be used by the application  */
   if(READ_BIT(dmatxdesc->DESC3, ETH_DMATXNDESCWBF_OWN) == ETH_DMATXNDESCWBF_OWN)
   {
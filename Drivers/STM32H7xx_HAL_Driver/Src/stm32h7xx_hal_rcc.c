@@ -100,11 +100,29 @@
 /** @defgroup RCC_Private_Variables RCC Private Variables
   * @{
   */
+/* Clock tree cache: rebuilt once after each HAL_RCC_ClockCacheInvalidate().
+   Read and written with interrupts masked, so a getter in an interrupt
+   handler never sees the generation of one update with the clocks of
+   another. */
+typedef struct
+{
+  uint32_t SysClock;
+  uint32_t CoreClock;
+  uint32_t HCLK;
+  uint32_t PCLK1;
+  uint32_t PCLK2;
+} RCC_ClockCacheTypeDef;
+
+static uint32_t RCC_ClockGeneration = 1U;       /* bumped on every invalidation */
+static uint32_t RCC_ClockCacheGeneration = 0U;  /* generation the cache holds */
+static RCC_ClockCacheTypeDef RCC_ClockCache;
 
 /**
   * @}
   */
 /* Private function prototypes -----------------------------------------------*/
+static uint32_t RCC_ComputeSysClockFreq(void);
+static void RCC_ClockCacheGet(RCC_ClockCacheTypeDef *clocks);
 /* Exported functions --------------------------------------------------------*/
 
 /** @defgroup RCC_Exported_Functions RCC Exported Functions
@@ -191,6 +209,8 @@ HAL_StatusTypeDef HAL_RCC_DeInit(void)
 {
   uint32_t tickstart;
 
+  HAL_RCC_ClockCacheInvalidate();
+
         /* Increasing the CPU frequency */
   if(FLASH_LATENCY_DEFAULT  > __HAL_FLASH_GET_LATENCY())
   {
@@ -382,6 +402,8 @@ HAL_StatusTypeDef HAL_RCC_DeInit(void)
 
 }
 
+  HAL_RCC_ClockCacheInvalidate();
+
   return HAL_OK;
 }
 
@@ -410,6 +432,9 @@ __weak HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef  *RCC_OscInitStruc
     return HAL_ERROR;
   }
 
+  /* PLL or oscillator settings may change below */
+  HAL_RCC_ClockCacheInvalidate();
+
   /* Check the parameters */
   assert_param(IS_RCC_OSCILLATORTYPE(RCC_OscInitStruct->OscillatorType));
   /*------------------------------- HSE Configuration ------------------------*/
@@ -850,6 +875,9 @@ __weak HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef  *RCC_OscInitStruc
       }
     }
   }
+
+  HAL_RCC_ClockCacheInvalidate();
+
   return HAL_OK;
 }
 
@@ -891,6 +919,8 @@ HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef  *RCC_ClkInitStruct, ui
     return HAL_ERROR;
   }
 
+  HAL_RCC_ClockCacheInvalidate();
+
   /* Check the parameters */
   assert_param(IS_RCC_CLOCKTYPE(RCC_ClkInitStruct->ClockType));
   assert_param(IS_FLASH_LATENCY(FLatency));
@@ -1174,6 +1204,9 @@ HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef  *RCC_ClkInitStruct, ui
 #endif
  }
 
+  /* New clock tree is in place, drop values cached while switching */
+  HAL_RCC_ClockCacheInvalidate();
+
   /* Update the SystemCoreClock global variable */
 #if defined(RCC_D1CFGR_D1CPRE)
   common_system_clock = HAL_RCC_GetSysClockFreq() >> ((D1CorePrescTable[(RCC->D1CFGR & RCC_D1CFGR_D1CPRE)>> RCC_D1CFGR_D1CPRE_Pos]) & 0x1FU);
@@ -1343,9 +1376,23 @@ void HAL_RCC_DisableCSS(void)
   *         right SYSCLK value. Otherwise, any configuration based on this function will be incorrect.
   *
   *
+  * @note   The value is served from the clock tree cache, see HAL_RCC_ClockCacheInvalidate().
+  *
   * @retval SYSCLK frequency
   */
 uint32_t HAL_RCC_GetSysClockFreq(void)
+{
+  RCC_ClockCacheTypeDef clocks;
+
+  RCC_ClockCacheGet(&clocks);
+  return clocks.SysClock;
+}
+
+/**
+  * @brief  Computes the SYSCLK frequency from the RCC registers.
+  * @retval SYSCLK frequency
+  */
+static uint32_t RCC_ComputeSysClockFreq(void)
 {
   uint32_t pllp, pllsource, pllm, pllfracen, hsivalue;
   float_t fracn1, pllvco;
@@ -1444,27 +1491,14 @@ uint32_t HAL_RCC_GetSysClockFreq(void)
   */
 uint32_t HAL_RCC_GetHCLKFreq(void)
 {
-uint32_t common_system_clock;
+  RCC_ClockCacheTypeDef clocks;
 
-#if defined(RCC_D1CFGR_D1CPRE)
-  common_system_clock = HAL_RCC_GetSysClockFreq() >> (D1CorePrescTable[(RCC->D1CFGR & RCC_D1CFGR_D1CPRE)>> RCC_D1CFGR_D1CPRE_Pos] & 0x1FU);
-#else
-  common_system_clock = HAL_RCC_GetSysClockFreq() >> (D1CorePrescTable[(RCC->CDCFGR1 & RCC_CDCFGR1_CDCPRE)>> RCC_CDCFGR1_CDCPRE_Pos] & 0x1FU);
-#endif
+  RCC_ClockCacheGet(&clocks);
 
-#if defined(RCC_D1CFGR_HPRE)
-  SystemD2Clock = (common_system_clock >> ((D1CorePrescTable[(RCC->D1CFGR & RCC_D1CFGR_HPRE)>> RCC_D1CFGR_HPRE_Pos]) & 0x1FU));
-#else
-  SystemD2Clock = (common_system_clock >> ((D1CorePrescTable[(RCC->CDCFGR1 & RCC_CDCFGR1_HPRE)>> RCC_CDCFGR1_HPRE_Pos]) & 0x1FU));
-#endif
+  SystemD2Clock = clocks.HCLK;
+  SystemCoreClock = clocks.CoreClock;
 
-#if defined(DUAL_CORE) && defined(CORE_CM4)
-  SystemCoreClock = SystemD2Clock;
-#else
-  SystemCoreClock = common_system_clock;
-#endif /* DUAL_CORE && CORE_CM4 */
-
-  return SystemD2Clock;
+  return clocks.HCLK;
 }
 
 
@@ -1476,13 +1510,10 @@ uint32_t common_system_clock;
   */
 uint32_t HAL_RCC_GetPCLK1Freq(void)
 {
-#if defined (RCC_D2CFGR_D2PPRE1)
-  /* Get HCLK source and Compute PCLK1 frequency ---------------------------*/
-  return (HAL_RCC_GetHCLKFreq() >> ((D1CorePrescTable[(RCC->D2CFGR & RCC_D2CFGR_D2PPRE1)>> RCC_D2CFGR_D2PPRE1_Pos]) & 0x1FU));
-#else
- /* Get HCLK source and Compute PCLK1 frequency ---------------------------*/
-  return (HAL_RCC_GetHCLKFreq() >> ((D1CorePrescTable[(RCC->CDCFGR2 & RCC_CDCFGR2_CDPPRE1)>> RCC_CDCFGR2_CDPPRE1_Pos]) & 0x1FU));
-#endif
+  RCC_ClockCacheTypeDef clocks;
+
+  RCC_ClockCacheGet(&clocks);
+  return clocks.PCLK1;
 }
 
 
@@ -1494,12 +1525,98 @@ uint32_t HAL_RCC_GetPCLK1Freq(void)
   */
 uint32_t HAL_RCC_GetPCLK2Freq(void)
 {
-  /* Get HCLK source and Compute PCLK1 frequency ---------------------------*/
+  RCC_ClockCacheTypeDef clocks;
+
+  RCC_ClockCacheGet(&clocks);
+  return clocks.PCLK2;
+}
+
+/**
+  * @brief  Marks the clock tree cache stale.
+  * @note   SYSCLK, HCLK and PCLKx getters (and HAL_RCCEx_GetPeriphCLKFreq())
+  *         serve cached values that are recomputed once on the next query
+  *         after this call. HAL_RCC_OscConfig(), HAL_RCC_ClockConfig(),
+  *         HAL_RCC_DeInit(), HAL_RCCEx_PeriphCLKConfig() and
+  *         SystemCoreClockUpdate() call it; code writing the RCC clock
+  *         registers directly must call it too.
+  * @retval None
+  */
+void HAL_RCC_ClockCacheInvalidate(void)
+{
+  RCC_ClockGeneration++;
+}
+
+/**
+  * @brief  Returns the clock tree generation, changed by every
+  *         HAL_RCC_ClockCacheInvalidate() call.
+  * @retval Generation counter
+  */
+uint32_t HAL_RCC_GetClockGeneration(void)
+{
+  return RCC_ClockGeneration;
+}
+
+/**
+  * @brief  Returns the cached clock frequencies, recomputed from the RCC
+  *         registers if the cache is stale.
+  * @param  clocks: the SYSCLK, core, HCLK and PCLK1/2 frequencies
+  * @retval None
+  */
+static void RCC_ClockCacheGet(RCC_ClockCacheTypeDef *clocks)
+{
+  uint32_t generation = RCC_ClockGeneration;
+  uint32_t primask = __get_PRIMASK();
+  uint32_t common_system_clock;
+
+  __disable_irq();
+  if(RCC_ClockCacheGeneration == generation)
+  {
+    *clocks = RCC_ClockCache;
+    __set_PRIMASK(primask);
+    return;
+  }
+  __set_PRIMASK(primask);
+
+  clocks->SysClock = RCC_ComputeSysClockFreq();
+
+#if defined(RCC_D1CFGR_D1CPRE)
+  common_system_clock = clocks->SysClock >> (D1CorePrescTable[(RCC->D1CFGR & RCC_D1CFGR_D1CPRE)>> RCC_D1CFGR_D1CPRE_Pos] & 0x1FU);
+#else
+  common_system_clock = clocks->SysClock >> (D1CorePrescTable[(RCC->CDCFGR1 & RCC_CDCFGR1_CDCPRE)>> RCC_CDCFGR1_CDCPRE_Pos] & 0x1FU);
+#endif
+
+#if defined(RCC_D1CFGR_HPRE)
+  clocks->HCLK = (common_system_clock >> ((D1CorePrescTable[(RCC->D1CFGR & RCC_D1CFGR_HPRE)>> RCC_D1CFGR_HPRE_Pos]) & 0x1FU));
+#else
+  clocks->HCLK = (common_system_clock >> ((D1CorePrescTable[(RCC->CDCFGR1 & RCC_CDCFGR1_HPRE)>> RCC_CDCFGR1_HPRE_Pos]) & 0x1FU));
+#endif
+
+#if defined(DUAL_CORE) && defined(CORE_CM4)
+  clocks->CoreClock = clocks->HCLK;
+#else
+  clocks->CoreClock = common_system_clock;
+#endif /* DUAL_CORE && CORE_CM4 */
+
+#if defined (RCC_D2CFGR_D2PPRE1)
+  clocks->PCLK1 = (clocks->HCLK >> ((D1CorePrescTable[(RCC->D2CFGR & RCC_D2CFGR_D2PPRE1)>> RCC_D2CFGR_D2PPRE1_Pos]) & 0x1FU));
+#else
+  clocks->PCLK1 = (clocks->HCLK >> ((D1CorePrescTable[(RCC->CDCFGR2 & RCC_CDCFGR2_CDPPRE1)>> RCC_CDCFGR2_CDPPRE1_Pos]) & 0x1FU));
+#endif
+
 #if defined(RCC_D2CFGR_D2PPRE2)
-  return (HAL_RCC_GetHCLKFreq() >> ((D1CorePrescTable[(RCC->D2CFGR & RCC_D2CFGR_D2PPRE2)>> RCC_D2CFGR_D2PPRE2_Pos]) & 0x1FU));
+  clocks->PCLK2 = (clocks->HCLK >> ((D1CorePrescTable[(RCC->D2CFGR & RCC_D2CFGR_D2PPRE2)>> RCC_D2CFGR_D2PPRE2_Pos]) & 0x1FU));
 #else
-  return (HAL_RCC_GetHCLKFreq() >> ((D1CorePrescTable[(RCC->CDCFGR2 & RCC_CDCFGR2_CDPPRE2)>> RCC_CDCFGR2_CDPPRE2_Pos]) & 0x1FU));
+  clocks->PCLK2 = (clocks->HCLK >> ((D1CorePrescTable[(RCC->CDCFGR2 & RCC_CDCFGR2_CDPPRE2)>> RCC_CDCFGR2_CDPPRE2_Pos]) & 0x1FU));
 #endif
+
+  /* Only valid if no invalidation happened while computing */
+  __disable_irq();
+  if(RCC_ClockGeneration == generation)
+  {
+    RCC_ClockCache = *clocks;
+    RCC_ClockCacheGeneration = generation;
+  }
+  __set_PRIMASK(primask);
 }
 
 /**
@@ -46,6 +46,10 @@
 #define DIVIDER_P_UPDATE          0U
 #define DIVIDER_Q_UPDATE          1U
 #define DIVIDER_R_UPDATE          2U
+
+/* One slot for each kernel clock RCCEx_ComputePeriphCLKFreq() handles,
+   see RCCEx_PeriphClkCacheSlot() */
+#define PERIPHCLK_CACHE_SIZE      11U
 /**
   * @}
   */
@@ -59,9 +63,33 @@
   */
 
 /* Private variables ---------------------------------------------------------*/
+/* Kernel clock cache, a slot valid while its generation matches
+   HAL_RCC_GetClockGeneration() */
+static uint32_t RCCEx_PeriphClkCacheGeneration[PERIPHCLK_CACHE_SIZE];
+static uint32_t RCCEx_PeriphClkCacheFreq[PERIPHCLK_CACHE_SIZE];
+
+/* PLL outputs and D1/D3 APB clocks, same generation rule (0 is never a
+   generation). The baud rate paths of the UART/USART drivers read these
+   on every HAL_xxx_Init(). */
+static uint32_t RCCEx_PLL1CacheGeneration = 0U;
+static PLL1_ClocksTypeDef RCCEx_PLL1Cache;
+static uint32_t RCCEx_PLL2CacheGeneration = 0U;
+static PLL2_ClocksTypeDef RCCEx_PLL2Cache;
+static uint32_t RCCEx_PLL3CacheGeneration = 0U;
+static PLL3_ClocksTypeDef RCCEx_PLL3Cache;
+static uint32_t RCCEx_D1PCLK1CacheGeneration = 0U;
+static uint32_t RCCEx_D1PCLK1Cache;
+static uint32_t RCCEx_D3PCLK1CacheGeneration = 0U;
+static uint32_t RCCEx_D3PCLK1Cache;
+
 /* Private function prototypes -----------------------------------------------*/
 static HAL_StatusTypeDef RCCEx_PLL2_Config(RCC_PLL2InitTypeDef *pll2, uint32_t Divider);
 static HAL_StatusTypeDef RCCEx_PLL3_Config(RCC_PLL3InitTypeDef *pll3, uint32_t Divider);
+static uint32_t RCCEx_PeriphClkCacheSlot(uint32_t PeriphClk);
+static uint32_t RCCEx_ComputePeriphCLKFreq(uint32_t PeriphClk);
+static void RCCEx_ComputePLL1ClockFreq(PLL1_ClocksTypeDef* PLL1_Clocks);
+static void RCCEx_ComputePLL2ClockFreq(PLL2_ClocksTypeDef* PLL2_Clocks);
+static void RCCEx_ComputePLL3ClockFreq(PLL3_ClocksTypeDef* PLL3_Clocks);
 
 /* Exported functions --------------------------------------------------------*/
 /** @defgroup RCCEx_Exported_Functions RCCEx Exported Functions
@@ -111,6 +139,9 @@ HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef  *PeriphClk
   HAL_StatusTypeDef ret = HAL_OK;      /* Intermediate status */
   HAL_StatusTypeDef status = HAL_OK;   /* Final status */
 
+  /* Kernel clock muxes and PLL2/PLL3 may change below */
+  HAL_RCC_ClockCacheInvalidate();
+
   /*---------------------------- SPDIFRX configuration -------------------------------*/
 
   if(((PeriphClkInit->PeriphClockSelection) & RCC_PERIPHCLK_SPDIFRX) == RCC_PERIPHCLK_SPDIFRX)
@@ -1566,6 +1597,8 @@ HAL_StatusTypeDef HAL_RCCEx_PeriphCLKConfig(RCC_PeriphCLKInitTypeDef  *PeriphClk
     __HAL_RCC_CLKP_CONFIG(PeriphClkInit->CkperClockSelection);
   }
 
+  HAL_RCC_ClockCacheInvalidate();
+
   if (status == HAL_OK)
   {
     return HAL_OK;
@@ -1768,12 +1801,91 @@ PeriphClkInit->PeriphClockSelection |= RCC_PERIPHCLK_I2C123;
   *            @arg RCC_PERIPHCLK_SPI123: SPI1/2/3 peripheral clock
   *            @arg RCC_PERIPHCLK_ADC   : ADC peripheral clock
   *            @arg RCC_PERIPHCLK_SDMMC : SDMMC peripheral clock
+  *            @arg RCC_PERIPHCLK_QSPI  : QSPI peripheral clock
   *            @arg RCC_PERIPHCLK_SPI6  : SPI6 peripheral clock
   * @retval Frequency in KHz
   *
   *  (*) : Available on some STM32H7 lines only.
+  * @note   Results are cached until the next HAL_RCC_ClockCacheInvalidate(),
+  *         each kernel clock listed above in a slot of its own; other
+  *         identifiers return 0 and are not cached. The cache is looked up
+  *         and filled with interrupts masked, so this may also be called
+  *         from interrupt handlers.
   */
 uint32_t HAL_RCCEx_GetPeriphCLKFreq(uint32_t PeriphClk)
+{
+  uint32_t generation = HAL_RCC_GetClockGeneration();
+  uint32_t slot = RCCEx_PeriphClkCacheSlot(PeriphClk);
+  uint32_t primask = __get_PRIMASK();
+  uint32_t frequency;
+
+  if(slot == PERIPHCLK_CACHE_SIZE)
+  {
+    return 0U;
+  }
+
+  __disable_irq();
+  frequency = RCCEx_PeriphClkCacheFreq[slot];
+  if(RCCEx_PeriphClkCacheGeneration[slot] == generation)
+  {
+    __set_PRIMASK(primask);
+    return frequency;
+  }
+  __set_PRIMASK(primask);
+
+  frequency = RCCEx_ComputePeriphCLKFreq(PeriphClk);
+
+  /* Not if an invalidation came in meanwhile */
+  __disable_irq();
+  if(HAL_RCC_GetClockGeneration() == generation)
+  {
+    RCCEx_PeriphClkCacheFreq[slot] = frequency;
+    RCCEx_PeriphClkCacheGeneration[slot] = generation;
+  }
+  __set_PRIMASK(primask);
+
+  return frequency;
+}
+
+/**
+  * @brief  Returns the cache slot of a kernel clock identifier.
+  * @param  PeriphClk: Peripheral clock identifier, see HAL_RCCEx_GetPeriphCLKFreq()
+  * @retval Slot, PERIPHCLK_CACHE_SIZE if RCCEx_ComputePeriphCLKFreq() does
+  *         not handle the identifier
+  */
+static uint32_t RCCEx_PeriphClkCacheSlot(uint32_t PeriphClk)
+{
+  switch(PeriphClk)
+  {
+    case RCC_PERIPHCLK_SAI1:   return 0U;
+#if defined(SAI3)
+    case RCC_PERIPHCLK_SAI23:  return 1U;
+#endif /* SAI3 */
+#if defined(RCC_CDCCIP1R_SAI2ASEL)
+    case RCC_PERIPHCLK_SAI2A:  return 2U;
+#endif /* RCC_CDCCIP1R_SAI2ASEL */
+#if defined(RCC_CDCCIP1R_SAI2BSEL_0)
+    case RCC_PERIPHCLK_SAI2B:  return 3U;
+#endif /* RCC_CDCCIP1R_SAI2BSEL_0 */
+#if defined(SAI4)
+    case RCC_PERIPHCLK_SAI4A:  return 4U;
+    case RCC_PERIPHCLK_SAI4B:  return 5U;
+#endif /* SAI4 */
+    case RCC_PERIPHCLK_SPI123: return 6U;
+    case RCC_PERIPHCLK_ADC:    return 7U;
+    case RCC_PERIPHCLK_SDMMC:  return 8U;
+    case RCC_PERIPHCLK_QSPI:   return 9U;
+    case RCC_PERIPHCLK_SPI6:   return 10U;
+    default:                   return PERIPHCLK_CACHE_SIZE;
+  }
+}
+
+/**
+  * @brief  Computes the peripheral kernel clock frequency from the RCC registers.
+  * @param  PeriphClk: Peripheral clock identifier, see HAL_RCCEx_GetPeriphCLKFreq()
+  * @retval Frequency in Hz
+  */
+static uint32_t RCCEx_ComputePeriphCLKFreq(uint32_t PeriphClk)
 {
   PLL1_ClocksTypeDef pll1_clocks;
   PLL2_ClocksTypeDef pll2_clocks;
@@ -2379,6 +2491,68 @@ uint32_t HAL_RCCEx_GetPeriphCLKFreq(uint32_t PeriphClk)
           break;
         }
 
+      default :
+        {
+          frequency = 0;
+          break;
+        }
+      }
+    }
+  else if (PeriphClk == RCC_PERIPHCLK_QSPI)
+    {
+      /* Get QSPI clock source */
+      srcclk= __HAL_RCC_GET_QSPI_SOURCE();
+
+      switch (srcclk)
+      {
+      case RCC_QSPICLKSOURCE_D1HCLK: /* D1 HCLK (HCLK3) is the clock source for QSPI */
+        {
+          frequency = HAL_RCC_GetHCLKFreq();
+          break;
+        }
+      case RCC_QSPICLKSOURCE_PLL: /* PLL1 is the clock source for QSPI */
+        {
+          HAL_RCCEx_GetPLL1ClockFreq(&pll1_clocks);
+          frequency = pll1_clocks.PLL1_Q_Frequency;
+          break;
+        }
+      case RCC_QSPICLKSOURCE_PLL2: /* PLL2 is the clock source for QSPI */
+        {
+          HAL_RCCEx_GetPLL2ClockFreq(&pll2_clocks);
+          frequency = pll2_clocks.PLL2_R_Frequency;
+          break;
+        }
+      case RCC_QSPICLKSOURCE_CLKP: /* CKPER is the clock source for QSPI */
+        {
+          ckpclocksource= __HAL_RCC_GET_CLKP_SOURCE();
+
+          if(ckpclocksource== RCC_CLKPSOURCE_HSI)
+          {
+            /* In Case the CKPER Source is HSI */
+            frequency = HSI_VALUE;
+          }
+
+          else if(ckpclocksource== RCC_CLKPSOURCE_CSI)
+          {
+            /* In Case the CKPER Source is CSI */
+            frequency = CSI_VALUE;
+          }
+
+          else if (ckpclocksource== RCC_CLKPSOURCE_HSE)
+          {
+            /* In Case the CKPER Source is HSE */
+            frequency = HSE_VALUE;
+          }
+
+          else
+          {
+            /* In Case the CKPER is disabled*/
+            frequency = 0;
+          }
+
+          break;
+        }
+
       default :
         {
           frequency = 0;
@@ -2452,34 +2626,82 @@ uint32_t HAL_RCCEx_GetPeriphCLKFreq(uint32_t PeriphClk)
   * @brief  Returns the D1PCLK1 frequency
   * @note   Each time D1PCLK1 changes, this function must be called to update the
   *         right D1PCLK1 value. Otherwise, any configuration based on this function will be incorrect.
+  * @note   Results are cached until the next HAL_RCC_ClockCacheInvalidate().
   * @retval D1PCLK1 frequency
   */
 uint32_t HAL_RCCEx_GetD1PCLK1Freq(void)
 {
+  uint32_t generation = HAL_RCC_GetClockGeneration();
+  uint32_t primask = __get_PRIMASK();
+  uint32_t frequency;
+
+  __disable_irq();
+  frequency = RCCEx_D1PCLK1Cache;
+  if(RCCEx_D1PCLK1CacheGeneration == generation)
+  {
+    __set_PRIMASK(primask);
+    return frequency;
+  }
+  __set_PRIMASK(primask);
+
 #if defined(RCC_D1CFGR_D1PPRE)
   /* Get HCLK source and Compute D1PCLK1 frequency ---------------------------*/
-  return (HAL_RCC_GetHCLKFreq() >> (D1CorePrescTable[(RCC->D1CFGR & RCC_D1CFGR_D1PPRE)>> RCC_D1CFGR_D1PPRE_Pos] & 0x1FU));
+  frequency = (HAL_RCC_GetHCLKFreq() >> (D1CorePrescTable[(RCC->D1CFGR & RCC_D1CFGR_D1PPRE)>> RCC_D1CFGR_D1PPRE_Pos] & 0x1FU));
 #else
 /* Get HCLK source and Compute D1PCLK1 frequency ---------------------------*/
-  return (HAL_RCC_GetHCLKFreq() >> (D1CorePrescTable[(RCC->CDCFGR1 & RCC_CDCFGR1_CDPPRE)>> RCC_CDCFGR1_CDPPRE_Pos] & 0x1FU));
+  frequency = (HAL_RCC_GetHCLKFreq() >> (D1CorePrescTable[(RCC->CDCFGR1 & RCC_CDCFGR1_CDPPRE)>> RCC_CDCFGR1_CDPPRE_Pos] & 0x1FU));
 #endif
+
+  __disable_irq();
+  if(HAL_RCC_GetClockGeneration() == generation)
+  {
+    RCCEx_D1PCLK1Cache = frequency;
+    RCCEx_D1PCLK1CacheGeneration = generation;
+  }
+  __set_PRIMASK(primask);
+
+  return frequency;
 }
 
 /**
   * @brief  Returns the D3PCLK1 frequency
   * @note   Each time D3PCLK1 changes, this function must be called to update the
   *         right D3PCLK1 value. Otherwise, any configuration based on this function will be incorrect.
+  * @note   Results are cached until the next HAL_RCC_ClockCacheInvalidate().
   * @retval D3PCLK1 frequency
   */
 uint32_t HAL_RCCEx_GetD3PCLK1Freq(void)
 {
+  uint32_t generation = HAL_RCC_GetClockGeneration();
+  uint32_t primask = __get_PRIMASK();
+  uint32_t frequency;
+
+  __disable_irq();
+  frequency = RCCEx_D3PCLK1Cache;
+  if(RCCEx_D3PCLK1CacheGeneration == generation)
+  {
+    __set_PRIMASK(primask);
+    return frequency;
+  }
+  __set_PRIMASK(primask);
+
 #if defined(RCC_D3CFGR_D3PPRE)
   /* Get HCLK source and Compute D3PCLK1 frequency ---------------------------*/
-  return (HAL_RCC_GetHCLKFreq() >> (D1CorePrescTable[(RCC->D3CFGR & RCC_D3CFGR_D3PPRE)>> RCC_D3CFGR_D3PPRE_Pos] & 0x1FU));
+  frequency = (HAL_RCC_GetHCLKFreq() >> (D1CorePrescTable[(RCC->D3CFGR & RCC_D3CFGR_D3PPRE)>> RCC_D3CFGR_D3PPRE_Pos] & 0x1FU));
 #else
   /* Get HCLK source and Compute D3PCLK1 frequency ---------------------------*/
-  return (HAL_RCC_GetHCLKFreq() >> (D1CorePrescTable[(RCC->SRDCFGR & RCC_SRDCFGR_SRDPPRE)>> RCC_SRDCFGR_SRDPPRE_Pos] & 0x1FU));
+  frequency = (HAL_RCC_GetHCLKFreq() >> (D1CorePrescTable[(RCC->SRDCFGR & RCC_SRDCFGR_SRDPPRE)>> RCC_SRDCFGR_SRDPPRE_Pos] & 0x1FU));
 #endif
+
+  __disable_irq();
+  if(HAL_RCC_GetClockGeneration() == generation)
+  {
+    RCCEx_D3PCLK1Cache = frequency;
+    RCCEx_D3PCLK1CacheGeneration = generation;
+  }
+  __set_PRIMASK(primask);
+
+  return frequency;
 }
 /**
 * @brief  Returns the PLL2 clock frequencies :PLL2_P_Frequency,PLL2_R_Frequency and PLL2_Q_Frequency
@@ -2492,10 +2714,41 @@ uint32_t HAL_RCCEx_GetD3PCLK1Freq(void)
   *
   * @note   Each time PLL2CLK changes, this function must be called to update the
   *         right PLL2CLK value. Otherwise, any configuration based on this function will be incorrect.
+  * @note   Results are cached until the next HAL_RCC_ClockCacheInvalidate().
   * @param  PLL2_Clocks structure.
   * @retval None
   */
 void HAL_RCCEx_GetPLL2ClockFreq(PLL2_ClocksTypeDef* PLL2_Clocks)
+{
+  uint32_t generation = HAL_RCC_GetClockGeneration();
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if(RCCEx_PLL2CacheGeneration == generation)
+  {
+    *PLL2_Clocks = RCCEx_PLL2Cache;
+    __set_PRIMASK(primask);
+    return;
+  }
+  __set_PRIMASK(primask);
+
+  RCCEx_ComputePLL2ClockFreq(PLL2_Clocks);
+
+  __disable_irq();
+  if(HAL_RCC_GetClockGeneration() == generation)
+  {
+    RCCEx_PLL2Cache = *PLL2_Clocks;
+    RCCEx_PLL2CacheGeneration = generation;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Computes the PLL2 P, Q and R outputs from the RCC registers.
+  * @param  PLL2_Clocks structure.
+  * @retval None
+  */
+static void RCCEx_ComputePLL2ClockFreq(PLL2_ClocksTypeDef* PLL2_Clocks)
 {
   uint32_t  pllsource, pll2m,  pll2fracen, hsivalue;
   float_t fracn2, pll2vco;
@@ -2561,10 +2814,41 @@ void HAL_RCCEx_GetPLL2ClockFreq(PLL2_ClocksTypeDef* PLL2_Clocks)
   *
   * @note   Each time PLL3CLK changes, this function must be called to update the
   *         right PLL3CLK value. Otherwise, any configuration based on this function will be incorrect.
+  * @note   Results are cached until the next HAL_RCC_ClockCacheInvalidate().
   * @param  PLL3_Clocks structure.
   * @retval None
   */
 void HAL_RCCEx_GetPLL3ClockFreq(PLL3_ClocksTypeDef* PLL3_Clocks)
+{
+  uint32_t generation = HAL_RCC_GetClockGeneration();
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if(RCCEx_PLL3CacheGeneration == generation)
+  {
+    *PLL3_Clocks = RCCEx_PLL3Cache;
+    __set_PRIMASK(primask);
+    return;
+  }
+  __set_PRIMASK(primask);
+
+  RCCEx_ComputePLL3ClockFreq(PLL3_Clocks);
+
+  __disable_irq();
+  if(HAL_RCC_GetClockGeneration() == generation)
+  {
+    RCCEx_PLL3Cache = *PLL3_Clocks;
+    RCCEx_PLL3CacheGeneration = generation;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Computes the PLL3 P, Q and R outputs from the RCC registers.
+  * @param  PLL3_Clocks structure.
+  * @retval None
+  */
+static void RCCEx_ComputePLL3ClockFreq(PLL3_ClocksTypeDef* PLL3_Clocks)
 {
   uint32_t pllsource, pll3m, pll3fracen, hsivalue;
   float_t fracn3, pll3vco;
@@ -2629,10 +2913,41 @@ void HAL_RCCEx_GetPLL3ClockFreq(PLL3_ClocksTypeDef* PLL3_Clocks)
   *
   * @note   Each time PLL1CLK changes, this function must be called to update the
   *         right PLL1CLK value. Otherwise, any configuration based on this function will be incorrect.
+  * @note   Results are cached until the next HAL_RCC_ClockCacheInvalidate().
   * @param  PLL1_Clocks structure.
   * @retval None
   */
 void HAL_RCCEx_GetPLL1ClockFreq(PLL1_ClocksTypeDef* PLL1_Clocks)
+{
+  uint32_t generation = HAL_RCC_GetClockGeneration();
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if(RCCEx_PLL1CacheGeneration == generation)
+  {
+    *PLL1_Clocks = RCCEx_PLL1Cache;
+    __set_PRIMASK(primask);
+    return;
+  }
+  __set_PRIMASK(primask);
+
+  RCCEx_ComputePLL1ClockFreq(PLL1_Clocks);
+
+  __disable_irq();
+  if(HAL_RCC_GetClockGeneration() == generation)
+  {
+    RCCEx_PLL1Cache = *PLL1_Clocks;
+    RCCEx_PLL1CacheGeneration = generation;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Computes the PLL1 P, Q and R outputs from the RCC registers.
+  * @param  PLL1_Clocks structure.
+  * @retval None
+  */
+static void RCCEx_ComputePLL1ClockFreq(PLL1_ClocksTypeDef* PLL1_Clocks)
 {
   uint32_t pllsource, pll1m, pll1fracen, hsivalue;
   float_t fracn1, pll1vco;
@@ -1254,6 +1254,11 @@ HAL_StatusTypeDef HAL_SD_ReadBlocks_DMA(SD_HandleTypeDef *hsd, uint8_t *pData, u
     config.DPSM          = SDMMC_DPSM_DISABLE;
     (void)SDMMC_ConfigData(hsd->Instance, &config);
 
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+    /* Drop cached lines of the reception buffer */
+    HAL_DMA_CacheInvalidate(pData, BLOCKSIZE * NumberOfBlocks);
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
     __SDMMC_CMDTRANS_ENABLE( hsd->Instance);
     hsd->Instance->IDMABASE0 = (uint32_t) pData ;
     hsd->Instance->IDMACTRL  = SDMMC_ENABLE_IDMA_SINGLE_BUFF;
@@ -1353,6 +1358,11 @@ HAL_StatusTypeDef HAL_SD_WriteBlocks_DMA(SD_HandleTypeDef *hsd, uint8_t *pData,
     (void)SDMMC_ConfigData(hsd->Instance, &config);
 
 
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+    /* Write the transmission buffer back to memory */
+    HAL_DMA_CacheClean(pData, BLOCKSIZE * NumberOfBlocks);
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
     __SDMMC_CMDTRANS_ENABLE( hsd->Instance);
 
     hsd->Instance->IDMABASE0 = (uint32_t) pData ;
@@ -1598,6 +1608,10 @@ void HAL_SD_IRQHandler(SD_HandleTypeDef *hsd)
       }
       if(((context & SD_CONTEXT_READ_SINGLE_BLOCK) != 0U) || ((context & SD_CONTEXT_READ_MULTIPLE_BLOCK) != 0U))
       {
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+        /* Lines speculatively refilled during the transfer are stale */
+        HAL_DMA_CacheInvalidate(hsd->pRxBuffPtr, hsd->RxXferSize);
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
 #if defined (USE_HAL_SD_REGISTER_CALLBACKS) && (USE_HAL_SD_REGISTER_CALLBACKS == 1U)
         hsd->RxCpltCallback(hsd);
 #else
@@ -163,6 +163,9 @@ static void SPI_DMAHalfTransmitCplt(DMA_HandleTypeDef *hdma);
 static void SPI_DMAHalfReceiveCplt(DMA_HandleTypeDef *hdma);
 static void SPI_DMAHalfTransmitReceiveCplt(DMA_HandleTypeDef *hdma);
 static void SPI_DMAError(DMA_HandleTypeDef *hdma);
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+static uint32_t SPI_DMABufferSize(const SPI_HandleTypeDef *hspi, uint16_t Size);
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
 static void SPI_DMAAbortOnError(DMA_HandleTypeDef *hdma);
 static void SPI_DMATxAbortCallback(DMA_HandleTypeDef *hdma);
 static void SPI_DMARxAbortCallback(DMA_HandleTypeDef *hdma);
@@ -2082,6 +2085,11 @@ HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData,
   CLEAR_BIT(hspi->Instance->CFG1, SPI_CFG1_TXDMAEN);
 
   /* Enable the Tx DMA Stream/Channel */
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+  /* Write the transmission buffer back to memory */
+  HAL_DMA_CacheClean(hspi->pTxBuffPtr, SPI_DMABufferSize(hspi, hspi->TxXferSize));
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
   if (HAL_OK != HAL_DMA_Start_IT(hspi->hdmatx, (uint32_t)hspi->pTxBuffPtr, (uint32_t)&hspi->Instance->TXDR, hspi->TxXferCount))
   {
     /* Update SPI error code */
@@ -2231,6 +2239,11 @@ HAL_StatusTypeDef HAL_SPI_Receive_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, u
   hspi->hdmarx->XferAbortCallback = NULL;
 
   /* Enable the Rx DMA Stream/Channel  */
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+  /* Drop cached lines of the reception buffer */
+  HAL_DMA_CacheInvalidate(hspi->pRxBuffPtr, SPI_DMABufferSize(hspi, hspi->RxXferSize));
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
   if (HAL_OK != HAL_DMA_Start_IT(hspi->hdmarx, (uint32_t)&hspi->Instance->RXDR, (uint32_t)hspi->pRxBuffPtr, hspi->RxXferCount))
   {
     /* Update SPI error code */
@@ -2403,6 +2416,11 @@ HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi, uint8_t *
   hspi->hdmarx->XferAbortCallback = NULL;
 
   /* Enable the Rx DMA Stream/Channel  */
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+  /* Drop cached lines of the reception buffer */
+  HAL_DMA_CacheInvalidate(hspi->pRxBuffPtr, SPI_DMABufferSize(hspi, hspi->RxXferSize));
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
   if (HAL_OK != HAL_DMA_Start_IT(hspi->hdmarx, (uint32_t)&hspi->Instance->RXDR, (uint32_t)hspi->pRxBuffPtr, hspi->RxXferCount))
   {
     /* Update SPI error code */
@@ -2423,6 +2441,11 @@ HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi, uint8_t *
   hspi->hdmatx->XferAbortCallback    = NULL;
 
   /* Enable the Tx DMA Stream/Channel  */
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+  /* Write the transmission buffer back to memory */
+  HAL_DMA_CacheClean(hspi->pTxBuffPtr, SPI_DMABufferSize(hspi, hspi->TxXferSize));
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
   if (HAL_OK != HAL_DMA_Start_IT(hspi->hdmatx, (uint32_t)hspi->pTxBuffPtr, (uint32_t)&hspi->Instance->TXDR, hspi->TxXferCount))
   {
     /* Update SPI error code */
@@ -3216,6 +3239,11 @@ static void SPI_DMAReceiveCplt(DMA_HandleTypeDef *hdma)
 {
   SPI_HandleTypeDef *hspi = (SPI_HandleTypeDef *)((DMA_HandleTypeDef *)hdma)->Parent;
 
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+  /* Lines speculatively refilled during the transfer are stale */
+  HAL_DMA_CacheInvalidate(hspi->pRxBuffPtr, SPI_DMABufferSize(hspi, hspi->RxXferSize));
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
   if (hspi->State != HAL_SPI_STATE_ABORT)
   {
     if (hspi->hdmarx->Init.Mode == DMA_CIRCULAR)
@@ -3244,6 +3272,11 @@ static void SPI_DMATransmitReceiveCplt(DMA_HandleTypeDef *hdma)
 {
   SPI_HandleTypeDef *hspi = (SPI_HandleTypeDef *)((DMA_HandleTypeDef *)hdma)->Parent;
 
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+  /* Lines speculatively refilled during the transfer are stale */
+  HAL_DMA_CacheInvalidate(hspi->pRxBuffPtr, SPI_DMABufferSize(hspi, hspi->RxXferSize));
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
   if (hspi->State != HAL_SPI_STATE_ABORT)
   {
     if (hspi->hdmatx->Init.Mode == DMA_CIRCULAR)
@@ -3289,6 +3322,11 @@ static void SPI_DMAHalfReceiveCplt(DMA_HandleTypeDef *hdma)
 {
   SPI_HandleTypeDef *hspi = (SPI_HandleTypeDef *)((DMA_HandleTypeDef *)hdma)->Parent;
 
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+  /* Lines speculatively refilled during the transfer are stale */
+  HAL_DMA_CacheInvalidate(hspi->pRxBuffPtr, SPI_DMABufferSize(hspi, (uint16_t)(hspi->RxXferSize >> 1U)));
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
 #if (USE_HAL_SPI_REGISTER_CALLBACKS == 1UL)
   hspi->RxHalfCpltCallback(hspi);
 #else
@@ -3306,6 +3344,11 @@ static void SPI_DMAHalfTransmitReceiveCplt(DMA_HandleTypeDef *hdma)
 {
   SPI_HandleTypeDef *hspi = (SPI_HandleTypeDef *)((DMA_HandleTypeDef *)hdma)->Parent;
 
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+  /* Lines speculatively refilled during the transfer are stale */
+  HAL_DMA_CacheInvalidate(hspi->pRxBuffPtr, SPI_DMABufferSize(hspi, (uint16_t)(hspi->RxXferSize >> 1U)));
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
 #if (USE_HAL_SPI_REGISTER_CALLBACKS == 1UL)
   hspi->TxRxHalfCpltCallback(hspi);
 #else
@@ -3313,6 +3356,31 @@ static void SPI_DMAHalfTransmitReceiveCplt(DMA_HandleTypeDef *hdma)
 #endif /* USE_HAL_SPI_REGISTER_CALLBACKS */
 }
 
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+/**
+  * @brief  Size in bytes of a DMA buffer holding Size data frames.
+  * @param  hspi : pointer to a SPI_HandleTypeDef structure that contains
+  *                the configuration information for SPI module.
+  * @param  Size : number of data frames
+  * @retval Buffer size in bytes
+  */
+static uint32_t SPI_DMABufferSize(const SPI_HandleTypeDef *hspi, uint16_t Size)
+{
+  if (hspi->Init.DataSize <= SPI_DATASIZE_8BIT)
+  {
+    return (uint32_t)Size;
+  }
+  else if (hspi->Init.DataSize <= SPI_DATASIZE_16BIT)
+  {
+    return (uint32_t)Size * 2UL;
+  }
+  else
+  {
+    return (uint32_t)Size * 4UL;
+  }
+}
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
 /**
   * @brief  DMA SPI communication error callback.
   * @param  hdma: pointer to a DMA_HandleTypeDef structure that contains
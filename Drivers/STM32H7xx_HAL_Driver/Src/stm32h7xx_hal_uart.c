@@ -204,6 +204,9 @@ static void UART_DMAReceiveCplt(DMA_HandleTypeDef *hdma);
 static void UART_DMARxHalfCplt(DMA_HandleTypeDef *hdma);
 static void UART_DMATxHalfCplt(DMA_HandleTypeDef *hdma);
 static void UART_DMAError(DMA_HandleTypeDef *hdma);
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+static uint32_t UART_DMABufferSize(const UART_HandleTypeDef *huart, uint16_t Size);
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
 static void UART_DMAAbortOnError(DMA_HandleTypeDef *hdma);
 static void UART_DMATxAbortCallback(DMA_HandleTypeDef *hdma);
 static void UART_DMARxAbortCallback(DMA_HandleTypeDef *hdma);
@@ -1392,6 +1395,11 @@ HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, uint8_t *pDat
       /* Set the DMA abort callback */
       huart->hdmatx->XferAbortCallback = NULL;
 
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+      /* Write the transmission buffer back to memory */
+      HAL_DMA_CacheClean(huart->pTxBuffPtr, UART_DMABufferSize(huart, Size));
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
       /* Enable the UART transmit DMA channel */
       if (HAL_DMA_Start_IT(huart->hdmatx, (uint32_t)huart->pTxBuffPtr, (uint32_t)&huart->Instance->TDR, Size) != HAL_OK)
       {
@@ -1467,6 +1475,11 @@ HAL_StatusTypeDef HAL_UART_Receive_DMA(UART_HandleTypeDef *huart, uint8_t *pData
       /* Set the DMA abort callback */
       huart->hdmarx->XferAbortCallback = NULL;
 
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+      /* Drop cached lines of the reception buffer */
+      HAL_DMA_CacheInvalidate(huart->pRxBuffPtr, UART_DMABufferSize(huart, Size));
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
       /* Enable the DMA channel */
       if (HAL_DMA_Start_IT(huart->hdmarx, (uint32_t)&huart->Instance->RDR, (uint32_t)huart->pRxBuffPtr, Size) != HAL_OK)
       {
@@ -3388,6 +3401,11 @@ static void UART_DMAReceiveCplt(DMA_HandleTypeDef *hdma)
 {
   UART_HandleTypeDef *huart = (UART_HandleTypeDef *)(hdma->Parent);
 
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+  /* Lines speculatively refilled during the transfer are stale */
+  HAL_DMA_CacheInvalidate(huart->pRxBuffPtr, UART_DMABufferSize(huart, huart->RxXferSize));
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
   /* DMA Normal mode */
   if (hdma->Init.Mode != DMA_CIRCULAR)
   {
@@ -3423,6 +3441,11 @@ static void UART_DMARxHalfCplt(DMA_HandleTypeDef *hdma)
 {
   UART_HandleTypeDef *huart = (UART_HandleTypeDef *)(hdma->Parent);
 
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+  /* Lines speculatively refilled during the transfer are stale */
+  HAL_DMA_CacheInvalidate(huart->pRxBuffPtr, UART_DMABufferSize(huart, (uint16_t)(huart->RxXferSize >> 1U)));
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
 #if (USE_HAL_UART_REGISTER_CALLBACKS == 1)
   /*Call registered Rx Half complete callback*/
   huart->RxHalfCpltCallback(huart);
@@ -3432,6 +3455,24 @@ static void UART_DMARxHalfCplt(DMA_HandleTypeDef *hdma)
 #endif /* USE_HAL_UART_REGISTER_CALLBACKS */
 }
 
+#if (USE_HAL_DMA_CACHE_MAINTENANCE == 1U)
+/**
+  * @brief Size in bytes of a DMA buffer holding Size data frames.
+  * @param huart UART handle.
+  * @param Size  Number of data frames.
+  * @retval Buffer size in bytes
+  */
+static uint32_t UART_DMABufferSize(const UART_HandleTypeDef *huart, uint16_t Size)
+{
+  /* 9 data bits without parity are stored as u16 */
+  if ((huart->Init.WordLength == UART_WORDLENGTH_9B) && (huart->Init.Parity == UART_PARITY_NONE))
+  {
+    return (uint32_t)Size * 2U;
+  }
+  return (uint32_t)Size;
+}
+#endif /* USE_HAL_DMA_CACHE_MAINTENANCE */
+
 /**
   * @brief DMA UART communication error callback.
   * @param hdma DMA handle.
@@ -0,0 +1,126 @@
+"""Report where the hot functions ended up in an IAR ILINK map file.
+
+Reads the ENTRY LIST of the map, lists every symbol placed in ITCM or DTCM
+and checks the hot symbols (the ones stm32h750xx_flash_tcm.icf and
+TCM_CODE are meant to move) against the memory they actually landed in.
+
+    python tcm_report.py [Debug/List/Project.map] [--hot SYMBOL ...]
+
+Exit status is 1 if a hot symbol is linked but not in a TCM, so the script
+can gate a build. Symbols that are not linked at all are only listed.
+"""
+
+import argparse
+import re
+import sys
+
+REGIONS = [
+    ("ITCM",     0x00000000, 0x00010000),
+    ("FLASH",    0x08000000, 0x08020000),
+    ("DTCM",     0x20000000, 0x20020000),
+    ("AXISRAM",  0x24000000, 0x24080000),
+    ("SRAM1-3",  0x30000000, 0x30048000),
+    ("SRAM4",    0x38000000, 0x38010000),
+    ("QSPI",     0x90000000, 0xA0000000),
+]
+TCM = ("ITCM", "DTCM")
+
+# Keep in step with HOT_CODE in stm32h750xx_flash_tcm.icf and the TCM_CODE
+# functions in .Library
+HOT = [
+    "HAL_DMA_IRQHandler",
+    "HAL_MDMA_IRQHandler",
+    "HAL_UART_IRQHandler",
+    "HAL_SPI_IRQHandler",
+    "HAL_TIM_IRQHandler",
+    "HAL_ETH_IRQHandler",
+    "HAL_GPIO_EXTI_IRQHandler",
+    "TIM5_IRQHandler",
+    "TIM6_DAC_IRQHandler",
+    "TIM7_IRQHandler",
+]
+
+ENTRY = re.compile(r"^\s*(0x[0-9a-fA-F']+)\s+(?:(0x[0-9a-fA-F']+)\s+)?(Code|Data|--)\s+(\w+)\s+(.*)$")
+
+
+def region_of(addr):
+    for name, start, end in REGIONS:
+        if start <= addr < end:
+            return name
+    return "?"
+
+
+def parse_entries(path):
+    """Yield (symbol, address, size, type, object) from the ENTRY LIST."""
+    with open(path, encoding="latin-1") as f:
+        lines = f.read().splitlines()
+
+    try:
+        start = next(i for i, l in enumerate(lines) if "*** ENTRY LIST" in l)
+    except StopIteration:
+        raise SystemExit("%s: no ENTRY LIST, link with --map" % path)
+
+    pending = None
+    for line in lines[start + 1:]:
+        if line.startswith("[") or line.startswith("*****"):
+            break
+        if not line.strip() or line.startswith("***") or line.lstrip().startswith(("Entry", "-----")):
+            continue
+
+        if pending is None:
+            # Long names get the rest of the entry on the next line
+            name, _, rest = line.strip().partition(" ")
+            if not rest.strip():
+                pending = name
+                continue
+        else:
+            name, rest = pending, line
+            pending = None
+
+        m = ENTRY.match(rest)
+        if m is None:
+            continue
+        addr = int(m.group(1).replace("'", ""), 16)
+        size = int(m.group(2).replace("'", ""), 16) if m.group(2) else 0
+        kind = m.group(3)
+        if kind == "Code":
+            addr &= ~1
+        yield name, addr, size, kind, m.group(5).strip()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("map", nargs="?", default="Debug/List/Project.map")
+    parser.add_argument("--hot", nargs="*", default=[], help="more symbols to check")
+    args = parser.parse_args()
+
+    entries = {}
+    for name, addr, size, kind, obj in parse_entries(args.map):
+        entries[name] = (addr, size, kind, obj)
+
+    print("Symbols in TCM")
+    tcm_bytes = {"ITCM": 0, "DTCM": 0}
+    for name, (addr, size, kind, obj) in sorted(entries.items(), key=lambda e: e[1][0]):
+        region = region_of(addr)
+        if region in TCM:
+            tcm_bytes[region] += size
+            print("  %-32s %-5s 0x%08x %6d  %s" % (name, region, addr, size, obj))
+    print("  ITCM %d bytes, DTCM %d bytes (sized entries only)" % (tcm_bytes["ITCM"], tcm_bytes["DTCM"]))
+
+    print("\nHot symbols")
+    misplaced = 0
+    for name in HOT + args.hot:
+        if name not in entries:
+            print("  %-32s not linked" % name)
+            continue
+        addr, size, kind, obj = entries[name]
+        region = region_of(addr)
+        ok = region in TCM
+        misplaced += 0 if ok else 1
+        print("  %-32s %-8s 0x%08x %s" % (name, region, addr, "ok" if ok else "NOT IN TCM"))
+
+    return 1 if misplaced else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,426 @@
+/* Header includes -----------------------------------------------------------*/
+/* The alignment and the Q15 conversion are private: test them from inside */
+#include "adc_filter.c"
+#include "host.h"
+#include <math.h>
+
+/* adc_filter: the left shift that brings the pipe's largest code to 16
+   bits for every resolution, oversampling ratio and shift, worked out here
+   by counting; the offset binary to Q15 conversion for every code of 12,
+   14 and 16 bit pipes; then blocks of synthetic ADC codes, at the extremes
+   now and then, through adc_filter_poll() with a stand-in for the pipe's
+   queue. The in-place chain (FIR or decimator, biquad cascade, each alone
+   or both) is compared with the dsp_ref kernels run out of place on
+   codes converted here, over several blocks so the history carries, and
+   across a dropped block, where both start over. dsp.c is built with
+   __ARM_FEATURE_DSP=1 as in dsp_test, so the chain runs the SIMD forms. */
+
+/* Private macro -------------------------------------------------------------*/
+#define N                       ADC_PIPE_BLOCK_SAMPLES
+#define BLOCKS                  6U
+#define TAPS                    31U
+#define STAGES                  2U
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t bits;
+  uint32_t ratio;
+  uint32_t shift;
+} cfg_t;
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t seed = 0x0DDBA11U;
+
+/* Stand-in for the pipe's ready queue */
+static adc_pipe_block_t queue[BLOCKS];
+static uint32_t queue_head;
+static uint32_t queue_tail;
+static const adc_pipe_block_t *released[BLOCKS];
+static uint32_t releases;
+
+static uint16_t blocks[BLOCKS][N];
+static uint16_t codes[BLOCKS][N];
+
+/* What the sink got */
+static int16_t out[BLOCKS][N];
+static uint32_t out_len[BLOCKS];
+static uint32_t out_seq[BLOCKS];
+static uint32_t sinks;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+const adc_pipe_block_t *adc_pipe_get(adc_pipe_t *p)
+{
+  (void)p;
+  return (queue_tail == queue_head) ? NULL : &queue[queue_tail++];
+}
+
+void adc_pipe_release(adc_pipe_t *p, const adc_pipe_block_t *block)
+{
+  (void)p;
+  released[releases++] = block;
+}
+
+static void sink(adc_filter_t *f, const int16_t *samples, uint32_t len, uint32_t seq)
+{
+  (void)f;
+  memcpy(out[sinks], samples, len * sizeof(int16_t));
+  out_len[sinks] = len;
+  out_seq[sinks] = seq;
+  sinks++;
+}
+
+/* Largest code of the pipe, and the shift that takes it to 16 bits by
+   counting; 32 when it does not fit */
+static uint32_t full_code(const cfg_t *c)
+{
+  uint64_t full = ((1ULL << c->bits) - 1U) * c->ratio;
+
+  return (uint32_t)((c->ratio > 1U) ? (full >> c->shift) : full);
+}
+
+static uint32_t expected_align(const cfg_t *c)
+{
+  uint32_t full = full_code(c);
+  uint32_t a = 0U;
+
+  if((full == 0U) || (full > 0xFFFFU))
+  {
+    return 32U;
+  }
+  while((full << (a + 1U)) <= 0xFFFFU)
+  {
+    a++;
+  }
+  return a;
+}
+
+static void set_pipe(adc_pipe_t *p, const cfg_t *c)
+{
+  memset(p, 0, sizeof(*p));
+  p->resolution = c->bits;
+  p->ratio = c->ratio;
+  p->shift = c->shift;
+}
+
+static void test_align(void)
+{
+  static const uint32_t bits[] = {8U, 10U, 12U, 14U, 16U};
+  static const uint32_t ratios[] = {1U, 2U, 3U, 4U, 7U, 16U, 100U, 256U, 1024U};
+  adc_pipe_t pipe;
+  adc_filter_t f;
+  cfg_t c;
+  uint32_t i;
+  uint32_t j;
+  uint32_t ok = 0U;
+  uint32_t a;
+
+  memset(&f, 0, sizeof(f));
+  f.pipe = &pipe;
+  for(i = 0U; i < sizeof(bits) / sizeof(bits[0]); i++)
+  {
+    for(j = 0U; j < sizeof(ratios) / sizeof(ratios[0]); j++)
+    {
+      for(c.shift = 0U; c.shift <= 11U; c.shift++)
+      {
+        c.bits = bits[i];
+        c.ratio = ratios[j];
+        set_pipe(&pipe, &c);
+        a = expected_align(&c);
+        HOST_CHECK_EQ(adc_filter_align(&pipe), a);
+        /* Codes that need more than 8 bits of shift lose too much */
+        HOST_CHECK_EQ(adc_filter_init(&f), (a <= 8U) ? HAL_OK : HAL_ERROR);
+        ok += (a <= 8U) ? 1U : 0U;
+      }
+    }
+  }
+  /* Not an ADC setting */
+  c.bits = 11U;
+  c.ratio = 1U;
+  c.shift = 0U;
+  set_pipe(&pipe, &c);
+  HOST_CHECK(adc_filter_align(&pipe) > 8U);
+  c.bits = 12U;
+  c.ratio = 0U;
+  set_pipe(&pipe, &c);
+  HOST_CHECK(adc_filter_align(&pipe) > 8U);
+  c.bits = 8U;
+  c.ratio = 2048U;
+  c.shift = 11U;
+  set_pipe(&pipe, &c);
+  HOST_CHECK(adc_filter_align(&pipe) > 8U);
+  printf("  align: %u settings accepted\n", (unsigned)ok);
+}
+
+/* Every code of the resolution, the pipe's full scale to Q15 full scale */
+static void test_to_q15(void)
+{
+  static const cfg_t cfgs[] =
+  {
+    {12U, 1U, 0U}, {12U, 4U, 2U}, {12U, 16U, 0U}, {14U, 1U, 0U},
+    {14U, 16U, 4U}, {14U, 4U, 3U}, {16U, 1U, 0U}, {16U, 2U, 1U},
+  };
+  static uint16_t buf[65536U];
+  adc_pipe_t pipe;
+  uint32_t i;
+  uint32_t k;
+  uint32_t full;
+  uint32_t a;
+  uint32_t bad;
+
+  for(k = 0U; k < sizeof(cfgs) / sizeof(cfgs[0]); k++)
+  {
+    set_pipe(&pipe, &cfgs[k]);
+    a = adc_filter_align(&pipe);
+    full = full_code(&cfgs[k]);
+    for(i = 0U; i <= full; i++)
+    {
+      buf[i] = (uint16_t)i;
+    }
+    /* An even count, as in a block */
+    adc_filter_to_q15(buf, (full + 2U) & ~1U, a);
+    bad = 0U;
+    for(i = 0U; i <= full; i++)
+    {
+      bad += ((int16_t)buf[i] != (int16_t)(((int32_t)i << a) - 32768)) ? 1U : 0U;
+    }
+    HOST_CHECK_EQ(bad, 0U);
+    /* Zero is -1.0, full scale above 0.5: no bit of headroom wasted */
+    HOST_CHECK_EQ((int16_t)buf[0], -32768);
+    HOST_CHECK((int16_t)buf[full] >= 0);
+  }
+}
+
+/* A tone and noise around mid scale, hitting both ends now and then */
+static void fill_codes(uint16_t *c, uint32_t full, uint32_t block)
+{
+  uint32_t i;
+  uint32_t r;
+  double x;
+
+  for(i = 0U; i < N; i++)
+  {
+    r = rnd();
+    x = 0.5 + 0.4 * sin((double)(block * N + i) * 0.0731) + ((double)(r >> 20) / 4096.0 - 0.5) * 0.1;
+    if((r & 0xFFU) == 0U)
+    {
+      x = ((r & 0x100U) != 0U) ? 1.0 : 0.0;
+    }
+    x = (x < 0.0) ? 0.0 : ((x > 1.0) ? 1.0 : x);
+    c[i] = (uint16_t)(x * (double)full + 0.5);
+  }
+}
+
+/* FIR (factor 1 or 4), biquad cascade, each alone or both, over BLOCKS
+   blocks with one dropped */
+static void run_chain(const cfg_t *c, uint32_t use_fir, uint16_t factor, uint32_t use_biquad)
+{
+  static int16_t fir_c[TAPS];
+  static int16_t fir_s[2][DSP_FIR_STATE(TAPS, N)];
+  static int16_t bq_c[5U * STAGES];
+  static int16_t bq_s[2][4U * STAGES];
+  static int16_t x[N];
+  static int16_t y[N];
+  static int16_t z[N];
+  dsp_fir_q15_t fir[2];
+  dsp_biquad_q15_t bq[2];
+  adc_pipe_t pipe;
+  adc_filter_t f;
+  uint32_t full = full_code(c);
+  uint32_t a = expected_align(c);
+  uint32_t b;
+  uint32_t i;
+  uint32_t len;
+  uint32_t seq;
+  uint32_t mismatch = 0U;
+  uint32_t k;
+
+  /* A low pass with a random ripple, and two resonant sections at 2^-1 */
+  for(i = 0U; i < TAPS; i++)
+  {
+    fir_c[i] = (int16_t)(2000.0 * exp(-0.02 * ((double)i - 15.0) * ((double)i - 15.0)) + (double)(int16_t)rnd() / 64.0);
+  }
+  for(k = 0U; k < STAGES; k++)
+  {
+    bq_c[5U * k] = 3277;
+    bq_c[(5U * k) + 1U] = 1638;
+    bq_c[(5U * k) + 2U] = -819;
+    bq_c[(5U * k) + 3U] = (int16_t)(0.9 * cos((double)(k + 1U)) * 32768.0);
+    bq_c[(5U * k) + 4U] = -13271;
+  }
+  for(k = 0U; k < 2U; k++)
+  {
+    dsp_fir_q15_init(&fir[k], fir_c, TAPS, factor, fir_s[k]);
+    dsp_biquad_q15_init(&bq[k], bq_c, STAGES, 1U, bq_s[k]);
+  }
+  /* Leftovers of another run: init must clear them */
+  for(i = 0U; i < TAPS - 1U; i++)
+  {
+    fir_s[0][i] = (int16_t)rnd();
+  }
+  for(i = 0U; i < 4U * STAGES; i++)
+  {
+    bq_s[0][i] = (int16_t)rnd();
+  }
+
+  set_pipe(&pipe, c);
+  memset(&f, 0, sizeof(f));
+  f.pipe = &pipe;
+  f.fir = (use_fir != 0U) ? &fir[0] : NULL;
+  f.biquad = (use_biquad != 0U) ? &bq[0] : NULL;
+  f.sink = sink;
+  HOST_CHECK_EQ(adc_filter_init(&f), HAL_OK);
+  HOST_CHECK_EQ(f.align, a);
+
+  /* Block 2 was dropped by the pipe: sequence numbers 0 1 3 4 ... */
+  queue_head = 0U;
+  queue_tail = 0U;
+  releases = 0U;
+  sinks = 0U;
+  for(b = 0U; b < BLOCKS; b++)
+  {
+    fill_codes(codes[b], full, b);
+    memcpy(blocks[b], codes[b], sizeof(blocks[b]));
+    queue[b].samples = blocks[b];
+    queue[b].seq = (b < 2U) ? b : (b + 1U);
+    queue[b].overruns = 0U;
+  }
+  /* Two polls, the second finding the rest */
+  queue_head = 3U;
+  HOST_CHECK_EQ(adc_filter_poll(&f), 3U);
+  queue_head = BLOCKS;
+  HOST_CHECK_EQ(adc_filter_poll(&f), BLOCKS - 3U);
+  HOST_CHECK_EQ(adc_filter_poll(&f), 0U);
+
+  /* The reference: converted here, out of place, history cleared at the gap */
+  memset(fir_s[1], 0, sizeof(fir_s[1]));
+  memset(bq_s[1], 0, sizeof(bq_s[1]));
+  for(b = 0U; b < BLOCKS; b++)
+  {
+    seq = queue[b].seq;
+    if((b > 0U) && (seq != queue[b - 1U].seq + 1U))
+    {
+      memset(fir_s[1], 0, sizeof(fir_s[1]));
+      memset(bq_s[1], 0, sizeof(bq_s[1]));
+    }
+    for(i = 0U; i < N; i++)
+    {
+      x[i] = (int16_t)(((int32_t)codes[b][i] << a) - 32768);
+    }
+    len = N;
+    memcpy(y, x, sizeof(y));
+    if(use_fir != 0U)
+    {
+      if(factor > 1U)
+      {
+        dsp_decimate_q15_ref(&fir[1], x, y, N);
+        len = N / factor;
+      }
+      else
+      {
+        dsp_fir_q15_ref(&fir[1], x, y, N);
+      }
+    }
+    memcpy(z, y, sizeof(z));
+    if(use_biquad != 0U)
+    {
+      dsp_biquad_q15_ref(&bq[1], y, z, len);
+    }
+    HOST_CHECK_EQ(out_len[b], len);
+    HOST_CHECK_EQ(out_seq[b], seq);
+    mismatch += (memcmp(out[b], z, len * sizeof(int16_t)) != 0) ? 1U : 0U;
+    /* Each block back to the pool after the sink, in order */
+    HOST_CHECK(released[b] == &queue[b]);
+  }
+  HOST_CHECK_EQ(mismatch, 0U);
+  HOST_CHECK_EQ(sinks, BLOCKS);
+  HOST_CHECK_EQ(releases, BLOCKS);
+  HOST_CHECK_EQ(f.blocks, BLOCKS);
+  HOST_CHECK_EQ(f.gaps, 1U);
+  HOST_CHECK_EQ(f.seq, queue[BLOCKS - 1U].seq + 1U);
+  if(use_fir != 0U)
+  {
+    HOST_CHECK(memcmp(fir_s[0], fir_s[1], (TAPS - 1U) * sizeof(int16_t)) == 0);
+  }
+  if(use_biquad != 0U)
+  {
+    HOST_CHECK(memcmp(bq_s[0], bq_s[1], sizeof(bq_s[0])) == 0);
+  }
+}
+
+static void test_chain(void)
+{
+  static const cfg_t cfgs[] =
+  {
+    {12U, 1U, 0U}, {12U, 4U, 2U}, {12U, 16U, 0U},
+    {14U, 1U, 0U}, {14U, 16U, 4U},
+    {16U, 1U, 0U}, {16U, 2U, 1U},
+  };
+  static const struct
+  {
+    uint32_t fir;
+    uint16_t factor;
+    uint32_t biquad;
+  } chains[] =
+  {
+    {0U, 1U, 0U}, {1U, 1U, 0U}, {1U, 4U, 0U}, {0U, 1U, 1U}, {1U, 1U, 1U}, {1U, 4U, 1U},
+  };
+  uint32_t k;
+  uint32_t j;
+
+  for(k = 0U; k < sizeof(cfgs) / sizeof(cfgs[0]); k++)
+  {
+    for(j = 0U; j < sizeof(chains) / sizeof(chains[0]); j++)
+    {
+      run_chain(&cfgs[k], chains[j].fir, chains[j].factor, chains[j].biquad);
+    }
+  }
+  printf("  chain: %u settings x %u filter chains x %u blocks\n", (unsigned)k, (unsigned)j, (unsigned)BLOCKS);
+}
+
+/* A decimation factor must divide the block */
+static void test_factor(void)
+{
+  static int16_t c[4];
+  static int16_t s[DSP_FIR_STATE(4U, N)];
+  static const cfg_t cfg = {12U, 1U, 0U};
+  dsp_fir_q15_t fir;
+  adc_pipe_t pipe;
+  adc_filter_t f;
+
+  set_pipe(&pipe, &cfg);
+  memset(&f, 0, sizeof(f));
+  f.pipe = &pipe;
+  f.fir = &fir;
+  dsp_fir_q15_init(&fir, c, 4U, 3U, s);
+  HOST_CHECK_EQ(adc_filter_init(&f), HAL_ERROR);
+  fir.factor = 0U;
+  HOST_CHECK_EQ(adc_filter_init(&f), HAL_ERROR);
+  /* A restart clears the counters of the last run */
+  fir.factor = 8U;
+  f.seq = 9U;
+  f.blocks = 9U;
+  f.gaps = 2U;
+  HOST_CHECK_EQ(adc_filter_init(&f), HAL_OK);
+  HOST_CHECK_EQ(f.seq, 0U);
+  HOST_CHECK_EQ(f.blocks, 0U);
+  HOST_CHECK_EQ(f.gaps, 0U);
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  test_align();
+  test_to_q15();
+  test_chain();
+  test_factor();
+  return host_result();
+}
@@ -0,0 +1,955 @@
+/* Header includes -----------------------------------------------------------*/
+#include "adc_pipe.h"
+#include "host.h"
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+/* adc_pipe: ADC1/ADC2 models (power-up, calibration, enable, start/stop,
+   overrun flag and interrupt, register writes the reference manual does
+   not allow in the current state) convert a synthetic waveform (ramp,
+   two tones, noise) in dual interleaved mode with the resolution,
+   oversampling and shift they are programmed for; a model of DMA1 stream 0
+   in double-buffer mode takes each pair from the common data register,
+   swaps memories on completion (CT) and raises the completion interrupt
+   after a random latency, through the real HAL handler. Each DMA fill is
+   recorded: which block it went to and which pair went where. The consumer
+   holds blocks for a while, sometimes stalls with the whole pool, and
+   works on the blocks in place before releasing them. Checked: the
+   registers as programmed for both silicon revisions; each block handed
+   out holds exactly its fill, in sample order, with sequence numbers
+   rising and gaps only for dropped fills; the samples stay intact while
+   the consumer holds them; the DMA never fills a block the consumer has
+   or has queued, and a memory address is only rewritten while the DMA is
+   on the other one, once per delivered block; a consumer that keeps up
+   loses nothing, one that stalls gets dropped blocks counted; every
+   overrun is counted once and reported on the next block. */
+
+/* Private macro -------------------------------------------------------------*/
+#define PAIRS                   (ADC_PIPE_BLOCK_SAMPLES / 2U)
+#define FILLS                   256U    /* fill records kept */
+#define ADC_REG(a, r)           ((uint32_t)((a) * (ADC2_BASE - ADC1_BASE) + offsetof(ADC_TypeDef, r)))
+#define COMMON_REG(r)           ((uint32_t)(ADC12_COMMON_BASE - ADC1_BASE + offsetof(ADC_Common_TypeDef, r)))
+#define DMA_REG(r)              ((uint32_t)offsetof(DMA_TypeDef, r))
+#define STREAM_REG(r)           ((uint32_t)(sizeof(DMA_TypeDef) + offsetof(DMA_Stream_TypeDef, r)))
+#define ADC_CR_RS               (ADC_CR_ADCAL | ADC_CR_JADSTP | ADC_CR_ADSTP | ADC_CR_JADSTART | \
+                                 ADC_CR_ADSTART | ADC_CR_ADDIS | ADC_CR_ADEN)
+/* Stream 0 flags in LISR */
+#define DMA_S0_TC               0x20U
+#define NEVER                   UINT64_MAX
+/* Run on PLL2 P at 48 MHz instead of per_ck */
+#define PLL2P_48MHZ             0xFFFFFFFFU
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  const char *name;
+  uint32_t revid;
+  uint32_t ckper;               /* RCC_CLKPSOURCE_x for per_ck, or PLL2P_48MHZ */
+  uint32_t boost;               /* CR BOOST expected */
+  uint32_t bits;
+  uint32_t ratio;
+  uint32_t shift;
+  uint32_t channel;
+  uint32_t smp;
+  uint32_t delay;
+  uint32_t wave;                /* 0 ramp, 1 two tones, 2 noise */
+  uint32_t fills;               /* per start */
+  uint32_t latency;             /* DMA interrupt served up to this many pairs late */
+  uint32_t hold;                /* consumer holds a block up to this many pairs */
+  uint32_t stall;               /* in 1/256 per look: the consumer stalls */
+  uint32_t stall_fills;         /* for up to this many fills */
+  uint32_t ovr;                 /* in 1/65536 pairs: the DMA misses one */
+  uint32_t starts;              /* start/stop cycles after one init */
+} run_t;
+
+typedef struct
+{
+  uint32_t num;                 /* fill number since start */
+  uint32_t addr;
+  uint32_t src[PAIRS];          /* pair converted into each word */
+} fill_t;
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t seed = 0x1F2E3D4CU;
+static DMA_HandleTypeDef hdma;
+static adc_pipe_t pipe;
+static const run_t *run;
+static uint64_t now;            /* pairs converted, the time base */
+
+/* ADC1 (0), ADC2 (1) and the common registers */
+static host_mmio_t adc_m;
+static struct
+{
+  uint32_t isr[2];
+  uint32_t cr[2];               /* ADEN, ADCAL, ADSTART as the ADC has them */
+  uint32_t cal[2];              /* reads of CR until the calibration ends */
+  uint32_t rdy[2];              /* reads of ISR until ADRDY */
+  uint32_t lin[2];              /* calibrated, with linearity, single ended */
+  uint32_t running;
+  uint64_t src;                 /* next pair */
+  uint32_t bits;                /* as programmed */
+  uint32_t ratio;
+  uint32_t shift;
+  uint32_t ovr_set;             /* OVR set from clear */
+  uint32_t ovr_cleared;         /* and cleared by software */
+  uint32_t bad;                 /* register use against RM0433 */
+} adc;
+
+/* DMA1 stream 0 */
+static host_mmio_t dma_m;
+static struct
+{
+  uint32_t isr;
+  uint32_t enabled;
+  uint32_t ct;                  /* memory being filled */
+  uint32_t pos;
+  uint32_t reload;
+  uint32_t fill;                /* fill in progress */
+  uint32_t addr;
+  uint32_t last_addr[2];
+  uint32_t reused;              /* fills into the block of the last fill of their memory */
+  uint32_t owned;               /* fills into a block queued or held by the consumer */
+  uint32_t bad_ar;              /* address written while the DMA is on it */
+  uint32_t bad;                 /* stream programmed wrong */
+  uint64_t irq_t;
+  uint32_t irq_fill;            /* fill completed the pending interrupt is for */
+  uint32_t completions;         /* interrupts served */
+  uint32_t swaps;               /* memory address rewritten in the interrupt */
+} dma;
+
+static fill_t fills[FILLS];
+
+/* Consumer side; blocks by their index in the pool */
+static struct
+{
+  uint32_t owner[ADC_PIPE_BLOCKS];      /* 0 DMA or free, 1 queued, 2 held */
+  uint64_t until[ADC_PIPE_BLOCKS];
+  const adc_pipe_block_t *held[ADC_PIPE_BLOCKS];
+  uint16_t copy[ADC_PIPE_BLOCKS][ADC_PIPE_BLOCK_SAMPLES];
+  uint64_t stall_until;
+  uint32_t next_seq;
+  uint32_t queued;              /* callbacks */
+  uint32_t got;
+  uint32_t gaps;
+  uint32_t order;               /* sequence number not rising */
+  uint32_t wrong_fill;          /* callback for another fill than the DMA completed */
+  uint32_t wrong_owner;
+  uint32_t corrupt;             /* block differs from its fill when handed out */
+  uint32_t torn;                /* and when released */
+  uint32_t bad_ovr;             /* block reports other overruns than were cleared */
+  uint32_t ovr_mark;
+} cons;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+/* The input at conversion u (both ADCs, interleaved), 0..1 */
+static double wave(uint32_t w, uint64_t u)
+{
+  uint32_t x;
+
+  switch(w)
+  {
+  case 0U:
+    return (double)(u % 997U) / 997.0;
+  case 1U:
+    return 0.5 + 0.45 * sin((double)u * 6.283185307179586 / 123.7) +
+           0.04 * sin((double)u * 6.283185307179586 / 17.3);
+  default:
+    x = (uint32_t)u * 0x9E3779B1U ^ (uint32_t)(u >> 32);
+    x ^= x >> 15;
+    x *= 0x85EBCA6BU;
+    x ^= x >> 13;
+    return (double)x / 4294967296.0;
+  }
+}
+
+/* Sample j of the stream: the master converts the even ones, the slave the
+   odd ones, each oversampling its own conversions */
+static uint16_t sample(uint64_t j, uint32_t bits, uint32_t ratio, uint32_t shift)
+{
+  uint64_t n = j >> 1;
+  uint32_t side = (uint32_t)(j & 1U);
+  uint32_t full = (1UL << bits) - 1U;
+  uint32_t sum = 0U;
+  uint32_t q;
+  uint32_t r;
+
+  for(r = 0U; r < ratio; r++)
+  {
+    q = (uint32_t)(wave(run->wave, ((n * ratio) + r) * 2U + side) * (double)(full + 1U));
+    sum += (q > full) ? full : q;
+  }
+  return (uint16_t)(sum >> shift);
+}
+
+static uint32_t block_index(uint32_t addr)
+{
+  /* Block 0 and the others after it */
+  uint32_t off = addr - (uint32_t)(uintptr_t)pipe.block[0].samples;
+
+  if(((off % (ADC_PIPE_BLOCK_SAMPLES * 2U)) != 0U) || (off / (ADC_PIPE_BLOCK_SAMPLES * 2U) >= ADC_PIPE_BLOCKS))
+  {
+    return ADC_PIPE_BLOCKS;
+  }
+  return off / (ADC_PIPE_BLOCK_SAMPLES * 2U);
+}
+
+/* The ADC models --------------------------------------------------------------*/
+static void adc_isr_fn(void)
+{
+  adc_pipe_irq(&pipe);
+}
+
+/* CFGR RES code to bits, as the revision has them */
+static uint32_t adc_res_bits(uint32_t res)
+{
+  static const uint8_t rev_y[8] = {16U, 14U, 12U, 10U, 8U, 0U, 0U, 0U};
+  static const uint8_t rev_v[8] = {16U, 0U, 0U, 10U, 0U, 14U, 12U, 8U};
+
+  return (run->revid > REV_ID_Y) ? rev_v[res & 7U] : rev_y[res & 7U];
+}
+
+/* What the pair converts, from the registers */
+static void adc_decode(void)
+{
+  uint32_t cfgr = host_mmio_get(&adc_m, ADC_REG(0U, CFGR));
+  uint32_t cfgr2 = host_mmio_get(&adc_m, ADC_REG(0U, CFGR2));
+
+  if((cfgr != host_mmio_get(&adc_m, ADC_REG(1U, CFGR))) || (cfgr2 != host_mmio_get(&adc_m, ADC_REG(1U, CFGR2))))
+  {
+    adc.bad++;
+  }
+  adc.bits = adc_res_bits((cfgr & ADC_CFGR_RES) >> ADC_CFGR_RES_Pos);
+  adc.ratio = ((cfgr2 & ADC_CFGR2_ROVSE) != 0U) ? (((cfgr2 & ADC_CFGR2_OVSR) >> ADC_CFGR2_OVSR_Pos) + 1U) : 1U;
+  adc.shift = ((cfgr2 & ADC_CFGR2_ROVSE) != 0U) ? ((cfgr2 & ADC_CFGR2_OVSS) >> ADC_CFGR2_OVSS_Pos) : 0U;
+  if((adc.bits == 0U) || ((cfgr & ADC_CFGR_CONT) == 0U) || ((cfgr & ADC_CFGR_OVRMOD) == 0U) ||
+     ((cfgr & ADC_CFGR_EXTEN) != 0U))
+  {
+    adc.bad++;
+    adc.bits = (adc.bits == 0U) ? 16U : adc.bits;
+  }
+}
+
+static void adc_ovr(uint32_t a)
+{
+  if((adc.isr[a] & ADC_ISR_OVR) == 0U)
+  {
+    adc.isr[a] |= ADC_ISR_OVR;
+    adc.ovr_set++;
+    if((host_mmio_get(&adc_m, ADC_REG(a, IER)) & ADC_IER_OVRIE) != 0U)
+    {
+      host_irq_raise(adc_isr_fn);
+    }
+  }
+}
+
+static uint32_t adc_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  uint32_t a = offset / (ADC2_BASE - ADC1_BASE);
+  uint32_t r = offset % (ADC2_BASE - ADC1_BASE);
+
+  if(a > 1U)
+  {
+    return current;
+  }
+  if(r == offsetof(ADC_TypeDef, ISR))
+  {
+    if((adc.rdy[a] != 0U) && (--adc.rdy[a] == 0U))
+    {
+      adc.isr[a] |= ADC_ISR_ADRDY;
+    }
+    return adc.isr[a];
+  }
+  if((r == offsetof(ADC_TypeDef, CR)) && (adc.cal[a] != 0U) && (--adc.cal[a] == 0U))
+  {
+    adc.cr[a] &= ~ADC_CR_ADCAL;
+    current &= ~ADC_CR_ADCAL;
+    host_mmio_set(m, offset, current);
+  }
+  return current;
+}
+
+/* CR: the rs bits only take a 1, the ADC clears them */
+static void adc_cr(uint32_t a, uint32_t value)
+{
+  uint32_t b;
+
+  if(((value & ADC_CR_DEEPPWD) != 0U) && ((value & (ADC_CR_ADVREGEN | ADC_CR_ADEN | ADC_CR_ADCAL)) != 0U))
+  {
+    adc.bad++;
+  }
+  if((value & ADC_CR_ADCAL) != 0U)
+  {
+    if(((adc.cr[a] & ADC_CR_ADEN) != 0U) || ((value & ADC_CR_ADVREGEN) == 0U))
+    {
+      adc.bad++;
+    }
+    adc.cr[a] |= ADC_CR_ADCAL;
+    adc.cal[a] = 3U;
+    adc.lin[a] = (((value & ADC_CR_ADCALLIN) != 0U) && ((value & ADC_CR_ADCALDIF) == 0U)) ? 1U : 0U;
+  }
+  if((value & ADC_CR_ADEN) != 0U)
+  {
+    if(((value & ADC_CR_ADVREGEN) == 0U) || ((value & ADC_CR_DEEPPWD) != 0U) || (adc.lin[a] == 0U) ||
+       (adc.cal[a] != 0U))
+    {
+      adc.bad++;
+    }
+    adc.cr[a] |= ADC_CR_ADEN;
+    adc.rdy[a] = 2U;
+  }
+  if((value & ADC_CR_ADDIS) != 0U)
+  {
+    if((adc.cr[a] & ADC_CR_ADSTART) != 0U)
+    {
+      adc.bad++;
+    }
+    adc.cr[a] &= ~ADC_CR_ADEN;
+    adc.isr[a] &= ~ADC_ISR_ADRDY;
+  }
+  if((value & ADC_CR_ADSTART) != 0U)
+  {
+    /* The master starts the pair, in interleaved mode */
+    if((a != 0U) || ((adc.cr[0] & ADC_CR_ADEN) == 0U) || ((adc.cr[1] & ADC_CR_ADEN) == 0U) ||
+       ((adc.isr[0] & ADC_ISR_ADRDY) == 0U) ||
+       ((host_mmio_get(&adc_m, COMMON_REG(CCR)) & ADC_CCR_DUAL) != (7UL << ADC_CCR_DUAL_Pos)))
+    {
+      adc.bad++;
+    }
+    adc_decode();
+    adc.cr[0] |= ADC_CR_ADSTART;
+    adc.cr[1] |= ADC_CR_ADSTART;
+    adc.running = 1U;
+  }
+  if((value & ADC_CR_ADSTP) != 0U)
+  {
+    adc.cr[0] &= ~ADC_CR_ADSTART;
+    adc.cr[1] &= ~ADC_CR_ADSTART;
+    adc.running = 0U;
+  }
+  for(b = 0U; b < 2U; b++)
+  {
+    host_mmio_set(&adc_m, ADC_REG(b, CR), (((b == a) ? value : host_mmio_get(&adc_m, ADC_REG(b, CR))) &
+                                           ~ADC_CR_RS) | adc.cr[b]);
+  }
+}
+
+static void adc_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  uint32_t a = offset / (ADC2_BASE - ADC1_BASE);
+  uint32_t r = offset % (ADC2_BASE - ADC1_BASE);
+
+  (void)m;
+  (void)size;
+  if((RCC->AHB1ENR & RCC_AHB1ENR_ADC12EN) == 0U)
+  {
+    adc.bad++;
+  }
+  if(offset == COMMON_REG(CCR))
+  {
+    /* Only with both ADCs off */
+    if(((adc.cr[0] | adc.cr[1]) & ADC_CR_ADEN) != 0U)
+    {
+      adc.bad++;
+    }
+    return;
+  }
+  if(a > 1U)
+  {
+    return;
+  }
+  switch(r)
+  {
+  case offsetof(ADC_TypeDef, CR):
+    adc_cr(a, value);
+    break;
+  case offsetof(ADC_TypeDef, ISR):
+    if((adc.isr[a] & value & ADC_ISR_OVR) != 0U)
+    {
+      adc.ovr_cleared++;
+    }
+    adc.isr[a] &= ~value;
+    break;
+  case offsetof(ADC_TypeDef, IER):
+    if(((value & ADC_IER_OVRIE) != 0U) && ((adc.isr[a] & ADC_ISR_OVR) != 0U))
+    {
+      host_irq_raise(adc_isr_fn);
+    }
+    break;
+  case offsetof(ADC_TypeDef, DIFSEL):
+    if((adc.cr[a] & ADC_CR_ADEN) != 0U)
+    {
+      adc.bad++;
+    }
+    break;
+  case offsetof(ADC_TypeDef, CFGR):
+  case offsetof(ADC_TypeDef, CFGR2):
+  case offsetof(ADC_TypeDef, SMPR1):
+  case offsetof(ADC_TypeDef, SMPR2):
+  case offsetof(ADC_TypeDef, PCSEL):
+  case offsetof(ADC_TypeDef, SQR1):
+    if((adc.cr[a] & ADC_CR_ADSTART) != 0U)
+    {
+      adc.bad++;
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+/* The DMA model ---------------------------------------------------------------*/
+static uint32_t dma_reg(uint32_t offset)
+{
+  return host_mmio_get(&dma_m, offset);
+}
+
+static void dma_isr_fn(void)
+{
+  uint32_t ar = (dma.ct != 0U) ? STREAM_REG(M0AR) : STREAM_REG(M1AR);
+  uint32_t before = dma_reg(ar);
+
+  HAL_DMA_IRQHandler(&hdma);
+  dma.completions++;
+  dma.swaps += (dma_reg(ar) != before) ? 1U : 0U;
+}
+
+/* The DMA switches to memory ct and reads its address */
+static void dma_start_fill(void)
+{
+  fill_t *f = &fills[dma.fill % FILLS];
+  uint32_t i;
+
+  dma.addr = dma_reg((dma.ct != 0U) ? STREAM_REG(M1AR) : STREAM_REG(M0AR));
+  dma.pos = 0U;
+  i = block_index(dma.addr);
+  if((i == ADC_PIPE_BLOCKS) || (dma.addr == dma_reg((dma.ct != 0U) ? STREAM_REG(M0AR) : STREAM_REG(M1AR))))
+  {
+    dma.bad++;
+  }
+  else if(cons.owner[i] != 0U)
+  {
+    dma.owned++;
+  }
+  if((dma.fill >= 2U) && (dma.addr == dma.last_addr[dma.ct]))
+  {
+    dma.reused++;
+  }
+  dma.last_addr[dma.ct] = dma.addr;
+  f->num = dma.fill;
+  f->addr = dma.addr;
+}
+
+static uint32_t dma_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  (void)m;
+  if(offset == DMA_REG(LISR))
+  {
+    return dma.isr;
+  }
+  if(offset == DMA_REG(HISR))
+  {
+    return 0U;
+  }
+  if((offset == STREAM_REG(CR)) && (dma.enabled != 0U))
+  {
+    return (current & ~DMA_SxCR_CT) | ((dma.ct != 0U) ? DMA_SxCR_CT : 0U);
+  }
+  if((offset == STREAM_REG(NDTR)) && (dma.enabled != 0U))
+  {
+    return dma.reload - dma.pos;
+  }
+  return current;
+}
+
+static void dma_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  uint32_t cr;
+
+  (void)m;
+  (void)size;
+  if(offset == DMA_REG(LIFCR))
+  {
+    dma.isr &= ~(value & 0x3DU);
+  }
+  else if((offset == STREAM_REG(M0AR)) || (offset == STREAM_REG(M1AR)))
+  {
+    if((dma.enabled != 0U) && (dma.ct == ((offset == STREAM_REG(M1AR)) ? 1U : 0U)))
+    {
+      dma.bad_ar++;
+    }
+  }
+  else if(offset == STREAM_REG(CR))
+  {
+    if(((value & DMA_SxCR_EN) != 0U) && (dma.enabled == 0U))
+    {
+      /* Double buffer, peripheral to memory, word to word, from CDR */
+      cr = value & (DMA_SxCR_DBM | DMA_SxCR_DIR | DMA_SxCR_MINC | DMA_SxCR_PINC | DMA_SxCR_MSIZE | DMA_SxCR_PSIZE);
+      if((cr != (DMA_SxCR_DBM | DMA_SxCR_MINC | DMA_SxCR_MSIZE_1 | DMA_SxCR_PSIZE_1)) ||
+         (dma_reg(STREAM_REG(PAR)) != (uint32_t)&ADC12_COMMON->CDR) || (dma_reg(STREAM_REG(NDTR)) != PAIRS))
+      {
+        dma.bad++;
+      }
+      dma.enabled = 1U;
+      dma.ct = ((value & DMA_SxCR_CT) != 0U) ? 1U : 0U;
+      dma.reload = dma_reg(STREAM_REG(NDTR));
+      dma.fill = 0U;
+      dma_start_fill();
+    }
+    else if((value & DMA_SxCR_EN) == 0U)
+    {
+      dma.enabled = 0U;
+      dma.irq_t = NEVER;
+    }
+  }
+}
+
+/* One conversion pair: to the DMA, or an overrun when the DMA misses it */
+static void convert(void)
+{
+  uint64_t src;
+  uint32_t *dst;
+  uint32_t x;
+
+  if(adc.running == 0U)
+  {
+    return;
+  }
+  src = adc.src++;
+  if((dma.enabled == 0U) || ((run->ovr != 0U) && ((rnd() & 0xFFFFU) < run->ovr)))
+  {
+    x = (dma.enabled == 0U) ? 2U : (rnd() % 3U);
+    if(x != 1U)
+    {
+      adc_ovr(0U);
+    }
+    if(x != 0U)
+    {
+      adc_ovr(1U);
+    }
+    host_irq_poll();
+    return;
+  }
+
+  dst = (uint32_t *)(uintptr_t)dma.addr;
+  dst[dma.pos] = (uint32_t)sample(2U * src, adc.bits, adc.ratio, adc.shift) |
+                 ((uint32_t)sample(2U * src + 1U, adc.bits, adc.ratio, adc.shift) << 16);
+  fills[dma.fill % FILLS].src[dma.pos] = (uint32_t)src;
+  if(++dma.pos == dma.reload)
+  {
+    dma.isr |= DMA_S0_TC;
+    if((dma_reg(STREAM_REG(CR)) & DMA_SxCR_TCIE) != 0U)
+    {
+      /* The previous one still pending would be merged into this one */
+      dma.bad += (dma.irq_t != NEVER) ? 1U : 0U;
+      dma.irq_t = now + (rnd() % (run->latency + 1U));
+      dma.irq_fill = dma.fill;
+    }
+    dma.fill++;
+    dma.ct ^= 1U;
+    dma_start_fill();
+  }
+}
+
+/* The consumer ----------------------------------------------------------------*/
+/* From the DMA interrupt */
+static void on_block(adc_pipe_t *p, const adc_pipe_block_t *b)
+{
+  uint32_t i = block_index((uint32_t)(uintptr_t)b->samples);
+
+  (void)p;
+  if((b->seq != dma.irq_fill) || (fills[b->seq % FILLS].addr != (uint32_t)(uintptr_t)b->samples))
+  {
+    cons.wrong_fill++;
+  }
+  if((i == ADC_PIPE_BLOCKS) || (cons.owner[i] != 0U))
+  {
+    cons.wrong_owner++;
+  }
+  else
+  {
+    cons.owner[i] = 1U;
+  }
+  if(b->overruns != adc.ovr_cleared - cons.ovr_mark)
+  {
+    cons.bad_ovr++;
+  }
+  cons.ovr_mark = adc.ovr_cleared;
+  cons.queued++;
+}
+
+static void take(const adc_pipe_block_t *b)
+{
+  const fill_t *f = &fills[b->seq % FILLS];
+  uint32_t i = block_index((uint32_t)(uintptr_t)b->samples);
+  uint32_t j;
+
+  if((i == ADC_PIPE_BLOCKS) || (cons.owner[i] != 1U))
+  {
+    cons.wrong_owner++;
+    return;
+  }
+  cons.owner[i] = 2U;
+  if(b->seq < cons.next_seq)
+  {
+    cons.order++;
+  }
+  else
+  {
+    cons.gaps += b->seq - cons.next_seq;
+    cons.next_seq = b->seq + 1U;
+  }
+
+  /* Sample order: the master's result of a pair first */
+  if(f->num != b->seq)
+  {
+    cons.corrupt++;
+  }
+  else
+  {
+    for(j = 0U; j < PAIRS; j++)
+    {
+      if((b->samples[2U * j] != sample(2U * (uint64_t)f->src[j], run->bits, run->ratio, run->shift)) ||
+         (b->samples[2U * j + 1U] != sample(2U * (uint64_t)f->src[j] + 1U, run->bits, run->ratio, run->shift)))
+      {
+        cons.corrupt++;
+        break;
+      }
+    }
+  }
+  memcpy(cons.copy[i], b->samples, sizeof(cons.copy[i]));
+  cons.held[i] = b;
+  cons.until[i] = now + (rnd() % (run->hold + 1U));
+  cons.got++;
+}
+
+/* Worked on in place, then back to the pool */
+static void give_back(uint32_t i)
+{
+  uint32_t j;
+
+  if(memcmp(cons.copy[i], cons.held[i]->samples, sizeof(cons.copy[i])) != 0)
+  {
+    cons.torn++;
+  }
+  for(j = 0U; j < ADC_PIPE_BLOCK_SAMPLES; j++)
+  {
+    cons.held[i]->samples[j] = (uint16_t)rnd();
+  }
+  cons.owner[i] = 0U;
+  adc_pipe_release(&pipe, cons.held[i]);
+  cons.held[i] = NULL;
+}
+
+static void consume(uint32_t drain)
+{
+  const adc_pipe_block_t *b;
+  uint32_t i;
+
+  if((drain == 0U) && (now < cons.stall_until))
+  {
+    return;
+  }
+  while((b = adc_pipe_get(&pipe)) != NULL)
+  {
+    take(b);
+  }
+  for(i = 0U; i < ADC_PIPE_BLOCKS; i++)
+  {
+    if((cons.held[i] != NULL) && ((drain != 0U) || (now >= cons.until[i])))
+    {
+      give_back(i);
+    }
+  }
+  if((run->stall != 0U) && ((rnd() & 0xFFU) < run->stall))
+  {
+    cons.stall_until = now + (rnd() % (run->stall_fills * PAIRS + 1U));
+  }
+}
+
+/* The runs --------------------------------------------------------------------*/
+static uint32_t res_code(uint32_t revid, uint32_t bits)
+{
+  switch(bits)
+  {
+  case 14U:
+    return (revid > REV_ID_Y) ? 5U : 1U;
+  case 12U:
+    return (revid > REV_ID_Y) ? 6U : 2U;
+  case 10U:
+    return 3U;
+  case 8U:
+    return (revid > REV_ID_Y) ? 7U : 4U;
+  default:
+    return 0U;
+  }
+}
+
+/* Registers as the pipe has programmed them, before the first start */
+static void check_registers(void)
+{
+  uint32_t ccr = host_mmio_get(&adc_m, COMMON_REG(CCR));
+  uint32_t ch = run->channel;
+  uint32_t smpr;
+  uint32_t a;
+
+  HOST_CHECK_EQ(ccr & ADC_CCR_DUAL, 7UL << ADC_CCR_DUAL_Pos);
+  HOST_CHECK_EQ(ccr & ADC_CCR_DAMDF, 2UL << ADC_CCR_DAMDF_Pos);
+  HOST_CHECK_EQ((ccr & ADC_CCR_DELAY) >> ADC_CCR_DELAY_Pos, run->delay);
+  HOST_CHECK_EQ(ccr & (ADC_CCR_CKMODE | ADC_CCR_PRESC), 1UL << ADC_CCR_PRESC_Pos);
+  for(a = 0U; a < 2U; a++)
+  {
+    HOST_CHECK_EQ(host_mmio_get(&adc_m, ADC_REG(a, CR)) & (ADC_CR_BOOST | ADC_CR_DEEPPWD | ADC_CR_ADVREGEN),
+                  run->boost | ADC_CR_ADVREGEN);
+    HOST_CHECK_EQ(adc.lin[a], 1U);
+    HOST_CHECK_EQ(adc.cr[a], 0U);
+    HOST_CHECK_EQ((host_mmio_get(&adc_m, ADC_REG(a, CFGR)) & ADC_CFGR_RES) >> ADC_CFGR_RES_Pos,
+                  res_code(run->revid, run->bits));
+    HOST_CHECK_EQ(host_mmio_get(&adc_m, ADC_REG(a, SQR1)), ch << ADC_SQR1_SQ1_Pos);
+    HOST_CHECK_EQ(host_mmio_get(&adc_m, ADC_REG(a, PCSEL)), 1UL << ch);
+    HOST_CHECK_EQ(host_mmio_get(&adc_m, ADC_REG(a, DIFSEL)) & (1UL << ch), 0U);
+    smpr = (ch < 10U) ? (host_mmio_get(&adc_m, ADC_REG(a, SMPR1)) >> (3U * ch)) :
+                        (host_mmio_get(&adc_m, ADC_REG(a, SMPR2)) >> (3U * (ch - 10U)));
+    HOST_CHECK_EQ(smpr & 7U, run->smp);
+  }
+}
+
+/* Registers at reset, the ADC12 clock off, the kernel clock set up */
+static void reset(void)
+{
+  uint32_t off;
+
+  for(off = 0U; off < adc_m.size; off += 4U)
+  {
+    host_mmio_set(&adc_m, off, 0U);
+  }
+  host_mmio_set(&adc_m, ADC_REG(0U, CR), ADC_CR_DEEPPWD);
+  host_mmio_set(&adc_m, ADC_REG(1U, CR), ADC_CR_DEEPPWD);
+  memset(&adc, 0, sizeof(adc));
+  DBGMCU->IDCODE = (run->revid << 16) | 0x450U;
+  RCC->AHB1ENR &= ~RCC_AHB1ENR_ADC12EN;
+  if(run->ckper == PLL2P_48MHZ)
+  {
+    /* HSI / 4 * 24 / 8 */
+    __HAL_RCC_ADC_CONFIG(RCC_ADCCLKSOURCE_PLL2);
+    RCC->CR |= RCC_CR_HSIDIVF;
+    RCC->PLLCKSELR = RCC_PLLSOURCE_HSI | (4UL << RCC_PLLCKSELR_DIVM2_Pos);
+    RCC->PLL2DIVR = (23UL << RCC_PLL2DIVR_N2_Pos) | (7UL << RCC_PLL2DIVR_P2_Pos);
+    RCC->PLLCFGR &= ~RCC_PLLCFGR_PLL2FRACEN;
+  }
+  else
+  {
+    __HAL_RCC_ADC_CONFIG(RCC_ADCCLKSOURCE_CLKP);
+    __HAL_RCC_CLKP_CONFIG(run->ckper);
+  }
+  HAL_RCC_ClockCacheInvalidate();
+}
+
+/* Settings the pipe refuses */
+static void test_settings(void)
+{
+  adc_pipe_t bad;
+
+  memset(&bad, 0, sizeof(bad));
+  bad.hdma = &hdma;
+  bad.channel = 20U;
+  bad.resolution = 12U;
+  bad.ratio = 1U;
+  HOST_CHECK_EQ(adc_pipe_init(&bad), HAL_ERROR);
+  bad.channel = 19U;
+  bad.resolution = 11U;
+  HOST_CHECK_EQ(adc_pipe_init(&bad), HAL_ERROR);
+  bad.resolution = 12U;
+  bad.ratio = 1025U;
+  HOST_CHECK_EQ(adc_pipe_init(&bad), HAL_ERROR);
+  bad.ratio = 2U;
+  bad.shift = 12U;
+  HOST_CHECK_EQ(adc_pipe_init(&bad), HAL_ERROR);
+  bad.shift = 1U;
+  bad.delay = 16U;
+  HOST_CHECK_EQ(adc_pipe_init(&bad), HAL_ERROR);
+  bad.delay = 0U;
+  bad.hdma = NULL;
+  HOST_CHECK_EQ(adc_pipe_init(&bad), HAL_ERROR);
+  HOST_CHECK_EQ(adc.bad, 0U);
+}
+
+static void segment(uint32_t *blocks, uint32_t *dropped, uint32_t *overruns)
+{
+  uint64_t end;
+  uint64_t look = 0U;
+  uint32_t pending;
+
+  memset(&cons, 0, sizeof(cons));
+  memset(&dma, 0, sizeof(dma));
+  dma.irq_t = NEVER;
+  adc.ovr_set = 0U;
+  adc.ovr_cleared = 0U;
+
+  HOST_CHECK_EQ(adc_pipe_start(&pipe), HAL_OK);
+  HOST_CHECK_EQ(adc_pipe_running(&pipe), 1U);
+  HOST_CHECK_EQ(adc.running, 1U);
+  HOST_CHECK_EQ(dma.enabled, 1U);
+  for(end = now + (uint64_t)run->fills * PAIRS; now < end; )
+  {
+    now++;
+    convert();
+    if(now >= dma.irq_t)
+    {
+      dma.irq_t = NEVER;
+      host_irq_raise(dma_isr_fn);
+      host_irq_poll();
+    }
+    if(now >= look)
+    {
+      consume(0U);
+      look = now + 1U + (rnd() % 256U);
+    }
+  }
+  HOST_CHECK_EQ(adc_pipe_stop(&pipe), HAL_OK);
+  HOST_CHECK_EQ(adc_pipe_running(&pipe), 0U);
+  HOST_CHECK_EQ(adc.running, 0U);
+  HOST_CHECK_EQ(adc.cr[0] | adc.cr[1], 0U);
+  HOST_CHECK_EQ((host_mmio_get(&adc_m, ADC_REG(0U, IER)) | host_mmio_get(&adc_m, ADC_REG(1U, IER))) & ADC_IER_OVRIE, 0U);
+  HOST_CHECK_EQ(dma.enabled, 0U);
+  consume(1U);
+
+  HOST_CHECK_EQ(adc.bad, 0U);
+  HOST_CHECK_EQ(dma.bad, 0U);
+  HOST_CHECK_EQ(dma.bad_ar, 0U);
+  HOST_CHECK_EQ(dma.owned, 0U);
+  HOST_CHECK_EQ(cons.wrong_fill, 0U);
+  HOST_CHECK_EQ(cons.wrong_owner, 0U);
+  HOST_CHECK_EQ(cons.corrupt, 0U);
+  HOST_CHECK_EQ(cons.torn, 0U);
+  HOST_CHECK_EQ(cons.order, 0U);
+  HOST_CHECK_EQ(cons.bad_ovr, 0U);
+  HOST_CHECK_EQ(pipe.stats.dma_errors, 0U);
+
+  /* Every fill whose interrupt came is delivered or dropped, one address
+     rewrite per delivered block; gaps are dropped fills */
+  HOST_CHECK_EQ(cons.queued, pipe.stats.blocks);
+  HOST_CHECK_EQ(cons.got, pipe.stats.blocks);
+  HOST_CHECK_EQ(dma.completions, pipe.stats.blocks + pipe.stats.dropped);
+  HOST_CHECK((dma.fill - dma.completions) <= 1U);
+  HOST_CHECK_EQ(dma.swaps, pipe.stats.blocks);
+  HOST_CHECK_EQ(cons.next_seq - cons.gaps, cons.got);
+  HOST_CHECK(cons.gaps <= pipe.stats.dropped);
+  HOST_CHECK(dma.reused <= pipe.stats.dropped);
+  HOST_CHECK(cons.got >= run->fills / 2U);
+  if(run->stall == 0U)
+  {
+    HOST_CHECK_EQ(pipe.stats.dropped, 0U);
+    HOST_CHECK_EQ(dma.reused, 0U);
+  }
+  else
+  {
+    HOST_CHECK(cons.gaps != 0U);
+    HOST_CHECK(dma.reused != 0U);
+  }
+
+  /* Each overrun flag counted once when cleared, or still pending */
+  pending = (((adc.isr[0] & ADC_ISR_OVR) != 0U) ? 1U : 0U) + (((adc.isr[1] & ADC_ISR_OVR) != 0U) ? 1U : 0U);
+  HOST_CHECK_EQ(pipe.stats.overruns, adc.ovr_cleared);
+  HOST_CHECK_EQ(adc.ovr_cleared + pending, adc.ovr_set);
+  HOST_CHECK((adc.ovr_set != 0U) == (run->ovr != 0U));
+
+  *blocks += pipe.stats.blocks;
+  *dropped += pipe.stats.dropped;
+  *overruns += pipe.stats.overruns;
+}
+
+static void run_pipe(const run_t *r)
+{
+  uint32_t blocks = 0U;
+  uint32_t dropped = 0U;
+  uint32_t overruns = 0U;
+  uint32_t i;
+
+  run = r;
+  reset();
+  pipe.channel = r->channel;
+  pipe.resolution = r->bits;
+  pipe.sampling_time = r->smp;
+  pipe.delay = r->delay;
+  pipe.ratio = r->ratio;
+  pipe.shift = r->shift;
+  HOST_CHECK_EQ(adc_pipe_init(&pipe), HAL_OK);
+  HOST_CHECK_EQ(adc.bad, 0U);
+  check_registers();
+
+  for(i = 0U; i < r->starts; i++)
+  {
+    segment(&blocks, &dropped, &overruns);
+  }
+  printf("  %-36s %4u blocks, %3u dropped, %3u overruns\n", r->name, (unsigned)blocks,
+         (unsigned)dropped, (unsigned)overruns);
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  static const run_t runs[] =
+  {
+    {"12 bit tones, keeping up", REV_ID_V, RCC_CLKPSOURCE_HSI, ADC_CR_BOOST_1, 12U, 1U, 0U,
+     3U, ADC_PIPE_SMP_8C5, 5U, 1U, 48U, 300U, 300U, 0U, 0U, 0U, 1U},
+    {"16 bit ramp, channel 11", REV_ID_V, RCC_CLKPSOURCE_CSI, 0U, 16U, 1U, 0U,
+     11U, ADC_PIPE_SMP_2C5, 7U, 0U, 32U, 200U, 200U, 0U, 0U, 0U, 1U},
+    {"14 bit noise, 4x >> 2, rev Y", REV_ID_Y, RCC_CLKPSOURCE_HSI, ADC_CR_BOOST_0, 14U, 4U, 2U,
+     5U, ADC_PIPE_SMP_16C5, 3U, 2U, 32U, 300U, 300U, 0U, 0U, 0U, 1U},
+    {"12 bit tones, 16x to 16 bit, rev Y", REV_ID_Y, RCC_CLKPSOURCE_HSE, 0U, 12U, 16U, 0U,
+     19U, ADC_PIPE_SMP_1C5, 2U, 1U, 24U, 300U, 300U, 0U, 0U, 0U, 1U},
+    {"10 bit ramp, 8x >> 1, overruns", REV_ID_V, PLL2P_48MHZ, ADC_CR_BOOST_0, 10U, 8U, 1U,
+     0U, ADC_PIPE_SMP_32C5, 1U, 0U, 48U, 300U, 300U, 0U, 0U, 40U, 1U},
+    {"8 bit noise, 2x, pool underrun", REV_ID_V, RCC_CLKPSOURCE_CSI, 0U, 8U, 2U, 0U,
+     7U, ADC_PIPE_SMP_64C5, 0U, 2U, 64U, 300U, 2000U, 6U, 6U, 0U, 2U},
+    {"late interrupts, stalls, overruns", REV_ID_Y, RCC_CLKPSOURCE_CSI, 0U, 12U, 1U, 0U,
+     14U, ADC_PIPE_SMP_810C5, 2U, 1U, 64U, PAIRS - 64U, 1500U, 16U, 4U, 24U, 2U},
+  };
+  uint32_t i;
+
+  adc_m.base = ADC1_BASE;
+  adc_m.size = ADC12_COMMON_BASE - ADC1_BASE + sizeof(ADC_Common_TypeDef);
+  adc_m.read = adc_read;
+  adc_m.write = adc_write;
+  host_mmio_attach(&adc_m);
+  dma_m.base = DMA1_BASE;
+  dma_m.size = sizeof(DMA_TypeDef) + sizeof(DMA_Stream_TypeDef);
+  dma_m.read = dma_read;
+  dma_m.write = dma_write;
+  host_mmio_attach(&dma_m);
+
+  hdma.Instance = DMA1_Stream0;
+  hdma.Init.Request = DMA_REQUEST_ADC1;
+  hdma.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  hdma.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma.Init.MemInc = DMA_MINC_ENABLE;
+  hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+  hdma.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+  hdma.Init.Mode = DMA_CIRCULAR;
+  hdma.Init.Priority = DMA_PRIORITY_HIGH;
+  hdma.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  HOST_CHECK_EQ(HAL_DMA_Init(&hdma), HAL_OK);
+  pipe.hdma = &hdma;
+  pipe.callback = on_block;
+
+  run = &runs[0];
+  reset();
+  test_settings();
+  for(i = 0U; i < (sizeof(runs) / sizeof(runs[0])); i++)
+  {
+    run_pipe(&runs[i]);
+  }
+
+  host_mmio_detach(&dma_m);
+  host_mmio_detach(&adc_m);
+  return host_result();
+}
@@ -0,0 +1,30 @@
+/* Header includes -----------------------------------------------------------*/
+#include "bench.h"
+#include <stdio.h>
+
+/* Exported variables --------------------------------------------------------*/
+uint32_t bench_overhead;
+
+/* Function definitions ------------------------------------------------------*/
+void bench_init(void)
+{
+  delay_init();
+  bench_overhead = 0U;
+  BENCH_TIME(bench_overhead, (void)0, (void)0);
+}
+
+void bench_print(const bench_row_t *rows, uint32_t n, const char *fast, const char *ref)
+{
+  uint32_t i;
+
+  printf("%-14s %5s %9s %9s %8s %7s\n", "kernel", "n", fast, ref, "cyc/n", "speedup");
+  for(i = 0U; i < n; i++)
+  {
+    const bench_row_t *r = &rows[i];
+
+    printf("%-14s %5lu %9lu %9lu %8.2f %6.2fx\n", r->kernel, (unsigned long)r->len,
+           (unsigned long)r->cycles, (unsigned long)r->ref_cycles,
+           (double)r->cycles / (double)r->len,
+           (r->cycles != 0U) ? ((double)r->ref_cycles / (double)r->cycles) : 0.0);
+  }
+}
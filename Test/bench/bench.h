@@ -0,0 +1,59 @@
+#ifndef __BENCH_H
+#define __BENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "delay.h"
+
+/* Timing and the table shared by the benchmarks: each row times a kernel
+   against its reference on the DWT cycle counter (delay_cycles()). */
+
+/* Exported constants --------------------------------------------------------*/
+#define BENCH_RUNS              5U
+
+/* Exported macro ------------------------------------------------------------*/
+/* Best of BENCH_RUNS, so the first run can warm the caches, less the cost
+   of reading the counter. prep runs before each run, untimed. */
+#define BENCH_TIME(best, prep, stmt)                            \
+  do                                                            \
+  {                                                             \
+    uint32_t run_;                                              \
+    uint32_t t_;                                                \
+    (best) = UINT32_MAX;                                        \
+    for(run_ = 0U; run_ < BENCH_RUNS; run_++)                   \
+    {                                                           \
+      prep;                                                     \
+      t_ = delay_cycles();                                      \
+      stmt;                                                     \
+      t_ = delay_cycles() - t_;                                 \
+      (best) = (t_ < (best)) ? t_ : (best);                     \
+    }                                                           \
+    (best) = ((best) > bench_overhead) ? ((best) - bench_overhead) : 0U; \
+  } while(0)
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  const char *kernel;
+  uint32_t len;                 /* elements */
+  uint32_t cycles;              /* the kernel, best of the runs */
+  uint32_t ref_cycles;          /* its reference */
+} bench_row_t;
+
+/* Exported variables --------------------------------------------------------*/
+extern uint32_t bench_overhead;
+
+/* Function definitions ------------------------------------------------------*/
+/* Start the counter and measure bench_overhead */
+void bench_init(void);
+/* rows as a table, fast and ref naming the two columns */
+void bench_print(const bench_row_t *rows, uint32_t n, const char *fast, const char *ref);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
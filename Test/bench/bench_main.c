@@ -0,0 +1,149 @@
+/* Header includes -----------------------------------------------------------*/
+#include "dsp_bench.h"
+#include "trig_bench.h"
+#include "soft_timer_bench.h"
+#include "eth_zc_bench.h"
+#include "delay.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Host runner of the benchmarks. It stands in for delay.c with a cycle
+   counter that follows host time at SystemCoreClock, so the tables come
+   out in the units the target prints but measure the host. For
+   eth_zc_bench() a model of the ETH DMA gathers the transmit ring at each
+   tail pointer write and, with MACCR.LM set, writes the frame to the
+   receive ring at once, as the MAC loopback does without the wire time. */
+
+/* Private macro -------------------------------------------------------------*/
+#define REG(r)                  ((uint32_t)offsetof(ETH_TypeDef, r))
+
+/* Private variables ---------------------------------------------------------*/
+static uint64_t cycles_origin;
+
+static ETH_HandleTypeDef heth;
+static host_mmio_t eth_m;
+static uint32_t eth_rx_idx;
+static uint32_t eth_tx_idx;
+static uint32_t eth_tx_len;
+static uint8_t eth_frame[2U * ETH_ZC_BUF_SIZE];
+
+/* Private functions ---------------------------------------------------------*/
+static ETH_DMADescTypeDef *eth_ring(uint32_t dlar)
+{
+  return (ETH_DMADescTypeDef *)(uintptr_t)host_mmio_get(&eth_m, dlar);
+}
+
+/* All of the frame or nothing, when the ring has no room */
+static void eth_loop(void)
+{
+  ETH_DMADescTypeDef *ring = eth_ring(REG(DMACRDLAR));
+  ETH_DMADescTypeDef *d;
+  uint32_t n = host_mmio_get(&eth_m, REG(DMACRDRLR)) + 1U;
+  uint32_t need = (eth_tx_len + ETH_ZC_BUF_SIZE - 1U) / ETH_ZC_BUF_SIZE;
+  uint32_t chunk;
+  uint32_t pos;
+  uint32_t k;
+
+  for(k = 0U; k < need; k++)
+  {
+    if((ring[(eth_rx_idx + k) % n].DESC3 & ETH_DMARXNDESCRF_OWN) == 0U)
+    {
+      return;
+    }
+  }
+  for(pos = 0U; pos < eth_tx_len; pos += chunk)
+  {
+    d = &ring[eth_rx_idx];
+    chunk = ((eth_tx_len - pos) > ETH_ZC_BUF_SIZE) ? ETH_ZC_BUF_SIZE : (eth_tx_len - pos);
+    memcpy((void *)(uintptr_t)d->DESC0, &eth_frame[pos], chunk);
+    d->DESC0 = 0U;
+    d->DESC1 = 0U;
+    d->DESC2 = 0U;
+    d->DESC3 = ((pos == 0U) ? ETH_DMARXNDESCWBF_FD : 0U) |
+               (((pos + chunk) == eth_tx_len) ? (ETH_DMARXNDESCWBF_LD | eth_tx_len) : 0U);
+    eth_rx_idx = (eth_rx_idx + 1U) % n;
+  }
+}
+
+static void eth_tx(uint32_t tail)
+{
+  ETH_DMADescTypeDef *ring = eth_ring(REG(DMACTDLAR));
+  ETH_DMADescTypeDef *d;
+  uint32_t n = host_mmio_get(&eth_m, REG(DMACTDRLR)) + 1U;
+  uint32_t len;
+
+  while((eth_tx_idx != tail) && ((ring[eth_tx_idx].DESC3 & ETH_DMATXNDESCRF_OWN) != 0U))
+  {
+    d = &ring[eth_tx_idx];
+    len = d->DESC2 & ETH_DMATXNDESCRF_B1L;
+    if((eth_tx_len + len) <= sizeof(eth_frame))
+    {
+      memcpy(&eth_frame[eth_tx_len], (const void *)(uintptr_t)d->DESC0, len);
+      eth_tx_len += len;
+    }
+    if((d->DESC3 & ETH_DMATXNDESCRF_LD) != 0U)
+    {
+      if((host_mmio_get(&eth_m, REG(MACCR)) & ETH_MACCR_LM) != 0U)
+      {
+        eth_loop();
+      }
+      eth_tx_len = 0U;
+    }
+    d->DESC3 &= ~ETH_DMATXNDESCRF_OWN;
+    eth_tx_idx = (eth_tx_idx + 1U) % n;
+  }
+}
+
+static void eth_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  if(offset == REG(DMAMR))
+  {
+    /* Software reset is over at once */
+    host_mmio_set(m, offset, value & ~ETH_DMAMR_SWR);
+  }
+  else if(offset == REG(DMACRDLAR))
+  {
+    eth_rx_idx = 0U;
+  }
+  else if(offset == REG(DMACTDLAR))
+  {
+    eth_tx_idx = 0U;
+    eth_tx_len = 0U;
+  }
+  else if(offset == REG(DMACTDTPR))
+  {
+    eth_tx((value - host_mmio_get(m, REG(DMACTDLAR))) / sizeof(ETH_DMADescTypeDef) %
+           (host_mmio_get(m, REG(DMACTDRLR)) + 1U));
+  }
+}
+
+/* Function definitions ------------------------------------------------------*/
+void delay_init(void)
+{
+  cycles_origin = host_ns();
+}
+
+uint32_t delay_cycles(void)
+{
+  return (uint32_t)(((host_ns() - cycles_origin) * SystemCoreClock) / 1000000000U);
+}
+
+int main(void)
+{
+  static uint8_t mac[6] = {0x02U, 0x00U, 0x00U, 0x11U, 0x22U, 0x33U};
+
+  SystemCoreClock = 480000000U;
+  dsp_bench();
+  trig_bench();
+  soft_timer_bench();
+
+  eth_m.base = (uintptr_t)ETH;
+  eth_m.size = sizeof(ETH_TypeDef);
+  eth_m.write = eth_write;
+  host_mmio_attach(&eth_m);
+  heth.Instance = ETH;
+  heth.Init.MACAddr = mac;
+  heth.Init.MediaInterface = HAL_ETH_RMII_MODE;
+  eth_zc_bench(&heth);
+  return 0;
+}
@@ -0,0 +1,140 @@
+/* Header includes -----------------------------------------------------------*/
+#include "dsp_bench.h"
+#include "dsp.h"
+
+/* Private macro -------------------------------------------------------------*/
+#define BENCH_LEN               256U
+#define BENCH_TAPS              32U
+#define BENCH_STAGES            4U
+#define BENCH_FFT               1024U
+
+#define BENCH_ROW(name, n, fast, ref)                           \
+  do                                                            \
+  {                                                             \
+    bench_row_t *row_ = &dsp_bench_rows[rows++];                \
+    row_->kernel = (name);                                      \
+    row_->len = (n);                                            \
+    BENCH_TIME(row_->cycles, (void)0, fast);                    \
+    BENCH_TIME(row_->ref_cycles, (void)0, ref);                 \
+  } while(0)
+
+/* Private variables ---------------------------------------------------------*/
+static int16_t q15_a[BENCH_LEN];
+static int16_t q15_b[BENCH_LEN];
+static int16_t q15_o[BENCH_LEN];
+static int32_t q31_a[BENCH_LEN];
+static int32_t q31_b[BENCH_LEN];
+static int32_t q31_o[BENCH_LEN];
+static float f32_a[BENCH_LEN];
+static float f32_b[BENCH_LEN];
+static float f32_o[BENCH_LEN];
+
+static int16_t q15_c[5U * BENCH_STAGES];
+static int32_t q31_c[5U * BENCH_STAGES];
+static float f32_c[5U * BENCH_STAGES];
+static int16_t q15_s[DSP_FIR_STATE(BENCH_TAPS, BENCH_LEN)];
+static int32_t q31_s[DSP_FIR_STATE(BENCH_TAPS, BENCH_LEN)];
+static float f32_s[DSP_FIR_STATE(BENCH_TAPS, BENCH_LEN)];
+
+static int16_t fft_tw15[2U * DSP_CFFT_TWIDDLES(BENCH_FFT)];
+static float fft_twf[2U * DSP_CFFT_TWIDDLES(BENCH_FFT)];
+static int16_t fft_q15[2U * BENCH_FFT];
+static float fft_f32[2U * BENCH_FFT];
+
+/* Results go here so the calls are not optimised away */
+static volatile int64_t bench_sink;
+
+/* Exported variables --------------------------------------------------------*/
+bench_row_t dsp_bench_rows[DSP_BENCH_ROWS];
+
+/* Private functions ---------------------------------------------------------*/
+static void bench_fill(void)
+{
+  uint32_t x = 1U;
+  uint32_t i;
+
+  for(i = 0U; i < BENCH_LEN; i++)
+  {
+    x = (x * 1664525U) + 1013904223U;
+    q15_a[i] = (int16_t)(x >> 18);
+    q15_b[i] = (int16_t)(x >> 17);
+    q31_a[i] = (int32_t)(x >> 2);
+    q31_b[i] = (int32_t)x;
+    f32_a[i] = (float)(int32_t)x / 4294967296.0f;
+    f32_b[i] = (float)q15_b[i] / 32768.0f;
+  }
+  for(i = 0U; i < 5U * BENCH_STAGES; i++)
+  {
+    q15_c[i] = (int16_t)(q15_a[i] >> 3);
+    q31_c[i] = q31_a[i] >> 3;
+    f32_c[i] = f32_a[i] / 4.0f;
+  }
+  for(i = 0U; i < 2U * BENCH_FFT; i++)
+  {
+    fft_q15[i] = q15_a[i % BENCH_LEN];
+    fft_f32[i] = f32_a[i % BENCH_LEN];
+  }
+}
+
+/* Function definitions ------------------------------------------------------*/
+void dsp_bench(void)
+{
+  dsp_fir_q15_t fir15;
+  dsp_fir_q31_t fir31;
+  dsp_fir_f32_t firf;
+  dsp_biquad_q15_t bq15;
+  dsp_biquad_q31_t bq31;
+  dsp_biquad_f32_t bqf;
+  dsp_cfft_q15_t fft15;
+  dsp_cfft_f32_t fftf;
+  uint32_t rows = 0U;
+
+  bench_init();
+  bench_fill();
+  dsp_fir_q15_init(&fir15, q15_b, BENCH_TAPS, 1U, q15_s);
+  dsp_fir_q31_init(&fir31, q31_b, BENCH_TAPS, 1U, q31_s);
+  dsp_fir_f32_init(&firf, f32_b, BENCH_TAPS, 1U, f32_s);
+  dsp_biquad_q15_init(&bq15, q15_c, BENCH_STAGES, 1U, q15_s);
+  dsp_biquad_q31_init(&bq31, q31_c, BENCH_STAGES, 1U, q31_s);
+  dsp_biquad_f32_init(&bqf, f32_c, BENCH_STAGES, f32_s);
+  (void)dsp_cfft_q15_init(&fft15, fft_tw15, BENCH_FFT);
+  (void)dsp_cfft_f32_init(&fftf, fft_twf, BENCH_FFT);
+
+  BENCH_ROW("dot_q15", BENCH_LEN, bench_sink = dsp_dot_q15(q15_a, q15_b, BENCH_LEN),
+            bench_sink = dsp_dot_q15_ref(q15_a, q15_b, BENCH_LEN));
+  BENCH_ROW("dot_q31", BENCH_LEN, bench_sink = dsp_dot_q31(q31_a, q31_b, BENCH_LEN),
+            bench_sink = dsp_dot_q31_ref(q31_a, q31_b, BENCH_LEN));
+  BENCH_ROW("dot_f32", BENCH_LEN, bench_sink = (int64_t)dsp_dot_f32(f32_a, f32_b, BENCH_LEN),
+            bench_sink = (int64_t)dsp_dot_f32_ref(f32_a, f32_b, BENCH_LEN));
+  BENCH_ROW("rms_q15", BENCH_LEN, bench_sink = dsp_rms_q15(q15_a, BENCH_LEN),
+            bench_sink = dsp_rms_q15_ref(q15_a, BENCH_LEN));
+  BENCH_ROW("rms_q31", BENCH_LEN, bench_sink = dsp_rms_q31(q31_a, BENCH_LEN),
+            bench_sink = dsp_rms_q31_ref(q31_a, BENCH_LEN));
+  BENCH_ROW("rms_f32", BENCH_LEN, bench_sink = (int64_t)dsp_rms_f32(f32_a, BENCH_LEN),
+            bench_sink = (int64_t)dsp_rms_f32_ref(f32_a, BENCH_LEN));
+  BENCH_ROW("fir_q15", BENCH_LEN, dsp_fir_q15(&fir15, q15_a, q15_o, BENCH_LEN),
+            dsp_fir_q15_ref(&fir15, q15_a, q15_o, BENCH_LEN));
+  BENCH_ROW("fir_q31", BENCH_LEN, dsp_fir_q31(&fir31, q31_a, q31_o, BENCH_LEN),
+            dsp_fir_q31_ref(&fir31, q31_a, q31_o, BENCH_LEN));
+  BENCH_ROW("fir_f32", BENCH_LEN, dsp_fir_f32(&firf, f32_a, f32_o, BENCH_LEN),
+            dsp_fir_f32_ref(&firf, f32_a, f32_o, BENCH_LEN));
+  fir15.factor = 4U;
+  fir31.factor = 4U;
+  firf.factor = 4U;
+  BENCH_ROW("decimate4_q15", BENCH_LEN, dsp_decimate_q15(&fir15, q15_a, q15_o, BENCH_LEN),
+            dsp_decimate_q15_ref(&fir15, q15_a, q15_o, BENCH_LEN));
+  BENCH_ROW("decimate4_q31", BENCH_LEN, dsp_decimate_q31(&fir31, q31_a, q31_o, BENCH_LEN),
+            dsp_decimate_q31_ref(&fir31, q31_a, q31_o, BENCH_LEN));
+  BENCH_ROW("decimate4_f32", BENCH_LEN, dsp_decimate_f32(&firf, f32_a, f32_o, BENCH_LEN),
+            dsp_decimate_f32_ref(&firf, f32_a, f32_o, BENCH_LEN));
+  BENCH_ROW("biquad4_q15", BENCH_LEN, dsp_biquad_q15(&bq15, q15_a, q15_o, BENCH_LEN),
+            dsp_biquad_q15_ref(&bq15, q15_a, q15_o, BENCH_LEN));
+  BENCH_ROW("biquad4_q31", BENCH_LEN, dsp_biquad_q31(&bq31, q31_a, q31_o, BENCH_LEN),
+            dsp_biquad_q31_ref(&bq31, q31_a, q31_o, BENCH_LEN));
+  BENCH_ROW("biquad4_f32", BENCH_LEN, dsp_biquad_f32(&bqf, f32_a, f32_o, BENCH_LEN),
+            dsp_biquad_f32_ref(&bqf, f32_a, f32_o, BENCH_LEN));
+  BENCH_ROW("cfft_q15", BENCH_FFT, dsp_cfft_q15(&fft15, fft_q15), dsp_cfft_q15_ref(&fft15, fft_q15));
+  BENCH_ROW("cfft_f32", BENCH_FFT, dsp_cfft_f32(&fftf, fft_f32), dsp_cfft_f32_ref(&fftf, fft_f32));
+
+  bench_print(dsp_bench_rows, rows, "dsp.c", "dsp_ref.c");
+}
@@ -0,0 +1,38 @@
+#ifndef __DSP_BENCH_H
+#define __DSP_BENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "bench.h"
+
+/* Cycle table of the dsp.c kernels against their dsp_ref.c twins, counted
+   on the DWT cycle counter (delay_cycles()).
+
+   On the board: add Test/bench/bench.c and dsp_bench.c to the project,
+   call dsp_bench() from main() once the clocks and caches are up, and read
+   the table from the terminal I/O window (printf) or dsp_bench_rows in a
+   watch window. Build with DSP_NO_SIMD to measure the fallback.
+
+   On the host, bench_main.c runs the same code against a cycle counter
+   that follows host time at SystemCoreClock: it checks the bench runs, the
+   figures are not the target's. */
+
+/* Exported constants --------------------------------------------------------*/
+#define DSP_BENCH_ROWS          17U
+
+/* Exported variables --------------------------------------------------------*/
+/* len is samples, or FFT points */
+extern bench_row_t dsp_bench_rows[DSP_BENCH_ROWS];
+
+/* Function definitions ------------------------------------------------------*/
+/* Fills dsp_bench_rows and prints it */
+void dsp_bench(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,197 @@
+/* Header includes -----------------------------------------------------------*/
+#include "eth_zc_bench.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private macro -------------------------------------------------------------*/
+#define BENCH_FRAMES            1000U
+/* Polls without a frame before a run gives up: a frame got lost */
+#define BENCH_SPIN              0x100000U
+/* IEEE local experimental EtherType */
+#define BENCH_ETHERTYPE         0x88B5U
+
+#define BENCH_ROW(name, size)                                   \
+  do                                                            \
+  {                                                             \
+    bench_row_t *row_ = &eth_zc_bench_rows[rows++];             \
+    row_->kernel = (name);                                      \
+    row_->len = BENCH_FRAMES;                                   \
+    bench_size = (size);                                        \
+    BENCH_TIME(row_->cycles, bench_prime(), bench_forward_zc(BENCH_FRAMES)); \
+    BENCH_TIME(row_->ref_cycles, bench_prime(), bench_forward_copy(BENCH_FRAMES)); \
+  } while(0)
+
+/* Private variables ---------------------------------------------------------*/
+static const uint8_t *bench_mac;
+static uint32_t bench_size;                     /* bytes per frame, no FCS */
+static uint32_t bench_lost;
+/* Where the copy column keeps a frame between receive and transmit */
+static uint8_t bench_frame[ETH_ZC_BUF_SIZE];
+
+/* Exported variables --------------------------------------------------------*/
+bench_row_t eth_zc_bench_rows[ETH_ZC_BENCH_ROWS];
+
+/* Private functions ---------------------------------------------------------*/
+/* Frames sent that have not come back yet */
+static uint32_t bench_inflight(void)
+{
+  eth_zc_stats_t stats;
+
+  eth_zc_get_stats(&stats);
+  return stats.tx_frames - stats.rx_frames - stats.rx_errors - bench_lost;
+}
+
+/* Takes back every frame still circulating */
+static void bench_drain(void)
+{
+  eth_zc_buf_t *frame;
+  uint32_t spin;
+
+  for(spin = 0U; (bench_inflight() != 0U) && (spin < BENCH_SPIN); spin++)
+  {
+    frame = eth_zc_rx();
+    if(frame != NULL)
+    {
+      eth_zc_free(frame);
+    }
+  }
+  bench_lost += bench_inflight();
+  eth_zc_tx_reclaim();
+}
+
+/* Sends the frames the run forwards, addressed to the MAC itself */
+static void bench_prime(void)
+{
+  eth_zc_buf_t *frame;
+  uint32_t i;
+  uint32_t k;
+
+  bench_drain();
+  for(i = 0U; i < ETH_ZC_BENCH_INFLIGHT; i++)
+  {
+    frame = eth_zc_alloc();
+    if(frame == NULL)
+    {
+      break;
+    }
+    memcpy(&frame->data[0], bench_mac, 6U);
+    memcpy(&frame->data[6], bench_mac, 6U);
+    frame->data[12] = (uint8_t)(BENCH_ETHERTYPE >> 8);
+    frame->data[13] = (uint8_t)BENCH_ETHERTYPE;
+    for(k = 14U; k < bench_size; k++)
+    {
+      frame->data[k] = (uint8_t)(i + k);
+    }
+    frame->len = bench_size;
+    if(eth_zc_tx(frame) != HAL_OK)
+    {
+      eth_zc_free(frame);
+    }
+  }
+}
+
+/* Each frame received goes out again in the buffers it came in */
+static void bench_forward_zc(uint32_t n)
+{
+  eth_zc_buf_t *frame;
+  uint32_t spin = 0U;
+
+  while((n != 0U) && (spin < BENCH_SPIN))
+  {
+    frame = eth_zc_rx();
+    if(frame == NULL)
+    {
+      spin++;
+      continue;
+    }
+    /* The length as sent, without an FCS the MAC may have kept */
+    frame->len = bench_size;
+    if(eth_zc_tx(frame) != HAL_OK)
+    {
+      eth_zc_free(frame);
+    }
+    spin = 0U;
+    n--;
+  }
+}
+
+/* The same through a copy on each side, as a copying driver does it */
+static void bench_forward_copy(uint32_t n)
+{
+  eth_zc_buf_t *frame;
+  eth_zc_buf_t *buf;
+  uint32_t len;
+  uint32_t spin = 0U;
+
+  while((n != 0U) && (spin < BENCH_SPIN))
+  {
+    frame = eth_zc_rx();
+    if(frame == NULL)
+    {
+      spin++;
+      continue;
+    }
+    len = 0U;
+    for(buf = frame; (buf != NULL) && ((len + buf->len) <= sizeof(bench_frame)); buf = buf->next)
+    {
+      memcpy(&bench_frame[len], buf->data, buf->len);
+      len += buf->len;
+    }
+    eth_zc_free(frame);
+
+    frame = eth_zc_alloc();
+    if(frame != NULL)
+    {
+      memcpy(frame->data, bench_frame, bench_size);
+      frame->len = bench_size;
+      if(eth_zc_tx(frame) != HAL_OK)
+      {
+        eth_zc_free(frame);
+      }
+    }
+    spin = 0U;
+    n--;
+  }
+}
+
+static unsigned long bench_fps(uint32_t frames, uint32_t cycles)
+{
+  return (cycles != 0U) ? (unsigned long)(((uint64_t)frames * SystemCoreClock) / cycles) : 0UL;
+}
+
+/* Function definitions ------------------------------------------------------*/
+void eth_zc_bench(ETH_HandleTypeDef *heth)
+{
+  const bench_row_t *r;
+  uint32_t rows = 0U;
+  uint32_t i;
+
+  bench_init();
+  bench_mac = heth->Init.MACAddr;
+  bench_lost = 0U;
+  if(eth_zc_init(heth) != HAL_OK)
+  {
+    printf("eth_zc_init failed\n");
+    return;
+  }
+  HAL_NVIC_DisableIRQ(ETH_IRQn);
+  /* What the MAC sends comes straight back to its receiver */
+  SET_BIT(heth->Instance->MACCR, ETH_MACCR_LM);
+
+  BENCH_ROW("echo 60", 60U);
+  BENCH_ROW("echo 512", 512U);
+  BENCH_ROW("echo 1514", 1514U);
+
+  bench_drain();
+  bench_print(eth_zc_bench_rows, rows, "zero-copy", "copy");
+  printf("%-14s %9s %9s\n", "frames/s", "zero-copy", "copy");
+  for(i = 0U; i < rows; i++)
+  {
+    r = &eth_zc_bench_rows[i];
+    printf("%-14s %9lu %9lu\n", r->kernel, bench_fps(r->len, r->cycles), bench_fps(r->len, r->ref_cycles));
+  }
+  if(bench_lost != 0U)
+  {
+    printf("%lu frames lost, the rows are not valid\n", (unsigned long)bench_lost);
+  }
+}
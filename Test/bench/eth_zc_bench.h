@@ -0,0 +1,47 @@
+#ifndef __ETH_ZC_BENCH_H
+#define __ETH_ZC_BENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "bench.h"
+#include "eth_zc.h"
+
+/* Frames per second through eth_zc.c with the MAC in loopback: each frame
+   received is sent again, ETH_ZC_BENCH_INFLIGHT frames circulating. The
+   zero-copy column forwards the received buffer as it is; the copy column
+   does what a copying driver costs, the frame copied out of the DMA buffer
+   on receive and into a fresh one on transmit. len is frames forwarded;
+   frames/s follow from the cycles at SystemCoreClock.
+
+   On the board: add Test/bench/bench.c, eth_zc_bench.c and eth_zc.c to the
+   project and call eth_zc_bench() from main() once the clocks and caches
+   are up, with heth set as for eth_zc_init() and HAL_ETH_MspInit() giving
+   the ETH its clocks and pins; RMII needs the PHY's reference clock even
+   though no frame leaves the MAC. It masks the ETH interrupt and polls;
+   the ETH is not usable by the application afterwards. At 100 Mbit/s the
+   wire bounds both columns for long frames, the copies show in the short
+   ones.
+
+   On the host, bench_main.c loops the frames back in a model of the ETH
+   DMA. Each tail pointer write traps to it at a cost well above the copies,
+   so the columns come out alike there: the run checks the bench works. */
+
+/* Exported constants --------------------------------------------------------*/
+#define ETH_ZC_BENCH_ROWS       3U
+#define ETH_ZC_BENCH_INFLIGHT   4U
+
+/* Exported variables --------------------------------------------------------*/
+extern bench_row_t eth_zc_bench_rows[ETH_ZC_BENCH_ROWS];
+
+/* Function definitions ------------------------------------------------------*/
+/* Starts the ETH with eth_zc_init(), fills eth_zc_bench_rows and prints it */
+void eth_zc_bench(ETH_HandleTypeDef *heth);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,198 @@
+/* Header includes -----------------------------------------------------------*/
+#include "soft_timer_bench.h"
+#include "soft_timer.h"
+
+/* Private macro -------------------------------------------------------------*/
+#define BENCH_TIMERS            SOFT_TIMER_BENCH_TIMERS
+#define BENCH_IDLE_TICKS        256U
+/* Delays of the idle row start here, nothing falls due */
+#define BENCH_FAR               100000U
+
+#define BENCH_ROW(name, n, prep, fast, ref_prep, ref)           \
+  do                                                            \
+  {                                                             \
+    bench_row_t *row_ = &soft_timer_bench_rows[rows++];         \
+    row_->kernel = (name);                                      \
+    row_->len = (n);                                            \
+    BENCH_TIME(row_->cycles, prep, fast);                       \
+    BENCH_TIME(row_->ref_cycles, ref_prep, ref);                \
+  } while(0)
+
+/* Private types -------------------------------------------------------------*/
+/* The reference: timers kept sorted by expiry in a doubly linked list */
+typedef struct list_timer_s
+{
+  struct list_timer_s *next;
+  struct list_timer_s *prev;
+  uint32_t expires;
+  uint32_t active;
+} list_timer_t;
+
+/* Private variables ---------------------------------------------------------*/
+static soft_timer_t wheel[BENCH_TIMERS];
+static list_timer_t list[BENCH_TIMERS];
+static list_timer_t list_head = {&list_head, &list_head, 0U, 0U};
+static uint32_t list_now;
+
+static uint32_t delay_any[BENCH_TIMERS];    /* 1 .. 2^20 ticks */
+static uint32_t delay_far[BENCH_TIMERS];
+static uint32_t delay_near[BENCH_TIMERS];   /* 1 .. 255 ticks */
+
+/* Callbacks count here so they are not optimised away */
+static volatile uint32_t bench_fired;
+
+/* Exported variables --------------------------------------------------------*/
+bench_row_t soft_timer_bench_rows[SOFT_TIMER_BENCH_ROWS];
+
+/* Private functions ---------------------------------------------------------*/
+static void bench_fill(void)
+{
+  uint32_t x = 1U;
+  uint32_t i;
+
+  for(i = 0U; i < BENCH_TIMERS; i++)
+  {
+    x = (x * 1664525U) + 1013904223U;
+    delay_any[i] = 1U + (x >> 12);
+    delay_far[i] = BENCH_FAR + (x >> 12);
+    delay_near[i] = 1U + ((x >> 8) % 255U);
+  }
+}
+
+static void bench_callback(void *context)
+{
+  (void)context;
+  bench_fired++;
+}
+
+static void list_stop(list_timer_t *timer)
+{
+  if(timer->active != 0U)
+  {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->active = 0U;
+  }
+}
+
+static void list_start(list_timer_t *timer, uint32_t delay)
+{
+  list_timer_t *at = list_head.next;
+
+  list_stop(timer);
+  timer->expires = list_now + delay;
+  while((at != &list_head) && ((int32_t)(at->expires - timer->expires) <= 0))
+  {
+    at = at->next;
+  }
+  timer->next = at;
+  timer->prev = at->prev;
+  at->prev->next = timer;
+  at->prev = timer;
+  timer->active = 1U;
+}
+
+static void list_tick(void)
+{
+  list_timer_t *timer;
+
+  list_now++;
+  while((list_head.next != &list_head) && ((int32_t)(list_head.next->expires - list_now) <= 0))
+  {
+    timer = list_head.next;
+    list_stop(timer);
+    bench_callback(NULL);
+  }
+}
+
+static void list_start_all(const uint32_t *delays)
+{
+  uint32_t i;
+
+  for(i = 0U; i < BENCH_TIMERS; i++)
+  {
+    list_start(&list[i], delays[i]);
+  }
+}
+
+static void list_stop_all(void)
+{
+  uint32_t i;
+
+  for(i = 0U; i < BENCH_TIMERS; i++)
+  {
+    list_stop(&list[i]);
+  }
+}
+
+static void list_ticks(uint32_t n)
+{
+  while(n-- != 0U)
+  {
+    list_tick();
+  }
+}
+
+static void wheel_start_all(const uint32_t *delays)
+{
+  uint32_t i;
+
+  for(i = 0U; i < BENCH_TIMERS; i++)
+  {
+    soft_timer_start(&wheel[i], delays[i], 0U, bench_callback, NULL);
+  }
+}
+
+static void wheel_stop_all(void)
+{
+  uint32_t i;
+
+  for(i = 0U; i < BENCH_TIMERS; i++)
+  {
+    soft_timer_stop(&wheel[i]);
+  }
+}
+
+/* One TIM6 tick and the TIM7 dispatch after it. UG sets the update flag
+   on the board; on the host the flag is plain memory and takes the store. */
+static void wheel_ticks(uint32_t n)
+{
+  while(n-- != 0U)
+  {
+    htim6.Instance->EGR = TIM_EGR_UG;
+    htim6.Instance->SR = TIM_SR_UIF;
+    TIM6_DAC_IRQHandler();
+    TIM7_IRQHandler();
+  }
+}
+
+/* Function definitions ------------------------------------------------------*/
+void soft_timer_bench(void)
+{
+  uint32_t rows = 0U;
+  uint32_t i;
+
+  bench_init();
+  bench_fill();
+  for(i = 0U; i < BENCH_TIMERS; i++)
+  {
+    soft_timer_setup(&wheel[i]);
+  }
+  soft_timer_init();
+  HAL_NVIC_DisableIRQ(TIM6_DAC_IRQn);
+  HAL_NVIC_DisableIRQ(TIM7_IRQn);
+
+  BENCH_ROW("start", BENCH_TIMERS, wheel_stop_all(), wheel_start_all(delay_any),
+            list_stop_all(), list_start_all(delay_any));
+  BENCH_ROW("stop", BENCH_TIMERS, wheel_start_all(delay_any), wheel_stop_all(),
+            list_start_all(delay_any), list_stop_all());
+  BENCH_ROW("tick idle", BENCH_IDLE_TICKS, wheel_start_all(delay_far), wheel_ticks(BENCH_IDLE_TICKS),
+            list_start_all(delay_far), list_ticks(BENCH_IDLE_TICKS));
+  /* Every timer fires within 256 ticks */
+  BENCH_ROW("expire", BENCH_TIMERS, wheel_start_all(delay_near), wheel_ticks(256U),
+            list_start_all(delay_near), list_ticks(256U));
+
+  wheel_stop_all();
+  list_stop_all();
+  bench_print(soft_timer_bench_rows, rows, "wheel", "list");
+}
@@ -0,0 +1,42 @@
+#ifndef __SOFT_TIMER_BENCH_H
+#define __SOFT_TIMER_BENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "bench.h"
+
+/* Cost of the soft_timer.c wheel against a sorted list, the usual simple
+   timer queue, for SOFT_TIMER_BENCH_TIMERS timers with random delays:
+   starting and stopping them all, ticks with nothing due, and the ticks
+   in which every timer expires, callbacks included. len is timers, or
+   ticks for the idle row.
+
+   On the board: add Test/bench/bench.c and soft_timer_bench.c to the
+   project and call soft_timer_bench() from main() once the clocks and
+   caches are up. It calls soft_timer_init() and then masks the TIM6 and
+   TIM7 interrupts, driving both handlers itself; the timer service is not
+   usable by the application afterwards. At 10000 timers the tables take
+   about 480 KB of RAM there; define SOFT_TIMER_BENCH_TIMERS lower for a
+   project that cannot spare it. */
+
+/* Exported constants --------------------------------------------------------*/
+#define SOFT_TIMER_BENCH_ROWS   4U
+#ifndef SOFT_TIMER_BENCH_TIMERS
+#define SOFT_TIMER_BENCH_TIMERS 10000U
+#endif
+
+/* Exported variables --------------------------------------------------------*/
+extern bench_row_t soft_timer_bench_rows[SOFT_TIMER_BENCH_ROWS];
+
+/* Function definitions ------------------------------------------------------*/
+/* Fills soft_timer_bench_rows and prints it */
+void soft_timer_bench(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
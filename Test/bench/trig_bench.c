@@ -0,0 +1,142 @@
+/* Header includes -----------------------------------------------------------*/
+#include "trig_bench.h"
+#include "trig.h"
+#include <math.h>
+#include <string.h>
+
+/* Private macro -------------------------------------------------------------*/
+#define BENCH_LEN               256U
+
+/* The batches work in place: inputs are put back before each run */
+#define BENCH_ROW(name, prep, fast, ref)                        \
+  do                                                            \
+  {                                                             \
+    bench_row_t *row_ = &trig_bench_rows[rows++];               \
+    row_->kernel = (name);                                      \
+    row_->len = BENCH_LEN;                                      \
+    BENCH_TIME(row_->cycles, prep, fast);                       \
+    BENCH_TIME(row_->ref_cycles, prep, ref);                    \
+  } while(0)
+
+/* Private variables ---------------------------------------------------------*/
+static float angles[2U * BENCH_LEN];
+static float points[2U * BENCH_LEN];
+static float work[2U * BENCH_LEN];
+
+/* Results go here so the calls are not optimised away */
+static volatile float bench_sink;
+
+/* Exported variables --------------------------------------------------------*/
+bench_row_t trig_bench_rows[TRIG_BENCH_ROWS];
+
+/* Private functions ---------------------------------------------------------*/
+static void bench_fill(void)
+{
+  uint32_t x = 1U;
+  uint32_t i;
+
+  for(i = 0U; i < (2U * BENCH_LEN); i++)
+  {
+    x = (x * 1664525U) + 1013904223U;
+    angles[i] = (float)(int32_t)x * (1e4f / 2147483648.0f);
+    x = (x * 1664525U) + 1013904223U;
+    points[i] = (float)(int32_t)x * (1.0f / 2147483648.0f);
+  }
+}
+
+static void ref_sincos(float *v, uint32_t n)
+{
+  float a;
+  uint32_t i;
+
+  for(i = 0U; i < n; i++)
+  {
+    a = v[2U * i];
+    v[2U * i] = cosf(a);
+    v[(2U * i) + 1U] = sinf(a);
+  }
+}
+
+static void ref_polar(float *v, uint32_t n)
+{
+  float x;
+  float y;
+  uint32_t i;
+
+  for(i = 0U; i < n; i++)
+  {
+    x = v[2U * i];
+    y = v[(2U * i) + 1U];
+    v[2U * i] = sqrtf((x * x) + (y * y));
+    v[(2U * i) + 1U] = atan2f(y, x);
+  }
+}
+
+static float single_sincos(void)
+{
+  float c;
+  float s;
+  float sum = 0.0f;
+  uint32_t i;
+
+  for(i = 0U; i < BENCH_LEN; i++)
+  {
+    trig_sincos1(angles[2U * i], &c, &s);
+    sum += c + s;
+  }
+  return sum;
+}
+
+static float single_sincos_ref(void)
+{
+  float sum = 0.0f;
+  uint32_t i;
+
+  for(i = 0U; i < BENCH_LEN; i++)
+  {
+    sum += cosf(angles[2U * i]) + sinf(angles[2U * i]);
+  }
+  return sum;
+}
+
+static float single_atan2(void)
+{
+  float sum = 0.0f;
+  uint32_t i;
+
+  for(i = 0U; i < BENCH_LEN; i++)
+  {
+    sum += trig_atan2(points[(2U * i) + 1U], points[2U * i]);
+  }
+  return sum;
+}
+
+static float single_atan2_ref(void)
+{
+  float sum = 0.0f;
+  uint32_t i;
+
+  for(i = 0U; i < BENCH_LEN; i++)
+  {
+    sum += atan2f(points[(2U * i) + 1U], points[2U * i]);
+  }
+  return sum;
+}
+
+/* Function definitions ------------------------------------------------------*/
+void trig_bench(void)
+{
+  uint32_t rows = 0U;
+
+  bench_init();
+  bench_fill();
+
+  BENCH_ROW("trig_sincos", memcpy(work, angles, sizeof(work)), trig_sincos(work, BENCH_LEN),
+            ref_sincos(work, BENCH_LEN));
+  BENCH_ROW("trig_polar", memcpy(work, points, sizeof(work)), trig_polar(work, BENCH_LEN),
+            ref_polar(work, BENCH_LEN));
+  BENCH_ROW("trig_sincos1", (void)0, bench_sink = single_sincos(), bench_sink = single_sincos_ref());
+  BENCH_ROW("trig_atan2", (void)0, bench_sink = single_atan2(), bench_sink = single_atan2_ref());
+
+  bench_print(trig_bench_rows, rows, "trig.c", "libm");
+}
@@ -0,0 +1,33 @@
+#ifndef __TRIG_BENCH_H
+#define __TRIG_BENCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include "bench.h"
+
+/* Latency of the trig.c batches and single calls against sinf/cosf,
+   sqrtf and atan2f from the C library, per element, on the same inputs
+   (|angle| < 1e4, coordinates in -1..1).
+
+   On the board: add Test/bench/bench.c and trig_bench.c to the project,
+   call trig_bench() from main() once the clocks and caches are up, and
+   read the table from the terminal I/O window or trig_bench_rows. */
+
+/* Exported constants --------------------------------------------------------*/
+#define TRIG_BENCH_ROWS         4U
+
+/* Exported variables --------------------------------------------------------*/
+extern bench_row_t trig_bench_rows[TRIG_BENCH_ROWS];
+
+/* Function definitions ------------------------------------------------------*/
+/* Fills trig_bench_rows and prints it */
+void trig_bench(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,689 @@
+/* Header includes -----------------------------------------------------------*/
+#include "clock_profile.h"
+#include "host.h"
+#include <stddef.h>
+#include <string.h>
+
+/* clock_profile: every switch between the profiles, and from reset, runs
+   against RCC, PWR and FLASH models whose ready flags follow their enables.
+   After each store the clock tree the registers describe is checked
+   against the voltage scale and flash settings in force at that moment,
+   with the limits of the RM0433 flash table written out here again, so
+   no intermediate state overclocks the core, the buses or the flash.
+   On the same model the cached SYSCLK, bus, PLL and kernel clock getters
+   are held against a computation of their own, for PLL1..3 fed by HSI,
+   CSI and HSE and every D1/D2/D3 prescaler: served from the cache with no
+   register read once warm, stale until HAL_RCC_ClockCacheInvalidate(),
+   and fresh after a clock change through the HAL. */
+
+/* Private macro -------------------------------------------------------------*/
+#define MHZ(x)                  ((x) * 1000000UL)
+#define FIELD(reg, name)        (((reg) & RCC_##name##_Msk) >> RCC_##name##_Pos)
+/* PLLCKSELR, PLLxDIVR and PLLxFRACR as the dividers read */
+#define CKSEL(src, m1, m2, m3)  ((src) | ((m1) << 4U) | ((m2) << 12U) | ((m3) << 20U))
+#define DIVR(n, p, q, r)        (((n) - 1U) | (((p) - 1U) << 9U) | (((q) - 1U) << 16U) | (((r) - 1U) << 24U))
+#define FRAC(x)                 ((x) << RCC_PLL1FRACR_FRACN1_Pos)
+/* Getter results compared: SYSCLK, core, HCLK, PCLK1/2, D1/D3 PCLK1,
+   PLL1..3 P/Q/R and the kernel clocks */
+#define CLOCKS                  (7U + 9U + KERNELS)
+#define KERNELS                 5U
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t sysclk;
+  uint32_t cpu;
+  uint32_t hclk;
+  uint32_t pclk[4];             /* D1, D2 1, D2 2, D3 */
+} tree_t;
+
+/* A clock tree written straight into the registers */
+typedef struct
+{
+  uint32_t hsidiv;
+  uint32_t sw;
+  uint32_t cksel;
+  uint32_t pllcfgr;
+  uint32_t divr[3];
+  uint32_t fracr[3];
+  uint32_t d1cfgr;
+  uint32_t d2cfgr;
+  uint32_t d3cfgr;
+  uint32_t d1ccipr;
+  uint32_t d2ccip1r;
+  uint32_t d3ccipr;
+} cache_cfg_t;
+
+/* Private variables ---------------------------------------------------------*/
+static host_mmio_t rcc_m;
+static host_mmio_t pwr_m;
+static host_mmio_t flash_m;
+static volatile uint32_t pll_stores;
+static volatile uint32_t rcc_reads;
+static volatile uint32_t violations;
+static volatile const char *violation;
+/* PLLCKSELR and PLLCFGR before the store */
+static uint32_t cksel;
+static uint32_t pllcfgr;
+
+/* RM0433 flash table: highest AXI clock for 0..4 wait states, and for
+   WRHIGHFREQ 0 and 1, per voltage scale */
+static const uint32_t flash_hclk[4][5] =
+{
+  {MHZ(70), MHZ(140), MHZ(185), MHZ(225), MHZ(240)},
+  {MHZ(70), MHZ(140), MHZ(185), MHZ(225), MHZ(240)},
+  {MHZ(55), MHZ(110), MHZ(165), MHZ(225), MHZ(225)},
+  {MHZ(45), MHZ(90), MHZ(135), MHZ(180), MHZ(225)},
+};
+static const uint32_t wrhf_hclk[4][2] =
+{
+  {MHZ(70), MHZ(185)},
+  {MHZ(70), MHZ(185)},
+  {MHZ(55), MHZ(165)},
+  {MHZ(45), MHZ(135)},
+};
+static const uint32_t max_sysclk[4] = {MHZ(480), MHZ(400), MHZ(300), MHZ(200)};
+
+static const uint32_t kernels[KERNELS] =
+{
+  RCC_PERIPHCLK_SPI123, RCC_PERIPHCLK_ADC, RCC_PERIPHCLK_SDMMC, RCC_PERIPHCLK_QSPI, RCC_PERIPHCLK_SPI6
+};
+
+#define D1(cpre, hpre, ppre)    (((cpre) << RCC_D1CFGR_D1CPRE_Pos) | ((hpre) << RCC_D1CFGR_HPRE_Pos) | \
+                                 ((ppre) << RCC_D1CFGR_D1PPRE_Pos))
+#define D2(ppre1, ppre2)        (((ppre1) << RCC_D2CFGR_D2PPRE1_Pos) | ((ppre2) << RCC_D2CFGR_D2PPRE2_Pos))
+#define D3(ppre)                ((ppre) << RCC_D3CFGR_D3PPRE_Pos)
+#define D1CCIP(qspi, sdmmc, ckper) (((qspi) << RCC_D1CCIPR_QSPISEL_Pos) | ((sdmmc) << RCC_D1CCIPR_SDMMCSEL_Pos) | \
+                                 ((ckper) << RCC_D1CCIPR_CKPERSEL_Pos))
+#define D3CCIP(adc, spi6)       (((adc) << RCC_D3CCIPR_ADCSEL_Pos) | ((spi6) << RCC_D3CCIPR_SPI6SEL_Pos))
+
+static const cache_cfg_t cache_cfg[] =
+{
+  /* PLL1 P from HSE as SYSCLK, every bus halved */
+  {0U, 3U, CKSEL(2U, 5U, 5U, 5U), 0U,
+   {DIVR(192U, 2U, 4U, 2U), DIVR(80U, 2U, 2U, 2U), DIVR(96U, 2U, 5U, 8U)}, {0U, 0U, 0U},
+   D1(0U, 8U, 4U), D2(4U, 4U), D3(4U), D1CCIP(0U, 0U, 0U), 0U << RCC_D2CCIP1R_SPI123SEL_Pos, D3CCIP(0U, 0U)},
+  /* Fractional PLL1 and PLL3 from CSI, kernels on PLL2 and PLL3 */
+  {0U, 3U, CKSEL(1U, 1U, 1U, 2U), RCC_PLLCFGR_PLL1FRACEN | RCC_PLLCFGR_PLL3FRACEN,
+   {DIVR(100U, 2U, 4U, 2U), DIVR(60U, 3U, 4U, 5U), DIVR(200U, 2U, 7U, 3U)}, {FRAC(2048U), FRAC(77U), FRAC(1000U)},
+   D1(9U, 0U, 5U), D2(6U, 7U), D3(5U), D1CCIP(2U, 1U, 0U), 2U << RCC_D2CCIP1R_SPI123SEL_Pos, D3CCIP(1U, 2U)},
+  /* HSI / 2 as SYSCLK and PLL source, kernels on per_ck from CSI */
+  {1U, 0U, CKSEL(0U, 4U, 8U, 16U), 0U,
+   {DIVR(50U, 2U, 2U, 2U), DIVR(100U, 4U, 2U, 2U), DIVR(120U, 3U, 3U, 3U)}, {0U, 0U, 0U},
+   D1(10U, 11U, 7U), D2(0U, 5U), D3(7U), D1CCIP(3U, 0U, 1U), 4U << RCC_D2CCIP1R_SPI123SEL_Pos, D3CCIP(2U, 0U)},
+  /* HSE as SYSCLK, deepest prescalers, PLL2 without a reference */
+  {0U, 2U, CKSEL(2U, 2U, 0U, 25U), RCC_PLLCFGR_PLL3FRACEN,
+   {DIVR(64U, 2U, 2U, 2U), DIVR(80U, 2U, 2U, 2U), DIVR(300U, 2U, 3U, 6U)}, {0U, 0U, FRAC(8191U)},
+   D1(15U, 12U, 6U), D2(5U, 4U), D3(6U), D1CCIP(1U, 1U, 2U), 1U << RCC_D2CCIP1R_SPI123SEL_Pos, D3CCIP(0U, 5U)},
+  /* CSI as SYSCLK, PLLs from HSI, per_ck from HSI */
+  {0U, 1U, CKSEL(0U, 32U, 16U, 8U), RCC_PLLCFGR_PLL1FRACEN | RCC_PLLCFGR_PLL2FRACEN,
+   {DIVR(200U, 2U, 5U, 2U), DIVR(100U, 2U, 2U, 2U), DIVR(60U, 4U, 4U, 4U)}, {FRAC(1U), FRAC(8191U), 0U},
+   D1(0U, 13U, 0U), D2(0U, 0U), D3(0U), D1CCIP(3U, 0U, 0U), 4U << RCC_D2CCIP1R_SPI123SEL_Pos, D3CCIP(2U, 3U)},
+  /* PLL1 from HSI / 8, per_ck off */
+  {3U, 3U, CKSEL(0U, 1U, 2U, 4U), 0U,
+   {DIVR(100U, 2U, 2U, 2U), DIVR(100U, 2U, 2U, 2U), DIVR(100U, 2U, 2U, 2U)}, {0U, 0U, 0U},
+   D1(8U, 8U, 4U), D2(5U, 6U), D3(7U), D1CCIP(3U, 0U, 3U), 4U << RCC_D2CCIP1R_SPI123SEL_Pos, D3CCIP(2U, 4U)},
+};
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rcc(uint32_t offset)
+{
+  return host_mmio_get(&rcc_m, offset);
+}
+
+static uint32_t hpre_div(uint32_t code)
+{
+  static const uint32_t div[8] = {2U, 4U, 8U, 16U, 64U, 128U, 256U, 512U};
+
+  return (code < 8U) ? 1U : div[code - 8U];
+}
+
+static uint32_t ppre_div(uint32_t code)
+{
+  return (code < 4U) ? 1U : (1UL << (code - 3U));
+}
+
+static uint32_t hsi(void)
+{
+  return HSI_VALUE >> FIELD(rcc(offsetof(RCC_TypeDef, CR)), CR_HSIDIV);
+}
+
+/* PLLn (0..2) output P, Q or R (0..2), fractional part included */
+static uint32_t pll(uint32_t n, uint32_t out)
+{
+  static const uint32_t div_pos[3] = {9U, 16U, 24U};
+  uint32_t sel = rcc(offsetof(RCC_TypeDef, PLLCKSELR));
+  uint32_t divr = rcc(offsetof(RCC_TypeDef, PLL1DIVR) + (8U * n));
+  uint32_t m = (sel >> (4U + (8U * n))) & 0x3FU;
+  double frac = 0.0;
+  double src;
+
+  switch(sel & RCC_PLLCKSELR_PLLSRC)
+  {
+    case RCC_PLLCKSELR_PLLSRC_HSI:
+      src = hsi();
+      break;
+    case RCC_PLLCKSELR_PLLSRC_CSI:
+      src = CSI_VALUE;
+      break;
+    default:
+      src = HSE_VALUE;
+      break;
+  }
+  if(m == 0U)
+  {
+    return 0U;
+  }
+  if((rcc(offsetof(RCC_TypeDef, PLLCFGR)) & (RCC_PLLCFGR_PLL1FRACEN << (4U * n))) != 0U)
+  {
+    frac = (double)FIELD(rcc(offsetof(RCC_TypeDef, PLL1FRACR) + (8U * n)), PLL1FRACR_FRACN1) / 8192.0;
+  }
+  return (uint32_t)((src / m) * ((double)((divr & 0x1FFU) + 1U) + frac) / (double)(((divr >> div_pos[out]) & 0x7FU) + 1U));
+}
+
+/* The clocks the registers select now */
+static void tree(tree_t *t)
+{
+  uint32_t cfgr = rcc(offsetof(RCC_TypeDef, CFGR));
+  uint32_t d1 = rcc(offsetof(RCC_TypeDef, D1CFGR));
+  uint32_t d2 = rcc(offsetof(RCC_TypeDef, D2CFGR));
+  uint32_t d3 = rcc(offsetof(RCC_TypeDef, D3CFGR));
+
+  switch(FIELD(cfgr, CFGR_SWS))
+  {
+    case 0U:
+      t->sysclk = hsi();
+      break;
+    case 2U:
+      t->sysclk = HSE_VALUE;
+      break;
+    case 3U:
+      t->sysclk = pll(0U, 0U);
+      break;
+    default:
+      t->sysclk = CSI_VALUE;
+      break;
+  }
+  t->cpu = t->sysclk / hpre_div(FIELD(d1, D1CFGR_D1CPRE));
+  t->hclk = t->cpu / hpre_div(FIELD(d1, D1CFGR_HPRE));
+  t->pclk[0] = t->hclk / ppre_div(FIELD(d1, D1CFGR_D1PPRE));
+  t->pclk[1] = t->hclk / ppre_div(FIELD(d2, D2CFGR_D2PPRE1));
+  t->pclk[2] = t->hclk / ppre_div(FIELD(d2, D2CFGR_D2PPRE2));
+  t->pclk[3] = t->hclk / ppre_div(FIELD(d3, D3CFGR_D3PPRE));
+}
+
+/* per_ck, and the kernel clocks of the kernels[] table */
+static uint32_t per_ck(void)
+{
+  static const uint32_t ckper[4] = {HSI_VALUE, CSI_VALUE, HSE_VALUE, 0U};
+  uint32_t sel = FIELD(rcc(offsetof(RCC_TypeDef, D1CCIPR)), D1CCIPR_CKPERSEL);
+
+  return (sel == 0U) ? hsi() : ckper[sel];
+}
+
+static uint32_t kernel(uint32_t k, const tree_t *t)
+{
+  uint32_t d1 = rcc(offsetof(RCC_TypeDef, D1CCIPR));
+  uint32_t d3 = rcc(offsetof(RCC_TypeDef, D3CCIPR));
+  uint32_t sel;
+
+  switch(k)
+  {
+    case 0U:
+      sel = FIELD(rcc(offsetof(RCC_TypeDef, D2CCIP1R)), D2CCIP1R_SPI123SEL);
+      return (sel == 0U) ? pll(0U, 1U) : (sel == 1U) ? pll(1U, 0U) : (sel == 2U) ? pll(2U, 0U) :
+             (sel == 4U) ? per_ck() : 0U;
+    case 1U:
+      sel = FIELD(d3, D3CCIPR_ADCSEL);
+      return (sel == 0U) ? pll(1U, 0U) : (sel == 1U) ? pll(2U, 2U) : (sel == 2U) ? per_ck() : 0U;
+    case 2U:
+      return (FIELD(d1, D1CCIPR_SDMMCSEL) == 0U) ? pll(0U, 1U) : pll(1U, 2U);
+    case 3U:
+      sel = FIELD(d1, D1CCIPR_QSPISEL);
+      return (sel == 0U) ? t->hclk : (sel == 1U) ? pll(0U, 1U) : (sel == 2U) ? pll(1U, 2U) : per_ck();
+    default:
+      sel = FIELD(d3, D3CCIPR_SPI6SEL);
+      return (sel == 0U) ? t->pclk[3] : (sel == 1U) ? pll(1U, 1U) : (sel == 2U) ? pll(2U, 1U) :
+             (sel == 3U) ? hsi() : (sel == 4U) ? CSI_VALUE : (sel == 5U) ? HSE_VALUE : 0U;
+  }
+}
+
+/* Every compared clock from the registers, and from the HAL getters */
+static void clocks_ref(uint32_t *f)
+{
+  uint32_t i;
+  tree_t t;
+
+  tree(&t);
+  f[0] = t.sysclk;
+  f[1] = t.cpu;
+  f[2] = t.hclk;
+  f[3] = t.pclk[1];
+  f[4] = t.pclk[2];
+  f[5] = t.pclk[0];
+  f[6] = t.pclk[3];
+  for(i = 0U; i < 9U; i++)
+  {
+    f[7U + i] = pll(i / 3U, i % 3U);
+  }
+  for(i = 0U; i < KERNELS; i++)
+  {
+    f[16U + i] = kernel(i, &t);
+  }
+}
+
+static void clocks_hal(uint32_t *f)
+{
+  PLL1_ClocksTypeDef pll1;
+  PLL2_ClocksTypeDef pll2;
+  PLL3_ClocksTypeDef pll3;
+  uint32_t i;
+
+  f[0] = HAL_RCC_GetSysClockFreq();
+  f[2] = HAL_RCC_GetHCLKFreq();
+  f[1] = SystemCoreClock;
+  f[3] = HAL_RCC_GetPCLK1Freq();
+  f[4] = HAL_RCC_GetPCLK2Freq();
+  f[5] = HAL_RCCEx_GetD1PCLK1Freq();
+  f[6] = HAL_RCCEx_GetD3PCLK1Freq();
+  HAL_RCCEx_GetPLL1ClockFreq(&pll1);
+  HAL_RCCEx_GetPLL2ClockFreq(&pll2);
+  HAL_RCCEx_GetPLL3ClockFreq(&pll3);
+  f[7] = pll1.PLL1_P_Frequency;
+  f[8] = pll1.PLL1_Q_Frequency;
+  f[9] = pll1.PLL1_R_Frequency;
+  f[10] = pll2.PLL2_P_Frequency;
+  f[11] = pll2.PLL2_Q_Frequency;
+  f[12] = pll2.PLL2_R_Frequency;
+  f[13] = pll3.PLL3_P_Frequency;
+  f[14] = pll3.PLL3_Q_Frequency;
+  f[15] = pll3.PLL3_R_Frequency;
+  for(i = 0U; i < KERNELS; i++)
+  {
+    f[16U + i] = HAL_RCCEx_GetPeriphCLKFreq(kernels[i]);
+  }
+}
+
+/* The HAL divides in single precision: a part per million apart */
+static uint32_t clocks_match(const uint32_t *hal, const uint32_t *ref)
+{
+  uint32_t i;
+
+  for(i = 0U; i < CLOCKS; i++)
+  {
+    if(((hal[i] > ref[i]) ? (hal[i] - ref[i]) : (ref[i] - hal[i])) > (ref[i] / 1000000U))
+    {
+      printf("clock %u: %u, expected %u\n", (unsigned)i, (unsigned)hal[i], (unsigned)ref[i]);
+      return 0U;
+    }
+  }
+  return 1U;
+}
+
+static uint32_t vos_now(void)
+{
+  switch(host_mmio_get(&pwr_m, offsetof(PWR_TypeDef, D3CR)) & PWR_D3CR_VOS)
+  {
+    case PWR_REGULATOR_VOLTAGE_SCALE1:
+      return ((SYSCFG->PWRCR & SYSCFG_PWRCR_ODEN) != 0U) ? 0U : 1U;
+    case PWR_REGULATOR_VOLTAGE_SCALE2:
+      return 2U;
+    default:
+      return 3U;
+  }
+}
+
+static void violate(const char *what)
+{
+  if(violations++ == 0U)
+  {
+    violation = what;
+  }
+}
+
+/* What has to hold after every store */
+static void check(void)
+{
+  uint32_t acr = host_mmio_get(&flash_m, offsetof(FLASH_TypeDef, ACR));
+  uint32_t ws = acr & FLASH_ACR_LATENCY;
+  uint32_t wrhf = (acr & FLASH_ACR_WRHIGHFREQ) >> FLASH_ACR_WRHIGHFREQ_Pos;
+  uint32_t vos = vos_now();
+  uint32_t i;
+  tree_t t;
+
+  tree(&t);
+  if(t.cpu > max_sysclk[vos])
+  {
+    violate("core clock over the voltage scale");
+  }
+  if(t.hclk > (max_sysclk[vos] / 2U))
+  {
+    violate("AXI clock over the voltage scale");
+  }
+  /* HSI undivided everywhere is the reset state, allowed at any scale */
+  for(i = 0U; i < 4U; i++)
+  {
+    if(t.pclk[i] > ((max_sysclk[vos] / 4U) > HSI_VALUE ? (max_sysclk[vos] / 4U) : HSI_VALUE))
+    {
+      violate("APB clock over the voltage scale");
+    }
+  }
+  if((ws < 5U) && (t.hclk > flash_hclk[vos][ws]))
+  {
+    violate("too few flash wait states");
+  }
+  if((wrhf < 2U) && (t.hclk > wrhf_hclk[vos][wrhf]))
+  {
+    violate("WRHIGHFREQ too low");
+  }
+}
+
+static uint32_t rcc_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  rcc_reads++;
+  return current;
+}
+
+static void rcc_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  uint32_t cr = host_mmio_get(m, offsetof(RCC_TypeDef, CR));
+  uint32_t i;
+
+  if(offset == offsetof(RCC_TypeDef, CR))
+  {
+    /* Oscillators and PLLs are ready at once, or stop at once */
+    cr &= ~(RCC_CR_HSIRDY | RCC_CR_HSERDY | RCC_CR_PLL1RDY | RCC_CR_PLL2RDY | RCC_CR_PLL3RDY);
+    cr |= RCC_CR_HSIDIVF;
+    cr |= ((cr & RCC_CR_HSION) != 0U) ? RCC_CR_HSIRDY : 0U;
+    cr |= ((cr & RCC_CR_HSEON) != 0U) ? RCC_CR_HSERDY : 0U;
+    for(i = 0U; i < 3U; i++)
+    {
+      cr |= ((cr & (RCC_CR_PLL1ON << (2U * i))) != 0U) ? (RCC_CR_PLL1RDY << (2U * i)) : 0U;
+    }
+    if(((cr & RCC_CR_PLL1RDY) == 0U) &&
+       (FIELD(host_mmio_get(m, offsetof(RCC_TypeDef, CFGR)), CFGR_SWS) == 3U))
+    {
+      violate("PLL1 stopped under the core");
+    }
+    if(((cr & RCC_CR_HSIRDY) == 0U) &&
+       (FIELD(host_mmio_get(m, offsetof(RCC_TypeDef, CFGR)), CFGR_SWS) == 0U))
+    {
+      violate("HSI stopped under the core");
+    }
+    host_mmio_set(m, offset, cr);
+  }
+  else if(offset == offsetof(RCC_TypeDef, CFGR))
+  {
+    /* The switch happens at once, to a ready source only */
+    i = value & RCC_CFGR_SW;
+    if(((i == RCC_CFGR_SW_PLL1) && ((cr & RCC_CR_PLL1RDY) == 0U)) ||
+       ((i == RCC_CFGR_SW_HSE) && ((cr & RCC_CR_HSERDY) == 0U)) ||
+       ((i == RCC_CFGR_SW_HSI) && ((cr & RCC_CR_HSIRDY) == 0U)))
+    {
+      violate("switch to a source not ready");
+    }
+    host_mmio_set(m, offset, (value & ~RCC_CFGR_SWS) | (i << RCC_CFGR_SWS_Pos));
+  }
+  else
+  {
+    if((offset == offsetof(RCC_TypeDef, PLLCKSELR)) || (offset == offsetof(RCC_TypeDef, PLLCFGR)) ||
+       ((offset >= offsetof(RCC_TypeDef, PLL1DIVR)) && (offset <= offsetof(RCC_TypeDef, PLL3FRACR))))
+    {
+      pll_stores++;
+    }
+    /* A running PLL keeps its source and dividers */
+    for(i = 0U; i < 3U; i++)
+    {
+      if((cr & (RCC_CR_PLL1ON << (2U * i))) == 0U)
+      {
+        continue;
+      }
+      if(((offset == offsetof(RCC_TypeDef, PLLCKSELR)) &&
+          (((value ^ cksel) & (RCC_PLLCKSELR_PLLSRC | (0x3FUL << (RCC_PLLCKSELR_DIVM1_Pos + (8U * i))))) != 0U)) ||
+         ((offset == offsetof(RCC_TypeDef, PLLCFGR)) &&
+          (((value ^ pllcfgr) & ((0xFUL << (4U * i)) | (7UL << (16U + (3U * i))))) != 0U)) ||
+         (offset == (offsetof(RCC_TypeDef, PLL1DIVR) + (8U * i))))
+      {
+        violate("running PLL reprogrammed");
+      }
+    }
+    cksel = rcc(offsetof(RCC_TypeDef, PLLCKSELR));
+    pllcfgr = rcc(offsetof(RCC_TypeDef, PLLCFGR));
+  }
+  check();
+}
+
+static uint32_t pwr_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  return (offset == offsetof(PWR_TypeDef, D3CR)) ? (current | PWR_D3CR_VOSRDY) : current;
+}
+
+static void pwr_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  check();
+}
+
+static void flash_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  check();
+}
+
+/* Reset values */
+static void reset(void)
+{
+  uint32_t i;
+
+  host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, CR), RCC_CR_HSION | RCC_CR_HSIRDY | RCC_CR_HSIDIVF);
+  host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, CFGR), 0U);
+  host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, D1CFGR), 0U);
+  host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, D2CFGR), 0U);
+  host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, D3CFGR), 0U);
+  host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, PLLCKSELR), 0x02020200U);
+  host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, PLLCFGR), 0x01FF0000U);
+  for(i = 0U; i < 3U; i++)
+  {
+    host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, PLL1DIVR) + (8U * i), 0x01010280U);
+  }
+  host_mmio_set(&pwr_m, offsetof(PWR_TypeDef, D3CR), PWR_REGULATOR_VOLTAGE_SCALE3);
+  host_mmio_set(&flash_m, offsetof(FLASH_TypeDef, ACR), 0x37U);
+  SYSCFG->PWRCR = 0U;
+  cksel = rcc(offsetof(RCC_TypeDef, PLLCKSELR));
+  pllcfgr = rcc(offsetof(RCC_TypeDef, PLLCFGR));
+  violations = 0U;
+  violation = NULL;
+}
+
+/* Each profile's flash settings against the table */
+static void test_flash(void)
+{
+  const clock_profile_t *p;
+  uint32_t wrhf;
+  uint32_t ws;
+  uint32_t id;
+
+  for(id = 0U; id < CLOCK_PROFILE_COUNT; id++)
+  {
+    p = clock_profile_get((clock_profile_id_t)id);
+    ws = p->acr & FLASH_ACR_LATENCY;
+    wrhf = (p->acr & FLASH_ACR_WRHIGHFREQ) >> FLASH_ACR_WRHIGHFREQ_Pos;
+    HOST_CHECK(ws < 5U);
+    HOST_CHECK(p->hclk <= flash_hclk[p->vos][ws]);
+    HOST_CHECK_EQ(wrhf, (p->hclk <= wrhf_hclk[p->vos][0]) ? 0U : (p->hclk <= wrhf_hclk[p->vos][1]) ? 1U : 2U);
+  }
+  /* 64 MHz is over the 45 MHz WRHIGHFREQ 0 allows at VOS3 */
+  p = clock_profile_get(CLOCK_PROFILE_64MHZ_HSI);
+  HOST_CHECK_EQ(p->acr & FLASH_ACR_WRHIGHFREQ, FLASH_ACR_WRHIGHFREQ_0);
+  HOST_CHECK(clock_profile_get(CLOCK_PROFILE_COUNT) == NULL);
+}
+
+/* From reset and from every profile to every profile */
+static void test_switch(void)
+{
+  const clock_profile_t *p;
+  uint32_t from;
+  uint32_t to;
+  uint32_t n;
+  tree_t t;
+
+  for(from = 0U; from <= CLOCK_PROFILE_COUNT; from++)
+  {
+    for(to = 0U; to < CLOCK_PROFILE_COUNT; to++)
+    {
+      reset();
+      if(from < CLOCK_PROFILE_COUNT)
+      {
+        HOST_CHECK_EQ(clock_profile_apply((clock_profile_id_t)from), HAL_OK);
+      }
+      n = pll_stores;
+      HOST_CHECK_EQ(clock_profile_apply((clock_profile_id_t)to), HAL_OK);
+      if(!HOST_CHECK_EQ(violations, 0U))
+      {
+        printf("%u -> %u: %s\n", (unsigned)from, (unsigned)to, (const char *)violation);
+      }
+
+      p = clock_profile_get((clock_profile_id_t)to);
+      tree(&t);
+      HOST_CHECK_EQ(t.cpu, p->sysclk);
+      HOST_CHECK_EQ(t.hclk, p->hclk);
+      HOST_CHECK_EQ(SystemCoreClock, p->sysclk);
+      HOST_CHECK_EQ(vos_now(), p->vos);
+      HOST_CHECK_EQ(host_mmio_get(&flash_m, offsetof(FLASH_TypeDef, ACR)) & (FLASH_ACR_LATENCY | FLASH_ACR_WRHIGHFREQ),
+                    p->acr);
+      /* The same profile again leaves the PLLs alone */
+      if(from == to)
+      {
+        HOST_CHECK_EQ(pll_stores, n);
+      }
+    }
+  }
+  HOST_CHECK_EQ(clock_profile_apply(CLOCK_PROFILE_COUNT), HAL_ERROR);
+}
+
+/* Each tree of cache_cfg[]: computed once after the invalidation, then
+   served without a register read */
+static void test_cache(void)
+{
+  const cache_cfg_t *c;
+  uint32_t hal[CLOCKS];
+  uint32_t again[CLOCKS];
+  uint32_t ref[CLOCKS];
+  uint32_t i;
+  uint32_t n;
+
+  for(i = 0U; i < (sizeof(cache_cfg) / sizeof(cache_cfg[0])); i++)
+  {
+    c = &cache_cfg[i];
+    reset();
+    host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, CR),
+                  RCC_CR_HSION | RCC_CR_HSIRDY | RCC_CR_HSIDIVF | (c->hsidiv << RCC_CR_HSIDIV_Pos));
+    host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, CFGR), c->sw | (c->sw << RCC_CFGR_SWS_Pos));
+    host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, PLLCKSELR), c->cksel);
+    host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, PLLCFGR), c->pllcfgr);
+    for(n = 0U; n < 3U; n++)
+    {
+      host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, PLL1DIVR) + (8U * n), c->divr[n]);
+      host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, PLL1FRACR) + (8U * n), c->fracr[n]);
+    }
+    host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, D1CFGR), c->d1cfgr);
+    host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, D2CFGR), c->d2cfgr);
+    host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, D3CFGR), c->d3cfgr);
+    host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, D1CCIPR), c->d1ccipr);
+    host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, D2CCIP1R), c->d2ccip1r);
+    host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, D3CCIPR), c->d3ccipr);
+
+    HAL_RCC_ClockCacheInvalidate();
+    n = rcc_reads;
+    clocks_hal(hal);
+    HOST_CHECK(rcc_reads != n);
+    clocks_ref(ref);
+    if(!HOST_CHECK(clocks_match(hal, ref)))
+    {
+      printf("cache_cfg[%u]\n", (unsigned)i);
+    }
+    n = rcc_reads;
+    clocks_hal(again);
+    HOST_CHECK_EQ(rcc_reads, n);
+    HOST_CHECK(memcmp(hal, again, sizeof(hal)) == 0);
+  }
+}
+
+/* A HAL clock change refreshes the caches by itself, a direct register
+   store only once invalidated */
+static void test_cache_change(void)
+{
+  RCC_PeriphCLKInitTypeDef clk = {0};
+  uint32_t hal[CLOCKS];
+  uint32_t ref[CLOCKS];
+  uint32_t old[CLOCKS];
+  uint32_t generation;
+  uint32_t n;
+
+  reset();
+  HAL_RCC_ClockCacheInvalidate();
+  clocks_hal(old);
+  clocks_ref(ref);
+  HOST_CHECK(clocks_match(old, ref));
+
+  HOST_CHECK_EQ(clock_profile_apply(CLOCK_PROFILE_480MHZ), HAL_OK);
+  clocks_hal(hal);
+  clocks_ref(ref);
+  HOST_CHECK(clocks_match(hal, ref));
+  HOST_CHECK(hal[0] != old[0]);
+
+  clk.PeriphClockSelection = RCC_PERIPHCLK_ADC | RCC_PERIPHCLK_CKPER;
+  clk.AdcClockSelection = RCC_ADCCLKSOURCE_CLKP;
+  clk.CkperClockSelection = RCC_CLKPSOURCE_HSE;
+  HOST_CHECK_EQ(HAL_RCCEx_PeriphCLKConfig(&clk), HAL_OK);
+  HOST_CHECK_EQ(HAL_RCCEx_GetPeriphCLKFreq(RCC_PERIPHCLK_ADC), HSE_VALUE);
+  clocks_hal(hal);
+  clocks_ref(ref);
+  HOST_CHECK(clocks_match(hal, ref));
+
+  /* D1CPRE, HPRE and D3PPRE stored behind the HAL's back */
+  memcpy(old, hal, sizeof(old));
+  host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, D1CFGR), host_mmio_get(&rcc_m, offsetof(RCC_TypeDef, D1CFGR)) ^
+                (RCC_D1CFGR_D1CPRE_3 | RCC_D1CFGR_HPRE_0));
+  host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, D3CFGR), D3(7U));
+  host_mmio_set(&rcc_m, offsetof(RCC_TypeDef, D3CCIPR), D3CCIP(2U, 0U));
+  n = rcc_reads;
+  clocks_hal(hal);
+  HOST_CHECK_EQ(rcc_reads, n);
+  HOST_CHECK(memcmp(hal, old, sizeof(hal)) == 0);
+
+  generation = HAL_RCC_GetClockGeneration();
+  HAL_RCC_ClockCacheInvalidate();
+  HOST_CHECK(HAL_RCC_GetClockGeneration() != generation);
+  clocks_hal(hal);
+  clocks_ref(ref);
+  HOST_CHECK(clocks_match(hal, ref));
+  HOST_CHECK(hal[1] != old[1]);
+  HOST_CHECK(hal[6] != old[6]);
+  HOST_CHECK(hal[20] != old[20]);
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  rcc_m.base = RCC_BASE;
+  rcc_m.size = sizeof(RCC_TypeDef);
+  rcc_m.read = rcc_read;
+  rcc_m.write = rcc_write;
+  host_mmio_attach(&rcc_m);
+  pwr_m.base = PWR_BASE;
+  pwr_m.size = sizeof(PWR_TypeDef);
+  pwr_m.read = pwr_read;
+  pwr_m.write = pwr_write;
+  host_mmio_attach(&pwr_m);
+  flash_m.base = FLASH_R_BASE;
+  flash_m.size = sizeof(FLASH_TypeDef);
+  flash_m.write = flash_write;
+  host_mmio_attach(&flash_m);
+
+  /* As HAL_Init() leaves it, clock_profile_apply() restarts the tick */
+  HOST_CHECK_EQ(HAL_InitTick(TICK_INT_PRIORITY), HAL_OK);
+  test_flash();
+  test_switch();
+  test_cache();
+  test_cache_change();
+  return host_result();
+}
@@ -0,0 +1,196 @@
+/* Header includes -----------------------------------------------------------*/
+#include "crc_stream.h"
+#include <stddef.h>
+
+/* crc_stream against a model of the CRC unit: the catalogue check values
+   on the unit and in software (slicing-by-8 and bitwise), split updates,
+   and streams moving between the unit and software between updates. The
+   software updates run from an "interrupt" raised while another stream
+   holds the unit, which is when crc_stream takes that path. */
+
+/* Private macro -------------------------------------------------------------*/
+#define CFGS                    9U
+#define LEN                     77U
+
+/* Private variables ---------------------------------------------------------*/
+static crc_stream_table_t tables[CFGS];
+static crc_stream_cfg_t sliced[CFGS] =
+{
+  CRC_STREAM_CRC32(tables[0]), CRC_STREAM_CRC32C(tables[1]), CRC_STREAM_CRC32_MPEG2(tables[2]),
+  CRC_STREAM_CRC16_CCITT(tables[3]), CRC_STREAM_CRC16_XMODEM(tables[4]), CRC_STREAM_CRC16_MODBUS(tables[5]),
+  CRC_STREAM_CRC8(tables[6]), CRC_STREAM_CRC8_MAXIM(tables[7]), CRC_STREAM_CRC7_MMC(tables[8])
+};
+static crc_stream_cfg_t bitwise[CFGS] =
+{
+  CRC_STREAM_CRC32(NULL), CRC_STREAM_CRC32C(NULL), CRC_STREAM_CRC32_MPEG2(NULL),
+  CRC_STREAM_CRC16_CCITT(NULL), CRC_STREAM_CRC16_XMODEM(NULL), CRC_STREAM_CRC16_MODBUS(NULL),
+  CRC_STREAM_CRC8(NULL), CRC_STREAM_CRC8_MAXIM(NULL), CRC_STREAM_CRC7_MMC(NULL)
+};
+static const uint32_t check[CFGS] =
+{
+  0xCBF43926U, 0xE3069283U, 0x0376E6E7U, 0x29B1U, 0x31C3U, 0x4B37U, 0xF4U, 0xA1U, 0x75U
+};
+static const crc_stream_cfg_t holder_cfg = CRC_STREAM_CRC32(NULL);
+static uint8_t data[LEN + 3U];
+
+/* The CRC unit: DR, CR, INIT and POL; input reversal by byte only */
+static uint32_t unit_crc;
+static uint32_t unit_raise;
+static host_mmio_t unit;
+
+/* What the "interrupt" does while the holder stream has the unit */
+static crc_stream_t *isr_stream;
+static const uint8_t *isr_data;
+static uint32_t isr_len;
+
+/* Private functions ---------------------------------------------------------*/
+static void unit_feed(uint32_t byte)
+{
+  uint32_t cr = host_mmio_get(&unit, offsetof(CRC_TypeDef, CR));
+  uint32_t poly = host_mmio_get(&unit, offsetof(CRC_TypeDef, POL));
+  uint32_t w = 32U >> ((cr & CRC_CR_POLYSIZE) >> CRC_CR_POLYSIZE_Pos);
+  uint32_t i;
+
+  if(w == 4U)
+  {
+    w = 7U;
+  }
+  HOST_CHECK((cr & CRC_CR_REV_IN) != CRC_CR_REV_IN_1);
+  if((cr & CRC_CR_REV_IN) != 0U)
+  {
+    byte = __RBIT(byte) >> 24;
+  }
+  for(i = 0U; i < 8U; i++)
+  {
+    uint32_t bit = ((unit_crc >> (w - 1U)) ^ (byte >> (7U - i))) & 1U;
+    unit_crc = (unit_crc << 1) ^ ((bit != 0U) ? poly : 0U);
+  }
+  unit_crc &= (w == 32U) ? 0xFFFFFFFFU : ((1UL << w) - 1U);
+}
+
+static void isr_update(void)
+{
+  HOST_CHECK_EQ(crc_stream_update(isr_stream, isr_data, isr_len), HAL_OK);
+}
+
+static void unit_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  if(offset == offsetof(CRC_TypeDef, DR))
+  {
+    while(size-- > 0U)
+    {
+      unit_feed((value >> (size * 8U)) & 0xFFU);
+    }
+    host_mmio_set(m, offset, unit_crc);
+    if(unit_raise != 0U)
+    {
+      unit_raise = 0U;
+      host_irq_raise(isr_update);
+    }
+  }
+  else if((offset == offsetof(CRC_TypeDef, CR)) && ((value & CRC_CR_RESET) != 0U))
+  {
+    unit_crc = host_mmio_get(m, offsetof(CRC_TypeDef, INIT));
+    host_mmio_set(m, offset, value & ~CRC_CR_RESET);
+    host_mmio_set(m, offsetof(CRC_TypeDef, DR), unit_crc);
+  }
+}
+
+/* s gets len bytes in software: from an interrupt while another stream
+   feeds the unit */
+static void update_sw(crc_stream_t *s, const uint8_t *p, uint32_t len)
+{
+  crc_stream_t holder;
+  uint32_t sw = crc_stream_stats()->sw_bytes;
+
+  isr_stream = s;
+  isr_data = p;
+  isr_len = len;
+  unit_raise = 1U;
+  crc_stream_begin(&holder, &holder_cfg);
+  (void)crc_stream_update(&holder, "123456789", 9U);
+  HOST_CHECK_EQ(crc_stream_value(&holder), check[0]);
+  HOST_CHECK_EQ(crc_stream_stats()->sw_bytes - sw, len);
+}
+
+static void update_hw(crc_stream_t *s, const uint8_t *p, uint32_t len)
+{
+  uint32_t hw = crc_stream_stats()->hw_bytes;
+
+  (void)crc_stream_update(s, p, len);
+  HOST_CHECK_EQ(crc_stream_stats()->hw_bytes - hw, len);
+}
+
+static void check_cfg(const crc_stream_cfg_t *cfg, uint32_t value)
+{
+  crc_stream_t a;
+  crc_stream_t b;
+  uint32_t whole;
+  uint32_t k;
+
+  /* Catalogue check value, on the unit and in software */
+  HOST_CHECK_EQ(crc_stream_calc(cfg, "123456789", 9U), value);
+  crc_stream_begin(&a, cfg);
+  update_sw(&a, (const uint8_t *)"123456789", 9U);
+  HOST_CHECK_EQ(crc_stream_value(&a), value);
+
+  /* Split anywhere, handed over both ways, at every alignment */
+  crc_stream_begin(&a, cfg);
+  update_hw(&a, data + 1U, LEN);
+  whole = crc_stream_value(&a);
+  crc_stream_begin(&a, cfg);
+  update_sw(&a, data + 1U, LEN);
+  HOST_CHECK_EQ(crc_stream_value(&a), whole);
+  for(k = 0U; k <= 19U; k++)
+  {
+    crc_stream_begin(&a, cfg);
+    crc_stream_begin(&b, cfg);
+    update_hw(&a, data + 1U, k);
+    update_sw(&b, data + 1U, k);
+    update_sw(&a, data + 1U + k, LEN - k - 20U);
+    update_hw(&b, data + 1U + k, LEN - k - 20U);
+    update_hw(&a, data + LEN - 19U, 20U);
+    update_sw(&b, data + LEN - 19U, 20U);
+    HOST_CHECK_EQ(crc_stream_value(&a), whole);
+    HOST_CHECK_EQ(crc_stream_value(&b), whole);
+    HOST_CHECK_EQ(a.bytes, LEN);
+  }
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  crc_stream_t a;
+  crc_stream_t b;
+  uint32_t i;
+
+  for(i = 0U; i < sizeof(data); i++)
+  {
+    data[i] = (uint8_t)(i * 167U + 13U);
+  }
+  unit.base = CRC_BASE;
+  unit.size = sizeof(CRC_TypeDef);
+  unit.write = unit_write;
+  host_mmio_attach(&unit);
+  HOST_CHECK_EQ(crc_stream_init(NULL), HAL_OK);
+
+  for(i = 0U; i < CFGS; i++)
+  {
+    crc_stream_table(&sliced[i]);
+    check_cfg(&sliced[i], check[i]);
+    check_cfg(&bitwise[i], check[i]);
+  }
+
+  /* Two streams interleaved on the unit, each reloaded in turn */
+  crc_stream_begin(&a, &sliced[0]);
+  crc_stream_begin(&b, &sliced[5]);
+  update_hw(&a, (const uint8_t *)"1234", 4U);
+  update_hw(&b, (const uint8_t *)"12345", 5U);
+  update_hw(&a, (const uint8_t *)"56789", 5U);
+  update_hw(&b, (const uint8_t *)"6789", 4U);
+  HOST_CHECK_EQ(crc_stream_value(&a), check[0]);
+  HOST_CHECK_EQ(crc_stream_value(&b), check[5]);
+
+  host_mmio_detach(&unit);
+  return host_result();
+}
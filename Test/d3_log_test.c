@@ -0,0 +1,601 @@
+/* Header includes -----------------------------------------------------------*/
+#include "d3_log.h"
+#include "host.h"
+#include <stddef.h>
+#include <string.h>
+
+/* d3_log: an application that sleeps in d3_log_sleep() and drains the
+   batches on each wakeup, against models of the D3 side. LPTIM2/LPTIM3
+   on the 32.768 kHz LSE pace DMAMUX2 request generator 0, or LPUART1
+   receiving at 9600 baud requests by itself; BDMA channel 0 then copies
+   one sample per request into the ring, circular, with the half and full
+   interrupts through the real HAL handler. A sample is the number of the
+   request since the start, so a sample the BDMA misses shows as a gap.
+
+   In Stop the D3 side runs only if D3 is kept in Run and the BDMA, SRAM4
+   and the pacer are in autonomous mode; the BDMA interrupt wakes the CPU
+   only through its EXTI line. Sometimes another interrupt wakes the CPU,
+   a batch completes while the application does other work before
+   sleeping, or between d3_log_sleep()'s check and the WFI. Time is
+   simulated. Checked: every batch is intact when handed out,
+   and still intact at release unless release says otherwise; the batches
+   follow each other with no gap but what `lost` reports; every sample up
+   to the last batch is delivered, reported lost or in a batch reported
+   torn; a consumer that keeps up loses nothing; the CPU wakes once per
+   batch and never sleeps through one. */
+
+/* Private macro -------------------------------------------------------------*/
+#define LSE_HZ                  32768U
+#define LPUART_BYTE_NS          (10ULL * 1000000000ULL / 9600U)
+#define BDMA_CH                 0U
+#define BDMA_REG(r)             ((uint32_t)offsetof(BDMA_TypeDef, r))
+#define CHAN_REG(r)             ((uint32_t)(BDMA_Channel0_BASE - BDMA_BASE + offsetof(BDMA_Channel_TypeDef, r)))
+/* Channel 0 flags in ISR */
+#define BDMA_C0_TC              0x2U
+#define BDMA_C0_HT              0x4U
+#define NEVER                   UINT64_MAX
+/* The CPU is given up for lost after sleeping this long */
+#define SLEEP_MAX_NS            (20ULL * 1000000000ULL)
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  LPTIM_TypeDef *lptim;         /* NULL: LPUART1 paces */
+  uint32_t size;
+  uint32_t period;              /* LSE ticks per sample */
+  uint32_t threshold;
+  uint32_t batches;             /* to collect */
+  uint32_t work;                /* in % of a batch: the consumer holds a batch up to this long */
+  uint32_t stall;               /* in 1/256: the consumer holds a batch for several batch periods */
+  uint32_t spurious;            /* in 1/256 per sleep: another interrupt wakes the CPU */
+  uint32_t race;                /* in 1/256 per sleep: a batch completes on the way into Stop */
+} run_t;
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t seed = 0x5EED1234U;
+static LPTIM_HandleTypeDef hlptim;
+static DMA_HandleTypeDef hdma;
+static d3_log_t lg;
+static const run_t *run;
+
+/* Simulated time in ns */
+static uint64_t now_ns;
+static uint64_t req_t;          /* next request of the pacer */
+static uint64_t req_start;
+static uint32_t req_n;          /* requests since the start */
+
+/* BDMA channel 0 */
+static host_mmio_t bdma_m;
+static volatile struct
+{
+  uint32_t isr;
+  uint32_t enabled;
+  uint32_t ndtr;
+  uint32_t reload;
+  uint32_t pos;
+  uint32_t irq;                 /* interrupt raised and not yet served */
+  uint32_t missed;              /* requests the D3 side did not serve */
+} bdma;
+
+static host_mmio_t lptim_m;
+static host_mmio_t pwr_m;
+
+/* The CPU */
+static struct
+{
+  uint32_t stopped;
+  uint32_t wakes;               /* Stop entered and left */
+  uint32_t spurious;            /* woken by something else */
+  uint32_t races;
+  uint32_t stuck;               /* slept SLEEP_MAX_NS */
+} cpu;
+
+/* The consumer */
+static struct
+{
+  uint32_t batches;
+  uint32_t samples;             /* released intact */
+  uint32_t torn;                /* batches release refused */
+  uint32_t lost;                /* sum of batch.lost */
+  uint32_t next;                /* number expected next */
+  uint32_t stale;               /* wrong samples at get */
+  uint32_t corrupt;             /* wrong samples at a successful release */
+  uint32_t gaps;                /* batch.first not where expected */
+} cons;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static uint64_t sample_ns(void)
+{
+  return (run->lptim != NULL) ? (((uint64_t)run->period * 1000000000ULL) / LSE_HZ) : LPUART_BYTE_NS;
+}
+
+static uint64_t batch_ns(void)
+{
+  return sample_ns() * run->threshold;
+}
+
+/* Sample n as the source register reads it */
+static uint32_t sample(uint32_t n)
+{
+  return (run->size == 4U) ? n : (n & ((1UL << (8U * run->size)) - 1U));
+}
+
+static uint32_t sample_at(const void *samples, uint32_t i)
+{
+  if(run->size == 4U)
+  {
+    return ((const uint32_t *)samples)[i];
+  }
+  return (run->size == 2U) ? ((const uint16_t *)samples)[i] : ((const uint8_t *)samples)[i];
+}
+
+static void bdma_isr_fn(void)
+{
+  bdma.irq = 0U;
+  HAL_DMA_IRQHandler(&hdma);
+}
+
+/* D3 ------------------------------------------------------------------------*/
+/* RCC and DMAMUX2 share pages with PWR and the BDMA: read without a trap,
+   the models run inside one */
+static uint32_t reg_peek(const volatile uint32_t *reg)
+{
+  host_mmio_t at;
+
+  at.base = (uintptr_t)reg;
+  return host_mmio_get(&at, 0U);
+}
+
+/* Whether a request of the pacer gets to the BDMA channel and is served:
+   clocks, routing and, in Stop, the autonomous mode */
+static uint32_t d3_serves(void)
+{
+  uint32_t ccr = host_mmio_get(&bdma_m, CHAN_REG(CCR));
+  uint32_t rgcr = reg_peek(&DMAMUX2_RequestGenerator0->RGCR);
+  uint32_t route = reg_peek(&DMAMUX2_Channel0->CCR) & DMAMUX_CxCR_DMAREQ_ID;
+  uint32_t d3amr = reg_peek(&RCC->D3AMR);
+  uint32_t amen;
+
+  if((bdma.enabled == 0U) || ((ccr & BDMA_CCR_EN) == 0U) ||
+     ((reg_peek(&RCC->AHB4ENR) & RCC_AHB4ENR_BDMAEN) == 0U))
+  {
+    return 0U;
+  }
+  if(run->lptim != NULL)
+  {
+    if(((host_mmio_get(&lptim_m, offsetof(LPTIM_TypeDef, CR)) & (LPTIM_CR_ENABLE | LPTIM_CR_CNTSTRT)) !=
+        (LPTIM_CR_ENABLE | LPTIM_CR_CNTSTRT)) ||
+       (route != BDMA_REQUEST_GENERATOR0) ||
+       ((rgcr & DMAMUX_RGxCR_GE) == 0U) || ((rgcr & DMAMUX_RGxCR_GNBREQ) != 0U) ||
+       ((rgcr & DMAMUX_RGxCR_SIG_ID) !=
+        ((run->lptim == LPTIM2) ? HAL_DMAMUX2_REQ_GEN_LPTIM2_OUT : HAL_DMAMUX2_REQ_GEN_LPTIM3_OUT)))
+    {
+      return 0U;
+    }
+    amen = (run->lptim == LPTIM2) ? RCC_D3AMR_LPTIM2AMEN : RCC_D3AMR_LPTIM3AMEN;
+  }
+  else
+  {
+    if(route != BDMA_REQUEST_LPUART1_RX)
+    {
+      return 0U;
+    }
+    amen = RCC_D3AMR_LPUART1AMEN;
+  }
+  if(cpu.stopped != 0U)
+  {
+    amen |= RCC_D3AMR_BDMAAMEN | RCC_D3AMR_SRAM4AMEN;
+    if(((host_mmio_get(&pwr_m, offsetof(PWR_TypeDef, CPUCR)) & PWR_CPUCR_RUN_D3) == 0U) ||
+       ((d3amr & amen) != amen))
+    {
+      return 0U;
+    }
+  }
+  return 1U;
+}
+
+/* The BDMA interrupt, if enabled in the NVIC */
+static void bdma_flag(uint32_t flag)
+{
+  uint32_t ccr = host_mmio_get(&bdma_m, CHAN_REG(CCR));
+
+  bdma.isr |= flag | 0x1U;
+  if(((((flag & BDMA_C0_HT) != 0U) && ((ccr & BDMA_CCR_HTIE) != 0U)) ||
+      (((flag & BDMA_C0_TC) != 0U) && ((ccr & BDMA_CCR_TCIE) != 0U))) &&
+     ((NVIC->ISER[(uint32_t)BDMA_Channel0_IRQn >> 5] & (1UL << ((uint32_t)BDMA_Channel0_IRQn & 31U))) != 0U))
+  {
+    bdma.irq = 1U;
+    host_irq_raise(bdma_isr_fn);
+  }
+}
+
+/* The pacer requests one sample */
+static void d3_request(void)
+{
+  uint8_t *dst;
+  uint32_t v = sample(req_n);
+
+  req_n++;
+  req_t = req_start + (req_n * sample_ns());
+  if(d3_serves() == 0U)
+  {
+    bdma.missed++;
+    return;
+  }
+  dst = (uint8_t *)(uintptr_t)host_mmio_get(&bdma_m, CHAN_REG(CM0AR)) + (bdma.pos * run->size);
+  memcpy(dst, &v, run->size);
+  bdma.pos++;
+  bdma.ndtr--;
+  if(bdma.ndtr == bdma.reload / 2U)
+  {
+    bdma_flag(BDMA_C0_HT);
+  }
+  if(bdma.ndtr == 0U)
+  {
+    bdma.ndtr = bdma.reload;
+    bdma.pos = 0U;
+    bdma_flag(BDMA_C0_TC);
+  }
+}
+
+static uint32_t bdma_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  (void)m;
+  if(offset == BDMA_REG(ISR))
+  {
+    return bdma.isr;
+  }
+  if((offset == CHAN_REG(CNDTR)) && (bdma.enabled != 0U))
+  {
+    return bdma.ndtr;
+  }
+  return current;
+}
+
+static void bdma_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  (void)m;
+  (void)size;
+  if(offset == BDMA_REG(IFCR))
+  {
+    bdma.isr &= ~(value & 0xFU);
+    if((bdma.isr & 0xEU) == 0U)
+    {
+      bdma.isr = 0U;
+    }
+  }
+  else if(offset == CHAN_REG(CCR))
+  {
+    if(((value & BDMA_CCR_EN) != 0U) && (bdma.enabled == 0U))
+    {
+      bdma.enabled = 1U;
+      bdma.reload = host_mmio_get(&bdma_m, CHAN_REG(CNDTR));
+      bdma.ndtr = bdma.reload;
+      bdma.pos = 0U;
+    }
+    else if(((value & BDMA_CCR_EN) == 0U) && (bdma.enabled != 0U))
+    {
+      bdma.enabled = 0U;
+      host_mmio_set(&bdma_m, CHAN_REG(CNDTR), bdma.ndtr);
+    }
+  }
+}
+
+/* ARR and CMP writes complete at once */
+static uint32_t lptim_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  (void)m;
+  if(offset == offsetof(LPTIM_TypeDef, ISR))
+  {
+    return LPTIM_ISR_ARROK | LPTIM_ISR_CMPOK;
+  }
+  return current;
+}
+
+/* The pacer runs from its start, the LPTIM case from CNTSTRT */
+static void lptim_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  (void)m;
+  (void)size;
+  if(offset != offsetof(LPTIM_TypeDef, CR))
+  {
+    return;
+  }
+  if((value & LPTIM_CR_ENABLE) == 0U)
+  {
+    req_t = NEVER;
+  }
+  else if(((value & LPTIM_CR_CNTSTRT) != 0U) && (req_t == NEVER))
+  {
+    req_start = now_ns;
+    req_n = 0U;
+    req_t = now_ns + sample_ns();
+  }
+}
+
+/* CPU ---------------------------------------------------------------------*/
+static void wake_isr_fn(void)
+{
+}
+
+/* Requests go on while the CPU is on its way into Stop: a batch completes,
+   its interrupt pending */
+static void race_jump(void)
+{
+  uint32_t n;
+
+  for(n = 0U; (n < 4U * run->threshold) && (bdma.irq == 0U) && (req_t != NEVER); n++)
+  {
+    now_ns = req_t;
+    d3_request();
+  }
+}
+
+/* Entering Stop: HAL_PWREx_EnterSTOPMode() sets the regulator first */
+static void pwr_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  (void)m;
+  (void)value;
+  (void)size;
+  if((offset == offsetof(PWR_TypeDef, CR1)) && ((rnd() % 256U) < run->race))
+  {
+    cpu.races++;
+    race_jump();
+  }
+}
+
+/* __WFI() with nothing pending: D1 stops until the BDMA interrupt comes
+   through EXTI, or something else wakes it */
+static void cpu_idle(void)
+{
+  uint64_t end = now_ns + SLEEP_MAX_NS;
+  uint64_t wake_t = NEVER;
+
+  HOST_CHECK((SCB->SCR & SCB_SCR_SLEEPDEEP_Msk) != 0U);
+  cpu.stopped = 1U;
+  cpu.wakes++;
+  if((rnd() % 256U) < run->spurious)
+  {
+    wake_t = now_ns + (rnd() % batch_ns());
+  }
+  for(;;)
+  {
+    if((req_t > end) && (wake_t > end))
+    {
+      now_ns = end;
+      cpu.stuck++;
+      break;
+    }
+    if(wake_t < req_t)
+    {
+      now_ns = wake_t;
+      cpu.spurious++;
+      host_irq_raise(wake_isr_fn);
+      break;
+    }
+    now_ns = req_t;
+    d3_request();
+    if((bdma.irq != 0U) && ((EXTI_D1->IMR3 & (1UL << (2U + BDMA_CH))) != 0U))
+    {
+      break;
+    }
+  }
+  cpu.stopped = 0U;
+}
+
+/* Awake: time runs to t, the interrupts land as they are raised */
+static void advance(uint64_t t)
+{
+  while(req_t <= t)
+  {
+    now_ns = req_t;
+    d3_request();
+    host_irq_poll();
+  }
+  now_ns = t;
+}
+
+/* The application -----------------------------------------------------------*/
+/* Drain the batches, holding each for a while */
+static void consume(void)
+{
+  d3_log_batch_t batch;
+  uint64_t hold;
+  uint32_t bad = 0U;
+  uint32_t i;
+
+  while(d3_log_get(&lg, &batch) == HAL_OK)
+  {
+    cons.batches++;
+    cons.lost += batch.lost;
+    cons.gaps += ((batch.first != (cons.next + batch.lost)) || (batch.count != run->threshold)) ? 1U : 0U;
+    for(i = 0U; i < batch.count; i++)
+    {
+      cons.stale += (sample_at(batch.samples, i) != sample(batch.first + i)) ? 1U : 0U;
+    }
+
+    hold = rnd() % (((batch_ns() * run->work) / 100U) + 1U);
+    if((run->stall != 0U) && ((rnd() % 256U) < run->stall))
+    {
+      hold += batch_ns() + (rnd() % (3U * batch_ns()));
+    }
+    advance(now_ns + hold);
+
+    bad = 0U;
+    for(i = 0U; i < batch.count; i++)
+    {
+      bad += (sample_at(batch.samples, i) != sample(batch.first + i)) ? 1U : 0U;
+    }
+    if(d3_log_release(&lg) == HAL_OK)
+    {
+      cons.samples += batch.count;
+      cons.corrupt += bad;
+    }
+    else
+    {
+      cons.torn++;
+    }
+    cons.next = batch.first + batch.count;
+  }
+}
+
+static void run_log(const char *name, const run_t *r)
+{
+  uint32_t guard;
+
+  run = r;
+  memset(&cons, 0, sizeof(cons));
+  memset(&cpu, 0, sizeof(cpu));
+  bdma.missed = 0U;
+  req_t = NEVER;
+
+  lg.hdma = &hdma;
+  lg.size = r->size;
+  lg.threshold = r->threshold;
+  if(r->lptim != NULL)
+  {
+    /* The kernel clock is the caller's: LSE */
+    if(r->lptim == LPTIM2)
+    {
+      __HAL_RCC_LPTIM2_CONFIG(RCC_LPTIM2CLKSOURCE_LSE);
+    }
+    else
+    {
+      __HAL_RCC_LPTIM345_CONFIG(RCC_LPTIM345CLKSOURCE_LSE);
+    }
+    lptim_m.base = (uintptr_t)r->lptim;
+    host_mmio_attach(&lptim_m);
+    memset(&hlptim, 0, sizeof(hlptim));
+    hlptim.Instance = r->lptim;
+    hlptim.Init.Clock.Source = LPTIM_CLOCKSOURCE_APBCLOCK_LPOSC;
+    hlptim.Init.Clock.Prescaler = LPTIM_PRESCALER_DIV1;
+    hlptim.Init.Trigger.Source = LPTIM_TRIGSOURCE_SOFTWARE;
+    hlptim.Init.OutputPolarity = LPTIM_OUTPUTPOLARITY_HIGH;
+    hlptim.Init.UpdateMode = LPTIM_UPDATE_IMMEDIATE;
+    hlptim.Init.CounterSource = LPTIM_COUNTERSOURCE_INTERNAL;
+    lg.hlptim = &hlptim;
+    lg.request = BDMA_REQUEST_GENERATOR0;
+    lg.source = (uint32_t)&ADC3->DR;
+    lg.period = r->period;
+  }
+  else
+  {
+    lg.hlptim = NULL;
+    lg.request = BDMA_REQUEST_LPUART1_RX;
+    lg.source = (uint32_t)&LPUART1->RDR;
+    lg.period = 0U;
+  }
+
+  HOST_CHECK_EQ(d3_log_init(&lg), HAL_OK);
+  HOST_CHECK_EQ(d3_log_start(&lg), HAL_OK);
+  if(r->lptim == NULL)
+  {
+    /* The sensor starts talking */
+    req_start = now_ns;
+    req_n = 0U;
+    req_t = now_ns + sample_ns();
+  }
+  for(guard = 0U; (guard < 10U * r->batches) && (cons.batches < r->batches) && (cpu.stuck == 0U); guard++)
+  {
+    d3_log_sleep(&lg);
+    consume();
+    /* The rest of the loop: a batch may complete before the next sleep */
+    advance(now_ns + (rnd() % (((batch_ns() * run->work) / 200U) + 1U)));
+  }
+  if(r->lptim == NULL)
+  {
+    req_t = NEVER;
+  }
+  HOST_CHECK_EQ(d3_log_stop(&lg), HAL_OK);
+
+  printf("  %-18s %5u batches of %4u, %3u wakeups (%u by other interrupts, %u on the way in), "
+         "%u samples lost, %u batches torn\n", name, (unsigned)cons.batches, (unsigned)r->threshold,
+         (unsigned)cpu.wakes, (unsigned)cpu.spurious, (unsigned)cpu.races, (unsigned)lg.stats.lost,
+         (unsigned)lg.stats.torn);
+  HOST_CHECK_EQ(cpu.stuck, 0U);
+  HOST_CHECK(cons.batches >= r->batches);
+  HOST_CHECK_EQ(bdma.missed, 0U);
+  HOST_CHECK_EQ(cons.stale, 0U);
+  HOST_CHECK_EQ(cons.corrupt, 0U);
+  HOST_CHECK_EQ(cons.gaps, 0U);
+  HOST_CHECK_EQ(lg.stats.batches, cons.batches);
+  HOST_CHECK_EQ(lg.stats.lost, cons.lost);
+  HOST_CHECK_EQ(lg.stats.torn, cons.torn);
+  HOST_CHECK_EQ(lg.stats.dma_errors, 0U);
+  /* Every sample up to the last batch is accounted for */
+  HOST_CHECK_EQ(cons.samples + (cons.torn * r->threshold) + cons.lost, lg.count * r->threshold);
+  HOST_CHECK(lg.halves * r->threshold <= req_n);
+  HOST_CHECK(req_n < (lg.halves + 1U) * r->threshold);
+  /* One wakeup per batch, and sleeps end with a batch unless something
+     else woke the CPU */
+  HOST_CHECK(cpu.wakes <= cons.batches + cpu.spurious + 1U);
+  HOST_CHECK(lg.stats.sleeps - lg.stats.wakeups <= cpu.spurious);
+  HOST_CHECK((cpu.spurious != 0U) == (r->spurious != 0U));
+  HOST_CHECK((cpu.races != 0U) == (r->race != 0U));
+  if(r->stall == 0U)
+  {
+    HOST_CHECK_EQ(cons.lost, 0U);
+    HOST_CHECK_EQ(cons.torn, 0U);
+  }
+  else
+  {
+    HOST_CHECK(cons.lost != 0U);
+    HOST_CHECK(cons.torn != 0U);
+  }
+
+  /* Stopped: D3 may stop with D1 again */
+  HOST_CHECK_EQ(lg.running, 0U);
+  HOST_CHECK_EQ(bdma.enabled, 0U);
+  HOST_CHECK_EQ(host_mmio_get(&pwr_m, offsetof(PWR_TypeDef, CPUCR)) & PWR_CPUCR_RUN_D3, 0U);
+  if(r->lptim != NULL)
+  {
+    HOST_CHECK_EQ(host_mmio_get(&lptim_m, offsetof(LPTIM_TypeDef, ARR)), r->period - 1U);
+    HOST_CHECK_EQ(host_mmio_get(&lptim_m, offsetof(LPTIM_TypeDef, CR)) & LPTIM_CR_ENABLE, 0U);
+    host_mmio_detach(&lptim_m);
+  }
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  /* pacer, size, period, threshold, batches, work %, stall, spurious, race */
+  static const run_t lptim2 = {LPTIM2, 4U, 32U, 64U, 200U, 50U, 0U, 32U, 48U};
+  static const run_t lptim3 = {LPTIM3, 2U, 8U, 500U, 80U, 80U, 0U, 48U, 64U};
+  static const run_t lpuart = {NULL, 1U, 0U, 32U, 200U, 50U, 0U, 32U, 48U};
+  static const run_t slow = {LPTIM2, 4U, 32U, 64U, 300U, 90U, 32U, 16U, 32U};
+
+  bdma_m.base = BDMA_BASE;
+  bdma_m.size = (BDMA_Channel0_BASE - BDMA_BASE) + sizeof(BDMA_Channel_TypeDef);
+  bdma_m.read = bdma_read;
+  bdma_m.write = bdma_write;
+  host_mmio_attach(&bdma_m);
+  pwr_m.base = PWR_BASE;
+  pwr_m.size = sizeof(PWR_TypeDef);
+  pwr_m.write = pwr_write;
+  host_mmio_attach(&pwr_m);
+  lptim_m.size = sizeof(LPTIM_TypeDef);
+  lptim_m.read = lptim_read;
+  lptim_m.write = lptim_write;
+  host_set_idle(cpu_idle);
+
+  hdma.Instance = BDMA_Channel0;
+  hdma.Init.Priority = DMA_PRIORITY_HIGH;
+
+  run_log("LPTIM2, 32-bit", &lptim2);
+  run_log("LPTIM3, 16-bit", &lptim3);
+  run_log("LPUART1, 8-bit", &lpuart);
+  run_log("slow consumer", &slow);
+
+  host_set_idle(NULL);
+  host_mmio_detach(&pwr_m);
+  host_mmio_detach(&bdma_m);
+  return host_result();
+}
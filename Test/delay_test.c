@@ -0,0 +1,196 @@
+/* Header includes -----------------------------------------------------------*/
+#include "delay.h"
+#include <stddef.h>
+#include <stdlib.h>
+
+/* delay: the busy-waits run against a DWT model whose CYCCNT moves a fixed
+   number of cycles per load, so every delay is an exact count of cycles.
+   The model keeps the DWT locked until the LAR key and counts only with
+   TRCENA and CYCCNTENA set, as the Cortex-M7 does. Checked: the lazy setup
+   on the first call, that a debugger's running counter is left alone, waits
+   across the 32-bit wrap, delays longer than a wrap split into chunks, the
+   rounding for core clocks that are not whole MHz and the recalibration
+   after SystemCoreClock changes. */
+
+/* Private macro -------------------------------------------------------------*/
+#define DWT_LAR_KEY             0xC5ACCE55U
+#define US                      1000000ULL
+
+/* Private variables ---------------------------------------------------------*/
+static host_mmio_t dwt_m;
+static volatile struct
+{
+  uint32_t locked;
+  uint32_t step;                /* cycles per CYCCNT load */
+  uint64_t loads;               /* left before a delay counts as hung */
+  uint64_t total;               /* cycles counted, without the wrap */
+} dwt;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t dwt_counting(void)
+{
+  return ((CoreDebug->DEMCR & CoreDebug_DEMCR_TRCENA_Msk) != 0U) &&
+         ((host_mmio_get(&dwt_m, offsetof(DWT_Type, CTRL)) & DWT_CTRL_CYCCNTENA_Msk) != 0U);
+}
+
+static uint32_t dwt_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  if(offset != offsetof(DWT_Type, CYCCNT))
+  {
+    return current;
+  }
+  if(dwt.loads-- == 0U)
+  {
+    HOST_CHECK(!"delay did not end");
+    exit(host_result());
+  }
+  if(dwt_counting())
+  {
+    current += dwt.step;
+    dwt.total += dwt.step;
+    host_mmio_set(m, offset, current);
+  }
+  return current;
+}
+
+static void dwt_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  static uint32_t ctrl;
+  static uint32_t cyccnt;
+
+  if(offset == offsetof(DWT_Type, LAR))
+  {
+    dwt.locked = (value == DWT_LAR_KEY) ? 0U : 1U;
+  }
+  else if(dwt.locked != 0U)
+  {
+    /* Ignored while locked */
+    host_mmio_set(m, offsetof(DWT_Type, CTRL), ctrl);
+    host_mmio_set(m, offsetof(DWT_Type, CYCCNT), cyccnt);
+  }
+  ctrl = host_mmio_get(m, offsetof(DWT_Type, CTRL));
+  cyccnt = host_mmio_get(m, offsetof(DWT_Type, CYCCNT));
+}
+
+/* The DWT as after a reset: locked, stopped */
+static void dwt_reset(void)
+{
+  dwt.locked = 0U;
+  host_mmio_set(&dwt_m, offsetof(DWT_Type, CTRL), 0U);
+  host_mmio_set(&dwt_m, offsetof(DWT_Type, CYCCNT), 0U);
+  DWT->LAR = 0U;
+  CoreDebug->DEMCR = 0U;
+  dwt.total = 0U;
+}
+
+/* Cycles nus took with step cycles per load, checked against the exact
+   count at the current clock: at least that, and over by no more than the
+   loads that straddle the start and end of each 1 s chunk */
+static void check_us(uint32_t nus, uint32_t step)
+{
+  uint64_t cycles = (((uint64_t)nus * SystemCoreClock) + US - 1U) / US;
+  uint64_t chunks = ((uint64_t)nus + US - 1U) / US;
+  uint64_t begin = dwt.total;
+  uint64_t took;
+
+  dwt.step = step;
+  dwt.loads = (2U * cycles / step) + 1000U;
+  delayus(nus);
+  took = dwt.total - begin;
+  if(!HOST_CHECK(took >= cycles) ||
+     !HOST_CHECK(took <= cycles + ((uint64_t)step * ((2U * chunks) + 2U))))
+  {
+    printf("  %u us at %u Hz: %llu cycles, want %llu\n", (unsigned)nus, (unsigned)SystemCoreClock,
+           (unsigned long long)took, (unsigned long long)cycles);
+  }
+}
+
+static void test_lazy(void)
+{
+  SystemCoreClock = 480000000U;
+  dwt_reset();
+  /* No delay_init(): the first call sets the counter up */
+  check_us(10U, 7U);
+  HOST_CHECK(dwt.locked == 0U);
+  HOST_CHECK(dwt_counting());
+
+  /* Already running under a debugger: delay_init() must not restart it */
+  host_mmio_set(&dwt_m, offsetof(DWT_Type, CYCCNT), 0x12345678U);
+  delay_init();
+  HOST_CHECK(delay_cycles() > 0x12345678U);
+}
+
+static void test_wrap(void)
+{
+  uint64_t begin;
+
+  SystemCoreClock = 480000000U;
+  dwt_reset();
+  delay_init();
+  host_mmio_set(&dwt_m, offsetof(DWT_Type, CYCCNT), 0xFFFFFFFFU - 2000U);
+  check_us(100U, 50U);
+  HOST_CHECK(delay_cycles() < 0x10000U);
+
+  host_mmio_set(&dwt_m, offsetof(DWT_Type, CYCCNT), 0xFFFFFFFFU - 100U);
+  dwt.step = 3U;
+  dwt.loads = 1000U;
+  begin = dwt.total;
+  delay_cycles_wait(1000U);
+  HOST_CHECK(dwt.total - begin >= 1000U);
+  HOST_CHECK(dwt.total - begin <= 1000U + (2U * 3U));
+}
+
+static void test_long(void)
+{
+  SystemCoreClock = 480000000U;
+  dwt_reset();
+  delay_init();
+  host_mmio_set(&dwt_m, offsetof(DWT_Type, CYCCNT), 0xF0000000U);
+  /* 20 s: more than two wraps of CYCCNT at 480 MHz, in 1 s chunks */
+  check_us(20000000U, 7500000U);
+  /* The largest argument, about 1.2 hours */
+  SystemCoreClock = 64000000U;
+  check_us(0xFFFFFFFFU, 32000000U);
+}
+
+static void test_clock(void)
+{
+  static const uint32_t clocks[] = {480000000U, 400000000U, 64000000U, 12345678U, 4000000U, 32768U};
+  uint32_t clock;
+  uint32_t i;
+
+  dwt_reset();
+  SystemCoreClock = 480000000U;
+  delay_init();
+  /* Changed without telling the driver, as SystemCoreClockUpdate() does */
+  for(i = 0U; i < (sizeof(clocks) / sizeof(clocks[0])); i++)
+  {
+    clock = clocks[i];
+    SystemCoreClock = clock;
+    /* Exact to the cycle where the fraction of a MHz shows */
+    check_us(100U, (clock < 20000000U) ? 1U : (clock / 1000000U));
+    check_us(100000U, (clock < 1000000U) ? 1U : (clock / 10000U));
+    check_us(1234567U, (clock < 1000000U) ? 1U : (clock / 1000U));
+  }
+  SystemCoreClock = 480000000U;
+  check_us(1U, 1U);
+  check_us(0U, 1U);
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  dwt_m.base = (uintptr_t)DWT;
+  dwt_m.size = 0x1000U;
+  dwt_m.read = dwt_read;
+  dwt_m.write = dwt_write;
+  host_mmio_attach(&dwt_m);
+
+  test_lazy();
+  test_wrap();
+  test_long();
+  test_clock();
+
+  host_mmio_detach(&dwt_m);
+  return host_result();
+}
@@ -0,0 +1,307 @@
+/* Header includes -----------------------------------------------------------*/
+#include "dma_alloc.h"
+#include <string.h>
+
+/* dma_alloc: which controller and stream a request gets, what it refuses,
+   the failure and utilisation counters. The streams are plain memory; a
+   stream is "running" when the test sets its enable bit. */
+
+/* Private macro -------------------------------------------------------------*/
+#define AXI_BUF                 ((const void *)0x24001000U)
+#define SRAM4_BUF               ((const void *)(D3_SRAM_BASE + 0x100U))
+#define DTCM_BUF                ((const void *)(D1_DTCMRAM_BASE + 0x100U))
+
+/* Private variables ---------------------------------------------------------*/
+static DMA_HandleTypeDef h[32];
+static MDMA_HandleTypeDef hm[17];
+
+/* Private functions ---------------------------------------------------------*/
+static dma_alloc_req_t req(uint32_t mux, uint32_t request, uint32_t cls, const void *mem, const void *mem2)
+{
+  dma_alloc_req_t r;
+
+  memset(&r, 0, sizeof(r));
+  r.mux = mux;
+  r.request = request;
+  r.cls = cls;
+  r.mem = mem;
+  r.len = (mem != NULL) ? 256U : 0U;
+  r.mem2 = mem2;
+  r.len2 = (mem2 != NULL) ? 256U : 0U;
+  return r;
+}
+
+static HAL_StatusTypeDef take(DMA_HandleTypeDef *hdma, uint32_t mux, uint32_t request, uint32_t cls,
+                              const void *mem, const void *mem2)
+{
+  dma_alloc_req_t r = req(mux, request, cls, mem, mem2);
+  HAL_StatusTypeDef status;
+
+  memset(hdma, 0, sizeof(*hdma));
+  status = dma_alloc_dma(hdma, &r);
+  /* Interrupts are masked only inside */
+  HOST_CHECK_EQ(host_get_primask(), 0U);
+  return status;
+}
+
+static uint32_t is_dma1(const DMA_HandleTypeDef *hdma)
+{
+  return (((uint32_t)hdma->Instance >= DMA1_Stream0_BASE) && ((uint32_t)hdma->Instance <= DMA1_Stream7_BASE)) ? 1U : 0U;
+}
+
+static uint32_t is_dma2(const DMA_HandleTypeDef *hdma)
+{
+  return (((uint32_t)hdma->Instance >= DMA2_Stream0_BASE) && ((uint32_t)hdma->Instance <= DMA2_Stream7_BASE)) ? 1U : 0U;
+}
+
+static uint32_t is_bdma(const DMA_HandleTypeDef *hdma)
+{
+  return (((uint32_t)hdma->Instance >= BDMA_Channel0_BASE) && ((uint32_t)hdma->Instance <= BDMA_Channel7_BASE)) ? 1U : 0U;
+}
+
+static void free_all(void)
+{
+  uint32_t i;
+
+  for(i = 0U; i < 8U; i++)
+  {
+    dma_alloc_free(DMA1_Stream0 + i);
+    dma_alloc_free(DMA2_Stream0 + i);
+    dma_alloc_free(BDMA_Channel0 + i);
+  }
+  for(i = 0U; i < 16U; i++)
+  {
+    dma_alloc_free((const void *)(MDMA_Channel0_BASE + (i * 0x40U)));
+  }
+  dma_alloc_stats_reset();
+}
+
+/* Controller by domain, request and priority as asked */
+static void test_route(void)
+{
+  HOST_CHECK_EQ(take(&h[0], DMA_ALLOC_MUX1, DMA_REQUEST_USART1_RX, DMA_ALLOC_NORMAL, AXI_BUF, NULL), HAL_OK);
+  HOST_CHECK(is_dma1(&h[0]) || is_dma2(&h[0]));
+  HOST_CHECK_EQ(h[0].Init.Request, DMA_REQUEST_USART1_RX);
+  HOST_CHECK_EQ(h[0].Init.Priority, DMA_PRIORITY_MEDIUM);
+
+  HOST_CHECK_EQ(take(&h[1], DMA_ALLOC_MUX2, BDMA_REQUEST_LPUART1_RX, DMA_ALLOC_REALTIME, SRAM4_BUF, NULL), HAL_OK);
+  HOST_CHECK(is_bdma(&h[1]));
+  HOST_CHECK_EQ(h[1].Init.Request, BDMA_REQUEST_LPUART1_RX);
+  HOST_CHECK_EQ(h[1].Init.Priority, DMA_PRIORITY_VERY_HIGH);
+
+  /* Memory to memory: D3 to D3 on the BDMA, otherwise DMA1/DMA2 */
+  HOST_CHECK_EQ(take(&h[2], DMA_ALLOC_MEM, 0U, DMA_ALLOC_BULK, SRAM4_BUF, SRAM4_BUF), HAL_OK);
+  HOST_CHECK(is_bdma(&h[2]));
+  HOST_CHECK_EQ(h[2].Init.Request, DMA_REQUEST_MEM2MEM);
+  HOST_CHECK_EQ(h[2].Init.Priority, DMA_PRIORITY_LOW);
+  HOST_CHECK_EQ(take(&h[3], DMA_ALLOC_MEM, 0U, DMA_ALLOC_STREAM, AXI_BUF, SRAM4_BUF), HAL_OK);
+  HOST_CHECK(is_dma1(&h[3]) || is_dma2(&h[3]));
+  HOST_CHECK_EQ(h[3].Init.Priority, DMA_PRIORITY_HIGH);
+
+  /* Out of reach or malformed */
+  HOST_CHECK_EQ(take(&h[4], DMA_ALLOC_MUX1, DMA_REQUEST_USART1_RX, DMA_ALLOC_NORMAL, DTCM_BUF, NULL), HAL_ERROR);
+  HOST_CHECK_EQ(take(&h[4], DMA_ALLOC_MUX1, DMA_REQUEST_USART1_RX, DMA_ALLOC_NORMAL, (const void *)0x100U, NULL), HAL_ERROR);
+  HOST_CHECK_EQ(take(&h[4], DMA_ALLOC_MUX2, BDMA_REQUEST_LPUART1_RX, DMA_ALLOC_NORMAL, AXI_BUF, NULL), HAL_ERROR);
+  HOST_CHECK_EQ(take(&h[4], DMA_ALLOC_MEM, 0U, DMA_ALLOC_NORMAL, AXI_BUF, DTCM_BUF), HAL_ERROR);
+  HOST_CHECK_EQ(take(&h[4], DMA_ALLOC_MUX1, DMA_REQUEST_USART1_RX, DMA_ALLOC_REALTIME + 1U, AXI_BUF, NULL), HAL_ERROR);
+  HOST_CHECK_EQ(take(&h[4], 7U, DMA_REQUEST_USART1_RX, DMA_ALLOC_NORMAL, AXI_BUF, NULL), HAL_ERROR);
+  HOST_CHECK_EQ(dma_alloc_stats()->refused, 6U);
+  HOST_CHECK(h[4].Instance == NULL);
+  free_all();
+}
+
+/* Upper classes from stream 0 up, the others from stream 7 down; DMA1 and
+   DMA2 kept level by priority weight */
+static void test_streams(void)
+{
+  uint32_t i;
+
+  HOST_CHECK_EQ(take(&h[0], DMA_ALLOC_MUX2, BDMA_REQUEST_LPUART1_RX, DMA_ALLOC_STREAM, SRAM4_BUF, NULL), HAL_OK);
+  HOST_CHECK(h[0].Instance == (void *)BDMA_Channel0);
+  HOST_CHECK_EQ(take(&h[1], DMA_ALLOC_MUX2, BDMA_REQUEST_LPUART1_TX, DMA_ALLOC_BULK, SRAM4_BUF, NULL), HAL_OK);
+  HOST_CHECK(h[1].Instance == (void *)BDMA_Channel7);
+  HOST_CHECK_EQ(take(&h[2], DMA_ALLOC_MUX2, BDMA_REQUEST_SPI6_RX, DMA_ALLOC_REALTIME, SRAM4_BUF, NULL), HAL_OK);
+  HOST_CHECK(h[2].Instance == (void *)BDMA_Channel1);
+  HOST_CHECK_EQ(take(&h[3], DMA_ALLOC_MUX2, BDMA_REQUEST_SPI6_TX, DMA_ALLOC_NORMAL, SRAM4_BUF, NULL), HAL_OK);
+  HOST_CHECK(h[3].Instance == (void *)BDMA_Channel6);
+
+  /* Alternating while the weights are equal, towards the lighter one */
+  HOST_CHECK_EQ(take(&h[4], DMA_ALLOC_MUX1, DMA_REQUEST_USART1_RX, DMA_ALLOC_REALTIME, NULL, NULL), HAL_OK);
+  HOST_CHECK(h[4].Instance == (void *)DMA1_Stream0);
+  HOST_CHECK_EQ(take(&h[5], DMA_ALLOC_MUX1, DMA_REQUEST_USART1_TX, DMA_ALLOC_BULK, NULL, NULL), HAL_OK);
+  HOST_CHECK(h[5].Instance == (void *)DMA2_Stream7);
+  /* DMA1 4, DMA2 1: the next three go to DMA2 */
+  for(i = 6U; i < 9U; i++)
+  {
+    HOST_CHECK_EQ(take(&h[i], DMA_ALLOC_MUX1, DMA_REQUEST_USART2_RX, DMA_ALLOC_BULK, NULL, NULL), HAL_OK);
+    HOST_CHECK(is_dma2(&h[i]));
+  }
+  HOST_CHECK(h[8].Instance == (void *)DMA2_Stream4);
+  HOST_CHECK_EQ(take(&h[9], DMA_ALLOC_MUX1, DMA_REQUEST_USART2_RX, DMA_ALLOC_BULK, NULL, NULL), HAL_OK);
+  HOST_CHECK(h[9].Instance == (void *)DMA1_Stream7);
+
+  /* A freed stream is handed out again */
+  dma_alloc_free(h[4].Instance);
+  HOST_CHECK_EQ(take(&h[10], DMA_ALLOC_MUX1, DMA_REQUEST_USART3_RX, DMA_ALLOC_STREAM, NULL, NULL), HAL_OK);
+  HOST_CHECK(h[10].Instance == (void *)DMA1_Stream0);
+  HOST_CHECK_EQ(dma_alloc_stats()->ctrl[DMA_ALLOC_DMA1].stream[0].grants, 2U);
+  HOST_CHECK_EQ(dma_alloc_stats()->ctrl[DMA_ALLOC_DMA1].stream[0].request, DMA_REQUEST_USART3_RX);
+  free_all();
+}
+
+/* A failure is a request no controller in its list had room for */
+static void test_failures(void)
+{
+  const dma_alloc_stats_t *st = dma_alloc_stats();
+  uint32_t i;
+
+  /* BDMA full: D3 to D3 moves to DMA1/DMA2 and nothing failed */
+  for(i = 0U; i < 8U; i++)
+  {
+    HOST_CHECK_EQ(take(&h[i], DMA_ALLOC_MEM, 0U, DMA_ALLOC_BULK, SRAM4_BUF, SRAM4_BUF), HAL_OK);
+    HOST_CHECK(is_bdma(&h[i]));
+  }
+  HOST_CHECK_EQ(take(&h[8], DMA_ALLOC_MEM, 0U, DMA_ALLOC_BULK, SRAM4_BUF, SRAM4_BUF), HAL_OK);
+  HOST_CHECK(is_dma1(&h[8]) || is_dma2(&h[8]));
+  HOST_CHECK_EQ(st->ctrl[DMA_ALLOC_BDMA].failures, 0U);
+
+  /* DMA1 full: DMA2 serves and nothing failed */
+  for(i = 0U; i < 8U; i++)
+  {
+    if(dma_alloc_reserve(DMA1_Stream0 + i, DMA_ALLOC_NORMAL) != HAL_OK)
+    {
+      HOST_CHECK(h[8].Instance == (void *)(DMA1_Stream0 + i));
+    }
+  }
+  for(i = 9U; i < 16U; i++)
+  {
+    HOST_CHECK_EQ(take(&h[i], DMA_ALLOC_MUX1, DMA_REQUEST_USART1_RX, DMA_ALLOC_BULK, NULL, NULL), HAL_OK);
+    HOST_CHECK(is_dma2(&h[i]));
+  }
+  HOST_CHECK_EQ(st->ctrl[DMA_ALLOC_DMA1].failures, 0U);
+  HOST_CHECK_EQ(st->ctrl[DMA_ALLOC_DMA2].failures, 0U);
+
+  /* DMA2 full too (h[8] may hold one of DMA2's): a real failure, once on
+     each controller that could have served it */
+  if(is_dma2(&h[8]))
+  {
+    HOST_CHECK_EQ(take(&h[16], DMA_ALLOC_MUX1, DMA_REQUEST_USART1_RX, DMA_ALLOC_BULK, NULL, NULL), HAL_BUSY);
+  }
+  else
+  {
+    HOST_CHECK_EQ(take(&h[16], DMA_ALLOC_MUX1, DMA_REQUEST_USART1_RX, DMA_ALLOC_BULK, NULL, NULL), HAL_OK);
+    HOST_CHECK_EQ(take(&h[17], DMA_ALLOC_MUX1, DMA_REQUEST_USART1_RX, DMA_ALLOC_BULK, NULL, NULL), HAL_BUSY);
+  }
+  HOST_CHECK_EQ(st->ctrl[DMA_ALLOC_DMA1].failures, 1U);
+  HOST_CHECK_EQ(st->ctrl[DMA_ALLOC_DMA2].failures, 1U);
+  HOST_CHECK_EQ(st->ctrl[DMA_ALLOC_BDMA].failures, 0U);
+
+  /* D3 to D3 with everything full fails on all three */
+  HOST_CHECK_EQ(take(&h[18], DMA_ALLOC_MEM, 0U, DMA_ALLOC_BULK, SRAM4_BUF, SRAM4_BUF), HAL_BUSY);
+  HOST_CHECK_EQ(st->ctrl[DMA_ALLOC_BDMA].failures, 1U);
+  HOST_CHECK_EQ(st->ctrl[DMA_ALLOC_DMA1].failures, 2U);
+  HOST_CHECK_EQ(st->ctrl[DMA_ALLOC_DMA2].failures, 2U);
+  /* A refusal for reach is not a failure */
+  HOST_CHECK_EQ(take(&h[18], DMA_ALLOC_MUX1, DMA_REQUEST_USART1_RX, DMA_ALLOC_BULK, DTCM_BUF, NULL), HAL_ERROR);
+  HOST_CHECK_EQ(st->ctrl[DMA_ALLOC_DMA1].failures, 2U);
+  free_all();
+}
+
+static void test_mdma(void)
+{
+  const dma_alloc_stats_t *st = dma_alloc_stats();
+  dma_alloc_req_t r = req(0U, MDMA_REQUEST_SW, DMA_ALLOC_REALTIME, DTCM_BUF, NULL);
+  uint32_t i;
+
+  /* TCM is fine for the MDMA */
+  HOST_CHECK_EQ(dma_alloc_mdma(&hm[0], &r), HAL_OK);
+  HOST_CHECK(hm[0].Instance == MDMA_Channel0);
+  HOST_CHECK_EQ(hm[0].Init.Priority, MDMA_PRIORITY_VERY_HIGH);
+  HOST_CHECK_EQ(hm[0].Init.Request, MDMA_REQUEST_SW);
+  r.cls = DMA_ALLOC_BULK;
+  HOST_CHECK_EQ(dma_alloc_mdma(&hm[1], &r), HAL_OK);
+  HOST_CHECK(hm[1].Instance == MDMA_Channel15);
+  HOST_CHECK_EQ(dma_alloc_reserve(MDMA_Channel15, DMA_ALLOC_BULK), HAL_BUSY);
+  for(i = 2U; i < 16U; i++)
+  {
+    HOST_CHECK_EQ(dma_alloc_mdma(&hm[i], &r), HAL_OK);
+  }
+  HOST_CHECK_EQ(dma_alloc_mdma(&hm[16], &r), HAL_BUSY);
+  HOST_CHECK_EQ(st->ctrl[DMA_ALLOC_MDMA].failures, 1U);
+  r.request = 0xFFFFU;
+  HOST_CHECK_EQ(dma_alloc_mdma(&hm[16], &r), HAL_ERROR);
+  HOST_CHECK_EQ(st->ctrl[DMA_ALLOC_MDMA].failures, 1U);
+
+  HOST_CHECK_EQ(dma_alloc_reserve((const void *)(MDMA_Channel0_BASE + 4U), DMA_ALLOC_BULK), HAL_ERROR);
+  HOST_CHECK_EQ(dma_alloc_reserve(DMA1_Stream0, DMA_ALLOC_REALTIME + 1U), HAL_ERROR);
+  free_all();
+}
+
+/* Busy streams, contention, ties and the load of one stream */
+static void test_sample(void)
+{
+  const dma_alloc_ctrl_stats_t *c = &dma_alloc_stats()->ctrl[DMA_ALLOC_DMA1];
+  uint32_t i;
+
+  HOST_CHECK_EQ(dma_alloc_reserve(DMA1_Stream0, DMA_ALLOC_STREAM), HAL_OK);
+  HOST_CHECK_EQ(dma_alloc_reserve(DMA1_Stream1, DMA_ALLOC_STREAM), HAL_OK);
+  HOST_CHECK_EQ(dma_alloc_reserve(DMA1_Stream2, DMA_ALLOC_BULK), HAL_OK);
+  for(i = 0U; i < 100U; i++)
+  {
+    DMA1_Stream0->CR = ((i % 2U) == 0U) ? DMA_SxCR_EN : 0U;
+    DMA1_Stream1->CR = ((i % 4U) == 0U) ? DMA_SxCR_EN : 0U;
+    DMA1_Stream2->CR = ((i % 5U) == 0U) ? DMA_SxCR_EN : 0U;
+    /* Enabled but not the allocator's: busy, no class */
+    DMA1_Stream5->CR = ((i % 10U) == 0U) ? DMA_SxCR_EN : 0U;
+    dma_alloc_sample();
+  }
+  HOST_CHECK_EQ(c->samples, 100U);
+  HOST_CHECK_EQ(c->stream[0].busy, 50U);
+  HOST_CHECK_EQ(c->stream[5].busy, 10U);
+  HOST_CHECK_EQ(dma_alloc_load(DMA1_Stream0), 500U);
+  HOST_CHECK_EQ(dma_alloc_load(DMA1_Stream1), 250U);
+  HOST_CHECK_EQ(dma_alloc_load(DMA1_Stream2), 200U);
+  HOST_CHECK_EQ(dma_alloc_load((const void *)0x24000000U), 0U);
+  /* Two or more: i % 4 == 0 (with 0), i % 10 == 0 with 0, i % 5 == 0 with
+     0 or 1; counted by hand */
+  {
+    uint32_t contended = 0U;
+    uint32_t tied = 0U;
+
+    for(i = 0U; i < 100U; i++)
+    {
+      uint32_t n = ((i % 2U) == 0U) + ((i % 4U) == 0U) + ((i % 5U) == 0U) + ((i % 10U) == 0U);
+
+      contended += (n >= 2U) ? 1U : 0U;
+      tied += ((i % 4U) == 0U) ? 1U : 0U;
+    }
+    HOST_CHECK_EQ(c->contended, contended);
+    HOST_CHECK_EQ(c->tied, tied);
+  }
+  HOST_CHECK_EQ(c->peak, 4U);
+  HOST_CHECK_EQ(dma_alloc_stats()->ctrl[DMA_ALLOC_DMA2].samples, 100U);
+  HOST_CHECK_EQ(dma_alloc_stats()->ctrl[DMA_ALLOC_DMA2].peak, 0U);
+
+  /* Counters go, allocations stay */
+  dma_alloc_stats_reset();
+  HOST_CHECK_EQ(c->samples, 0U);
+  HOST_CHECK_EQ(c->stream[0].busy, 0U);
+  HOST_CHECK_EQ(c->stream[0].used, 1U);
+  HOST_CHECK_EQ(dma_alloc_reserve(DMA1_Stream0, DMA_ALLOC_STREAM), HAL_BUSY);
+  DMA1_Stream0->CR = 0U;
+  DMA1_Stream1->CR = 0U;
+  DMA1_Stream2->CR = 0U;
+  DMA1_Stream5->CR = 0U;
+  free_all();
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  test_route();
+  test_streams();
+  test_failures();
+  test_mdma();
+  test_sample();
+  return host_result();
+}
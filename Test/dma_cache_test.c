@@ -0,0 +1,476 @@
+/* Header includes -----------------------------------------------------------*/
+#include "dma_cache.h"
+#include <stddef.h>
+#include <string.h>
+
+/* dma_cache: maintenance against a model of the Cortex-M7 D-cache over a
+   block of AXI SRAM, 32-byte lines, write-back and write-allocate, driven
+   by the by-address operations in the SCB. The test plays both masters:
+   the CPU reads and writes through the cache, the DMA reads and writes the
+   memory behind it, and lines are filled speculatively or evicted while a
+   transfer runs. A buffer at any offset and length is checked on both
+   sides: what the DMA reads after a clean, what the CPU reads after the two
+   invalidates around a receive, and the neighbours sharing its first and
+   last line. Ranges the core does not cache (TCM, peripherals, the arena)
+   must not reach the cache at all, and the HAL drivers' cache hooks must be
+   the ones in dma_cache.c rather than the __weak defaults of
+   stm32h7xx_hal.c, which know no such ranges. */
+
+/* Private macro -------------------------------------------------------------*/
+#define REG(r)                  ((uint32_t)offsetof(SCB_Type, r))
+#define SRAM                    D1_AXISRAM_BASE
+#define SRAM_SIZE               4096U
+#define LINE                    DMA_CACHE_LINE
+#define LINES                   (SRAM_SIZE / LINE)
+#define BUF_MAX                 512U
+#define TRIALS                  400U
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  uint8_t valid;
+  uint8_t dirty;
+  uint8_t data[LINE];
+} line_t;
+
+typedef void (*clean_fn_t)(const void *addr, uint32_t len);
+typedef void (*invalidate_fn_t)(void *addr, uint32_t len);
+
+/* Private variables ---------------------------------------------------------*/
+static host_mmio_t scb_m;
+static line_t cache[LINES];
+/* Operations the SCB model saw */
+static volatile struct
+{
+  uint32_t clean;               /* DCCMVAC */
+  uint32_t inv;                 /* DCIMVAC */
+  uint32_t flush;               /* DCCIMVAC */
+  uint32_t stray;               /* of those, outside the modelled SRAM */
+  uint32_t other;               /* set/way and point of unification */
+} scb;
+
+/* Room for an end rounded up to the line */
+static uint8_t want[BUF_MAX + LINE];
+static uint8_t edge[2U * LINE];
+static uint32_t seed = 0x2545F491U;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static uint8_t *mem(uint32_t addr)
+{
+  return (uint8_t *)(uintptr_t)addr;
+}
+
+static line_t *line_of(uint32_t addr)
+{
+  return &cache[(addr - SRAM) / LINE];
+}
+
+static void write_back(uint32_t addr)
+{
+  line_t *l = line_of(addr);
+
+  if((l->valid != 0U) && (l->dirty != 0U))
+  {
+    memcpy(mem(addr & ~(LINE - 1U)), l->data, LINE);
+  }
+  l->dirty = 0U;
+}
+
+/* A line fill, by a CPU access or a speculative read */
+static void fill(uint32_t addr)
+{
+  line_t *l = line_of(addr);
+
+  if(l->valid == 0U)
+  {
+    memcpy(l->data, mem(addr & ~(LINE - 1U)), LINE);
+    l->valid = 1U;
+    l->dirty = 0U;
+  }
+}
+
+static void evict(uint32_t addr)
+{
+  write_back(addr);
+  line_of(addr)->valid = 0U;
+}
+
+static uint8_t cpu_read(uint32_t addr)
+{
+  fill(addr);
+  return line_of(addr)->data[addr % LINE];
+}
+
+static void cpu_write(uint32_t addr, uint8_t value)
+{
+  line_t *l = line_of(addr);
+
+  fill(addr);
+  l->data[addr % LINE] = value;
+  l->dirty = 1U;
+}
+
+static void scb_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  if((offset == REG(DCCMVAC)) || (offset == REG(DCIMVAC)) || (offset == REG(DCCIMVAC)))
+  {
+    scb.clean += (offset == REG(DCCMVAC)) ? 1U : 0U;
+    scb.inv += (offset == REG(DCIMVAC)) ? 1U : 0U;
+    scb.flush += (offset == REG(DCCIMVAC)) ? 1U : 0U;
+    if((value < SRAM) || (value >= (SRAM + SRAM_SIZE)))
+    {
+      scb.stray++;
+      return;
+    }
+    if(offset != REG(DCIMVAC))
+    {
+      write_back(value);
+    }
+    if(offset != REG(DCCMVAC))
+    {
+      line_of(value)->valid = 0U;
+      line_of(value)->dirty = 0U;
+    }
+  }
+  else if((offset == REG(DCISW)) || (offset == REG(DCCSW)) || (offset == REG(DCCISW)) ||
+          (offset == REG(DCCMVAU)))
+  {
+    scb.other++;
+  }
+}
+
+static uint32_t ops(void)
+{
+  return scb.clean + scb.inv + scb.flush + scb.other;
+}
+
+static void ops_reset(void)
+{
+  memset((void *)&scb, 0, sizeof(scb));
+}
+
+/* Memory and cache disagree everywhere: lines valid or not, dirty or not */
+static void scramble(void)
+{
+  uint32_t i;
+  uint32_t k;
+
+  for(i = 0U; i < SRAM_SIZE; i++)
+  {
+    mem(SRAM)[i] = (uint8_t)rnd();
+  }
+  for(i = 0U; i < LINES; i++)
+  {
+    cache[i].valid = (uint8_t)(rnd() & 1U);
+    cache[i].dirty = (uint8_t)(cache[i].valid & (rnd() >> 7) & 1U);
+    for(k = 0U; k < LINE; k++)
+    {
+      cache[i].data[k] = (uint8_t)rnd();
+    }
+  }
+}
+
+/* A buffer at any offset; either end on a line boundary a third of the time */
+static uint32_t pick(uint32_t *len)
+{
+  uint32_t addr = SRAM + (4U * LINE) + (rnd() % (SRAM_SIZE - (8U * LINE) - BUF_MAX));
+  uint32_t end;
+
+  if((rnd() % 3U) == 0U)
+  {
+    addr &= ~(LINE - 1U);
+  }
+  end = addr + 1U + (rnd() % BUF_MAX);
+  if((rnd() % 3U) == 0U)
+  {
+    end = (end + LINE - 1U) & ~(LINE - 1U);
+  }
+  *len = end - addr;
+  return addr;
+}
+
+static uint32_t lines_of(uint32_t addr, uint32_t len)
+{
+  return (((addr + len + LINE - 1U) & ~(LINE - 1U)) - (addr & ~(LINE - 1U))) / LINE;
+}
+
+/* Lines the range shares with other data */
+static uint32_t partial_of(uint32_t addr, uint32_t len)
+{
+  uint32_t end = addr + len;
+  uint32_t head = ((addr % LINE) != 0U) ? 1U : 0U;
+  uint32_t tail = ((end % LINE) != 0U) ? 1U : 0U;
+
+  if((head != 0U) && (tail != 0U) && (lines_of(addr, len) == 1U))
+  {
+    tail = 0U;
+  }
+  return head + tail;
+}
+
+/* Memory -> peripheral: the CPU writes the buffer, the DMA must read it */
+static void tx(clean_fn_t clean, uint32_t trials)
+{
+  uint32_t addr;
+  uint32_t len;
+  uint32_t t;
+  uint32_t i;
+  uint32_t bad = 0U;
+
+  for(t = 0U; t < trials; t++)
+  {
+    scramble();
+    addr = pick(&len);
+    for(i = 0U; i < len; i++)
+    {
+      want[i] = (uint8_t)rnd();
+      cpu_write(addr + i, want[i]);
+    }
+    ops_reset();
+    clean((const void *)(uintptr_t)addr, len);
+    bad += (memcmp(mem(addr), want, len) != 0) ? 1U : 0U;
+    /* Every line once, and the cache keeps them */
+    bad += (scb.clean != lines_of(addr, len)) ? 1U : 0U;
+    bad += (ops() != scb.clean) ? 1U : 0U;
+    bad += (line_of(addr)->valid == 0U) ? 1U : 0U;
+    bad += (line_of(addr + len - 1U)->valid == 0U) ? 1U : 0U;
+  }
+  HOST_CHECK_EQ(bad, 0U);
+  HOST_CHECK_EQ(scb.stray, 0U);
+}
+
+/* Peripheral -> memory with the CPU holding stale and dirty lines over the
+   buffer and dirty data beside it in the edge lines. While the DMA writes,
+   lines fill speculatively and get evicted. */
+static void rx(invalidate_fn_t invalidate, uint32_t trials)
+{
+  uint32_t addr;
+  uint32_t len;
+  uint32_t first;
+  uint32_t last;
+  uint32_t end;
+  uint32_t a;
+  uint32_t n;
+  uint32_t t;
+  uint32_t i;
+  uint32_t bad = 0U;
+  uint32_t bad_ops = 0U;
+  uint32_t bad_edge = 0U;
+
+  for(t = 0U; t < trials; t++)
+  {
+    scramble();
+    addr = pick(&len);
+    end = addr + len;
+    first = addr & ~(LINE - 1U);
+    last = (end + LINE - 1U) & ~(LINE - 1U);
+
+    /* Stale copies of the buffer, some of them dirty */
+    for(i = 0U; i < len; i++)
+    {
+      if((rnd() % 4U) == 0U)
+      {
+        cpu_write(addr + i, (uint8_t)rnd());
+      }
+      (void)cpu_read(addr + i);
+    }
+    /* The neighbours, written by the CPU just before */
+    n = 0U;
+    for(a = first; a < last; a++)
+    {
+      if((a < addr) || (a >= end))
+      {
+        if((rnd() & 1U) != 0U)
+        {
+          cpu_write(a, (uint8_t)rnd());
+        }
+        edge[n++] = cpu_read(a);
+      }
+    }
+
+    ops_reset();
+    invalidate((void *)(uintptr_t)addr, len);
+    bad_ops += (scb.flush != partial_of(addr, len)) ? 1U : 0U;
+    bad_ops += (scb.inv != (lines_of(addr, len) - partial_of(addr, len))) ? 1U : 0U;
+    bad_ops += (scb.clean != 0U) ? 1U : 0U;
+
+    /* The transfer, with the cache busy meanwhile */
+    for(i = 0U; i < len; i++)
+    {
+      want[i] = (uint8_t)rnd();
+      mem(addr)[i] = want[i];
+      if((rnd() % 16U) == 0U)
+      {
+        fill(first + (rnd() % (last - first)));
+      }
+      if((rnd() % 16U) == 0U)
+      {
+        evict(first + (rnd() % (last - first)));
+      }
+    }
+
+    invalidate((void *)(uintptr_t)addr, len);
+    for(i = 0U; i < len; i++)
+    {
+      if(cpu_read(addr + i) != want[i])
+      {
+        bad++;
+        break;
+      }
+    }
+    n = 0U;
+    for(a = first; a < last; a++)
+    {
+      if((a < addr) || (a >= end))
+      {
+        bad_edge += (cpu_read(a) != edge[n++]) ? 1U : 0U;
+      }
+    }
+    /* Nothing stale left to be written back over the data either */
+    for(a = first; a < last; a += LINE)
+    {
+      evict(a);
+    }
+    bad += (memcmp(mem(addr), want, len) != 0) ? 1U : 0U;
+  }
+  HOST_CHECK_EQ(bad, 0U);
+  HOST_CHECK_EQ(bad_edge, 0U);
+  HOST_CHECK_EQ(bad_ops, 0U);
+  HOST_CHECK_EQ(scb.stray, 0U);
+}
+
+static void test_clean(void)
+{
+  tx(dma_cache_clean, TRIALS);
+  printf("  clean: %u buffers\n", (unsigned)TRIALS);
+}
+
+static void test_invalidate(void)
+{
+  rx(dma_cache_invalidate, TRIALS);
+  printf("  invalidate: %u buffers\n", (unsigned)TRIALS);
+}
+
+/* Written back and dropped, every line the range touches */
+static void test_flush(void)
+{
+  uint32_t addr;
+  uint32_t len;
+  uint32_t a;
+  uint32_t t;
+  uint32_t bad = 0U;
+
+  for(t = 0U; t < TRIALS; t++)
+  {
+    scramble();
+    addr = pick(&len);
+    for(a = addr; a < (addr + len); a++)
+    {
+      cpu_write(a, (uint8_t)rnd());
+      want[a - addr] = cpu_read(a);
+    }
+    ops_reset();
+    dma_cache_flush((void *)(uintptr_t)addr, len);
+    bad += (memcmp(mem(addr), want, len) != 0) ? 1U : 0U;
+    bad += (scb.flush != lines_of(addr, len)) ? 1U : 0U;
+    bad += (ops() != scb.flush) ? 1U : 0U;
+    for(a = addr & ~(LINE - 1U); a < (addr + len); a += LINE)
+    {
+      bad += line_of(a)->valid;
+    }
+  }
+  HOST_CHECK_EQ(bad, 0U);
+}
+
+/* The SPI, UART and ETH drivers reach dma_cache.c through these */
+static void test_hooks(void)
+{
+  tx(HAL_DMA_CacheClean, TRIALS / 4U);
+  rx(HAL_DMA_CacheInvalidate, TRIALS / 4U);
+
+  ops_reset();
+  HAL_DMA_CacheClean((const void *)(D1_DTCMRAM_BASE + 0x100U), 256U);
+  HAL_DMA_CacheInvalidate((void *)(D1_DTCMRAM_BASE + 0x100U), 256U);
+  HOST_CHECK_EQ(ops(), 0U);
+}
+
+/* Memory the core does not cache is left alone */
+static void test_skip(void)
+{
+  uint8_t *arena;
+
+  ops_reset();
+  dma_cache_clean((const void *)(D1_DTCMRAM_BASE + 0x100U), 256U);
+  dma_cache_invalidate((void *)(D1_DTCMRAM_BASE + 0x1F000U), 0x1000U);
+  dma_cache_flush((void *)(D1_DTCMRAM_BASE), 0x20000U);
+  dma_cache_invalidate((void *)(D1_ITCMRAM_BASE + 0x40U), 64U);
+  dma_cache_clean((const void *)(D1_ITCMRAM_BASE + 0xFFE0U), 32U);
+  dma_cache_invalidate((void *)&USART1->RDR, 4U);
+  dma_cache_invalidate((void *)(uintptr_t)SRAM, 0U);
+  dma_cache_clean((const void *)(uintptr_t)(SRAM + 5U), 0U);
+  HOST_CHECK_EQ(ops(), 0U);
+
+  /* Reaching past the end of a TCM is memory that caches */
+  HOST_CHECK_EQ(dma_cache_needed((const void *)(D1_DTCMRAM_BASE + 0x1FFF0U), 32U), 1U);
+  HOST_CHECK_EQ(dma_cache_needed((const void *)(D1_ITCMRAM_BASE + 0xFFF0U), 32U), 1U);
+  HOST_CHECK_EQ(dma_cache_needed((const void *)(uintptr_t)SRAM, 1U), 1U);
+
+  /* D-cache off */
+  CLEAR_BIT(SCB->CCR, SCB_CCR_DC_Msk);
+  dma_cache_clean((const void *)(uintptr_t)SRAM, 64U);
+  dma_cache_invalidate((void *)(uintptr_t)SRAM, 64U);
+  dma_cache_flush((void *)(uintptr_t)SRAM, 64U);
+  HOST_CHECK_EQ(ops(), 0U);
+  SET_BIT(SCB->CCR, SCB_CCR_DC_Msk);
+
+  /* The arena: flushed once before the MPU maps it uncached, then never */
+  HOST_CHECK(dma_arena_alloc(64U) == NULL);
+  ops_reset();
+  dma_arena_init();
+  HOST_CHECK_EQ(scb.flush, DMA_ARENA_SIZE / LINE);
+  HOST_CHECK_EQ(ops(), scb.flush);
+  arena = dma_arena_alloc(64U);
+  if(!HOST_CHECK(arena != NULL))
+  {
+    return;
+  }
+  HOST_CHECK_EQ(MPU->RBAR & MPU_RBAR_ADDR_Msk, (uint32_t)arena);
+  HOST_CHECK((MPU->RASR & MPU_RASR_ENABLE_Msk) != 0U);
+
+  ops_reset();
+  dma_cache_clean(arena, 64U);
+  dma_cache_invalidate(arena + 3, 40U);
+  dma_cache_flush(arena, DMA_ARENA_SIZE);
+  HAL_DMA_CacheClean(arena, 64U);
+  HAL_DMA_CacheInvalidate(arena, 64U);
+  HOST_CHECK_EQ(ops(), 0U);
+  HOST_CHECK_EQ(dma_cache_needed(arena + DMA_ARENA_SIZE - 32U, 64U), 1U);
+  HOST_CHECK_EQ(dma_cache_needed(arena - 32, 64U), 1U);
+  HOST_CHECK_EQ(scb.other, 0U);
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  host_map(SRAM, SRAM_SIZE);
+  scb_m.base = SCB_BASE;
+  scb_m.size = sizeof(SCB_Type);
+  scb_m.write = scb_write;
+  host_mmio_attach(&scb_m);
+  SET_BIT(SCB->CCR, SCB_CCR_DC_Msk);
+
+  test_clean();
+  test_invalidate();
+  test_flush();
+  test_hooks();
+  test_skip();
+  return host_result();
+}
@@ -0,0 +1,660 @@
+/* Header includes -----------------------------------------------------------*/
+#include "dma_graph.h"
+#include <string.h>
+
+/* dma_graph: the arm order (every node armed before the nodes that fire
+   into it), loops and tables dma_graph_init() has to refuse, and the order
+   dma_graph_start() and dma_graph_stop() touch the streams and request
+   generators in, seen through models of DMA1/DMA2/DMAMUX1 and
+   BDMA/DMAMUX2 that log each enable and disable. */
+
+/* Private macro -------------------------------------------------------------*/
+#define LOG_MAX                 128U
+#define EV_ARM                  0U
+#define EV_GEN_ON               1U
+#define EV_GEN_OFF              2U
+#define EV_ABORT                3U
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t seed = 0x2C1B3C6DU;
+
+static DMA_HandleTypeDef handles[DMA_GRAPH_MAX];
+static dma_graph_node_t table[DMA_GRAPH_MAX];
+
+/* DMA1, DMA2 and DMAMUX1; BDMA and DMAMUX2 */
+static host_mmio_t mux1;
+static host_mmio_t mux2;
+static volatile struct
+{
+  uint32_t what;
+  uint32_t channel;             /* DMA_GRAPH_CH1/CH2 */
+} log_[LOG_MAX];
+static volatile uint32_t logged;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static void log_event(uint32_t what, uint32_t channel)
+{
+  if(logged < LOG_MAX)
+  {
+    log_[logged].what = what;
+    log_[logged].channel = channel;
+  }
+  logged++;
+}
+
+/* Stream and generator enables; the register already holds the new value */
+static void dma_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  uint32_t addr = (uint32_t)m->base + offset;
+  uint32_t *shadow = m->context;
+  uint32_t mux = (m == &mux1) ? 0x100U : 0x200U;
+  uint32_t en = (m == &mux1) ? DMA_SxCR_EN : BDMA_CCR_EN;
+  uint32_t ch = 0xFFFFFFFFU;
+  uint32_t rg = 0xFFFFFFFFU;
+  uint32_t was;
+
+  (void)size;
+  if(m == &mux1)
+  {
+    if((addr >= (uint32_t)DMA1_Stream0) && (addr <= (uint32_t)DMA1_Stream7) &&
+       (((addr - (uint32_t)DMA1_Stream0) % sizeof(DMA_Stream_TypeDef)) == 0U))
+    {
+      ch = (addr - (uint32_t)DMA1_Stream0) / sizeof(DMA_Stream_TypeDef);
+    }
+    else if((addr >= (uint32_t)DMA2_Stream0) && (addr <= (uint32_t)DMA2_Stream7) &&
+            (((addr - (uint32_t)DMA2_Stream0) % sizeof(DMA_Stream_TypeDef)) == 0U))
+    {
+      ch = 8U + ((addr - (uint32_t)DMA2_Stream0) / sizeof(DMA_Stream_TypeDef));
+    }
+    else if((addr >= (uint32_t)DMAMUX1_RequestGenerator0) && (addr <= (uint32_t)DMAMUX1_RequestGenerator7))
+    {
+      rg = (addr - (uint32_t)DMAMUX1_RequestGenerator0) / 4U;
+    }
+  }
+  else
+  {
+    if((addr >= (uint32_t)BDMA_Channel0) && (addr <= (uint32_t)BDMA_Channel7) &&
+       (((addr - (uint32_t)BDMA_Channel0) % sizeof(BDMA_Channel_TypeDef)) == 0U))
+    {
+      ch = (addr - (uint32_t)BDMA_Channel0) / sizeof(BDMA_Channel_TypeDef);
+    }
+    else if((addr >= (uint32_t)DMAMUX2_RequestGenerator0) && (addr <= (uint32_t)DMAMUX2_RequestGenerator7))
+    {
+      rg = (addr - (uint32_t)DMAMUX2_RequestGenerator0) / 4U;
+    }
+  }
+
+  if(ch != 0xFFFFFFFFU)
+  {
+    was = shadow[ch];
+    shadow[ch] = value & en;
+    if((was == 0U) && ((value & en) != 0U))
+    {
+      log_event(EV_ARM, mux | ch);
+    }
+    else if((was != 0U) && ((value & en) == 0U))
+    {
+      log_event(EV_ABORT, mux | ch);
+    }
+  }
+  else if(rg != 0xFFFFFFFFU)
+  {
+    was = shadow[16U + rg];
+    shadow[16U + rg] = value & DMAMUX_RGxCR_GE;
+    if((was == 0U) && ((value & DMAMUX_RGxCR_GE) != 0U))
+    {
+      log_event(EV_GEN_ON, mux | (0x80U + rg));
+    }
+    else if((was != 0U) && ((value & DMAMUX_RGxCR_GE) == 0U))
+    {
+      log_event(EV_GEN_OFF, mux | (0x80U + rg));
+    }
+  }
+}
+
+static DMA_HandleTypeDef *handle(uint32_t channel)
+{
+  DMA_HandleTypeDef *h = &handles[((channel & 0x300U) == 0x100U) ? (channel & 0xFFU) : (16U + (channel & 0xFFU))];
+
+  memset(h, 0, sizeof(*h));
+  if((channel & 0x300U) == 0x200U)
+  {
+    h->Instance = (void *)(BDMA_Channel0 + (channel & 0xFFU));
+  }
+  else
+  {
+    h->Instance = ((channel & 0xFFU) < 8U) ? (DMA1_Stream0 + (channel & 0xFFU)) : (DMA2_Stream0 + ((channel & 0xFFU) - 8U));
+  }
+  h->Init.Direction = DMA_PERIPH_TO_MEMORY;
+  h->Init.PeriphInc = DMA_PINC_DISABLE;
+  h->Init.MemInc = DMA_MINC_ENABLE;
+  h->Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+  h->Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+  h->Init.Mode = DMA_CIRCULAR;
+  h->Init.Priority = DMA_PRIORITY_LOW;
+  h->Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  return h;
+}
+
+/* A node on channel: peripheral request, no sync, no event, a transfer */
+static dma_graph_node_t *node(uint32_t i, uint32_t channel)
+{
+  dma_graph_node_t *n = &table[i];
+
+  memset(n, 0, sizeof(*n));
+  n->hdma = handle(channel);
+  n->channel = channel;
+  n->request = ((channel & 0x300U) == 0x100U) ? DMA_REQUEST_TIM2_UP : BDMA_REQUEST_LPUART1_RX;
+  n->sync_signal = DMA_GRAPH_NONE;
+  n->sync_polarity = HAL_DMAMUX_SYNC_RISING;
+  n->gen_polarity = HAL_DMAMUX_REQ_GEN_RISING;
+  n->count = 1U;
+  n->src = 0x40000000U;
+  n->dst = 0x24000000U;
+  n->len = 16U;
+  return n;
+}
+
+static void gen(dma_graph_node_t *n, uint32_t generator, uint32_t signal)
+{
+  n->request = DMA_REQUEST_GENERATOR0 + generator;
+  n->gen_signal = signal;
+  n->gen_count = 1U;
+}
+
+static void sync(dma_graph_node_t *n, uint32_t signal)
+{
+  n->sync_signal = signal;
+  n->count = 4U;
+}
+
+/* Node of the table whose event a chained signal of node i is */
+static uint32_t source(uint32_t count, uint32_t i, uint32_t signal)
+{
+  uint32_t k;
+
+  for(k = 0U; k < count; k++)
+  {
+    if((table[k].channel == ((table[i].channel & 0x300U) | signal)) && (table[k].event != 0U))
+    {
+      return k;
+    }
+  }
+  return DMA_GRAPH_MAX;
+}
+
+/* Chained signals of node i: up to two nodes that fire into it */
+static void sources(uint32_t count, uint32_t i, uint32_t *up)
+{
+  uint32_t mux1 = ((table[i].channel & 0x300U) == 0x100U) ? 1U : 0U;
+
+  up[0] = DMA_GRAPH_MAX;
+  up[1] = DMA_GRAPH_MAX;
+  if((table[i].sync_signal != DMA_GRAPH_NONE) && (table[i].sync_signal < (mux1 ? 3U : 6U)))
+  {
+    up[0] = source(count, i, table[i].sync_signal);
+  }
+  if((table[i].request >= DMA_REQUEST_GENERATOR0) && (table[i].request <= DMA_REQUEST_GENERATOR7) &&
+     (table[i].gen_signal < (mux1 ? 3U : 7U)))
+  {
+    up[1] = source(count, i, table[i].gen_signal);
+  }
+}
+
+/* g->order is a permutation with every node ahead of those firing into it */
+static void check_order(const dma_graph_t *g, uint32_t count)
+{
+  uint32_t pos[DMA_GRAPH_MAX];
+  uint32_t up[2];
+  uint32_t i;
+  uint32_t j;
+
+  for(i = 0U; i < count; i++)
+  {
+    pos[i] = DMA_GRAPH_MAX;
+  }
+  for(i = 0U; i < count; i++)
+  {
+    if(HOST_CHECK(g->order[i] < count) && HOST_CHECK_EQ(pos[g->order[i]], DMA_GRAPH_MAX))
+    {
+      pos[g->order[i]] = i;
+    }
+  }
+  for(i = 0U; i < count; i++)
+  {
+    sources(count, i, up);
+    for(j = 0U; j < 2U; j++)
+    {
+      if(up[j] != DMA_GRAPH_MAX)
+      {
+        HOST_CHECK(pos[i] < pos[up[j]]);
+      }
+    }
+  }
+}
+
+/* Log positions of node i's first and last enable (start) or disable (stop) */
+static uint32_t span(uint32_t i, uint32_t stop, uint32_t *first, uint32_t *last)
+{
+  const dma_graph_node_t *n = &table[i];
+  uint32_t rg = ((n->request >= DMA_REQUEST_GENERATOR0) && (n->request <= DMA_REQUEST_GENERATOR7)) ?
+                ((n->channel & 0x300U) | (0x80U + (n->request - DMA_REQUEST_GENERATOR0))) : 0xFFFFFFFFU;
+  uint32_t found = 0U;
+  uint32_t e;
+
+  for(e = 0U; (e < logged) && (e < LOG_MAX); e++)
+  {
+    if(((stop == 0U) && (((log_[e].what == EV_ARM) && (log_[e].channel == n->channel)) ||
+                         ((log_[e].what == EV_GEN_ON) && (log_[e].channel == rg)))) ||
+       ((stop != 0U) && (((log_[e].what == EV_ABORT) && (log_[e].channel == n->channel)) ||
+                         ((log_[e].what == EV_GEN_OFF) && (log_[e].channel == rg)))))
+    {
+      *last = e;
+      if(found == 0U)
+      {
+        *first = e;
+      }
+      found++;
+    }
+  }
+  return found;
+}
+
+/* Streams and generators the graph turns on for node i */
+static uint32_t uses(uint32_t i)
+{
+  return ((table[i].len != 0U) ? 1U : 0U) +
+         (((table[i].request >= DMA_REQUEST_GENERATOR0) && (table[i].request <= DMA_REQUEST_GENERATOR7)) ? 1U : 0U);
+}
+
+/* Start: a node is running before anything that fires into it starts.
+   Stop: a node stops only after everything that fires into it. */
+static void check_start_stop(dma_graph_t *g, uint32_t count)
+{
+  uint32_t up[2];
+  uint32_t fi;
+  uint32_t li;
+  uint32_t fk;
+  uint32_t lk;
+  uint32_t i;
+  uint32_t j;
+
+  logged = 0U;
+  HOST_CHECK_EQ(dma_graph_start(g), HAL_OK);
+  HOST_CHECK_EQ(g->running, 1U);
+  for(i = 0U; i < count; i++)
+  {
+    /* Each stream with a transfer once and each generator once */
+    if(HOST_CHECK_EQ(span(i, 0U, &fi, &li), uses(i)) && (uses(i) != 0U))
+    {
+      sources(count, i, up);
+      for(j = 0U; j < 2U; j++)
+      {
+        if((up[j] != DMA_GRAPH_MAX) && (span(up[j], 0U, &fk, &lk) != 0U))
+        {
+          HOST_CHECK(li < fk);
+        }
+      }
+    }
+  }
+
+  logged = 0U;
+  dma_graph_stop(g);
+  HOST_CHECK_EQ(g->running, 0U);
+  for(i = 0U; i < count; i++)
+  {
+    if(HOST_CHECK_EQ(span(i, 1U, &fi, &li), uses(i)) && (uses(i) != 0U))
+    {
+      sources(count, i, up);
+      for(j = 0U; j < 2U; j++)
+      {
+        if((up[j] != DMA_GRAPH_MAX) && (span(up[j], 1U, &fk, &lk) != 0U))
+        {
+          HOST_CHECK(lk < fi);
+        }
+      }
+    }
+  }
+}
+
+static void run(uint32_t count, HAL_StatusTypeDef want)
+{
+  dma_graph_t g;
+
+  if(HOST_CHECK_EQ(dma_graph_init(&g, table, count), want) && (want == HAL_OK))
+  {
+    check_order(&g, count);
+    check_start_stop(&g, count);
+  }
+}
+
+/* TIM12 TRGO -> generator 0 -> stream 0 -> sync of stream 1 -> sync of
+   stream 2, listed in every order */
+static void test_chain(void)
+{
+  static const uint8_t perms[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+  dma_graph_node_t *n;
+  dma_graph_t g;
+  uint32_t p;
+
+  for(p = 0U; p < 6U; p++)
+  {
+    n = node(perms[p][0], DMA_GRAPH_CH1(0));
+    gen(n, 0U, HAL_DMAMUX1_REQ_GEN_TIM12_TRGO);
+    n->event = 1U;
+    n->count = DMA_GRAPH_COUNT(4);
+    n = node(perms[p][1], DMA_GRAPH_CH1(1));
+    sync(n, DMA_GRAPH_EVT1(0));
+    n->event = 1U;
+    n = node(perms[p][2], DMA_GRAPH_CH1(2));
+    sync(n, DMA_GRAPH_EVT1(1));
+    /* Owned elsewhere: only its generator and sync are the graph's */
+    n->len = 0U;
+    run(3U, HAL_OK);
+  }
+
+  HOST_CHECK_EQ(dma_graph_init(&g, table, 3U), HAL_OK);
+  HOST_CHECK_EQ(g.order[0], 0U);
+  HOST_CHECK_EQ(g.order[1], 1U);
+  HOST_CHECK_EQ(g.order[2], 2U);
+  n = node(0U, DMA_GRAPH_CH1(0));
+  gen(n, 0U, HAL_DMAMUX1_REQ_GEN_TIM12_TRGO);
+  n->event = 1U;
+  n = node(1U, DMA_GRAPH_CH1(1));
+  sync(n, DMA_GRAPH_EVT1(0));
+  n->event = 1U;
+  n = node(2U, DMA_GRAPH_CH1(2));
+  sync(n, DMA_GRAPH_EVT1(1));
+  HOST_CHECK_EQ(dma_graph_init(&g, table, 3U), HAL_OK);
+  HOST_CHECK_EQ(g.order[0], 2U);
+  HOST_CHECK_EQ(g.order[1], 1U);
+  HOST_CHECK_EQ(g.order[2], 0U);
+}
+
+/* A fan-out and a generator on a chained event on DMAMUX2, next to an
+   outside sync on DMAMUX1 */
+static void test_branches(void)
+{
+  dma_graph_node_t *n;
+
+  n = node(0U, DMA_GRAPH_CH2(2));
+  sync(n, DMA_GRAPH_SYNC_EVT2(0));
+  n = node(1U, DMA_GRAPH_CH2(3));
+  gen(n, 1U, DMA_GRAPH_GEN_EVT2(1));
+  n = node(2U, DMA_GRAPH_CH2(1));
+  sync(n, DMA_GRAPH_SYNC_EVT2(0));
+  n->event = 1U;
+  n = node(3U, DMA_GRAPH_CH2(0));
+  gen(n, 0U, HAL_DMAMUX2_REQ_GEN_LPTIM2_OUT);
+  n->event = 1U;
+  n = node(4U, DMA_GRAPH_CH2(4));
+  n = node(5U, DMA_GRAPH_CH1(9));
+  sync(n, HAL_DMAMUX1_SYNC_EXTI0);
+  /* The same generator number on the other DMAMUX is another generator */
+  n = node(6U, DMA_GRAPH_CH1(5));
+  gen(n, 1U, HAL_DMAMUX1_REQ_GEN_EXTI0);
+  run(7U, HAL_OK);
+}
+
+static void swap(uint32_t a, uint32_t b)
+{
+  dma_graph_node_t t = table[a];
+
+  table[a] = table[b];
+  table[b] = t;
+}
+
+/* Random tables without loops: a node's signals come from nodes made
+   before it, then the table is shuffled */
+static void test_random(void)
+{
+  uint32_t used[2];
+  uint32_t gens[2];
+  uint32_t round;
+  uint32_t count;
+  uint32_t i;
+  uint32_t k;
+  uint32_t m;
+  uint32_t c;
+  uint32_t pick;
+  dma_graph_node_t *n;
+
+  for(round = 0U; round < 300U; round++)
+  {
+    used[0] = 0U;
+    used[1] = 0U;
+    gens[0] = 0U;
+    gens[1] = 0U;
+    count = 1U + (rnd() % DMA_GRAPH_MAX);
+    for(i = 0U; i < count; i++)
+    {
+      /* A free channel; event capable ones more often */
+      do
+      {
+        m = rnd() & 1U;
+        c = ((rnd() & 1U) != 0U) ? (rnd() % ((m == 0U) ? 3U : 7U)) : (rnd() % ((m == 0U) ? 16U : 8U));
+      } while((used[m] & (1UL << c)) != 0U);
+      used[m] |= 1UL << c;
+      n = node(i, ((m == 0U) ? 0x100U : 0x200U) | c);
+      n->event = ((c < ((m == 0U) ? 3U : 7U)) && ((rnd() & 3U) != 0U)) ? 1U : 0U;
+      n->count = 1U + (rnd() % 32U);
+      n->len = ((rnd() & 3U) != 0U) ? 16U : 0U;
+
+      pick = rnd() % (i + 1U);
+      if((rnd() & 1U) != 0U)
+      {
+        /* Sync on an earlier node's event, or on the outside */
+        sync(n, (m == 0U) ? HAL_DMAMUX1_SYNC_EXTI0 : HAL_DMAMUX2_SYNC_LPTIM2_OUT);
+        for(k = pick; k < i; k++)
+        {
+          if(((table[k].channel & 0x300U) == (n->channel & 0x300U)) && (table[k].event != 0U) &&
+             ((table[k].channel & 0xFFU) < ((m == 0U) ? 3U : 6U)))
+          {
+            n->sync_signal = table[k].channel & 0xFFU;
+            break;
+          }
+        }
+      }
+      if(((rnd() & 1U) != 0U) && (gens[m] != 0xFFU))
+      {
+        do
+        {
+          k = rnd() & 7U;
+        } while((gens[m] & (1UL << k)) != 0U);
+        gens[m] |= 1UL << k;
+        gen(n, k, (m == 0U) ? HAL_DMAMUX1_REQ_GEN_TIM12_TRGO : HAL_DMAMUX2_REQ_GEN_LPTIM2_OUT);
+        n->gen_count = 1U + (rnd() % 32U);
+        for(k = (pick + 1U) % (i + 1U); k < i; k++)
+        {
+          if(((table[k].channel & 0x300U) == (n->channel & 0x300U)) && (table[k].event != 0U))
+          {
+            n->gen_signal = table[k].channel & 0xFFU;
+            break;
+          }
+        }
+      }
+    }
+    for(i = count; i > 1U; i--)
+    {
+      swap(i - 1U, rnd() % i);
+    }
+    run(count, HAL_OK);
+  }
+}
+
+static void test_loops(void)
+{
+  dma_graph_node_t *n;
+
+  /* Onto itself */
+  n = node(0U, DMA_GRAPH_CH1(0));
+  sync(n, DMA_GRAPH_EVT1(0));
+  n->event = 1U;
+  run(1U, HAL_ERROR);
+
+  /* Two syncs on each other */
+  n = node(0U, DMA_GRAPH_CH1(0));
+  sync(n, DMA_GRAPH_EVT1(1));
+  n->event = 1U;
+  n = node(1U, DMA_GRAPH_CH1(1));
+  sync(n, DMA_GRAPH_EVT1(0));
+  n->event = 1U;
+  run(2U, HAL_ERROR);
+
+  /* Through a generator, with unrelated nodes around */
+  n = node(0U, DMA_GRAPH_CH2(5));
+  n = node(1U, DMA_GRAPH_CH2(0));
+  gen(n, 0U, DMA_GRAPH_GEN_EVT2(6));
+  n->event = 1U;
+  n = node(2U, DMA_GRAPH_CH2(3));
+  sync(n, DMA_GRAPH_SYNC_EVT2(0));
+  n->event = 1U;
+  n = node(3U, DMA_GRAPH_CH1(4));
+  n = node(4U, DMA_GRAPH_CH2(6));
+  sync(n, DMA_GRAPH_SYNC_EVT2(3));
+  n->event = 1U;
+  run(5U, HAL_ERROR);
+  /* Cut it and the same table is fine */
+  table[1].gen_signal = HAL_DMAMUX2_REQ_GEN_LPTIM2_OUT;
+  run(5U, HAL_OK);
+
+  /* The longest chain DMAMUX2 has, listed backwards: not a loop */
+  for(n = NULL; n == NULL; )
+  {
+    uint32_t i;
+
+    for(i = 0U; i < 7U; i++)
+    {
+      n = node(6U - i, DMA_GRAPH_CH2(i));
+      if(i == 0U)
+      {
+        gen(n, 0U, HAL_DMAMUX2_REQ_GEN_LPTIM2_OUT);
+      }
+      else if(i < 6U)
+      {
+        sync(n, i - 1U);
+      }
+      else
+      {
+        gen(n, 1U, DMA_GRAPH_GEN_EVT2(5));
+      }
+      n->event = 1U;
+    }
+    n = node(7U, DMA_GRAPH_CH2(7));
+    gen(n, 2U, DMA_GRAPH_GEN_EVT2(6));
+  }
+  run(8U, HAL_OK);
+}
+
+static void test_refused(void)
+{
+  dma_graph_node_t *n;
+  dma_graph_t g;
+
+  HOST_CHECK_EQ(dma_graph_init(&g, table, 0U), HAL_ERROR);
+  HOST_CHECK_EQ(dma_graph_init(&g, table, DMA_GRAPH_MAX + 1U), HAL_ERROR);
+
+  /* A DMAMUX channel twice */
+  node(0U, DMA_GRAPH_CH1(3));
+  node(1U, DMA_GRAPH_CH1(4));
+  node(2U, DMA_GRAPH_CH1(3));
+  run(3U, HAL_ERROR);
+  node(0U, DMA_GRAPH_CH2(3));
+  node(1U, DMA_GRAPH_CH1(3));
+  node(2U, DMA_GRAPH_CH2(3));
+  run(3U, HAL_ERROR);
+  /* BDMA channel 3 and DMA1 stream 3 are different channels */
+  run(2U, HAL_OK);
+
+  /* A generator twice on one DMAMUX */
+  n = node(0U, DMA_GRAPH_CH1(3));
+  gen(n, 2U, HAL_DMAMUX1_REQ_GEN_EXTI0);
+  n = node(1U, DMA_GRAPH_CH1(12));
+  gen(n, 2U, HAL_DMAMUX1_REQ_GEN_TIM12_TRGO);
+  run(2U, HAL_ERROR);
+  n = node(1U, DMA_GRAPH_CH2(4));
+  gen(n, 7U, HAL_DMAMUX2_REQ_GEN_LPTIM2_OUT);
+  n = node(2U, DMA_GRAPH_CH2(5));
+  gen(n, 7U, HAL_DMAMUX2_REQ_GEN_LPTIM2_OUT);
+  run(3U, HAL_ERROR);
+  n->request = BDMA_REQUEST_GENERATOR0 + 6U;
+  run(3U, HAL_OK);
+
+  /* The handle is not the node's channel, or missing */
+  n = node(0U, DMA_GRAPH_CH1(3));
+  n->hdma = handle(DMA_GRAPH_CH1(4));
+  run(1U, HAL_ERROR);
+  n->hdma = NULL;
+  run(1U, HAL_ERROR);
+
+  /* A chained signal from a node that is missing or makes no event */
+  n = node(0U, DMA_GRAPH_CH1(1));
+  sync(n, DMA_GRAPH_EVT1(0));
+  run(1U, HAL_ERROR);
+  n = node(1U, DMA_GRAPH_CH1(0));
+  run(2U, HAL_ERROR);
+  n->event = 1U;
+  run(2U, HAL_OK);
+  n = node(0U, DMA_GRAPH_CH2(1));
+  gen(n, 0U, DMA_GRAPH_GEN_EVT2(6));
+  run(1U, HAL_ERROR);
+
+  /* Counts and signal ids out of range */
+  n = node(0U, DMA_GRAPH_CH1(6));
+  gen(n, 0U, HAL_DMAMUX1_REQ_GEN_EXTI0);
+  n->gen_count = 0U;
+  run(1U, HAL_ERROR);
+  n->gen_count = 33U;
+  run(1U, HAL_ERROR);
+  n->gen_count = 32U;
+  n->gen_signal = 100U;
+  run(1U, HAL_ERROR);
+  n->gen_signal = HAL_DMAMUX1_REQ_GEN_EXTI0;
+  sync(n, 100U);
+  run(1U, HAL_ERROR);
+  sync(n, HAL_DMAMUX1_SYNC_EXTI0);
+  n->count = 0U;
+  run(1U, HAL_ERROR);
+  n->sync_signal = DMA_GRAPH_NONE;
+  n->event = 1U;
+  n->count = 33U;
+  run(1U, HAL_ERROR);
+  n->count = 32U;
+  run(1U, HAL_OK);
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  static uint32_t shadow1[24];
+  static uint32_t shadow2[24];
+
+  mux1.base = DMA1_BASE;
+  mux1.size = (DMAMUX1_RequestGenerator7_BASE + 4U) - DMA1_BASE;
+  mux1.write = dma_write;
+  mux1.context = shadow1;
+  host_mmio_attach(&mux1);
+  mux2.base = BDMA_BASE;
+  mux2.size = (DMAMUX2_RequestGenerator7_BASE + 4U) - BDMA_BASE;
+  mux2.write = dma_write;
+  mux2.context = shadow2;
+  host_mmio_attach(&mux2);
+
+  test_chain();
+  test_branches();
+  test_random();
+  test_loops();
+  test_refused();
+
+  host_mmio_detach(&mux2);
+  host_mmio_detach(&mux1);
+  return host_result();
+}
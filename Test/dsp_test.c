@@ -0,0 +1,316 @@
+/* Header includes -----------------------------------------------------------*/
+#include "dsp.h"
+#include "host.h"
+#include <math.h>
+#include <string.h>
+
+/* Every kernel of dsp.c against its twin in dsp_ref.c. dsp.c is built with
+   __ARM_FEATURE_DSP=1 here, so the Q15 kernels take their SIMD form on the
+   host versions of the DSP instructions (host/stm32h7xx_hal.h). Q15 and
+   Q31 results, filter states included, must be bit-exact; float ones are
+   compared with a tolerance (dsp.h). Lengths cover the unrolled bodies and
+   every remainder, buffers sit at odd halfword offsets, and filters run
+   over two blocks to check the history carried between calls. */
+
+#if !DSP_SIMD
+#error "dsp_test: build dsp.c with __ARM_FEATURE_DSP=1"
+#endif
+
+/* Private macro -------------------------------------------------------------*/
+#define MAX_LEN                 520U
+#define MAX_TAPS                40U
+#define MAX_STAGES              4U
+#define TOL                     2e-4f
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t seed = 0x12345678U;
+
+static int16_t q15_a[MAX_LEN + 1U];
+static int16_t q15_b[MAX_LEN + 1U];
+static int32_t q31_a[MAX_LEN];
+static int32_t q31_b[MAX_LEN];
+static float f32_a[MAX_LEN];
+static float f32_b[MAX_LEN];
+
+static const uint32_t lens[] = {1U, 2U, 3U, 4U, 5U, 6U, 7U, 8U, 9U, 15U, 16U, 17U, 63U, 256U, 517U};
+static const uint16_t taps[] = {1U, 2U, 3U, 4U, 5U, 7U, 8U, 9U, 31U, 32U, 33U, 40U};
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+/* Full scale, with the extremes that saturate now and then */
+static void fill_q15(int16_t *p, uint32_t n)
+{
+  while(n-- > 0U)
+  {
+    uint32_t r = rnd();
+
+    *p++ = ((r & 0x3FU) == 0U) ? (((r & 0x40U) != 0U) ? INT16_MIN : INT16_MAX) : (int16_t)(r >> 16);
+  }
+}
+
+static void fill_q31(int32_t *p, uint32_t n)
+{
+  while(n-- > 0U)
+  {
+    uint32_t r = rnd();
+
+    *p++ = ((r & 0x3FU) == 0U) ? (((r & 0x40U) != 0U) ? INT32_MIN : INT32_MAX) : (int32_t)rnd();
+  }
+}
+
+static void fill_f32(float *p, uint32_t n, float scale)
+{
+  while(n-- > 0U)
+  {
+    *p++ = scale * ((float)(int32_t)rnd() / 2147483648.0f);
+  }
+}
+
+static int near_f32(const float *a, const float *b, uint32_t n)
+{
+  uint32_t i;
+
+  for(i = 0U; i < n; i++)
+  {
+    if(fabsf(a[i] - b[i]) > TOL * fmaxf(1.0f, fabsf(b[i])))
+    {
+      printf("float %u: %.9g vs %.9g\n", i, (double)a[i], (double)b[i]);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void test_dot_rms(void)
+{
+  uint32_t i;
+  uint32_t n;
+  float x;
+
+  for(i = 0U; i < sizeof(lens) / sizeof(lens[0]); i++)
+  {
+    n = lens[i];
+    fill_q15(q15_a, n + 1U);
+    fill_q15(q15_b, n + 1U);
+    fill_q31(q31_a, n);
+    fill_q31(q31_b, n);
+    fill_f32(f32_a, n, 1.0f);
+    fill_f32(f32_b, n, 1.0f);
+    HOST_CHECK_EQ(dsp_dot_q15(q15_a + 1, q15_b, n), dsp_dot_q15_ref(q15_a + 1, q15_b, n));
+    HOST_CHECK_EQ(dsp_dot_q15(q15_a, q15_b + 1, n), dsp_dot_q15_ref(q15_a, q15_b + 1, n));
+    HOST_CHECK_EQ(dsp_dot_q31(q31_a, q31_b, n), dsp_dot_q31_ref(q31_a, q31_b, n));
+    x = dsp_dot_f32(f32_a, f32_b, n);
+    HOST_CHECK(near_f32(&x, (float[]){dsp_dot_f32_ref(f32_a, f32_b, n)}, 1U));
+    HOST_CHECK_EQ(dsp_rms_q15(q15_a + 1, n), dsp_rms_q15_ref(q15_a + 1, n));
+    HOST_CHECK_EQ(dsp_rms_q31(q31_a, n), dsp_rms_q31_ref(q31_a, n));
+    x = dsp_rms_f32(f32_a, n);
+    HOST_CHECK(near_f32(&x, (float[]){dsp_rms_f32_ref(f32_a, n)}, 1U));
+  }
+  /* All at full scale: the 64-bit sums and the RMS clamp */
+  for(i = 0U; i < MAX_LEN; i++)
+  {
+    q15_a[i] = INT16_MIN;
+    q31_a[i] = INT32_MIN;
+  }
+  HOST_CHECK_EQ(dsp_dot_q15(q15_a, q15_a, MAX_LEN), dsp_dot_q15_ref(q15_a, q15_a, MAX_LEN));
+  HOST_CHECK_EQ(dsp_rms_q15(q15_a, MAX_LEN), dsp_rms_q15_ref(q15_a, MAX_LEN));
+  HOST_CHECK_EQ(dsp_rms_q31(q31_a, MAX_LEN), dsp_rms_q31_ref(q31_a, MAX_LEN));
+}
+
+/* FIR and decimator, factor 1 being the plain filter */
+static void test_fir(void)
+{
+  static int16_t c15[MAX_TAPS];
+  static int32_t c31[MAX_TAPS];
+  static float cf[MAX_TAPS];
+  static int16_t s15[2][DSP_FIR_STATE(MAX_TAPS, MAX_LEN)];
+  static int32_t s31[2][DSP_FIR_STATE(MAX_TAPS, MAX_LEN)];
+  static float sf[2][DSP_FIR_STATE(MAX_TAPS, MAX_LEN)];
+  static int16_t o15[2][MAX_LEN];
+  static int32_t o31[2][MAX_LEN];
+  static float of[2][MAX_LEN];
+  dsp_fir_q15_t f15[2];
+  dsp_fir_q31_t f31[2];
+  dsp_fir_f32_t ff[2];
+  uint32_t t;
+  uint32_t i;
+  uint32_t k;
+  uint32_t n;
+  uint32_t d;
+  uint16_t factor;
+
+  for(t = 0U; t < sizeof(taps) / sizeof(taps[0]); t++)
+  {
+    fill_q15(c15, taps[t]);
+    fill_q31(c31, taps[t]);
+    fill_f32(cf, taps[t], 1.0f / (float)taps[t]);
+    for(factor = 1U; factor <= 4U; factor++)
+    {
+      for(k = 0U; k < 2U; k++)
+      {
+        dsp_fir_q15_init(&f15[k], c15, taps[t], factor, s15[k]);
+        dsp_fir_q31_init(&f31[k], c31, taps[t], factor, s31[k]);
+        dsp_fir_f32_init(&ff[k], cf, taps[t], factor, sf[k]);
+      }
+      for(i = 0U; i < sizeof(lens) / sizeof(lens[0]); i++)
+      {
+        n = lens[i] - (lens[i] % factor);
+        d = n / factor;
+        fill_q15(q15_a, n + 1U);
+        fill_q31(q31_a, n);
+        fill_f32(f32_a, n, 1.0f);
+        if(factor == 1U)
+        {
+          dsp_fir_q15(&f15[0], q15_a + 1, o15[0], n);
+          dsp_fir_q15_ref(&f15[1], q15_a + 1, o15[1], n);
+          dsp_fir_q31(&f31[0], q31_a, o31[0], n);
+          dsp_fir_q31_ref(&f31[1], q31_a, o31[1], n);
+          dsp_fir_f32(&ff[0], f32_a, of[0], n);
+          dsp_fir_f32_ref(&ff[1], f32_a, of[1], n);
+        }
+        else
+        {
+          dsp_decimate_q15(&f15[0], q15_a + 1, o15[0], n);
+          dsp_decimate_q15_ref(&f15[1], q15_a + 1, o15[1], n);
+          dsp_decimate_q31(&f31[0], q31_a, o31[0], n);
+          dsp_decimate_q31_ref(&f31[1], q31_a, o31[1], n);
+          dsp_decimate_f32(&ff[0], f32_a, of[0], n);
+          dsp_decimate_f32_ref(&ff[1], f32_a, of[1], n);
+        }
+        HOST_CHECK(memcmp(o15[0], o15[1], d * sizeof(int16_t)) == 0);
+        HOST_CHECK(memcmp(s15[0], s15[1], (taps[t] - 1U) * sizeof(int16_t)) == 0);
+        HOST_CHECK(memcmp(o31[0], o31[1], d * sizeof(int32_t)) == 0);
+        HOST_CHECK(memcmp(s31[0], s31[1], (taps[t] - 1U) * sizeof(int32_t)) == 0);
+        HOST_CHECK(near_f32(of[0], of[1], d));
+      }
+    }
+  }
+}
+
+/* Random coefficients: the fixed point cascades saturate and must do it
+   the same way. The float one gets stable sections. */
+static void test_biquad(void)
+{
+  static int16_t c15[5U * MAX_STAGES];
+  static int32_t c31[5U * MAX_STAGES];
+  static float cf[5U * MAX_STAGES];
+  static int16_t s15[2][4U * MAX_STAGES];
+  static int32_t s31[2][4U * MAX_STAGES];
+  static float sf[2][2U * MAX_STAGES];
+  static int16_t o15[2][MAX_LEN];
+  static int32_t o31[2][MAX_LEN];
+  static float of[2][MAX_LEN];
+  dsp_biquad_q15_t b15[2];
+  dsp_biquad_q31_t b31[2];
+  dsp_biquad_f32_t bf[2];
+  uint8_t stages;
+  uint8_t shift;
+  uint32_t i;
+  uint32_t k;
+  uint32_t n;
+
+  for(stages = 1U; stages <= MAX_STAGES; stages++)
+  {
+    for(shift = 0U; shift <= 2U; shift++)
+    {
+      fill_q15(c15, 5U * stages);
+      fill_q31(c31, 5U * stages);
+      for(k = 0U; k < stages; k++)
+      {
+        /* Poles at radius 0.9, angle k: a1 = 1.8 cos, a2 = -0.81 */
+        cf[5U * k] = 0.2f;
+        cf[(5U * k) + 1U] = 0.1f;
+        cf[(5U * k) + 2U] = -0.05f;
+        cf[(5U * k) + 3U] = 1.8f * cosf((float)(k + 1U));
+        cf[(5U * k) + 4U] = -0.81f;
+      }
+      for(k = 0U; k < 2U; k++)
+      {
+        dsp_biquad_q15_init(&b15[k], c15, stages, shift, s15[k]);
+        dsp_biquad_q31_init(&b31[k], c31, stages, shift, s31[k]);
+        dsp_biquad_f32_init(&bf[k], cf, stages, sf[k]);
+      }
+      for(i = 0U; i < sizeof(lens) / sizeof(lens[0]); i++)
+      {
+        n = lens[i];
+        fill_q15(q15_a, n + 1U);
+        fill_q31(q31_a, n);
+        fill_f32(f32_a, n, 1.0f);
+        dsp_biquad_q15(&b15[0], q15_a + 1, o15[0], n);
+        dsp_biquad_q15_ref(&b15[1], q15_a + 1, o15[1], n);
+        dsp_biquad_q31(&b31[0], q31_a, o31[0], n);
+        dsp_biquad_q31_ref(&b31[1], q31_a, o31[1], n);
+        dsp_biquad_f32(&bf[0], f32_a, of[0], n);
+        dsp_biquad_f32_ref(&bf[1], f32_a, of[1], n);
+        HOST_CHECK(memcmp(o15[0], o15[1], n * sizeof(int16_t)) == 0);
+        HOST_CHECK(memcmp(s15[0], s15[1], sizeof(s15[0])) == 0);
+        HOST_CHECK(memcmp(o31[0], o31[1], n * sizeof(int32_t)) == 0);
+        HOST_CHECK(memcmp(s31[0], s31[1], sizeof(s31[0])) == 0);
+        HOST_CHECK(near_f32(of[0], of[1], n));
+      }
+    }
+  }
+}
+
+/* Every size; Q15 input inside the unit circle, as dsp.h asks */
+static void test_cfft(void)
+{
+  static int16_t tw15[2U * DSP_CFFT_TWIDDLES(DSP_CFFT_MAX)];
+  static float twf[2U * DSP_CFFT_TWIDDLES(DSP_CFFT_MAX)];
+  static int16_t d15[2][2U * DSP_CFFT_MAX + 1U];
+  static float df[2][2U * DSP_CFFT_MAX];
+  dsp_cfft_q15_t c15;
+  dsp_cfft_f32_t cf;
+  uint32_t n;
+  uint32_t i;
+  uint32_t round;
+
+  HOST_CHECK_EQ(dsp_cfft_q15_init(&c15, tw15, 32U), 0U);
+  HOST_CHECK_EQ(dsp_cfft_f32_init(&cf, twf, 4U * DSP_CFFT_MAX), 0U);
+  for(n = DSP_CFFT_MIN; n <= DSP_CFFT_MAX; n <<= 2)
+  {
+    HOST_CHECK_EQ(dsp_cfft_q15_init(&c15, tw15, n), 1U);
+    HOST_CHECK_EQ(dsp_cfft_f32_init(&cf, twf, n), 1U);
+    for(round = 0U; round < 3U; round++)
+    {
+      for(i = 0U; i < 2U * n; i++)
+      {
+        /* |re|, |im| < 0.7: inside the unit circle */
+        d15[0][i + 1U] = (int16_t)((int32_t)(rnd() % 45875U) - 22937);
+      }
+      if(round == 2U)
+      {
+        /* An impulse and a constant, the two ends of the scaling */
+        memset(&d15[0][1], 0, 4U * n);
+        d15[0][1] = 22937;
+        d15[0][2U * (n / 2U) + 1U] = -22937;
+      }
+      memcpy(d15[1], &d15[0][1], 4U * n);
+      fill_f32(df[0], 2U * n, 1.0f);
+      memcpy(df[1], df[0], 8U * n);
+      dsp_cfft_q15(&c15, &d15[0][1]);
+      dsp_cfft_q15_ref(&c15, d15[1]);
+      dsp_cfft_f32(&cf, df[0]);
+      dsp_cfft_f32_ref(&cf, df[1]);
+      HOST_CHECK(memcmp(&d15[0][1], d15[1], 4U * n) == 0);
+      HOST_CHECK(near_f32(df[0], df[1], 2U * n));
+    }
+  }
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  test_dot_rms();
+  test_fir();
+  test_biquad();
+  test_cfft();
+  return host_result();
+}
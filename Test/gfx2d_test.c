@@ -0,0 +1,879 @@
+/* Header includes -----------------------------------------------------------*/
+/* The CPU path is the reference renderer: test from inside */
+#include "gfx2d.c"
+#include "host.h"
+#include <stddef.h>
+
+/* gfx2d: random fills, blits, blends and glyphs, from every source format
+   to both destination formats, clipped at all four edges, drawn through
+   the driver on a model of the DMA2D and, op for op, by the driver's CPU
+   path (gfx2d_cpu()) into a shadow of the destination; the two must match
+   to the pixel, padding included, with nothing written past the end.
+
+   The model works from the registers alone, with the arithmetic of the
+   reference manual: it loads the CLUT on FGPFCCR.START, runs the transfer
+   on CR.START and raises the interrupt, which the NVIC gives to
+   gfx2d_irq(). The transfer is drawn only when the interrupt is taken, so
+   operations called with interrupts masked stay queued behind it, as they
+   do behind a long transfer on the target. A register written while a
+   transfer or CLUT load runs is counted. Also checked: the reference
+   against worked values, what the driver refuses, glyphs clipped at each
+   column of the edges, and an operation lost to a transfer error. */
+
+/* Private macro -------------------------------------------------------------*/
+/* AXI SRAM, where the DMA2D reaches; DTCM, where it does not */
+#define SRAM                    0x24000000U
+#define SRAM_SIZE               0x80000U
+#define DTCM                    0x20000000U
+#define DTCM_SIZE               0x20000U
+#define DMA2D_REG(r)            ((uint32_t)offsetof(DMA2D_TypeDef, r))
+#define GUARD                   64U
+#define GUARD_BYTE              0xA5U
+#define ROUNDS                  300U
+
+/* Private types -------------------------------------------------------------*/
+typedef enum
+{
+  DMA2D_IDLE = 0U,
+  DMA2D_TRANSFER,
+  DMA2D_CLUT
+} dma2d_job_t;
+
+/* An operation as the application calls it */
+typedef struct
+{
+  uint32_t kind;                /* gfx2d_kind_t */
+  const gfx2d_surface_t *src;
+  int32_t x;
+  int32_t y;
+  int32_t sx;
+  int32_t sy;
+  int32_t w;
+  int32_t h;
+  uint32_t argb;
+  uint8_t alpha;
+} draw_t;
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t seed = 0x0D2A2D11U;
+static uint32_t sram_used;
+
+static host_mmio_t dma2d_m;
+static volatile struct
+{
+  uint32_t job;                 /* dma2d_job_t */
+  uint32_t fail;                /* the next transfer ends in a transfer error */
+  uint32_t transfers;
+  uint32_t pixels;
+  uint32_t clut_loads;
+  uint32_t clut_addr;           /* loaded, 0 after an error */
+  uint32_t reloads;             /* CLUT loads of the CLUT already loaded */
+  uint32_t late_writes;         /* registers written while running */
+  uint32_t bad;                 /* configurations refused */
+  uint32_t clut[256];
+} dma2d;
+
+/* Sources: every format, one in DTCM and A4 glyphs of even and odd width */
+static gfx2d_surface_t s_argb;
+static gfx2d_surface_t s_rgb;
+static gfx2d_surface_t s_l8a;
+static gfx2d_surface_t s_l8b;           /* the same pixels, another CLUT */
+static gfx2d_surface_t s_tcm;
+static gfx2d_surface_t g_a8;
+static gfx2d_surface_t g_a4;
+static gfx2d_surface_t g_a4odd;
+
+static gfx2d_surface_t dst;
+static gfx2d_surface_t shadow;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static int32_t rnd_in(int32_t lo, int32_t hi)
+{
+  return lo + (int32_t)(rnd() % (uint32_t)(hi - lo + 1));
+}
+
+/* Colours with the alphas that matter: 0, 255 and the rest */
+static uint32_t rnd_argb(void)
+{
+  uint32_t v = rnd();
+
+  switch(rnd() % 4U)
+  {
+    case 0U: return v & 0x00FFFFFFU;
+    case 1U: return v | 0xFF000000U;
+    default: return v;
+  }
+}
+
+static uint8_t *take(uint32_t bytes)
+{
+  uint8_t *p = (uint8_t *)(uintptr_t)(SRAM + sram_used);
+
+  sram_used = (sram_used + bytes + 31U) & ~31U;
+  HOST_CHECK(sram_used <= SRAM_SIZE);
+  return p;
+}
+
+static uint32_t bytes_of(const gfx2d_surface_t *s)
+{
+  return ((s->pitch * s->height * gfx2d_bits(s->format)) + 7U) / 8U;
+}
+
+static void surface(gfx2d_surface_t *s, uint32_t format, uint32_t w, uint32_t h, uint32_t pitch,
+                    void *pixels)
+{
+  uint32_t i;
+
+  memset(s, 0, sizeof(*s));
+  s->format = (uint16_t)format;
+  s->width = (uint16_t)w;
+  s->height = (uint16_t)h;
+  s->pitch = (uint16_t)pitch;
+  s->pixels = (pixels != NULL) ? pixels : take(bytes_of(s) + GUARD);
+  for(i = 0U; i < bytes_of(s); i++)
+  {
+    ((uint8_t *)s->pixels)[i] = (uint8_t)rnd();
+  }
+}
+
+static uint32_t *clut_make(void)
+{
+  uint32_t *clut = (uint32_t *)take(256U * 4U);
+  uint32_t i;
+
+  for(i = 0U; i < 256U; i++)
+  {
+    clut[i] = rnd_argb();
+  }
+  return clut;
+}
+
+/* DMA2D ---------------------------------------------------------------------*/
+static uint32_t dma2d_get(uint32_t offset)
+{
+  return host_mmio_get(&dma2d_m, offset);
+}
+
+static uint32_t dma2d_tcm(uint32_t addr)
+{
+  return ((addr < 0x00010000U) || ((addr >= DTCM) && (addr < (DTCM + DTCM_SIZE)))) ? 1U : 0U;
+}
+
+/* Bits per pixel of the colour modes the model takes, 0 for the rest */
+static uint32_t dma2d_bits(uint32_t cm)
+{
+  switch(cm)
+  {
+    case 0U:  return 32U;         /* ARGB8888 */
+    case 2U:  return 16U;         /* RGB565 */
+    case 5U:  return 8U;          /* L8 */
+    case 9U:  return 8U;          /* A8 */
+    case 10U: return 4U;          /* A4 */
+    default:  return 0U;
+  }
+}
+
+/* Pixel i of line j: memory address plus, for A4, the nibble (low first) */
+static uint32_t dma2d_fetch(uint32_t mar, uint32_t offs, uint32_t pl, uint32_t cm,
+                            uint32_t i, uint32_t j)
+{
+  uint32_t n = (j * (pl + offs)) + i;
+  const uint8_t *p = (const uint8_t *)(uintptr_t)mar;
+
+  switch(dma2d_bits(cm))
+  {
+    case 32U: return ((const uint32_t *)p)[n];
+    case 16U: return ((const uint16_t *)p)[n];
+    case 8U:  return p[n];
+    default:  return (p[n / 2U] >> ((n % 2U) * 4U)) & 0xFU;
+  }
+}
+
+static void dma2d_store(uint32_t mar, uint32_t offs, uint32_t pl, uint32_t cm,
+                        uint32_t i, uint32_t j, uint32_t v)
+{
+  uint32_t n = (j * (pl + offs)) + i;
+  uint8_t *p = (uint8_t *)(uintptr_t)mar;
+
+  if(cm == 0U)
+  {
+    ((uint32_t *)p)[n] = v;
+  }
+  else
+  {
+    ((uint16_t *)p)[n] = (uint16_t)v;
+  }
+}
+
+/* The pixel converter of a foreground or background input: to ARGB8888,
+   then the alpha mode */
+static uint32_t dma2d_argb(uint32_t raw, uint32_t pfccr, uint32_t colr)
+{
+  uint32_t cm = pfccr & DMA2D_FGPFCCR_CM;
+  uint32_t am = (pfccr & DMA2D_FGPFCCR_AM) >> DMA2D_FGPFCCR_AM_Pos;
+  uint32_t alpha = (pfccr & DMA2D_FGPFCCR_ALPHA) >> DMA2D_FGPFCCR_ALPHA_Pos;
+  uint32_t r5 = (raw >> 11) & 0x1FU;
+  uint32_t g6 = (raw >> 5) & 0x3FU;
+  uint32_t b5 = raw & 0x1FU;
+  uint32_t a;
+  uint32_t rgb;
+
+  switch(cm)
+  {
+    case 0U:
+      a = raw >> 24;
+      rgb = raw & 0x00FFFFFFU;
+      break;
+    case 2U:
+      a = 0xFFU;
+      rgb = (((r5 << 3) | (r5 >> 2)) << 16) | (((g6 << 2) | (g6 >> 4)) << 8) | ((b5 << 3) | (b5 >> 2));
+      break;
+    case 5U:
+      a = dma2d.clut[raw] >> 24;
+      rgb = dma2d.clut[raw] & 0x00FFFFFFU;
+      break;
+    case 9U:
+      a = raw;
+      rgb = colr & 0x00FFFFFFU;
+      break;
+    default:
+      a = (raw << 4) | raw;
+      rgb = colr & 0x00FFFFFFU;
+      break;
+  }
+  if(am == 1U)
+  {
+    a = alpha;
+  }
+  else if(am == 2U)
+  {
+    a = (a * alpha) / 255U;
+  }
+  return (a << 24) | rgb;
+}
+
+/* The blender: Mult = aFG.aBG/255, aOUT = aFG + aBG - Mult,
+   COUT = (CFG.aFG + CBG.aBG - CBG.Mult)/aOUT */
+static uint32_t dma2d_blend(uint32_t fg, uint32_t bg)
+{
+  uint32_t afg = fg >> 24;
+  uint32_t abg = bg >> 24;
+  uint32_t mult = (afg * abg) / 255U;
+  uint32_t aout = afg + abg - mult;
+  uint32_t out;
+  uint32_t c;
+
+  if(aout == 0U)
+  {
+    return 0U;
+  }
+  out = aout << 24;
+  for(c = 0U; c < 3U; c++)
+  {
+    uint32_t cfg = (fg >> (8U * c)) & 0xFFU;
+    uint32_t cbg = (bg >> (8U * c)) & 0xFFU;
+
+    out |= (((cfg * afg) + (cbg * abg) - (cbg * mult)) / aout) << (8U * c);
+  }
+  return out;
+}
+
+/* The output converter */
+static uint32_t dma2d_out(uint32_t argb, uint32_t cm)
+{
+  if(cm == 0U)
+  {
+    return argb;
+  }
+  return ((((argb >> 16) & 0xFFU) >> 3) << 11) | ((((argb >> 8) & 0xFFU) >> 2) << 5) | ((argb & 0xFFU) >> 3);
+}
+
+/* The transfer the registers describe; 0 for a configuration the DMA2D
+   refuses, or one its bus master cannot reach */
+static uint32_t dma2d_transfer(void)
+{
+  uint32_t mode = dma2d_get(DMA2D_REG(CR)) & DMA2D_CR_MODE;
+  uint32_t fgp = dma2d_get(DMA2D_REG(FGPFCCR));
+  uint32_t bgp = dma2d_get(DMA2D_REG(BGPFCCR));
+  uint32_t fgcm = fgp & DMA2D_FGPFCCR_CM;
+  uint32_t bgcm = bgp & DMA2D_BGPFCCR_CM;
+  uint32_t ocm = dma2d_get(DMA2D_REG(OPFCCR)) & DMA2D_OPFCCR_CM;
+  uint32_t fgmar = dma2d_get(DMA2D_REG(FGMAR));
+  uint32_t fgor = dma2d_get(DMA2D_REG(FGOR)) & DMA2D_FGOR_LO;
+  uint32_t bgmar = dma2d_get(DMA2D_REG(BGMAR));
+  uint32_t bgor = dma2d_get(DMA2D_REG(BGOR)) & DMA2D_BGOR_LO;
+  uint32_t omar = dma2d_get(DMA2D_REG(OMAR));
+  uint32_t oor = dma2d_get(DMA2D_REG(OOR)) & DMA2D_OOR_LO;
+  uint32_t fgcolr = dma2d_get(DMA2D_REG(FGCOLR));
+  uint32_t ocolr = dma2d_get(DMA2D_REG(OCOLR));
+  uint32_t nlr = dma2d_get(DMA2D_REG(NLR));
+  uint32_t pl = (nlr & DMA2D_NLR_PL) >> DMA2D_NLR_PL_Pos;
+  uint32_t nl = nlr & DMA2D_NLR_NL;
+  uint32_t fetch = (mode != GFX2D_MODE_R2M) ? 1U : 0U;
+  uint32_t i;
+  uint32_t j;
+  uint32_t v;
+
+  if((pl == 0U) || (nl == 0U) || ((ocm != 0U) && (ocm != 2U)) || (dma2d_tcm(omar) != 0U))
+  {
+    return 0U;
+  }
+  if((fetch != 0U) && ((dma2d_bits(fgcm) == 0U) || (dma2d_tcm(fgmar) != 0U)))
+  {
+    return 0U;
+  }
+  /* A4 lines are whole bytes */
+  if((fetch != 0U) && (fgcm == 10U) && (((pl | fgor) & 1U) != 0U))
+  {
+    return 0U;
+  }
+  if((mode == GFX2D_MODE_M2M) && (fgcm != ocm))
+  {
+    return 0U;
+  }
+  if((mode == GFX2D_MODE_BLEND) && ((dma2d_bits(bgcm) == 0U) || (dma2d_tcm(bgmar) != 0U)))
+  {
+    return 0U;
+  }
+
+  for(j = 0U; j < nl; j++)
+  {
+    for(i = 0U; i < pl; i++)
+    {
+      switch(mode)
+      {
+        case GFX2D_MODE_R2M:
+          v = ocolr & ((ocm == 0U) ? 0xFFFFFFFFU : 0xFFFFU);
+          break;
+        case GFX2D_MODE_M2M:
+          v = dma2d_fetch(fgmar, fgor, pl, fgcm, i, j);
+          break;
+        case GFX2D_MODE_PFC:
+          v = dma2d_out(dma2d_argb(dma2d_fetch(fgmar, fgor, pl, fgcm, i, j), fgp, fgcolr), ocm);
+          break;
+        default:
+          v = dma2d_out(dma2d_blend(dma2d_argb(dma2d_fetch(fgmar, fgor, pl, fgcm, i, j), fgp, fgcolr),
+                                    dma2d_argb(dma2d_fetch(bgmar, bgor, pl, bgcm, i, j), bgp, 0U)),
+                        ocm);
+          break;
+      }
+      dma2d_store(omar, oor, pl, ocm, i, j, v);
+    }
+  }
+  dma2d.transfers++;
+  dma2d.pixels += pl * nl;
+  return 1U;
+}
+
+/* 256 ARGB8888 entries from FGCMAR */
+static uint32_t dma2d_clut_load(void)
+{
+  uint32_t fgp = dma2d_get(DMA2D_REG(FGPFCCR));
+  uint32_t addr = dma2d_get(DMA2D_REG(FGCMAR));
+
+  if((((fgp & DMA2D_FGPFCCR_CS) >> DMA2D_FGPFCCR_CS_Pos) != 255U) || ((fgp & DMA2D_FGPFCCR_CCM) != 0U) ||
+     (dma2d_tcm(addr) != 0U))
+  {
+    return 0U;
+  }
+  if(addr == dma2d.clut_addr)
+  {
+    dma2d.reloads++;
+  }
+  memcpy((void *)dma2d.clut, (const void *)(uintptr_t)addr, sizeof(dma2d.clut));
+  dma2d.clut_addr = addr;
+  dma2d.clut_loads++;
+  return 1U;
+}
+
+/* The job started ends; its interrupt, if enabled in the NVIC, calls
+   gfx2d_irq() as DMA2D_IRQHandler would */
+static void dma2d_isr_fn(void)
+{
+  uint32_t cr = dma2d_get(DMA2D_REG(CR));
+  uint32_t flag;
+
+  if(dma2d.job == DMA2D_CLUT)
+  {
+    host_mmio_set(&dma2d_m, DMA2D_REG(FGPFCCR), dma2d_get(DMA2D_REG(FGPFCCR)) & ~DMA2D_FGPFCCR_START);
+    flag = (dma2d_clut_load() != 0U) ? DMA2D_ISR_CTCIF : DMA2D_ISR_CEIF;
+  }
+  else if(dma2d.fail != 0U)
+  {
+    dma2d.fail = 0U;
+    dma2d.clut_addr = 0U;
+    flag = DMA2D_ISR_TEIF;
+  }
+  else
+  {
+    flag = (dma2d_transfer() != 0U) ? DMA2D_ISR_TCIF : DMA2D_ISR_CEIF;
+  }
+  if(flag == DMA2D_ISR_CEIF)
+  {
+    dma2d.bad++;
+  }
+  host_mmio_set(&dma2d_m, DMA2D_REG(CR), cr & ~DMA2D_CR_START);
+  host_mmio_set(&dma2d_m, DMA2D_REG(ISR), dma2d_get(DMA2D_REG(ISR)) | flag);
+  dma2d.job = DMA2D_IDLE;
+
+  /* The interrupt enables are ISR flags shifted up by 8 */
+  if(((cr & (flag << 8)) != 0U) &&
+     ((NVIC->ISER[(uint32_t)DMA2D_IRQn >> 5] & (1UL << ((uint32_t)DMA2D_IRQn & 31U))) != 0U))
+  {
+    gfx2d_irq();
+  }
+}
+
+static void dma2d_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  (void)size;
+  if(offset == DMA2D_REG(IFCR))
+  {
+    host_mmio_set(m, DMA2D_REG(ISR), dma2d_get(DMA2D_REG(ISR)) & ~value);
+    return;
+  }
+  if(dma2d.job != DMA2D_IDLE)
+  {
+    /* Too late for the job running */
+    dma2d.late_writes++;
+    return;
+  }
+  if((offset == DMA2D_REG(CR)) && ((value & DMA2D_CR_START) != 0U))
+  {
+    dma2d.job = DMA2D_TRANSFER;
+    host_irq_raise(dma2d_isr_fn);
+  }
+  else if((offset == DMA2D_REG(FGPFCCR)) && ((value & DMA2D_FGPFCCR_START) != 0U))
+  {
+    dma2d.job = DMA2D_CLUT;
+    host_irq_raise(dma2d_isr_fn);
+  }
+}
+
+/* Reference -----------------------------------------------------------------*/
+/* The clipped rectangle against the intersection of the surfaces, worked
+   out here in destination coordinates */
+static void clip_check(const draw_t *d, const gfx2d_rect_t *r, uint32_t drawn)
+{
+  int32_t x0 = (d->x > 0) ? d->x : 0;
+  int32_t y0 = (d->y > 0) ? d->y : 0;
+  int32_t x1 = (d->x + d->w < (int32_t)dst.width) ? (d->x + d->w) : (int32_t)dst.width;
+  int32_t y1 = (d->y + d->h < (int32_t)dst.height) ? (d->y + d->h) : (int32_t)dst.height;
+  /* Source pixel (0, 0) lands here */
+  int32_t ox = d->x - d->sx;
+  int32_t oy = d->y - d->sy;
+
+  if(d->src != NULL)
+  {
+    x0 = (ox > x0) ? ox : x0;
+    y0 = (oy > y0) ? oy : y0;
+    x1 = (ox + (int32_t)d->src->width < x1) ? (ox + (int32_t)d->src->width) : x1;
+    y1 = (oy + (int32_t)d->src->height < y1) ? (oy + (int32_t)d->src->height) : y1;
+  }
+  HOST_CHECK_EQ(drawn, ((x0 < x1) && (y0 < y1)) ? 1U : 0U);
+  if(drawn != 0U)
+  {
+    HOST_CHECK_EQ(r->x, x0);
+    HOST_CHECK_EQ(r->y, y0);
+    HOST_CHECK_EQ(r->w, x1 - x0);
+    HOST_CHECK_EQ(r->h, y1 - y0);
+    if(d->src != NULL)
+    {
+      HOST_CHECK_EQ(r->sx, x0 - ox);
+      HOST_CHECK_EQ(r->sy, y0 - oy);
+    }
+  }
+}
+
+/* d drawn into the shadow by gfx2d_cpu(), clipped as the driver clips; 0
+   if nothing is left. The driver's statistics are left alone. */
+static uint32_t ref_draw(const draw_t *d)
+{
+  gfx2d_stats_t keep = gfx2d_stat;
+  gfx2d_rect_t r;
+  uint32_t drawn;
+
+  memset(&r, 0, sizeof(r));
+  r.kind = d->kind;
+  r.dst = &shadow;
+  r.src = d->src;
+  r.argb = d->argb;
+  r.alpha = (d->kind == GFX2D_GLYPH) ? (d->argb >> 24) : d->alpha;
+  drawn = gfx2d_clip(&r, d->x, d->y, d->sx, d->sy, d->w, d->h);
+  clip_check(d, &r, drawn);
+  if(drawn != 0U)
+  {
+    gfx2d_cpu(&r);
+  }
+  gfx2d_stat = keep;
+  return drawn;
+}
+
+/* Through the driver, then the reference */
+static uint32_t draw(const draw_t *d)
+{
+  HAL_StatusTypeDef status;
+
+  switch(d->kind)
+  {
+    case GFX2D_FILL:
+      status = gfx2d_fill(&dst, d->x, d->y, d->w, d->h, d->argb);
+      break;
+    case GFX2D_BLIT:
+      status = gfx2d_blit(&dst, d->x, d->y, d->src, d->sx, d->sy, d->w, d->h);
+      break;
+    case GFX2D_BLEND:
+      status = gfx2d_blend(&dst, d->x, d->y, d->src, d->sx, d->sy, d->w, d->h, d->alpha);
+      break;
+    default:
+      status = gfx2d_glyph(&dst, d->x, d->y, d->src, d->argb);
+      break;
+  }
+  HOST_CHECK_EQ(status, HAL_OK);
+  return ref_draw(d);
+}
+
+/* A random operation. queued: one the driver can leave to the DMA2D, so
+   that it never waits for the queue with interrupts masked. */
+static void draw_random(draw_t *d, uint32_t queued)
+{
+  static const gfx2d_surface_t *const colour[] = {&s_argb, &s_rgb, &s_l8a, &s_l8b, &s_tcm};
+  static const gfx2d_surface_t *const glyph[] = {&g_a8, &g_a4, &g_a4odd};
+  uint32_t tiny = ((rnd() % 3U) == 0U) ? 1U : 0U;
+
+  memset(d, 0, sizeof(*d));
+  d->kind = rnd() % 4U;
+  d->x = rnd_in(-24, (int32_t)dst.width + 4);
+  d->y = rnd_in(-24, (int32_t)dst.height + 4);
+  d->w = (tiny != 0U) ? rnd_in(1, 8) : rnd_in(1, (int32_t)dst.width + 16);
+  d->h = (tiny != 0U) ? rnd_in(1, 8) : rnd_in(1, (int32_t)dst.height + 16);
+  d->argb = rnd_argb();
+  switch(rnd() % 3U)
+  {
+    case 0U:  d->alpha = 0xFFU; break;
+    case 1U:  d->alpha = 0U; break;
+    default:  d->alpha = (uint8_t)rnd(); break;
+  }
+
+  if((d->kind == GFX2D_BLIT) || (d->kind == GFX2D_BLEND))
+  {
+    d->src = colour[rnd() % ((queued != 0U) ? 4U : 5U)];
+    d->sx = rnd_in(-8, (int32_t)d->src->width - 1);
+    d->sy = rnd_in(-8, (int32_t)d->src->height - 1);
+  }
+  else if(d->kind == GFX2D_GLYPH)
+  {
+    d->src = glyph[rnd() % ((queued != 0U) ? 2U : 3U)];
+    d->w = d->src->width;
+    d->h = d->src->height;
+    if((queued != 0U) && (d->src->format == GFX2D_A4))
+    {
+      /* Clipped at an even column, so whole bytes a line */
+      d->x &= ~1;
+    }
+  }
+}
+
+static void surface_same(const char *what)
+{
+  uint32_t bpp = gfx2d_bits(dst.format) / 8U;
+  uint32_t n = bytes_of(&dst) / bpp;
+  uint32_t i;
+  uint32_t a;
+  uint32_t b;
+
+  for(i = 0U; i < n; i++)
+  {
+    a = (bpp == 4U) ? ((const uint32_t *)dst.pixels)[i] : ((const uint16_t *)dst.pixels)[i];
+    b = (bpp == 4U) ? ((const uint32_t *)shadow.pixels)[i] : ((const uint16_t *)shadow.pixels)[i];
+    if(a != b)
+    {
+      printf("  %s: pixel (%u, %u) is %08X, the reference has %08X\n", what,
+             (unsigned)(i % dst.pitch), (unsigned)(i / dst.pitch), (unsigned)a, (unsigned)b);
+      HOST_CHECK_EQ(a, b);
+      return;
+    }
+  }
+}
+
+/* A fresh destination and its shadow, the same pixels */
+static void dst_make(uint32_t format, uint32_t w, uint32_t h, uint32_t pitch)
+{
+  surface(&dst, format, w, h, pitch, NULL);
+  memset((uint8_t *)dst.pixels + bytes_of(&dst), GUARD_BYTE, GUARD);
+  shadow = dst;
+  shadow.pixels = take(bytes_of(&dst));
+  memcpy(shadow.pixels, dst.pixels, bytes_of(&dst));
+}
+
+static void guard_check(void)
+{
+  uint32_t i;
+
+  for(i = 0U; i < GUARD; i++)
+  {
+    HOST_CHECK_EQ(((const uint8_t *)dst.pixels)[bytes_of(&dst) + i], GUARD_BYTE);
+  }
+}
+
+static void dma2d_reset(void)
+{
+  memset((void *)&dma2d, 0, sizeof(dma2d));
+}
+
+/* Tests ---------------------------------------------------------------------*/
+/* The reference arithmetic, worked by hand from the formulas in gfx2d.h */
+static void test_reference(void)
+{
+  gfx2d_surface_t s;
+  uint8_t *px = take(4U);
+
+  /* Half-transparent red over opaque blue */
+  HOST_CHECK_EQ(gfx2d_mix(0x80FF0000U, 0xFF0000FFU), 0xFF80007FU);
+  /* Both half transparent: Mult = 64, a = 192 */
+  HOST_CHECK_EQ(gfx2d_mix(0x80204060U, 0x80A0C0E0U), 0xC04A6A8AU);
+  HOST_CHECK_EQ(gfx2d_mix(0x00123456U, 0x40ABCDEFU), 0x40ABCDEFU);
+  HOST_CHECK_EQ(gfx2d_mix(0x00123456U, 0x00ABCDEFU), 0U);
+  HOST_CHECK_EQ(gfx2d_scale(0x80FFFFFFU, 128U), 0x40FFFFFFU);
+  HOST_CHECK_EQ(gfx2d_scale(0xC0123456U, 255U), 0xC0123456U);
+
+  /* RGB565 widens by repeating the top bits and narrows by truncation */
+  surface(&s, GFX2D_RGB565, 1U, 1U, 1U, px);
+  ((uint16_t *)px)[0] = 0x8410U;
+  HOST_CHECK_EQ(gfx2d_read(&s, 0U, 0U, 0U), 0xFF848284U);
+  ((uint16_t *)px)[0] = 0xFFFFU;
+  HOST_CHECK_EQ(gfx2d_read(&s, 0U, 0U, 0U), 0xFFFFFFFFU);
+  HOST_CHECK_EQ(gfx2d_pack565(0xFF848284U), 0x8410U);
+  HOST_CHECK_EQ(gfx2d_pack565(0x00FFFFFFU), 0xFFFFU);
+  HOST_CHECK_EQ(gfx2d_pack565(0xFF070307U), 0U);
+
+  /* A4: first pixel in the low nibble, A * 0x11 */
+  surface(&s, GFX2D_A4, 2U, 1U, 2U, px);
+  px[0] = 0x3CU;
+  HOST_CHECK_EQ(gfx2d_read(&s, 0U, 0U, 0xFF112233U), 0xCC112233U);
+  HOST_CHECK_EQ(gfx2d_read(&s, 1U, 0U, 0xFF112233U), 0x33112233U);
+}
+
+/* Formats an operation cannot take, and rectangles clipped away */
+static void test_refused(void)
+{
+  gfx2d_surface_t l8 = s_l8a;
+
+  HOST_CHECK_EQ(gfx2d_init(), HAL_OK);
+  dma2d_reset();
+  dst_make(GFX2D_ARGB8888, 32U, 16U, 32U);
+
+  HOST_CHECK_EQ(gfx2d_fill(&s_l8a, 0, 0, 8, 8, 0xFFFFFFFFU), HAL_ERROR);
+  HOST_CHECK_EQ(gfx2d_blit(&g_a8, 0, 0, &s_argb, 0, 0, 8, 8), HAL_ERROR);
+  HOST_CHECK_EQ(gfx2d_blit(&dst, 0, 0, &g_a8, 0, 0, 8, 8), HAL_ERROR);
+  HOST_CHECK_EQ(gfx2d_blend(&dst, 0, 0, &g_a4, 0, 0, 8, 8, 255U), HAL_ERROR);
+  HOST_CHECK_EQ(gfx2d_glyph(&dst, 0, 0, &s_argb, 0xFFFFFFFFU), HAL_ERROR);
+  l8.clut = NULL;
+  HOST_CHECK_EQ(gfx2d_blit(&dst, 0, 0, &l8, 0, 0, 8, 8), HAL_ERROR);
+
+  HOST_CHECK_EQ(gfx2d_fill(&dst, 32, 0, 8, 8, 0xFFFFFFFFU), HAL_OK);
+  HOST_CHECK_EQ(gfx2d_fill(&dst, -8, 0, 8, 8, 0xFFFFFFFFU), HAL_OK);
+  HOST_CHECK_EQ(gfx2d_fill(&dst, 0, 0, 0, 8, 0xFFFFFFFFU), HAL_OK);
+  HOST_CHECK_EQ(gfx2d_blit(&dst, 0, 0, &s_argb, (int32_t)s_argb.width, 0, 8, 8), HAL_OK);
+  HOST_CHECK_EQ(gfx2d_blend(&dst, 0, 0, &s_argb, 0, -40, 8, 40, 255U), HAL_OK);
+  HOST_CHECK_EQ(gfx2d_glyph(&dst, 0, -(int32_t)g_a8.height, &g_a8, 0xFFFFFFFFU), HAL_OK);
+
+  gfx2d_sync();
+  HOST_CHECK_EQ(gfx2d_stats()->dma2d_ops + gfx2d_stats()->cpu_ops, 0U);
+  HOST_CHECK_EQ(dma2d.transfers + dma2d.clut_loads, 0U);
+  surface_same("refused");
+}
+
+/* Random operations into one destination format. Most rounds are bursts
+   called with interrupts masked, queued behind the first; the rest are
+   single operations, the CPU-only ones among them. */
+static void run_draw(const char *name, uint32_t format, uint32_t pitch)
+{
+  const gfx2d_stats_t *st = gfx2d_stats();
+  uint32_t drawn = 0U;
+  uint32_t depth = 0U;
+  uint32_t round;
+  uint32_t n;
+  uint32_t k;
+  draw_t d;
+
+  HOST_CHECK_EQ(gfx2d_init(), HAL_OK);
+  dma2d_reset();
+  dst_make(format, 96U, 64U, pitch);
+
+  for(round = 0U; round < ROUNDS; round++)
+  {
+    if((rnd() % 4U) != 0U)
+    {
+      n = 1U + (rnd() % GFX2D_QUEUE);
+      k = dma2d.transfers;
+      __disable_irq();
+      for(; n > 0U; n--)
+      {
+        draw_random(&d, 1U);
+        drawn += draw(&d);
+        if((gfx2d_head - gfx2d_tail) > depth)
+        {
+          depth = gfx2d_head - gfx2d_tail;
+        }
+      }
+      /* The DMA2D draws nothing until the interrupt is taken */
+      HOST_CHECK_EQ(dma2d.transfers, k);
+      __enable_irq();
+    }
+    else
+    {
+      draw_random(&d, 0U);
+      drawn += draw(&d);
+    }
+    gfx2d_sync();
+    surface_same(name);
+  }
+  guard_check();
+
+  printf("  %-9s %4u operations: %4u by the DMA2D (%6u pixels, %3u CLUT loads, up to %2u queued), "
+         "%4u by the CPU\n", name, (unsigned)drawn, (unsigned)st->dma2d_ops, (unsigned)st->dma2d_pixels,
+         (unsigned)dma2d.clut_loads, (unsigned)depth, (unsigned)st->cpu_ops);
+  HOST_CHECK_EQ(st->dma2d_ops + st->cpu_ops, drawn);
+  HOST_CHECK_EQ(dma2d.transfers, st->dma2d_ops);
+  HOST_CHECK_EQ(dma2d.pixels, st->dma2d_pixels);
+  HOST_CHECK_EQ(st->errors, 0U);
+  HOST_CHECK_EQ(st->waits, 0U);
+  HOST_CHECK_EQ(dma2d.bad, 0U);
+  HOST_CHECK_EQ(dma2d.late_writes, 0U);
+  HOST_CHECK_EQ(dma2d.reloads, 0U);
+  HOST_CHECK(dma2d.clut_loads != 0U);
+  HOST_CHECK(st->cpu_ops != 0U);
+  HOST_CHECK(depth > 1U);
+  HOST_CHECK_EQ(gfx2d_busy(), 0U);
+}
+
+/* Glyphs across each edge, one column at a time: A4 ones clipped to an
+   odd column go to the CPU */
+static void test_glyph_edges(void)
+{
+  static const gfx2d_surface_t *const glyph[] = {&g_a8, &g_a4, &g_a4odd};
+  uint32_t g;
+  int32_t k;
+  draw_t d;
+
+  HOST_CHECK_EQ(gfx2d_init(), HAL_OK);
+  dma2d_reset();
+  dst_make(GFX2D_RGB565, 40U, 30U, 40U);
+
+  for(g = 0U; g < 3U; g++)
+  {
+    for(k = -4; k <= 4; k++)
+    {
+      memset(&d, 0, sizeof(d));
+      d.kind = GFX2D_GLYPH;
+      d.src = glyph[g];
+      d.w = d.src->width;
+      d.h = d.src->height;
+      d.argb = rnd_argb() | 0x80000000U;
+      d.x = k;
+      d.y = k;
+      draw(&d);
+      d.x = (int32_t)dst.width - d.w + k;
+      d.y = (int32_t)dst.height - d.h + k;
+      draw(&d);
+      gfx2d_sync();
+      surface_same("glyph edges");
+    }
+  }
+  HOST_CHECK(gfx2d_stats()->cpu_ops != 0U);
+  HOST_CHECK(gfx2d_stats()->dma2d_ops != 0U);
+  HOST_CHECK_EQ(dma2d.bad, 0U);
+}
+
+/* A transfer error drops its operation only, and the next L8 one loads
+   its CLUT again */
+static void test_error(void)
+{
+  const gfx2d_stats_t *st = gfx2d_stats();
+  draw_t d;
+
+  HOST_CHECK_EQ(gfx2d_init(), HAL_OK);
+  dma2d_reset();
+  dst_make(GFX2D_ARGB8888, 96U, 64U, 96U);
+
+  memset(&d, 0, sizeof(d));
+  d.kind = GFX2D_BLIT;
+  d.src = &s_l8a;
+  d.w = 40;
+  d.h = 30;
+  __disable_irq();
+  dma2d.fail = 1U;
+  HOST_CHECK_EQ(gfx2d_blit(&dst, 0, 0, &s_l8a, 0, 0, 40, 30), HAL_OK);
+  HOST_CHECK_EQ(gfx2d_fill(&dst, 20, 20, 50, 30, 0x80336699U), HAL_OK);
+  d.x = 50;
+  d.y = 30;
+  HOST_CHECK_EQ(gfx2d_blit(&dst, d.x, d.y, &s_l8a, 0, 0, d.w, d.h), HAL_OK);
+  __enable_irq();
+  gfx2d_sync();
+
+  /* The reference without the first */
+  memset(&d, 0, sizeof(d));
+  d.kind = GFX2D_FILL;
+  d.x = 20;
+  d.y = 20;
+  d.w = 50;
+  d.h = 30;
+  d.argb = 0x80336699U;
+  ref_draw(&d);
+  d.kind = GFX2D_BLIT;
+  d.src = &s_l8a;
+  d.x = 50;
+  d.y = 30;
+  d.w = 40;
+  d.h = 30;
+  ref_draw(&d);
+  surface_same("transfer error");
+
+  HOST_CHECK_EQ(st->errors, 1U);
+  HOST_CHECK_EQ(st->dma2d_ops, 3U);
+  HOST_CHECK_EQ(dma2d.transfers, 2U);
+  HOST_CHECK_EQ(dma2d.clut_loads, 2U);
+  HOST_CHECK_EQ(dma2d.late_writes, 0U);
+  HOST_CHECK_EQ(gfx2d_busy(), 0U);
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  host_map(SRAM, SRAM_SIZE);
+  host_map(DTCM, DTCM_SIZE);
+  dma2d_m.base = DMA2D_BASE;
+  dma2d_m.size = sizeof(DMA2D_TypeDef);
+  dma2d_m.write = dma2d_write;
+  host_mmio_attach(&dma2d_m);
+
+  surface(&s_argb, GFX2D_ARGB8888, 48U, 40U, 50U, NULL);
+  surface(&s_rgb, GFX2D_RGB565, 48U, 40U, 49U, NULL);
+  surface(&s_l8a, GFX2D_L8, 48U, 40U, 51U, NULL);
+  s_l8a.clut = clut_make();
+  s_l8b = s_l8a;
+  s_l8b.clut = clut_make();
+  surface(&s_tcm, GFX2D_ARGB8888, 20U, 16U, 20U, (void *)DTCM);
+  surface(&g_a8, GFX2D_A8, 13U, 17U, 13U, NULL);
+  surface(&g_a4, GFX2D_A4, 14U, 16U, 14U, NULL);
+  surface(&g_a4odd, GFX2D_A4, 15U, 12U, 16U, NULL);
+
+  test_reference();
+  test_refused();
+  run_draw("ARGB8888", GFX2D_ARGB8888, 100U);
+  run_draw("RGB565", GFX2D_RGB565, 98U);
+  test_glyph_edges();
+  test_error();
+
+  host_mmio_detach(&dma2d_m);
+  return host_result();
+}
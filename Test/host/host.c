@@ -0,0 +1,457 @@
+/* Header includes -----------------------------------------------------------*/
+#define _GNU_SOURCE
+#include "host.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <ucontext.h>
+
+#if !defined(__linux__) || !defined(__x86_64__)
+#error "host: the register trap needs Linux on x86-64"
+#endif
+
+/* Private macro -------------------------------------------------------------*/
+#define HOST_PAGE               4096U
+#define HOST_MMIO_MAX           16U
+#define HOST_IRQ_MAX            16U
+#define HOST_EFLAGS_TF          0x100U
+
+/* ctest reports this exit status as skipped */
+#define HOST_SKIP               77
+
+/* Private variables ---------------------------------------------------------*/
+static host_mmio_t *host_mmio[HOST_MMIO_MAX];
+static uint32_t host_mmio_count;
+
+static void (*host_irq[HOST_IRQ_MAX])(void);
+static uint32_t host_irq_count;
+static uint32_t host_in_irq;
+static uint32_t host_primask;
+static void (*host_idle)(void);
+
+static uint32_t host_checks;
+static uint32_t host_failures;
+
+/* The access being single-stepped. A store is run twice, over the register
+   and over its complement: the bytes it wrote come out the same both
+   times, or changed by the first run when it read them too. */
+static struct
+{
+  uint32_t active;
+  host_mmio_t *m;               /* NULL: plain memory on a trapped page */
+  uintptr_t page;
+  volatile uint32_t *word;
+  uint32_t store;
+  uint32_t pass;
+  uint32_t before;
+  uint32_t first;
+  greg_t regs[NGREG];
+} host_step;
+
+/* Private functions ---------------------------------------------------------*/
+static uintptr_t host_page(uintptr_t a)
+{
+  return a & ~(uintptr_t)(HOST_PAGE - 1U);
+}
+
+static uint32_t host_page_trapped(uintptr_t page)
+{
+  uint32_t i;
+
+  for(i = 0U; i < host_mmio_count; i++)
+  {
+    if((host_page(host_mmio[i]->base) <= page) && (page < host_mmio[i]->base + host_mmio[i]->size))
+    {
+      return 1U;
+    }
+  }
+  return 0U;
+}
+
+static host_mmio_t *host_mmio_at(uintptr_t a)
+{
+  uint32_t i;
+
+  for(i = 0U; i < host_mmio_count; i++)
+  {
+    if((host_mmio[i]->base <= a) && (a < host_mmio[i]->base + host_mmio[i]->size))
+    {
+      return host_mmio[i];
+    }
+  }
+  return NULL;
+}
+
+static void host_protect(uintptr_t page, uint32_t trapped)
+{
+  if(mprotect((void *)page, HOST_PAGE, (trapped != 0U) ? PROT_NONE : (PROT_READ | PROT_WRITE)) != 0)
+  {
+    perror("host: mprotect");
+    abort();
+  }
+}
+
+static void host_irq_deliver(void)
+{
+  void (*isr)(void);
+
+  if((host_primask != 0U) || (host_in_irq != 0U))
+  {
+    return;
+  }
+  host_in_irq = 1U;
+  while(host_irq_count > 0U)
+  {
+    isr = host_irq[0];
+    host_irq_count--;
+    memmove(&host_irq[0], &host_irq[1], host_irq_count * sizeof(host_irq[0]));
+    isr();
+  }
+  host_in_irq = 0U;
+}
+
+static void host_segv(int sig, siginfo_t *si, void *context)
+{
+  ucontext_t *uc = context;
+  uintptr_t a = (uintptr_t)si->si_addr;
+  host_mmio_t *m;
+
+  (void)sig;
+  if((host_step.active != 0U) || (host_page_trapped(host_page(a)) == 0U))
+  {
+    /* A real fault: let it happen again without the handler */
+    signal(SIGSEGV, SIG_DFL);
+    return;
+  }
+
+  /* A pending interrupt lands before the access */
+  host_irq_deliver();
+
+  m = host_mmio_at(a);
+  host_step.active = 1U;
+  host_step.m = m;
+  host_step.page = host_page(a);
+  host_step.word = (volatile uint32_t *)(a & ~(uintptr_t)3U);
+  host_step.store = ((uc->uc_mcontext.gregs[REG_ERR] & 2) != 0) ? 1U : 0U;
+  host_step.pass = 0U;
+  memcpy(host_step.regs, uc->uc_mcontext.gregs, sizeof(host_step.regs));
+  host_protect(host_step.page, 0U);
+
+  if(m != NULL)
+  {
+    if(host_step.store != 0U)
+    {
+      host_step.before = *host_step.word;
+    }
+    else
+    {
+      m->reads++;
+      if(m->read != NULL)
+      {
+        *host_step.word = m->read(m, (uint32_t)((uintptr_t)host_step.word - m->base), *host_step.word);
+      }
+    }
+  }
+  uc->uc_mcontext.gregs[REG_EFL] |= HOST_EFLAGS_TF;
+}
+
+static void host_store_done(host_mmio_t *m, uint32_t second)
+{
+  uint32_t first = host_step.first;
+  uint32_t mask = 0U;
+  uint32_t lo;
+  uint32_t hi;
+  uint32_t size;
+  uint32_t b;
+
+  for(b = 0U; b < 32U; b += 8U)
+  {
+    if((((first ^ second) >> b) & 0xFFU) == 0U || (((first ^ host_step.before) >> b) & 0xFFU) != 0U)
+    {
+      mask |= 1UL << (b / 8U);
+    }
+  }
+  if(mask == 0U)
+  {
+    mask = 0xFU;
+  }
+  lo = (uint32_t)__builtin_ctz(mask);
+  hi = 31U - (uint32_t)__builtin_clz(mask);
+  size = (hi == lo) ? 1U : ((hi - lo == 1U) && ((lo & 1U) == 0U)) ? 2U : 4U;
+  if(size == 4U)
+  {
+    lo = 0U;
+  }
+
+  *host_step.word = first;
+  m->writes++;
+  if(m->write != NULL)
+  {
+    m->write(m, (uint32_t)((uintptr_t)host_step.word - m->base) + lo,
+             (size == 4U) ? first : ((first >> (lo * 8U)) & ((1UL << (size * 8U)) - 1U)), size);
+  }
+}
+
+static void host_trap(int sig, siginfo_t *si, void *context)
+{
+  ucontext_t *uc = context;
+  host_mmio_t *m = host_step.m;
+
+  (void)si;
+  if(host_step.active == 0U)
+  {
+    signal(sig, SIG_DFL);
+    return;
+  }
+
+  if((m != NULL) && (host_step.store != 0U))
+  {
+    if(host_step.pass == 0U)
+    {
+      host_step.first = *host_step.word;
+      host_step.pass = 1U;
+      *host_step.word = ~host_step.before;
+      memcpy(uc->uc_mcontext.gregs, host_step.regs, sizeof(host_step.regs));
+      uc->uc_mcontext.gregs[REG_EFL] |= HOST_EFLAGS_TF;
+      return;
+    }
+    host_store_done(m, *host_step.word);
+  }
+
+  uc->uc_mcontext.gregs[REG_EFL] &= ~(greg_t)HOST_EFLAGS_TF;
+  host_step.active = 0U;
+  host_protect(host_step.page, 1U);
+}
+
+static void host_map_fixed(uintptr_t base, uint32_t size)
+{
+  void *p = mmap((void *)base, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0);
+
+  if(p != (void *)base)
+  {
+    if((p == MAP_FAILED) && (errno == EEXIST))
+    {
+      return;
+    }
+    fprintf(stderr, "host: cannot map 0x%08lx, skipped\n", (unsigned long)base);
+    exit(HOST_SKIP);
+  }
+}
+
+__attribute__((constructor))
+static void host_init(void)
+{
+  struct sigaction sa;
+
+  host_map_fixed(0x40000000U, 0x20000000U);
+  host_map_fixed(0xE0000000U, 0x00100000U);
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+  sa.sa_sigaction = host_segv;
+  sigaction(SIGSEGV, &sa, NULL);
+  sa.sa_sigaction = host_trap;
+  sigaction(SIGTRAP, &sa, NULL);
+  setvbuf(stdout, NULL, _IOLBF, 0);
+}
+
+/* Function definitions ------------------------------------------------------*/
+void *host_map(uintptr_t base, uint32_t size)
+{
+  uintptr_t page = host_page(base);
+
+  host_map_fixed(page, (uint32_t)(host_page(base + size + HOST_PAGE - 1U) - page));
+  return (void *)base;
+}
+
+void host_mmio_attach(host_mmio_t *m)
+{
+  uintptr_t page;
+
+  if(host_mmio_count == HOST_MMIO_MAX)
+  {
+    fprintf(stderr, "host: too many register models\n");
+    abort();
+  }
+  m->reads = 0U;
+  m->writes = 0U;
+  host_mmio[host_mmio_count++] = m;
+  for(page = host_page(m->base); page < m->base + m->size; page += HOST_PAGE)
+  {
+    host_protect(page, 1U);
+  }
+}
+
+void host_mmio_detach(host_mmio_t *m)
+{
+  uintptr_t page;
+  uint32_t i;
+
+  for(i = 0U; i < host_mmio_count; i++)
+  {
+    if(host_mmio[i] == m)
+    {
+      host_mmio_count--;
+      memmove(&host_mmio[i], &host_mmio[i + 1U], (host_mmio_count - i) * sizeof(host_mmio[0]));
+      break;
+    }
+  }
+  for(page = host_page(m->base); page < m->base + m->size; page += HOST_PAGE)
+  {
+    host_protect(page, host_page_trapped(page));
+  }
+}
+
+uint32_t host_mmio_get(const host_mmio_t *m, uint32_t offset)
+{
+  uintptr_t a = m->base + offset;
+  uint32_t stepping = (host_step.active != 0U) && (host_step.page == host_page(a));
+  uint32_t v;
+
+  host_protect(host_page(a), 0U);
+  v = *(volatile uint32_t *)a;
+  host_protect(host_page(a), (stepping == 0U) && (host_page_trapped(host_page(a)) != 0U));
+  return v;
+}
+
+void host_mmio_set(host_mmio_t *m, uint32_t offset, uint32_t value)
+{
+  uintptr_t a = m->base + offset;
+  uint32_t stepping = (host_step.active != 0U) && (host_step.page == host_page(a));
+
+  host_protect(host_page(a), 0U);
+  *(volatile uint32_t *)a = value;
+  host_protect(host_page(a), (stepping == 0U) && (host_page_trapped(host_page(a)) != 0U));
+}
+
+void host_irq_raise(void (*isr)(void))
+{
+  uint32_t i;
+
+  for(i = 0U; i < host_irq_count; i++)
+  {
+    if(host_irq[i] == isr)
+    {
+      return;
+    }
+  }
+  if(host_irq_count < HOST_IRQ_MAX)
+  {
+    host_irq[host_irq_count++] = isr;
+  }
+}
+
+void host_irq_poll(void)
+{
+  host_irq_deliver();
+}
+
+uint32_t host_irq_pending(void)
+{
+  return host_irq_count;
+}
+
+void host_set_idle(void (*idle)(void))
+{
+  host_idle = idle;
+}
+
+int host_check(int ok, const char *cond, const char *file, int line)
+{
+  host_checks++;
+  if(!ok)
+  {
+    host_failures++;
+    printf("%s:%d: check failed: %s\n", file, line, cond);
+  }
+  return ok;
+}
+
+int host_check_eq(uint64_t a, uint64_t b, const char *sa, const char *sb, const char *file, int line)
+{
+  host_checks++;
+  if(a != b)
+  {
+    host_failures++;
+    printf("%s:%d: check failed: %s == %s (0x%llx != 0x%llx)\n", file, line, sa, sb,
+           (unsigned long long)a, (unsigned long long)b);
+    return 0;
+  }
+  return 1;
+}
+
+int host_result(void)
+{
+  printf("%u checks, %u failed\n", host_checks, host_failures);
+  return (host_failures == 0U) ? 0 : 1;
+}
+
+uint64_t host_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+uint32_t host_get_primask(void)
+{
+  return host_primask;
+}
+
+void host_set_primask(uint32_t primask)
+{
+  host_primask = primask & 1U;
+  host_irq_deliver();
+}
+
+/* Wakes on a pending interrupt even when masked, as on the target */
+void host_wfi(void)
+{
+  if((host_irq_count == 0U) && (host_idle != NULL))
+  {
+    host_idle();
+  }
+  host_irq_deliver();
+}
+
+void host_set_msp(uint32_t sp)
+{
+  fprintf(stderr, "host: __set_MSP(0x%08lx), cannot start code on the host\n", (unsigned long)sp);
+  abort();
+}
+
+uint32_t host_rbit(uint32_t x)
+{
+  uint32_t r = 0U;
+  uint32_t i;
+
+  for(i = 0U; i < 32U; i++)
+  {
+    r = (r << 1) | ((x >> i) & 1U);
+  }
+  return r;
+}
+
+uint32_t host_clz(uint32_t x)
+{
+  return (x == 0U) ? 32U : (uint32_t)__builtin_clz(x);
+}
+
+int32_t host_ssat(int32_t x, uint32_t bits)
+{
+  int32_t max = (int32_t)((1UL << (bits - 1U)) - 1U);
+
+  return (x > max) ? max : (x < -max - 1) ? (-max - 1) : x;
+}
+
+uint32_t host_usat(int32_t x, uint32_t bits)
+{
+  int32_t max = (int32_t)((1UL << bits) - 1U);
+
+  return (uint32_t)((x > max) ? max : (x < 0) ? 0 : x);
+}
@@ -0,0 +1,93 @@
+#ifndef __HOST_H
+#define __HOST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Header includes -----------------------------------------------------------*/
+#include <stdint.h>
+#include <stdio.h>
+
+/* Host side of the tests: the drivers are built unchanged for Linux x86-64
+   and run against memory mapped at the real peripheral addresses
+   (0x40000000-0x5FFFFFFF and the Cortex-M7 system space at 0xE0000000),
+   so every HAL macro and register access works as on the target.
+
+   Registers with behaviour (a data register that computes, a FIFO, a flag
+   set by hardware) are modelled by attaching a host_mmio_t over them. The
+   pages under an attached model are kept inaccessible; each access traps,
+   is given to the model and is single-stepped, so the model sees every
+   load and store with its width and value. Other registers are plain
+   memory. Test state a model changes is changed behind the compiler's
+   back, as by an interrupt: make it volatile.
+
+   Interrupts are functions raised with host_irq_raise(). They run at the
+   next register access, __enable_irq() or __set_PRIMASK() with the mask
+   clear, __WFI() or host_irq_poll(), the way a pending interrupt lands
+   between two instructions on the target. */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct host_mmio_s host_mmio_t;
+
+struct host_mmio_s
+{
+  uintptr_t base;               /* register block, as the device header has it */
+  uint32_t size;
+  /* Load of the word at offset, current: what the register holds now.
+     Returns what the load sees; NULL reads the register as memory. */
+  uint32_t (*read)(host_mmio_t *m, uint32_t offset, uint32_t current);
+  /* Store of size bytes (1, 2 or 4) at offset; the register already holds
+     value. NULL leaves it there. */
+  void (*write)(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size);
+  void *context;
+  /* Counted by the trap, behind the compiler's back */
+  volatile uint32_t reads;      /* loads seen */
+  volatile uint32_t writes;     /* stores seen */
+};
+
+/* Exported macro ------------------------------------------------------------*/
+#define HOST_CHECK(cond)        host_check((cond) != 0, #cond, __FILE__, __LINE__)
+#define HOST_CHECK_EQ(a, b)     host_check_eq((uint64_t)(a), (uint64_t)(b), #a, #b, __FILE__, __LINE__)
+
+/* Function definitions ------------------------------------------------------*/
+/* Memory at a target address, for buffers a driver hands to a DMA as a
+   32-bit address. Peripheral and system space are mapped already. */
+void *host_map(uintptr_t base, uint32_t size);
+
+void host_mmio_attach(host_mmio_t *m);
+void host_mmio_detach(host_mmio_t *m);
+/* The register at offset, for models and tests; no trap */
+uint32_t host_mmio_get(const host_mmio_t *m, uint32_t offset);
+void host_mmio_set(host_mmio_t *m, uint32_t offset, uint32_t value);
+
+void host_irq_raise(void (*isr)(void));
+void host_irq_poll(void);
+uint32_t host_irq_pending(void);
+/* Called by __WFI() when no interrupt is pending, e.g. to advance time */
+void host_set_idle(void (*idle)(void));
+
+int host_check(int ok, const char *cond, const char *file, int line);
+int host_check_eq(uint64_t a, uint64_t b, const char *sa, const char *sb, const char *file, int line);
+/* Exit status for main() */
+int host_result(void);
+
+/* Monotonic host time, for the benchmarks */
+uint64_t host_ns(void);
+
+/* CMSIS intrinsics, see stm32h7xx_hal.h */
+uint32_t host_get_primask(void);
+void host_set_primask(uint32_t primask);
+void host_wfi(void);
+/* There is no stack to switch to: a test that gets there has jumped */
+void host_set_msp(uint32_t sp);
+uint32_t host_rbit(uint32_t x);
+uint32_t host_clz(uint32_t x);
+int32_t host_ssat(int32_t x, uint32_t bits);
+uint32_t host_usat(int32_t x, uint32_t bits);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
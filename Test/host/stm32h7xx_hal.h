@@ -0,0 +1,70 @@
+#ifndef __HOST_STM32H7XX_HAL_H
+#define __HOST_STM32H7XX_HAL_H
+
+/* The HAL header for host builds: the real one, then the CMSIS intrinsics
+   that are Cortex-M instructions replaced by host functions (host.h).
+
+   Inline functions of the CMSIS headers keep their Cortex-M barriers; the
+   assembler macros below turn those into nothing when one of them is
+   compiled in. */
+__asm__(".macro dsb args:vararg\n.endm\n"
+        ".macro dmb args:vararg\n.endm\n"
+        ".macro isb args:vararg\n.endm\n");
+
+#include_next "stm32h7xx_hal.h"
+#include "host.h"
+
+#undef __set_MSP
+#undef __NOP
+#undef __WFI
+#undef __WFE
+#undef __SEV
+#undef __BKPT
+#undef __CLZ
+#undef __SSAT
+#undef __USAT
+
+#define __get_PRIMASK()         host_get_primask()
+#define __set_PRIMASK(x)        host_set_primask(x)
+#define __disable_irq()         host_set_primask(1U)
+#define __enable_irq()          host_set_primask(0U)
+#define __DSB()                 __asm__ volatile ("" ::: "memory")
+#define __DMB()                 __asm__ volatile ("" ::: "memory")
+#define __ISB()                 __asm__ volatile ("" ::: "memory")
+#define __NOP()                 __asm__ volatile ("nop")
+#define __set_MSP(sp)           host_set_msp(sp)
+#define __WFI()                 host_wfi()
+#define __WFE()                 host_wfi()
+#define __SEV()                 ((void)0)
+#define __BKPT(value)           __builtin_trap()
+#define __REV(x)                __builtin_bswap32((uint32_t)(x))
+#define __REV16(x)              ((uint32_t)__builtin_bswap32((uint32_t)(x)) >> 16 | \
+                                 (uint32_t)__builtin_bswap32((uint32_t)(x)) << 16)
+#define __RBIT(x)               host_rbit(x)
+#define __CLZ(x)                host_clz(x)
+#define __SSAT(x, bits)         host_ssat((int32_t)(x), (bits))
+#define __USAT(x, bits)         host_usat((int32_t)(x), (bits))
+
+/* DSP extension, for builds with __ARM_FEATURE_DSP=1 */
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#undef __PKHBT
+#undef __PKHTB
+
+#define HOST_LO(x)              ((int32_t)(int16_t)(uint16_t)(x))
+#define HOST_HI(x)              ((int32_t)(int16_t)(uint16_t)((uint32_t)(x) >> 16))
+#define HOST_PACK(hi, lo)       (((uint32_t)(hi) << 16) | ((uint32_t)(lo) & 0xFFFFU))
+
+#define __PKHBT(a, b, sh)       (((uint32_t)(a) & 0xFFFFU) | (((uint32_t)(b) << (sh)) & 0xFFFF0000U))
+#define __PKHTB(a, b, sh)       (((uint32_t)(a) & 0xFFFF0000U) | (((uint32_t)(b) >> (sh)) & 0xFFFFU))
+#define __SHADD16(x, y)         HOST_PACK((HOST_HI(x) + HOST_HI(y)) >> 1, (HOST_LO(x) + HOST_LO(y)) >> 1)
+#define __SHSUB16(x, y)         HOST_PACK((HOST_HI(x) - HOST_HI(y)) >> 1, (HOST_LO(x) - HOST_LO(y)) >> 1)
+#define __SHASX(x, y)           HOST_PACK((HOST_HI(x) + HOST_LO(y)) >> 1, (HOST_LO(x) - HOST_HI(y)) >> 1)
+#define __SHSAX(x, y)           HOST_PACK((HOST_HI(x) - HOST_LO(y)) >> 1, (HOST_LO(x) + HOST_HI(y)) >> 1)
+/* 32-bit results wrap as on the target (which sets Q) */
+#define __SMUSD(x, y)           ((uint32_t)(HOST_LO(x) * HOST_LO(y)) - (uint32_t)(HOST_HI(x) * HOST_HI(y)))
+#define __SMUADX(x, y)          ((uint32_t)(HOST_LO(x) * HOST_HI(y)) + (uint32_t)(HOST_HI(x) * HOST_LO(y)))
+#define __SMLALD(x, y, acc)     ((uint64_t)((int64_t)(acc) + (int64_t)HOST_LO(x) * HOST_LO(y) + \
+                                            (int64_t)HOST_HI(x) * HOST_HI(y)))
+#endif
+
+#endif
@@ -0,0 +1,932 @@
+/* Header includes -----------------------------------------------------------*/
+#include "i2c_sched.h"
+#include "pin.h"
+#include <stddef.h>
+#include <string.h>
+
+/* i2c_sched: jobs run through the real HAL interrupt path against an I2C1
+   model that moves one bus event (start and address, a byte, a stop) per
+   microsecond of a simulated timebase, talking to a register file target.
+   The bus pins are on a GPIOB model the target can hold SDA low on. The
+   events seen on the wire are checked against each job, and so are NACK
+   retries, the timeout and bus error recoveries: the SCL pulses and the
+   STOP, their timing, that they run from alarms while the next job waits,
+   and that the pins come back as the application set them. */
+
+/* Private macro -------------------------------------------------------------*/
+#define WIRE_MAX                1024U
+#define EDGE_MAX                256U
+#define JOB_MAX                 16U
+#define RUN_MAX                 100000U
+#define DEV                     0x50U
+#define NO_DEV                  0x51U
+#define SCL                     PIN_BIT(8)
+#define SDA                     PIN_BIT(9)
+/* I2C_RECOVER_HALF_US in i2c_sched.c */
+#define HALF_US                 5U
+#define HOLD_FOREVER            0xFFFFFFFFU
+
+/* wire_t.kind */
+#define W_START                 0U      /* value: address << 1 | read */
+#define W_RESTART               1U
+#define W_OUT                   2U
+#define W_IN                    3U
+#define W_STOP                  4U
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  uint64_t t;
+  uint8_t kind;
+  uint8_t value;
+  uint8_t ack;                  /* W_START/W_RESTART: address acknowledged */
+} wire_t;
+
+typedef struct
+{
+  uint64_t t;
+  uint32_t level;               /* GPIOB ODR & (SCL | SDA) */
+} edge_t;
+
+typedef struct
+{
+  i2c_job_t j;
+  uint8_t data[16];
+  uint32_t order;               /* done() count when it was called */
+  uint64_t done_t;
+  uint32_t recovering;          /* s.recovering in done() */
+} job_t;
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t seed = 0x2468ACE1U;
+static I2C_HandleTypeDef hi2c;
+static I2C_HandleTypeDef hi2c_other;
+static i2c_sched_t s;
+
+/* Simulated timebase: time moves only while the test waits in __WFI() */
+static volatile uint64_t now_us;
+static timebase_alarm_t *volatile armed;
+
+/* I2C1: master, interrupt path */
+static host_mmio_t i2c_m;
+static volatile struct
+{
+  uint32_t sr;                  /* latched NACKF, STOPF, TC, TCR, BERR */
+  uint32_t start;               /* START requested */
+  uint32_t xfer;                /* NBYTES counting */
+  uint32_t read;
+  uint32_t remaining;
+  uint32_t busy;                /* between our START and STOP */
+  uint32_t txfull;
+  uint8_t txdr;
+  uint32_t rxfull;
+  uint8_t rxdr;
+  uint32_t berr_at;             /* bus error after this many bytes, 0 = none */
+} i2c;
+
+/* The target: register file with an auto-incremented pointer set by the
+   first byte written */
+static volatile struct
+{
+  uint8_t mem[256];
+  uint8_t ptr;
+  uint32_t first;
+  uint32_t nack;                /* addresses to NACK */
+  uint32_t hold;                /* SCL pulses it holds SDA low for */
+} dev;
+
+static volatile wire_t wire[WIRE_MAX];
+static volatile uint32_t wire_n;
+
+/* GPIOB: SCL and SDA, edges logged while the pins are outputs */
+static host_mmio_t port;
+static volatile edge_t edges[EDGE_MAX];
+static volatile uint32_t edge_n;
+static volatile uint32_t cfg_writes;    /* PUPDR, OSPEEDR, AFR */
+static volatile uint32_t glitches;      /* taken low or push-pull */
+
+static volatile uint32_t done_n;
+static volatile uint32_t other_n;
+static I2C_HandleTypeDef *volatile other_hi2c;
+static volatile uint32_t other_event;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static uint32_t i2c_reg(uint32_t offset)
+{
+  return host_mmio_get(&i2c_m, offset);
+}
+
+static void wire_log(uint32_t kind, uint32_t value, uint32_t ack)
+{
+  if(wire_n < WIRE_MAX)
+  {
+    wire[wire_n].t = now_us;
+    wire[wire_n].kind = (uint8_t)kind;
+    wire[wire_n].value = (uint8_t)value;
+    wire[wire_n].ack = (uint8_t)ack;
+  }
+  wire_n++;
+}
+
+static uint32_t i2c_isr_value(void)
+{
+  uint32_t v = i2c.sr;
+
+  v |= (i2c.txfull == 0U) ? I2C_ISR_TXE : 0U;
+  if((i2c.xfer != 0U) && (i2c.read == 0U) && (i2c.remaining != 0U) && (i2c.txfull == 0U))
+  {
+    v |= I2C_ISR_TXIS;
+  }
+  v |= (i2c.rxfull != 0U) ? I2C_ISR_RXNE : 0U;
+  v |= ((i2c.busy != 0U) || (dev.hold != 0U)) ? I2C_ISR_BUSY : 0U;
+  return v;
+}
+
+static void i2c_ev_isr(void)
+{
+  HAL_I2C_EV_IRQHandler(&hi2c);
+}
+
+static void i2c_er_isr(void)
+{
+  HAL_I2C_ER_IRQHandler(&hi2c);
+}
+
+static void i2c_irq_update(void)
+{
+  uint32_t cr1 = i2c_reg(offsetof(I2C_TypeDef, CR1));
+  uint32_t isr = i2c_isr_value();
+  uint32_t ev = 0U;
+
+  ev |= ((isr & I2C_ISR_TXIS) != 0U) ? (cr1 & I2C_CR1_TXIE) : 0U;
+  ev |= ((isr & I2C_ISR_RXNE) != 0U) ? (cr1 & I2C_CR1_RXIE) : 0U;
+  ev |= ((isr & (I2C_ISR_TC | I2C_ISR_TCR)) != 0U) ? (cr1 & I2C_CR1_TCIE) : 0U;
+  ev |= ((isr & I2C_ISR_STOPF) != 0U) ? (cr1 & I2C_CR1_STOPIE) : 0U;
+  ev |= ((isr & I2C_ISR_NACKF) != 0U) ? (cr1 & I2C_CR1_NACKIE) : 0U;
+  if(ev != 0U)
+  {
+    host_irq_raise(i2c_ev_isr);
+  }
+  if(((isr & (I2C_ISR_BERR | I2C_ISR_ARLO | I2C_ISR_OVR)) != 0U) && ((cr1 & I2C_CR1_ERRIE) != 0U))
+  {
+    host_irq_raise(i2c_er_isr);
+  }
+}
+
+static void i2c_stop(void)
+{
+  wire_log(W_STOP, 0U, 0U);
+  i2c.sr |= I2C_ISR_STOPF;
+  i2c.busy = 0U;
+  i2c.xfer = 0U;
+}
+
+static uint32_t i2c_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  uint32_t v = current;
+
+  (void)m;
+  if(offset == offsetof(I2C_TypeDef, ISR))
+  {
+    v = i2c_isr_value();
+  }
+  else if(offset == offsetof(I2C_TypeDef, RXDR))
+  {
+    HOST_CHECK(i2c.rxfull);
+    v = i2c.rxdr;
+    i2c.rxfull = 0U;
+  }
+  i2c_irq_update();
+  return v;
+}
+
+static void i2c_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  (void)size;
+  if(offset == offsetof(I2C_TypeDef, CR1))
+  {
+    if((value & I2C_CR1_PE) == 0U)
+    {
+      /* PE = 0 resets the state machine and the flags */
+      i2c.sr = 0U;
+      i2c.start = 0U;
+      i2c.xfer = 0U;
+      i2c.busy = 0U;
+      i2c.txfull = 0U;
+      i2c.rxfull = 0U;
+    }
+  }
+  else if(offset == offsetof(I2C_TypeDef, CR2))
+  {
+    if((value & I2C_CR2_START) != 0U)
+    {
+      i2c.start = 1U;
+      i2c.xfer = 0U;
+      i2c.sr &= ~(I2C_ISR_TC | I2C_ISR_TCR);
+    }
+    else if(((value & I2C_CR2_STOP) != 0U) && (i2c.busy != 0U))
+    {
+      i2c_stop();
+      host_mmio_set(m, offset, value & ~I2C_CR2_STOP);
+    }
+    else if(((i2c.sr & I2C_ISR_TCR) != 0U) && ((value & I2C_CR2_NBYTES) != 0U))
+    {
+      /* Reload: the transfer goes on without a start */
+      i2c.remaining = (value & I2C_CR2_NBYTES) >> I2C_CR2_NBYTES_Pos;
+      i2c.sr &= ~I2C_ISR_TCR;
+    }
+  }
+  else if(offset == offsetof(I2C_TypeDef, ISR))
+  {
+    /* Writing TXE flushes TXDR */
+    if((value & I2C_ISR_TXE) != 0U)
+    {
+      i2c.txfull = 0U;
+    }
+  }
+  else if(offset == offsetof(I2C_TypeDef, ICR))
+  {
+    i2c.sr &= ~(value & (I2C_ISR_ADDR | I2C_ISR_NACKF | I2C_ISR_STOPF |
+                         I2C_ISR_BERR | I2C_ISR_ARLO | I2C_ISR_OVR));
+    host_mmio_set(m, offset, 0U);
+  }
+  else if(offset == offsetof(I2C_TypeDef, TXDR))
+  {
+    i2c.txdr = (uint8_t)value;
+    i2c.txfull = 1U;
+  }
+  i2c_irq_update();
+}
+
+/* One bus event, if the transfer can make progress */
+static void i2c_clock(void)
+{
+  uint32_t cr2 = i2c_reg(offsetof(I2C_TypeDef, CR2));
+  uint32_t addr = (cr2 & I2C_CR2_SADD) >> 1;
+  uint32_t b;
+
+  if((i2c_reg(offsetof(I2C_TypeDef, CR1)) & I2C_CR1_PE) == 0U)
+  {
+    return;
+  }
+  if(i2c.start != 0U)
+  {
+    /* A START waits for SDA */
+    if(dev.hold != 0U)
+    {
+      return;
+    }
+    i2c.start = 0U;
+    i2c.read = ((cr2 & I2C_CR2_RD_WRN) != 0U) ? 1U : 0U;
+    host_mmio_set(&i2c_m, offsetof(I2C_TypeDef, CR2), cr2 & ~I2C_CR2_START);
+    b = (addr == DEV) && (dev.nack == 0U);
+    wire_log((i2c.busy != 0U) ? W_RESTART : W_START, (addr << 1) | i2c.read, b);
+    i2c.busy = 1U;
+    if(b == 0U)
+    {
+      /* NACK, the master sends the STOP itself */
+      if((addr == DEV) && (dev.nack != 0U))
+      {
+        dev.nack--;
+      }
+      i2c.sr |= I2C_ISR_NACKF;
+      i2c_stop();
+    }
+    else
+    {
+      dev.first = (i2c.read == 0U) ? 1U : 0U;
+      i2c.xfer = 1U;
+      i2c.remaining = (cr2 & I2C_CR2_NBYTES) >> I2C_CR2_NBYTES_Pos;
+    }
+    i2c_irq_update();
+    return;
+  }
+  if((i2c.xfer == 0U) || (i2c.remaining == 0U))
+  {
+    return;
+  }
+  /* The master stretches SCL until it has data or room */
+  if(i2c.read == 0U)
+  {
+    if(i2c.txfull == 0U)
+    {
+      return;
+    }
+    b = i2c.txdr;
+    i2c.txfull = 0U;
+    if(dev.first != 0U)
+    {
+      dev.ptr = (uint8_t)b;
+      dev.first = 0U;
+    }
+    else
+    {
+      dev.mem[dev.ptr++] = (uint8_t)b;
+    }
+    wire_log(W_OUT, b, 1U);
+  }
+  else
+  {
+    if(i2c.rxfull != 0U)
+    {
+      return;
+    }
+    b = dev.mem[dev.ptr++];
+    i2c.rxdr = (uint8_t)b;
+    i2c.rxfull = 1U;
+    wire_log(W_IN, b, 1U);
+  }
+
+  if((i2c.berr_at != 0U) && (--i2c.berr_at == 0U))
+  {
+    /* Misplaced START or STOP: the transfer is lost, the bus stays busy */
+    i2c.sr |= I2C_ISR_BERR;
+    i2c.xfer = 0U;
+  }
+  else if(--i2c.remaining == 0U)
+  {
+    if((cr2 & I2C_CR2_RELOAD) != 0U)
+    {
+      i2c.sr |= I2C_ISR_TCR;
+    }
+    else if((cr2 & I2C_CR2_AUTOEND) != 0U)
+    {
+      i2c_stop();
+    }
+    else
+    {
+      i2c.sr |= I2C_ISR_TC;
+    }
+  }
+  i2c_irq_update();
+}
+
+/* SCL and SDA driven by the port */
+static uint32_t port_outputs(uint32_t moder)
+{
+  return ((((moder >> 16) & 3U) == PIN_MODE_OUTPUT) ? SCL : 0U) |
+         ((((moder >> 18) & 3U) == PIN_MODE_OUTPUT) ? SDA : 0U);
+}
+
+/* The lines are pulled up; the port or the target pull them low */
+static uint32_t port_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  uint32_t low;
+
+  if(offset != offsetof(GPIO_TypeDef, IDR))
+  {
+    return current;
+  }
+  low = port_outputs(host_mmio_get(m, offsetof(GPIO_TypeDef, MODER))) &
+        ~host_mmio_get(m, offsetof(GPIO_TypeDef, ODR));
+  low |= (dev.hold != 0U) ? SDA : 0U;
+  return (current & ~(SCL | SDA)) | (~low & (SCL | SDA));
+}
+
+static void port_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  uint32_t odr = host_mmio_get(m, offsetof(GPIO_TypeDef, ODR));
+  uint32_t out = port_outputs(host_mmio_get(m, offsetof(GPIO_TypeDef, MODER)));
+  uint32_t now;
+
+  (void)size;
+  if(offset == offsetof(GPIO_TypeDef, BSRR))
+  {
+    now = (odr & ~(value >> 16)) | (value & 0xFFFFU);
+    host_mmio_set(m, offsetof(GPIO_TypeDef, ODR), now);
+    host_mmio_set(m, offset, 0U);
+    if((out != 0U) && (((odr ^ now) & (SCL | SDA)) != 0U))
+    {
+      if(edge_n < EDGE_MAX)
+      {
+        edges[edge_n].t = now_us;
+        edges[edge_n].level = now & (SCL | SDA);
+      }
+      edge_n++;
+      /* A target stuck in a read shifts a bit out per SCL pulse */
+      if(((~odr & now & SCL) != 0U) && (dev.hold != 0U) && (dev.hold != HOLD_FOREVER))
+      {
+        dev.hold--;
+      }
+    }
+  }
+  else if(offset == offsetof(GPIO_TypeDef, MODER))
+  {
+    /* The pins may only start driving as open-drain high */
+    out = port_outputs(value) & ~out;
+    if((out != 0U) && (((odr & out) != out) ||
+                       ((host_mmio_get(m, offsetof(GPIO_TypeDef, OTYPER)) & out) != out)))
+    {
+      glitches++;
+    }
+  }
+  else if((offset == offsetof(GPIO_TypeDef, PUPDR)) || (offset == offsetof(GPIO_TypeDef, OSPEEDR)) ||
+          (offset == offsetof(GPIO_TypeDef, AFR[0])) || (offset == offsetof(GPIO_TypeDef, AFR[1])))
+  {
+    cfg_writes++;
+  }
+}
+
+static void tim5_isr(void)
+{
+  timebase_alarm_t *a = armed;
+
+  armed = NULL;
+  a->callback(a->context);
+}
+
+/* A microsecond goes by */
+static void idle(void)
+{
+  now_us++;
+  i2c_clock();
+  if((armed != NULL) && (armed->deadline <= now_us))
+  {
+    host_irq_raise(tim5_isr);
+  }
+}
+
+/* Until the scheduler is idle */
+static void run(void)
+{
+  uint32_t n;
+
+  for(n = 0U; (n < RUN_MAX) && (i2c_sched_idle(&s) == 0U); n++)
+  {
+    __WFI();
+  }
+  HOST_CHECK(i2c_sched_idle(&s));
+  HOST_CHECK(armed == NULL);
+}
+
+static void reset_logs(void)
+{
+  wire_n = 0U;
+  edge_n = 0U;
+  done_n = 0U;
+}
+
+static void job_done(i2c_job_t *job)
+{
+  job_t *t = (job_t *)job->context;
+
+  t->order = done_n++;
+  t->done_t = now_us;
+  t->recovering = s.recovering;
+}
+
+static void job_make(job_t *t, uint32_t addr, uint32_t reg, uint32_t len, uint32_t read)
+{
+  uint32_t i;
+
+  memset(t, 0, sizeof(*t));
+  for(i = 0U; i < sizeof(t->data); i++)
+  {
+    t->data[i] = (uint8_t)rnd();
+  }
+  if(read != 0U)
+  {
+    i2c_job_reg_read(&t->j, (uint16_t)addr, (uint16_t)reg, 1U, t->data, (uint16_t)len);
+  }
+  else
+  {
+    i2c_job_reg_write(&t->j, (uint16_t)addr, (uint16_t)reg, 1U, t->data, (uint16_t)len);
+  }
+  t->j.done = job_done;
+  t->j.context = t;
+  t->order = 0xFFFFFFFFU;
+  t->j.status = HAL_BUSY;
+}
+
+/* The wire events of a successful register job start at *w: one START
+   for a write, a repeated start into the read */
+static void check_wire(const job_t *t, uint32_t *w)
+{
+  const i2c_job_t *j = &t->j;
+  uint32_t n = j->seg[1].len + ((j->seg[1].read != 0U) ? 4U : 3U);
+  uint32_t k = *w;
+  uint32_t i;
+
+  if(!HOST_CHECK(k + n <= wire_n))
+  {
+    return;
+  }
+  HOST_CHECK_EQ(wire[k].kind, W_START);
+  HOST_CHECK_EQ(wire[k].value, j->addr << 1);
+  HOST_CHECK_EQ(wire[k].ack, 1U);
+  HOST_CHECK_EQ(wire[k + 1U].kind, W_OUT);
+  HOST_CHECK_EQ(wire[k + 1U].value, j->reg[0]);
+  k += 2U;
+  if(j->seg[1].read != 0U)
+  {
+    HOST_CHECK_EQ(wire[k].kind, W_RESTART);
+    HOST_CHECK_EQ(wire[k].value, (j->addr << 1) | 1U);
+    k++;
+  }
+  for(i = 0U; i < j->seg[1].len; i++, k++)
+  {
+    if(!HOST_CHECK_EQ(wire[k].kind, (j->seg[1].read != 0U) ? W_IN : W_OUT) ||
+       !HOST_CHECK_EQ(wire[k].value, j->seg[1].data[i]))
+    {
+      break;
+    }
+  }
+  HOST_CHECK_EQ(wire[*w + n - 1U].kind, W_STOP);
+  *w += n;
+}
+
+/* The edges of a recovery with pulses SCL pulses: each half period an
+   alarm apart, SDA moving only while SCL is low, then a STOP. Returns the
+   time of the STOP. */
+static uint64_t check_recovery(uint32_t pulses)
+{
+  uint32_t level = SCL | SDA;
+  uint64_t last = 0U;
+  uint32_t rises = 0U;
+  uint32_t i;
+
+  if(!HOST_CHECK_EQ(edge_n, (2U * pulses) + 4U))
+  {
+    return 0U;
+  }
+  for(i = 0U; i < edge_n; i++)
+  {
+    if(((level ^ edges[i].level) & SCL) != 0U)
+    {
+      HOST_CHECK((i == 0U) || (edges[i].t - last >= HALF_US));
+      rises += ((edges[i].level & SCL) != 0U) ? 1U : 0U;
+      last = edges[i].t;
+    }
+    else if((i + 1U) < edge_n)
+    {
+      HOST_CHECK_EQ(edges[i].level & SCL, 0U);
+    }
+    level = edges[i].level;
+  }
+  /* STOP: SDA rises a half period after SCL */
+  HOST_CHECK_EQ(edges[edge_n - 2U].level, SCL);
+  HOST_CHECK_EQ(edges[edge_n - 1U].level, SCL | SDA);
+  HOST_CHECK(edges[edge_n - 1U].t - edges[edge_n - 2U].t >= HALF_US);
+  HOST_CHECK_EQ(rises, pulses + 1U);
+  return edges[edge_n - 1U].t;
+}
+
+static void pins_save(uint32_t *save)
+{
+  save[0] = host_mmio_get(&port, offsetof(GPIO_TypeDef, MODER));
+  save[1] = host_mmio_get(&port, offsetof(GPIO_TypeDef, OTYPER));
+  save[2] = host_mmio_get(&port, offsetof(GPIO_TypeDef, OSPEEDR));
+  save[3] = host_mmio_get(&port, offsetof(GPIO_TypeDef, PUPDR));
+  save[4] = host_mmio_get(&port, offsetof(GPIO_TypeDef, AFR[0]));
+  save[5] = host_mmio_get(&port, offsetof(GPIO_TypeDef, AFR[1]));
+}
+
+/* The pins are back as the application set them, and pull, speed and AF
+   were never touched */
+static void check_pins(const uint32_t *save)
+{
+  uint32_t now[6];
+  uint32_t i;
+
+  pins_save(now);
+  for(i = 0U; i < 6U; i++)
+  {
+    HOST_CHECK_EQ(now[i], save[i]);
+  }
+  HOST_CHECK_EQ(cfg_writes, 0U);
+  HOST_CHECK_EQ(glitches, 0U);
+}
+
+/* Writes and read-backs of random registers, all queued at once */
+static void test_sequence(void)
+{
+  static job_t jobs[JOB_MAX];
+  uint32_t reg;
+  uint32_t len;
+  uint32_t w = 0U;
+  uint32_t i;
+
+  reset_logs();
+  for(i = 0U; i < JOB_MAX; i += 2U)
+  {
+    reg = rnd() & 0xF0U;
+    len = 1U + (rnd() % sizeof(jobs[i].data));
+    job_make(&jobs[i], DEV, reg, len, 0U);
+    job_make(&jobs[i + 1U], DEV, reg, len, 1U);
+    HOST_CHECK_EQ(i2c_sched_submit(&s, &jobs[i].j), HAL_OK);
+    HOST_CHECK_EQ(i2c_sched_submit(&s, &jobs[i + 1U].j), HAL_OK);
+  }
+  run();
+
+  for(i = 0U; i < JOB_MAX; i++)
+  {
+    HOST_CHECK_EQ(jobs[i].order, i);
+    HOST_CHECK_EQ(jobs[i].j.status, HAL_OK);
+    HOST_CHECK_EQ(jobs[i].j.error, HAL_I2C_ERROR_NONE);
+    HOST_CHECK(jobs[i].j.bus_us > 0U);
+    check_wire(&jobs[i], &w);
+  }
+  for(i = 0U; i < JOB_MAX; i += 2U)
+  {
+    HOST_CHECK(memcmp(jobs[i].data, jobs[i + 1U].data, jobs[i].j.seg[1].len) == 0);
+  }
+  /* The last one waited for all the others */
+  HOST_CHECK(jobs[JOB_MAX - 1U].j.wait_us >= jobs[JOB_MAX - 2U].j.bus_us);
+  HOST_CHECK_EQ(wire_n, w);
+  HOST_CHECK_EQ(edge_n, 0U);
+  HOST_CHECK_EQ(s.stats.jobs, JOB_MAX);
+  HOST_CHECK_EQ(s.stats.errors, 0U);
+}
+
+static void test_nack(void)
+{
+  static job_t a;
+  i2c_sched_stats_t st = s.stats;
+  uint32_t w = 4U;
+
+  /* Busy twice, then it answers */
+  reset_logs();
+  job_make(&a, DEV, 0x20U, 3U, 0U);
+  a.j.retries = 3U;
+  dev.nack = 2U;
+  i2c_sched_submit(&s, &a.j);
+  run();
+
+  HOST_CHECK_EQ(a.j.status, HAL_OK);
+  HOST_CHECK_EQ(s.stats.nacks, st.nacks + 2U);
+  HOST_CHECK_EQ(s.stats.retries, st.retries + 2U);
+  HOST_CHECK_EQ(wire[0].ack, 0U);
+  HOST_CHECK_EQ(wire[1].kind, W_STOP);
+  HOST_CHECK_EQ(wire[2].ack, 0U);
+  HOST_CHECK(wire[2].t - wire[1].t >= I2C_SCHED_RETRY_US);
+  HOST_CHECK(wire[4].t - wire[3].t >= I2C_SCHED_RETRY_US);
+  check_wire(&a, &w);
+  HOST_CHECK_EQ(wire_n, w);
+
+  /* Busy for longer than the retries */
+  reset_logs();
+  job_make(&a, DEV, 0x20U, 3U, 1U);
+  a.j.retries = 1U;
+  dev.nack = 5U;
+  i2c_sched_submit(&s, &a.j);
+  run();
+  dev.nack = 0U;
+
+  HOST_CHECK_EQ(a.j.status, HAL_ERROR);
+  HOST_CHECK_EQ(a.j.error, HAL_I2C_ERROR_AF);
+  HOST_CHECK_EQ(wire_n, 4U);
+
+  /* Nobody there; a NACK leaves the bus as it is */
+  job_make(&a, NO_DEV, 0x00U, 1U, 1U);
+  i2c_sched_submit(&s, &a.j);
+  run();
+
+  HOST_CHECK_EQ(a.j.status, HAL_ERROR);
+  HOST_CHECK_EQ(a.j.error, HAL_I2C_ERROR_AF);
+  HOST_CHECK_EQ(s.stats.recoveries, st.recoveries);
+  HOST_CHECK_EQ(edge_n, 0U);
+}
+
+/* A target left in a read holds SDA: the job times out, the bus is clocked
+   free from the alarms and the next job waits for it */
+static void test_timeout(void)
+{
+  static job_t a;
+  static job_t b;
+  uint32_t recoveries = s.stats.recoveries;
+  uint32_t save[6];
+  uint64_t t0 = now_us;
+  uint64_t stop;
+  uint32_t w = 0U;
+
+  reset_logs();
+  pins_save(save);
+  dev.hold = 3U;
+  job_make(&a, DEV, 0x30U, 2U, 1U);
+  job_make(&b, DEV, 0x30U, 2U, 0U);
+  i2c_sched_submit(&s, &a.j);
+  i2c_sched_submit(&s, &b.j);
+  run();
+
+  HOST_CHECK_EQ(a.j.status, HAL_TIMEOUT);
+  HOST_CHECK((a.j.error & HAL_I2C_ERROR_TIMEOUT) != 0U);
+  HOST_CHECK(a.done_t - t0 >= I2C_SCHED_TIMEOUT_US);
+  /* Reported before the recovery */
+  HOST_CHECK_EQ(a.recovering, 1U);
+  HOST_CHECK(a.done_t <= edges[0].t);
+  HOST_CHECK_EQ(s.stats.recoveries, recoveries + 1U);
+  HOST_CHECK_EQ(s.stats.stuck, 0U);
+  stop = check_recovery(3U);
+  HOST_CHECK(stop - edges[0].t >= 9U * HALF_US);
+  check_pins(save);
+
+  HOST_CHECK_EQ(b.j.status, HAL_OK);
+  HOST_CHECK_EQ(b.order, a.order + 1U);
+  check_wire(&b, &w);
+  HOST_CHECK_EQ(wire_n, w);
+  HOST_CHECK(wire[0].t > stop);
+}
+
+/* A bus error in the middle of a write */
+static void test_bus_error(void)
+{
+  static job_t a;
+  static job_t b;
+  uint32_t recoveries = s.stats.recoveries;
+  uint32_t save[6];
+  uint64_t stop;
+  uint32_t w;
+
+  reset_logs();
+  pins_save(save);
+  job_make(&a, DEV, 0x40U, 4U, 0U);
+  job_make(&b, DEV, 0x40U, 4U, 1U);
+  i2c.berr_at = 3U;
+  i2c_sched_submit(&s, &a.j);
+  i2c_sched_submit(&s, &b.j);
+  run();
+
+  HOST_CHECK_EQ(a.j.status, HAL_ERROR);
+  HOST_CHECK((a.j.error & HAL_I2C_ERROR_BERR) != 0U);
+  HOST_CHECK_EQ(a.recovering, 1U);
+  HOST_CHECK_EQ(s.stats.recoveries, recoveries + 1U);
+  stop = check_recovery(0U);
+  check_pins(save);
+
+  /* START, register, two data bytes; then b after the recovery */
+  HOST_CHECK_EQ(b.j.status, HAL_OK);
+  w = 4U;
+  HOST_CHECK(wire[w].t > stop);
+  check_wire(&b, &w);
+  HOST_CHECK_EQ(wire_n, w);
+  HOST_CHECK(memcmp(b.data, a.data, 2U) == 0);
+}
+
+static void test_recover(void)
+{
+  static job_t a;
+  i2c_sched_stats_t st = s.stats;
+  uint32_t save[6];
+  uint64_t stop;
+  uint32_t w = 0U;
+
+  /* On request, on a free bus; a job submitted meanwhile waits */
+  reset_logs();
+  pins_save(save);
+  HOST_CHECK_EQ(i2c_sched_recover(&s), HAL_OK);
+  HOST_CHECK_EQ(i2c_sched_recover(&s), HAL_BUSY);
+  HOST_CHECK(!i2c_sched_idle(&s));
+  job_make(&a, DEV, 0x50U, 2U, 1U);
+  i2c_sched_submit(&s, &a.j);
+  HOST_CHECK_EQ(wire_n, 0U);
+  run();
+
+  HOST_CHECK_EQ(s.stats.recoveries, st.recoveries + 1U);
+  HOST_CHECK_EQ(s.stats.stuck, st.stuck);
+  stop = check_recovery(0U);
+  check_pins(save);
+  HOST_CHECK_EQ(a.j.status, HAL_OK);
+  check_wire(&a, &w);
+  HOST_CHECK(wire[0].t > stop);
+
+  /* Not while a job runs */
+  job_make(&a, DEV, 0x50U, 2U, 1U);
+  i2c_sched_submit(&s, &a.j);
+  HOST_CHECK_EQ(i2c_sched_recover(&s), HAL_BUSY);
+  run();
+  HOST_CHECK_EQ(s.stats.recoveries, st.recoveries + 1U);
+
+  /* SDA never lets go: nine pulses, a STOP, and it counts as stuck */
+  reset_logs();
+  dev.hold = HOLD_FOREVER;
+  HOST_CHECK_EQ(i2c_sched_recover(&s), HAL_OK);
+  run();
+  dev.hold = 0U;
+
+  HOST_CHECK_EQ(s.stats.recoveries, st.recoveries + 2U);
+  HOST_CHECK_EQ(s.stats.stuck, st.stuck + 1U);
+  check_recovery(9U);
+  check_pins(save);
+}
+
+static void test_other(void)
+{
+  uint32_t jobs = s.stats.jobs;
+
+  /* Nothing so far went past the scheduler */
+  HOST_CHECK_EQ(other_n, 0U);
+
+  HAL_I2C_MasterTxCpltCallback(&hi2c_other);
+  HOST_CHECK_EQ(other_n, 1U);
+  HOST_CHECK(other_hi2c == &hi2c_other);
+  HOST_CHECK_EQ(other_event, I2C_SCHED_MASTER_TX_CPLT);
+  HAL_I2C_MasterRxCpltCallback(&hi2c_other);
+  HOST_CHECK_EQ(other_event, I2C_SCHED_MASTER_RX_CPLT);
+  HAL_I2C_ErrorCallback(&hi2c_other);
+  HOST_CHECK_EQ(other_event, I2C_SCHED_ERROR);
+  HOST_CHECK_EQ(other_n, 3U);
+
+  /* Stray callbacks of the scheduler's I2C with nothing running */
+  HAL_I2C_MasterTxCpltCallback(&hi2c);
+  HAL_I2C_ErrorCallback(&hi2c);
+  HOST_CHECK_EQ(other_n, 3U);
+  HOST_CHECK_EQ(s.stats.jobs, jobs);
+
+  HOST_CHECK_EQ(i2c_sched_submit(&s, &(i2c_job_t){.count = 0U}), HAL_ERROR);
+  HOST_CHECK_EQ(i2c_sched_submit(&s, &(i2c_job_t){.count = 1U}), HAL_ERROR);
+  HOST_CHECK_EQ(i2c_sched_submit(&s, &(i2c_job_t){.count = I2C_JOB_MAX_SEGS + 1U}), HAL_ERROR);
+}
+
+/* Function definitions ------------------------------------------------------*/
+/* The timebase, one alarm at a time is all the scheduler needs */
+uint64_t timebase_us(void)
+{
+  return now_us;
+}
+
+uint32_t timebase_elapsed_us(uint64_t since)
+{
+  return (uint32_t)(now_us - since);
+}
+
+void timebase_alarm_start_in(timebase_alarm_t *alarm, uint32_t delay_us,
+                             timebase_callback_t callback, void *context)
+{
+  HOST_CHECK((armed == NULL) || (armed == alarm));
+  alarm->deadline = now_us + delay_us;
+  alarm->callback = callback;
+  alarm->context = context;
+  armed = alarm;
+}
+
+void timebase_alarm_cancel(timebase_alarm_t *alarm)
+{
+  if(armed == alarm)
+  {
+    armed = NULL;
+  }
+}
+
+void i2c_sched_other_callback(I2C_HandleTypeDef *h, uint32_t event)
+{
+  other_n++;
+  other_hi2c = h;
+  other_event = event;
+}
+
+int main(void)
+{
+  i2c_m.base = I2C1_BASE;
+  i2c_m.size = sizeof(I2C_TypeDef);
+  i2c_m.read = i2c_read;
+  i2c_m.write = i2c_write;
+  host_mmio_attach(&i2c_m);
+  port.base = GPIOB_BASE;
+  port.size = sizeof(GPIO_TypeDef);
+  port.read = port_read;
+  port.write = port_write;
+  host_mmio_attach(&port);
+  /* As the application sets the bus up: AF4 open-drain with pull-ups, very
+     high speed; PB0 a push-pull and PB1 an open-drain output */
+  host_mmio_set(&port, offsetof(GPIO_TypeDef, MODER), 0xFFFAFFF5U);
+  host_mmio_set(&port, offsetof(GPIO_TypeDef, OTYPER), SCL | SDA | PIN_BIT(1));
+  host_mmio_set(&port, offsetof(GPIO_TypeDef, OSPEEDR), 0x000F0000U);
+  host_mmio_set(&port, offsetof(GPIO_TypeDef, PUPDR), 0x00050000U);
+  host_mmio_set(&port, offsetof(GPIO_TypeDef, AFR[1]), 0x00000044U);
+  host_set_idle(idle);
+
+  hi2c.Instance = I2C1;
+  hi2c.Init.Timing = 0x10C0ECFFU;
+  hi2c.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
+  hi2c.Init.DualAddressMode = I2C_DUALADDRESS_DISABLE;
+  hi2c.Init.GeneralCallMode = I2C_GENERALCALL_DISABLE;
+  hi2c.Init.NoStretchMode = I2C_NOSTRETCH_DISABLE;
+  hi2c_other.Instance = I2C2;
+  HOST_CHECK_EQ(HAL_I2C_Init(&hi2c), HAL_OK);
+  s.hi2c = &hi2c;
+  s.scl_port = GPIOB;
+  s.scl_mask = SCL;
+  s.sda_port = GPIOB;
+  s.sda_mask = SDA;
+  s.af = GPIO_AF4_I2C1;
+  HOST_CHECK_EQ(i2c_sched_init(&s), HAL_OK);
+
+  test_sequence();
+  test_nack();
+  test_timeout();
+  test_bus_error();
+  test_recover();
+  test_other();
+
+  host_mmio_detach(&port);
+  host_mmio_detach(&i2c_m);
+  return host_result();
+}
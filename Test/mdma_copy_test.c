@@ -0,0 +1,560 @@
+/* Header includes -----------------------------------------------------------*/
+/* The node builder is private: test it from inside */
+#include "mdma_copy.c"
+#include <stdlib.h>
+
+/* mdma_copy: the register images mdma_copy_build() makes (data size,
+   bursts, the 64 KB split of plain operations, 2D block repeats and the
+   range checks), run through a model of the MDMA linked list transfer and
+   compared with a copy done by hand; then whole jobs through the driver
+   on an MDMA channel model that raises the interrupt. */
+
+/* Private macro -------------------------------------------------------------*/
+/* AXI SRAM, where the MDMA reaches and the driver wants its nodes */
+#define SRAM                    0x24000000U
+#define SRAM_SIZE               0x80000U
+#define SRC                     (SRAM)
+#define DST                     (SRAM + 0x40000U)
+#define AREA                    0x30000U
+#define MARGIN                  64U
+#define OPS                     ((mdma_copy_op_t *)(SRAM + 0x7F000U))
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t seed = 0x13579BDFU;
+
+/* MDMA channel 0: SWRQ runs the list, CIFCR clears CISR */
+static host_mmio_t chan;
+static volatile uint32_t chan_error;
+static volatile uint32_t chan_runs;
+
+static volatile uint32_t done_order[8];
+static volatile uint32_t done_count;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static uint8_t *at(uint32_t addr)
+{
+  return (uint8_t *)(uintptr_t)addr;
+}
+
+static void area_fill(uint32_t base, uint32_t len)
+{
+  uint32_t i;
+
+  for(i = 0U; i < len; i++)
+  {
+    at(base)[i] = (uint8_t)rnd();
+  }
+}
+
+/* The transfer the nodes describe, one data item at a time: BNDT bytes a
+   block, BRC more blocks with the CBRUR updates added after each, then the
+   node at CLAR. Checks what the hardware would refuse or split. */
+static void mdma_run(const MDMA_LinkNodeTypeDef *n)
+{
+  while(n != NULL)
+  {
+    uint32_t ssize = (n->CTCR & MDMA_CTCR_SSIZE) >> MDMA_CTCR_SSIZE_Pos;
+    uint32_t size = 1UL << ssize;
+    uint32_t sinc = n->CTCR & MDMA_CTCR_SINC;
+    uint32_t bndt = n->CBNDTR & MDMA_CBNDTR_BNDT;
+    uint32_t brc = (n->CBNDTR & MDMA_CBNDTR_BRC) >> MDMA_CBNDTR_BRC_Pos;
+    uint32_t burst = (MDMA_COPY_BURST << ssize) - 1U;
+    uint32_t s = n->CSAR;
+    uint32_t d = n->CDAR;
+    uint32_t b;
+    uint32_t k;
+
+    HOST_CHECK_EQ((n->CTCR & MDMA_CTCR_DSIZE) >> MDMA_CTCR_DSIZE_Pos, ssize);
+    HOST_CHECK_EQ((n->CTCR & MDMA_CTCR_DINCOS) >> MDMA_CTCR_DINCOS_Pos, ssize);
+    HOST_CHECK_EQ(n->CTCR & MDMA_CTCR_DINC, MDMA_CTCR_DINC_1);
+    HOST_CHECK((sinc == 0U) || (sinc == MDMA_CTCR_SINC_1));
+    HOST_CHECK((sinc == 0U) || (((n->CTCR & MDMA_CTCR_SINCOS) >> MDMA_CTCR_SINCOS_Pos) == ssize));
+    HOST_CHECK_EQ(n->CTCR & (MDMA_CTCR_TRGM | MDMA_CTCR_SWRM), MDMA_FULL_TRANSFER | MDMA_CTCR_SWRM);
+    HOST_CHECK((bndt != 0U) && ((bndt & (size - 1U)) == 0U));
+    HOST_CHECK((n->CBNDTR & (MDMA_CBNDTR_BRSUM | MDMA_CBNDTR_BRDUM)) == 0U);
+    for(b = 0U; b <= brc; b++)
+    {
+      /* A burst from a block start stays inside a 1 KB boundary */
+      if((n->CTCR & MDMA_CTCR_SBURST) != 0U)
+      {
+        HOST_CHECK_EQ(s & burst, 0U);
+      }
+      if((n->CTCR & MDMA_CTCR_DBURST) != 0U)
+      {
+        HOST_CHECK_EQ(d & burst, 0U);
+      }
+      for(k = 0U; k < bndt; k += size)
+      {
+        HOST_CHECK_EQ((s | d) & (size - 1U), 0U);
+        memcpy(at(d), at(s), size);
+        s += (sinc != 0U) ? size : 0U;
+        d += size;
+      }
+      s += n->CBRUR & MDMA_CBRUR_SUV;
+      d += (n->CBRUR & MDMA_CBRUR_DUV) >> MDMA_CBRUR_DUV_Pos;
+    }
+    n = (n->CLAR != 0U) ? (const MDMA_LinkNodeTypeDef *)(uintptr_t)n->CLAR : NULL;
+  }
+}
+
+/* What the operation should leave in [lo, lo + len), done by hand over a
+   copy of it */
+static void expect(uint8_t *want, uint32_t lo, const mdma_copy_op_t *op, uint32_t len)
+{
+  uint32_t r;
+  uint32_t i;
+
+  memcpy(want, at(lo), len);
+  for(r = 0U; r < op->rows; r++)
+  {
+    for(i = 0U; i < op->width; i++)
+    {
+      want[((uint32_t)op->dst - lo) + (r * op->dst_pitch) + i] =
+        (op->src != NULL) ? ((const uint8_t *)op->src)[(r * op->src_pitch) + i] : (uint8_t)op->fill[0];
+    }
+  }
+}
+
+/* Build op, run it and compare the destination with a margin either side */
+static void check_run(mdma_copy_op_t *op)
+{
+  static uint8_t want[AREA];
+  uint32_t lo = (uint32_t)op->dst - MARGIN;
+  uint32_t len = mdma_copy_span(op->dst_pitch, op) + (2U * MARGIN);
+
+  area_fill(lo, len);
+  expect(want, lo, op, len);
+  if(HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_OK))
+  {
+    mdma_run(op->node);
+    HOST_CHECK(memcmp(want, at(lo), len) == 0);
+  }
+}
+
+/* Data size the widest that divides everything, bursts on both sides iff
+   both addresses start on a 16-beat boundary */
+static void check_size(const mdma_copy_op_t *op, uint32_t lg, uint32_t burst)
+{
+  uint32_t ctcr = op->node[0].CTCR;
+
+  HOST_CHECK_EQ((ctcr & MDMA_CTCR_SSIZE) >> MDMA_CTCR_SSIZE_Pos, lg);
+  HOST_CHECK_EQ((ctcr & MDMA_CTCR_DSIZE) >> MDMA_CTCR_DSIZE_Pos, lg);
+  HOST_CHECK_EQ(ctcr & MDMA_CTCR_DBURST, (burst != 0U) ? MDMA_DEST_BURST_16BEATS : 0U);
+  HOST_CHECK_EQ(ctcr & MDMA_CTCR_SBURST, ((burst != 0U) && (op->src != NULL)) ? MDMA_SOURCE_BURST_16BEATS : 0U);
+  HOST_CHECK_EQ(ctcr & MDMA_CTCR_SINC, (op->src != NULL) ? MDMA_CTCR_SINC_1 : 0U);
+}
+
+static uint32_t lg_of(uint32_t a)
+{
+  return ((a & 7U) == 0U) ? 3U : ((a & 3U) == 0U) ? 2U : ((a & 1U) == 0U) ? 1U : 0U;
+}
+
+static void test_size_burst(void)
+{
+  static const uint32_t widths[] = {1U, 2U, 3U, 4U, 6U, 8U, 12U, 16U, 100U, 128U, 256U, 1000U, 1024U};
+  mdma_copy_op_t *op = OPS;
+  uint32_t so;
+  uint32_t d0;
+  uint32_t w;
+  uint32_t lg;
+
+  area_fill(SRC, 0x2000U);
+  for(so = 0U; so < 9U; so++)
+  {
+    for(d0 = 0U; d0 < 9U; d0++)
+    {
+      for(w = 0U; w < (sizeof(widths) / sizeof(widths[0])); w++)
+      {
+        uint32_t src = SRC + 0x100U + ((so == 8U) ? 0x80U : so);
+        uint32_t dst = DST + 0x100U + ((d0 == 8U) ? 0x80U : d0);
+
+        lg = lg_of(src | dst | widths[w]);
+        mdma_copy_op(op, at(dst), at(src), widths[w]);
+        check_run(op);
+        check_size(op, lg, ((src | dst) & ((16UL << lg) - 1U)) == 0U);
+        HOST_CHECK_EQ(op->node[0].CBNDTR, widths[w]);
+        HOST_CHECK_EQ(op->node[0].CBRUR, 0U);
+
+        lg = lg_of(dst | widths[w]);
+        mdma_copy_op_fill(op, at(dst), (uint8_t)rnd(), widths[w]);
+        check_run(op);
+        /* The pattern is 8-byte aligned and read in place: only dst and
+           the length count */
+        check_size(op, lg, (dst & ((16UL << lg) - 1U)) == 0U);
+      }
+    }
+  }
+
+  /* A pitch narrows the data size like an address does */
+  mdma_copy_op_2d(op, at(DST + 0x100U), 12U, at(SRC + 0x100U), 16U, 8U, 9U);
+  check_run(op);
+  check_size(op, 2U, 0U);
+  mdma_copy_op_2d(op, at(DST + 0x800U), 256U, at(SRC + 0x400U), 128U, 128U, 4U);
+  check_run(op);
+  check_size(op, 3U, 1U);
+  mdma_copy_op_2d(op, at(DST + 0x800U), 258U, at(SRC + 0x400U), 128U, 128U, 4U);
+  check_run(op);
+  check_size(op, 1U, 0U);
+
+  /* TCM on either side goes over the AHBS port */
+  mdma_copy_op(op, (void *)0x20000100U, at(SRC), 64U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_OK);
+  HOST_CHECK_EQ(op->node[0].CTBR, MDMA_CTBR_DBUS);
+  mdma_copy_op(op, at(DST), (const void *)0x00000400U, 64U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_OK);
+  HOST_CHECK_EQ(op->node[0].CTBR, MDMA_CTBR_SBUS);
+  mdma_copy_op(op, at(DST), at(SRC), 64U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_OK);
+  HOST_CHECK_EQ(op->node[0].CTBR, 0U);
+}
+
+/* Plain operations: one block up to 64 KB, then BRC repeats of 64 KB and
+   the rest in the second node */
+static void check_split(mdma_copy_op_t *op, uint32_t link)
+{
+  uint32_t len = op->width;
+  uint32_t blocks = len / MDMA_COPY_ROW_MAX;
+  uint32_t rest = len % MDMA_COPY_ROW_MAX;
+  const MDMA_LinkNodeTypeDef *n = op->node;
+  uint32_t src = (op->src != NULL) ? (uint32_t)op->src : (uint32_t)op->fill;
+
+  HOST_CHECK_EQ(n[0].CSAR, src);
+  HOST_CHECK_EQ(n[0].CDAR, (uint32_t)op->dst);
+  HOST_CHECK_EQ(n[0].CBRUR, 0U);
+  if(blocks == 0U)
+  {
+    HOST_CHECK_EQ(n[0].CBNDTR, len);
+    HOST_CHECK_EQ(n[0].CLAR, link);
+    return;
+  }
+  HOST_CHECK_EQ(n[0].CBNDTR & MDMA_CBNDTR_BNDT, MDMA_COPY_ROW_MAX);
+  HOST_CHECK_EQ((n[0].CBNDTR & MDMA_CBNDTR_BRC) >> MDMA_CBNDTR_BRC_Pos, blocks - 1U);
+  if(rest == 0U)
+  {
+    HOST_CHECK_EQ(n[0].CLAR, link);
+    return;
+  }
+  HOST_CHECK_EQ(n[0].CLAR, (uint32_t)&n[1]);
+  HOST_CHECK_EQ(n[1].CTCR, n[0].CTCR);
+  HOST_CHECK_EQ(n[1].CTBR, n[0].CTBR);
+  HOST_CHECK_EQ(n[1].CBNDTR, rest);
+  HOST_CHECK_EQ(n[1].CBRUR, 0U);
+  HOST_CHECK_EQ(n[1].CSAR, (op->src != NULL) ? (src + (blocks * MDMA_COPY_ROW_MAX)) : src);
+  HOST_CHECK_EQ(n[1].CDAR, (uint32_t)op->dst + (blocks * MDMA_COPY_ROW_MAX));
+  HOST_CHECK_EQ(n[1].CLAR, link);
+}
+
+static void test_split(void)
+{
+  static const uint32_t lens[] = {65535U, 65536U, 65537U, 131071U, 131072U, 131072U + 100U, 3U * 65536U - 8U};
+  mdma_copy_op_t *op = OPS;
+  uint32_t i;
+  uint32_t k;
+
+  area_fill(SRC, 0x40000U);
+  for(i = 0U; i < (sizeof(lens) / sizeof(lens[0])); i++)
+  {
+    for(k = 0U; k < 3U; k++)
+    {
+      uint32_t off = (k == 0U) ? 0U : (k == 1U) ? 4U : 1U;
+
+      mdma_copy_op(op, at(DST + off), at(SRC + off), lens[i]);
+      check_run(op);
+      check_split(op, 0U);
+      HOST_CHECK_EQ((op->node[0].CTCR & MDMA_CTCR_SSIZE) >> MDMA_CTCR_SSIZE_Pos, lg_of(off | lens[i]));
+
+      mdma_copy_op_fill(op, at(DST + off), (uint8_t)rnd(), lens[i]);
+      check_run(op);
+      check_split(op, 0U);
+    }
+  }
+
+  /* The link goes on the last node */
+  mdma_copy_op(op, at(DST), at(SRC), 65536U + 16U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0x24012340U), HAL_OK);
+  check_split(op, 0x24012340U);
+  mdma_copy_op(op, at(DST), at(SRC), 2U * 65536U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0x24012340U), HAL_OK);
+  check_split(op, 0x24012340U);
+
+  /* Up to 4096 blocks and a rest; built only, the MDMA reaches 256 MB */
+  mdma_copy_op(op, at(DST), at(SRC), (MDMA_COPY_ROWS_MAX * MDMA_COPY_ROW_MAX) + 1U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_OK);
+  check_split(op, 0U);
+  mdma_copy_op(op, at(DST), at(SRC), MDMA_COPY_ROWS_MAX * MDMA_COPY_ROW_MAX);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_OK);
+  check_split(op, 0U);
+  mdma_copy_op(op, at(DST), at(SRC), (MDMA_COPY_ROWS_MAX + 1U) * MDMA_COPY_ROW_MAX);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_ERROR);
+  mdma_copy_op(op, at(DST), at(SRC), 0U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_ERROR);
+}
+
+static void check_2d(mdma_copy_op_t *op)
+{
+  const MDMA_LinkNodeTypeDef *n = op->node;
+
+  HOST_CHECK_EQ(n[0].CBNDTR & MDMA_CBNDTR_BNDT, op->width & MDMA_CBNDTR_BNDT);
+  HOST_CHECK_EQ((n[0].CBNDTR & MDMA_CBNDTR_BRC) >> MDMA_CBNDTR_BRC_Pos, op->rows - 1U);
+  HOST_CHECK_EQ(n[0].CBRUR & MDMA_CBRUR_SUV, (op->src != NULL) ? (op->src_pitch - op->width) : 0U);
+  HOST_CHECK_EQ((n[0].CBRUR & MDMA_CBRUR_DUV) >> MDMA_CBRUR_DUV_Pos, op->dst_pitch - op->width);
+  HOST_CHECK_EQ(n[0].CLAR, 0U);
+}
+
+static void test_2d(void)
+{
+  mdma_copy_op_t *op = OPS;
+  uint32_t i;
+
+  area_fill(SRC, 0x40000U);
+  for(i = 0U; i < 400U; i++)
+  {
+    uint32_t width = 1U + (rnd() % 300U);
+    uint32_t rows = 2U + (rnd() % 40U);
+    uint32_t dpitch = width + (((i & 3U) == 0U) ? 0U : (rnd() % 200U));
+    uint32_t spitch = width + (((i & 7U) == 1U) ? 0U : (rnd() % 200U));
+    uint32_t so = (i & 4U) ? (rnd() & 7U) : 0U;
+    uint32_t d0 = (i & 8U) ? (rnd() & 7U) : 0U;
+
+    if((i & 16U) != 0U)
+    {
+      /* Widths and pitches that allow words and bursts */
+      width = (width + 7U) & ~7U;
+      dpitch = (dpitch + 127U) & ~127U;
+      spitch = (spitch + 127U) & ~127U;
+    }
+    mdma_copy_op_2d(op, at(DST + d0), dpitch, at(SRC + so), spitch, width, rows);
+    check_run(op);
+    check_2d(op);
+    check_size(op, lg_of(so | d0 | width | dpitch | spitch), ((so | d0 | dpitch | spitch) & ((16UL << lg_of(so | d0 | width | dpitch | spitch)) - 1U)) == 0U);
+
+    mdma_copy_op_2d(op, at(DST + d0), dpitch, NULL, 0U, width, rows);
+    op->fill[0] = (uint8_t)rnd() * 0x01010101U;
+    op->fill[1] = op->fill[0];
+    check_run(op);
+    check_2d(op);
+  }
+
+  /* Bounds: a 64 KB row, 4096 rows, 65535-byte gaps; one past each fails */
+  mdma_copy_op_2d(op, at(DST), 65536U + 65535U, at(SRC), 65536U + 65535U, 65536U, 2U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_OK);
+  check_2d(op);
+  HOST_CHECK_EQ(op->node[0].CBRUR, 0xFFFFFFFFU);
+  mdma_copy_op_2d(op, at(DST), 16U, at(SRC), 16U, 16U, MDMA_COPY_ROWS_MAX);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_OK);
+  check_2d(op);
+  mdma_copy_op_2d(op, at(DST), 65536U + 65536U, at(SRC), 65536U, 65536U, 2U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_ERROR);
+  mdma_copy_op_2d(op, at(DST), 65536U, at(SRC), 65536U + 65536U, 65536U, 2U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_ERROR);
+  mdma_copy_op_2d(op, at(DST), 65537U, at(SRC), 65537U, 65537U, 2U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_ERROR);
+  mdma_copy_op_2d(op, at(DST), 16U, at(SRC), 16U, 16U, MDMA_COPY_ROWS_MAX + 1U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_ERROR);
+  mdma_copy_op_2d(op, at(DST), 15U, at(SRC), 16U, 16U, 2U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_ERROR);
+  mdma_copy_op_2d(op, at(DST), 16U, at(SRC), 15U, 16U, 2U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_ERROR);
+  mdma_copy_op_2d(op, at(DST), 16U, at(SRC), 16U, 0U, 2U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_ERROR);
+  mdma_copy_op_2d(op, at(DST), 16U, at(SRC), 16U, 16U, 0U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_ERROR);
+  /* A fill has no source pitch to check */
+  mdma_copy_op_2d(op, at(DST), 16U, NULL, 0U, 16U, 2U);
+  HOST_CHECK_EQ(mdma_copy_build(op, 0U), HAL_OK);
+}
+
+static void chan_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  MDMA_LinkNodeTypeDef first;
+  uint32_t isr;
+
+  (void)size;
+  if(offset == offsetof(MDMA_Channel_TypeDef, CIFCR))
+  {
+    isr = host_mmio_get(m, offsetof(MDMA_Channel_TypeDef, CISR));
+    host_mmio_set(m, offsetof(MDMA_Channel_TypeDef, CISR), isr & ~value);
+  }
+  else if((offset == offsetof(MDMA_Channel_TypeDef, CCR)) &&
+          ((value & (MDMA_CCR_EN | MDMA_CCR_SWRQ)) == (MDMA_CCR_EN | MDMA_CCR_SWRQ)))
+  {
+    /* The whole list at once, from the first node in the registers */
+    chan_runs++;
+    first.CTCR = host_mmio_get(m, offsetof(MDMA_Channel_TypeDef, CTCR));
+    first.CBNDTR = host_mmio_get(m, offsetof(MDMA_Channel_TypeDef, CBNDTR));
+    first.CSAR = host_mmio_get(m, offsetof(MDMA_Channel_TypeDef, CSAR));
+    first.CDAR = host_mmio_get(m, offsetof(MDMA_Channel_TypeDef, CDAR));
+    first.CBRUR = host_mmio_get(m, offsetof(MDMA_Channel_TypeDef, CBRUR));
+    first.CLAR = host_mmio_get(m, offsetof(MDMA_Channel_TypeDef, CLAR));
+    first.CTBR = host_mmio_get(m, offsetof(MDMA_Channel_TypeDef, CTBR));
+    if(chan_error != 0U)
+    {
+      isr = MDMA_CISR_TEIF;
+    }
+    else
+    {
+      mdma_run(&first);
+      isr = MDMA_CISR_CTCIF | MDMA_CISR_BTIF | MDMA_CISR_BRTIF | MDMA_CISR_TCIF;
+    }
+    host_mmio_set(m, offsetof(MDMA_Channel_TypeDef, CISR), isr);
+    host_mmio_set(m, offset, value & ~(MDMA_CCR_EN | MDMA_CCR_SWRQ));
+    host_irq_raise(mdma_copy_irq);
+  }
+}
+
+static void job_done(mdma_copy_job_t *job, void *context)
+{
+  (void)job;
+  if(done_count < 8U)
+  {
+    done_order[done_count] = (uint32_t)(uintptr_t)context;
+  }
+  done_count++;
+}
+
+static void job_set(mdma_copy_job_t *job, mdma_copy_op_t *ops, uint32_t count, uint32_t id)
+{
+  job->ops = ops;
+  job->count = count;
+  job->done = job_done;
+  job->context = (void *)(uintptr_t)id;
+  job->state = MDMA_COPY_IDLE;
+}
+
+/* The bytes op wrote */
+static uint32_t op_ok(const mdma_copy_op_t *op)
+{
+  const uint8_t *d = op->dst;
+  const uint8_t *s = op->src;
+  uint32_t r;
+  uint32_t i;
+
+  for(r = 0U; r < op->rows; r++)
+  {
+    for(i = 0U; i < op->width; i++)
+    {
+      if(d[(r * op->dst_pitch) + i] != ((s != NULL) ? s[(r * op->src_pitch) + i] : (uint8_t)op->fill[0]))
+      {
+        return 0U;
+      }
+    }
+  }
+  return 1U;
+}
+
+static void test_jobs(void)
+{
+  static mdma_copy_job_t a;
+  static mdma_copy_job_t b;
+  static mdma_copy_job_t c;
+  mdma_copy_op_t *ops = OPS;
+  const mdma_copy_stats_t *st = mdma_copy_stats();
+  uint32_t i;
+
+  HOST_CHECK_EQ(mdma_copy_init(NULL), HAL_ERROR);
+  HOST_CHECK_EQ(mdma_copy_init(MDMA_Channel0), HAL_OK);
+  area_fill(SRC, 0x10000U);
+  area_fill(DST, 0x10000U);
+
+  mdma_copy_op(&ops[0], at(DST), at(SRC), 4000U);
+  mdma_copy_op_fill(&ops[1], at(DST + 0x1000U), 0x5AU, 1000U);
+  mdma_copy_op_2d(&ops[2], at(DST + 0x2001U), 100U, at(SRC + 0x2003U), 64U, 40U, 30U);
+  mdma_copy_op(&ops[3], at(DST + 0x4000U), at(SRC + 0x4000U), 3000U);
+  mdma_copy_op(&ops[4], at(DST + 0x5000U), at(SRC + 0x5000U), 100U);
+  job_set(&a, &ops[0], 3U, 1U);
+  job_set(&b, &ops[3], 1U, 2U);
+  job_set(&c, &ops[4], 1U, 3U);
+
+  /* Queued behind the first while the interrupt is held off, small or not */
+  done_count = 0U;
+  __disable_irq();
+  HOST_CHECK_EQ(mdma_copy_submit(&a), HAL_OK);
+  HOST_CHECK_EQ(a.state, MDMA_COPY_RUNNING);
+  HOST_CHECK_EQ(mdma_copy_submit(&b), HAL_OK);
+  HOST_CHECK_EQ(mdma_copy_submit(&c), HAL_OK);
+  HOST_CHECK_EQ(b.state, MDMA_COPY_QUEUED);
+  HOST_CHECK_EQ(c.state, MDMA_COPY_QUEUED);
+  HOST_CHECK_EQ(mdma_copy_submit(&a), HAL_BUSY);
+  HOST_CHECK_EQ(mdma_copy_busy(), 1U);
+  HOST_CHECK_EQ(chan_runs, 1U);
+  __enable_irq();
+  host_irq_poll();
+
+  HOST_CHECK_EQ(done_count, 3U);
+  for(i = 0U; i < 3U; i++)
+  {
+    HOST_CHECK_EQ(done_order[i], i + 1U);
+  }
+  HOST_CHECK_EQ(chan_runs, 3U);
+  HOST_CHECK_EQ(mdma_copy_wait(&a, 0U), HAL_OK);
+  HOST_CHECK_EQ(mdma_copy_wait(&c, 0U), HAL_OK);
+  HOST_CHECK_EQ(mdma_copy_busy(), 0U);
+  for(i = 0U; i < 5U; i++)
+  {
+    HOST_CHECK(op_ok(&ops[i]));
+  }
+  HOST_CHECK_EQ(st->mdma_jobs, 3U);
+  HOST_CHECK_EQ(st->mdma_bytes, 4000U + 1000U + (40U * 30U) + 3000U + 100U);
+  HOST_CHECK_EQ(st->cpu_jobs, 0U);
+
+  /* Small and idle: done by the CPU before submit returns */
+  mdma_copy_op(&ops[4], at(DST + 0x6000U), at(SRC + 0x6000U), 100U);
+  c.state = MDMA_COPY_IDLE;
+  HOST_CHECK_EQ(mdma_copy_submit(&c), HAL_OK);
+  HOST_CHECK_EQ(c.state, MDMA_COPY_DONE);
+  HOST_CHECK_EQ(done_count, 4U);
+  HOST_CHECK(op_ok(&ops[4]));
+  HOST_CHECK_EQ(st->cpu_jobs, 1U);
+  HOST_CHECK_EQ(chan_runs, 3U);
+
+  /* A transfer error ends the job in error */
+  chan_error = 1U;
+  HOST_CHECK_EQ(mdma_copy_submit(&b), HAL_OK);
+  host_irq_poll();
+  HOST_CHECK_EQ(b.state, MDMA_COPY_ERROR);
+  HOST_CHECK_EQ(mdma_copy_wait(&b, 0U), HAL_ERROR);
+  HOST_CHECK_EQ(st->errors, 1U);
+  HOST_CHECK_EQ(mdma_copy_busy(), 0U);
+  chan_error = 0U;
+
+  /* Nodes the MDMA cannot fetch, operations out of range */
+  job_set(&b, (mdma_copy_op_t *)((uint8_t *)&ops[3] + 4U), 1U, 2U);
+  HOST_CHECK_EQ(mdma_copy_submit(&b), HAL_ERROR);
+  job_set(&b, (mdma_copy_op_t *)0x20000000U, 1U, 2U);
+  mdma_copy_op(b.ops, at(DST), at(SRC), 4000U);
+  HOST_CHECK_EQ(mdma_copy_submit(&b), HAL_ERROR);
+  mdma_copy_op_2d(&ops[4], at(DST), 10U, at(SRC), 64U, 40U, 30U);
+  job_set(&b, &ops[3], 2U, 2U);
+  HOST_CHECK_EQ(mdma_copy_submit(&b), HAL_ERROR);
+  job_set(&b, &ops[3], 0U, 2U);
+  HOST_CHECK_EQ(mdma_copy_submit(&b), HAL_ERROR);
+  HOST_CHECK_EQ(chan_runs, 4U);
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  host_map(SRAM, SRAM_SIZE);
+  /* DTCM, to be refused for the nodes */
+  host_map(0x20000000U, 0x1000U);
+
+  test_size_burst();
+  test_split();
+  test_2d();
+
+  chan.base = (uintptr_t)MDMA_Channel0;
+  chan.size = sizeof(MDMA_Channel_TypeDef);
+  chan.write = chan_write;
+  host_mmio_attach(&chan);
+  test_jobs();
+  host_mmio_detach(&chan);
+  return host_result();
+}
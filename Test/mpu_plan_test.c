@@ -0,0 +1,378 @@
+/* Header includes -----------------------------------------------------------*/
+#include "mpu_plan.h"
+#include "host.h"
+#include <stddef.h>
+
+/* mpu_plan: plans are applied to an MPU register model and every address
+   checked is resolved the way the Cortex-M7 does it, highest enabled
+   region with the subregion not disabled, then compared with the use the
+   table gave it. The H750 map is checked at the edges of each memory,
+   random tables for all uses, and the errors mpu_plan_build() reports. */
+
+/* Private macro -------------------------------------------------------------*/
+#define REGION_CNT              16U
+/* XN, AP, TEX, S, C, B */
+#define RASR_ATTR               (MPU_RASR_XN_Msk | MPU_RASR_AP_Msk | MPU_RASR_TEX_Msk | \
+                                 MPU_RASR_S_Msk | MPU_RASR_C_Msk | MPU_RASR_B_Msk)
+#define RASR_AP(rasr)           (((rasr) & MPU_RASR_AP_Msk) >> MPU_RASR_AP_Pos)
+#define BACKGROUND              0xFFFFFFFFU
+#define WINDOW                  0x24000000U
+#define WINDOW_SIZE             0x00100000U
+#define RANDOM_TABLES           5000U
+#define RANGE_MAX               4U
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t seed = 0x1F2E3D4CU;
+
+/* MPU: RNR selects the region RBAR and RASR go to */
+static host_mmio_t mpu_m;
+static volatile struct
+{
+  uint32_t rbar[REGION_CNT];
+  uint32_t rasr[REGION_CNT];
+  uint32_t written[REGION_CNT];
+  uint32_t while_on;            /* region stores with the MPU enabled */
+  uint32_t unmasked;            /* region stores with interrupts enabled */
+} mpu;
+
+/* RASR attributes of each use */
+static uint32_t use_attr[MPU_PLAN_USE_COUNT];
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static void mpu_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  uint32_t rnr = host_mmio_get(m, offsetof(MPU_Type, RNR)) % REGION_CNT;
+
+  if((offset != offsetof(MPU_Type, RBAR)) && (offset != offsetof(MPU_Type, RASR)))
+  {
+    return;
+  }
+  if((host_mmio_get(m, offsetof(MPU_Type, CTRL)) & MPU_CTRL_ENABLE_Msk) != 0U)
+  {
+    mpu.while_on++;
+  }
+  if(host_get_primask() == 0U)
+  {
+    mpu.unmasked++;
+  }
+  if(offset == offsetof(MPU_Type, RBAR))
+  {
+    mpu.rbar[rnr] = value & MPU_RBAR_ADDR_Msk;
+  }
+  else
+  {
+    mpu.rasr[rnr] = value;
+  }
+  mpu.written[rnr]++;
+}
+
+static void mpu_reset(void)
+{
+  uint32_t i;
+
+  for(i = 0U; i < REGION_CNT; i++)
+  {
+    mpu.rbar[i] = 0U;
+    mpu.rasr[i] = 0U;
+    mpu.written[i] = 0U;
+  }
+  mpu.while_on = 0U;
+  mpu.unmasked = 0U;
+}
+
+/* RASR of the region addr falls in, BACKGROUND for the default map */
+static uint32_t resolve(uint32_t addr)
+{
+  uint64_t size;
+  uint64_t offset;
+  uint32_t rasr;
+  uint32_t sub;
+  int32_t i;
+
+  for(i = (int32_t)REGION_CNT - 1; i >= 0; i--)
+  {
+    rasr = mpu.rasr[i];
+    if((rasr & MPU_RASR_ENABLE_Msk) == 0U)
+    {
+      continue;
+    }
+    size = 1ULL << ((((rasr & MPU_RASR_SIZE_Msk) >> MPU_RASR_SIZE_Pos)) + 1U);
+    offset = (uint64_t)addr - (uint64_t)(mpu.rbar[i] & (uint32_t)~(size - 1U));
+    if(offset >= size)
+    {
+      continue;
+    }
+    sub = (uint32_t)(offset / (size / 8U));
+    if((size >= 256U) && ((rasr & (1UL << (MPU_RASR_SRD_Pos + sub))) != 0U))
+    {
+      continue;
+    }
+    return rasr & RASR_ATTR;
+  }
+  return BACKGROUND;
+}
+
+static HAL_StatusTypeDef plan(const mpu_plan_range_t *table, uint32_t count, mpu_plan_t *p)
+{
+  HAL_StatusTypeDef status = mpu_plan_build(table, count, p);
+
+  if(status == HAL_OK)
+  {
+    mpu_reset();
+    mpu_plan_apply(p);
+  }
+  return status;
+}
+
+/* The attributes of each use, from a one range plan */
+static void learn_attr(void)
+{
+  mpu_plan_range_t range = {WINDOW, 0x1000U, MPU_PLAN_CODE};
+  mpu_plan_t p;
+  uint32_t use;
+
+  for(use = 0U; use < MPU_PLAN_USE_COUNT; use++)
+  {
+    range.use = (mpu_plan_use_t)use;
+    HOST_CHECK_EQ(plan(&range, 1U, &p), HAL_OK);
+    HOST_CHECK_EQ(p.count, 1U);
+    use_attr[use] = resolve(WINDOW);
+  }
+}
+
+static uint32_t expect(uint32_t addr, uint32_t use)
+{
+  return HOST_CHECK_EQ(resolve(addr), (use == BACKGROUND) ? BACKGROUND : use_attr[use]);
+}
+
+static void test_h750(void)
+{
+  uint32_t ctrl;
+  uint32_t i;
+
+  mpu_reset();
+  HOST_CHECK_EQ(mpu_plan_init(), HAL_OK);
+  ctrl = host_mmio_get(&mpu_m, offsetof(MPU_Type, CTRL));
+  HOST_CHECK_EQ(ctrl, MPU_CTRL_ENABLE_Msk | MPU_CTRL_PRIVDEFENA_Msk);
+  HOST_CHECK_EQ(mpu.while_on, 0U);
+  HOST_CHECK_EQ(mpu.unmasked, 0U);
+  /* Every planner region written, region 15 left to the DMA arena */
+  for(i = 0U; i < MPU_PLAN_MAX_REGIONS; i++)
+  {
+    HOST_CHECK(mpu.written[i] != 0U);
+  }
+  HOST_CHECK_EQ(mpu.written[15], 0U);
+
+  /* ITCM runs the code copied there and must stay writable */
+  expect(D1_ITCMRAM_BASE, MPU_PLAN_RAMCODE);
+  expect(D1_ITCMRAM_BASE + 0xFFFCU, MPU_PLAN_RAMCODE);
+  HOST_CHECK_EQ(RASR_AP(resolve(D1_ITCMRAM_BASE + 0x8000U)), MPU_REGION_FULL_ACCESS);
+  HOST_CHECK_EQ(resolve(D1_ITCMRAM_BASE + 0x8000U) & MPU_RASR_XN_Msk, 0U);
+  expect(D1_ITCMRAM_BASE + 0x10000U, BACKGROUND);
+
+  expect(FLASH_BANK1_BASE, MPU_PLAN_CODE);
+  expect(FLASH_BANK1_BASE + 0x1FFFCU, MPU_PLAN_CODE);
+  HOST_CHECK_EQ(RASR_AP(resolve(FLASH_BANK1_BASE)), MPU_REGION_PRIV_RO_URO);
+  expect(FLASH_BANK1_BASE + 0x20000U, BACKGROUND);
+
+  expect(D1_DTCMRAM_BASE, MPU_PLAN_DATA);
+  expect(D1_DTCMRAM_BASE + 0x1FFFCU, MPU_PLAN_DATA);
+  HOST_CHECK(resolve(D1_DTCMRAM_BASE) & MPU_RASR_XN_Msk);
+  expect(D1_AXISRAM_BASE, MPU_PLAN_DATA);
+  expect(D1_AXISRAM_BASE + 0x7FFFCU, MPU_PLAN_DATA);
+  expect(D1_AXISRAM_BASE + 0x80000U, BACKGROUND);
+
+  /* SRAM1-3 are 288 KiB, not a power of two */
+  expect(D2_AHBSRAM_BASE, MPU_PLAN_DMA);
+  expect(D2_AHBSRAM_BASE + 0x47FFCU, MPU_PLAN_DMA);
+  expect(D2_AHBSRAM_BASE + 0x48000U, BACKGROUND);
+  HOST_CHECK_EQ(resolve(D2_AHBSRAM_BASE) & MPU_RASR_C_Msk, 0U);
+  expect(D3_SRAM_BASE, MPU_PLAN_DMA);
+  expect(D3_SRAM_BASE + 0xFFFCU, MPU_PLAN_DMA);
+
+  /* QSPI through the no-access window, the rest of which stays closed */
+  expect(0x60000000U, MPU_PLAN_NO_ACCESS);
+  expect(QSPI_BASE - 4U, MPU_PLAN_NO_ACCESS);
+  expect(QSPI_BASE, MPU_PLAN_CODE);
+  expect(QSPI_BASE + MPU_PLAN_QSPI_SIZE - 4U, MPU_PLAN_CODE);
+  expect(QSPI_BASE + MPU_PLAN_QSPI_SIZE, MPU_PLAN_NO_ACCESS);
+  expect(0xDFFFFFFCU, MPU_PLAN_NO_ACCESS);
+  expect(0xE0000000U, BACKGROUND);
+  expect(PERIPH_BASE, BACKGROUND);
+}
+
+/* What the table makes of addr in the window */
+static uint32_t check(const mpu_plan_range_t *table, uint32_t n, uint32_t under, uint32_t addr)
+{
+  uint32_t i;
+
+  if((addr < WINDOW) || (addr >= (WINDOW + WINDOW_SIZE)))
+  {
+    return 1U;
+  }
+  for(i = 0U; i < n; i++)
+  {
+    if((table[i].use != MPU_PLAN_NO_ACCESS) && (addr >= table[i].base) &&
+       ((addr - table[i].base) < table[i].size))
+    {
+      return expect(addr, table[i].use);
+    }
+  }
+  return expect(addr, under);
+}
+
+/* Random tables over a window: every range as its use, the gaps as the
+   NO_ACCESS range under them or the default map */
+static void test_random(void)
+{
+  mpu_plan_range_t table[RANGE_MAX + 1U];
+  mpu_plan_t p;
+  uint32_t cut[2U * RANGE_MAX];
+  uint32_t built = 0U;
+  uint32_t ranges;
+  uint32_t under;
+  uint32_t addr;
+  uint32_t n;
+  uint32_t t;
+  uint32_t i;
+  uint32_t k;
+
+  for(t = 0U; t < RANDOM_TABLES; t++)
+  {
+    ranges = 1U + (rnd() % RANGE_MAX);
+    /* Sorted distinct 32-byte aligned cut points, two per range */
+    for(n = 0U; n < (2U * ranges); n++)
+    {
+      cut[n] = (rnd() % (WINDOW_SIZE / 32U)) * 32U;
+      for(k = n; (k > 0U) && (cut[k - 1U] > cut[k]); k--)
+      {
+        addr = cut[k];
+        cut[k] = cut[k - 1U];
+        cut[k - 1U] = addr;
+      }
+    }
+    n = 0U;
+    for(i = 0U; i < ranges; i++)
+    {
+      if(cut[2U * i] != cut[(2U * i) + 1U])
+      {
+        table[n].base = WINDOW + cut[2U * i];
+        table[n].size = cut[(2U * i) + 1U] - cut[2U * i];
+        table[n].use = (mpu_plan_use_t)(rnd() % MPU_PLAN_NO_ACCESS);
+        n++;
+      }
+    }
+    under = BACKGROUND;
+    if((rnd() & 1U) != 0U)
+    {
+      table[n].base = WINDOW;
+      table[n].size = WINDOW_SIZE;
+      table[n].use = MPU_PLAN_NO_ACCESS;
+      under = MPU_PLAN_NO_ACCESS;
+      n++;
+    }
+    if((n == 0U) || (plan(table, n, &p) != HAL_OK))
+    {
+      continue;
+    }
+    built++;
+
+    for(i = 0U; (i < n) && (table[i].use != MPU_PLAN_NO_ACCESS); i++)
+    {
+      addr = table[i].base + ((rnd() % (table[i].size / 32U)) * 32U);
+      if(!check(table, n, under, table[i].base) || !check(table, n, under, table[i].base - 32U) ||
+         !check(table, n, under, table[i].base + table[i].size - 4U) ||
+         !check(table, n, under, table[i].base + table[i].size) || !check(table, n, under, addr))
+      {
+        return;
+      }
+    }
+    for(i = 0U; i < 16U; i++)
+    {
+      if(!check(table, n, under, WINDOW + (rnd() % WINDOW_SIZE)))
+      {
+        return;
+      }
+    }
+  }
+  printf("random tables: %u of %u fit in %u regions\n", (unsigned)built, (unsigned)RANDOM_TABLES,
+         (unsigned)MPU_PLAN_MAX_REGIONS);
+  HOST_CHECK(built > (RANDOM_TABLES / 4U));
+}
+
+static void test_errors(void)
+{
+  mpu_plan_range_t table[MPU_PLAN_MAX_REGIONS + 1U];
+  mpu_plan_t p;
+  uint32_t i;
+
+  /* Overlap */
+  table[0] = (mpu_plan_range_t){WINDOW, 0x1000U, MPU_PLAN_DATA};
+  table[1] = (mpu_plan_range_t){WINDOW + 0x800U, 0x1000U, MPU_PLAN_CODE};
+  HOST_CHECK_EQ(mpu_plan_build(table, 2U, &p), HAL_ERROR);
+  HOST_CHECK_EQ(p.failed, 1U);
+  /* Misaligned base and size, bad use, past 4 GB */
+  table[1] = (mpu_plan_range_t){WINDOW + 0x1004U, 0x20U, MPU_PLAN_CODE};
+  HOST_CHECK_EQ(mpu_plan_build(table, 2U, &p), HAL_ERROR);
+  HOST_CHECK_EQ(p.failed, 1U);
+  table[1] = (mpu_plan_range_t){WINDOW + 0x1000U, 0x30U, MPU_PLAN_CODE};
+  HOST_CHECK_EQ(mpu_plan_build(table, 2U, &p), HAL_ERROR);
+  table[1] = (mpu_plan_range_t){WINDOW + 0x1000U, 0x20U, MPU_PLAN_USE_COUNT};
+  HOST_CHECK_EQ(mpu_plan_build(table, 2U, &p), HAL_ERROR);
+  table[1] = (mpu_plan_range_t){0xFFFFFFE0U, 0x40U, MPU_PLAN_CODE};
+  HOST_CHECK_EQ(mpu_plan_build(table, 2U, &p), HAL_ERROR);
+  HOST_CHECK_EQ(p.failed, 1U);
+
+  /* One region more than the planner has */
+  for(i = 0U; i <= MPU_PLAN_MAX_REGIONS; i++)
+  {
+    table[i] = (mpu_plan_range_t){WINDOW + (i * 0x40U), 0x20U, MPU_PLAN_DATA};
+  }
+  HOST_CHECK_EQ(mpu_plan_build(table, MPU_PLAN_MAX_REGIONS, &p), HAL_OK);
+  HOST_CHECK_EQ(mpu_plan_build(table, MPU_PLAN_MAX_REGIONS + 1U, &p), HAL_ERROR);
+  HOST_CHECK_EQ(p.failed, MPU_PLAN_MAX_REGIONS);
+
+  /* NO_ACCESS over everything, size 0, and a range through it */
+  table[0] = (mpu_plan_range_t){0U, 0U, MPU_PLAN_NO_ACCESS};
+  table[1] = (mpu_plan_range_t){WINDOW, 0x1000U, MPU_PLAN_NO_ACCESS};
+  table[2] = (mpu_plan_range_t){WINDOW + 0x800U, 0x1000U, MPU_PLAN_RAMCODE};
+  HOST_CHECK_EQ(plan(table, 3U, &p), HAL_OK);
+  expect(0U, MPU_PLAN_NO_ACCESS);
+  expect(0xFFFFFFFCU, MPU_PLAN_NO_ACCESS);
+  expect(WINDOW + 0x7E0U, MPU_PLAN_NO_ACCESS);
+  expect(WINDOW + 0x800U, MPU_PLAN_RAMCODE);
+  expect(WINDOW + 0x17FCU, MPU_PLAN_RAMCODE);
+  expect(WINDOW + 0x1800U, MPU_PLAN_NO_ACCESS);
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  mpu_m.base = MPU_BASE;
+  mpu_m.size = sizeof(MPU_Type);
+  mpu_m.write = mpu_write;
+  host_mmio_attach(&mpu_m);
+
+  learn_attr();
+  /* Code and data attributes as mpu_plan.h describes them */
+  HOST_CHECK_EQ(RASR_AP(use_attr[MPU_PLAN_CODE]), MPU_REGION_PRIV_RO_URO);
+  HOST_CHECK_EQ(use_attr[MPU_PLAN_CODE] & MPU_RASR_XN_Msk, 0U);
+  HOST_CHECK_EQ(RASR_AP(use_attr[MPU_PLAN_RAMCODE]), MPU_REGION_FULL_ACCESS);
+  HOST_CHECK_EQ(use_attr[MPU_PLAN_RAMCODE] & MPU_RASR_XN_Msk, 0U);
+  HOST_CHECK(use_attr[MPU_PLAN_DATA] & MPU_RASR_XN_Msk);
+  HOST_CHECK(use_attr[MPU_PLAN_STACK] & MPU_RASR_XN_Msk);
+  HOST_CHECK_EQ(RASR_AP(use_attr[MPU_PLAN_NO_ACCESS]), MPU_REGION_NO_ACCESS);
+
+  test_h750();
+  test_random();
+  test_errors();
+  return host_result();
+}
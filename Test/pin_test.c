@@ -0,0 +1,289 @@
+/* Header includes -----------------------------------------------------------*/
+#include "pin.h"
+#include <stddef.h>
+
+/* pin.h: the spread helpers against a loop over all 16-bit masks, and the
+   pin operations on a GPIO port model that logs every store, so each one
+   is checked to be the single bus write pin.h promises (one per register
+   for pin_config()) with the right effect on the port. */
+
+/* Private macro -------------------------------------------------------------*/
+#define TEST_PIN                GPIOD, 5
+#define LOG_MAX                 16U
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t seed = 0x2468ACE1U;
+static volatile uint32_t idr;
+
+/* GPIOD: BSRR drives ODR and reads as 0, IDR reads idr */
+static host_mmio_t port;
+static volatile struct
+{
+  uint32_t offset;
+  uint32_t value;
+} log_[LOG_MAX];
+static volatile uint32_t logged;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static uint32_t port_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  (void)m;
+  return (offset == offsetof(GPIO_TypeDef, IDR)) ? idr : current;
+}
+
+static void port_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  uint32_t odr;
+
+  HOST_CHECK_EQ(size, 4U);
+  if(logged < LOG_MAX)
+  {
+    log_[logged].offset = offset;
+    log_[logged].value = value;
+  }
+  logged++;
+  if(offset == offsetof(GPIO_TypeDef, BSRR))
+  {
+    /* Set wins over reset for a pin in both halves */
+    odr = host_mmio_get(m, offsetof(GPIO_TypeDef, ODR));
+    odr = (odr & ~(value >> 16)) | (value & 0xFFFFU);
+    host_mmio_set(m, offsetof(GPIO_TypeDef, ODR), odr);
+    host_mmio_set(m, offset, 0U);
+  }
+}
+
+static uint32_t odr_get(void)
+{
+  return host_mmio_get(&port, offsetof(GPIO_TypeDef, ODR));
+}
+
+static void odr_set(uint32_t v)
+{
+  host_mmio_set(&port, offsetof(GPIO_TypeDef, ODR), v);
+}
+
+/* Reset the counters and the log before an operation */
+static void start(void)
+{
+  logged = 0U;
+  port.reads = 0U;
+  port.writes = 0U;
+}
+
+/* One store to BSRR and nothing else */
+static void check_bsrr(uint32_t value)
+{
+  HOST_CHECK_EQ(port.writes, 1U);
+  HOST_CHECK_EQ(log_[0].offset, offsetof(GPIO_TypeDef, BSRR));
+  HOST_CHECK_EQ(log_[0].value, value);
+}
+
+static void test_spread(void)
+{
+  uint32_t mask;
+  uint32_t want2;
+  uint32_t want4;
+  uint32_t n;
+
+  for(mask = 0U; mask <= 0xFFFFU; mask++)
+  {
+    want2 = 0U;
+    want4 = 0U;
+    for(n = 0U; n < 16U; n++)
+    {
+      if((mask & PIN_BIT(n)) != 0U)
+      {
+        want2 |= 1UL << (2U * n);
+        want4 |= (n < 8U) ? (1UL << (4U * n)) : 0U;
+      }
+    }
+    if(!HOST_CHECK_EQ(pin_spread2(mask), want2) || !HOST_CHECK_EQ(pin_spread4(mask), want4))
+    {
+      break;
+    }
+    /* Bits above the field are ignored */
+    HOST_CHECK_EQ(pin_spread2(mask | 0xFFFF0000U), want2);
+  }
+}
+
+static void test_bsrr_ops(void)
+{
+  uint32_t mask;
+  uint32_t odr;
+  uint32_t i;
+
+  for(i = 0U; i < 4096U; i++)
+  {
+    /* Single pins, none, all, then random masks */
+    mask = (i < 16U) ? PIN_BIT(i) : (i == 16U) ? 0U : (i == 17U) ? 0xFFFFU : (rnd() & 0xFFFFU);
+    odr = rnd() & 0xFFFFU;
+    odr_set(odr);
+    start();
+    pin_set(GPIOD, mask);
+    check_bsrr(mask);
+    HOST_CHECK_EQ(port.reads, 0U);
+    HOST_CHECK_EQ(odr_get(), odr | mask);
+
+    odr_set(odr);
+    start();
+    pin_clr(GPIOD, mask);
+    check_bsrr(mask << 16);
+    HOST_CHECK_EQ(odr_get(), odr & ~mask);
+
+    odr_set(odr);
+    start();
+    pin_write(GPIOD, mask, mask & 1U);
+    check_bsrr(((mask & 1U) != 0U) ? mask : (mask << 16));
+
+    odr_set(odr);
+    start();
+    pin_write_masked(GPIOD, mask & 0x5555U, mask & 0xAAAAU);
+    check_bsrr((mask & 0x5555U) | ((mask & 0xAAAAU) << 16));
+    HOST_CHECK_EQ(odr_get(), (odr & ~(mask & 0xAAAAU)) | (mask & 0x5555U));
+
+    /* Toggle reads ODR once and stores once */
+    odr_set(odr);
+    start();
+    pin_toggle(GPIOD, mask);
+    HOST_CHECK_EQ(port.reads, 1U);
+    HOST_CHECK_EQ(port.writes, 1U);
+    HOST_CHECK_EQ(odr_get(), odr ^ mask);
+  }
+
+  idr = 0x0020U;
+  start();
+  HOST_CHECK(PIN_READ(TEST_PIN));
+  HOST_CHECK_EQ(port.reads, 1U);
+  HOST_CHECK_EQ(port.writes, 0U);
+  idr = 0xFFDFU;
+  HOST_CHECK(!PIN_READ(TEST_PIN));
+  odr_set(0U);
+  PIN_SET(TEST_PIN);
+  HOST_CHECK_EQ(odr_get(), 0x0020U);
+  PIN_WRITE(TEST_PIN, 0U);
+  HOST_CHECK_EQ(odr_get(), 0U);
+  PIN_TOGGLE(TEST_PIN);
+  HOST_CHECK_EQ(odr_get(), 0x0020U);
+  PIN_CLR(TEST_PIN);
+  HOST_CHECK_EQ(odr_get(), 0U);
+}
+
+/* Field of pin n, width bits wide, in a register value */
+static uint32_t field(uint32_t reg, uint32_t n, uint32_t width)
+{
+  return (reg >> (n * width)) & ((1UL << width) - 1U);
+}
+
+static void check_config(uint32_t mask, uint32_t mode, uint32_t otype, uint32_t speed, uint32_t pull, uint32_t af)
+{
+  GPIO_TypeDef before;
+  GPIO_TypeDef after;
+  uint32_t writes = 0U;
+  uint32_t i;
+  uint32_t n;
+  const uint32_t *r;
+
+  for(i = 0U; i < 10U; i++)
+  {
+    host_mmio_set(&port, i * 4U, (i == offsetof(GPIO_TypeDef, BSRR) / 4U) ? 0U : rnd());
+  }
+  for(i = 0U; i < 10U; i++)
+  {
+    ((uint32_t *)&before)[i] = host_mmio_get(&port, i * 4U);
+  }
+  start();
+  pin_config(GPIOD, mask, mode, otype, speed, pull, af);
+  for(i = 0U; i < 10U; i++)
+  {
+    ((uint32_t *)&after)[i] = host_mmio_get(&port, i * 4U);
+  }
+
+  /* One store per register, MODER last */
+  writes += ((mode == PIN_MODE_AF) && ((mask & 0x00FFU) != 0U)) ? 1U : 0U;
+  writes += ((mode == PIN_MODE_AF) && ((mask & 0xFF00U) != 0U)) ? 1U : 0U;
+  writes += ((mode == PIN_MODE_OUTPUT) || (mode == PIN_MODE_AF)) ? 2U : 0U;
+  writes += 2U;
+  HOST_CHECK_EQ(port.writes, writes);
+  HOST_CHECK_EQ(log_[port.writes - 1U].offset, offsetof(GPIO_TypeDef, MODER));
+  for(i = 0U; i + 1U < port.writes; i++)
+  {
+    for(n = i + 1U; n < port.writes; n++)
+    {
+      HOST_CHECK(log_[i].offset != log_[n].offset);
+    }
+  }
+
+  for(n = 0U; n < 16U; n++)
+  {
+    uint32_t in = (mask >> n) & 1U;
+    uint32_t drive = (in != 0U) && ((mode == PIN_MODE_OUTPUT) || (mode == PIN_MODE_AF));
+    uint32_t alt = (in != 0U) && (mode == PIN_MODE_AF);
+
+    HOST_CHECK_EQ(field(after.MODER, n, 2U), (in != 0U) ? mode : field(before.MODER, n, 2U));
+    HOST_CHECK_EQ(field(after.PUPDR, n, 2U), (in != 0U) ? pull : field(before.PUPDR, n, 2U));
+    HOST_CHECK_EQ(field(after.OTYPER, n, 1U), (drive != 0U) ? otype : field(before.OTYPER, n, 1U));
+    HOST_CHECK_EQ(field(after.OSPEEDR, n, 2U), (drive != 0U) ? speed : field(before.OSPEEDR, n, 2U));
+    r = (const uint32_t *)((n < 8U) ? &after.AFR[0] : &after.AFR[1]);
+    HOST_CHECK_EQ(field(*r, n & 7U, 4U),
+                  (alt != 0U) ? af : field((n < 8U) ? before.AFR[0] : before.AFR[1], n & 7U, 4U));
+  }
+  HOST_CHECK_EQ(after.ODR, before.ODR);
+  HOST_CHECK_EQ(after.LCKR, before.LCKR);
+}
+
+static void test_config(void)
+{
+  uint32_t mode;
+  uint32_t i;
+
+  for(mode = PIN_MODE_INPUT; mode <= PIN_MODE_ANALOG; mode++)
+  {
+    for(i = 0U; i < 16U; i++)
+    {
+      check_config(PIN_BIT(i), mode, rnd() & 1U, rnd() & 3U, rnd() % 3U, rnd() & 0xFU);
+    }
+    check_config(0x00FFU, mode, 1U, 3U, 2U, 0xFU);
+    check_config(0xFF00U, mode, 0U, 1U, 1U, 7U);
+    check_config(0xFFFFU, mode, 1U, 2U, 0U, 5U);
+    for(i = 0U; i < 500U; i++)
+    {
+      check_config((rnd() & 0xFFFFU) | 1U, mode, rnd() & 1U, rnd() & 3U, rnd() % 3U, rnd() & 0xFU);
+    }
+  }
+
+  /* Through the macros, constant mask */
+  check_config(PIN_MASK(TEST_PIN), PIN_MODE_AF, PIN_OTYPE_OD, PIN_SPEED_HIGH, PIN_PULL_UP, 11U);
+  start();
+  PIN_CONFIG(TEST_PIN, PIN_MODE_OUTPUT, PIN_OTYPE_PP, PIN_SPEED_VHIGH, PIN_PULL_NONE, 0U);
+  HOST_CHECK_EQ(port.writes, 4U);
+  HOST_CHECK_EQ(field(host_mmio_get(&port, offsetof(GPIO_TypeDef, MODER)), 5U, 2U), PIN_MODE_OUTPUT);
+
+  RCC->AHB4ENR = 0U;
+  PIN_CLOCK_ENABLE(TEST_PIN);
+  HOST_CHECK_EQ(RCC->AHB4ENR, RCC_AHB4ENR_GPIODEN);
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  port.base = GPIOD_BASE;
+  port.size = sizeof(GPIO_TypeDef);
+  port.read = port_read;
+  port.write = port_write;
+  host_mmio_attach(&port);
+
+  test_spread();
+  test_bsrr_ops();
+  test_config();
+
+  host_mmio_detach(&port);
+  return host_result();
+}
@@ -0,0 +1,788 @@
+/* Header includes -----------------------------------------------------------*/
+#include "qspi_boot.h"
+#include "host.h"
+#include <stddef.h>
+#include <string.h>
+
+/* qspi_boot: the real HAL QSPI driver runs against a QUADSPI model (indirect
+   write and read, automatic polling, memory-mapped mode, the peripheral
+   reset from RCC) wired to a W25Q64JV-like flash: reset enable and reset
+   with tRST, WEL, WIP, a non-volatile SR2 with QE and the write time, and
+   quad reads that only answer with QE set, the dummy clocks and DTR mode
+   of the part, no continuous read mode and a clock within its limit. A
+   command the flash would ignore or misread is counted. Checked, for a
+   fresh part, a second boot, a part still busy after reset and a missing
+   part, on the 64 MHz reset clock and a 240 MHz HCLK: the command
+   sequence, that QE is written once and the rest of SR2 kept, the QUADSPI
+   prescaler and sampling, and the data read through the mapped window. */
+
+/* Private macro -------------------------------------------------------------*/
+#define LOG_MAX                 64U
+#define FIFO_MAX                32U
+/* The part: 8 MB, quad I/O fast read DTR 0xED with 8 dummy clocks up to
+   80 MHz, SDR 0xEB with 4 up to 133 MHz */
+#define FLASH_BYTES              (8U * 1024U * 1024U)
+#define FLASH_DUMMY_DTR         8U
+#define FLASH_DUMMY_SDR         4U
+#define FLASH_MAX_DTR_HZ        80000000U
+#define FLASH_MAX_SDR_HZ        133000000U
+#define FLASH_T_RST_US          30U
+#define FLASH_T_W_US            10000U
+/* The part of the window the test reads back */
+#define WINDOW                  0x10000U
+
+/* CCR fields */
+#define CCR_FIELD(ccr, name)    (((ccr) & QUADSPI_CCR_##name##_Msk) >> QUADSPI_CCR_##name##_Pos)
+#define LINES_NONE              0U
+#define LINES_1                 1U
+#define LINES_4                 3U
+#define FMODE_WRITE             0U
+#define FMODE_READ              1U
+#define FMODE_POLL              2U
+#define FMODE_MAPPED            3U
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  uint8_t instruction;
+  uint8_t fmode;
+  uint8_t data;                 /* first data byte, written or read */
+  uint8_t nbytes;
+} cmd_t;
+
+/* Private variables ---------------------------------------------------------*/
+static uint64_t now_us;
+
+/* The flash */
+static struct
+{
+  uint32_t present;
+  uint8_t sr1;
+  uint8_t sr2;                  /* non-volatile */
+  uint32_t reset_enabled;
+  uint64_t ready_us;            /* busy (tRST, tW) until then */
+  uint64_t reset_busy_us;       /* extra WIP after a reset, as after an interrupted erase */
+  uint32_t sr2_writes;
+  uint32_t ignored;             /* commands it could not take */
+  uint8_t data[WINDOW];
+} flash;
+
+static cmd_t log_cmd[LOG_MAX];
+static uint32_t log_n;
+
+/* The QUADSPI */
+static host_mmio_t qspi_m;
+static struct
+{
+  uint32_t sr;                  /* TEF, TCF, SMF, TOF */
+  uint32_t busy;
+  uint32_t polling;
+  uint32_t mapped;
+  uint8_t fifo[FIFO_MAX];
+  uint32_t fifo_n;
+  uint32_t fifo_head;
+  uint8_t tx[FIFO_MAX];
+  uint32_t tx_n;
+  uint32_t polls;
+  uint32_t disabled;            /* transfers started with EN clear */
+  uint32_t resets;              /* through RCC */
+} q;
+
+/* RCC, for the QUADSPI reset */
+static host_mmio_t rcc_m;
+
+/* The memory-mapped window */
+static host_mmio_t window_m;
+static uint32_t bad_reads;
+static const char *bad_why;
+/* The QUADSPI kernel clock the test set up */
+static uint32_t kernel_hz;
+static uint32_t seed = 0x5EEDB007U;
+
+/* Private functions ---------------------------------------------------------*/
+/* The HAL timeouts and HAL_Delay() run on a tick that moves 100 us a call */
+uint32_t HAL_GetTick(void)
+{
+  now_us += 100U;
+  return (uint32_t)(now_us / 1000U);
+}
+
+static uint32_t flash_busy(void)
+{
+  return (now_us < flash.ready_us) ? 1U : 0U;
+}
+
+/* SR1 as read on the bus: nothing drives it while absent or in tRST */
+static uint8_t flash_sr1(void)
+{
+  if((flash.present == 0U) || (now_us < flash.ready_us - flash.reset_busy_us))
+  {
+    return 0xFFU;
+  }
+  return (uint8_t)(flash.sr1 | (flash_busy() ? QSPI_STATUS1_WIP : 0U));
+}
+
+static void flash_ignored(const char *why, uint32_t instruction)
+{
+  flash.ignored++;
+  printf("  flash: 0x%02x ignored, %s\n", (unsigned)instruction, why);
+}
+
+/* A single-line command on the bus with its data; returns the byte read
+   back for the read commands */
+static uint8_t flash_command(uint32_t ccr, const uint8_t *tx, uint32_t ntx)
+{
+  uint32_t instruction = CCR_FIELD(ccr, INSTRUCTION);
+  uint32_t reset_enabled = flash.reset_enabled;
+
+  if(flash.present == 0U)
+  {
+    return 0xFFU;
+  }
+  flash.reset_enabled = 0U;
+  if((CCR_FIELD(ccr, IMODE) != LINES_1) || (CCR_FIELD(ccr, ADMODE) != LINES_NONE) ||
+     ((CCR_FIELD(ccr, DMODE) != LINES_NONE) && (CCR_FIELD(ccr, DMODE) != LINES_1)))
+  {
+    flash_ignored("not a single-line register command", instruction);
+    return 0xFFU;
+  }
+  /* Only the status read gets through while busy */
+  if(flash_busy() && (instruction != QSPI_CMD_READ_STATUS1))
+  {
+    flash_ignored("busy", instruction);
+    return 0xFFU;
+  }
+
+  switch(instruction)
+  {
+    case QSPI_CMD_RESET_ENABLE:
+      flash.reset_enabled = 1U;
+      break;
+    case QSPI_CMD_RESET_DEVICE:
+      if(reset_enabled == 0U)
+      {
+        flash_ignored("no reset enable before", instruction);
+        break;
+      }
+      flash.sr1 = 0U;
+      flash.ready_us = now_us + FLASH_T_RST_US + flash.reset_busy_us;
+      break;
+    case QSPI_CMD_READ_STATUS1:
+      return flash_sr1();
+    case QSPI_CMD_READ_STATUS2:
+      return flash.sr2;
+    case QSPI_CMD_WRITE_ENABLE:
+      flash.sr1 |= QSPI_STATUS1_WEL;
+      break;
+    case QSPI_CMD_WRITE_STATUS2:
+      if(((flash.sr1 & QSPI_STATUS1_WEL) == 0U) || (ntx != 1U))
+      {
+        flash_ignored("write status without WEL or one byte", instruction);
+        break;
+      }
+      flash.sr2 = tx[0];
+      flash.sr2_writes++;
+      flash.sr1 &= (uint8_t)~QSPI_STATUS1_WEL;
+      flash.ready_us = now_us + FLASH_T_W_US;
+      break;
+    default:
+      flash_ignored("unknown", instruction);
+      break;
+  }
+  return 0xFFU;
+}
+
+static void log_add(uint32_t ccr, uint8_t data, uint32_t nbytes)
+{
+  if(log_n < LOG_MAX)
+  {
+    log_cmd[log_n].instruction = (uint8_t)CCR_FIELD(ccr, INSTRUCTION);
+    log_cmd[log_n].fmode = (uint8_t)CCR_FIELD(ccr, FMODE);
+    log_cmd[log_n].data = data;
+    log_cmd[log_n].nbytes = (uint8_t)nbytes;
+    log_n++;
+  }
+}
+
+static uint32_t qspi_get(uint32_t offset)
+{
+  return host_mmio_get(&qspi_m, offset);
+}
+
+static void q_reset(void)
+{
+  uint32_t offset;
+
+  memset(q.fifo, 0, sizeof(q.fifo));
+  q.sr = 0U;
+  q.busy = 0U;
+  q.polling = 0U;
+  q.mapped = 0U;
+  q.fifo_n = 0U;
+  q.fifo_head = 0U;
+  q.tx_n = 0U;
+  for(offset = 0U; offset < sizeof(QUADSPI_TypeDef); offset += 4U)
+  {
+    host_mmio_set(&qspi_m, offset, 0U);
+  }
+}
+
+/* A transfer starts: the command goes out on the bus */
+static void q_start(void)
+{
+  uint32_t ccr = qspi_get(offsetof(QUADSPI_TypeDef, CCR));
+  uint32_t nbytes = qspi_get(offsetof(QUADSPI_TypeDef, DLR)) + 1U;
+  uint8_t b;
+
+  if((qspi_get(offsetof(QUADSPI_TypeDef, CR)) & QUADSPI_CR_EN) == 0U)
+  {
+    q.disabled++;
+    return;
+  }
+  q.sr &= ~(QUADSPI_SR_TCF | QUADSPI_SR_SMF);
+  q.fifo_n = 0U;
+  q.fifo_head = 0U;
+  q.tx_n = 0U;
+  if(CCR_FIELD(ccr, DMODE) == LINES_NONE)
+  {
+    log_add(ccr, 0U, 0U);
+    (void)flash_command(ccr, NULL, 0U);
+    q.sr |= QUADSPI_SR_TCF;
+    return;
+  }
+  switch(CCR_FIELD(ccr, FMODE))
+  {
+    case FMODE_WRITE:
+      q.busy = 1U;
+      break;
+    case FMODE_READ:
+      b = flash_command(ccr, NULL, 0U);
+      log_add(ccr, b, nbytes);
+      q.fifo[0] = b;
+      memset(&q.fifo[1], 0xFF, FIFO_MAX - 1U);
+      q.fifo_n = (nbytes < FIFO_MAX) ? nbytes : FIFO_MAX;
+      q.busy = 1U;
+      q.sr |= QUADSPI_SR_TCF;
+      break;
+    case FMODE_POLL:
+      log_add(ccr, 0U, nbytes);
+      q.polling = 1U;
+      q.busy = 1U;
+      break;
+    default:
+      log_add(ccr, 0U, 0U);
+      q.mapped = 1U;
+      q.busy = 1U;
+      break;
+  }
+}
+
+/* One status read of the automatic polling, on each SR read */
+static void q_poll(void)
+{
+  uint32_t mask = qspi_get(offsetof(QUADSPI_TypeDef, PSMKR));
+  uint32_t match = qspi_get(offsetof(QUADSPI_TypeDef, PSMAR));
+  uint8_t status;
+
+  now_us++;
+  status = flash_command(qspi_get(offsetof(QUADSPI_TypeDef, CCR)), NULL, 0U);
+  q.polls++;
+  if((status & mask) == match)
+  {
+    log_cmd[log_n - 1U].data = status;
+    q.sr |= QUADSPI_SR_SMF;
+    q.polling = 0U;
+    q.busy = 0U;
+  }
+}
+
+static uint32_t qspi_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  uint32_t sr;
+  uint32_t threshold;
+
+  now_us++;
+  if(offset == offsetof(QUADSPI_TypeDef, SR))
+  {
+    if(q.polling != 0U)
+    {
+      q_poll();
+    }
+    threshold = ((qspi_get(offsetof(QUADSPI_TypeDef, CR)) & QUADSPI_CR_FTHRES) >> QUADSPI_CR_FTHRES_Pos) + 1U;
+    sr = q.sr | (q.fifo_n << QUADSPI_SR_FLEVEL_Pos);
+    if(q.busy != 0U)
+    {
+      sr |= QUADSPI_SR_BUSY;
+    }
+    /* Read: enough to read, or the end of the data. Write: room for more */
+    if(CCR_FIELD(qspi_get(offsetof(QUADSPI_TypeDef, CCR)), FMODE) == FMODE_READ)
+    {
+      if((q.fifo_n >= threshold) || ((q.fifo_n != 0U) && ((q.sr & QUADSPI_SR_TCF) != 0U)))
+      {
+        sr |= QUADSPI_SR_FTF;
+      }
+    }
+    else if(FIFO_MAX - q.tx_n >= threshold)
+    {
+      sr |= QUADSPI_SR_FTF;
+    }
+    return sr;
+  }
+  if(offset == offsetof(QUADSPI_TypeDef, DR))
+  {
+    if(q.fifo_n == 0U)
+    {
+      return 0U;
+    }
+    q.fifo_n--;
+    if(q.fifo_n == 0U)
+    {
+      q.busy = 0U;
+    }
+    return q.fifo[q.fifo_head++];
+  }
+  return current;
+}
+
+static void qspi_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  uint32_t ccr = qspi_get(offsetof(QUADSPI_TypeDef, CCR));
+  uint32_t fmode = CCR_FIELD(ccr, FMODE);
+
+  now_us++;
+  if(offset == offsetof(QUADSPI_TypeDef, CR))
+  {
+    if((value & QUADSPI_CR_ABORT) != 0U)
+    {
+      q.busy = 0U;
+      q.polling = 0U;
+      q.mapped = 0U;
+      q.fifo_n = 0U;
+      q.sr |= QUADSPI_SR_TCF;
+      host_mmio_set(m, offset, value & ~QUADSPI_CR_ABORT);
+    }
+  }
+  else if(offset == offsetof(QUADSPI_TypeDef, FCR))
+  {
+    q.sr &= ~(value & (QUADSPI_SR_TEF | QUADSPI_SR_TCF | QUADSPI_SR_SMF | QUADSPI_SR_TOF));
+    host_mmio_set(m, offset, 0U);
+  }
+  else if(offset == offsetof(QUADSPI_TypeDef, CCR))
+  {
+    /* The CCR write starts memory-mapped mode, and the transfers that need
+       no address and no data to send */
+    q.mapped = 0U;
+    q.polling = 0U;
+    q.tx_n = 0U;
+    if((CCR_FIELD(value, FMODE) == FMODE_MAPPED) ||
+       ((CCR_FIELD(value, ADMODE) == LINES_NONE) &&
+        ((CCR_FIELD(value, DMODE) == LINES_NONE) || (CCR_FIELD(value, FMODE) != FMODE_WRITE))))
+    {
+      q_start();
+    }
+  }
+  else if(offset == offsetof(QUADSPI_TypeDef, AR))
+  {
+    if((CCR_FIELD(ccr, ADMODE) != LINES_NONE) && (fmode != FMODE_MAPPED))
+    {
+      q_start();
+    }
+  }
+  else if((offset == offsetof(QUADSPI_TypeDef, DR)) && (fmode == FMODE_WRITE) && (size == 1U))
+  {
+    if(q.tx_n == 0U)
+    {
+      q_start();
+    }
+    q.tx[q.tx_n++] = (uint8_t)value;
+    if(q.tx_n == qspi_get(offsetof(QUADSPI_TypeDef, DLR)) + 1U)
+    {
+      log_add(ccr, q.tx[0], q.tx_n);
+      (void)flash_command(ccr, q.tx, q.tx_n);
+      q.tx_n = 0U;
+      q.busy = 0U;
+      q.sr |= QUADSPI_SR_TCF;
+    }
+  }
+}
+
+/* The peripheral reset clears the QUADSPI, whatever it was doing */
+static void rcc_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  if((offset == offsetof(RCC_TypeDef, AHB3RSTR)) && ((value & RCC_AHB3RSTR_QSPIRST) != 0U))
+  {
+    q_reset();
+    q.resets++;
+  }
+}
+
+/* What would make a mapped read return something else than the flash data */
+static const char *mapped_fault(void)
+{
+  uint32_t cr = qspi_get(offsetof(QUADSPI_TypeDef, CR));
+  uint32_t dcr = qspi_get(offsetof(QUADSPI_TypeDef, DCR));
+  uint32_t ccr = qspi_get(offsetof(QUADSPI_TypeDef, CCR));
+  uint32_t abr = qspi_get(offsetof(QUADSPI_TypeDef, ABR));
+  uint32_t dtr = QSPI_BOOT_DTR;
+  uint32_t prescaler = ((cr & QUADSPI_CR_PRESCALER) >> QUADSPI_CR_PRESCALER_Pos) + 1U;
+
+  if((q.mapped == 0U) || ((cr & QUADSPI_CR_EN) == 0U))
+  {
+    return "not memory-mapped";
+  }
+  if((flash.present == 0U) || flash_busy())
+  {
+    return "flash not ready";
+  }
+  if((flash.sr2 & QSPI_STATUS2_QE) == 0U)
+  {
+    return "QE clear, IO2/IO3 are WP/HOLD";
+  }
+  if((CCR_FIELD(ccr, INSTRUCTION) != (dtr ? QSPI_CMD_QUAD_READ_DTR : QSPI_CMD_QUAD_READ)) ||
+     (CCR_FIELD(ccr, IMODE) != LINES_1) || (CCR_FIELD(ccr, SIOO) != 0U))
+  {
+    return "not the instruction on one line every access";
+  }
+  if((CCR_FIELD(ccr, ADMODE) != LINES_4) || (CCR_FIELD(ccr, ADSIZE) != 2U) ||
+     (CCR_FIELD(ccr, ABMODE) != LINES_4) || (CCR_FIELD(ccr, ABSIZE) != 0U) ||
+     (CCR_FIELD(ccr, DMODE) != LINES_4))
+  {
+    return "not 24-bit address, mode byte and data on four lines";
+  }
+  if((abr & 0x30U) == 0x20U)
+  {
+    return "mode bits enter continuous read";
+  }
+  if(CCR_FIELD(ccr, DCYC) != (dtr ? FLASH_DUMMY_DTR : FLASH_DUMMY_SDR))
+  {
+    return "dummy clocks";
+  }
+  if((CCR_FIELD(ccr, DDRM) != dtr) || (CCR_FIELD(ccr, DHHC) != dtr))
+  {
+    return "DTR mode or its hold";
+  }
+  /* DTR samples on both edges; SDR at this clock needs the half-cycle shift */
+  if(((cr & QUADSPI_CR_SSHIFT) != 0U) == (dtr != 0U))
+  {
+    return "sample shift";
+  }
+  if(kernel_hz / prescaler > (dtr ? FLASH_MAX_DTR_HZ : FLASH_MAX_SDR_HZ))
+  {
+    return "clock above the flash limit";
+  }
+  if((((dcr & QUADSPI_DCR_FSIZE) >> QUADSPI_DCR_FSIZE_Pos) + 1U) != (uint32_t)__builtin_ctz(FLASH_BYTES))
+  {
+    return "flash size";
+  }
+  return NULL;
+}
+
+static uint32_t window_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  const char *why = mapped_fault();
+  uint32_t word;
+
+  if(why != NULL)
+  {
+    if(bad_why == NULL)
+    {
+      bad_why = why;
+      printf("  mapped read at 0x%05x: %s\n", (unsigned)offset, why);
+    }
+    bad_reads++;
+    return 0xA5A5A5A5U;
+  }
+  memcpy(&word, &flash.data[offset], sizeof(word));
+  return word;
+}
+
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+/* A part out of the box: QE clear, a lock bit set that must survive */
+static void flash_fit(uint32_t present, uint8_t sr2)
+{
+  uint32_t sp = D1_DTCMRAM_BASE + 0x20000U;
+  uint32_t entry = QSPI_BASE + 0x299U;
+  uint32_t i;
+
+  flash.present = present;
+  flash.sr1 = 0U;
+  flash.sr2 = sr2;
+  flash.reset_enabled = 0U;
+  flash.ready_us = 0U;
+  flash.reset_busy_us = 0U;
+  flash.sr2_writes = 0U;
+  for(i = 0U; i < WINDOW; i++)
+  {
+    flash.data[i] = (uint8_t)rnd();
+  }
+  memcpy(&flash.data[0], &sp, 4U);
+  memcpy(&flash.data[4], &entry, 4U);
+}
+
+/* Reset clock: HSI 64 MHz everywhere */
+static void clock_hsi(void)
+{
+  RCC->CFGR = 0U;
+  RCC->D1CFGR = 0U;
+  RCC->D1CCIPR = 0U;
+  HAL_RCC_ClockCacheInvalidate();
+  kernel_hz = 64000000U;
+}
+
+/* PLL1 from HSI: 64 / 4 * 50 = 800 MHz VCO, P /2 = 400 MHz SYSCLK, HCLK
+   /2 = 200 MHz, Q /5 = 160 MHz */
+static void clock_pll(uint32_t source)
+{
+  RCC->PLLCKSELR = (4U << RCC_PLLCKSELR_DIVM1_Pos) | RCC_PLLCKSELR_PLLSRC_HSI;
+  RCC->PLL1DIVR = (49U << RCC_PLL1DIVR_N1_Pos) | (1U << RCC_PLL1DIVR_P1_Pos) |
+                  (4U << RCC_PLL1DIVR_Q1_Pos) | (1U << RCC_PLL1DIVR_R1_Pos);
+  RCC->PLLCFGR = RCC_PLLCFGR_DIVP1EN | RCC_PLLCFGR_DIVQ1EN;
+  RCC->CFGR = RCC_CFGR_SW_PLL1 | RCC_CFGR_SWS_PLL1;
+  RCC->D1CFGR = RCC_D1CFGR_HPRE_DIV2;
+  RCC->D1CCIPR = source;
+  HAL_RCC_ClockCacheInvalidate();
+  kernel_hz = (source == RCC_QSPICLKSOURCE_PLL) ? 160000000U : 200000000U;
+}
+
+/* A power-on of the MCU: the flash keeps its state, the handle is zeroed */
+static HAL_StatusTypeDef boot(void)
+{
+  extern QSPI_HandleTypeDef hqspi;
+
+  memset(&hqspi, 0, sizeof(hqspi));
+  log_n = 0U;
+  bad_reads = 0U;
+  bad_why = NULL;
+  flash.ignored = 0U;
+  q.resets = 0U;
+  q.disabled = 0U;
+  q.polls = 0U;
+  return qspi_boot_init();
+}
+
+static void print_log(void)
+{
+  uint32_t i;
+
+  for(i = 0U; i < log_n; i++)
+  {
+    printf("  0x%02x mode %u data 0x%02x x%u\n", log_cmd[i].instruction, log_cmd[i].fmode,
+           log_cmd[i].data, log_cmd[i].nbytes);
+  }
+}
+
+/* The instructions sent, in order */
+static int check_log(const uint8_t *expected, uint32_t n)
+{
+  int ok = HOST_CHECK_EQ(log_n, n);
+  uint32_t i;
+
+  for(i = 0U; ok && (i < n); i++)
+  {
+    ok = HOST_CHECK_EQ(log_cmd[i].instruction, expected[i]);
+  }
+  if(!ok)
+  {
+    print_log();
+  }
+  return ok;
+}
+
+/* The mapped window reads the flash: the vectors and random words */
+static int check_window(void)
+{
+  const volatile uint32_t *window = (const volatile uint32_t *)QSPI_BASE;
+  uint32_t offset;
+  uint32_t word;
+  uint32_t i;
+  int ok = 1;
+
+  for(i = 0U; ok && (i < 64U); i++)
+  {
+    offset = (i < 2U) ? (i * 4U) : ((rnd() % WINDOW) & ~3U);
+    memcpy(&word, &flash.data[offset], sizeof(word));
+    ok = HOST_CHECK_EQ(window[offset / 4U], word);
+  }
+  return ok && HOST_CHECK_EQ(bad_reads, 0U);
+}
+
+static uint32_t prescaler_field(void)
+{
+  return (qspi_get(offsetof(QUADSPI_TypeDef, CR)) & QUADSPI_CR_PRESCALER) >> QUADSPI_CR_PRESCALER_Pos;
+}
+
+/* Fresh part, then the second boot: QE written once, the rest of SR2 kept */
+static int test_fresh(void)
+{
+  const uint8_t first[] = {QSPI_CMD_RESET_ENABLE, QSPI_CMD_RESET_DEVICE, QSPI_CMD_READ_STATUS1,
+                           QSPI_CMD_READ_STATUS2, QSPI_CMD_WRITE_ENABLE, QSPI_CMD_READ_STATUS1,
+                           QSPI_CMD_WRITE_STATUS2, QSPI_CMD_READ_STATUS1,
+                           QSPI_BOOT_DTR ? QSPI_CMD_QUAD_READ_DTR : QSPI_CMD_QUAD_READ};
+  const uint8_t again[] = {QSPI_CMD_RESET_ENABLE, QSPI_CMD_RESET_DEVICE, QSPI_CMD_READ_STATUS1,
+                           QSPI_CMD_READ_STATUS2,
+                           QSPI_BOOT_DTR ? QSPI_CMD_QUAD_READ_DTR : QSPI_CMD_QUAD_READ};
+  uint32_t dcr;
+  int ok = 1;
+
+  flash_fit(1U, 0x08U);
+  clock_hsi();
+  ok &= HOST_CHECK_EQ(boot(), HAL_OK);
+  ok &= check_log(first, sizeof(first));
+  ok &= HOST_CHECK_EQ(flash.sr2, 0x08U | QSPI_STATUS2_QE);
+  ok &= HOST_CHECK_EQ(flash.sr2_writes, 1U);
+  ok &= HOST_CHECK_EQ(flash.ignored, 0U);
+  ok &= HOST_CHECK_EQ(q.resets, 1U);
+  ok &= HOST_CHECK_EQ(q.disabled, 0U);
+  ok &= HOST_CHECK_EQ(prescaler_field(), 0U);
+  dcr = qspi_get(offsetof(QUADSPI_TypeDef, DCR));
+  ok &= HOST_CHECK_EQ(dcr & QUADSPI_DCR_CSHT, QSPI_CS_HIGH_TIME_2_CYCLE);
+  ok &= HOST_CHECK_EQ(dcr & QUADSPI_DCR_CKMODE, QSPI_CLOCK_MODE_0);
+  ok &= check_window();
+
+  ok &= HOST_CHECK_EQ(boot(), HAL_OK);
+  ok &= check_log(again, sizeof(again));
+  ok &= HOST_CHECK_EQ(flash.sr2_writes, 1U);
+  ok &= HOST_CHECK_EQ(flash.ignored, 0U);
+  ok &= check_window();
+  return ok;
+}
+
+/* The prescaler keeps the flash clock at or under its limit, from HCLK
+   and from PLL1Q: 200 MHz is /3 in DTR (66.7 MHz) and /2 in SDR (100 MHz),
+   160 MHz /2 and /2 */
+static int test_clock(void)
+{
+  int ok = 1;
+
+  flash_fit(1U, QSPI_STATUS2_QE);
+  clock_pll(RCC_QSPICLKSOURCE_D1HCLK);
+  ok &= HOST_CHECK_EQ(HAL_RCC_GetHCLKFreq(), 200000000U);
+  ok &= HOST_CHECK_EQ(boot(), HAL_OK);
+  ok &= HOST_CHECK_EQ(prescaler_field(), QSPI_BOOT_DTR ? 2U : 1U);
+  ok &= check_window();
+
+  clock_pll(RCC_QSPICLKSOURCE_PLL);
+  ok &= HOST_CHECK_EQ(boot(), HAL_OK);
+  ok &= HOST_CHECK_EQ(prescaler_field(), 1U);
+  ok &= check_window();
+
+  clock_hsi();
+  return ok;
+}
+
+/* A reset in the middle of an erase: the part stays busy after tRST and
+   only takes status reads until it is done */
+static int test_busy(void)
+{
+  int ok = 1;
+
+  flash_fit(1U, 0x00U);
+  flash.reset_busy_us = 20000U;
+  ok &= HOST_CHECK_EQ(boot(), HAL_OK);
+  ok &= HOST_CHECK_EQ(flash.ignored, 0U);
+  ok &= HOST_CHECK_EQ(flash.sr2, QSPI_STATUS2_QE);
+  ok &= check_window();
+  return ok;
+}
+
+/* A warm restart, the QUADSPI still memory-mapped and busy from the last
+   run: only the peripheral reset makes it take commands */
+static int test_warm(void)
+{
+  int ok = 1;
+
+  flash_fit(1U, QSPI_STATUS2_QE);
+  ok &= HOST_CHECK_EQ(boot(), HAL_OK);
+  ok &= HOST_CHECK_EQ(q.mapped, 1U);
+  ok &= HOST_CHECK_EQ(boot(), HAL_OK);
+  ok &= HOST_CHECK_EQ(q.resets, 1U);
+  ok &= HOST_CHECK_EQ(flash.ignored, 0U);
+  ok &= check_window();
+  return ok;
+}
+
+/* No flash: the lines float high, the first status poll times out and
+   nothing is written or mapped */
+static int test_absent(void)
+{
+  const uint8_t expected[] = {QSPI_CMD_RESET_ENABLE, QSPI_CMD_RESET_DEVICE, QSPI_CMD_READ_STATUS1};
+  uint64_t start;
+  int ok = 1;
+
+  flash_fit(0U, 0x00U);
+  start = now_us;
+  ok &= HOST_CHECK_EQ(boot(), HAL_ERROR);
+  ok &= check_log(expected, sizeof(expected));
+  ok &= HOST_CHECK(now_us - start < 2U * HAL_QSPI_TIMEOUT_DEFAULT_VALUE * 1000U);
+  ok &= HOST_CHECK_EQ(q.mapped, 0U);
+  return ok;
+}
+
+/* qspi_boot_jump() refuses what is not a vector table, and returns with
+   the interrupt state untouched */
+static int test_jump(void)
+{
+  static const struct
+  {
+    uint32_t sp;
+    uint32_t entry;
+  } bad[] = {
+    {0xFFFFFFFFU, 0xFFFFFFFFU},                                 /* erased */
+    {D1_DTCMRAM_BASE, QSPI_BASE + 0x299U},                      /* empty stack */
+    {D1_AXISRAM_BASE + 0x80004U, QSPI_BASE + 0x299U},           /* past the AXI SRAM */
+    {D1_DTCMRAM_BASE + 0x20000U, QSPI_BASE + 0x298U},           /* not Thumb */
+    {D1_AXISRAM_BASE + 0x80000U, QSPI_BASE + FLASH_BYTES + 1U},  /* past the flash */
+    {D1_AXISRAM_BASE + 0x80000U, 0x08000001U},                  /* internal flash */
+  };
+  uint32_t vtor = SCB->VTOR;
+  uint32_t i;
+  int ok = 1;
+
+  flash_fit(1U, QSPI_STATUS2_QE);
+  ok &= HOST_CHECK_EQ(boot(), HAL_OK);
+  for(i = 0U; i < sizeof(bad) / sizeof(bad[0]); i++)
+  {
+    memcpy(&flash.data[0], &bad[i].sp, 4U);
+    memcpy(&flash.data[4], &bad[i].entry, 4U);
+    ok &= HOST_CHECK_EQ(qspi_boot_jump(QSPI_BOOT_APP_ADDR), HAL_ERROR);
+    ok &= HOST_CHECK_EQ(SCB->VTOR, vtor);
+    ok &= HOST_CHECK_EQ(__get_PRIMASK(), 0U);
+  }
+  return ok && HOST_CHECK_EQ(bad_reads, 0U);
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  memset(&qspi_m, 0, sizeof(qspi_m));
+  qspi_m.base = QSPI_R_BASE;
+  qspi_m.size = sizeof(QUADSPI_TypeDef);
+  qspi_m.read = qspi_read;
+  qspi_m.write = qspi_write;
+  host_mmio_attach(&qspi_m);
+  memset(&rcc_m, 0, sizeof(rcc_m));
+  rcc_m.base = RCC_BASE;
+  rcc_m.size = sizeof(RCC_TypeDef);
+  rcc_m.write = rcc_write;
+  host_mmio_attach(&rcc_m);
+  host_map(QSPI_BASE, WINDOW);
+  memset(&window_m, 0, sizeof(window_m));
+  window_m.base = QSPI_BASE;
+  window_m.size = WINDOW;
+  window_m.read = window_read;
+  host_mmio_attach(&window_m);
+
+  printf("qspi_boot: %s\n", QSPI_BOOT_DTR ? "DTR" : "SDR");
+  if(test_fresh() && test_clock() && test_busy() && test_warm() && test_absent())
+  {
+    (void)test_jump();
+  }
+  return host_result();
+}
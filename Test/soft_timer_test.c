@@ -0,0 +1,550 @@
+/* Header includes -----------------------------------------------------------*/
+/* The wheel's tick count is set directly to start runs near its wrap */
+#include "soft_timer.c"
+#include "host.h"
+#include <stddef.h>
+
+/* soft_timer: TIM6 is a model whose update flag the test's tick sets and a
+   0 written to it clears (rc_w0), interrupting while UIE and CEN are set;
+   the NVIC is a model that runs TIM7_IRQHandler() when it is set pending.
+   Runs of millions of ticks detach both and step the two handlers
+   directly. Checked: the tick each timer fires on, for delays on both
+   sides of every wheel level and of the level boundaries the tick count
+   crosses, from several starting counts and across its 32-bit wrap;
+   periodic timers staying on their start + k * period grid, also after
+   TIM7 ran late; a timer stopped from another's callback in the same
+   batch or from a far level, and a periodic one stopping itself; restarts
+   of a timer queued at any level and from its own callback; and random
+   starts, stops and restarts against a reference that knows each
+   deadline. */
+
+/* Private macro -------------------------------------------------------------*/
+#define PROBES                  48U
+#define LEVEL_TICKS(n)          (1UL << (TW_ROOT_BITS + ((n) * TW_LEVEL_BITS)))
+#define TIM7_BIT                (1UL << ((uint32_t)TIM7_IRQn & 31U))
+#define TIM7_ISPR               (offsetof(NVIC_Type, ISPR) + (4U * ((uint32_t)TIM7_IRQn >> 5U)))
+#define TIM7_ISER               (offsetof(NVIC_Type, ISER) + (4U * ((uint32_t)TIM7_IRQn >> 5U)))
+#define TIM7_ICER               (offsetof(NVIC_Type, ICER) + (4U * ((uint32_t)TIM7_IRQn >> 5U)))
+
+/* Private types -------------------------------------------------------------*/
+typedef struct probe_s
+{
+  soft_timer_t t;
+  uint32_t active;              /* as the reference has it */
+  uint32_t due;                 /* soft_timer_now() at the next fire */
+  uint32_t fired;
+  uint32_t wrong;               /* fires off due, or while stopped */
+  uint32_t at;                  /* soft_timer_now() at the last fire */
+  void (*action)(struct probe_s *p);
+  struct probe_s *other;
+  uint32_t n;                   /* for the action */
+} probe_t;
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t seed = 0x2468ACE1U;
+
+static host_mmio_t tim6_m;
+static host_mmio_t nvic_m;
+static volatile uint32_t tim6_sr;
+static volatile uint32_t tim7_enabled;      /* the TIM7 word of ISER */
+static volatile uint32_t tim7_runs;
+/* Models detached, the handlers stepped by tick() */
+static uint32_t fast;
+/* fast: TIM7 left pending */
+static uint32_t tim7_hold;
+
+static probe_t probes[PROBES];
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static uint32_t tim6_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  return (offset == offsetof(TIM_TypeDef, SR)) ? tim6_sr : current;
+}
+
+static void tim6_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  if(offset == offsetof(TIM_TypeDef, SR))
+  {
+    tim6_sr &= value;
+  }
+}
+
+static void nvic_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  if(offset == TIM7_ISER)
+  {
+    tim7_enabled |= value;
+    host_mmio_set(m, offset, tim7_enabled);
+  }
+  else if(offset == TIM7_ICER)
+  {
+    tim7_enabled &= ~value;
+    host_mmio_set(m, TIM7_ISER, tim7_enabled);
+  }
+  else if((offset == TIM7_ISPR) && ((value & TIM7_BIT) != 0U) && ((tim7_enabled & TIM7_BIT) != 0U))
+  {
+    host_mmio_set(m, offset, 0U);
+    tim7_runs++;
+    host_irq_raise(TIM7_IRQHandler);
+  }
+}
+
+static void tim7_dispatch(void)
+{
+  if((NVIC->ISPR[(uint32_t)TIM7_IRQn >> 5U] & TIM7_BIT) != 0U)
+  {
+    NVIC->ISPR[(uint32_t)TIM7_IRQn >> 5U] = 0U;
+    tim7_runs++;
+    TIM7_IRQHandler();
+  }
+}
+
+/* One TIM6 update */
+static void tick(void)
+{
+  if(fast != 0U)
+  {
+    TIM6->SR = TIM_SR_UIF;
+    TIM6_DAC_IRQHandler();
+    if(tim7_hold == 0U)
+    {
+      tim7_dispatch();
+    }
+    return;
+  }
+  if(((host_mmio_get(&tim6_m, offsetof(TIM_TypeDef, CR1)) & TIM_CR1_CEN) != 0U) &&
+     ((host_mmio_get(&tim6_m, offsetof(TIM_TypeDef, DIER)) & TIM_DIER_UIE) != 0U))
+  {
+    tim6_sr |= TIM_SR_UIF;
+    host_irq_raise(TIM6_DAC_IRQHandler);
+  }
+  host_irq_poll();
+}
+
+static void ticks(uint32_t n)
+{
+  while(n-- != 0U)
+  {
+    tick();
+  }
+}
+
+static void on_fire(void *context)
+{
+  probe_t *p = (probe_t *)context;
+
+  p->fired++;
+  p->at = soft_timer_now();
+  if((p->active == 0U) || (p->at != p->due))
+  {
+    p->wrong++;
+  }
+  if(p->t.period == 0U)
+  {
+    p->active = 0U;
+  }
+  p->due += p->t.period;
+  if(p->action != NULL)
+  {
+    p->action(p);
+  }
+}
+
+/* Starts p, fires on the (delay + 1)th tick from now */
+static void arm(probe_t *p, uint32_t delay, uint32_t period)
+{
+  p->active = 1U;
+  p->due = soft_timer_now() + delay + 1U;
+  soft_timer_start(&p->t, delay, period, on_fire, p);
+}
+
+static void disarm(probe_t *p)
+{
+  p->active = 0U;
+  soft_timer_stop(&p->t);
+}
+
+static void clear_probes(void)
+{
+  uint32_t i;
+
+  for(i = 0U; i < PROBES; i++)
+  {
+    soft_timer_stop(&probes[i].t);
+    probes[i].active = 0U;
+    probes[i].fired = 0U;
+    probes[i].wrong = 0U;
+    probes[i].action = NULL;
+    probes[i].other = NULL;
+    probes[i].n = 0U;
+  }
+}
+
+/* An empty wheel whose next tick is now */
+static void wheel_at(uint32_t now)
+{
+  clear_probes();
+  tw_now = now;
+}
+
+static uint32_t wrong_total(void)
+{
+  uint32_t n = 0U;
+  uint32_t i;
+
+  for(i = 0U; i < PROBES; i++)
+  {
+    n += probes[i].wrong;
+  }
+  return n;
+}
+
+/* Action: stops the other probe */
+static void stop_other(probe_t *p)
+{
+  disarm(p->other);
+}
+
+/* Action: stops itself at its n-th fire */
+static void stop_self(probe_t *p)
+{
+  if(p->fired == p->n)
+  {
+    disarm(p);
+  }
+}
+
+/* Action: one-shot re-armed n times, 99 ticks on */
+static void rearm_self(probe_t *p)
+{
+  if(p->fired <= p->n)
+  {
+    arm(p, 99U, 0U);
+  }
+}
+
+/* Action: periodic restarted once with another delay and period */
+static void repace_self(probe_t *p)
+{
+  if(p->fired == 2U)
+  {
+    arm(p, 5U, 13U);
+  }
+}
+
+/* Through the models: the update flag cleared alone, TIM7 set pending at
+   a lower priority than TIM6, and the callbacks of a short run */
+static void test_irq(void)
+{
+  probe_t *p = &probes[0];
+  uint32_t runs;
+
+  HOST_CHECK(NVIC->IP[TIM6_DAC_IRQn] < NVIC->IP[TIM7_IRQn]);
+  HOST_CHECK((tim7_enabled & TIM7_BIT) != 0U);
+  wheel_at(0U);
+  arm(&probes[0], 0U, 0U);
+  arm(&probes[1], 1U, 0U);
+  arm(&probes[2], 300U, 0U);
+  arm(&probes[3], 2U, 7U);
+  runs = tim7_runs;
+  tick();
+  HOST_CHECK_EQ(tim6_sr, 0U);
+  HOST_CHECK_EQ(tim7_runs, runs + 1U);
+  HOST_CHECK_EQ(p->fired, 1U);
+  ticks(400U);
+  HOST_CHECK_EQ(probes[1].fired, 1U);
+  HOST_CHECK_EQ(probes[2].fired, 1U);
+  HOST_CHECK_EQ(probes[3].fired, ((401U - 3U) / 7U) + 1U);
+  HOST_CHECK_EQ(wrong_total(), 0U);
+  /* Nothing due, no TIM7 */
+  disarm(&probes[3]);
+  runs = tim7_runs;
+  ticks(20U);
+  HOST_CHECK_EQ(tim7_runs, runs);
+}
+
+/* Delays on both sides of each level, and of each level boundary ahead of
+   the tick count, fire on their tick */
+static void test_cascade(uint32_t now, uint32_t levels)
+{
+  static const uint32_t near[] = {0U, 1U, 2U, 254U, 255U, 256U, 257U, 511U, 512U};
+  uint32_t n = 0U;
+  uint32_t last = 0U;
+  uint32_t d;
+  uint32_t i;
+  uint32_t k;
+
+  wheel_at(now);
+  for(i = 0U; i < (sizeof(near) / sizeof(near[0])); i++)
+  {
+    arm(&probes[n++], near[i], 0U);
+  }
+  for(k = 1U; k <= levels; k++)
+  {
+    for(i = 0U; i < 3U; i++)
+    {
+      /* Around the level's span, and the next boundary of the level */
+      d = LEVEL_TICKS(k - 1U) - 1U + i;
+      arm(&probes[n++], d, 0U);
+      last = (d > last) ? d : last;
+      d = LEVEL_TICKS(k - 1U) - (now & (LEVEL_TICKS(k - 1U) - 1U)) - 1U + i;
+      arm(&probes[n++], d, 0U);
+      last = (d > last) ? d : last;
+    }
+  }
+  /* Deep in the last level */
+  d = LEVEL_TICKS(levels - 1U) + (3U * LEVEL_TICKS(levels - 2U)) + 777U;
+  arm(&probes[n++], d, 0U);
+  last = (d > last) ? d : last;
+
+  ticks(last + 1U);
+  for(i = 0U; i < n; i++)
+  {
+    if(!HOST_CHECK_EQ(probes[i].fired, 1U) || !HOST_CHECK_EQ(probes[i].wrong, 0U))
+    {
+      printf("  from %08x, delay %u: fired %u at %08x, due %08x\n", (unsigned)now,
+             (unsigned)(probes[i].t.expires - now), (unsigned)probes[i].fired, (unsigned)probes[i].at,
+             (unsigned)probes[i].due);
+    }
+    HOST_CHECK_EQ(soft_timer_is_active(&probes[i].t), 0U);
+  }
+  printf("cascade from %08x: %u timers, %u ticks\n", (unsigned)now, (unsigned)n, (unsigned)(last + 1U));
+}
+
+/* Periodic timers stay on their grid, also across a late TIM7 */
+static void test_periodic(void)
+{
+  static const uint32_t pattern[][2] =
+  {
+    {0U, 1U}, {3U, 7U}, {100U, 256U}, {1000U, 300U}, {5U, 16384U}, {20000U, 70000U}, {255U, 257U},
+  };
+  const uint32_t n = sizeof(pattern) / sizeof(pattern[0]);
+  const uint32_t run = 1U << 20;
+  uint32_t i;
+
+  wheel_at(0xFFF00000U);
+  for(i = 0U; i < n; i++)
+  {
+    arm(&probes[i], pattern[i][0], pattern[i][1]);
+  }
+  ticks(run);
+  for(i = 0U; i < n; i++)
+  {
+    HOST_CHECK_EQ(probes[i].fired, ((run - pattern[i][0] - 1U) / pattern[i][1]) + 1U);
+    HOST_CHECK_EQ(probes[i].wrong, 0U);
+  }
+
+  /* TIM7 held for 40 ticks: the fires due meanwhile come late, one per
+     tick, and the ones after are back on the grid. A period of one tick
+     would stay behind for good. */
+  wheel_at(1000U);
+  arm(&probes[0], 0U, 2U);
+  arm(&probes[1], 4U, 7U);
+  ticks(10U);
+  tim7_hold = 1U;
+  ticks(40U);
+  HOST_CHECK_EQ(probes[0].fired, 5U);
+  tim7_hold = 0U;
+  tim7_dispatch();
+  ticks(450U);
+  HOST_CHECK_EQ(probes[0].fired, 250U);
+  HOST_CHECK_EQ(probes[0].at, probes[0].due - 2U);
+  HOST_CHECK_EQ(probes[1].fired, ((500U - 5U) / 7U) + 1U);
+  HOST_CHECK_EQ(probes[1].at, probes[1].due - 7U);
+  HOST_CHECK_EQ((probes[1].at - 1000U - 5U) % 7U, 0U);
+  HOST_CHECK(probes[0].wrong <= 40U);
+  HOST_CHECK(probes[1].wrong <= 7U);
+}
+
+/* Stops from callbacks */
+static void test_cancel(void)
+{
+  probe_t *a = &probes[0];
+  probe_t *b = &probes[1];
+  probe_t *c = &probes[2];
+  probe_t *d = &probes[3];
+  probe_t *e = &probes[4];
+
+  wheel_at(0x7FFFFF80U);
+  /* b would fire after a in the same batch */
+  arm(a, 300U, 0U);
+  arm(b, 300U, 0U);
+  a->action = stop_other;
+  a->other = b;
+  /* d fires before c in the batch, c's stop finds it fired */
+  arm(d, 20U, 0U);
+  arm(c, 20U, 0U);
+  c->action = stop_other;
+  c->other = d;
+  /* A periodic timer stopping itself at its third fire */
+  arm(e, 10U, 30U);
+  e->action = stop_self;
+  e->n = 3U;
+  /* A timer two levels up stopped by a callback */
+  arm(&probes[5], 50U, 0U);
+  probes[5].action = stop_other;
+  probes[5].other = &probes[6];
+  arm(&probes[6], LEVEL_TICKS(2U) + 5U, 0U);
+
+  ticks(LEVEL_TICKS(2U) + 10U);
+  HOST_CHECK_EQ(a->fired, 1U);
+  HOST_CHECK_EQ(b->fired, 0U);
+  HOST_CHECK_EQ(soft_timer_is_active(&b->t), 0U);
+  HOST_CHECK_EQ(c->fired, 1U);
+  HOST_CHECK_EQ(d->fired, 1U);
+  HOST_CHECK_EQ(e->fired, 3U);
+  HOST_CHECK_EQ(soft_timer_is_active(&e->t), 0U);
+  HOST_CHECK_EQ(probes[5].fired, 1U);
+  HOST_CHECK_EQ(probes[6].fired, 0U);
+  HOST_CHECK_EQ(soft_timer_is_active(&probes[6].t), 0U);
+  HOST_CHECK_EQ(wrong_total(), 0U);
+}
+
+/* Restarts of running timers, from outside and from their callback */
+static void test_restart(void)
+{
+  static const uint32_t delays[] = {5U, 300U, 20000U, 1U << 21, (1U << 26) + 3U};
+  const uint32_t n = sizeof(delays) / sizeof(delays[0]);
+  uint32_t i;
+  uint32_t j;
+
+  /* Queued at each level, restarted into each other level */
+  for(i = 0U; i < n; i++)
+  {
+    for(j = 0U; j < n; j++)
+    {
+      if((delays[j] > LEVEL_TICKS(2U)) && (i != j))
+      {
+        continue;
+      }
+      wheel_at(0xFFFFFFF0U - (i * 1000U));
+      arm(&probes[0], delays[i], 0U);
+      arm(&probes[1], delays[i], 0U);
+      ticks(3U);
+      arm(&probes[0], delays[j], 0U);
+      ticks(((delays[i] > delays[j]) ? delays[i] : delays[j]) + 1U);
+      HOST_CHECK_EQ(probes[0].fired, 1U);
+      HOST_CHECK_EQ(probes[1].fired, 1U);
+      HOST_CHECK_EQ(wrong_total(), 0U);
+    }
+  }
+
+  wheel_at(12345U);
+  /* Periodic restarted as a one-shot */
+  arm(&probes[0], 0U, 50U);
+  ticks(120U);
+  HOST_CHECK_EQ(probes[0].fired, 3U);
+  arm(&probes[0], 7U, 0U);
+  ticks(200U);
+  HOST_CHECK_EQ(probes[0].fired, 4U);
+  HOST_CHECK_EQ(soft_timer_is_active(&probes[0].t), 0U);
+  /* A one-shot re-arming itself, a periodic one changing pace */
+  arm(&probes[1], 10U, 0U);
+  probes[1].action = rearm_self;
+  probes[1].n = 4U;
+  arm(&probes[2], 0U, 40U);
+  probes[2].action = repace_self;
+  ticks(11U + (4U * 100U) + 10U);
+  HOST_CHECK_EQ(probes[1].fired, 5U);
+  HOST_CHECK_EQ(soft_timer_is_active(&probes[1].t), 0U);
+  HOST_CHECK_EQ(probes[2].fired, 2U + ((421U - 41U - 6U) / 13U) + 1U);
+  HOST_CHECK_EQ(wrong_total(), 0U);
+}
+
+/* Random starts, stops and restarts; every due timer fires on its tick */
+static void test_random(void)
+{
+  uint32_t missed = 0U;
+  uint32_t ops = 0U;
+  uint32_t step;
+  uint32_t fired = 0U;
+  uint32_t delay;
+  uint32_t i;
+  probe_t *p;
+
+  wheel_at(0xFFFC0000U);
+  for(step = 0U; step < 400000U; step++)
+  {
+    while((rnd() & 3U) == 0U)
+    {
+      p = &probes[rnd() % PROBES];
+      switch(rnd() % 8U)
+      {
+        case 0U:
+          disarm(p);
+          break;
+        case 1U:
+          arm(p, rnd() % 64U, 1U + (rnd() % 3000U));
+          break;
+        default:
+          delay = rnd() >> (8U + (rnd() % 24U));
+          arm(p, delay, 0U);
+          break;
+      }
+      ops++;
+    }
+    tick();
+    for(i = 0U; i < PROBES; i++)
+    {
+      p = &probes[i];
+      if((p->active != 0U) && ((int32_t)(soft_timer_now() - p->due) > 0))
+      {
+        missed++;
+        p->active = 0U;
+      }
+      HOST_CHECK_EQ(soft_timer_is_active(&p->t), p->active);
+    }
+  }
+  for(i = 0U; i < PROBES; i++)
+  {
+    fired += probes[i].fired;
+  }
+  HOST_CHECK_EQ(missed, 0U);
+  HOST_CHECK_EQ(wrong_total(), 0U);
+  HOST_CHECK(fired > 10000U);
+  printf("random: %u operations, %u fires\n", (unsigned)ops, (unsigned)fired);
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  uint32_t i;
+
+  tim6_m.base = (uintptr_t)TIM6;
+  tim6_m.size = sizeof(TIM_TypeDef);
+  tim6_m.read = tim6_read;
+  tim6_m.write = tim6_write;
+  host_mmio_attach(&tim6_m);
+  nvic_m.base = (uintptr_t)NVIC;
+  nvic_m.size = offsetof(NVIC_Type, ICPR);
+  nvic_m.write = nvic_write;
+  host_mmio_attach(&nvic_m);
+
+  for(i = 0U; i < PROBES; i++)
+  {
+    soft_timer_setup(&probes[i].t);
+  }
+  soft_timer_init();
+  test_irq();
+
+  host_mmio_detach(&tim6_m);
+  host_mmio_detach(&nvic_m);
+  fast = 1U;
+  test_cascade(0U, 4U);
+  test_cascade(0x0009ABCDU, 3U);
+  test_cascade(0xFFFFFF00U - (1U << 26), 4U);
+  test_cascade(0xFFFFFFFFU, 2U);
+  test_periodic();
+  test_cancel();
+  test_restart();
+  test_random();
+  return host_result();
+}
@@ -0,0 +1,683 @@
+/* Header includes -----------------------------------------------------------*/
+#include "spi_queue.h"
+#include "pin.h"
+#include <stddef.h>
+#include <string.h>
+
+/* spi_queue: transactions run through the real HAL interrupt path against
+   an SPI1 model that clocks one frame per microsecond of a simulated
+   timebase, with the chip selects on a GPIOB model. The frames seen on
+   the wire are checked against each transaction: chip select, mode,
+   clock, data both ways, TSIZE reload chaining, the CS-to-clock delays
+   and that nothing waits for them in the caller or an interrupt. */
+
+/* Private macro -------------------------------------------------------------*/
+#define FIFO_MAX                16U
+#define FRAME_MAX               4096U
+#define EDGE_MAX                1024U
+#define XFER_MAX                64U
+#define DEV_A                   GPIOB, PIN_BIT(0)
+#define DEV_B                   GPIOB, PIN_BIT(1)
+#define CS_MASK                 0x0003U
+#define RUN_MAX                 100000U
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  uint64_t t;
+  uint32_t cs;                  /* GPIOB ODR & CS_MASK */
+  uint32_t cfg1;
+  uint32_t cfg2;
+  uint32_t start;               /* CSTART it was clocked under */
+  uint8_t out;
+  uint8_t in;
+} frame_t;
+
+typedef struct
+{
+  uint64_t t;
+  uint32_t cs;
+} edge_t;
+
+typedef struct
+{
+  spi_xfer_t x;
+  uint8_t tx[16];
+  uint8_t rx[16];
+  uint32_t order;               /* done() count when it was called */
+  HAL_StatusTypeDef status;
+  uint64_t done_t;
+} xfer_t;
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t seed = 0x13579BDFU;
+static SPI_HandleTypeDef hspi;
+static SPI_HandleTypeDef hspi_other;
+static spi_queue_t q;
+
+/* Simulated timebase: time moves only while the test waits in __WFI() */
+static volatile uint64_t now_us;
+static timebase_alarm_t *volatile armed;
+
+/* SPI1: full-duplex master, TSIZE and TSER, 16-frame FIFOs */
+static host_mmio_t spi_m;
+static volatile struct
+{
+  uint8_t tx[FIFO_MAX];
+  uint32_t tx_n;
+  uint8_t rx[FIFO_MAX];
+  uint32_t rx_n;
+  uint32_t running;
+  uint32_t remaining;
+  uint32_t tser;
+  uint32_t sr;                  /* latched flags */
+  uint32_t starts;
+  uint32_t fault;               /* mode fault on the next frame */
+  uint32_t cfg_while_on;        /* CFG1/CFG2 stores with SPE set */
+  uint8_t device;               /* next byte the device answers */
+} spi;
+static volatile frame_t frames[FRAME_MAX];
+static volatile uint32_t frame_n;
+
+/* GPIOB: the chip selects, edges logged */
+static host_mmio_t port;
+static volatile edge_t edges[EDGE_MAX];
+static volatile uint32_t edge_n;
+
+static volatile uint32_t done_n;
+static volatile uint32_t other_n;
+static SPI_HandleTypeDef *volatile other_hspi;
+static volatile uint32_t other_event;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static uint32_t spi_reg(uint32_t offset)
+{
+  return host_mmio_get(&spi_m, offset);
+}
+
+static uint32_t spi_sr(void)
+{
+  uint32_t sr = spi.sr;
+
+  if((spi_reg(offsetof(SPI_TypeDef, CR1)) & SPI_CR1_SPE) != 0U)
+  {
+    sr |= (spi.tx_n < FIFO_MAX) ? SPI_SR_TXP : 0U;
+    sr |= (spi.rx_n != 0U) ? SPI_SR_RXP : 0U;
+    sr |= ((sr & (SPI_SR_TXP | SPI_SR_RXP)) == (SPI_SR_TXP | SPI_SR_RXP)) ? SPI_SR_DXP : 0U;
+  }
+  return sr;
+}
+
+static void spi_isr(void)
+{
+  HAL_SPI_IRQHandler(&hspi);
+}
+
+static void spi_irq_update(void)
+{
+  if((spi_sr() & spi_reg(offsetof(SPI_TypeDef, IER))) != 0U)
+  {
+    host_irq_raise(spi_isr);
+  }
+}
+
+static uint32_t spi_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  uint32_t v = current;
+  uint32_t i;
+
+  (void)m;
+  if(offset == offsetof(SPI_TypeDef, SR))
+  {
+    v = spi_sr();
+  }
+  else if(offset == offsetof(SPI_TypeDef, RXDR))
+  {
+    HOST_CHECK(spi.rx_n != 0U);
+    v = spi.rx[0];
+    if(spi.rx_n != 0U)
+    {
+      spi.rx_n--;
+      for(i = 0U; i < spi.rx_n; i++)
+      {
+        spi.rx[i] = spi.rx[i + 1U];
+      }
+    }
+  }
+  return v;
+}
+
+static void spi_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  if(offset == offsetof(SPI_TypeDef, CR1))
+  {
+    if((value & SPI_CR1_SPE) == 0U)
+    {
+      /* Disabling flushes the FIFOs and ends the transfer */
+      spi.running = 0U;
+      spi.tx_n = 0U;
+      spi.rx_n = 0U;
+      spi.tser = 0U;
+      host_mmio_set(m, offset, value & ~SPI_CR1_CSTART);
+    }
+    else if(((value & SPI_CR1_CSTART) != 0U) && (spi.running == 0U))
+    {
+      spi.running = 1U;
+      spi.remaining = spi_reg(offsetof(SPI_TypeDef, CR2)) & SPI_CR2_TSIZE;
+      spi.tser = 0U;
+      spi.starts++;
+    }
+  }
+  else if(offset == offsetof(SPI_TypeDef, CR2))
+  {
+    if(spi.running != 0U)
+    {
+      spi.tser = (value & SPI_CR2_TSER) >> SPI_CR2_TSER_Pos;
+    }
+  }
+  else if((offset == offsetof(SPI_TypeDef, CFG1)) || (offset == offsetof(SPI_TypeDef, CFG2)))
+  {
+    if((spi_reg(offsetof(SPI_TypeDef, CR1)) & SPI_CR1_SPE) != 0U)
+    {
+      spi.cfg_while_on++;
+    }
+  }
+  else if(offset == offsetof(SPI_TypeDef, TXDR))
+  {
+    HOST_CHECK_EQ(size, 1U);
+    if(HOST_CHECK(spi.tx_n < FIFO_MAX))
+    {
+      spi.tx[spi.tx_n++] = (uint8_t)value;
+    }
+  }
+  else if(offset == offsetof(SPI_TypeDef, IFCR))
+  {
+    spi.sr &= ~(value & 0x0FF8U);
+    host_mmio_set(m, offset, 0U);
+  }
+  spi_irq_update();
+}
+
+/* One frame, if the transfer can make progress */
+static void spi_clock(void)
+{
+  uint32_t ier = spi_reg(offsetof(SPI_TypeDef, IER));
+  uint32_t cr2;
+  uint8_t out = 0xFFU;
+  uint32_t i;
+
+  if((spi.running == 0U) || (spi.remaining == 0U))
+  {
+    return;
+  }
+  /* The master waits for data to send or room for what it receives */
+  if((spi.tx_n == 0U) && ((ier & SPI_IER_TXPIE) != 0U))
+  {
+    return;
+  }
+  if((spi.rx_n == FIFO_MAX) && ((ier & SPI_IER_RXPIE) != 0U))
+  {
+    return;
+  }
+  if(spi.tx_n != 0U)
+  {
+    out = spi.tx[0];
+    spi.tx_n--;
+    for(i = 0U; i < spi.tx_n; i++)
+    {
+      spi.tx[i] = spi.tx[i + 1U];
+    }
+  }
+
+  if(frame_n < FRAME_MAX)
+  {
+    frames[frame_n].t = now_us;
+    frames[frame_n].cs = host_mmio_get(&port, offsetof(GPIO_TypeDef, ODR)) & CS_MASK;
+    frames[frame_n].cfg1 = spi_reg(offsetof(SPI_TypeDef, CFG1));
+    frames[frame_n].cfg2 = spi_reg(offsetof(SPI_TypeDef, CFG2));
+    frames[frame_n].start = spi.starts;
+    frames[frame_n].out = out;
+    frames[frame_n].in = spi.device;
+  }
+  frame_n++;
+  if(spi.rx_n < FIFO_MAX)
+  {
+    spi.rx[spi.rx_n++] = spi.device;
+  }
+  else
+  {
+    spi.sr |= SPI_SR_OVR;
+  }
+  spi.device = (uint8_t)((spi.device * 5U) + 1U);
+  if(spi.fault != 0U)
+  {
+    spi.fault = 0U;
+    spi.sr |= SPI_SR_MODF;
+  }
+
+  spi.remaining--;
+  if(spi.remaining == 0U)
+  {
+    cr2 = spi_reg(offsetof(SPI_TypeDef, CR2));
+    if(spi.tser != 0U)
+    {
+      spi.remaining = spi.tser;
+      spi.tser = 0U;
+      spi.sr |= SPI_SR_TSERF;
+      host_mmio_set(&spi_m, offsetof(SPI_TypeDef, CR2), (cr2 & ~(SPI_CR2_TSER | SPI_CR2_TSIZE)) | spi.remaining);
+    }
+    else
+    {
+      spi.running = 0U;
+      spi.sr |= SPI_SR_EOT | SPI_SR_TXTF;
+      host_mmio_set(&spi_m, offsetof(SPI_TypeDef, CR1),
+                    spi_reg(offsetof(SPI_TypeDef, CR1)) & ~SPI_CR1_CSTART);
+    }
+  }
+  spi_irq_update();
+}
+
+static void port_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  uint32_t odr;
+
+  (void)size;
+  if(offset == offsetof(GPIO_TypeDef, BSRR))
+  {
+    odr = host_mmio_get(m, offsetof(GPIO_TypeDef, ODR));
+    odr = (odr & ~(value >> 16)) | (value & 0xFFFFU);
+    host_mmio_set(m, offsetof(GPIO_TypeDef, ODR), odr);
+    host_mmio_set(m, offset, 0U);
+    if(edge_n < EDGE_MAX)
+    {
+      edges[edge_n].t = now_us;
+      edges[edge_n].cs = odr & CS_MASK;
+    }
+    edge_n++;
+  }
+}
+
+static uint32_t cs_now(void)
+{
+  return host_mmio_get(&port, offsetof(GPIO_TypeDef, ODR)) & CS_MASK;
+}
+
+static void tim5_isr(void)
+{
+  timebase_alarm_t *a = armed;
+
+  armed = NULL;
+  a->callback(a->context);
+}
+
+/* A microsecond goes by */
+static void idle(void)
+{
+  now_us++;
+  spi_clock();
+  if((armed != NULL) && (armed->deadline <= now_us))
+  {
+    host_irq_raise(tim5_isr);
+  }
+}
+
+/* Until the queue is idle */
+static void run(void)
+{
+  uint32_t n;
+
+  for(n = 0U; (n < RUN_MAX) && (spi_queue_idle(&q) == 0U); n++)
+  {
+    __WFI();
+  }
+  HOST_CHECK(spi_queue_idle(&q));
+  HOST_CHECK(armed == NULL);
+}
+
+static void reset_logs(void)
+{
+  frame_n = 0U;
+  edge_n = 0U;
+  done_n = 0U;
+  spi.starts = 0U;
+}
+
+static void xfer_done(spi_xfer_t *xfer, HAL_StatusTypeDef status)
+{
+  xfer_t *t = (xfer_t *)xfer->context;
+
+  t->order = done_n++;
+  t->status = status;
+  t->done_t = now_us;
+}
+
+/* kind: 1 transmit, 2 receive, 3 both */
+static void xfer_make(xfer_t *t, GPIO_TypeDef *port_, uint32_t mask, uint32_t kind, uint32_t len)
+{
+  uint32_t i;
+
+  memset(t, 0, sizeof(*t));
+  for(i = 0U; i < sizeof(t->tx); i++)
+  {
+    t->tx[i] = (uint8_t)rnd();
+  }
+  memset(t->rx, 0xEE, sizeof(t->rx));
+  t->x.cs_port = port_;
+  t->x.cs_mask = mask;
+  t->x.tx = ((kind & 1U) != 0U) ? t->tx : NULL;
+  t->x.rx = ((kind & 2U) != 0U) ? t->rx : NULL;
+  t->x.len = (uint16_t)len;
+  t->x.done = xfer_done;
+  t->x.context = t;
+  t->order = 0xFFFFFFFFU;
+  t->status = HAL_TIMEOUT;
+}
+
+/* The frames of t start at *f: its device selected alone, its mode and
+   clock, its data both ways. A receive clocks out what its buffer held
+   (the HAL's dummy data). Returns the CSTART of its first frame. */
+static uint32_t check_frames(const xfer_t *t, uint32_t *f)
+{
+  uint32_t mbr = (t->x.prescaler != 0U) ? (t->x.prescaler & SPI_CFG1_MBR) : SPI_BAUDRATEPRESCALER_16;
+  uint32_t start = frames[*f].start;
+  uint32_t i;
+  volatile const frame_t *fr;
+
+  if(!HOST_CHECK(*f + t->x.len <= frame_n))
+  {
+    return start;
+  }
+  for(i = 0U; i < t->x.len; i++)
+  {
+    fr = &frames[*f + i];
+    if(!HOST_CHECK_EQ(fr->cs, CS_MASK & ~t->x.cs_mask) ||
+       !HOST_CHECK_EQ(fr->cfg2 & (SPI_CFG2_CPOL | SPI_CFG2_CPHA), t->x.mode) ||
+       !HOST_CHECK_EQ(fr->cfg1 & SPI_CFG1_MBR, mbr) ||
+       !HOST_CHECK_EQ(fr->out, (t->x.tx != NULL) ? t->tx[i] : 0xEEU) ||
+       !HOST_CHECK_EQ((t->x.rx != NULL) ? t->rx[i] : fr->in, fr->in))
+    {
+      break;
+    }
+  }
+  *f += t->x.len;
+  return start;
+}
+
+static void test_sequence(void)
+{
+  static xfer_t xf[XFER_MAX];
+  uint32_t dev;
+  uint32_t f = 0U;
+  uint32_t i;
+
+  reset_logs();
+  for(i = 0U; i < XFER_MAX; i++)
+  {
+    dev = rnd() & 1U;
+    xfer_make(&xf[i], GPIOB, PIN_BIT(dev), 1U + (rnd() % 3U), 1U + (rnd() % SPI_QUEUE_IT_MAX));
+    /* A: mode 0 at its own clock, B: mode 3 at the initial one */
+    xf[i].x.mode = (dev == 0U) ? SPI_XFER_MODE_0 : SPI_XFER_MODE_3;
+    xf[i].x.prescaler = (dev == 0U) ? SPI_XFER_PRESCALER(SPI_BAUDRATEPRESCALER_8) : 0U;
+    HOST_CHECK_EQ(spi_queue_submit(&q, &xf[i].x), HAL_OK);
+  }
+  run();
+
+  for(i = 0U; i < XFER_MAX; i++)
+  {
+    HOST_CHECK_EQ(xf[i].order, i);
+    HOST_CHECK_EQ(xf[i].status, HAL_OK);
+    /* Each its own transfer, CS released in between */
+    HOST_CHECK_EQ(check_frames(&xf[i], &f), i + 1U);
+  }
+  HOST_CHECK_EQ(frame_n, f);
+  HOST_CHECK_EQ(spi.starts, XFER_MAX);
+  HOST_CHECK_EQ(edge_n, 2U * XFER_MAX);
+  HOST_CHECK_EQ(cs_now(), CS_MASK);
+  HOST_CHECK_EQ(q.stats.errors, 0U);
+}
+
+/* An address held under CS, then the data in the same transfer */
+static void test_chain(void)
+{
+  static xfer_t blocker;
+  static xfer_t a;
+  static xfer_t b;
+  uint32_t reloads;
+  uint32_t kind;
+  uint32_t f;
+
+  for(kind = 1U; kind <= 3U; kind++)
+  {
+    reset_logs();
+    reloads = q.stats.reloads;
+    xfer_make(&blocker, DEV_B, 1U, 4U);
+    xfer_make(&a, DEV_A, kind, 2U);
+    a.x.flags = SPI_XFER_HOLD_CS;
+    xfer_make(&b, DEV_A, kind, 1U + (rnd() % SPI_QUEUE_IT_MAX));
+    /* b is queued by the time a starts */
+    spi_queue_submit(&q, &blocker.x);
+    spi_queue_submit(&q, &a.x);
+    spi_queue_submit(&q, &b.x);
+    run();
+
+    HOST_CHECK_EQ(q.stats.reloads, reloads + 1U);
+    HOST_CHECK_EQ(a.status, HAL_OK);
+    HOST_CHECK_EQ(b.status, HAL_OK);
+    HOST_CHECK_EQ(b.order, a.order + 1U);
+    f = 0U;
+    HOST_CHECK_EQ(check_frames(&blocker, &f), 1U);
+    HOST_CHECK_EQ(check_frames(&a, &f), 2U);
+    /* No gap: the clock runs on from a into b */
+    HOST_CHECK(frames[f].t - frames[f - 1U].t <= 1U);
+    HOST_CHECK_EQ(check_frames(&b, &f), 2U);
+    HOST_CHECK_EQ(frame_n, f);
+    /* blocker low/high, A low/high */
+    HOST_CHECK_EQ(edge_n, 4U);
+    HOST_CHECK_EQ(cs_now(), CS_MASK);
+  }
+}
+
+static void test_delays(void)
+{
+  static xfer_t a;
+  static xfer_t b;
+  uint64_t t0 = now_us;
+  uint32_t f;
+
+  reset_logs();
+  xfer_make(&a, DEV_A, 3U, 4U);
+  a.x.pre_us = 20U;
+  a.x.post_us = 30U;
+  xfer_make(&b, DEV_B, 1U, 3U);
+  b.x.post_us = 5U;
+
+  /* Returns with CS asserted and the first clock left to the alarm */
+  HOST_CHECK_EQ(spi_queue_submit(&q, &a.x), HAL_OK);
+  HOST_CHECK_EQ(now_us, t0);
+  HOST_CHECK_EQ(cs_now(), CS_MASK & ~PIN_BIT(0));
+  HOST_CHECK_EQ(spi.starts, 0U);
+  HOST_CHECK(armed != NULL);
+  HOST_CHECK(!spi_queue_idle(&q));
+  HOST_CHECK_EQ(spi_queue_submit(&q, &b.x), HAL_OK);
+  run();
+
+  HOST_CHECK_EQ(a.status, HAL_OK);
+  HOST_CHECK_EQ(b.status, HAL_OK);
+  HOST_CHECK_EQ(b.order, a.order + 1U);
+  f = 0U;
+  check_frames(&a, &f);
+  check_frames(&b, &f);
+  if(!HOST_CHECK_EQ(edge_n, 4U) || !HOST_CHECK_EQ(frame_n, 7U))
+  {
+    return;
+  }
+  /* At least the delay, and not much more */
+  HOST_CHECK_EQ(edges[0].t, t0);
+  HOST_CHECK(frames[0].t - edges[0].t > 20U);
+  HOST_CHECK(frames[0].t - edges[0].t <= 23U);
+  HOST_CHECK(edges[1].t - frames[3].t > 30U);
+  HOST_CHECK(edges[1].t - frames[3].t <= 33U);
+  HOST_CHECK(a.done_t >= edges[1].t);
+  /* b selected after a is released, released 5 us after its last frame */
+  HOST_CHECK_EQ(edges[2].cs, CS_MASK & ~PIN_BIT(1));
+  HOST_CHECK(edges[2].t >= edges[1].t);
+  HOST_CHECK(frames[4].t > edges[2].t);
+  HOST_CHECK(edges[3].t - frames[6].t > 5U);
+  HOST_CHECK(edges[3].t - frames[6].t <= 8U);
+  HOST_CHECK_EQ(cs_now(), CS_MASK);
+}
+
+static void test_error(void)
+{
+  static xfer_t a;
+  static xfer_t b;
+  uint32_t errors = q.stats.errors;
+  uint32_t f;
+
+  reset_logs();
+  xfer_make(&a, DEV_A, 3U, 8U);
+  xfer_make(&b, DEV_B, 3U, 4U);
+  spi.fault = 1U;
+  spi_queue_submit(&q, &a.x);
+  spi_queue_submit(&q, &b.x);
+  run();
+
+  HOST_CHECK_EQ(a.status, HAL_ERROR);
+  HOST_CHECK_EQ(q.stats.errors, errors + 1U);
+  /* The next one runs as usual */
+  HOST_CHECK_EQ(b.status, HAL_OK);
+  HOST_CHECK_EQ(b.order, a.order + 1U);
+  f = frame_n - b.x.len;
+  check_frames(&b, &f);
+  HOST_CHECK_EQ(cs_now(), CS_MASK);
+}
+
+/* done() queues the same transaction again, ten times */
+static void resubmit_done(spi_xfer_t *xfer, HAL_StatusTypeDef status)
+{
+  HOST_CHECK_EQ(status, HAL_OK);
+  /* Still this transaction's turn: it goes behind */
+  HOST_CHECK(!spi_queue_idle(&q));
+  if(++done_n < 10U)
+  {
+    HOST_CHECK_EQ(spi_queue_submit(&q, xfer), HAL_OK);
+  }
+}
+
+static void test_resubmit(void)
+{
+  static xfer_t a;
+  uint32_t f = 0U;
+  uint32_t i;
+
+  reset_logs();
+  xfer_make(&a, DEV_A, 1U, 5U);
+  a.x.done = resubmit_done;
+  spi_queue_submit(&q, &a.x);
+  run();
+
+  HOST_CHECK_EQ(done_n, 10U);
+  HOST_CHECK_EQ(spi.starts, 10U);
+  HOST_CHECK_EQ(edge_n, 20U);
+  for(i = 0U; i < 10U; i++)
+  {
+    HOST_CHECK_EQ(check_frames(&a, &f), i + 1U);
+  }
+}
+
+static void test_other(void)
+{
+  uint32_t xfers = q.stats.xfers;
+
+  /* Nothing so far went past the queue */
+  HOST_CHECK_EQ(other_n, 0U);
+
+  HAL_SPI_TxCpltCallback(&hspi_other);
+  HOST_CHECK_EQ(other_n, 1U);
+  HOST_CHECK(other_hspi == &hspi_other);
+  HOST_CHECK_EQ(other_event, SPI_QUEUE_TX_CPLT);
+  HAL_SPI_RxCpltCallback(&hspi_other);
+  HOST_CHECK_EQ(other_event, SPI_QUEUE_RX_CPLT);
+  HAL_SPI_TxRxCpltCallback(&hspi_other);
+  HOST_CHECK_EQ(other_event, SPI_QUEUE_TXRX_CPLT);
+  HAL_SPI_ErrorCallback(&hspi_other);
+  HOST_CHECK_EQ(other_event, SPI_QUEUE_ERROR);
+  HOST_CHECK_EQ(other_n, 4U);
+
+  /* A stray callback of the queue's SPI with nothing running */
+  HAL_SPI_TxCpltCallback(&hspi);
+  HOST_CHECK_EQ(other_n, 4U);
+  HOST_CHECK_EQ(q.stats.xfers, xfers);
+
+  HOST_CHECK_EQ(spi_queue_submit(&q, &(spi_xfer_t){.len = 0U, .tx = &xfers}), HAL_ERROR);
+  HOST_CHECK_EQ(spi_queue_submit(&q, &(spi_xfer_t){.len = 1U}), HAL_ERROR);
+}
+
+/* Function definitions ------------------------------------------------------*/
+/* The timebase, one alarm at a time is all the queue needs */
+void timebase_alarm_start_in(timebase_alarm_t *alarm, uint32_t delay_us,
+                             timebase_callback_t callback, void *context)
+{
+  HOST_CHECK((armed == NULL) || (armed == alarm));
+  alarm->deadline = now_us + delay_us;
+  alarm->callback = callback;
+  alarm->context = context;
+  armed = alarm;
+}
+
+void spi_queue_other_callback(SPI_HandleTypeDef *h, uint32_t event)
+{
+  other_n++;
+  other_hspi = h;
+  other_event = event;
+}
+
+int main(void)
+{
+  spi_m.base = SPI1_BASE;
+  spi_m.size = sizeof(SPI_TypeDef);
+  spi_m.read = spi_read;
+  spi_m.write = spi_write;
+  host_mmio_attach(&spi_m);
+  port.base = GPIOB_BASE;
+  port.size = sizeof(GPIO_TypeDef);
+  port.write = port_write;
+  host_mmio_attach(&port);
+  host_mmio_set(&port, offsetof(GPIO_TypeDef, ODR), CS_MASK);
+  host_set_idle(idle);
+
+  hspi.Instance = SPI1;
+  hspi.Init.Mode = SPI_MODE_MASTER;
+  hspi.Init.Direction = SPI_DIRECTION_2LINES;
+  hspi.Init.DataSize = SPI_DATASIZE_8BIT;
+  hspi.Init.CLKPolarity = SPI_POLARITY_LOW;
+  hspi.Init.CLKPhase = SPI_PHASE_1EDGE;
+  hspi.Init.NSS = SPI_NSS_SOFT;
+  hspi.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_16;
+  hspi.Init.FirstBit = SPI_FIRSTBIT_MSB;
+  hspi.Init.FifoThreshold = SPI_FIFO_THRESHOLD_01DATA;
+  hspi_other.Instance = SPI2;
+  HOST_CHECK_EQ(HAL_SPI_Init(&hspi), HAL_OK);
+  q.hspi = &hspi;
+  HOST_CHECK_EQ(spi_queue_init(&q), HAL_OK);
+
+  test_sequence();
+  test_chain();
+  test_delays();
+  test_error();
+  test_resubmit();
+  test_other();
+  HOST_CHECK_EQ(spi.cfg_while_on, 0U);
+
+  host_mmio_detach(&port);
+  host_mmio_detach(&spi_m);
+  return host_result();
+}
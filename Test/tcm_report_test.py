@@ -0,0 +1,130 @@
+"""Tests of IAR_Project/tcm_report.py against tcm_report_test.map.
+
+The sample is the ENTRY LIST of an ILINK map with the hot handlers in ITCM
+except HAL_ETH_IRQHandler, left in flash; TIM7_IRQHandler is not linked.
+
+    python tcm_report_test.py
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+import unittest
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SCRIPT = os.path.join(HERE, "..", "IAR_Project", "tcm_report.py")
+SAMPLE = os.path.join(HERE, "tcm_report_test.map")
+BASELINE = os.path.join(HERE, "..", "IAR_Project", "Debug", "List", "Project.map")
+
+sys.path.insert(0, os.path.dirname(SCRIPT))
+import tcm_report  # noqa: E402
+
+
+def run(*args):
+    return subprocess.run([sys.executable, SCRIPT] + list(args),
+                          stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                          universal_newlines=True)
+
+
+def report_lines(out, heading):
+    """The lines of one section of the report, without its heading."""
+    lines = out.splitlines()
+    start = lines.index(heading) + 1
+    end = next((i for i in range(start, len(lines)) if not lines[i].startswith("  ")), len(lines))
+    return lines[start:end]
+
+
+class ParseTest(unittest.TestCase):
+    def setUp(self):
+        self.entries = {name: (addr, size, kind, obj)
+                        for name, addr, size, kind, obj in tcm_report.parse_entries(SAMPLE)}
+
+    def test_count(self):
+        self.assertEqual(len(self.entries), 22)
+
+    def test_code_drops_thumb_bit(self):
+        self.assertEqual(self.entries["HAL_DMA_IRQHandler"], (0x200, 0x3a2, "Code", "stm32h7xx_hal_dma.o [1]"))
+        self.assertEqual(self.entries["main"][0], 0x0800086c)
+
+    def test_data_keeps_odd_address(self):
+        self.assertEqual(self.entries["uart_rx_ring"], (0x20000011, 0x400, "Data", "uart_rx.o [1]"))
+
+    def test_linker_symbols(self):
+        self.assertEqual(self.entries["CSTACK$$Limit"], (0x20006000, 0, "--", "- Linker created -"))
+        self.assertEqual(self.entries["?main"], (0x08000848, 0, "Code", "cmain.o [4]"))
+
+    def test_wrapped_names(self):
+        self.assertEqual(self.entries["HAL_GPIO_EXTI_IRQHandler"][:3], (0x5a8, 0x24, "Code"))
+        self.assertEqual(self.entries["HAL_UARTEx_RxFifoFullCallback"][:3], (0x08001d34, 2, "Code"))
+
+    def test_stops_at_module_list(self):
+        self.assertFalse(any(name.startswith("[") for name in self.entries))
+
+    def test_regions(self):
+        self.assertEqual(tcm_report.region_of(0x0000ffff), "ITCM")
+        self.assertEqual(tcm_report.region_of(0x00010000), "?")
+        self.assertEqual(tcm_report.region_of(0x2001ffff), "DTCM")
+        self.assertEqual(tcm_report.region_of(0x24000000), "AXISRAM")
+        self.assertEqual(tcm_report.region_of(0x30040000), "SRAM1-3")
+        self.assertEqual(tcm_report.region_of(0x90000000), "QSPI")
+
+
+class ReportTest(unittest.TestCase):
+    def test_sample(self):
+        r = run(SAMPLE)
+        self.assertEqual(r.returncode, 1)
+        hot = report_lines(r.stdout, "Hot symbols")
+        self.assertEqual(len(hot), len(tcm_report.HOT))
+        status = {line.split()[0]: line.split()[-1] for line in hot}
+        self.assertEqual(status.pop("HAL_ETH_IRQHandler"), "TCM")
+        self.assertIn("  HAL_ETH_IRQHandler               FLASH    0x08001a3c NOT IN TCM", hot)
+        self.assertEqual(status.pop("TIM7_IRQHandler"), "linked")
+        self.assertEqual(set(status.values()), {"ok"})
+
+    def test_tcm_list(self):
+        r = run(SAMPLE)
+        tcm = report_lines(r.stdout, "Symbols in TCM")
+        self.assertEqual(tcm[-1], "  ITCM 4122 bytes, DTCM 1032 bytes (sized entries only)")
+        names = [line.split()[0] for line in tcm[:-1]]
+        # By address, flash and SRAM1 entries left out
+        self.assertEqual(names[0], "HAL_DMA_IRQHandler")
+        self.assertEqual(names[-1], "CSTACK$$Limit")
+        self.assertNotIn("HAL_ETH_IRQHandler", names)
+        self.assertNotIn("eth_rx_desc", names)
+        self.assertEqual(len(names), 13)
+
+    def test_all_placed(self):
+        with open(SAMPLE, encoding="latin-1", newline="") as f:
+            text = f.read()
+        text = text.replace("HAL_ETH_IRQHandler       0x800'1a3d", "HAL_ETH_IRQHandler           0x1a3d")
+        with tempfile.TemporaryDirectory() as tmp:
+            path = os.path.join(tmp, "Project.map")
+            with open(path, "w", encoding="latin-1", newline="") as f:
+                f.write(text)
+            r = run(path)
+            self.assertEqual(r.returncode, 0, r.stdout)
+            self.assertNotIn("NOT IN TCM", r.stdout)
+            # More symbols to check: one in flash fails, one not linked does not
+            self.assertEqual(run(path, "--hot", "HAL_UARTEx_RxFifoFullCallback").returncode, 1)
+            self.assertEqual(run(path, "--hot", "uart_rx_ring", "no_such_symbol").returncode, 0)
+
+    def test_no_entry_list(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            path = os.path.join(tmp, "Project.map")
+            with open(path, "w") as f:
+                f.write("*** PLACEMENT SUMMARY\n")
+            r = run(path)
+            self.assertEqual(r.returncode, 1)
+            self.assertIn("no ENTRY LIST", r.stderr)
+
+    def test_baseline_map(self):
+        # The map checked in with the project: nothing hot is linked yet
+        r = run(BASELINE)
+        self.assertEqual(r.returncode, 0)
+        hot = report_lines(r.stdout, "Hot symbols")
+        self.assertTrue(all(line.endswith("not linked") for line in hot))
+
+
+if __name__ == "__main__":
+    unittest.main()
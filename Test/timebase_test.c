@@ -0,0 +1,509 @@
+/* Header includes -----------------------------------------------------------*/
+#include "timebase.h"
+#include <stddef.h>
+
+/* timebase: TIM5 is a model counting one tick per simulated microsecond,
+   with the overflow and CC1 flags and their interrupt. Time jumps from one
+   counter event to the next, so hours pass in a few steps; in the race
+   tests it also moves a random 0-3 us on every register access, which lands
+   the overflow or the compare match between any two of them. Checked: that
+   the 64-bit time is never off the model's, with the overflow interrupt
+   able to run and masked; that it stays continuous over a second
+   timebase_init(); that alarms armed a few us ahead are not lost to a match
+   passing while CC1 is set up, nor fire early when they are more than a
+   period ahead; and that random alarms (due, near, past the 32-bit period,
+   restarted, cancelled, restarting themselves from their callback) each
+   fire once, on their deadline to the microsecond, in deadline then start
+   order, with no compare interrupt while none is due. */
+
+/* Private macro -------------------------------------------------------------*/
+#define PERIOD                  0x100000000ULL
+#define ALARMS                  24U
+#define STEPS                   3000U
+#define FIRES_MAX               8192U
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  timebase_alarm_t a;
+  uint32_t armed;
+  uint64_t deadline;
+  uint64_t started;             /* model time at the start */
+  uint32_t seq;                 /* start order */
+  uint32_t fired;
+  uint32_t periodic;            /* restarts itself this far ahead */
+  uint64_t late;                /* test_race(): us after the deadline */
+} alarm_t;
+
+typedef struct
+{
+  uint64_t t;
+  uint64_t deadline;
+  uint32_t seq;
+  uint32_t batch;
+} fire_t;
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t seed = 0x13579BDFU;
+
+/* TIM5: upcounting to 0xFFFFFFFF, UIF on overflow, CC1IF on CNT == CCR1 */
+static host_mmio_t tim_m;
+static volatile struct
+{
+  uint64_t epoch;               /* counter total before the last UG */
+  uint64_t count;               /* counter since the last UG, 64 bits */
+  uint32_t sr;
+  uint32_t ccr1;                /* CCR1 as the comparator has it */
+  uint32_t access_step;         /* max us a register access takes, 0: none */
+  uint32_t overflows;
+  uint32_t idle_irqs;           /* matches with CC1IE set and no alarm due */
+} tim;
+
+static alarm_t alarms[ALARMS];
+static uint32_t seq;
+/* Bumped by every start, cancel and counter event of the test; alarms that
+   fire in one batch went through one pass of the handler */
+static volatile uint32_t batch;
+static volatile uint32_t fires_n;
+static fire_t fires[FIRES_MAX];
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static uint32_t tim_reg(uint32_t offset)
+{
+  return host_mmio_get(&tim_m, offset);
+}
+
+/* The time timebase_us() should tell */
+static uint64_t model_us(void)
+{
+  return tim.epoch + tim.count;
+}
+
+/* 1 if an alarm the test started is due */
+static uint32_t alarm_due(void)
+{
+  uint32_t i;
+
+  for(i = 0U; i < ALARMS; i++)
+  {
+    if((alarms[i].armed != 0U) && (alarms[i].deadline <= model_us()))
+    {
+      return 1U;
+    }
+  }
+  return 0U;
+}
+
+static void tim_irq(void)
+{
+  if((tim.sr & tim_reg(offsetof(TIM_TypeDef, DIER)) & (TIM_SR_UIF | TIM_SR_CC1IF)) != 0U)
+  {
+    host_irq_raise(TIM5_IRQHandler);
+  }
+}
+
+/* Count up by at most us ticks, stopping at the first overflow or match.
+   Returns the ticks counted. */
+static uint64_t tim_step(uint64_t us)
+{
+  uint32_t cnt = (uint32_t)tim.count;
+  uint64_t wrap = PERIOD - cnt;
+  uint64_t match = (uint32_t)(tim.ccr1 - cnt);
+
+  if((tim_reg(offsetof(TIM_TypeDef, CR1)) & TIM_CR1_CEN) == 0U)
+  {
+    return us;
+  }
+  if(match == 0U)
+  {
+    match = PERIOD;
+  }
+  if(us > wrap)
+  {
+    us = wrap;
+  }
+  if(us > match)
+  {
+    us = match;
+  }
+  tim.count += us;
+  if(us == wrap)
+  {
+    tim.sr |= TIM_SR_UIF;
+    tim.overflows++;
+  }
+  if(us == match)
+  {
+    tim.sr |= TIM_SR_CC1IF;
+    if(((tim_reg(offsetof(TIM_TypeDef, DIER)) & TIM_DIER_CC1IE) != 0U) && (alarm_due() == 0U))
+    {
+      tim.idle_irqs++;
+    }
+  }
+  tim_irq();
+  return us;
+}
+
+/* Time passing while the test waits: interrupts run at each event */
+static void run(uint64_t us)
+{
+  while(us != 0U)
+  {
+    us -= tim_step(us);
+    batch++;
+    host_irq_poll();
+  }
+}
+
+/* The time a register access takes, before it lands */
+static void tim_access(void)
+{
+  uint64_t us;
+
+  if(tim.access_step != 0U)
+  {
+    us = rnd() % (tim.access_step + 1U);
+    while(us != 0U)
+    {
+      us -= tim_step(us);
+    }
+  }
+}
+
+static uint32_t tim_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  tim_access();
+  switch(offset)
+  {
+    case offsetof(TIM_TypeDef, CNT):
+      return (uint32_t)tim.count;
+    case offsetof(TIM_TypeDef, SR):
+      return tim.sr;
+    default:
+      return current;
+  }
+}
+
+static void tim_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  tim_access();
+  switch(offset)
+  {
+    case offsetof(TIM_TypeDef, CCR1):
+      tim.ccr1 = value;
+      break;
+    case offsetof(TIM_TypeDef, SR):
+      /* rc_w0 */
+      tim.sr &= value;
+      break;
+    case offsetof(TIM_TypeDef, EGR):
+      if((value & TIM_EGR_UG) != 0U)
+      {
+        tim.epoch += tim.count;
+        tim.count = 0U;
+        if((tim_reg(offsetof(TIM_TypeDef, CR1)) & TIM_CR1_URS) == 0U)
+        {
+          tim.sr |= TIM_SR_UIF;
+        }
+      }
+      if((value & TIM_EGR_CC1G) != 0U)
+      {
+        tim.sr |= TIM_SR_CC1IF;
+      }
+      host_mmio_set(m, offset, 0U);
+      break;
+    case offsetof(TIM_TypeDef, CNT):
+      tim.count = (tim.count & ~(PERIOD - 1U)) | value;
+      break;
+    default:
+      break;
+  }
+  tim_irq();
+}
+
+static uint64_t rnd64(void)
+{
+  return ((uint64_t)rnd() << 32) | rnd();
+}
+
+/* timebase_us() against the model around 64 overflows, loads taking a
+   random time so the overflow falls between any two of them */
+static void test_read(uint32_t masked)
+{
+  uint64_t last = timebase_us();
+  uint64_t before;
+  uint64_t after;
+  uint64_t t;
+  uint32_t w;
+  uint32_t i;
+
+  for(w = 0U; w < 64U; w++)
+  {
+    /* 33 to 48 us before the next overflow */
+    run(((2U * PERIOD) - (uint32_t)tim.count - 33U - (rnd() % 16U)) % PERIOD);
+    tim.access_step = 3U;
+    if(masked != 0U)
+    {
+      __disable_irq();
+    }
+    for(i = 0U; i < 40U; i++)
+    {
+      before = model_us();
+      t = timebase_us();
+      after = model_us();
+      if(!HOST_CHECK((t >= before) && (t <= after)) || !HOST_CHECK(t >= last))
+      {
+        printf("  %s, overflow %u: %llu not in [%llu, %llu]\n", (masked != 0U) ? "masked" : "open",
+               (unsigned)w, (unsigned long long)t, (unsigned long long)before,
+               (unsigned long long)after);
+        w = 64U;
+        break;
+      }
+      last = t;
+    }
+    if(masked != 0U)
+    {
+      __enable_irq();
+    }
+    tim.access_step = 0U;
+  }
+  HOST_CHECK_EQ(timebase_us(), model_us());
+  HOST_CHECK_EQ(HAL_GetTick(), (uint32_t)(model_us() / 1000U));
+}
+
+/* A second timebase_init(), as after a clock change, keeps the time */
+static void test_reinit(void)
+{
+  uint64_t t;
+
+  run(PERIOD + 123456789U);
+  t = timebase_us();
+  HOST_CHECK_EQ(timebase_init(1U), HAL_OK);
+  HOST_CHECK_EQ(timebase_us(), t);
+  run((2U * PERIOD) + 5U);
+  HOST_CHECK_EQ(timebase_us(), t + (2U * PERIOD) + 5U);
+  HOST_CHECK_EQ(timebase_us(), model_us());
+}
+
+static void alarm_fired(void *context)
+{
+  alarm_t *x = context;
+  uint64_t now = model_us();
+  uint64_t due = (x->deadline > x->started) ? x->deadline : x->started;
+  fire_t *f;
+
+  if(!HOST_CHECK(x->armed != 0U) || !HOST_CHECK_EQ(now, due))
+  {
+    printf("  alarm %u: deadline %llu, started %llu, fired %llu\n", (unsigned)(x - alarms),
+           (unsigned long long)x->deadline, (unsigned long long)x->started,
+           (unsigned long long)now);
+  }
+  x->armed = 0U;
+  x->fired++;
+  if(fires_n < FIRES_MAX)
+  {
+    f = &fires[fires_n++];
+    f->t = now;
+    f->deadline = x->deadline;
+    f->seq = x->seq;
+    f->batch = batch;
+  }
+  if(x->periodic != 0U)
+  {
+    x->armed = 1U;
+    x->deadline += x->periodic;
+    x->started = now;
+    x->seq = seq++;
+    timebase_alarm_start(&x->a, x->deadline, alarm_fired, x);
+  }
+}
+
+static void alarm_race(void *context)
+{
+  alarm_t *x = context;
+  uint64_t now = model_us();
+
+  HOST_CHECK(now >= x->deadline);
+  x->late = now - x->deadline;
+  x->armed = 0U;
+  x->fired++;
+}
+
+static void alarm_start(alarm_t *x, uint64_t deadline)
+{
+  batch++;
+  x->armed = 1U;
+  x->deadline = deadline;
+  x->started = model_us();
+  x->seq = seq++;
+  timebase_alarm_start(&x->a, deadline, alarm_fired, x);
+}
+
+static void alarm_cancel(alarm_t *x)
+{
+  batch++;
+  x->armed = 0U;
+  timebase_alarm_cancel(&x->a);
+}
+
+static void test_alarms(void)
+{
+  alarm_t *x;
+  uint64_t now;
+  uint32_t step;
+  uint32_t i;
+
+  /* Restarts itself from the callback, three times or so a period */
+  alarms[0].periodic = (uint32_t)(PERIOD / 3U) + 12345U;
+  alarm_start(&alarms[0], model_us() + alarms[0].periodic);
+
+  for(step = 0U; step < STEPS; step++)
+  {
+    x = &alarms[1U + (rnd() % (ALARMS - 1U))];
+    now = model_us();
+    switch(rnd() % 8U)
+    {
+      case 0U:
+        alarm_cancel(x);
+        break;
+      case 1U:
+        /* Already due */
+        alarm_start(x, now - (rnd() % 100U));
+        break;
+      case 2U:
+      case 3U:
+        /* Up to two periods ahead */
+        alarm_start(x, now + (rnd64() % (2U * PERIOD)));
+        break;
+      case 4U:
+        /* Equal to another one's */
+        alarm_start(x, alarms[rnd() % ALARMS].deadline);
+        break;
+      default:
+        alarm_start(x, now + (rnd() % 1000U));
+        break;
+    }
+    if((rnd() % 64U) == 0U)
+    {
+      run(rnd64() % PERIOD);
+    }
+    else
+    {
+      run(rnd() % 2000U);
+    }
+  }
+
+  alarm_cancel(&alarms[0]);
+  run(3U * PERIOD);
+  for(i = 0U; i < ALARMS; i++)
+  {
+    HOST_CHECK_EQ(alarms[i].armed, 0U);
+  }
+  HOST_CHECK(fires_n > (STEPS / 2U));
+  HOST_CHECK(fires_n < FIRES_MAX);
+  HOST_CHECK(alarms[0].fired > 10U);
+  HOST_CHECK_EQ(tim.idle_irqs, 0U);
+
+  /* In time order; within a pass of the handler by deadline, then start */
+  for(i = 1U; i < fires_n; i++)
+  {
+    if(!HOST_CHECK(fires[i].t >= fires[i - 1U].t) ||
+       ((fires[i].batch == fires[i - 1U].batch) &&
+        !HOST_CHECK((fires[i].deadline > fires[i - 1U].deadline) ||
+                    ((fires[i].deadline == fires[i - 1U].deadline) &&
+                     (fires[i].seq > fires[i - 1U].seq)))))
+    {
+      printf("  fire %u\n", (unsigned)i);
+      break;
+    }
+  }
+}
+
+/* Alarms a few us ahead while every access takes time: the match can
+   pass before CCR1 is written or its flag cleared */
+static void test_race(void)
+{
+  alarm_t *x = &alarms[0];
+  uint64_t late_max = 0U;
+  uint32_t i;
+
+  tim.access_step = 3U;
+  for(i = 0U; i < 500U; i++)
+  {
+    x->fired = 0U;
+    x->armed = 1U;
+    x->started = model_us();
+    x->deadline = x->started + (rnd() % 12U);
+    timebase_alarm_start(&x->a, x->deadline, alarm_race, x);
+    run(100U);
+    if(!HOST_CHECK_EQ(x->fired, 1U))
+    {
+      timebase_alarm_cancel(&x->a);
+      break;
+    }
+    if(x->late > late_max)
+    {
+      late_max = x->late;
+    }
+  }
+  tim.access_step = 0U;
+  /* Accesses of the start itself and of the handler */
+  HOST_CHECK(late_max <= 60U);
+  x->fired = 0U;
+  x->armed = 0U;
+}
+
+/* An alarm more than a period ahead waits for the overflows, its low 32
+   bits alone must not match */
+static void test_far(void)
+{
+  alarm_t *x = &alarms[0];
+  uint32_t idle = tim.idle_irqs;
+
+  alarm_start(x, model_us() + PERIOD + 1000U);
+  run(PERIOD + 999U);
+  HOST_CHECK_EQ(x->fired, 0U);
+  run(1U);
+  HOST_CHECK_EQ(x->fired, 1U);
+  alarm_start(x, model_us() + (3U * PERIOD) + 5U);
+  run(3U * PERIOD);
+  HOST_CHECK_EQ(x->fired, 1U);
+  run(5U);
+  HOST_CHECK_EQ(x->fired, 2U);
+  HOST_CHECK_EQ(tim.idle_irqs, idle);
+  x->fired = 0U;
+  fires_n = 0U;
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  tim_m.base = (uintptr_t)TIM5;
+  tim_m.size = sizeof(TIM_TypeDef);
+  tim_m.read = tim_read;
+  tim_m.write = tim_write;
+  host_mmio_attach(&tim_m);
+
+  HOST_CHECK_EQ(timebase_init(1U), HAL_OK);
+  HOST_CHECK_EQ(timebase_us(), 0U);
+  HOST_CHECK_EQ(HAL_InitTick(16U), HAL_ERROR);
+
+  test_read(0U);
+  test_read(1U);
+  HOST_CHECK(tim.overflows >= 128U);
+  test_reinit();
+  test_race();
+  test_far();
+  test_alarms();
+
+  host_mmio_detach(&tim_m);
+  return host_result();
+}
@@ -0,0 +1,566 @@
+/* Header includes -----------------------------------------------------------*/
+#include "uart_rx.h"
+#include "host.h"
+#include <stddef.h>
+#include <string.h>
+
+/* uart_rx: a byte stream at 1 to 4 Mbaud goes through a USART1 model
+   (IDLE after one idle frame, receiver timeout, line errors) into a model
+   of DMA1 stream 0 in circular mode, which writes the ring and raises the
+   half/complete interrupts after a random latency of up to a few bytes;
+   the USART and DMA interrupts go through the real HAL handlers. Time is
+   simulated: the consumer holds the spans it peeked for a while before
+   checking them against the stream and consuming, and sometimes stalls
+   for several rings. Checked: every byte consumed without an error is the
+   stream byte at its position, consumed plus lost is what was sent, a
+   consumer that keeps up loses nothing, and a burst is visible once the
+   line has been idle for a frame or the receiver timeout. */
+
+/* Private macro -------------------------------------------------------------*/
+#define RING_SIZE               256U
+#define KERNEL_HZ               64000000U
+#define DMA_REG(r)              ((uint32_t)offsetof(DMA_TypeDef, r))
+#define STREAM_REG(r)           ((uint32_t)(sizeof(DMA_TypeDef) + offsetof(DMA_Stream_TypeDef, r)))
+/* Stream 0 flags in LISR */
+#define DMA_S0_FE               0x01U
+#define DMA_S0_TE               0x08U
+#define DMA_S0_HT               0x10U
+#define DMA_S0_TC               0x20U
+#define NEVER                   UINT64_MAX
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t baud;
+  uint32_t bytes;               /* sent in the run */
+  uint32_t rto_bits;
+  uint32_t irq_latency;         /* DMA interrupt served up to this many bytes late */
+  uint32_t stall;               /* in 1/256: how often the consumer stalls */
+  uint32_t stall_rings;         /* for up to this many rings */
+  uint32_t errors;              /* in 1/1024 bytes: a framing error */
+} run_t;
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t seed = 0x2468ACE1U;
+static UART_HandleTypeDef huart;
+static DMA_HandleTypeDef hdma;
+static uart_rx_t rx;
+/* The DMA takes it as a 32-bit address: static, and the test links -no-pie */
+static uint8_t ring[RING_SIZE];
+
+/* Simulated time in ns */
+static uint64_t now_ns;
+
+/* The line: bursts of back-to-back frames with gaps between them */
+static struct
+{
+  uint64_t byte_ns;
+  uint64_t next_t;              /* end of the next frame */
+  uint64_t last_t;              /* end of the last frame */
+  uint32_t sent;
+  uint32_t total;
+  uint32_t burst;               /* frames left in this burst */
+  uint32_t error_rate;
+  uint32_t idle_armed;          /* IDLE not yet seen since the last frame */
+  uint32_t rto_armed;
+} line;
+
+/* USART1 */
+static host_mmio_t usart_m;
+static volatile uint32_t usart_isr;     /* IDLE, RTOF, PE, FE, NE, ORE */
+
+/* DMA1 stream 0 */
+static host_mmio_t dma_m;
+static volatile struct
+{
+  uint32_t isr;
+  uint32_t enabled;
+  uint32_t ndtr;                /* left before the reload */
+  uint32_t reload;              /* NDTR as programmed */
+  uint32_t pos;
+  uint64_t irq_t;               /* pending interrupt served then */
+  uint32_t latency_bytes;
+} dma;
+
+/* Consumer side */
+static struct
+{
+  uint32_t accepted;
+  uint32_t stale;               /* wrong bytes in the spans as peek returns them */
+  uint32_t corrupt;             /* wrong bytes consumed without an error */
+  uint32_t refused;             /* consumes that reported a lap */
+  uint32_t events;
+  uint32_t head_back;           /* head seen moving back in the callback */
+  uint32_t late;                /* IDLE/RTO with bytes not yet published */
+  uint32_t last_head;
+} cons;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+/* The byte at position p of the stream */
+static uint8_t stream(uint32_t p)
+{
+  uint32_t x = p * 0x9E3779B1U;
+
+  x ^= x >> 15;
+  x *= 0x85EBCA6BU;
+  return (uint8_t)(x >> 24);
+}
+
+static uint32_t usart_reg(uint32_t offset)
+{
+  return host_mmio_get(&usart_m, offset);
+}
+
+static void usart_isr_fn(void)
+{
+  uart_rx_irq(&rx);
+  HAL_UART_IRQHandler(&huart);
+}
+
+static void dma_isr_fn(void)
+{
+  HAL_DMA_IRQHandler(&hdma);
+}
+
+static void usart_irq_update(void)
+{
+  uint32_t cr1 = usart_reg(offsetof(USART_TypeDef, CR1));
+  uint32_t cr3 = usart_reg(offsetof(USART_TypeDef, CR3));
+
+  if((((usart_isr & USART_ISR_IDLE) != 0U) && ((cr1 & USART_CR1_IDLEIE) != 0U)) ||
+     (((usart_isr & USART_ISR_RTOF) != 0U) && ((cr1 & USART_CR1_RTOIE) != 0U)) ||
+     (((usart_isr & (USART_ISR_FE | USART_ISR_NE | USART_ISR_ORE)) != 0U) && ((cr3 & USART_CR3_EIE) != 0U)) ||
+     (((usart_isr & USART_ISR_PE) != 0U) && ((cr1 & USART_CR1_PEIE) != 0U)))
+  {
+    host_irq_raise(usart_isr_fn);
+  }
+}
+
+static uint32_t usart_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  uint32_t cr1;
+  uint32_t isr;
+
+  (void)m;
+  if(offset != offsetof(USART_TypeDef, ISR))
+  {
+    return current;
+  }
+  /* The transmitter is always empty, the DMA takes every byte */
+  cr1 = usart_reg(offsetof(USART_TypeDef, CR1));
+  isr = usart_isr | USART_ISR_TXE_TXFNF | USART_ISR_TC;
+  isr |= ((cr1 & USART_CR1_TE) != 0U) ? USART_ISR_TEACK : 0U;
+  isr |= ((cr1 & USART_CR1_RE) != 0U) ? USART_ISR_REACK : 0U;
+  return isr;
+}
+
+static void usart_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  (void)m;
+  (void)size;
+  if(offset == offsetof(USART_TypeDef, ICR))
+  {
+    usart_isr &= ~(value & (USART_ICR_PECF | USART_ICR_FECF | USART_ICR_NECF | USART_ICR_ORECF |
+                            USART_ICR_IDLECF | USART_ICR_RTOCF));
+  }
+  else if((offset == offsetof(USART_TypeDef, CR1)) || (offset == offsetof(USART_TypeDef, CR3)))
+  {
+    usart_irq_update();
+  }
+}
+
+static uint32_t dma_reg(uint32_t offset)
+{
+  return host_mmio_get(&dma_m, offset);
+}
+
+static uint32_t dma_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  (void)m;
+  if(offset == DMA_REG(LISR))
+  {
+    return dma.isr;
+  }
+  if(offset == DMA_REG(HISR))
+  {
+    return 0U;
+  }
+  if((offset == STREAM_REG(NDTR)) && (dma.enabled != 0U))
+  {
+    return dma.ndtr;
+  }
+  return current;
+}
+
+static void dma_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  (void)m;
+  (void)size;
+  if(offset == DMA_REG(LIFCR))
+  {
+    dma.isr &= ~(value & 0x3DU);
+  }
+  else if(offset == STREAM_REG(CR))
+  {
+    if(((value & DMA_SxCR_EN) != 0U) && (dma.enabled == 0U))
+    {
+      dma.enabled = 1U;
+      dma.reload = dma_reg(STREAM_REG(NDTR));
+      dma.ndtr = dma.reload;
+      dma.pos = 0U;
+    }
+    else if(((value & DMA_SxCR_EN) == 0U) && (dma.enabled != 0U))
+    {
+      /* Disabling the stream completes it */
+      dma.enabled = 0U;
+      host_mmio_set(&dma_m, STREAM_REG(NDTR), dma.ndtr);
+      dma.isr |= DMA_S0_TC;
+    }
+  }
+}
+
+/* A flag the stream interrupts on: served after the latency */
+static void dma_flag(uint32_t flag)
+{
+  uint32_t cr = dma_reg(STREAM_REG(CR));
+
+  dma.isr |= flag;
+  if((((flag & DMA_S0_HT) != 0U) && ((cr & DMA_SxCR_HTIE) != 0U)) ||
+     (((flag & DMA_S0_TC) != 0U) && ((cr & DMA_SxCR_TCIE) != 0U)))
+  {
+    if(dma.irq_t == NEVER)
+    {
+      dma.irq_t = now_ns + (rnd() % (dma.latency_bytes * line.byte_ns + 1U));
+    }
+  }
+}
+
+/* Events of the line model --------------------------------------------------*/
+static uint64_t idle_t;
+static uint64_t rto_t;
+
+static uint64_t bit_ns(void)
+{
+  return line.byte_ns / 10U;
+}
+
+/* When the frame after this one ends, and what the silence before it sets */
+static void line_schedule(void)
+{
+  uint64_t start;
+
+  if(line.sent == line.total)
+  {
+    line.next_t = NEVER;
+  }
+  else if(line.burst > 0U)
+  {
+    line.burst--;
+    line.next_t = line.last_t + line.byte_ns;
+  }
+  else
+  {
+    /* A new burst: short or several rings long, after a gap shorter
+       than a frame or of up to 40 frames */
+    line.burst = ((rnd() & 1U) != 0U) ? (rnd() % 64U) : (rnd() % (3U * RING_SIZE));
+    if((rnd() & 1U) != 0U)
+    {
+      line.next_t = line.last_t + line.byte_ns + (rnd() % (line.byte_ns / 2U));
+    }
+    else
+    {
+      line.next_t = line.last_t + line.byte_ns + (1U + (rnd() % 40U)) * line.byte_ns;
+    }
+  }
+
+  /* IDLE after a whole idle frame, RTO after rto_bits without a start bit */
+  start = (line.next_t == NEVER) ? NEVER : (line.next_t - line.byte_ns);
+  idle_t = (start >= line.last_t + line.byte_ns) ? (line.last_t + line.byte_ns) : NEVER;
+  rto_t = NEVER;
+  if((usart_reg(offsetof(USART_TypeDef, CR2)) & USART_CR2_RTOEN) != 0U)
+  {
+    rto_t = line.last_t + (usart_reg(offsetof(USART_TypeDef, RTOR)) & USART_RTOR_RTO) * bit_ns();
+    if(start < rto_t)
+    {
+      rto_t = NEVER;
+    }
+  }
+}
+
+/* A frame ends: the DMA takes it, or it overruns */
+static void line_frame(void)
+{
+  uint8_t *dst;
+
+  if((line.error_rate != 0U) && ((rnd() % 1024U) < line.error_rate))
+  {
+    usart_isr |= USART_ISR_FE;
+  }
+  if((dma.enabled != 0U) && ((usart_reg(offsetof(USART_TypeDef, CR3)) & USART_CR3_DMAR) != 0U))
+  {
+    dst = (uint8_t *)(uintptr_t)dma_reg(STREAM_REG(M0AR));
+    dst[dma.pos++] = stream(line.sent);
+    dma.ndtr--;
+    if(dma.ndtr == dma.reload / 2U)
+    {
+      dma_flag(DMA_S0_HT);
+    }
+    if(dma.ndtr == 0U)
+    {
+      dma_flag(DMA_S0_TC);
+      dma.ndtr = dma.reload;
+      dma.pos = 0U;
+    }
+  }
+  else
+  {
+    usart_isr |= USART_ISR_ORE;
+  }
+  line.sent++;
+  line.last_t = now_ns;
+  line_schedule();
+}
+
+/* Simulated time runs to t, the interrupts land as things happen */
+static void advance(uint64_t t)
+{
+  uint64_t next;
+
+  for(;;)
+  {
+    next = line.next_t;
+    next = (dma.irq_t < next) ? dma.irq_t : next;
+    next = (idle_t < next) ? idle_t : next;
+    next = (rto_t < next) ? rto_t : next;
+    if(next > t)
+    {
+      break;
+    }
+    now_ns = next;
+    if(next == line.next_t)
+    {
+      line_frame();
+    }
+    else if(next == dma.irq_t)
+    {
+      dma.irq_t = NEVER;
+      host_irq_raise(dma_isr_fn);
+    }
+    else if(next == idle_t)
+    {
+      idle_t = NEVER;
+      usart_isr |= USART_ISR_IDLE;
+    }
+    else
+    {
+      rto_t = NEVER;
+      usart_isr |= USART_ISR_RTOF;
+    }
+    usart_irq_update();
+    host_irq_poll();
+  }
+  now_ns = t;
+}
+
+/* The consumer ----------------------------------------------------------------*/
+static void rx_callback(uart_rx_t *r, uint32_t events)
+{
+  cons.events |= events;
+  if(r->head < cons.last_head)
+  {
+    cons.head_back++;
+  }
+  cons.last_head = r->head;
+  /* An idle line or a timeout publishes everything received */
+  if(((events & (UART_RX_EVT_IDLE | UART_RX_EVT_TIMEOUT)) != 0U) && (r->head != line.sent))
+  {
+    cons.late++;
+  }
+}
+
+/* Time the consumer spends on something, now and then a stall */
+static uint64_t busy_ns(const run_t *run)
+{
+  uint64_t t = 5000U + (rnd() % 45000U);
+
+  if((run->stall != 0U) && ((rnd() % 256U) < run->stall))
+  {
+    t += rnd() % ((uint64_t)run->stall_rings * RING_SIZE * line.byte_ns);
+  }
+  return t;
+}
+
+/* Peek, hold the spans while time goes by, check them, consume part, do
+   something else. What peek returns must be intact then; after the hold
+   only if consume says so */
+static uint32_t consume_once(const run_t *run)
+{
+  uart_rx_span_t span[2];
+  uint32_t avail;
+  uint32_t pos;
+  uint32_t take;
+  uint32_t bad = 0U;
+  uint32_t done = 0U;
+  uint32_t i;
+  uint32_t j;
+
+  avail = uart_rx_peek(&rx, span);
+  pos = rx.tail;
+  for(i = 0U; i < 2U; i++)
+  {
+    for(j = 0U; j < span[i].len; j++, done++)
+    {
+      cons.stale += (span[i].data[j] != stream(pos + done)) ? 1U : 0U;
+    }
+  }
+  done = 0U;
+  advance(now_ns + busy_ns(run) + (uint64_t)avail * 4U);
+
+  take = ((rnd() & 3U) == 0U) ? (rnd() % (avail + 1U)) : avail;
+  for(i = 0U; (i < 2U) && (done < take); i++)
+  {
+    for(j = 0U; (j < span[i].len) && (done < take); j++, done++)
+    {
+      bad += (span[i].data[j] != stream(pos + done)) ? 1U : 0U;
+    }
+  }
+  if(uart_rx_consume(&rx, take) == HAL_OK)
+  {
+    cons.accepted += take;
+    cons.corrupt += bad;
+  }
+  else
+  {
+    cons.refused++;
+  }
+  advance(now_ns + busy_ns(run) / 2U);
+  return avail;
+}
+
+static void run_stream(const char *name, const run_t *run)
+{
+  uint32_t n;
+  uint32_t guard;
+
+  memset(&cons, 0, sizeof(cons));
+  memset(&line, 0, sizeof(line));
+  line.byte_ns = 10ULL * 1000000000ULL / run->baud;
+  line.total = run->bytes;
+  line.error_rate = run->errors;
+  dma.latency_bytes = run->irq_latency;
+  dma.irq_t = NEVER;
+  usart_isr = 0U;
+
+  huart.Init.BaudRate = run->baud;
+  HOST_CHECK_EQ(HAL_UART_Init(&huart), HAL_OK);
+  HOST_CHECK_EQ(usart_reg(offsetof(USART_TypeDef, BRR)), KERNEL_HZ / run->baud);
+  rx.rto_bits = run->rto_bits;
+  HOST_CHECK_EQ(uart_rx_start(&rx), HAL_OK);
+
+  line.last_t = now_ns;
+  line.burst = 0U;
+  line_schedule();
+  for(guard = 0U; guard < 10U * run->bytes; guard++)
+  {
+    n = consume_once(run);
+    if((n == 0U) && (line.next_t == NEVER) && (idle_t == NEVER) && (rto_t == NEVER) &&
+       (dma.irq_t == NEVER) && (rx.head == rx.tail))
+    {
+      break;
+    }
+  }
+  uart_rx_stop(&rx);
+
+  printf("  %-24s %7u bytes at %u baud, %u lost, %u refused\n", name, (unsigned)line.sent,
+         (unsigned)run->baud, (unsigned)rx.lost, (unsigned)cons.refused);
+  HOST_CHECK_EQ(line.sent, run->bytes);
+  HOST_CHECK_EQ(cons.stale, 0U);
+  HOST_CHECK_EQ(cons.corrupt, 0U);
+  HOST_CHECK_EQ(rx.head, line.sent);
+  HOST_CHECK_EQ(rx.tail, rx.head);
+  HOST_CHECK_EQ(cons.accepted + rx.lost, line.sent);
+  HOST_CHECK_EQ(cons.head_back, 0U);
+  HOST_CHECK_EQ(cons.late, 0U);
+  HOST_CHECK((cons.events & UART_RX_EVT_IDLE) != 0U);
+  HOST_CHECK(((cons.events & UART_RX_EVT_TIMEOUT) != 0U) == (run->rto_bits != 0U));
+  HOST_CHECK(((rx.errors & HAL_UART_ERROR_FE) != 0U) == (run->errors != 0U));
+  HOST_CHECK_EQ(rx.errors & ~HAL_UART_ERROR_FE, 0U);
+  if(run->stall == 0U)
+  {
+    /* Keeping up: nothing lost, nothing refused */
+    HOST_CHECK_EQ(rx.lost, 0U);
+    HOST_CHECK_EQ(cons.refused, 0U);
+  }
+  else
+  {
+    HOST_CHECK(rx.lost != 0U);
+  }
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  static const run_t keep_up = {4000000U, 20000U, 0U, 8U, 0U, 0U, 0U};
+  static const run_t timeout = {1000000U, 10000U, 30U, 8U, 0U, 0U, 0U};
+  static const run_t errors = {4000000U, 15000U, 0U, 8U, 0U, 0U, 8U};
+  static const run_t late_irq = {4000000U, 15000U, 20U, RING_SIZE / 2U - 16U, 0U, 0U, 0U};
+  /* Laps of a fraction of a ring, between two half-ring interrupts */
+  static const run_t short_laps = {4000000U, 20000U, 0U, 8U, 64U, 2U, 0U};
+  static const run_t long_laps = {4000000U, 20000U, 20U, 64U, 8U, 4U, 4U};
+
+  usart_m.base = USART1_BASE;
+  usart_m.size = sizeof(USART_TypeDef);
+  usart_m.read = usart_read;
+  usart_m.write = usart_write;
+  host_mmio_attach(&usart_m);
+  dma_m.base = DMA1_BASE;
+  dma_m.size = sizeof(DMA_TypeDef) + sizeof(DMA_Stream_TypeDef);
+  dma_m.read = dma_read;
+  dma_m.write = dma_write;
+  host_mmio_attach(&dma_m);
+
+  hdma.Instance = DMA1_Stream0;
+  hdma.Init.Request = DMA_REQUEST_USART1_RX;
+  hdma.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  hdma.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma.Init.MemInc = DMA_MINC_ENABLE;
+  hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma.Init.Mode = DMA_CIRCULAR;
+  hdma.Init.Priority = DMA_PRIORITY_HIGH;
+  hdma.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  HOST_CHECK_EQ(HAL_DMA_Init(&hdma), HAL_OK);
+
+  huart.Instance = USART1;
+  huart.Init.WordLength = UART_WORDLENGTH_8B;
+  huart.Init.StopBits = UART_STOPBITS_1;
+  huart.Init.Parity = UART_PARITY_NONE;
+  huart.Init.Mode = UART_MODE_TX_RX;
+  huart.Init.HwFlowCtl = UART_HWCONTROL_NONE;
+  huart.Init.OverSampling = UART_OVERSAMPLING_16;
+  huart.Init.ClockPrescaler = UART_PRESCALER_DIV1;
+  __HAL_LINKDMA(&huart, hdmarx, hdma);
+  rx.huart = &huart;
+  rx.buf = ring;
+  rx.size = RING_SIZE;
+  rx.callback = rx_callback;
+
+  run_stream("keeping up", &keep_up);
+  run_stream("receiver timeout", &timeout);
+  run_stream("framing errors", &errors);
+  run_stream("late DMA interrupts", &late_irq);
+  run_stream("short laps", &short_laps);
+  run_stream("long laps", &long_laps);
+
+  host_mmio_detach(&dma_m);
+  host_mmio_detach(&usart_m);
+  return host_result();
+}
@@ -0,0 +1,812 @@
+/* Header includes -----------------------------------------------------------*/
+#include "uart_tx.h"
+#include "host.h"
+#include <stddef.h>
+#include <string.h>
+
+/* uart_tx: messages written from the main loop and from interrupts go
+   through a USART1 model, with its 16-byte transmit FIFO and a shifter at
+   the line rate, fed by the driver or by a model of DMA1 stream 0 in
+   normal mode; the DMA and USART interrupts land after a latency and go
+   through the real HAL handlers. Time is simulated. An interrupt raised
+   just before a write lands at the first point the write unmasks, between
+   its reservation and its copy; others are raised by the models in the
+   middle of the FIFO fill and the DMA setup. Checked: every accepted
+   message leaves once, intact and after the earlier ones from its
+   context, a refused one never does, the FIFO is never overrun, neither
+   it nor the DMA is started with interrupts masked, and the queue ends
+   empty.
+
+   Then the benchmark: back-to-back and paced messages through the queue
+   and through HAL_UART_Transmit_DMA() retried on HAL_BUSY, the usual way
+   around it. Printed per message size: line use (the throughput, as a
+   share of the baud rate), the latency from the first write attempt to
+   the last stop bit, the time the writer spends retrying, and register
+   accesses per message, interrupts included, for the CPU cost. */
+
+/* Private macro -------------------------------------------------------------*/
+#define RING_SIZE               512U
+#define BAUD                    2000000U
+#define FIFO_SIZE               16U
+#define DMA_REG(r)              ((uint32_t)offsetof(DMA_TypeDef, r))
+#define STREAM_REG(r)           ((uint32_t)(sizeof(DMA_TypeDef) + offsetof(DMA_Stream_TypeDef, r)))
+/* Stream 0 transfer complete in LISR */
+#define DMA_S0_TC               0x20U
+#define NEVER                   UINT64_MAX
+
+/* Messages: context, id, payload length, then the payload */
+#define MSG_MAX                 2048U
+#define MSG_HDR                 4U
+#define MSG_LEN_MAX             (MSG_HDR + 96U)
+#define MSG_THREAD              0xA5U
+#define MSG_ISR                 0x5AU
+
+#define IRQ_LATENCY_NS          1000U   /* and up to as much again */
+#define SPIN_NS                 250U    /* between retries on HAL_BUSY */
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t count;               /* messages from the main loop */
+  uint32_t gap_bytes;           /* up to this long between them */
+  uint32_t nest;                /* in 1/256: an interrupt lands inside the write */
+  uint32_t isr_bytes;           /* interrupt writers about this often, 0 none */
+} run_t;
+
+typedef struct
+{
+  const char *name;
+  uint32_t len;                 /* message, header included */
+  uint32_t count;
+  uint32_t load;                /* offered, in % of the line; 0 back to back */
+} bench_t;
+
+typedef enum
+{
+  MSG_FREE = 0U,
+  MSG_ACCEPTED,
+  MSG_REFUSED,
+  MSG_SENT
+} msg_state_t;
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t seed = 0x13579BDFU;
+static UART_HandleTypeDef huart;
+static DMA_HandleTypeDef hdma;
+static uart_tx_t tx;
+/* The DMA takes these as 32-bit addresses: static, and the test links
+   -no-pie. The benchmark hands msg_buf to HAL_UART_Transmit_DMA(). */
+static uint8_t ring[RING_SIZE];
+static uint8_t msg_buf[MSG_MAX][MSG_LEN_MAX];
+
+/* Simulated time in ns */
+static uint64_t now_ns;
+static uint64_t byte_ns;
+static uint64_t isr_t;          /* next interrupt writer */
+static uint32_t isr_bytes;
+static uint32_t nest;           /* in 1/256, see run_t */
+
+/* USART1 transmitter */
+static host_mmio_t usart_m;
+static volatile struct
+{
+  uint8_t fifo[FIFO_SIZE];
+  uint32_t rd;
+  uint32_t count;
+  uint32_t shifting;
+  uint8_t shift;                /* the frame on the line */
+  uint64_t shift_t;             /* its stop bit ends */
+  uint32_t tc;
+  uint64_t irq_t;
+  uint32_t overrun;             /* TDR written with the FIFO full */
+  uint32_t masked;              /* TDR written with interrupts masked */
+} usart;
+
+/* DMA1 stream 0 */
+static host_mmio_t dma_m;
+static volatile struct
+{
+  uint32_t isr;
+  uint32_t enabled;
+  uint32_t ndtr;
+  uint32_t pos;
+  uint32_t pumping;
+  uint64_t irq_t;
+  uint32_t masked;              /* enabled with interrupts masked */
+} dma;
+
+/* Messages and what the line carried */
+static struct
+{
+  uint8_t state[MSG_MAX];
+  uint64_t t_write[MSG_MAX];
+  uint32_t next_id;
+  uint32_t accepted;
+  uint32_t refused;
+  uint32_t sent;
+  uint32_t isr_sent;
+  uint32_t bytes;               /* accepted */
+  uint32_t corrupt;
+  uint32_t order;               /* sent before an earlier one of its context */
+  uint32_t nested;              /* interrupt writes that landed inside a write */
+  uint64_t lat_sum;
+  uint64_t lat_max;
+  uint64_t blocked;             /* main loop retrying */
+} msgs;
+
+static struct
+{
+  uint8_t hdr[MSG_HDR];
+  uint32_t n;                   /* bytes of the message so far */
+  uint32_t id;
+  uint32_t len;
+  int32_t last[2];              /* last id sent, per context */
+  uint64_t last_t;
+  uint32_t bytes;
+} line;
+
+/* Private functions ---------------------------------------------------------*/
+static uint32_t rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static uint8_t payload(uint32_t id, uint32_t k)
+{
+  return (uint8_t)((id * 31U) + (k * 7U) + 1U);
+}
+
+static uint64_t irq_latency(void)
+{
+  return IRQ_LATENCY_NS + (rnd() % IRQ_LATENCY_NS);
+}
+
+/* A frame leaves the shifter */
+static void line_byte(uint8_t b)
+{
+  uint32_t ctx;
+  uint64_t lat;
+
+  line.bytes++;
+  line.last_t = now_ns;
+  if(line.n < MSG_HDR)
+  {
+    line.hdr[line.n++] = b;
+    if(line.n == MSG_HDR)
+    {
+      line.id = (uint32_t)line.hdr[1] | ((uint32_t)line.hdr[2] << 8);
+      line.len = MSG_HDR + line.hdr[3];
+      if(((line.hdr[0] != MSG_THREAD) && (line.hdr[0] != MSG_ISR)) ||
+         (line.id >= msgs.next_id) || (msgs.state[line.id] != MSG_ACCEPTED))
+      {
+        /* Not a message waiting to go: nothing after it can be trusted */
+        msgs.corrupt++;
+        line.n = 0U;
+        return;
+      }
+    }
+  }
+  else
+  {
+    msgs.corrupt += (b != payload(line.id, line.n - MSG_HDR)) ? 1U : 0U;
+    line.n++;
+  }
+  if((line.n < MSG_HDR) || (line.n < line.len))
+  {
+    return;
+  }
+
+  ctx = (line.hdr[0] == MSG_ISR) ? 1U : 0U;
+  msgs.order += ((int32_t)line.id <= line.last[ctx]) ? 1U : 0U;
+  line.last[ctx] = (int32_t)line.id;
+  msgs.state[line.id] = MSG_SENT;
+  msgs.sent++;
+  msgs.isr_sent += ctx;
+  lat = now_ns - msgs.t_write[line.id];
+  msgs.lat_sum += lat;
+  msgs.lat_max = (lat > msgs.lat_max) ? lat : msgs.lat_max;
+  line.n = 0U;
+}
+
+/* USART1 --------------------------------------------------------------------*/
+static void writer_isr_fn(void);
+
+/* An interrupt writer lands at the driver's next register access */
+static void nest_maybe(void)
+{
+  if((rnd() % 256U) < nest)
+  {
+    host_irq_raise(writer_isr_fn);
+  }
+}
+
+static uint32_t usart_reg(uint32_t offset)
+{
+  return host_mmio_get(&usart_m, offset);
+}
+
+static uint32_t usart_cap(void)
+{
+  return ((usart_reg(offsetof(USART_TypeDef, CR1)) & USART_CR1_FIFOEN) != 0U) ? FIFO_SIZE : 1U;
+}
+
+static void usart_isr_fn(void)
+{
+  HAL_UART_IRQHandler(&huart);
+}
+
+static void usart_irq_update(void)
+{
+  if((usart.tc != 0U) && ((usart_reg(offsetof(USART_TypeDef, CR1)) & USART_CR1_TCIE) != 0U) &&
+     (usart.irq_t == NEVER))
+  {
+    usart.irq_t = now_ns + irq_latency();
+  }
+}
+
+static void dma_pump(void);
+
+/* The shifter takes the next frame from the FIFO, or the line goes idle */
+static void usart_shift_next(void)
+{
+  if(usart.count == 0U)
+  {
+    usart.shifting = 0U;
+    usart.shift_t = NEVER;
+    usart.tc = 1U;
+    usart_irq_update();
+    return;
+  }
+  usart.shift = usart.fifo[usart.rd];
+  usart.rd = (usart.rd + 1U) % FIFO_SIZE;
+  usart.count--;
+  usart.shifting = 1U;
+  usart.shift_t = now_ns + byte_ns;
+  dma_pump();
+}
+
+static void usart_push(uint8_t b)
+{
+  if(usart.count == usart_cap())
+  {
+    usart.overrun++;
+    return;
+  }
+  usart.fifo[(usart.rd + usart.count) % FIFO_SIZE] = b;
+  usart.count++;
+  usart.tc = 0U;
+  if(usart.shifting == 0U)
+  {
+    usart_shift_next();
+  }
+}
+
+static uint32_t usart_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  uint32_t cr1;
+  uint32_t isr = 0U;
+
+  (void)m;
+  if(offset != offsetof(USART_TypeDef, ISR))
+  {
+    return current;
+  }
+  cr1 = usart_reg(offsetof(USART_TypeDef, CR1));
+  isr |= ((cr1 & USART_CR1_TE) != 0U) ? USART_ISR_TEACK : 0U;
+  isr |= ((cr1 & USART_CR1_RE) != 0U) ? USART_ISR_REACK : 0U;
+  isr |= (usart.count < usart_cap()) ? USART_ISR_TXE_TXFNF : 0U;
+  isr |= (usart.count == 0U) ? USART_ISR_TXFE : 0U;
+  isr |= (usart.tc != 0U) ? USART_ISR_TC : 0U;
+  return isr;
+}
+
+static void usart_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  (void)m;
+  (void)size;
+  if(offset == offsetof(USART_TypeDef, TDR))
+  {
+    usart.masked += (host_get_primask() != 0U) ? 1U : 0U;
+    usart_push((uint8_t)value);
+    nest_maybe();
+  }
+  else if(offset == offsetof(USART_TypeDef, ICR))
+  {
+    if((value & USART_ICR_TCCF) != 0U)
+    {
+      usart.tc = 0U;
+    }
+  }
+  else if(offset == offsetof(USART_TypeDef, CR1))
+  {
+    usart_irq_update();
+  }
+  else if(offset == offsetof(USART_TypeDef, CR3))
+  {
+    dma_pump();
+  }
+}
+
+/* DMA1 stream 0 -------------------------------------------------------------*/
+static uint32_t dma_reg(uint32_t offset)
+{
+  return host_mmio_get(&dma_m, offset);
+}
+
+static void dma_isr_fn(void)
+{
+  HAL_DMA_IRQHandler(&hdma);
+}
+
+/* The stream keeps the FIFO full while the USART requests; the DMA is
+   much faster than the line */
+static void dma_pump(void)
+{
+  const uint8_t *src;
+  uint8_t b;
+
+  if(dma.pumping != 0U)
+  {
+    return;
+  }
+  dma.pumping = 1U;
+  while((dma.enabled != 0U) && (usart.count < usart_cap()) &&
+        ((usart_reg(offsetof(USART_TypeDef, CR3)) & USART_CR3_DMAT) != 0U))
+  {
+    src = (const uint8_t *)(uintptr_t)dma_reg(STREAM_REG(M0AR));
+    b = src[dma.pos++];
+    dma.ndtr--;
+    usart_push(b);
+    if(dma.ndtr == 0U)
+    {
+      /* Normal mode: the stream disables itself */
+      dma.enabled = 0U;
+      host_mmio_set(&dma_m, STREAM_REG(CR), dma_reg(STREAM_REG(CR)) & ~DMA_SxCR_EN);
+      host_mmio_set(&dma_m, STREAM_REG(NDTR), 0U);
+      dma.isr |= DMA_S0_TC;
+      if(((dma_reg(STREAM_REG(CR)) & DMA_SxCR_TCIE) != 0U) && (dma.irq_t == NEVER))
+      {
+        dma.irq_t = now_ns + irq_latency();
+      }
+    }
+  }
+  dma.pumping = 0U;
+}
+
+static uint32_t dma_read(host_mmio_t *m, uint32_t offset, uint32_t current)
+{
+  (void)m;
+  if(offset == DMA_REG(LISR))
+  {
+    return dma.isr;
+  }
+  if(offset == DMA_REG(HISR))
+  {
+    return 0U;
+  }
+  if((offset == STREAM_REG(NDTR)) && (dma.enabled != 0U))
+  {
+    return dma.ndtr;
+  }
+  return current;
+}
+
+static void dma_write(host_mmio_t *m, uint32_t offset, uint32_t value, uint32_t size)
+{
+  (void)m;
+  (void)size;
+  if(offset == DMA_REG(LIFCR))
+  {
+    dma.isr &= ~(value & 0x3DU);
+  }
+  else if(offset == STREAM_REG(M0AR))
+  {
+    nest_maybe();
+  }
+  else if(offset == STREAM_REG(CR))
+  {
+    if(((value & DMA_SxCR_EN) != 0U) && (dma.enabled == 0U))
+    {
+      dma.masked += (host_get_primask() != 0U) ? 1U : 0U;
+      dma.enabled = 1U;
+      dma.ndtr = dma_reg(STREAM_REG(NDTR));
+      dma.pos = 0U;
+      dma_pump();
+    }
+    else if(((value & DMA_SxCR_EN) == 0U) && (dma.enabled != 0U))
+    {
+      /* Aborted */
+      dma.enabled = 0U;
+      host_mmio_set(&dma_m, STREAM_REG(NDTR), dma.ndtr);
+    }
+  }
+}
+
+/* Writers -------------------------------------------------------------------*/
+/* A message of len bytes with the next id, into msg_buf */
+static uint32_t msg_make(uint8_t ctx, uint32_t len)
+{
+  uint32_t id = msgs.next_id++;
+  uint8_t *buf = msg_buf[id];
+  uint32_t k;
+
+  buf[0] = ctx;
+  buf[1] = (uint8_t)id;
+  buf[2] = (uint8_t)(id >> 8);
+  buf[3] = (uint8_t)(len - MSG_HDR);
+  for(k = 0U; k < len - MSG_HDR; k++)
+  {
+    buf[MSG_HDR + k] = payload(id, k);
+  }
+  msgs.t_write[id] = now_ns;
+  return id;
+}
+
+static void msg_result(uint32_t id, uint32_t len, HAL_StatusTypeDef status)
+{
+  if(status == HAL_OK)
+  {
+    msgs.state[id] = MSG_ACCEPTED;
+    msgs.accepted++;
+    msgs.bytes += len;
+  }
+  else
+  {
+    msgs.state[id] = MSG_REFUSED;
+    msgs.refused++;
+  }
+}
+
+/* The message in up to three segments, some of them empty */
+static HAL_StatusTypeDef msg_writev(uint32_t id, uint32_t len)
+{
+  uart_tx_seg_t seg[3];
+  uint32_t a = rnd() % (len + 1U);
+  uint32_t b = a + (rnd() % (len - a + 1U));
+
+  seg[0].data = msg_buf[id];
+  seg[0].len = a;
+  seg[1].data = &msg_buf[id][a];
+  seg[1].len = b - a;
+  seg[2].data = &msg_buf[id][b];
+  seg[2].len = len - b;
+  return uart_tx_writev(&tx, seg, 3U);
+}
+
+/* Short enough for the FIFO now and then */
+static uint32_t msg_len(uint32_t max)
+{
+  if((rnd() & 3U) == 0U)
+  {
+    return MSG_HDR + (rnd() % (UART_TX_PIO_MAX - MSG_HDR + 1U));
+  }
+  return MSG_HDR + (rnd() % (max - MSG_HDR + 1U));
+}
+
+/* An interrupt handler logging a message; refused, it is dropped */
+static void writer_isr_fn(void)
+{
+  uint32_t len = msg_len(MSG_HDR + 40U);
+  uint32_t id;
+
+  if(msgs.next_id == MSG_MAX)
+  {
+    return;
+  }
+  msgs.nested += (tx.writers != 0U) ? 1U : 0U;
+  id = msg_make(MSG_ISR, len);
+  msg_result(id, len, msg_writev(id, len));
+}
+
+/* Simulated time runs to t, the interrupts land as things happen */
+static void advance(uint64_t t)
+{
+  uint64_t next;
+
+  for(;;)
+  {
+    next = usart.shift_t;
+    next = (dma.irq_t < next) ? dma.irq_t : next;
+    next = (usart.irq_t < next) ? usart.irq_t : next;
+    next = (isr_t < next) ? isr_t : next;
+    if(next > t)
+    {
+      break;
+    }
+    now_ns = next;
+    if(next == usart.shift_t)
+    {
+      line_byte(usart.shift);
+      usart_shift_next();
+    }
+    else if(next == dma.irq_t)
+    {
+      dma.irq_t = NEVER;
+      host_irq_raise(dma_isr_fn);
+    }
+    else if(next == usart.irq_t)
+    {
+      usart.irq_t = NEVER;
+      host_irq_raise(usart_isr_fn);
+    }
+    else
+    {
+      isr_t = now_ns + byte_ns + (rnd() % (2U * isr_bytes * byte_ns));
+      host_irq_raise(writer_isr_fn);
+    }
+    host_irq_poll();
+  }
+  now_ns = t;
+}
+
+/* Time moves while the driver waits */
+uint32_t HAL_GetTick(void)
+{
+  advance(now_ns + 10000U);
+  return (uint32_t)(now_ns / 1000000U);
+}
+
+/* Runs ----------------------------------------------------------------------*/
+static void run_reset(void)
+{
+  memset(&msgs, 0, sizeof(msgs));
+  memset(&line, 0, sizeof(line));
+  line.last[0] = -1;
+  line.last[1] = -1;
+  isr_t = NEVER;
+}
+
+static uint32_t accesses(void)
+{
+  return usart_m.reads + usart_m.writes + dma_m.reads + dma_m.writes;
+}
+
+/* What every run ends with, whoever sent */
+static void run_check(void)
+{
+  uint32_t left = 0U;
+  uint32_t id;
+
+  for(id = 0U; id < msgs.next_id; id++)
+  {
+    left += (msgs.state[id] == MSG_ACCEPTED) ? 1U : 0U;
+  }
+  HOST_CHECK_EQ(msgs.corrupt, 0U);
+  HOST_CHECK_EQ(msgs.order, 0U);
+  HOST_CHECK_EQ(left, 0U);
+  HOST_CHECK_EQ(msgs.sent, msgs.accepted);
+  HOST_CHECK_EQ(line.bytes, msgs.bytes);
+  HOST_CHECK_EQ(line.n, 0U);
+  HOST_CHECK_EQ(usart.overrun, 0U);
+  HOST_CHECK_EQ(usart.masked, 0U);
+  HOST_CHECK_EQ(dma.masked, 0U);
+}
+
+static void run_mixed(const char *name, const run_t *run)
+{
+  HAL_StatusTypeDef status;
+  uint32_t retries = 0U;
+  uint32_t len;
+  uint32_t id;
+  uint32_t i;
+  uint64_t t0;
+
+  run_reset();
+  nest = run->nest;
+  isr_bytes = run->isr_bytes;
+  isr_t = (isr_bytes != 0U) ? (now_ns + (isr_bytes * byte_ns)) : NEVER;
+  HOST_CHECK_EQ(uart_tx_start(&tx), HAL_OK);
+  for(i = 0U; (i < run->count) && (msgs.next_id < MSG_MAX - 64U); i++)
+  {
+    len = msg_len(MSG_LEN_MAX);
+    id = msg_make(MSG_THREAD, len);
+    t0 = now_ns;
+    if((rnd() % 256U) < run->nest)
+    {
+      host_irq_raise(writer_isr_fn);
+    }
+    for(;;)
+    {
+      status = msg_writev(id, len);
+      if(status == HAL_OK)
+      {
+        break;
+      }
+      retries++;
+      advance(now_ns + SPIN_NS);
+    }
+    msgs.blocked += now_ns - t0;
+    msg_result(id, len, status);
+    advance(now_ns + (rnd() % ((run->gap_bytes * byte_ns) + 1U)));
+  }
+  isr_t = NEVER;
+  nest = 0U;
+  HOST_CHECK_EQ(uart_tx_flush(&tx, 100U), HAL_OK);
+
+  printf("  %-18s %4u messages, %3u from interrupts (%u inside a write), %u refused, "
+         "%u bursts, %u by the FIFO\n", name, (unsigned)msgs.accepted, (unsigned)msgs.isr_sent,
+         (unsigned)msgs.nested, (unsigned)msgs.refused, (unsigned)tx.stats.bursts,
+         (unsigned)tx.stats.pio);
+  run_check();
+  HOST_CHECK_EQ(i, run->count);
+  HOST_CHECK_EQ(tx.stats.bytes, msgs.bytes);
+  HOST_CHECK_EQ(tx.stats.dropped, msgs.refused + retries);
+  HOST_CHECK_EQ(tx.tail, tx.head);
+  HOST_CHECK_EQ(tx.reserved, tx.head);
+  HOST_CHECK_EQ(tx.writers, 0U);
+  HOST_CHECK_EQ(tx.burst, 0U);
+  HOST_CHECK_EQ(huart.gState, HAL_UART_STATE_READY);
+  HOST_CHECK(tx.stats.bursts != 0U);
+  if(run->isr_bytes == 0U)
+  {
+    /* The line goes idle between the writes, short ones skip the DMA */
+    HOST_CHECK(tx.stats.pio != 0U);
+  }
+  if(run->nest != 0U)
+  {
+    HOST_CHECK(msgs.nested != 0U);
+  }
+  if(run->isr_bytes != 0U)
+  {
+    HOST_CHECK(msgs.isr_sent != 0U);
+  }
+  uart_tx_stop(&tx);
+}
+
+/* One row of the benchmark through the queue (hal 0) or the HAL. Returns
+   the line use in % */
+static double bench_run(const bench_t *b, uint32_t hal)
+{
+  HAL_StatusTypeDef status;
+  uint32_t regs = accesses();
+  uint32_t id;
+  uint32_t i;
+  uint64_t start;
+  uint64_t t;
+  uint64_t t0;
+  double use;
+
+  run_reset();
+  if(hal == 0U)
+  {
+    HOST_CHECK_EQ(uart_tx_start(&tx), HAL_OK);
+  }
+  start = now_ns;
+  for(i = 0U; i < b->count; i++)
+  {
+    if(b->load != 0U)
+    {
+      t = start + (((uint64_t)i * b->len * byte_ns * 100U) / b->load);
+      if(t > now_ns)
+      {
+        advance(t);
+      }
+    }
+    id = msg_make(MSG_THREAD, b->len);
+    t0 = now_ns;
+    for(;;)
+    {
+      status = (hal != 0U) ? HAL_UART_Transmit_DMA(&huart, msg_buf[id], (uint16_t)b->len) :
+                             uart_tx_write(&tx, msg_buf[id], b->len);
+      if(status != HAL_BUSY)
+      {
+        break;
+      }
+      advance(now_ns + SPIN_NS);
+    }
+    HOST_CHECK_EQ(status, HAL_OK);
+    msgs.blocked += now_ns - t0;
+    msg_result(id, b->len, status);
+  }
+  for(i = 0U; (i < 100000U) && ((msgs.sent < msgs.accepted) || (huart.gState != HAL_UART_STATE_READY)); i++)
+  {
+    advance(now_ns + byte_ns);
+  }
+  regs = accesses() - regs;
+  if(hal == 0U)
+  {
+    uart_tx_stop(&tx);
+  }
+
+  use = (100.0 * (double)line.bytes * (double)byte_ns) / (double)(line.last_t - start);
+  printf("  %-18s %-5s %7.1f%% %8.1f %8.1f %8.1f %6.1f\n", b->name, (hal != 0U) ? "HAL" : "queue", use,
+         (double)msgs.lat_sum / (1000.0 * b->count), (double)msgs.lat_max / 1000.0,
+         (double)msgs.blocked / (1000.0 * b->count), (double)regs / b->count);
+  run_check();
+  return use;
+}
+
+/* Function definitions ------------------------------------------------------*/
+int main(void)
+{
+  /* count, gap, nesting, interrupt writers */
+  static const run_t idle = {300U, 200U, 0U, 0U};
+  static const run_t idle_nested = {200U, 200U, 128U, 0U};
+  static const run_t nested = {400U, 80U, 64U, 96U};
+  static const run_t full = {400U, 0U, 96U, 32U};
+  static const bench_t bench[] =
+  {
+    {"8 B back to back", 8U, 300U, 0U},
+    {"16 B back to back", 16U, 200U, 0U},
+    {"64 B back to back", 64U, 100U, 0U},
+    {"16 B at 50% load", 16U, 200U, 50U},
+    {"8 B at 25% load", 8U, 200U, 25U},
+  };
+  double queue;
+  double hal;
+  uint32_t i;
+
+  usart_m.base = USART1_BASE;
+  usart_m.size = sizeof(USART_TypeDef);
+  usart_m.read = usart_read;
+  usart_m.write = usart_write;
+  host_mmio_attach(&usart_m);
+  dma_m.base = DMA1_BASE;
+  dma_m.size = sizeof(DMA_TypeDef) + sizeof(DMA_Stream_TypeDef);
+  dma_m.read = dma_read;
+  dma_m.write = dma_write;
+  host_mmio_attach(&dma_m);
+  usart.tc = 1U;
+  usart.shift_t = NEVER;
+  usart.irq_t = NEVER;
+  dma.irq_t = NEVER;
+  isr_t = NEVER;
+  byte_ns = (10ULL * 1000000000ULL) / BAUD;
+
+  hdma.Instance = DMA1_Stream0;
+  hdma.Init.Request = DMA_REQUEST_USART1_TX;
+  hdma.Init.Direction = DMA_MEMORY_TO_PERIPH;
+  hdma.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma.Init.MemInc = DMA_MINC_ENABLE;
+  hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+  hdma.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+  hdma.Init.Mode = DMA_NORMAL;
+  hdma.Init.Priority = DMA_PRIORITY_HIGH;
+  hdma.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  HOST_CHECK_EQ(HAL_DMA_Init(&hdma), HAL_OK);
+
+  huart.Instance = USART1;
+  huart.Init.BaudRate = BAUD;
+  huart.Init.WordLength = UART_WORDLENGTH_8B;
+  huart.Init.StopBits = UART_STOPBITS_1;
+  huart.Init.Parity = UART_PARITY_NONE;
+  huart.Init.Mode = UART_MODE_TX_RX;
+  huart.Init.HwFlowCtl = UART_HWCONTROL_NONE;
+  huart.Init.OverSampling = UART_OVERSAMPLING_16;
+  huart.Init.ClockPrescaler = UART_PRESCALER_DIV1;
+  __HAL_LINKDMA(&huart, hdmatx, hdma);
+  HOST_CHECK_EQ(HAL_UART_Init(&huart), HAL_OK);
+  tx.huart = &huart;
+  tx.buf = ring;
+  tx.size = RING_SIZE;
+
+  run_mixed("main loop only", &idle);
+  run_mixed("nested, idle line", &idle_nested);
+  run_mixed("nested writers", &nested);
+  run_mixed("full ring", &full);
+
+  printf("\n  %-18s %-5s %8s %8s %8s %8s %6s\n", "messages", "path", "line use",
+         "avg us", "max us", "wait us", "regs");
+  for(i = 0U; i < (sizeof(bench) / sizeof(bench[0])); i++)
+  {
+    queue = bench_run(&bench[i], 0U);
+    hal = bench_run(&bench[i], 1U);
+    if(bench[i].load == 0U)
+    {
+      /* Back to back, the queue keeps the line busy */
+      HOST_CHECK(queue > 99.0);
+      HOST_CHECK(queue > hal);
+    }
+    else
+    {
+      HOST_CHECK(queue > (bench[i].load - 1.0));
+    }
+  }
+
+  host_mmio_detach(&dma_m);
+  host_mmio_detach(&usart_m);
+  return host_result();
+}
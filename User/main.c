@@ -1,15 +1,14 @@
 #include "main.h"
 #include "stdio.h"
+#include "pin.h"
+
+#define LED_PIN   GPIOD, 0
 
 void Led_config(){
-   RCC->AHB4ENR |= 1<<3;
-   GPIOD->MODER &= ~0x03; 
-   GPIOD->MODER |=0x01;
-   GPIOD->OTYPER|= 0x00; 
-   GPIOD->PUPDR |= 0x01;
-   GPIOD->OSPEEDR |= 0x03;
-  
-   GPIOD->ODR ^= 0x01;
+   PIN_CLOCK_ENABLE(LED_PIN);
+   PIN_CONFIG(LED_PIN, PIN_MODE_OUTPUT, PIN_OTYPE_PP, PIN_SPEED_VHIGH, PIN_PULL_UP, 0U);
+
+   PIN_TOGGLE(LED_PIN);
 }
 
 